@@ -0,0 +1,31 @@
+# all.tcl --
+#
+# This file runs all benchmarks contained in this directory. Each
+# benchmark is run in a separate process since SNMP sessions, sockets
+# and the request table are shared by all interpreters of a process
+# and would otherwise leak from one benchmark into the next one.
+#
+# See the file "license.terms" for information on usage and redistribution
+# of this file, and for a DISCLAIMER OF ALL WARRANTIES.
+
+set dir [file dirname [file normalize [info script]]]
+
+foreach file [lsort [glob -directory $dir *.bench]] {
+    puts "[file tail $file]:"
+    set code [catch {exec [info nameofexecutable] $file {*}$argv 2>@1} msg opts]
+    if {$code && [lindex [dict get $opts -errorcode] 0] ni {CHILDSTATUS CHILDKILLED}} {
+	puts "    failed: $msg"
+	continue
+    }
+    if {$msg ne ""} {
+	puts $msg
+    }
+    if {$code} {
+	lassign [dict get $opts -errorcode] reason pid status
+	if {$reason eq "CHILDKILLED"} {
+	    puts "    failed: killed by $status"
+	} else {
+	    puts "    failed: exit status $status"
+	}
+    }
+}
@@ -0,0 +1,57 @@
+# bench.tcl --
+#
+# This file contains utility procedures shared by all benchmarks.
+# It is sourced by the *.bench files.
+#
+# See the file "license.terms" for information on usage and redistribution
+# of this file, and for a DISCLAIMER OF ALL WARRANTIES.
+
+package require Tnm 3.0
+namespace import -force Tnm::*
+
+namespace eval ::bench {
+    variable scale 1.0
+    if {[info exists ::env(TNM_BENCH_SCALE)]} {
+	set scale $::env(TNM_BENCH_SCALE)
+    }
+}
+
+# bench::size --
+#
+#	Scale a problem size by the factor given in TNM_BENCH_SCALE.
+
+proc bench::size {n} {
+    variable scale
+    return [expr {max(1, int($n * $scale))}]
+}
+
+# bench::measure --
+#
+#	Evaluate a script in the caller's context and return the elapsed
+#	wall clock time in microseconds.
+
+proc bench::measure {script} {
+    set t [clock microseconds]
+    uplevel 1 $script
+    return [expr {[clock microseconds] - $t}]
+}
+
+# bench::report --
+#
+#	Print a measurement as the total time and the time per operation.
+
+proc bench::report {label count usec} {
+    puts [format "    %-40s %8d ops %10.3f ms %8.2f us/op" \
+	      $label $count [expr {$usec / 1000.0}] \
+	      [expr {double($usec) / $count}]]
+}
+
+# bench::rate --
+#
+#	Print a measurement as the number of operations per second.
+
+proc bench::rate {label count usec} {
+    puts [format "    %-40s %8d ops %10.3f ms %8.0f ops/s" \
+	      $label $count [expr {$usec / 1000.0}] \
+	      [expr {$count * 1e6 / max(1, $usec)}]]
+}
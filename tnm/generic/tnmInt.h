@@ -49,6 +49,19 @@ typedef size_t socklen_t;
 
 #define ckstrdup(s)	strcpy(ckalloc(strlen(s)+1), s)
 
+/*
+ *----------------------------------------------------------------
+ * The following macros convert between integers and pointers,
+ * e.g. to use integers as keys of TCL_ONE_WORD_KEYS hash tables.
+ * They are the same as the ones used in the Tcl core.
+ *----------------------------------------------------------------
+ */
+
+#if !defined(INT2PTR) && !defined(PTR2INT)
+#define INT2PTR(p)	((void *) (size_t) (p))
+#define PTR2INT(p)	((int) (size_t) (p))
+#endif
+
 /*
  *----------------------------------------------------------------
  * The following functions are not officially exported by Tcl. 
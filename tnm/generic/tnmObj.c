@@ -350,7 +350,7 @@ SetUnsigned64FromAny(interp, objPtr)
     Tcl_Obj *objPtr;		/* The object to convert. */
 {
     const Tcl_ObjType *oldTypePtr = objPtr->typePtr;
-    char *string, *p;
+    char *string, *p, *end;
     TnmUnsigned64 u;
 
     /*
@@ -372,8 +372,9 @@ SetUnsigned64FromAny(interp, objPtr)
 	goto badUnsigned64;
     }
     
-    /* XXX use strtoull() where available! */
-    if (sscanf(p, "%llu", &u) != 1) {
+    errno = 0;
+    u = strtoull(p, &end, 10);
+    if (end == p) {
     badUnsigned64:
 	if (interp != NULL) {
 	    /*
@@ -388,6 +389,26 @@ SetUnsigned64FromAny(interp, objPtr)
 	}
 	return TCL_ERROR;
     }
+    if (errno == ERANGE) {
+	if (interp != NULL) {
+	    char *s = "unsigned value too large to represent";
+	    Tcl_ResetResult(interp);
+	    Tcl_AppendToObj(Tcl_GetObjResult(interp), s, -1);
+	    Tcl_SetErrorCode(interp, "ARITH", "IOVERFLOW", s, (char *) NULL);
+	}
+	return TCL_ERROR;
+    }
+    
+    /*
+     * Make sure that the string has no garbage after the end of the int.
+     */
+    
+    while (*end && isspace(*end)) {
+	end++;
+    }
+    if (*end) {
+	goto badUnsigned64;
+    }
 
     /*
      * Free the old internalRep before setting the new one. We do this as
@@ -0,0 +1,304 @@
+/*
+ * tnmAES.c --
+ *
+ *	This file contains an implementation of the AES-128 block
+ *	cipher as defined in FIPS 197 and of the CFB128 mode of
+ *	operation. It is used by the AES privacy protocol of the user
+ *	based security model (RFC 3826). CFB mode only needs the
+ *	forward cipher, so there are no tables for the inverse cipher.
+ *	The S-box and the round tables are computed the first time a
+ *	key is set.
+ *
+ * See the file "license.terms" for information on usage and redistribution
+ * of this file, and for a DISCLAIMER OF ALL WARRANTIES.
+ */
+
+#include "tnmInt.h"
+#include "tnmAES.h"
+
+#define ROR32(x,n)	((((x) >> (n)) | ((x) << (32 - (n)))) & 0xffffffff)
+
+#define GET32(p)	(((unsigned int) (p)[0] << 24) | ((p)[1] << 16) \
+			 | ((p)[2] << 8) | (p)[3])
+#define PUT32(p,v)	((p)[0] = (unsigned char) ((v) >> 24), \
+			 (p)[1] = (unsigned char) ((v) >> 16), \
+			 (p)[2] = (unsigned char) ((v) >> 8), \
+			 (p)[3] = (unsigned char) (v))
+
+/*
+ * The S-box and the round tables which combine SubBytes, ShiftRows
+ * and MixColumns. The tables are computed by InitTables().
+ */
+
+static unsigned char sBox[256];
+static unsigned int te0[256], te1[256], te2[256], te3[256];
+static int initialized = 0;
+
+TCL_DECLARE_MUTEX(aesMutex)
+
+/*
+ * Forward declarations for procedures defined later in this file:
+ */
+
+static unsigned char
+Times2		(unsigned char x);
+
+static void
+InitTables	(void);
+
+static void
+EncryptBlock	(TnmAES_CTX *ctx, unsigned char *in,
+			     unsigned char *out);
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * Times2 --
+ *
+ *	This procedure multiplies an element of GF(2^8) by x.
+ *
+ * Results:
+ *	The product.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static unsigned char
+Times2(unsigned char x)
+{
+    return (unsigned char) ((x << 1) ^ ((x & 0x80) ? 0x1b : 0));
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * InitTables --
+ *
+ *	This procedure computes the S-box from the multiplicative
+ *	inverse in GF(2^8) followed by the affine transformation
+ *	(FIPS 197 section 5.1.1) and the round tables derived from
+ *	the S-box.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	The tables are initialized.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+InitTables(void)
+{
+    unsigned char p = 1, q = 1, s, s2;
+    unsigned int t;
+    int i;
+
+    Tcl_MutexLock(&aesMutex);
+    if (! initialized) {
+
+	/*
+	 * Walk through the multiplicative group with the generator 3
+	 * (p) while q runs through the inverses (multiplication by
+	 * the inverse of 3).
+	 */
+
+	do {
+	    p = p ^ Times2(p);
+	    q ^= q << 1;
+	    q ^= q << 2;
+	    q ^= q << 4;
+	    if (q & 0x80) {
+		q ^= 0x09;
+	    }
+	    s = q ^ ((q << 1) | (q >> 7)) ^ ((q << 2) | (q >> 6))
+		^ ((q << 3) | (q >> 5)) ^ ((q << 4) | (q >> 4));
+	    sBox[p] = s ^ 0x63;
+	} while (p != 1);
+	sBox[0] = 0x63;
+
+	for (i = 0; i < 256; i++) {
+	    s = sBox[i];
+	    s2 = Times2(s);
+	    t = ((unsigned int) s2 << 24) | ((unsigned int) s << 16)
+		| ((unsigned int) s << 8) | (unsigned int) (s2 ^ s);
+	    te0[i] = t;
+	    te1[i] = ROR32(t, 8);
+	    te2[i] = ROR32(t, 16);
+	    te3[i] = ROR32(t, 24);
+	}
+	initialized = 1;
+    }
+    Tcl_MutexUnlock(&aesMutex);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * EncryptBlock --
+ *
+ *	This procedure encrypts a single 16 byte block.
+ *
+ * Results:
+ *	The encrypted block is written to out.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+EncryptBlock(TnmAES_CTX *ctx, unsigned char *in, unsigned char *out)
+{
+    unsigned int s0, s1, s2, s3, t0, t1, t2, t3, *rk = ctx->roundKeys;
+    int round;
+
+    s0 = GET32(in) ^ rk[0];
+    s1 = GET32(in + 4) ^ rk[1];
+    s2 = GET32(in + 8) ^ rk[2];
+    s3 = GET32(in + 12) ^ rk[3];
+
+    for (round = 1; round < 10; round++) {
+	rk += 4;
+	t0 = te0[s0 >> 24] ^ te1[(s1 >> 16) & 0xff]
+	    ^ te2[(s2 >> 8) & 0xff] ^ te3[s3 & 0xff] ^ rk[0];
+	t1 = te0[s1 >> 24] ^ te1[(s2 >> 16) & 0xff]
+	    ^ te2[(s3 >> 8) & 0xff] ^ te3[s0 & 0xff] ^ rk[1];
+	t2 = te0[s2 >> 24] ^ te1[(s3 >> 16) & 0xff]
+	    ^ te2[(s0 >> 8) & 0xff] ^ te3[s1 & 0xff] ^ rk[2];
+	t3 = te0[s3 >> 24] ^ te1[(s0 >> 16) & 0xff]
+	    ^ te2[(s1 >> 8) & 0xff] ^ te3[s2 & 0xff] ^ rk[3];
+	s0 = t0; s1 = t1; s2 = t2; s3 = t3;
+    }
+
+    /*
+     * The last round has no MixColumns step.
+     */
+
+    rk += 4;
+    t0 = ((unsigned int) sBox[s0 >> 24] << 24)
+	^ ((unsigned int) sBox[(s1 >> 16) & 0xff] << 16)
+	^ ((unsigned int) sBox[(s2 >> 8) & 0xff] << 8)
+	^ (unsigned int) sBox[s3 & 0xff] ^ rk[0];
+    t1 = ((unsigned int) sBox[s1 >> 24] << 24)
+	^ ((unsigned int) sBox[(s2 >> 16) & 0xff] << 16)
+	^ ((unsigned int) sBox[(s3 >> 8) & 0xff] << 8)
+	^ (unsigned int) sBox[s0 & 0xff] ^ rk[1];
+    t2 = ((unsigned int) sBox[s2 >> 24] << 24)
+	^ ((unsigned int) sBox[(s3 >> 16) & 0xff] << 16)
+	^ ((unsigned int) sBox[(s0 >> 8) & 0xff] << 8)
+	^ (unsigned int) sBox[s1 & 0xff] ^ rk[2];
+    t3 = ((unsigned int) sBox[s3 >> 24] << 24)
+	^ ((unsigned int) sBox[(s0 >> 16) & 0xff] << 16)
+	^ ((unsigned int) sBox[(s1 >> 8) & 0xff] << 8)
+	^ (unsigned int) sBox[s2 & 0xff] ^ rk[3];
+
+    PUT32(out, t0);
+    PUT32(out + 4, t1);
+    PUT32(out + 8, t2);
+    PUT32(out + 12, t3);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * TnmAESSetKey --
+ *
+ *	This procedure expands an AES-128 key into the round keys
+ *	(FIPS 197 section 5.2).
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	The context is initialized.
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+TnmAESSetKey(TnmAES_CTX *ctx, unsigned char key[TNM_AES_KEYSIZE])
+{
+    unsigned int *rk = ctx->roundKeys, t;
+    unsigned char rcon = 1;
+    int i;
+
+    if (! initialized) {
+	InitTables();
+    }
+
+    for (i = 0; i < 4; i++) {
+	rk[i] = GET32(key + 4 * i);
+    }
+    for (i = 4; i < 44; i++) {
+	t = rk[i - 1];
+	if (i % 4 == 0) {
+	    t = (((unsigned int) sBox[(t >> 16) & 0xff] << 24)
+		 | ((unsigned int) sBox[(t >> 8) & 0xff] << 16)
+		 | ((unsigned int) sBox[t & 0xff] << 8)
+		 | (unsigned int) sBox[t >> 24])
+		^ ((unsigned int) rcon << 24);
+	    rcon = Times2(rcon);
+	}
+	rk[i] = rk[i - 4] ^ t;
+    }
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * TnmAESEncryptCFB, TnmAESDecryptCFB --
+ *
+ *	These procedures encrypt or decrypt data in place in CFB128
+ *	mode. The data does not need to be a multiple of the block
+ *	size.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	The data and the initialization vector are modified.
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+TnmAESEncryptCFB(TnmAES_CTX *ctx, unsigned char iv[TNM_AES_BLOCKSIZE], unsigned char *data, int length)
+{
+    unsigned char stream[TNM_AES_BLOCKSIZE];
+    int i, n;
+
+    while (length > 0) {
+	EncryptBlock(ctx, iv, stream);
+	n = length < TNM_AES_BLOCKSIZE ? length : TNM_AES_BLOCKSIZE;
+	for (i = 0; i < n; i++) {
+	    iv[i] = data[i] ^= stream[i];
+	}
+	data += n;
+	length -= n;
+    }
+}
+
+void
+TnmAESDecryptCFB(TnmAES_CTX *ctx, unsigned char iv[TNM_AES_BLOCKSIZE], unsigned char *data, int length)
+{
+    unsigned char stream[TNM_AES_BLOCKSIZE];
+    int i, n;
+
+    while (length > 0) {
+	EncryptBlock(ctx, iv, stream);
+	n = length < TNM_AES_BLOCKSIZE ? length : TNM_AES_BLOCKSIZE;
+	for (i = 0; i < n; i++) {
+	    iv[i] = data[i];
+	    data[i] ^= stream[i];
+	}
+	data += n;
+	length -= n;
+    }
+}
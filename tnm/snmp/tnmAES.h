@@ -0,0 +1,28 @@
+/*
+ * tnmAES.h --
+ *
+ *	Definitions for the AES-128 block cipher as defined in FIPS 197.
+ *	It is used in CFB128 mode by the AES privacy protocol of the user
+ *	based security model (RFC 3826).
+ *
+ * See the file "license.terms" for information on usage and redistribution
+ * of this file, and for a DISCLAIMER OF ALL WARRANTIES.
+ */
+
+#ifndef _TNMAES
+#define _TNMAES
+
+#define TNM_AES_KEYSIZE		16
+#define TNM_AES_BLOCKSIZE	16
+
+typedef struct TnmAES_CTX {
+    unsigned int roundKeys[44];		/* The expanded AES-128 key. */
+} TnmAES_CTX;
+
+void TnmAESSetKey(TnmAES_CTX *, unsigned char [TNM_AES_KEYSIZE]);
+void TnmAESEncryptCFB(TnmAES_CTX *, unsigned char [TNM_AES_BLOCKSIZE],
+		      unsigned char *, int);
+void TnmAESDecryptCFB(TnmAES_CTX *, unsigned char [TNM_AES_BLOCKSIZE],
+		      unsigned char *, int);
+
+#endif /* _TNMAES */
@@ -208,7 +208,32 @@ TnmBerCreate(u_char *packet, int packetlen)
     TnmBer *ber;
 
     ber = (TnmBer *) ckalloc(sizeof(TnmBer));
-    memset((char *) ber, 0, sizeof(TnmBer));
+    return TnmBerInit(ber, packet, packetlen);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * TnmBerInit --
+ *
+ *	This procedure initializes a BER stream in memory provided
+ *	by the caller, usually on the stack. Streams initialized by
+ *	this procedure must not be passed to TnmBerDelete().
+ *
+ * Results:
+ *	The initialized BER stream.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+TnmBer*
+TnmBerInit(TnmBer *ber, u_char *packet, int packetlen)
+{
+    ber->start = ber->end = ber->current = NULL;
+    ber->error[0] = '\0';
 
     if (packet && packetlen > 0) {
 	ber->start = packet;
@@ -895,7 +920,6 @@ TnmBer*
 TnmBerDecInt(TnmBer *ber, u_char tag, int *value)
 {
     int len = 0;
-    int negative = 0;
     u_char byte;
 
     ber = TnmBerDecByte(ber, &byte);
@@ -908,31 +932,67 @@ TnmBerDecInt(TnmBer *ber, u_char tag, int *value)
 	return NULL;
     }
 
-    /*
-     * Handle invalid integer size.
-     */
-
     ber = TnmBerDecLength(ber, &len);
     if (! ber) {
 	return NULL;
     }
-    
+
+    if (len > ber->end - ber->current) {
+	TnmBerSetError(ber, "BER buffer overflow");
+	return NULL;
+    }
+
+    ber = TnmBerDecIntView(ber, tag, ber->current, len, value);
+    if (! ber) {
+	return NULL;
+    }
+    ber->current += len;
+    return ber;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * TnmBerDecIntView --
+ *
+ *	This procedure decodes the contents octets of an ASN.1 integer
+ *	value. We return an error if an int is not large enough to
+ *	hold the ASN.1 value. The BER stream is only used to report
+ *	errors.
+ *
+ * Results:
+ *	A pointer to the BER byte stream or NULL.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+TnmBer*
+TnmBerDecIntView(TnmBer *ber, u_char tag, u_char *octets, int len, int *value)
+{
+    int negative = 0;
+
+    if (! ber) {
+	return NULL;
+    }
+
+    /*
+     * Handle invalid integer size.
+     */
+
     if (len == 0) {
 	*value = 0;
 	return ber;
     }
-    
+
     /*
      * Check for an overflow for normal 32 bit integer values.
      */
-    
-    ber = TnmBerDecPeek(ber, &byte);
-    if (! ber) {
-	return NULL;
-    }
 
-    if ((byte != 0 && len > sizeof(int))
-	|| (byte == 0 && len-1 > sizeof(int))) {
+    if ((octets[0] != 0 && len > sizeof(int))
+	|| (octets[0] == 0 && len-1 > sizeof(int))) {
 	TnmBerWrongLength(ber, tag, len);
 	return NULL;
     }
@@ -941,7 +1001,7 @@ TnmBerDecInt(TnmBer *ber, u_char tag, int *value)
      * Check if it is a negative value and decode data.
      */
 
-    if ((tag == ASN1_INTEGER) && (byte & 0x80)) {
+    if ((tag == ASN1_INTEGER) && (octets[0] & 0x80)) {
 	*value = -1;
 	negative = 1;
     } else {
@@ -950,11 +1010,7 @@ TnmBerDecInt(TnmBer *ber, u_char tag, int *value)
     }
 
     while (len-- > 0) {
-	ber = TnmBerDecByte(ber, &byte);
-	if (! ber) {
-	    return NULL;
-	}
-	*value = (*value << 8) | (byte & 0xff);
+	*value = (*value << 8) | (*octets++ & 0xff);
     }
 
     /*
@@ -977,9 +1033,9 @@ TnmBerDecInt(TnmBer *ber, u_char tag, int *value)
  * TnmBerEncUnsigned64 --
  *
  *	This procedure encodes an ASN.1 Unsigned64 value by using the
- *	primitive, definite length encoding method. Note, on 64 bit
- *	machines, TnmBerEncInt() should be used as it yields accurate
- *	results.
+ *	primitive, definite length encoding method. A leading zero
+ *	octet is added if the most significant bit is set so that
+ *	the value is not mistaken for a negative integer.
  *
  * Results:
  *	A pointer to the BER byte stream or NULL.
@@ -991,11 +1047,10 @@ TnmBerDecInt(TnmBer *ber, u_char tag, int *value)
  */
 
 TnmBer*
-TnmBerEncUnsigned64(TnmBer *ber, double value)
+TnmBerEncUnsigned64(TnmBer *ber, TnmUnsigned64 value)
 {
-    int i, len = 0;
+    int i, len = 1;
     u_char *length;
-    double d;
 
     ber = TnmBerEncByte(ber, ASN1_COUNTER64);
     if (! ber) {
@@ -1013,8 +1068,11 @@ TnmBerEncUnsigned64(TnmBer *ber, double value)
      * integer.
      */
 
-    for (d = value; d >= 1; len++) {
-	d /= 256.0;
+    while (len < 8 && (value >> (8 * len)) != 0) {
+	len++;
+    }
+    if ((value >> (8 * len - 1)) & 1) {
+	len++;
     }
 
     /*
@@ -1022,15 +1080,14 @@ TnmBerEncUnsigned64(TnmBer *ber, double value)
      * to the high byte.
      */
 
-    if (len > 65535 || ber->current + len > ber->end) {
+    if (ber->current + len > ber->end) {
 	TnmBerSetError(ber, "BER buffer size exceeded");
 	return NULL;
     }
 
     for (i = len - 1; i >= 0; i--) {
-	d = value / 256.0;
-	ber->current[i] = (int) (value - floor(d) * 256);
-	value = d;
+	ber->current[i] = (u_char) (value & 0xff);
+	value >>= 8;
     }
     ber->current += len;
     
@@ -1043,9 +1100,7 @@ TnmBerEncUnsigned64(TnmBer *ber, double value)
  *
  * TnmBerDecUnsigned64 --
  *
- *	This procedure decodes an ASN.1 Unsigned64 value. We return 
- *	the result as a double. Use TnmBerDecInt() on 64 bit machines
- *	to get an accurate result.
+ *	This procedure decodes an ASN.1 Unsigned64 value.
  *
  * Results:
  *	A pointer to the BER byte stream or NULL.
@@ -1077,8 +1132,46 @@ TnmBerDecUnsigned64(TnmBer *ber, TnmUnsigned64 *uPtr)
 	return NULL;
     }
 
+    if (len > ber->end - ber->current) {
+	TnmBerSetError(ber, "BER buffer overflow");
+	return NULL;
+    }
+
+    ber = TnmBerDecUnsigned64View(ber, ber->current, len, uPtr);
+    if (! ber) {
+	return NULL;
+    }
+    ber->current += len;
+    return ber;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * TnmBerDecUnsigned64View --
+ *
+ *	This procedure decodes the contents octets of an ASN.1
+ *	Unsigned64 value. The BER stream is only used to report
+ *	errors.
+ *
+ * Results:
+ *	A pointer to the BER byte stream or NULL.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+TnmBer*
+TnmBerDecUnsigned64View(TnmBer *ber, u_char *octets, int len, TnmUnsigned64 *uPtr)
+{
+    if (! ber) {
+	return NULL;
+    }
+
     /*
-     * Check for an overflow for normal 32 bit integer values.
+     * Check for an overflow for 64 bit integer values.
      */
     
     if (len-1 > 8) {
@@ -1086,11 +1179,9 @@ TnmBerDecUnsigned64(TnmBer *ber, TnmUnsigned64 *uPtr)
 	return NULL;
     }
 
-
     *uPtr = 0;
     while (len-- > 0) {
-	ber = TnmBerDecByte(ber, &byte);
-	*uPtr = *uPtr * 256 + byte;
+	*uPtr = *uPtr * 256 + *octets++;
     }
 
     return ber;
@@ -1252,6 +1343,46 @@ TnmBerDecOID(TnmBer *ber, Tnm_Oid *oid, int *oidLen)
 	return NULL;
     }
 
+    if (len > ber->end - ber->current) {
+	TnmBerSetError(ber, "BER buffer overflow");
+	return NULL;
+    }
+
+    ber = TnmBerDecOIDView(ber, ber->current, len, oid, oidLen);
+    if (! ber) {
+	return NULL;
+    }
+    ber->current += len;
+    return ber;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * TnmBerDecOIDView --
+ *
+ *	This procedure decodes the contents octets of an OBJECT
+ *	IDENTIFIER value. The BER stream is only used to report
+ *	errors.
+ *
+ * Results:
+ *	A pointer to the BER byte stream or NULL.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+TnmBer*
+TnmBerDecOIDView(TnmBer *ber, u_char *octets, int len, Tnm_Oid *oid, int *oidLen)
+{
+    u_char byte;
+
+    if (! ber) {
+	return NULL;
+    }
+
     if (len == 0) {
 	TnmBerWrongValue(ber, ASN1_OBJECT_IDENTIFIER);
 	return NULL;
@@ -1260,18 +1391,16 @@ TnmBerDecOID(TnmBer *ber, Tnm_Oid *oid, int *oidLen)
     *oidLen = 1;
     while (len > 0) {
 	oid[*oidLen] = 0;
-	ber = TnmBerDecByte(ber, &byte);
-	if (! ber) {
-	    return NULL;
-	}
+	byte = *octets++;
 	len--;
 	
 	while (byte > 0x7f) {
-	    oid[*oidLen] = ( oid[*oidLen] << 7 ) + ( byte & 0x7f );
-	    ber = TnmBerDecByte(ber, &byte);
-	    if (! ber) {
+	    if (len == 0) {
+		TnmBerWrongValue(ber, ASN1_OBJECT_IDENTIFIER);
 		return NULL;
 	    }
+	    oid[*oidLen] = ( oid[*oidLen] << 7 ) + ( byte & 0x7f );
+	    byte = *octets++;
 	    len--;
 	}
 	oid[*oidLen] = ( oid[*oidLen] << 7 ) + ( byte );
@@ -1499,3 +1628,149 @@ TnmBerDecAny(TnmBer *ber, char **octets, int *octets_len)
 }
 
 
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * TnmBerVarbindIterInit --
+ *
+ *	This procedure starts the decoding of a VarBindList (RFC 1157,
+ *	RFC 3416). The BER stream must be positioned at the start of
+ *	the VarBindList sequence.
+ *
+ * Results:
+ *	A pointer to the BER byte stream or NULL.
+ *
+ * Side effects:
+ *	The iterator is initialized.
+ *
+ *----------------------------------------------------------------------
+ */
+
+TnmBer*
+TnmBerVarbindIterInit(TnmBerVarbindIter *iter, TnmBer *ber)
+{
+    iter->ber = ber;
+    iter->token = NULL;
+    iter->length = 0;
+    return TnmBerDecSequenceStart(ber, ASN1_SEQUENCE,
+				  &iter->token, &iter->length);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * TnmBerVarbindIterNext --
+ *
+ *	This procedure decodes the next VarBind of a VarBindList. The
+ *	name and the value are returned as views into the BER buffer.
+ *	Nothing is copied and no memory is allocated. The views are
+ *	valid as long as the BER buffer is not modified.
+ *
+ * Results:
+ *	1 if the next VarBind has been decoded, 0 if the end of the
+ *	VarBindList has been reached or -1 if a decoding error
+ *	occured. The error message is left in the BER stream.
+ *
+ * Side effects:
+ *	The BER stream is advanced to the next VarBind.
+ *
+ *----------------------------------------------------------------------
+ */
+
+int
+TnmBerVarbindIterNext(TnmBerVarbindIter *iter, TnmBerVarbind *vb)
+{
+    TnmBer *ber = iter->ber;
+    u_char *end, *token;
+    int len, length;
+    u_char byte;
+
+    if (! ber) {
+	return -1;
+    }
+
+    end = iter->token + iter->length;
+    if (end > ber->end) {
+	end = ber->end;
+    }
+    if (ber->current >= end) {
+	return 0;
+    }
+
+    if (! TnmBerDecSequenceStart(ber, ASN1_SEQUENCE, &token, &length)) {
+	return -1;
+    }
+
+    /*
+     * Locate the name which must be an OBJECT IDENTIFIER.
+     */
+
+    if (! TnmBerDecByte(ber, &byte)) {
+	return -1;
+    }
+    if (byte != ASN1_OBJECT_IDENTIFIER) {
+	TnmBerWrongTag(ber, byte, ASN1_OBJECT_IDENTIFIER);
+	return -1;
+    }
+    if (! TnmBerDecLength(ber, &len)) {
+	return -1;
+    }
+    if (len > ber->end - ber->current) {
+	TnmBerSetError(ber, "BER buffer overflow");
+	return -1;
+    }
+    vb->name = ber->current;
+    vb->nameLength = len;
+    ber->current += len;
+
+    /*
+     * Locate the value. The tag is not checked here since the
+     * caller has to deal with exceptions and unknown tags anyway.
+     */
+
+    vb->encoding = ber->current;
+    if (! TnmBerDecByte(ber, &vb->tag)) {
+	return -1;
+    }
+    if (! TnmBerDecLength(ber, &len)) {
+	return -1;
+    }
+    if (len > 65535 || len > ber->end - ber->current) {
+	TnmBerSetError(ber, "BER buffer size exceeded");
+	return -1;
+    }
+    vb->value = ber->current;
+    vb->valueLength = len;
+    ber->current += len;
+    vb->encodingLength = ber->current - vb->encoding;
+
+    if (! TnmBerDecSequenceEnd(ber, token, length)) {
+	return -1;
+    }
+    return 1;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * TnmBerVarbindIterDone --
+ *
+ *	This procedure finishes the decoding of a VarBindList and
+ *	checks that the whole VarBindList has been consumed.
+ *
+ * Results:
+ *	A pointer to the BER byte stream or NULL.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+TnmBer*
+TnmBerVarbindIterDone(TnmBerVarbindIter *iter)
+{
+    return TnmBerDecSequenceEnd(iter->ber, iter->token, iter->length);
+}
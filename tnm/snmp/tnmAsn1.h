@@ -137,6 +137,9 @@ typedef struct TnmBer {
 EXTERN TnmBer*
 TnmBerCreate		(u_char *packet, int packetlen);
 
+EXTERN TnmBer*
+TnmBerInit		(TnmBer *ber, u_char *packet, int packetlen);
+
 EXTERN void
 TnmBerDelete		(TnmBer *ber);
 
@@ -209,7 +212,7 @@ TnmBerDecInt		(TnmBer *ber, u_char tag,
 				     int *value);
 EXTERN TnmBer*
 TnmBerEncUnsigned64	(TnmBer *ber,
-				     double value);
+				     TnmUnsigned64 value);
 EXTERN TnmBer*
 TnmBerDecUnsigned64	(TnmBer *ber,
 				     TnmUnsigned64 *uPtr);
@@ -234,4 +237,49 @@ TnmBerDecNull		(TnmBer *ber, u_char tag);
 EXTERN TnmBer*
 TnmBerDecAny		(TnmBer *ber, char **octets, int *len);
 
+/*
+ *----------------------------------------------------------------
+ * The varbind iterator walks over a BER encoded VarBindList in
+ * a single pass. It does not copy or allocate anything: every
+ * varbind is returned as a set of views (pointer and length)
+ * into the packet buffer. The contents octets of a view can be
+ * converted with the TnmBerDec*View() functions.
+ *----------------------------------------------------------------
+ */
+
+typedef struct TnmBerVarbind {
+    u_char *name;		/* Contents octets of the name. */
+    int nameLength;		/* Number of contents octets of the name. */
+    u_char tag;			/* The tag of the value. */
+    u_char *value;		/* Contents octets of the value. */
+    int valueLength;		/* Number of contents octets of the value. */
+    u_char *encoding;		/* The complete encoding of the value. */
+    int encodingLength;		/* Length of the encoding of the value. */
+} TnmBerVarbind;
+
+typedef struct TnmBerVarbindIter {
+    TnmBer *ber;		/* The BER stream we are walking over. */
+    u_char *token;		/* Start of the VarBindList contents. */
+    int length;			/* Length of the VarBindList contents. */
+} TnmBerVarbindIter;
+
+EXTERN TnmBer*
+TnmBerVarbindIterInit	(TnmBerVarbindIter *iter, TnmBer *ber);
+
+EXTERN int
+TnmBerVarbindIterNext	(TnmBerVarbindIter *iter, TnmBerVarbind *vb);
+
+EXTERN TnmBer*
+TnmBerVarbindIterDone	(TnmBerVarbindIter *iter);
+
+EXTERN TnmBer*
+TnmBerDecIntView	(TnmBer *ber, u_char tag, u_char *octets,
+				     int len, int *value);
+EXTERN TnmBer*
+TnmBerDecUnsigned64View	(TnmBer *ber, u_char *octets, int len,
+				     TnmUnsigned64 *uPtr);
+EXTERN TnmBer*
+TnmBerDecOIDView	(TnmBer *ber, u_char *octets, int len,
+				     Tnm_Oid *oid, int *oidLen);
+
 #endif /* _TNMASN1 */
@@ -0,0 +1,368 @@
+/*
+ * tnmDES.c --
+ *
+ *	This file contains an implementation of the DES block cipher
+ *	as defined in FIPS 46-3 and of the CBC mode of operation. It
+ *	is used by the DES privacy protocol of the user based security
+ *	model (RFC 3414 section 8). The permutations and the S-boxes
+ *	are expanded into lookup tables the first time a key is set.
+ *
+ * See the file "license.terms" for information on usage and redistribution
+ * of this file, and for a DISCLAIMER OF ALL WARRANTIES.
+ */
+
+#include "tnmInt.h"
+#include "tnmDES.h"
+
+#define ROL32(x,n)	((((x) << (n)) | ((x) >> (32 - (n)))) & 0xffffffff)
+
+/*
+ * The permutations of FIPS 46-3. The tables list the input bit for
+ * every output bit, counting bits from 1 starting with the most
+ * significant bit.
+ */
+
+static const unsigned char ipTable[64] = {
+    58, 50, 42, 34, 26, 18, 10,  2, 60, 52, 44, 36, 28, 20, 12,  4,
+    62, 54, 46, 38, 30, 22, 14,  6, 64, 56, 48, 40, 32, 24, 16,  8,
+    57, 49, 41, 33, 25, 17,  9,  1, 59, 51, 43, 35, 27, 19, 11,  3,
+    61, 53, 45, 37, 29, 21, 13,  5, 63, 55, 47, 39, 31, 23, 15,  7
+};
+
+static const unsigned char pTable[32] = {
+    16,  7, 20, 21, 29, 12, 28, 17,  1, 15, 23, 26,  5, 18, 31, 10,
+     2,  8, 24, 14, 32, 27,  3,  9, 19, 13, 30,  6, 22, 11,  4, 25
+};
+
+static const unsigned char pc1Table[56] = {
+    57, 49, 41, 33, 25, 17,  9,  1, 58, 50, 42, 34, 26, 18,
+    10,  2, 59, 51, 43, 35, 27, 19, 11,  3, 60, 52, 44, 36,
+    63, 55, 47, 39, 31, 23, 15,  7, 62, 54, 46, 38, 30, 22,
+    14,  6, 61, 53, 45, 37, 29, 21, 13,  5, 28, 20, 12,  4
+};
+
+static const unsigned char pc2Table[48] = {
+    14, 17, 11, 24,  1,  5,  3, 28, 15,  6, 21, 10,
+    23, 19, 12,  4, 26,  8, 16,  7, 27, 20, 13,  2,
+    41, 52, 31, 37, 47, 55, 30, 40, 51, 45, 33, 48,
+    44, 49, 39, 56, 34, 53, 46, 42, 50, 36, 29, 32
+};
+
+static const unsigned char shiftTable[16] = {
+    1, 1, 2, 2, 2, 2, 2, 2, 1, 2, 2, 2, 2, 2, 2, 1
+};
+
+static const unsigned char sBoxes[8][64] = {
+    { 14,  4, 13,  1,  2, 15, 11,  8,  3, 10,  6, 12,  5,  9,  0,  7,
+       0, 15,  7,  4, 14,  2, 13,  1, 10,  6, 12, 11,  9,  5,  3,  8,
+       4,  1, 14,  8, 13,  6,  2, 11, 15, 12,  9,  7,  3, 10,  5,  0,
+      15, 12,  8,  2,  4,  9,  1,  7,  5, 11,  3, 14, 10,  0,  6, 13 },
+    { 15,  1,  8, 14,  6, 11,  3,  4,  9,  7,  2, 13, 12,  0,  5, 10,
+       3, 13,  4,  7, 15,  2,  8, 14, 12,  0,  1, 10,  6,  9, 11,  5,
+       0, 14,  7, 11, 10,  4, 13,  1,  5,  8, 12,  6,  9,  3,  2, 15,
+      13,  8, 10,  1,  3, 15,  4,  2, 11,  6,  7, 12,  0,  5, 14,  9 },
+    { 10,  0,  9, 14,  6,  3, 15,  5,  1, 13, 12,  7, 11,  4,  2,  8,
+      13,  7,  0,  9,  3,  4,  6, 10,  2,  8,  5, 14, 12, 11, 15,  1,
+      13,  6,  4,  9,  8, 15,  3,  0, 11,  1,  2, 12,  5, 10, 14,  7,
+       1, 10, 13,  0,  6,  9,  8,  7,  4, 15, 14,  3, 11,  5,  2, 12 },
+    {  7, 13, 14,  3,  0,  6,  9, 10,  1,  2,  8,  5, 11, 12,  4, 15,
+      13,  8, 11,  5,  6, 15,  0,  3,  4,  7,  2, 12,  1, 10, 14,  9,
+      10,  6,  9,  0, 12, 11,  7, 13, 15,  1,  3, 14,  5,  2,  8,  4,
+       3, 15,  0,  6, 10,  1, 13,  8,  9,  4,  5, 11, 12,  7,  2, 14 },
+    {  2, 12,  4,  1,  7, 10, 11,  6,  8,  5,  3, 15, 13,  0, 14,  9,
+      14, 11,  2, 12,  4,  7, 13,  1,  5,  0, 15, 10,  3,  9,  8,  6,
+       4,  2,  1, 11, 10, 13,  7,  8, 15,  9, 12,  5,  6,  3,  0, 14,
+      11,  8, 12,  7,  1, 14,  2, 13,  6, 15,  0,  9, 10,  4,  5,  3 },
+    { 12,  1, 10, 15,  9,  2,  6,  8,  0, 13,  3,  4, 14,  7,  5, 11,
+      10, 15,  4,  2,  7, 12,  9,  5,  6,  1, 13, 14,  0, 11,  3,  8,
+       9, 14, 15,  5,  2,  8, 12,  3,  7,  0,  4, 10,  1, 13, 11,  6,
+       4,  3,  2, 12,  9,  5, 15, 10, 11, 14,  1,  7,  6,  0,  8, 13 },
+    {  4, 11,  2, 14, 15,  0,  8, 13,  3, 12,  9,  7,  5, 10,  6,  1,
+      13,  0, 11,  7,  4,  9,  1, 10, 14,  3,  5, 12,  2, 15,  8,  6,
+       1,  4, 11, 13, 12,  3,  7, 14, 10, 15,  6,  8,  0,  5,  9,  2,
+       6, 11, 13,  8,  1,  4, 10,  7,  9,  5,  0, 15, 14,  2,  3, 12 },
+    { 13,  2,  8,  4,  6, 15, 11,  1, 10,  9,  3, 14,  5,  0, 12,  7,
+       1, 15, 13,  8, 10,  3,  7,  4, 12,  5,  6, 11,  0, 14,  9,  2,
+       7, 11,  4,  1,  9, 12, 14,  2,  0,  6, 10, 13, 15,  3,  5,  8,
+       2,  1, 14,  7,  4, 10,  8, 13, 15, 12,  9,  0,  3,  5,  6, 11 }
+};
+
+/*
+ * The lookup tables computed by InitTables(). The initial and final
+ * permutations are applied one input byte at a time and the S-boxes
+ * are combined with the permutation P which follows them.
+ */
+
+static Tcl_WideUInt ipLookup[8][256];
+static Tcl_WideUInt fpLookup[8][256];
+static unsigned int spLookup[8][64];
+static int initialized = 0;
+
+TCL_DECLARE_MUTEX(desMutex)
+
+/*
+ * Forward declarations for procedures defined later in this file:
+ */
+
+static Tcl_WideUInt
+Permute		(Tcl_WideUInt in, int inBits,
+			     const unsigned char *table, int outBits);
+
+static void
+InitTables	(void);
+
+static Tcl_WideUInt
+ApplyLookup	(Tcl_WideUInt lookup[8][256], Tcl_WideUInt in);
+
+static void
+CryptBlock	(TnmDES_CTX *ctx, unsigned char *block, int decrypt);
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * Permute --
+ *
+ *	This procedure applies a permutation table bit by bit. It
+ *	is only used to set up keys and lookup tables.
+ *
+ * Results:
+ *	The permuted bits.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static Tcl_WideUInt
+Permute(Tcl_WideUInt in, int inBits, const unsigned char *table, int outBits)
+{
+    Tcl_WideUInt out = 0;
+    int i;
+
+    for (i = 0; i < outBits; i++) {
+	out = (out << 1) | ((in >> (inBits - table[i])) & 1);
+    }
+    return out;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * InitTables --
+ *
+ *	This procedure computes the lookup tables once.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	The lookup tables are initialized.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+InitTables(void)
+{
+    unsigned char fpTable[64];
+    int i, j, row, col;
+
+    Tcl_MutexLock(&desMutex);
+    if (! initialized) {
+	for (i = 0; i < 64; i++) {
+	    fpTable[ipTable[i] - 1] = i + 1;
+	}
+	for (i = 0; i < 8; i++) {
+	    for (j = 0; j < 256; j++) {
+		Tcl_WideUInt in = ((Tcl_WideUInt) j) << (56 - 8 * i);
+		ipLookup[i][j] = Permute(in, 64, ipTable, 64);
+		fpLookup[i][j] = Permute(in, 64, fpTable, 64);
+	    }
+	    for (j = 0; j < 64; j++) {
+		row = ((j >> 4) & 2) | (j & 1);
+		col = (j >> 1) & 0x0f;
+		spLookup[i][j] = (unsigned int) Permute(((Tcl_WideUInt)
+			 sBoxes[i][row * 16 + col]) << (28 - 4 * i),
+			 32, pTable, 32);
+	    }
+	}
+	initialized = 1;
+    }
+    Tcl_MutexUnlock(&desMutex);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * ApplyLookup --
+ *
+ *	This procedure applies the initial or the final permutation
+ *	with one of the byte lookup tables.
+ *
+ * Results:
+ *	The permuted block.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static Tcl_WideUInt
+ApplyLookup(Tcl_WideUInt lookup[8][256], Tcl_WideUInt in)
+{
+    return lookup[0][(in >> 56) & 0xff] | lookup[1][(in >> 48) & 0xff]
+	| lookup[2][(in >> 40) & 0xff] | lookup[3][(in >> 32) & 0xff]
+	| lookup[4][(in >> 24) & 0xff] | lookup[5][(in >> 16) & 0xff]
+	| lookup[6][(in >> 8) & 0xff] | lookup[7][in & 0xff];
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * CryptBlock --
+ *
+ *	This procedure encrypts or decrypts a single 8 byte block.
+ *	Decryption uses the round keys in reverse order.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	The block is replaced with the result.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+CryptBlock(TnmDES_CTX *ctx, unsigned char *block, int decrypt)
+{
+    Tcl_WideUInt x = 0;
+    unsigned int l, r, f;
+    unsigned char *k;
+    int i, n;
+
+    for (i = 0; i < 8; i++) {
+	x = (x << 8) | block[i];
+    }
+    x = ApplyLookup(ipLookup, x);
+    l = (unsigned int) (x >> 32);
+    r = (unsigned int) (x & 0xffffffff);
+
+    for (n = 0; n < 16; n++) {
+	k = ctx->subkeys[decrypt ? 15 - n : n];
+	f = 0;
+	for (i = 0; i < 8; i++) {
+	    f |= spLookup[i][(ROL32(r, (4 * i + 5) & 31) & 0x3f) ^ k[i]];
+	}
+	f ^= l;
+	l = r;
+	r = f;
+    }
+
+    x = ApplyLookup(fpLookup, (((Tcl_WideUInt) r) << 32) | l);
+    for (i = 7; i >= 0; i--) {
+	block[i] = (unsigned char) (x & 0xff);
+	x >>= 8;
+    }
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * TnmDESSetKey --
+ *
+ *	This procedure computes the round keys for a DES key. The
+ *	parity bits of the key are ignored.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	The context is initialized.
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+TnmDESSetKey(TnmDES_CTX *ctx, unsigned char key[TNM_DES_KEYSIZE])
+{
+    Tcl_WideUInt k = 0, cd, subkey;
+    unsigned int c, d;
+    int i, n;
+
+    if (! initialized) {
+	InitTables();
+    }
+
+    for (i = 0; i < 8; i++) {
+	k = (k << 8) | key[i];
+    }
+    cd = Permute(k, 64, pc1Table, 56);
+    c = (unsigned int) (cd >> 28) & 0x0fffffff;
+    d = (unsigned int) cd & 0x0fffffff;
+
+    for (n = 0; n < 16; n++) {
+	for (i = 0; i < shiftTable[n]; i++) {
+	    c = ((c << 1) | (c >> 27)) & 0x0fffffff;
+	    d = ((d << 1) | (d >> 27)) & 0x0fffffff;
+	}
+	subkey = Permute((((Tcl_WideUInt) c) << 28) | d, 56, pc2Table, 48);
+	for (i = 0; i < 8; i++) {
+	    ctx->subkeys[n][i] = (unsigned char) ((subkey >> (42 - 6 * i))
+						  & 0x3f);
+	}
+    }
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * TnmDESEncryptCBC, TnmDESDecryptCBC --
+ *
+ *	These procedures encrypt or decrypt data in place in CBC
+ *	mode. Any bytes following the last complete block are left
+ *	untouched.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	The data and the initialization vector are modified.
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+TnmDESEncryptCBC(TnmDES_CTX *ctx, unsigned char iv[TNM_DES_BLOCKSIZE], unsigned char *data, int length)
+{
+    int i;
+
+    for (; length >= TNM_DES_BLOCKSIZE; length -= TNM_DES_BLOCKSIZE) {
+	for (i = 0; i < TNM_DES_BLOCKSIZE; i++) {
+	    data[i] ^= iv[i];
+	}
+	CryptBlock(ctx, data, 0);
+	memcpy(iv, data, TNM_DES_BLOCKSIZE);
+	data += TNM_DES_BLOCKSIZE;
+    }
+}
+
+void
+TnmDESDecryptCBC(TnmDES_CTX *ctx, unsigned char iv[TNM_DES_BLOCKSIZE], unsigned char *data, int length)
+{
+    unsigned char cipher[TNM_DES_BLOCKSIZE];
+    int i;
+
+    for (; length >= TNM_DES_BLOCKSIZE; length -= TNM_DES_BLOCKSIZE) {
+	memcpy(cipher, data, TNM_DES_BLOCKSIZE);
+	CryptBlock(ctx, data, 1);
+	for (i = 0; i < TNM_DES_BLOCKSIZE; i++) {
+	    data[i] ^= iv[i];
+	}
+	memcpy(iv, cipher, TNM_DES_BLOCKSIZE);
+	data += TNM_DES_BLOCKSIZE;
+    }
+}
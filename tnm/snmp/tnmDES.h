@@ -0,0 +1,28 @@
+/*
+ * tnmDES.h --
+ *
+ *	Definitions for the DES block cipher as defined in FIPS 46-3.
+ *	It is used in CBC mode by the DES privacy protocol of the user
+ *	based security model (RFC 3414 section 8).
+ *
+ * See the file "license.terms" for information on usage and redistribution
+ * of this file, and for a DISCLAIMER OF ALL WARRANTIES.
+ */
+
+#ifndef _TNMDES
+#define _TNMDES
+
+#define TNM_DES_KEYSIZE		8
+#define TNM_DES_BLOCKSIZE	8
+
+typedef struct TnmDES_CTX {
+    unsigned char subkeys[16][8];	/* The 6 bit chunks of the round keys. */
+} TnmDES_CTX;
+
+void TnmDESSetKey(TnmDES_CTX *, unsigned char [TNM_DES_KEYSIZE]);
+void TnmDESEncryptCBC(TnmDES_CTX *, unsigned char [TNM_DES_BLOCKSIZE],
+		      unsigned char *, int);
+void TnmDESDecryptCBC(TnmDES_CTX *, unsigned char [TNM_DES_BLOCKSIZE],
+		      unsigned char *, int);
+
+#endif /* _TNMDES */
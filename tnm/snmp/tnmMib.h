@@ -175,6 +175,8 @@ typedef struct TnmMibNode {
     struct TnmMibNode *parentPtr; /* The parent of this node.	            */
     struct TnmMibNode *childPtr;  /* List of child nodes.	            */
     struct TnmMibNode *nextPtr;   /* List of peer nodes.		    */
+    struct TnmMibNode **childTab; /* Children sorted by subid or NULL.  */
+    int numChildren;		/* Number of children in childTab.	    */
 } TnmMibNode;
 
 EXTERN Tcl_Obj *tnmMibModulesLoaded;
@@ -250,6 +252,8 @@ EXTERN TnmMibNode *tnmMibTree;		/* The root of the MIB tree. */
 EXTERN TnmMibType *tnmMibTypeList;	/* List of textual conventions. */
 EXTERN TnmMibType *tnmMibTypeSaveMark;	/* The first already saved */
 					/* element in tnmMibTypeList. */
+EXTERN Tcl_Obj *tnmMibImportList;	/* Modules imported by the current */
+					/* MIB file loaded. */
 
 /*
  *----------------------------------------------------------------
@@ -273,6 +277,9 @@ TnmMibGetString		(char *fileName, int fileOffset);
 EXTERN TnmMibNode*
 TnmMibNodeFromOid	(TnmOid *oidPtr, TnmOid *nodeOidPtr);
 
+EXTERN TnmMibNode*
+TnmMibFindPrefix	(TnmOid *oidPtr, int *lengthPtr);
+
 EXTERN void
 TnmMibNodeToOid		(TnmMibNode *nodePtr, TnmOid *oidPtr);
 
@@ -314,6 +321,40 @@ EXTERN int
 TnmMibUnpack		(Tcl_Interp *interp, TnmOid *oidPtr,
 				     int offset, int implied,
 				     TnmMibNode **indexNodeList);
+
+/*
+ *----------------------------------------------------------------
+ * A bounded cache for the translation of names into object
+ * identifier and back. The kind of a translation is part of the
+ * key. Values longer than TNM_MIB_CACHE_MAX - 1 are not cached.
+ * The cache is flushed whenever the MIB tree changes.
+ *----------------------------------------------------------------
+ */
+
+#define TNM_MIB_CACHE_MAX	(TNM_OID_MAX_SIZE * 8)
+
+#define TNM_MIB_CACHE_OID	'o'	/* Name to object identifier. */
+#define TNM_MIB_CACHE_NAME	'n'	/* Object identifier to name. */
+#define TNM_MIB_CACHE_EXACT	'e'	/* Exact object identifier to name. */
+#define TNM_MIB_CACHE_QNAME	'q'	/* Object identifier to name which */
+					/* is qualified by the module name. */
+
+EXTERN int
+TnmMibCacheGet		(int kind, const char *key, char *buffer);
+
+EXTERN void
+TnmMibCachePut		(int kind, const char *key, const char *value);
+
+EXTERN void
+TnmMibCacheFlush	(void);
+
+EXTERN void
+TnmMibCacheConfig	(int size);
+
+EXTERN void
+TnmMibCacheInfo		(int *sizePtr, int *entriesPtr,
+				     Tcl_WideInt *hitsPtr,
+				     Tcl_WideInt *missesPtr);
 /*
  *----------------------------------------------------------------
  * Functions to read a file containing MIB definitions.
@@ -323,11 +364,40 @@ TnmMibUnpack		(Tcl_Interp *interp, TnmOid *oidPtr,
 EXTERN char*
 TnmMibParse		(char *file, char *frozen);
 
-EXTERN TnmMibNode*
-TnmMibReadFrozen	(FILE *fp);
+EXTERN int
+TnmMibReadFrozen	(char *frozen, char *file,
+				     TnmMibNode **nodeListPtr);
+EXTERN int
+TnmMibWriteFrozen	(char *frozen, char *file,
+				     TnmMibNode *nodeList);
 
+EXTERN char*
+TnmMibMapFile		(char *fileName, size_t minSize,
+				     size_t *sizePtr);
 EXTERN void
-TnmMibWriteFrozen	(FILE *fp, TnmMibNode *nodePtr);
+TnmMibUnmapFile		(char *image, size_t size);
+
+/*
+ *----------------------------------------------------------------
+ * The following structure describes a module of a bundle, which
+ * holds the complete MIB tree built from a list of MIB files.
+ *----------------------------------------------------------------
+ */
+
+typedef struct TnmMibModule {
+    char *name;			/* The name used to load the module. */
+    char *fileName;		/* The file with the MIB definitions. */
+    char *moduleName;		/* The name of the MIB module or NULL. */
+    Tcl_Obj *importList;	/* The modules imported by the module. */
+    int dirty;			/* Set if the module must be reloaded. */
+} TnmMibModule;
+
+EXTERN int
+TnmMibReadBundle	(char *bundle, int numModules,
+				     TnmMibModule *modules);
+EXTERN int
+TnmMibWriteBundle	(char *bundle, int numModules,
+				     TnmMibModule *modules);
 
 /*
  *----------------------------------------------------------------
@@ -342,6 +412,9 @@ TnmMibNewNode		(char *label);
 EXTERN int
 TnmMibAddNode		(TnmMibNode **rootPtr, 
 				     TnmMibNode *nodePtr);
+EXTERN void
+TnmMibInstallTree	(TnmMibNode *treePtr);
+
 EXTERN TnmMibType*
 TnmMibAddType		(TnmMibType *typePtr);
 
@@ -18,104 +18,291 @@
 #include "tnmSnmp.h"
 #include "tnmMib.h"
 
+#ifdef HAVE_MMAP
+#include <fcntl.h>
+#include <sys/mman.h>
+#endif
+
+/*
+ * A frozen file is a relocatable image of the definitions found in
+ * one MIB file. The image starts with the header defined below,
+ * followed by a string pool and arrays of fixed size records. All
+ * references are stored as offsets into the string pool or as
+ * indexes (+ 1) into the record arrays, so that the image does
+ * not depend on the address where it is loaded. The string pool
+ * is used in place from a read-only shared mapping of the file.
+ * Only the records are copied into memory since linking them into
+ * the MIB tree modifies them.
+ *
+ * A bundle uses the same records to store the complete MIB tree
+ * built from a list of MIB files. The nodes of a bundle are already
+ * linked and the bundle remembers the source files and the imports
+ * of all modules so that modifications can be detected.
+ */
+
+#define IMAGE_MAGIC	"TnmMibI"
+#define IMAGE_VERSION	2
+#define BUNDLE_MAGIC	"TnmMibB"
+#define BUNDLE_VERSION	1
+#define IMAGE_BYTEORDER	0x01020304
+
+typedef struct ImageHeader {
+    char magic[8];		/* The IMAGE_MAGIC string. */
+    char tnmVersion[16];	/* The TNM_VERSION of the writer. */
+    unsigned int version;	/* The IMAGE_VERSION of the writer. */
+    unsigned int byteOrder;	/* IMAGE_BYTEORDER in the writer's order. */
+    Tcl_WideInt srcMtime;	/* Modification time of the MIB file. */
+    Tcl_WideInt srcSize;	/* Size of the MIB file in bytes. */
+    unsigned int srcName;	/* Normalized path of the MIB file. */
+    unsigned int poolOffset;	/* Offset and size of the string pool. */
+    unsigned int poolSize;
+    unsigned int importOffset;	/* Offset and number of imported modules. */
+    unsigned int numImports;
+    unsigned int restOffset;	/* Offset and number of ImageRest records. */
+    unsigned int numRests;
+    unsigned int typeOffset;	/* Offset and number of ImageType records. */
+    unsigned int numTypes;
+    unsigned int numOwnTypes;	/* Number of types defined by this file. */
+    unsigned int nodeOffset;	/* Offset and number of ImageNode records. */
+    unsigned int numNodes;
+} ImageHeader;
+
+typedef struct ImageRest {
+    unsigned int min;		/* The enum value or the range minimum. */
+    unsigned int max;		/* The range maximum. */
+    unsigned int label;		/* The enum label or 0. */
+} ImageRest;
+
+typedef struct ImageType {
+    unsigned int name;
+    unsigned int moduleName;
+    unsigned int fileName;
+    unsigned int displayHint;
+    int fileOffset;
+    unsigned int restList;	/* Index + 1 of the first restriction. */
+    unsigned int numRests;	/* Number of consecutive restrictions. */
+    short syntax;
+    unsigned char macro;
+    unsigned char status;
+    unsigned char restKind;
+    unsigned char pad[3];
+} ImageType;
+
+typedef struct ImageNode {
+    unsigned int subid;
+    unsigned int label;
+    unsigned int parentName;
+    unsigned int moduleName;
+    unsigned int fileName;
+    unsigned int index;
+    int fileOffset;
+    unsigned int type;		/* Index + 1 of the type or 0. */
+    unsigned short syntax;
+    unsigned char access;
+    unsigned char macro;
+    unsigned char status;
+    unsigned char implied;
+    unsigned char augment;
+    unsigned char pad;
+} ImageNode;
+
+typedef struct BundleHeader {
+    char magic[8];		/* The BUNDLE_MAGIC string. */
+    char tnmVersion[16];	/* The TNM_VERSION of the writer. */
+    unsigned int version;	/* The BUNDLE_VERSION of the writer. */
+    unsigned int byteOrder;	/* IMAGE_BYTEORDER in the writer's order. */
+    unsigned int poolOffset;	/* Offset and size of the string pool. */
+    unsigned int poolSize;
+    unsigned int moduleOffset;	/* Offset and number of BundleModules. */
+    unsigned int numModules;
+    unsigned int importOffset;	/* Offset and number of imported modules. */
+    unsigned int numImports;
+    unsigned int restOffset;	/* Offset and number of ImageRest records. */
+    unsigned int numRests;
+    unsigned int typeOffset;	/* Offset and number of ImageType records. */
+    unsigned int numTypes;
+    unsigned int numListTypes;	/* Number of types in tnmMibTypeList. */
+    unsigned int nodeOffset;	/* Offset and number of BundleNode records. */
+    unsigned int numNodes;
+    unsigned int pad;
+} BundleHeader;
+
+typedef struct BundleModule {
+    Tcl_WideInt srcMtime;	/* Modification time of the MIB file. */
+    Tcl_WideInt srcSize;	/* Size of the MIB file in bytes. */
+    unsigned int name;		/* The name used to load the module. */
+    unsigned int srcName;	/* Normalized path of the MIB file. */
+    unsigned int moduleName;	/* The name of the MIB module or 0. */
+    unsigned int firstImport;	/* Index of the first imported module. */
+    unsigned int numImports;	/* Number of imported modules. */
+    unsigned int pad;
+} BundleModule;
+
+typedef struct BundleNode {
+    ImageNode node;		/* The node itself. */
+    unsigned int parent;	/* Index + 1 of the parent node or 0. */
+    unsigned int child;		/* Index + 1 of the first child or 0. */
+    unsigned int next;		/* Index + 1 of the next peer or 0. */
+    unsigned int pad;
+} BundleNode;
+
 /*
- * Strings are collected in a hashtable for every parsed mib. This allows
- * us to write all strings in one big chunk so that we do not need to
- * allocate every single string. The offset (== size) of the string pool
- * is maintained in poolOffset.
+ * The following structure is used while an image is written. Strings
+ * are collected in a hash table which maps them to their offset in
+ * the pool. Types are collected in a hash table which maps them to
+ * their index in the type array.
  */
 
-static Tcl_HashTable *poolHashTable = NULL;
-static int poolOffset = 0;
+typedef struct ImageWriter {
+    Tcl_HashTable stringTable;	/* Maps strings to pool offsets. */
+    Tcl_DString pool;		/* The string pool. */
+    Tcl_HashTable typeTable;	/* Maps type pointers to indexes. */
+    TnmMibType **types;		/* The types in image order. */
+    int numTypes;		/* Number of types in the types array. */
+    int maxTypes;		/* Size of the types array. */
+    int numRests;		/* Number of restrictions of all types. */
+} ImageWriter;
 
 /*
  * Forward declarations for procedures defined later in this file:
  */
 
+static int
+SourceIdentity		(char *file, Tcl_WideInt *mtimePtr,
+				     Tcl_WideInt *sizePtr, Tcl_DString *dsPtr);
 static void
-PoolInit		(void);
+InitWriter		(ImageWriter *writerPtr);
 
 static void
-PoolDelete		(void);
+FreeWriter		(ImageWriter *writerPtr);
+
+static unsigned int
+PoolAddString		(ImageWriter *writerPtr, char *s);
 
 static void
-PoolAddString		(char *string);
+CollectType		(ImageWriter *writerPtr, TnmMibType *typePtr);
 
-static int
-PoolGetOffset		(char *string);
+static void
+CollectTypeList		(ImageWriter *writerPtr, TnmMibType *markPtr);
 
 static void
-PoolSave		(FILE *fp);
+CollectTreeTypes	(ImageWriter *writerPtr, TnmMibNode *nodePtr);
 
 static void
-SaveRest		(TnmMibRest *restPtr, int restKind, 
-				     FILE *fp);
+EncodeTypes		(ImageWriter *writerPtr, ImageType *types,
+				     ImageRest *rests);
 static void
-SaveType		(TnmMibType *typePtr, int *i, FILE *fp);
-
+EncodeNode		(ImageWriter *writerPtr, TnmMibNode *nodePtr,
+				     ImageNode *inPtr);
 static void
-SaveNode		(TnmMibNode *nodePtr, int *i, FILE *fp);
+EncodeTree		(ImageWriter *writerPtr, TnmMibNode *nodePtr,
+				     unsigned int parent, Tcl_DString *dsPtr);
+static unsigned int
+AppendSection		(Tcl_DString *imagePtr, char *data, size_t size);
 
+static int
+WriteAtomic		(char *fileName, Tcl_DString *imagePtr);
+
+static int
+CheckSection		(size_t imageSize, unsigned int offset,
+				     unsigned int count, size_t size);
+static char*
+PoolString		(char *pool, unsigned int poolSize,
+				     unsigned int offset, int *okPtr);
+static int
+DecodeTypes		(char *pool, unsigned int poolSize,
+				     ImageType *iTypes, unsigned int numTypes,
+				     ImageRest *iRests, unsigned int numRests,
+				     TnmMibType *types, TnmMibRest *rests);
+static int
+DecodeNode		(char *pool, unsigned int poolSize,
+				     ImageNode *inPtr, unsigned int numTypes,
+				     TnmMibNode *nodePtr);
 static void
-CollectData		(int *numRests, int *numTcs,
-				     int *numNodes, TnmMibNode *nodePtr);
-static void
-SaveData		(FILE *fp, int numRests, int numTcs, 
-				     int numNodes, TnmMibNode *nodePtr);
+ResolveTypes		(TnmMibType *types, unsigned int numTypes,
+				     TnmMibType **typeTab);
 
 
 /*
  *----------------------------------------------------------------------
  *
- * PoolInit --
+ * SourceIdentity --
  *
- *	This procedure initializes the hash table that is used to
- *	create a string pool. The pool is used to eliminate 
- *	duplicated strings.
+ *	This procedure determines the modification time, the size
+ *	and the normalized path of a MIB file. They are stored in
+ *	a frozen file to detect images that are out of date or that
+ *	belong to another file with the same name.
  *
  * Results:
- *	None.
+ *	A standard Tcl result.
  *
  * Side effects:
- *	None.
+ *	The normalized path is appended to the dynamic string.
  *
  *----------------------------------------------------------------------
  */
 
-static void
-PoolInit()
+static int
+SourceIdentity(char *file, Tcl_WideInt *mtimePtr, Tcl_WideInt *sizePtr,
+	       Tcl_DString *dsPtr)
 {
-    poolOffset = 0;
-    if (poolHashTable == NULL) {
-	poolHashTable = (Tcl_HashTable *) ckalloc(sizeof(Tcl_HashTable));
+    Tcl_StatBuf stbuf;
+    Tcl_Obj *obj, *normPtr;
+    int code = TCL_ERROR;
+
+    obj = Tcl_NewStringObj(file, -1);
+    Tcl_IncrRefCount(obj);
+    if (Tcl_FSStat(obj, &stbuf) == 0) {
+	normPtr = Tcl_FSGetNormalizedPath(NULL, obj);
+	if (normPtr) {
+	    *mtimePtr = (Tcl_WideInt) stbuf.st_mtime;
+	    *sizePtr = (Tcl_WideInt) stbuf.st_size;
+	    Tcl_DStringAppend(dsPtr, Tcl_GetString(normPtr), -1);
+	    code = TCL_OK;
+	}
     }
-    Tcl_InitHashTable(poolHashTable, TCL_STRING_KEYS);
+    Tcl_DecrRefCount(obj);
+    return code;
 }
 
 /*
  *----------------------------------------------------------------------
  *
- * PoolDelete --
+ * InitWriter, FreeWriter --
  *
- *	This procedure clears the memory used to create the string
- *	pool. Very simple and really not worth the comments. Thats
- *	why this one is getting a bit longer as usual. :-)
+ *	These procedures initialize and release the state used to
+ *	write an image. The string pool starts with an empty string
+ *	so that offset 0 can represent NULL pointers.
  *
  * Results:
  *	None.
  *
  * Side effects:
- *	None.
+ *	Memory is allocated or freed.
  *
  *----------------------------------------------------------------------
  */
 
 static void
-PoolDelete()
+InitWriter(ImageWriter *writerPtr)
+{
+    Tcl_InitHashTable(&writerPtr->stringTable, TCL_STRING_KEYS);
+    Tcl_InitHashTable(&writerPtr->typeTable, TCL_ONE_WORD_KEYS);
+    Tcl_DStringInit(&writerPtr->pool);
+    Tcl_DStringAppend(&writerPtr->pool, "", 1);
+    writerPtr->types = NULL;
+    writerPtr->numTypes = writerPtr->maxTypes = writerPtr->numRests = 0;
+}
+
+static void
+FreeWriter(ImageWriter *writerPtr)
 {
-    if (poolHashTable) {
-        Tcl_DeleteHashTable(poolHashTable);
+    if (writerPtr->types) {
+	ckfree((char *) writerPtr->types);
     }
+    Tcl_DStringFree(&writerPtr->pool);
+    Tcl_DeleteHashTable(&writerPtr->typeTable);
+    Tcl_DeleteHashTable(&writerPtr->stringTable);
 }
 
 /*
@@ -123,184 +310,200 @@ PoolDelete()
  *
  * PoolAddString --
  *
- *	This procedure adds a string to the pool if it is not yet 
- *	there. The value is initialized to mark this entry as used.
- *	The total offset is incremented to get total memory required 
- *	for the string pool. 
+ *	This procedure adds a string to the string pool if it is not
+ *	yet there. Offset 0 is reserved to represent NULL pointers.
  *
  * Results:
- *	None.
+ *	The offset of the string in the string pool.
  *
  * Side effects:
- *	None.
+ *	The string pool grows.
  *
  *----------------------------------------------------------------------
  */
 
-static void
-PoolAddString(char *s)
+static unsigned int
+PoolAddString(ImageWriter *writerPtr, char *s)
 {
     Tcl_HashEntry *entryPtr;
     int isnew;
+    unsigned int offset;
 
-    if (! s) return;
+    if (! s) {
+	return 0;
+    }
 
-    entryPtr = Tcl_CreateHashEntry(poolHashTable, s, &isnew);
+    entryPtr = Tcl_CreateHashEntry(&writerPtr->stringTable, s, &isnew);
     if (! isnew) {
-	return;
+	return (unsigned int) (size_t) Tcl_GetHashValue(entryPtr);
     }
-    Tcl_SetHashValue(entryPtr, 1);
-    poolOffset += strlen(s) + 1;
+    offset = (unsigned int) Tcl_DStringLength(&writerPtr->pool);
+    Tcl_DStringAppend(&writerPtr->pool, s, (int) strlen(s) + 1);
+    Tcl_SetHashValue(entryPtr, (ClientData) (size_t) offset);
+    return offset;
 }
 
 /*
  *----------------------------------------------------------------------
  *
- * PoolGetOffset --
+ * CollectType --
  *
- *	This procedure returns the offset to the given string in the 
- *	string pool or 0 if the string is not in the pool.
+ *	This procedure assigns the next index in the type array to a
+ *	type unless the type has already been collected.
  *
  * Results:
  *	None.
  *
  * Side effects:
- *	None.
+ *	The type is added to the type array.
  *
  *----------------------------------------------------------------------
  */
 
-static int
-PoolGetOffset(char *s)
+static void
+CollectType(ImageWriter *writerPtr, TnmMibType *typePtr)
 {
     Tcl_HashEntry *entryPtr;
+    TnmMibRest *restPtr;
+    int isnew;
 
-    if (! s) return 0;
-
-    entryPtr = Tcl_FindHashEntry(poolHashTable, s);
-    if (entryPtr) {
-        return (int) Tcl_GetHashValue(entryPtr);
-    } else {
-	return 0;
+    entryPtr = Tcl_CreateHashEntry(&writerPtr->typeTable,
+				   (char *) typePtr, &isnew);
+    if (! isnew) {
+	return;
+    }
+    if (writerPtr->numTypes == writerPtr->maxTypes) {
+	writerPtr->maxTypes = writerPtr->maxTypes
+	    ? 2 * writerPtr->maxTypes : 64;
+	writerPtr->types = (TnmMibType **) ckrealloc(
+	    (char *) writerPtr->types,
+	    writerPtr->maxTypes * sizeof(TnmMibType *));
+    }
+    Tcl_SetHashValue(entryPtr, (ClientData) (size_t) writerPtr->numTypes);
+    writerPtr->types[writerPtr->numTypes++] = typePtr;
+    for (restPtr = typePtr->restList; restPtr; restPtr = restPtr->nextPtr) {
+	writerPtr->numRests++;
     }
 }
 
 /*
  *----------------------------------------------------------------------
  *
- * PoolSave --
+ * CollectTypeList --
  *
- *	This procedure writes the string pool to the given file pointer.
+ *	This procedure collects the types in tnmMibTypeList up to
+ *	markPtr in the order of their definition, which is the reverse
+ *	order of the list.
  *
  * Results:
  *	None.
  *
  * Side effects:
- *	None.
+ *	The types are added to the type array.
  *
  *----------------------------------------------------------------------
  */
 
 static void
-PoolSave(FILE *fp)
+CollectTypeList(ImageWriter *writerPtr, TnmMibType *markPtr)
 {
-    Tcl_HashSearch searchPtr;
-    Tcl_HashEntry *entryPtr;
-
-    /*
-     * Save magic and size:
-     */
-
-    poolOffset += strlen(TNM_VERSION) + 1;
-    fwrite((char *) &poolOffset, sizeof(int), 1, fp);
-    fwrite(TNM_VERSION, 1, strlen(TNM_VERSION) + 1, fp);
+    TnmMibType *typePtr, **typeTab;
+    int i, n = 0;
 
-    /*
-     * Save the strings in the pool:
-     */
-
-    poolOffset = strlen(TNM_VERSION) + 1;
-    entryPtr = Tcl_FirstHashEntry(poolHashTable, &searchPtr);
-    while (entryPtr) {
-	char *s = Tcl_GetHashKey(poolHashTable, entryPtr);
-	unsigned int len = strlen(s) + 1;
-	Tcl_SetHashValue(entryPtr, poolOffset);
-	fwrite(s, 1, len, fp);
-	poolOffset += len;
-	entryPtr = Tcl_NextHashEntry(&searchPtr);
+    for (typePtr = tnmMibTypeList;
+	 typePtr != markPtr; typePtr = typePtr->nextPtr) {
+	n++;
     }
+    typeTab = (TnmMibType **) ckalloc((n + 1) * sizeof(TnmMibType *));
+    for (i = n, typePtr = tnmMibTypeList;
+	 typePtr != markPtr; typePtr = typePtr->nextPtr) {
+	typeTab[--i] = typePtr;
+    }
+    for (i = 0; i < n; i++) {
+	CollectType(writerPtr, typeTab[i]);
+    }
+    ckfree((char *) typeTab);
 }
 
 /*
  *----------------------------------------------------------------------
  *
- * CollectData --
+ * CollectTreeTypes --
  *
- *	This procedure collects the strings (by adding them to the pool)
- *	and counts the number of enum/range restrictions, tcs and nodes
- *	to be saved.
+ *	This procedure collects the types used by the nodes of the
+ *	trees starting at nodePtr and its peers.
  *
  * Results:
- *	Returns the number of enum/range restrictions, tcs and nodes.
+ *	None.
  *
  * Side effects:
+ *	The types are added to the type array.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+CollectTreeTypes(ImageWriter *writerPtr, TnmMibNode *nodePtr)
+{
+    for (; nodePtr; nodePtr = nodePtr->nextPtr) {
+	if (nodePtr->typePtr) {
+	    CollectType(writerPtr, nodePtr->typePtr);
+	}
+	CollectTreeTypes(writerPtr, nodePtr->childPtr);
+    }
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * EncodeTypes --
+ *
+ *	This procedure converts the collected types and their
+ *	restrictions into image records. The restrictions of a type
+ *	are stored in consecutive records.
+ *
+ * Results:
  *	None.
  *
+ * Side effects:
+ *	Strings are added to the string pool.
+ *
  *----------------------------------------------------------------------
  */
 
 static void
-CollectData(numEnums, numTcs, numNodes, nodePtr)
-    int *numEnums, *numTcs, *numNodes;
-    TnmMibNode *nodePtr;
+EncodeTypes(ImageWriter *writerPtr, ImageType *types, ImageRest *rests)
 {
-    TnmMibNode *ptr;
     TnmMibRest *restPtr;
-    TnmMibType *typePtr;
-
-    *numEnums = *numTcs = *numNodes = 0;
-    for (ptr = nodePtr; ptr; (*numNodes)++, ptr = ptr->nextPtr) {
-	PoolAddString(ptr->label);
-	PoolAddString(ptr->parentName);
-	PoolAddString(ptr->fileName);
-	PoolAddString(ptr->moduleName);
-	PoolAddString(ptr->index);
-	if (ptr->typePtr) {
-	    (*numTcs)++;
-	    PoolAddString(ptr->typePtr->name);
-	    PoolAddString(ptr->typePtr->fileName);
-	    PoolAddString(ptr->typePtr->moduleName);
-	    PoolAddString(ptr->typePtr->displayHint);
-	    if (ptr->typePtr->restKind == TNM_MIB_REST_ENUMS
-		|| ptr->typePtr->restKind == TNM_MIB_REST_RANGE
-		|| ptr->typePtr->restKind == TNM_MIB_REST_SIZE) {
-		for (restPtr = ptr->typePtr->restList;
-		     restPtr;
-		     (*numEnums)++, restPtr = restPtr->nextPtr) {
-		    if (ptr->typePtr->restKind == TNM_MIB_REST_ENUMS) {
-			PoolAddString(restPtr->rest.intEnum.enumLabel);
-		    }
-		}
-	    }
+    int i, r;
+
+    for (i = 0, r = 0; i < writerPtr->numTypes; i++) {
+	TnmMibType *typePtr = writerPtr->types[i];
+	memset((char *) (types + i), 0, sizeof(ImageType));
+	types[i].name = PoolAddString(writerPtr, typePtr->name);
+	types[i].moduleName = PoolAddString(writerPtr, typePtr->moduleName);
+	types[i].fileName = PoolAddString(writerPtr, typePtr->fileName);
+	types[i].displayHint = PoolAddString(writerPtr, typePtr->displayHint);
+	types[i].fileOffset = typePtr->fileOffset;
+	types[i].syntax = typePtr->syntax;
+	types[i].macro = typePtr->macro;
+	types[i].status = typePtr->status;
+	types[i].restKind = typePtr->restKind;
+	if (typePtr->restList) {
+	    types[i].restList = r + 1;
 	}
-    }
-    for (typePtr = tnmMibTypeList; 
-	 typePtr != tnmMibTypeSaveMark; typePtr = typePtr->nextPtr) {
-        (*numTcs)++;
-	PoolAddString(typePtr->name);
-	PoolAddString(typePtr->fileName);
-	PoolAddString(typePtr->moduleName);
-	PoolAddString(typePtr->displayHint);
-	if (typePtr->restKind == TNM_MIB_REST_ENUMS
-	    || typePtr->restKind == TNM_MIB_REST_RANGE
-	    || typePtr->restKind == TNM_MIB_REST_SIZE) {
-	    for (restPtr = typePtr->restList;
-		 restPtr;
-		 (*numEnums)++, restPtr = restPtr->nextPtr) {
-		if (typePtr->restKind == TNM_MIB_REST_ENUMS) {
-		    PoolAddString(restPtr->rest.intEnum.enumLabel);
-		}
+	for (restPtr = typePtr->restList; restPtr; restPtr = restPtr->nextPtr) {
+	    memset((char *) (rests + r), 0, sizeof(ImageRest));
+	    if (typePtr->restKind == TNM_MIB_REST_ENUMS) {
+		rests[r].min = (unsigned int) restPtr->rest.intEnum.enumValue;
+		rests[r].label = PoolAddString(writerPtr,
+					restPtr->rest.intEnum.enumLabel);
+	    } else {
+		rests[r].min = restPtr->rest.unsRange.min;
+		rests[r].max = restPtr->rest.unsRange.max;
 	    }
+	    types[i].numRests++;
+	    r++;
 	}
     }
 }
@@ -308,239 +511,554 @@ CollectData(numEnums, numTcs, numNodes, nodePtr)
 /*
  *----------------------------------------------------------------------
  *
- * SaveRest --
+ * EncodeNode --
  *
- *	This procedure writes a TnmMibRest structure. The char*
- *	pointers are used to store the offset into the string pool.
+ *	This procedure converts a node into an image record. The
+ *	type of the node must have been collected already.
  *
  * Results:
  *	None.
  *
  * Side effects:
- *	None.
+ *	Strings are added to the string pool.
  *
  *----------------------------------------------------------------------
  */
 
 static void
-SaveRest(restPtr, restKind, fp)
-    TnmMibRest *restPtr;
-    FILE *fp;
+EncodeNode(ImageWriter *writerPtr, TnmMibNode *nodePtr, ImageNode *inPtr)
 {
-    TnmMibRest rest;
+    Tcl_HashEntry *entryPtr;
 
-    if (restKind == TNM_MIB_REST_ENUMS) {
-	memcpy((char *) &rest, (char *) restPtr, sizeof(TnmMibRest));
-	rest.rest.intEnum.enumLabel = 
-	    (char *) PoolGetOffset(restPtr->rest.intEnum.enumLabel);
-	rest.nextPtr = (TnmMibRest *) (restPtr->nextPtr ? 1 : 0);
-	restPtr = &rest;
+    memset((char *) inPtr, 0, sizeof(ImageNode));
+    inPtr->subid = nodePtr->subid;
+    inPtr->label = PoolAddString(writerPtr, nodePtr->label);
+    inPtr->parentName = PoolAddString(writerPtr, nodePtr->parentName);
+    inPtr->moduleName = PoolAddString(writerPtr, nodePtr->moduleName);
+    inPtr->fileName = PoolAddString(writerPtr, nodePtr->fileName);
+    inPtr->index = PoolAddString(writerPtr, nodePtr->index);
+    inPtr->fileOffset = nodePtr->fileOffset;
+    inPtr->syntax = nodePtr->syntax;
+    inPtr->access = nodePtr->access;
+    inPtr->macro = nodePtr->macro;
+    inPtr->status = nodePtr->status;
+    inPtr->implied = nodePtr->implied;
+    inPtr->augment = nodePtr->augment;
+    if (nodePtr->typePtr) {
+	entryPtr = Tcl_FindHashEntry(&writerPtr->typeTable,
+				     (char *) nodePtr->typePtr);
+	inPtr->type = (unsigned int) (size_t) Tcl_GetHashValue(entryPtr) + 1;
     }
-
-    fwrite((char *) restPtr, sizeof(TnmMibRest), 1, fp);
 }
 
 /*
  *----------------------------------------------------------------------
  *
- * SaveType --
+ * EncodeTree --
  *
- *	This procedure writes a TnmMibType structure. The char*
- *	pointers are used to store the offset into the string pool.
+ *	This procedure appends the nodes of the trees starting at
+ *	nodePtr and its peers in preorder to the bundle node records
+ *	kept in a dynamic string. The record of a node is reserved
+ *	before its children are appended and completed afterwards,
+ *	when the index of its next peer is known.
  *
  * Results:
  *	None.
  *
  * Side effects:
- *	None.
+ *	The dynamic string grows.
  *
  *----------------------------------------------------------------------
  */
 
 static void
-SaveType(TnmMibType *typePtr, int *i, FILE *fp)
+EncodeTree(ImageWriter *writerPtr, TnmMibNode *nodePtr, unsigned int parent,
+	   Tcl_DString *dsPtr)
 {
-    TnmMibType tc;
+    BundleNode bn;
+    unsigned int i;
 
-    memcpy((char *) &tc, (char *) typePtr, sizeof(TnmMibType));
-    tc.name = (char *) PoolGetOffset(typePtr->name);
-    tc.fileName = (char *) PoolGetOffset(typePtr->fileName);
-    tc.moduleName = (char *) PoolGetOffset(typePtr->moduleName);
-    tc.displayHint = (char *) PoolGetOffset(typePtr->displayHint);
-    if (typePtr->restList) {
-	TnmMibRest *e;
-	tc.restList = (TnmMibRest *) (*i + 1);
-	for (e = typePtr->restList; e; (*i)++, e = e->nextPtr) ;
+    for (; nodePtr; nodePtr = nodePtr->nextPtr) {
+	i = (unsigned int) (Tcl_DStringLength(dsPtr) / sizeof(BundleNode));
+	memset((char *) &bn, 0, sizeof(bn));
+	Tcl_DStringAppend(dsPtr, (char *) &bn, sizeof(bn));
+	EncodeNode(writerPtr, nodePtr, &bn.node);
+	bn.parent = parent;
+	bn.child = nodePtr->childPtr ? i + 2 : 0;
+	EncodeTree(writerPtr, nodePtr->childPtr, i + 1, dsPtr);
+	if (nodePtr->nextPtr) {
+	    bn.next = (unsigned int) (Tcl_DStringLength(dsPtr)
+				      / sizeof(BundleNode)) + 1;
+	}
+	memcpy(Tcl_DStringValue(dsPtr) + i * sizeof(BundleNode),
+	       (char *) &bn, sizeof(bn));
     }
-    tc.nextPtr = (TnmMibType *) (typePtr->nextPtr ? 1 : 0);
-
-    fwrite((char *) &tc, sizeof(TnmMibType), 1, fp);
 }
 
 /*
  *----------------------------------------------------------------------
  *
- * SaveNode --
+ * AppendSection --
  *
- *	This procedure writes a TnmMibNode structure. The char*
- *	pointers are used to store the offset into the string pool.
+ *	This procedure appends a section to an image. Sections start
+ *	at offsets aligned to 8 bytes.
  *
  * Results:
- *	None.
+ *	The offset of the section in the image.
  *
  * Side effects:
- *	None.
+ *	The image grows.
  *
  *----------------------------------------------------------------------
  */
 
-static void
-SaveNode(TnmMibNode *nodePtr, int *i, FILE *fp)
+static unsigned int
+AppendSection(Tcl_DString *imagePtr, char *data, size_t size)
 {
-    struct TnmMibNode no;
-
-    memcpy((char *) &no, (char *) nodePtr, sizeof(TnmMibNode));
-    no.label = (char *) PoolGetOffset(nodePtr->label);
-    no.parentName = (char *) PoolGetOffset(nodePtr->parentName);
-    no.fileName = (char *) PoolGetOffset(nodePtr->fileName);
-    no.moduleName = (char *) PoolGetOffset(nodePtr->moduleName);
-    no.index = (char *) PoolGetOffset(nodePtr->index);
-    no.childPtr = 0;
-    if (nodePtr->typePtr) {
-	no.typePtr = (TnmMibType *) ++(*i);
+    static char zero[8];
+    int offset = Tcl_DStringLength(imagePtr);
+
+    if (offset % 8) {
+	Tcl_DStringAppend(imagePtr, zero, 8 - offset % 8);
+	offset = Tcl_DStringLength(imagePtr);
+    }
+    if (size) {
+	Tcl_DStringAppend(imagePtr, data, (int) size);
     }
-    no.nextPtr = (TnmMibNode *) (nodePtr->nextPtr ? 1 : 0);
-    
-    fwrite((char *) &no, sizeof(TnmMibNode), 1, fp);
+    return (unsigned int) offset;
 }
 
 /*
  *----------------------------------------------------------------------
  *
- * SaveData --
+ * WriteAtomic --
  *
- *	This procedure writes the node list as an index file to fp.
+ *	This procedure writes an image into a temporary file which is
+ *	renamed when it is complete. Processes which have mapped the
+ *	old image keep it and nobody maps a partially written file.
  *
- *	int (#enum elements)
- *  		followed by #enum structs
- * 	int (#tc elements)
- *		followed by #tc structs
- *      int (#node elements)
- *		followed by n TnmMibNode structs.
+ * Results:
+ *	A standard Tcl result.
  *
- *	String pointer are saved as offsets relative to the pool,
- *	enum pointer are saved as offset to the saved enums (+ 1)
- *	tc pointer dito.
+ * Side effects:
+ *	The file is replaced.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+WriteAtomic(char *fileName, Tcl_DString *imagePtr)
+{
+    Tcl_DString tmpName;
+    FILE *fp;
+    char buf[32];
+    size_t size = (size_t) Tcl_DStringLength(imagePtr);
+    int code = TCL_ERROR;
+
+    Tcl_DStringInit(&tmpName);
+    Tcl_DStringAppend(&tmpName, fileName, -1);
+    sprintf(buf, ".%d", (int) getpid());
+    Tcl_DStringAppend(&tmpName, buf, -1);
+    fp = fopen(Tcl_DStringValue(&tmpName), "wb");
+    if (fp) {
+	if (fwrite(Tcl_DStringValue(imagePtr), 1, size, fp) == size) {
+	    code = TCL_OK;
+	}
+	if (fclose(fp) != 0) {
+	    code = TCL_ERROR;
+	}
+	if (code == TCL_OK
+	    && rename(Tcl_DStringValue(&tmpName), fileName) != 0) {
+	    code = TCL_ERROR;
+	}
+	if (code != TCL_OK) {
+	    unlink(Tcl_DStringValue(&tmpName));
+	}
+    }
+    Tcl_DStringFree(&tmpName);
+    return code;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * TnmMibWriteFrozen --
+ *
+ *	This procedure writes a frozen MIB file for the nodes in
+ *	nodeList, the types defined since tnmMibTypeSaveMark and the
+ *	modules in tnmMibImportList. Types of other files used by the
+ *	nodes are saved as well. See the description of
+ *	TnmMibReadFrozen() for an explanation of the format.
  *
  * Results:
- *	None.
+ *	A standard Tcl result.
  *
  * Side effects:
- *	None.
+ *	The frozen file is replaced.
  *
  *----------------------------------------------------------------------
  */
 
-static void
-SaveData(fp, numEnums, numTCs, numNodes, nodePtr)
-    FILE *fp;
-    int numEnums, numTCs, numNodes;
-    TnmMibNode *nodePtr;
+int
+TnmMibWriteFrozen(char *frozen, char *file, TnmMibNode *nodeList)
 {
-    TnmMibNode *nPtr;
-    TnmMibRest *ePtr;
-    TnmMibType *tPtr;
-    int i;
-    
+    ImageWriter writer;
+    ImageHeader hdr;
+    Tcl_DString srcName, image, nodes, imports;
+    TnmMibNode *nodePtr;
+    ImageType *types;
+    ImageRest *rests;
+    ImageNode node;
+    Tcl_Obj **objv;
+    unsigned int offset;
+    int i, objc, code;
+
+    memset((char *) &hdr, 0, sizeof(hdr));
+    Tcl_DStringInit(&srcName);
+    if (SourceIdentity(file, &hdr.srcMtime, &hdr.srcSize,
+		       &srcName) != TCL_OK) {
+	Tcl_DStringFree(&srcName);
+	return TCL_ERROR;
+    }
+    strcpy(hdr.magic, IMAGE_MAGIC);
+    strncpy(hdr.tnmVersion, TNM_VERSION, sizeof(hdr.tnmVersion) - 1);
+    hdr.version = IMAGE_VERSION;
+    hdr.byteOrder = IMAGE_BYTEORDER;
+
+    InitWriter(&writer);
+    hdr.srcName = PoolAddString(&writer, Tcl_DStringValue(&srcName));
+    Tcl_DStringFree(&srcName);
+
+    Tcl_DStringInit(&imports);
+    if (tnmMibImportList
+	&& Tcl_ListObjGetElements(NULL, tnmMibImportList,
+				  &objc, &objv) == TCL_OK) {
+	for (i = 0; i < objc; i++) {
+	    offset = PoolAddString(&writer, Tcl_GetString(objv[i]));
+	    Tcl_DStringAppend(&imports, (char *) &offset, sizeof(offset));
+	    hdr.numImports++;
+	}
+    }
+
     /*
-     * Save numEnums TnmMibRest structures:
+     * Collect the types defined in this file first, in the order
+     * of their definition, followed by the types of other files
+     * used by the nodes.
      */
 
-    fwrite((char *) &numEnums, sizeof(int), 1, fp);
-    for (nPtr = nodePtr; nPtr; nPtr = nPtr->nextPtr) {
-	if (nPtr->typePtr) {
-	    for (ePtr = nPtr->typePtr->restList; ePtr; ePtr = ePtr->nextPtr) {
-		SaveRest(ePtr, nPtr->typePtr->restKind, fp);
-	    }
+    CollectTypeList(&writer, tnmMibTypeSaveMark);
+    hdr.numOwnTypes = (unsigned int) writer.numTypes;
+    for (nodePtr = nodeList; nodePtr; nodePtr = nodePtr->nextPtr) {
+	if (nodePtr->typePtr) {
+	    CollectType(&writer, nodePtr->typePtr);
 	}
     }
-    for (tPtr=tnmMibTypeList; tPtr != tnmMibTypeSaveMark; tPtr = tPtr->nextPtr) {
-	for (ePtr = tPtr->restList; ePtr; ePtr = ePtr->nextPtr) {
-	    SaveRest(ePtr, tPtr->restKind, fp);
-	}
+
+    types = (ImageType *) ckalloc((writer.numTypes + 1) * sizeof(ImageType));
+    rests = (ImageRest *) ckalloc((writer.numRests + 1) * sizeof(ImageRest));
+    EncodeTypes(&writer, types, rests);
+    Tcl_DStringInit(&nodes);
+    for (nodePtr = nodeList; nodePtr; nodePtr = nodePtr->nextPtr) {
+	EncodeNode(&writer, nodePtr, &node);
+	Tcl_DStringAppend(&nodes, (char *) &node, sizeof(node));
+	hdr.numNodes++;
     }
 
     /*
-     * Save numTCs Tnm_MibTC structures:
+     * The string pool is complete now. Assemble the image behind a
+     * preliminary header which is updated once all offsets are known.
      */
 
-    fwrite((char *) &numTCs, sizeof(int), 1, fp);
-    for (i = 0, nPtr = nodePtr; nPtr; nPtr = nPtr->nextPtr) {
-	if (nPtr->typePtr) {
-	    SaveType(nPtr->typePtr, &i, fp);
-	}
+    Tcl_DStringInit(&image);
+    Tcl_DStringAppend(&image, (char *) &hdr, sizeof(hdr));
+    hdr.poolSize = (unsigned int) Tcl_DStringLength(&writer.pool);
+    hdr.poolOffset = AppendSection(&image, Tcl_DStringValue(&writer.pool),
+				   hdr.poolSize);
+    hdr.importOffset = AppendSection(&image, Tcl_DStringValue(&imports),
+				     (size_t) Tcl_DStringLength(&imports));
+    hdr.numRests = (unsigned int) writer.numRests;
+    hdr.restOffset = AppendSection(&image, (char *) rests,
+				   writer.numRests * sizeof(ImageRest));
+    hdr.numTypes = (unsigned int) writer.numTypes;
+    hdr.typeOffset = AppendSection(&image, (char *) types,
+				   writer.numTypes * sizeof(ImageType));
+    hdr.nodeOffset = AppendSection(&image, Tcl_DStringValue(&nodes),
+				   (size_t) Tcl_DStringLength(&nodes));
+    memcpy(Tcl_DStringValue(&image), (char *) &hdr, sizeof(hdr));
+
+    code = WriteAtomic(frozen, &image);
+
+    Tcl_DStringFree(&image);
+    Tcl_DStringFree(&nodes);
+    Tcl_DStringFree(&imports);
+    ckfree((char *) types);
+    ckfree((char *) rests);
+    FreeWriter(&writer);
+    return code;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * TnmMibWriteBundle --
+ *
+ *	This procedure writes a bundle which contains the complete MIB
+ *	tree, all known types and the list of modules which have been
+ *	loaded to build the tree. See the description of
+ *	TnmMibReadBundle() for an explanation of the format.
+ *
+ * Results:
+ *	A standard Tcl result.
+ *
+ * Side effects:
+ *	The bundle file is replaced.
+ *
+ *----------------------------------------------------------------------
+ */
+
+int
+TnmMibWriteBundle(char *bundle, int numModules, TnmMibModule *modules)
+{
+    ImageWriter writer;
+    BundleHeader hdr;
+    BundleModule *mods;
+    Tcl_DString srcName, image, nodes, imports;
+    ImageType *types = NULL;
+    ImageRest *rests = NULL;
+    Tcl_Obj **objv;
+    unsigned int offset;
+    int i, j, objc, code = TCL_ERROR;
+
+    if (! tnmMibTree) {
+	return TCL_ERROR;
     }
-    for (tPtr=tnmMibTypeList; tPtr != tnmMibTypeSaveMark; tPtr = tPtr->nextPtr) {
-	SaveType(tPtr, &i, fp);
+
+    memset((char *) &hdr, 0, sizeof(hdr));
+    strcpy(hdr.magic, BUNDLE_MAGIC);
+    strncpy(hdr.tnmVersion, TNM_VERSION, sizeof(hdr.tnmVersion) - 1);
+    hdr.version = BUNDLE_VERSION;
+    hdr.byteOrder = IMAGE_BYTEORDER;
+
+    InitWriter(&writer);
+    Tcl_DStringInit(&image);
+    Tcl_DStringInit(&nodes);
+    Tcl_DStringInit(&imports);
+    mods = (BundleModule *) ckalloc((numModules + 1) * sizeof(BundleModule));
+    memset((char *) mods, 0, (numModules + 1) * sizeof(BundleModule));
+
+    for (i = 0; i < numModules; i++) {
+	Tcl_DStringInit(&srcName);
+	if (SourceIdentity(modules[i].fileName, &mods[i].srcMtime,
+			   &mods[i].srcSize, &srcName) != TCL_OK) {
+	    Tcl_DStringFree(&srcName);
+	    goto done;
+	}
+	mods[i].name = PoolAddString(&writer, modules[i].name);
+	mods[i].srcName = PoolAddString(&writer, Tcl_DStringValue(&srcName));
+	mods[i].moduleName = PoolAddString(&writer, modules[i].moduleName);
+	Tcl_DStringFree(&srcName);
+	mods[i].firstImport = hdr.numImports;
+	if (modules[i].importList
+	    && Tcl_ListObjGetElements(NULL, modules[i].importList,
+				      &objc, &objv) == TCL_OK) {
+	    for (j = 0; j < objc; j++) {
+		offset = PoolAddString(&writer, Tcl_GetString(objv[j]));
+		Tcl_DStringAppend(&imports, (char *) &offset, sizeof(offset));
+		mods[i].numImports++;
+		hdr.numImports++;
+	    }
+	}
     }
-    
+
     /*
-     * Save numNodes TnmMibNode structures:
+     * Collect all types in tnmMibTypeList in the order of their
+     * definition, followed by the types only known to the nodes.
      */
 
-    fwrite((char *) &numNodes, sizeof(int), 1, fp);
-    for (i = 0, nPtr = nodePtr; nPtr; nPtr = nPtr->nextPtr) {
-	SaveNode(nPtr, &i, fp);
+    CollectTypeList(&writer, NULL);
+    hdr.numListTypes = (unsigned int) writer.numTypes;
+    CollectTreeTypes(&writer, tnmMibTree);
+
+    types = (ImageType *) ckalloc((writer.numTypes + 1) * sizeof(ImageType));
+    rests = (ImageRest *) ckalloc((writer.numRests + 1) * sizeof(ImageRest));
+    EncodeTypes(&writer, types, rests);
+    EncodeTree(&writer, tnmMibTree, 0, &nodes);
+    hdr.numNodes = (unsigned int) (Tcl_DStringLength(&nodes)
+				   / sizeof(BundleNode));
+
+    Tcl_DStringAppend(&image, (char *) &hdr, sizeof(hdr));
+    hdr.poolSize = (unsigned int) Tcl_DStringLength(&writer.pool);
+    hdr.poolOffset = AppendSection(&image, Tcl_DStringValue(&writer.pool),
+				   hdr.poolSize);
+    hdr.numModules = (unsigned int) numModules;
+    hdr.moduleOffset = AppendSection(&image, (char *) mods,
+				     numModules * sizeof(BundleModule));
+    hdr.importOffset = AppendSection(&image, Tcl_DStringValue(&imports),
+				     (size_t) Tcl_DStringLength(&imports));
+    hdr.numRests = (unsigned int) writer.numRests;
+    hdr.restOffset = AppendSection(&image, (char *) rests,
+				   writer.numRests * sizeof(ImageRest));
+    hdr.numTypes = (unsigned int) writer.numTypes;
+    hdr.typeOffset = AppendSection(&image, (char *) types,
+				   writer.numTypes * sizeof(ImageType));
+    hdr.nodeOffset = AppendSection(&image, Tcl_DStringValue(&nodes),
+				   (size_t) Tcl_DStringLength(&nodes));
+    memcpy(Tcl_DStringValue(&image), (char *) &hdr, sizeof(hdr));
+
+    code = WriteAtomic(bundle, &image);
+
+ done:
+    if (types) {
+	ckfree((char *) types);
+	ckfree((char *) rests);
     }
+    ckfree((char *) mods);
+    Tcl_DStringFree(&imports);
+    Tcl_DStringFree(&nodes);
+    Tcl_DStringFree(&image);
+    FreeWriter(&writer);
+    return code;
 }
 
 /*
  *----------------------------------------------------------------------
  *
- * TnmMibWriteFrozen --
+ * TnmMibMapFile --
  *
- *	This procedure writes a frozen MIB file. See the description
- *	of TnmMibReadFrozen() for an explanation of the format.
+ *	This procedure maps a file read-only into memory. The mapping
+ *	is shared so that all processes using the same file share the
+ *	physical pages. Systems without mmap() read the file into a
+ *	private buffer instead. Files shorter than minSize bytes are
+ *	rejected. Empty files are represented by an allocated buffer.
  *
  * Results:
- *	None.
+ *	A pointer to the contents of the file or NULL if the file can
+ *	not be mapped. The size of the file is left in sizePtr.
  *
  * Side effects:
+ *	Memory is mapped or allocated.
+ *
+ *----------------------------------------------------------------------
+ */
+
+char*
+TnmMibMapFile(char *fileName, size_t minSize, size_t *sizePtr)
+{
+    char *image = NULL;
+#ifdef HAVE_MMAP
+    struct stat st;
+    int fd;
+
+    fd = open(fileName, O_RDONLY);
+    if (fd < 0) {
+	return NULL;
+    }
+    if (fstat(fd, &st) == 0 && st.st_size >= (off_t) minSize) {
+	if (st.st_size == 0) {
+	    image = ckalloc(1);
+	    *sizePtr = 0;
+	} else {
+	    image = mmap(NULL, (size_t) st.st_size, PROT_READ, MAP_SHARED,
+			 fd, 0);
+	    if (image == (char *) MAP_FAILED) {
+		image = NULL;
+	    } else {
+		*sizePtr = (size_t) st.st_size;
+	    }
+	}
+    }
+    close(fd);
+#else
+    FILE *fp;
+    long size;
+
+    fp = fopen(fileName, "rb");
+    if (fp == NULL) {
+	return NULL;
+    }
+    if (fseek(fp, 0, SEEK_END) == 0 && (size = ftell(fp)) >= 0
+	&& size >= (long) minSize && fseek(fp, 0, SEEK_SET) == 0) {
+	image = ckalloc((unsigned) size + 1);
+	if (fread(image, 1, (size_t) size, fp) != (size_t) size) {
+	    ckfree(image);
+	    image = NULL;
+	} else {
+	    *sizePtr = (size_t) size;
+	}
+    }
+    fclose(fp);
+#endif
+    return image;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * TnmMibUnmapFile --
+ *
+ *	This procedure releases a file mapped by TnmMibMapFile().
+ *	Frozen images which have been loaded are never released since
+ *	the MIB tree refers to their strings.
+ *
+ * Results:
  *	None.
  *
+ * Side effects:
+ *	Memory is unmapped or freed.
+ *
  *----------------------------------------------------------------------
  */
 
 void
-TnmMibWriteFrozen(FILE *fp, TnmMibNode *nodePtr)
+TnmMibUnmapFile(char *image, size_t size)
 {
-    int numEnums, numTcs, numNodes; 
-    PoolInit();
-    CollectData(&numEnums, &numTcs, &numNodes, nodePtr);
-    PoolSave(fp);
-    SaveData(fp, numEnums, numTcs, numNodes, nodePtr);
-    PoolDelete();
+#ifdef HAVE_MMAP
+    if (size == 0) {
+	ckfree(image);
+    } else {
+	munmap(image, size);
+    }
+#else
+    ckfree(image);
+#endif
 }
 
 /*
  *----------------------------------------------------------------------
  *
- * TnmMibReadFrozen --
+ * CheckSection --
  *
- *	This procedure reads a frozen MIB file that was written by 
- *	TnmMibWriteFrozen(). The expected format is:
+ *	This procedure checks that a section of count records of the
+ *	given size is aligned and ends within the image.
  *
- *	int (stringpool size)
- *		pool_size bytes
- *	int (number of enum structs)
- *		#enum structs
- *	int (number of textual conventions)
- *		#tc structs
- *	int (number of nodes)
- *		#node structs
+ * Results:
+ *	1 if the section is valid and 0 otherwise.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+CheckSection(size_t imageSize, unsigned int offset, unsigned int count,
+	     size_t size)
+{
+    return (offset % 8 == 0 && offset <= imageSize
+	    && count <= (imageSize - offset) / size);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * PoolString --
+ *
+ *	This procedure converts a string pool offset into a pointer.
+ *	The offset 0 represents a NULL pointer.
  *
  * Results:
- *	A pointer to the MIB root node or NULL if there was an error.
+ *	A pointer into the string pool or NULL. The integer pointed to
+ *	by okPtr is cleared if the offset is out of range.
  *
  * Side effects:
  *	None.
@@ -548,173 +1066,503 @@ TnmMibWriteFrozen(FILE *fp, TnmMibNode *nodePtr)
  *----------------------------------------------------------------------
  */
 
-TnmMibNode*
-TnmMibReadFrozen(FILE *fp)
+static char*
+PoolString(char *pool, unsigned int poolSize, unsigned int offset, int *okPtr)
 {
-    TnmMibNode *root = NULL;
-    size_t poolSize;
-    char *pool;
-    size_t numEnums;
-    TnmMibRest *enums = NULL;
-    size_t numTcs;
-    TnmMibType *tcs = NULL;
-    size_t numNodes;
+    if (offset == 0) {
+	return NULL;
+    }
+    if (offset >= poolSize) {
+	*okPtr = 0;
+	return NULL;
+    }
+    return pool + offset;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * DecodeTypes --
+ *
+ *	This procedure converts the type and restriction records of
+ *	an image into TnmMibType and TnmMibRest structures.
+ *
+ * Results:
+ *	1 if all records are valid and 0 otherwise.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+DecodeTypes(char *pool, unsigned int poolSize,
+	    ImageType *iTypes, unsigned int numTypes,
+	    ImageRest *iRests, unsigned int numRests,
+	    TnmMibType *types, TnmMibRest *rests)
+{
+    unsigned int i, j;
+    int ok = 1;
+
+    for (i = 0; ok && i < numTypes; i++) {
+	ImageType *itPtr = iTypes + i;
+	TnmMibType *typePtr = types + i;
+	memset((char *) typePtr, 0, sizeof(TnmMibType));
+	typePtr->name = PoolString(pool, poolSize, itPtr->name, &ok);
+	typePtr->moduleName = PoolString(pool, poolSize,
+					 itPtr->moduleName, &ok);
+	typePtr->fileName = PoolString(pool, poolSize, itPtr->fileName, &ok);
+	typePtr->displayHint = PoolString(pool, poolSize,
+					  itPtr->displayHint, &ok);
+	typePtr->fileOffset = itPtr->fileOffset;
+	typePtr->syntax = itPtr->syntax;
+	typePtr->macro = itPtr->macro;
+	typePtr->status = itPtr->status;
+	typePtr->restKind = itPtr->restKind;
+	if (! typePtr->name || (itPtr->restList && (itPtr->numRests == 0
+	    || itPtr->restList - 1 + itPtr->numRests > numRests))) {
+	    return 0;
+	}
+	for (j = 0; itPtr->restList && j < itPtr->numRests; j++) {
+	    ImageRest *irPtr = iRests + itPtr->restList - 1 + j;
+	    TnmMibRest *restPtr = rests + itPtr->restList - 1 + j;
+	    if (itPtr->restKind == TNM_MIB_REST_ENUMS) {
+		restPtr->rest.intEnum.enumValue = (int) irPtr->min;
+		restPtr->rest.intEnum.enumLabel =
+		    PoolString(pool, poolSize, irPtr->label, &ok);
+	    } else {
+		restPtr->rest.unsRange.min = irPtr->min;
+		restPtr->rest.unsRange.max = irPtr->max;
+	    }
+	    restPtr->nextPtr = (j + 1 < itPtr->numRests) ? restPtr + 1 : NULL;
+	}
+	if (itPtr->restList) {
+	    typePtr->restList = rests + itPtr->restList - 1;
+	}
+    }
+    return ok;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * DecodeNode --
+ *
+ *	This procedure converts a node record of an image into a
+ *	TnmMibNode structure. The links are left to the caller.
+ *
+ * Results:
+ *	1 if the record is valid and 0 otherwise.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+DecodeNode(char *pool, unsigned int poolSize, ImageNode *inPtr,
+	   unsigned int numTypes, TnmMibNode *nodePtr)
+{
+    int ok = 1;
+
+    memset((char *) nodePtr, 0, sizeof(TnmMibNode));
+    nodePtr->subid = inPtr->subid;
+    nodePtr->label = PoolString(pool, poolSize, inPtr->label, &ok);
+    nodePtr->parentName = PoolString(pool, poolSize, inPtr->parentName, &ok);
+    nodePtr->moduleName = PoolString(pool, poolSize, inPtr->moduleName, &ok);
+    nodePtr->fileName = PoolString(pool, poolSize, inPtr->fileName, &ok);
+    nodePtr->index = PoolString(pool, poolSize, inPtr->index, &ok);
+    nodePtr->fileOffset = inPtr->fileOffset;
+    nodePtr->syntax = inPtr->syntax;
+    nodePtr->access = inPtr->access;
+    nodePtr->macro = inPtr->macro;
+    nodePtr->status = inPtr->status;
+    nodePtr->implied = inPtr->implied;
+    nodePtr->augment = inPtr->augment;
+    return (ok && inPtr->type <= numTypes
+	    && nodePtr->label && nodePtr->parentName);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * ResolveTypes --
+ *
+ *	This procedure resolves the types of an image by name like
+ *	the parser does and registers the ones not known yet. The
+ *	resolved types are left in typeTab.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	New types are added to the list of known types.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+ResolveTypes(TnmMibType *types, unsigned int numTypes, TnmMibType **typeTab)
+{
+    unsigned int i;
+
+    for (i = 0; i < numTypes; i++) {
+	typeTab[i] = TnmMibFindType(types[i].name);
+	if (! typeTab[i]) {
+	    typeTab[i] = TnmMibAddType(types + i);
+	}
+    }
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * TnmMibReadFrozen --
+ *
+ *	This procedure loads a frozen MIB file that was written by
+ *	TnmMibWriteFrozen(). The image is accepted if it has been
+ *	written by this version for the given MIB file and if the
+ *	MIB file has not been modified since. The image format is:
+ *
+ *	ImageHeader
+ *	string pool	(poolSize bytes)
+ *	imports		(numImports string pool offsets)
+ *	ImageRest	(numRests records)
+ *	ImageType	(numTypes records, own types first)
+ *	ImageNode	(numNodes records, in node list order)
+ *
+ *	All sections start at offsets aligned to 8 bytes. The strings
+ *	stay in the mapped image. The records are converted into one
+ *	block of TnmMibRest, TnmMibType and TnmMibNode structures in
+ *	a single pass.
+ *
+ * Results:
+ *	A standard Tcl result. The list of nodes is left in nodeListPtr.
+ *
+ * Side effects:
+ *	New types are added to the list of known types and the
+ *	imported modules are appended to tnmMibImportList.
+ *
+ *----------------------------------------------------------------------
+ */
+
+int
+TnmMibReadFrozen(char *frozen, char *file, TnmMibNode **nodeListPtr)
+{
+    ImageHeader *hdrPtr;
+    ImageNode *iNodes;
+    unsigned int *iImports;
+    TnmMibRest *rests;
+    TnmMibType *types, **typeTab;
     TnmMibNode *nodes;
+    Tcl_WideInt mtime, size;
+    Tcl_DString srcName;
+    char *image, *pool, *block;
+    size_t imageSize;
+    unsigned int i;
+    int ok;
+
+    image = TnmMibMapFile(frozen, sizeof(ImageHeader), &imageSize);
+    if (! image) {
+	return TCL_ERROR;
+    }
 
     /*
-     * First, read the string space: 
+     * Check the header and the bounds of all sections before we
+     * touch anything else.
      */
 
-    if (1 != fread((char *) &poolSize, sizeof(int), 1, fp)) {
-	TnmWriteLogMessage(NULL, TNM_LOG_DEBUG, TNM_LOG_USER,
-			   "error reading string pool size...\n");
-	return NULL;
+    hdrPtr = (ImageHeader *) image;
+    Tcl_DStringInit(&srcName);
+    ok = (strncmp(hdrPtr->magic, IMAGE_MAGIC, sizeof(hdrPtr->magic)) == 0
+	  && hdrPtr->version == IMAGE_VERSION
+	  && hdrPtr->byteOrder == IMAGE_BYTEORDER
+	  && strncmp(hdrPtr->tnmVersion, TNM_VERSION,
+		     sizeof(hdrPtr->tnmVersion)) == 0
+	  && hdrPtr->poolOffset >= sizeof(ImageHeader)
+	  && hdrPtr->poolSize > 0
+	  && CheckSection(imageSize, hdrPtr->poolOffset, hdrPtr->poolSize, 1)
+	  && image[hdrPtr->poolOffset + hdrPtr->poolSize - 1] == '\0'
+	  && CheckSection(imageSize, hdrPtr->importOffset,
+			  hdrPtr->numImports, sizeof(unsigned int))
+	  && CheckSection(imageSize, hdrPtr->restOffset,
+			  hdrPtr->numRests, sizeof(ImageRest))
+	  && CheckSection(imageSize, hdrPtr->typeOffset,
+			  hdrPtr->numTypes, sizeof(ImageType))
+	  && CheckSection(imageSize, hdrPtr->nodeOffset,
+			  hdrPtr->numNodes, sizeof(ImageNode))
+	  && hdrPtr->numOwnTypes <= hdrPtr->numTypes
+	  && SourceIdentity(file, &mtime, &size, &srcName) == TCL_OK
+	  && mtime == hdrPtr->srcMtime && size == hdrPtr->srcSize
+	  && hdrPtr->srcName > 0 && hdrPtr->srcName < hdrPtr->poolSize
+	  && strcmp(image + hdrPtr->poolOffset + hdrPtr->srcName,
+		    Tcl_DStringValue(&srcName)) == 0);
+    Tcl_DStringFree(&srcName);
+    if (! ok) {
+	TnmMibUnmapFile(image, imageSize);
+	return TCL_ERROR;
     }
 
-    pool = ckalloc(poolSize);
-    if (poolSize != fread(pool, 1, poolSize, fp)) {
-        TnmWriteLogMessage(NULL, TNM_LOG_DEBUG, TNM_LOG_USER,
-			   "error reading string pool...\n");
-	return NULL;
+    pool = image + hdrPtr->poolOffset;
+    iImports = (unsigned int *) (image + hdrPtr->importOffset);
+    iNodes = (ImageNode *) (image + hdrPtr->nodeOffset);
+
+    block = ckalloc(hdrPtr->numRests * sizeof(TnmMibRest)
+		    + hdrPtr->numTypes * sizeof(TnmMibType)
+		    + hdrPtr->numNodes * sizeof(TnmMibNode) + 1);
+    types = (TnmMibType *) block;
+    nodes = (TnmMibNode *) (types + hdrPtr->numTypes);
+    rests = (TnmMibRest *) (nodes + hdrPtr->numNodes);
+
+    ok = DecodeTypes(pool, hdrPtr->poolSize,
+		     (ImageType *) (image + hdrPtr->typeOffset),
+		     hdrPtr->numTypes,
+		     (ImageRest *) (image + hdrPtr->restOffset),
+		     hdrPtr->numRests, types, rests);
+    for (i = 0; ok && i < hdrPtr->numNodes; i++) {
+	ok = DecodeNode(pool, hdrPtr->poolSize, iNodes + i,
+			hdrPtr->numTypes, nodes + i);
+	nodes[i].nextPtr = (i + 1 < hdrPtr->numNodes) ? nodes + i + 1 : NULL;
     }
-    if (strcmp(pool, TNM_VERSION) != 0) {
-       TnmWriteLogMessage(NULL, TNM_LOG_DEBUG, TNM_LOG_USER,
-			   "wrong .idy file version...\n");
-	return NULL;
+    for (i = 0; ok && i < hdrPtr->numImports; i++) {
+	if (! PoolString(pool, hdrPtr->poolSize, iImports[i], &ok)) {
+	    ok = 0;
+	}
+    }
+    if (! ok) {
+	ckfree(block);
+	TnmMibUnmapFile(image, imageSize);
+	return TCL_ERROR;
     }
 
     /*
-     * Next, read the restrictions:
+     * The image is fine. The types defined by this file refer to
+     * the name used to load the file, like the parser does. Resolve
+     * the types by name and link the nodes to the resolved types.
      */
 
-    if (1 != fread((char *) &numEnums, sizeof(numEnums), 1, fp)) {
-        TnmWriteLogMessage(NULL, TNM_LOG_DEBUG, TNM_LOG_USER,
-			   "error reading enum counter...\n");
-	return NULL;
+    for (i = 0; i < hdrPtr->numOwnTypes; i++) {
+	types[i].fileName = tnmMibFileName;
     }
-
-    if (numEnums > 0) {
-	TnmMibRest *restPtr;
-	int i;
-	enums = (TnmMibRest *) ckalloc(numEnums * sizeof(TnmMibRest));
-	if (numEnums != fread(enums, sizeof(TnmMibRest), numEnums, fp)) {
-	    TnmWriteLogMessage(NULL, TNM_LOG_DEBUG, TNM_LOG_USER,
-			       "error reading enums...\n");
-	    ckfree((char *) enums);
-	    return NULL;
+    typeTab = (TnmMibType **) ckalloc((hdrPtr->numTypes + 1)
+				      * sizeof(TnmMibType *));
+    ResolveTypes(types, hdrPtr->numTypes, typeTab);
+    for (i = 0; i < hdrPtr->numNodes; i++) {
+	if (iNodes[i].type) {
+	    nodes[i].typePtr = typeTab[iNodes[i].type - 1];
 	}
-    
-	/* 
-	 * Chain the pointers:
-	 */
-	
-	for (i = 0, restPtr = enums; i < (int) numEnums; i++, restPtr++) {
-	    restPtr->nextPtr = restPtr->nextPtr ? restPtr + 1 : 0;
+    }
+    ckfree((char *) typeTab);
+
+    if (tnmMibImportList) {
+	for (i = 0; i < hdrPtr->numImports; i++) {
+	    Tcl_ListObjAppendElement(NULL, tnmMibImportList,
+				     Tcl_NewStringObj(pool + iImports[i], -1));
 	}
     }
 
+    *nodeListPtr = hdrPtr->numNodes ? nodes : NULL;
+    return TCL_OK;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * TnmMibReadBundle --
+ *
+ *	This procedure loads a bundle that was written by
+ *	TnmMibWriteBundle() for the same list of modules into an
+ *	empty MIB tree. The bundle format is:
+ *
+ *	BundleHeader
+ *	string pool	(poolSize bytes)
+ *	BundleModule	(numModules records, in load order)
+ *	imports		(numImports string pool offsets)
+ *	ImageRest	(numRests records)
+ *	ImageType	(numTypes records, tnmMibTypeList first)
+ *	BundleNode	(numNodes records, the tree in preorder)
+ *
+ *	The bundle is rejected if any MIB file has been modified.
+ *	Such modules are marked dirty in the modules array, together
+ *	with all modules which import them directly or indirectly,
+ *	since their frozen files may depend on the old definitions.
+ *
+ * Results:
+ *	A standard Tcl result. The names of the MIB modules are left
+ *	in the modules array.
+ *
+ * Side effects:
+ *	The MIB tree is installed and the types are registered.
+ *
+ *----------------------------------------------------------------------
+ */
+
+int
+TnmMibReadBundle(char *bundle, int numModules, TnmMibModule *modules)
+{
+    BundleHeader *hdrPtr;
+    BundleModule *mods;
+    BundleNode *iNodes;
+    unsigned int *iImports;
+    TnmMibRest *rests;
+    TnmMibType *types, **typeTab;
+    TnmMibNode *nodes;
+    Tcl_WideInt mtime, size;
+    Tcl_DString srcName;
+    char *image, *pool, *block, *name, *src;
+    size_t imageSize;
+    unsigned int i, j, k;
+    int ok, dirty = 0, changed;
+
+    image = TnmMibMapFile(bundle, sizeof(BundleHeader), &imageSize);
+    if (! image) {
+	return TCL_ERROR;
+    }
+
+    hdrPtr = (BundleHeader *) image;
+    ok = (imageSize >= sizeof(BundleHeader)
+	  && strncmp(hdrPtr->magic, BUNDLE_MAGIC, sizeof(hdrPtr->magic)) == 0
+	  && hdrPtr->version == BUNDLE_VERSION
+	  && hdrPtr->byteOrder == IMAGE_BYTEORDER
+	  && strncmp(hdrPtr->tnmVersion, TNM_VERSION,
+		     sizeof(hdrPtr->tnmVersion)) == 0
+	  && hdrPtr->poolOffset >= sizeof(BundleHeader)
+	  && hdrPtr->poolSize > 0
+	  && CheckSection(imageSize, hdrPtr->poolOffset, hdrPtr->poolSize, 1)
+	  && image[hdrPtr->poolOffset + hdrPtr->poolSize - 1] == '\0'
+	  && CheckSection(imageSize, hdrPtr->moduleOffset,
+			  hdrPtr->numModules, sizeof(BundleModule))
+	  && CheckSection(imageSize, hdrPtr->importOffset,
+			  hdrPtr->numImports, sizeof(unsigned int))
+	  && CheckSection(imageSize, hdrPtr->restOffset,
+			  hdrPtr->numRests, sizeof(ImageRest))
+	  && CheckSection(imageSize, hdrPtr->typeOffset,
+			  hdrPtr->numTypes, sizeof(ImageType))
+	  && CheckSection(imageSize, hdrPtr->nodeOffset,
+			  hdrPtr->numNodes, sizeof(BundleNode))
+	  && hdrPtr->numListTypes <= hdrPtr->numTypes
+	  && hdrPtr->numNodes > 0
+	  && hdrPtr->numModules == (unsigned int) numModules);
+    if (! ok) {
+	TnmMibUnmapFile(image, imageSize);
+	return TCL_ERROR;
+    }
+
+    pool = image + hdrPtr->poolOffset;
+    mods = (BundleModule *) (image + hdrPtr->moduleOffset);
+    iImports = (unsigned int *) (image + hdrPtr->importOffset);
+    iNodes = (BundleNode *) (image + hdrPtr->nodeOffset);
+
     /*
-     * Next, read the textual conventions: 
+     * Check that the bundle has been written for this list of
+     * modules and find the modules whose files have been modified.
      */
 
-    if (1 != fread((char *) &numTcs, sizeof(numTcs), 1, fp)) {
-	TnmWriteLogMessage(NULL, TNM_LOG_DEBUG, TNM_LOG_USER,
-			   "error reading tc counter...\n");
-	return NULL;
+    for (i = 0; ok && i < hdrPtr->numModules; i++) {
+	name = PoolString(pool, hdrPtr->poolSize, mods[i].name, &ok);
+	src = PoolString(pool, hdrPtr->poolSize, mods[i].srcName, &ok);
+	(void) PoolString(pool, hdrPtr->poolSize, mods[i].moduleName, &ok);
+	if (! ok || ! name || ! src || strcmp(name, modules[i].name) != 0
+	    || mods[i].firstImport > hdrPtr->numImports
+	    || mods[i].numImports > hdrPtr->numImports - mods[i].firstImport) {
+	    ok = 0;
+	    break;
+	}
+	Tcl_DStringInit(&srcName);
+	if (SourceIdentity(modules[i].fileName, &mtime, &size,
+			   &srcName) != TCL_OK
+	    || mtime != mods[i].srcMtime || size != mods[i].srcSize
+	    || strcmp(src, Tcl_DStringValue(&srcName)) != 0) {
+	    modules[i].dirty = 1;
+	    dirty++;
+	}
+	Tcl_DStringFree(&srcName);
+    }
+    for (i = 0; ok && i < hdrPtr->numImports; i++) {
+	if (! PoolString(pool, hdrPtr->poolSize, iImports[i], &ok)) {
+	    ok = 0;
+	}
+    }
+    if (! ok) {
+	for (i = 0; i < (unsigned int) numModules; i++) {
+	    modules[i].dirty = 0;
+	}
+	TnmMibUnmapFile(image, imageSize);
+	return TCL_ERROR;
     }
 
-    if (numTcs > 0) {
-	TnmMibType *typePtr;
-	int i;
+    /*
+     * Propagate the dirty flag to the modules which import a dirty
+     * module until nothing changes anymore.
+     */
 
-	tcs = (TnmMibType *) ckalloc(numTcs * sizeof(TnmMibType));
-	if (numTcs != fread(tcs, sizeof(TnmMibType), numTcs, fp)) {
-	    TnmWriteLogMessage(NULL, TNM_LOG_DEBUG, TNM_LOG_USER,
-			       "error reading tcs...\n");
-	    ckfree((char *) tcs);
-	    return NULL;
-	}
-	
-	/* 
-	 * Adjust string and enum pointers: 
-	 */
-
-	for (i = 0, typePtr = tcs; i < (int) numTcs; i++, typePtr++) {
-	    typePtr->name = (int) typePtr->name + pool;
-	    if (typePtr->fileName) {
-	        typePtr->fileName = (int) typePtr->fileName + pool;
-	    }
-	    if (typePtr->moduleName) {
-	        typePtr->moduleName = (int) typePtr->moduleName + pool;
-	    }
-	    if (typePtr->displayHint) {
-		typePtr->displayHint = (int) typePtr->displayHint + pool;
-	    }
-	    if (typePtr->restList) {
-		typePtr->restList = (int) typePtr->restList + enums - 1;
-		if (typePtr->restKind == TNM_MIB_REST_ENUMS) {
-		    /* Adjust the string pool pointers. */
-		    TnmMibRest *restPtr;
-		    for (restPtr = typePtr->restList;
-			 restPtr;
-			 restPtr = restPtr->nextPtr) {
-			restPtr->rest.intEnum.enumLabel = 
-			    (int) restPtr->rest.intEnum.enumLabel + pool;
+    if (dirty) {
+	do {
+	    changed = 0;
+	    for (i = 0; i < hdrPtr->numModules; i++) {
+		for (j = 0; ! modules[i].dirty && j < mods[i].numImports; j++) {
+		    name = pool + iImports[mods[i].firstImport + j];
+		    for (k = 0; k < hdrPtr->numModules; k++) {
+			if (modules[k].dirty && mods[k].moduleName
+			    && strcmp(pool + mods[k].moduleName, name) == 0) {
+			    modules[i].dirty = 1;
+			    changed = 1;
+			    break;
+			}
 		    }
 		}
 	    }
-	    if (typePtr->name[0] != '_') {
-		TnmMibAddType(typePtr);
-	    }
-	}	
+	} while (changed);
+	TnmMibUnmapFile(image, imageSize);
+	return TCL_ERROR;
     }
 
-    /*
-     * Next, read the MIB nodes:
-     */
+    block = ckalloc(hdrPtr->numRests * sizeof(TnmMibRest)
+		    + hdrPtr->numTypes * sizeof(TnmMibType)
+		    + hdrPtr->numNodes * sizeof(TnmMibNode) + 1);
+    types = (TnmMibType *) block;
+    nodes = (TnmMibNode *) (types + hdrPtr->numTypes);
+    rests = (TnmMibRest *) (nodes + hdrPtr->numNodes);
 
-    if (1 != fread((char *) &numNodes, sizeof(numNodes), 1, fp)) {
-	TnmWriteLogMessage(NULL, TNM_LOG_DEBUG, TNM_LOG_USER,
-			   "error reading node counter...\n");
-	return NULL;
+    ok = DecodeTypes(pool, hdrPtr->poolSize,
+		     (ImageType *) (image + hdrPtr->typeOffset),
+		     hdrPtr->numTypes,
+		     (ImageRest *) (image + hdrPtr->restOffset),
+		     hdrPtr->numRests, types, rests);
+    for (i = 0; ok && i < hdrPtr->numNodes; i++) {
+	BundleNode *bnPtr = iNodes + i;
+	ok = DecodeNode(pool, hdrPtr->poolSize, &bnPtr->node,
+			hdrPtr->numTypes, nodes + i)
+	    && bnPtr->parent <= hdrPtr->numNodes
+	    && bnPtr->child <= hdrPtr->numNodes
+	    && bnPtr->next <= hdrPtr->numNodes;
+	nodes[i].parentPtr = bnPtr->parent ? nodes + bnPtr->parent - 1 : NULL;
+	nodes[i].childPtr = bnPtr->child ? nodes + bnPtr->child - 1 : NULL;
+	nodes[i].nextPtr = bnPtr->next ? nodes + bnPtr->next - 1 : NULL;
+    }
+    if (! ok || iNodes[0].parent) {
+	ckfree(block);
+	TnmMibUnmapFile(image, imageSize);
+	return TCL_ERROR;
     }
 
-    if (numNodes > 0) {
-	TnmMibNode *ptr;
-	int i;
-
-	nodes = (TnmMibNode *) ckalloc(numNodes * sizeof(TnmMibNode));
-	if (numNodes != fread(nodes, sizeof(TnmMibNode), numNodes, fp)) {
-	    TnmWriteLogMessage(NULL, TNM_LOG_DEBUG, TNM_LOG_USER,
-			       "error reading nodes...\n");
-	    ckfree((char *) nodes);
-	    return NULL;
+    typeTab = (TnmMibType **) ckalloc((hdrPtr->numTypes + 1)
+				      * sizeof(TnmMibType *));
+    ResolveTypes(types, hdrPtr->numTypes, typeTab);
+    for (i = 0; i < hdrPtr->numNodes; i++) {
+	if (iNodes[i].node.type) {
+	    nodes[i].typePtr = typeTab[iNodes[i].node.type - 1];
 	}
-	
-	/*
-	 * Adjust string and tc pointers:
-	 */
-
-	for (i = 0, ptr = nodes; i < (int) numNodes; i++, ptr++) {
-	    ptr->label = (int) ptr->label + pool;
-	    ptr->parentName = (int) ptr->parentName + pool;
-	    if (ptr->fileName) {
-	        ptr->fileName = (int) ptr->fileName + pool;
-	    }
-	    if (ptr->moduleName) {
-	        ptr->moduleName = (int) ptr->moduleName + pool;
-	    }
-	    if (ptr->index) {
-	        ptr->index = (int) ptr->index + pool;
-	    }
-	    if (ptr->typePtr) {
-	        ptr->typePtr = (int) ptr->typePtr + tcs - 1;
-	    }
-	    ptr->nextPtr = ptr->nextPtr ? ptr + 1 : 0;
-	}
-	root = nodes;
     }
-    
-    return root;
-}
+    ckfree((char *) typeTab);
 
+    for (i = 0; i < hdrPtr->numModules; i++) {
+	modules[i].moduleName = mods[i].moduleName
+	    ? pool + mods[i].moduleName : NULL;
+    }
+
+    TnmMibInstallTree(nodes);
+    return TCL_OK;
+}
@@ -124,8 +124,7 @@
 #define NUM_ENTRIES	151
 #define SIGNEDNUMBER	152
 
-#define	HASHTAB_SIZE	17			/* size of hash table */
-#define	HASH(x)		(x % HASHTAB_SIZE)	/* Hash function      */
+#define	KEYTAB_SIZE	1024			/* size of keyword table */
 
 #define NODEHASHSIZE	127			/* hashsize for nodes */
 
@@ -135,16 +134,45 @@
 #define OUT_OF_MIB	2
 
 /*
- * Structure definition to hold the keyword table:
+ * The MIB file is mapped into memory and read through the following
+ * structure. The macros below replace getc(), ungetc() and ftell().
+ */
+
+typedef struct MibInput {
+    char *buffer;		/* The contents of the MIB file. */
+    char *cur;			/* The next character to read. */
+    char *end;			/* The end of the contents. */
+} MibInput;
+
+#define GetChar(in) \
+	((in)->cur < (in)->end ? (unsigned char) *(in)->cur++ : EOF)
+#define UngetChar(in)	((in)->cur--)
+#define TellInput(in)	((long) ((in)->cur - (in)->buffer))
+
+/*
+ * Character classes used by the tokenizer. Characters without a
+ * class are part of a keyword.
+ */
+
+#define CHAR_SPACE	0x01	/* White space which ends a keyword. */
+#define CHAR_PUNCT	0x02	/* Punctuation which ends a keyword. */
+
+/*
+ * Structure definition to hold the keyword table. The keywords are
+ * stored in a perfect hash table, i.e. every keyword has its own
+ * slot in the table. The hash function is seeded with a value
+ * that avoids collisions.
  */
 
 typedef struct Keyword {
    char			*name;		/* keyword name			    */
    int			key;		/* value			    */
-   int			hash;		/* hash of name			    */
-   struct Keyword	*nextPtr;	/* pointer to next in hash table    */
+   unsigned int		hash;		/* hash of name			    */
 } Keyword;
 
+#define KEYHASH_INIT(seed)	(2166136261U ^ (seed))
+#define KEYHASH_STEP(h, c)	(((h) ^ (unsigned char) (c)) * 16777619U)
+
 static Keyword keywords[] =
 {
    { "DEFINITIONS",		DEFINITIONS,		0 },
@@ -258,7 +286,9 @@ struct subid {			/* Element of an object identifier          */
 static int lastchar = ' ';	/* The last read character. */
 static int line = 1;		/* The current line number. */
 
-static Keyword *hashtab[HASHTAB_SIZE];
+static Keyword *keytab[KEYTAB_SIZE];
+static unsigned int keySeed;		/* The seed of the keyword hash.   */
+static unsigned char charClass[256];	/* The class of every character.   */
 
 /*
  * A faster strcmp(). Note, some compiler optimize strcmp() et.al.
@@ -283,67 +313,67 @@ static TnmMibRest*
 ScanRange		(char *str);
 
 static int
-ReadIntEnums		(FILE *fp, char **strPtr);
+ReadIntEnums		(MibInput *in, char **strPtr);
 
 static int
-ReadRange		(FILE *fp, char **strPtr);
+ReadRange		(MibInput *in, char **strPtr);
 
 static char*
-ReadNameList		(FILE *fp);
+ReadNameList		(MibInput *in);
 
 static TnmMibType*
 CreateType		(char *name, int syntax, char *displayHint,
 				     char *enums);
 static TnmMibNode*
-ParseFile		(FILE *fp);
+ParseFile		(MibInput *in);
 
 static int
-ParseHeader		(FILE *fp, char *keyword);
+ParseHeader		(MibInput *in, char *keyword);
 
 static int
-ParseASN1Type		(FILE *fp, char *keyword);
+ParseASN1Type		(MibInput *in, char *keyword);
 
 static TnmMibNode*
-ParseModuleCompliance	(FILE *fp, char *name, 
+ParseModuleCompliance	(MibInput *in, char *name, 
 				     TnmMibNode **nodeList);
 static TnmMibNode*
-ParseModuleIdentity	(FILE *fp, char *name, 
+ParseModuleIdentity	(MibInput *in, char *name, 
 				     TnmMibNode **nodeList);
 static TnmMibNode*
-ParseNotificationType	(FILE *fp, char *name,
+ParseNotificationType	(MibInput *in, char *name,
 				     TnmMibNode **nodeList);
 static TnmMibNode*
-ParseNotificationGroup	(FILE *fp, char *name,
+ParseNotificationGroup	(MibInput *in, char *name,
 				     TnmMibNode **nodeList);
 static TnmMibNode*
-ParseCapabilitiesType	(FILE *fp, char *name,
+ParseCapabilitiesType	(MibInput *in, char *name,
 				     TnmMibNode **nodeList);
 static TnmMibNode*
-ParseTrapType		(FILE *fp, char *name, 
+ParseTrapType		(MibInput *in, char *name, 
 				     TnmMibNode **nodeList);
 static TnmMibNode*
-ParseObjectGroup	(FILE *fp, char *name,
+ParseObjectGroup	(MibInput *in, char *name,
 				     TnmMibNode **nodeList);
 static TnmMibNode*
-ParseObjectIdentity	(FILE *fp, char *name,
+ParseObjectIdentity	(MibInput *in, char *name,
 				     TnmMibNode **nodeList);
 static TnmMibNode*
-ParseObjectID		(FILE *fp, char *name,
+ParseObjectID		(MibInput *in, char *name,
 				     TnmMibNode **nodeList);
 static TnmMibNode*
-ParseObjectType		(FILE *fp, char *name,
+ParseObjectType		(MibInput *in, char *name,
 				     TnmMibNode **nodeList);
 static int
-ParseNodeList		(FILE *fp, TnmMibNode **nodeList,
+ParseNodeList		(MibInput *in, TnmMibNode **nodeList,
 				     TnmMibNode *nodePtr);
 static void
 HashKeywords		(void);
 
 static int
-ReadKeyword		(FILE *fp, char *keyword);
+ReadKeyword		(MibInput *in, char *keyword);
 
 static struct subid *
-ReadSubID		(FILE *fp);
+ReadSubID		(MibInput *in);
 
 
 /*
@@ -363,60 +393,56 @@ AddNewNode(TnmMibNode **nodeList, char *label, char *parentName, u_int subid)
 }
 
 /*
- * TnmMibParse() opens a MIB file specified by file and returns a 
+ * TnmMibParse() maps a MIB file specified by file and returns a 
  * tree of objects in that MIB. The function returns a pointer to 
- * the "root" of the MIB, or NULL if an error occurred.
+ * the "root" of the MIB, or NULL if an error occurred. The frozen
+ * image is used instead of the MIB file if it is up to date.
+ * Otherwise, the MIB file is parsed and a new image is written.
  */
 
 char*
 TnmMibParse(char *file, char *frozen)
 {
-    FILE *fp;		/* The current FILE pointer. */
+    MibInput input;	/* The contents of the MIB file. */
+    size_t size;
     TnmMibNode *nodePtr = NULL;
-    Tcl_StatBuf stbuf;
-    time_t mib_mtime = 0, frozen_mtime = 0;
-    Tcl_Obj *obj = NULL;
 
     tnmMibFileName = ckstrdup(file);
-    obj = Tcl_NewStringObj(file, -1);
-    Tcl_IncrRefCount(obj);
-    if (Tcl_FSStat(obj, &stbuf) == 0) {
-	mib_mtime = stbuf.st_mtime;
+
+    /* save pointer to still known tt's: */
+    tnmMibTypeSaveMark = tnmMibTypeList;
+
+    /* collect the modules imported by this file: */
+    if (tnmMibImportList) {
+	Tcl_DecrRefCount(tnmMibImportList);
     }
-    Tcl_DecrRefCount(obj);
+    tnmMibImportList = Tcl_NewListObj(0, NULL);
+    Tcl_IncrRefCount(tnmMibImportList);
 
-    if (! frozen || mib_mtime == 0 || frozen_mtime == 0 || frozen_mtime < mib_mtime) {
-	fp = fopen(file, "rb");
-	if (fp == NULL) {
+    if (! frozen || TnmMibReadFrozen(frozen, file, &nodePtr) != TCL_OK) {
+	input.buffer = TnmMibMapFile(file, 0, &size);
+	if (input.buffer == NULL) {
 	    return NULL;
 	}
-	/* save pointer to still known tt's: */
-	tnmMibTypeSaveMark = tnmMibTypeList;
-	nodePtr = ParseFile(fp);
-	fclose(fp);
-	if (frozen) {
-	    if (nodePtr == NULL && tnmMibTypeList == tnmMibTypeSaveMark) {
+	input.cur = input.buffer;
+	input.end = input.buffer + size;
+	nodePtr = ParseFile(&input);
+	TnmMibUnmapFile(input.buffer, size);
+	if (nodePtr == NULL && tnmMibTypeList == tnmMibTypeSaveMark) {
+	    if (frozen) {
 		unlink(frozen);
-		return NULL;
-	    } else {
-		fp = fopen(frozen, "wb");
-		if (fp != NULL) {
-		    TnmMibWriteFrozen(fp, nodePtr);
-				fclose(fp);
-		}
 	    }
+	    return NULL;
 	}
-    } else {
-	nodePtr = NULL;
-	fp = fopen(frozen, "rb");
-	if (fp) {
-	    nodePtr = TnmMibReadFrozen(fp);
-	    fclose(fp);
+	if (frozen) {
+	    (void) TnmMibWriteFrozen(frozen, file, nodePtr);
 	}
     }
 
     if (TnmMibAddNode(&tnmMibTree, nodePtr) == -1) {
-	unlink(frozen);
+	if (frozen) {
+	    unlink(frozen);
+	}
 	return NULL;
     }
 
@@ -605,7 +631,7 @@ CreateType(char *name, int syntax, char *displayHint, char *enums)
  */
 
 static int
-ReadIntEnums(FILE *fp, char **strPtr)
+ReadIntEnums(MibInput *in, char **strPtr)
 {
     Tcl_DString result;
     int syntax;
@@ -622,16 +648,16 @@ ReadIntEnums(FILE *fp, char **strPtr)
 	char num [SYMBOL_MAXLEN];
 	char keyword [SYMBOL_MAXLEN];
 
-	syntax = ReadKeyword(fp, str);
+	syntax = ReadKeyword(in, str);
 #if 0
 /** XXX: dont check - all we need is a string */
 	if (syntax != LABEL) { fail = 1; break; }
 #endif
 	/* got the string:  ``{ foo'' */
-	syntax = ReadKeyword(fp, keyword);
+	syntax = ReadKeyword(in, keyword);
 	if (syntax != LEFTPAREN) { fail = 1; break; }
 	/* ``{ foo ('' */
-	syntax = ReadKeyword(fp, num);
+	syntax = ReadKeyword(in, num);
 	if (syntax != NUMBER && syntax != SIGNEDNUMBER) { fail = 1; break; }
 	/* append to the collecting string: */
 	Tcl_DStringAppend(&result, " ", 1);
@@ -639,11 +665,11 @@ ReadIntEnums(FILE *fp, char **strPtr)
 	Tcl_DStringAppend(&result, " ", 1);
 	Tcl_DStringAppend(&result, num, -1);
 	/* ``{ foo (99'' */
-        syntax = ReadKeyword(fp, keyword);
+        syntax = ReadKeyword(in, keyword);
 	if (syntax != RIGHTPAREN) { fail = 1; break; }
 	/* ``{ foo (99)'' */
 	/* now there must follow either a ``,'' or a ``}'' */
-        syntax = ReadKeyword(fp, keyword);
+        syntax = ReadKeyword(in, keyword);
 
     } while (syntax == COMMA);
     
@@ -670,7 +696,7 @@ ReadIntEnums(FILE *fp, char **strPtr)
  */
 
 static int
-ReadRange(FILE *fp, char **strPtr)
+ReadRange(MibInput *in, char **strPtr)
 {
     Tcl_DString result;
     int syntax;
@@ -688,7 +714,7 @@ ReadRange(FILE *fp, char **strPtr)
     
     /* got LEFTPAREN:  ``('' */
     do {
-	syntax = ReadKeyword(fp, value);
+	syntax = ReadKeyword(in, value);
 
 	switch (syntax) {
 	case NUMBER:
@@ -709,10 +735,10 @@ ReadRange(FILE *fp, char **strPtr)
 	}
 	/* got the string:  ``( 1'' */
 	/* now there must follow either a ``|'', a ``..'', or a ``)'' */
-	syntax = ReadKeyword(fp, keyword);
+	syntax = ReadKeyword(in, keyword);
 	if (syntax == UPTO) {
 	    /* ``( 1..'' */
-	    syntax = ReadKeyword(fp, value);
+	    syntax = ReadKeyword(in, value);
 	    
 	    switch (syntax) {
 	    case NUMBER:
@@ -733,7 +759,7 @@ ReadRange(FILE *fp, char **strPtr)
 	    }
 	    /* got the string:  ``( 1..10'' */
 	    /* now there must follow either a ``|'' or a ``)'' */
-	    syntax = ReadKeyword(fp, keyword);
+	    syntax = ReadKeyword(in, keyword);
 	} else {
 	    /* just a single number, not a range like ``1..10'' */
 	    *end = 0;
@@ -767,19 +793,19 @@ ReadRange(FILE *fp, char **strPtr)
  */
 
 static char*
-ReadNameList(FILE *fp)
+ReadNameList(MibInput *in)
 {
     int syntax;
     Tcl_DString dst;
     char keyword[SYMBOL_MAXLEN];
     char *result;
     
-    if ((syntax = ReadKeyword(fp, keyword)) != LEFTBRACKET) {
+    if ((syntax = ReadKeyword(in, keyword)) != LEFTBRACKET) {
 	return NULL;
     }
 
     Tcl_DStringInit(&dst);
-    while ((syntax = ReadKeyword(fp, keyword)) != RIGHTBRACKET) {
+    while ((syntax = ReadKeyword(in, keyword)) != RIGHTBRACKET) {
 	switch (syntax) {
 	case COMMA:
 	    continue;
@@ -800,12 +826,12 @@ ReadNameList(FILE *fp)
 
 
 /*
- * ParseFile() reads a MIB file specified by *fp and return a
- * linked list of objects in that MIB.
+ * ParseFile() reads the MIB definitions from the input buffer and
+ * returns a linked list of objects in that MIB.
  */
 
 static TnmMibNode*
-ParseFile (FILE *fp)
+ParseFile (MibInput *in)
 {
     char name[SYMBOL_MAXLEN];
     char keyword[SYMBOL_MAXLEN];
@@ -832,7 +858,7 @@ ParseFile (FILE *fp)
     HashKeywords();
     line = 1;
 
-    while ((syntax = ReadKeyword(fp, keyword)) != EOF) {
+    while ((syntax = ReadKeyword(in, keyword)) != EOF) {
 	
 	if (state == OUT_OF_MIB) {
 
@@ -843,7 +869,7 @@ ParseFile (FILE *fp)
 	    switch (syntax) {
 	      case DEFINITIONS:
 		state = IN_MIB;
-		syntax = ParseHeader(fp, name);
+		syntax = ParseHeader(in, name);
 		if (syntax == EOF || syntax == ERROR) {
 		    fprintf(stderr, "%s:%d: bad format in MIB header\n",
 			    tnmMibFileName, line);
@@ -870,7 +896,7 @@ ParseFile (FILE *fp)
 		  for (;;) {
 		      char buf [SYMBOL_MAXLEN];
 		      int syntax;
-		      if ((syntax = ReadKeyword(fp, buf)) == LEFTBRACKET)
+		      if ((syntax = ReadKeyword(in, buf)) == LEFTBRACKET)
 			cnt ++;
 		      else if (syntax == RIGHTBRACKET)
 			cnt--;
@@ -900,7 +926,7 @@ ParseFile (FILE *fp)
 		state = OUT_OF_MIB;
 		break;
 	      case EQUALS:
-		syntax = ParseASN1Type (fp, name);
+		syntax = ParseASN1Type (in, name);
 		if (syntax == END) {
 		    tnmMibModuleName = NULL;
 		    state = OUT_OF_MIB;
@@ -946,7 +972,7 @@ ParseFile (FILE *fp)
 		strncpy (tt_name, keyword, SYMBOL_MAXLEN);
 		break;
 	      case MODULECOMP:
-		nodePtr = ParseModuleCompliance(fp, name, &nodeList);
+		nodePtr = ParseModuleCompliance(in, name, &nodeList);
 		if (nodePtr == NULL) {
 		    fprintf(stderr,
 			    "%s:%d: bad format in MODULE-COMPLIANCE\n",
@@ -959,7 +985,7 @@ ParseFile (FILE *fp)
 		nodeList = nodePtr;
 		break;
 	      case MODULEIDENTITY:
-		nodePtr = ParseModuleIdentity(fp, name, &nodeList);
+		nodePtr = ParseModuleIdentity(in, name, &nodeList);
 		if (nodePtr == NULL) {
 		    fprintf(stderr,
 			    "%s:%d: bad format in MODULE-IDENTIY\n",
@@ -972,7 +998,7 @@ ParseFile (FILE *fp)
 		nodeList = nodePtr;
 		break;
 	      case NOTIFYTYPE:
-		nodePtr = ParseNotificationType(fp, name, &nodeList);
+		nodePtr = ParseNotificationType(in, name, &nodeList);
 		if (nodePtr == NULL) {
 		    fprintf(stderr,
 			    "%s:%d: bad format in NOTIFICATION-TYPE\n",
@@ -985,7 +1011,7 @@ ParseFile (FILE *fp)
 		nodeList = nodePtr;
 		break;
 	      case NOTIFYGROUP:
-		nodePtr = ParseNotificationGroup(fp, name, &nodeList);
+		nodePtr = ParseNotificationGroup(in, name, &nodeList);
 		if (nodePtr == NULL) {
 		    fprintf(stderr,
 			    "%s:%d: bad format in NOTIFICATION-GROUP\n",
@@ -998,7 +1024,7 @@ ParseFile (FILE *fp)
 		nodeList = nodePtr;
 		break;
 	      case CAPABILITIES:
-		nodePtr = ParseCapabilitiesType(fp, name, &nodeList);
+		nodePtr = ParseCapabilitiesType(in, name, &nodeList);
 		if (nodePtr == NULL) {
 		    fprintf(stderr, 
 			    "%s:%d: bad format in AGENT-CAPABILITIES\n",
@@ -1011,7 +1037,7 @@ ParseFile (FILE *fp)
 		nodeList = nodePtr;
 		break;
 	      case TRAPTYPE:
-		nodePtr = ParseTrapType(fp, name, &nodeList);
+		nodePtr = ParseTrapType(in, name, &nodeList);
 		if (nodePtr == NULL) {
 		    fprintf(stderr,
 			    "%s:%d: bad format in TRAP-TYPE\n",
@@ -1024,7 +1050,7 @@ ParseFile (FILE *fp)
 		nodeList = nodePtr;
 		break;
 	      case OBJGROUP:
-		nodePtr = ParseObjectGroup(fp, name, &nodeList);
+		nodePtr = ParseObjectGroup(in, name, &nodeList);
 		if (nodePtr == NULL) {
 		    fprintf(stderr,
 			    "%s:%d: bad format in OBJECT-GROUP\n",
@@ -1037,7 +1063,7 @@ ParseFile (FILE *fp)
 		nodeList = nodePtr;
 		break;
 	      case OBJECTIDENTITY:
-		nodePtr = ParseObjectIdentity(fp, name, &nodeList);
+		nodePtr = ParseObjectIdentity(in, name, &nodeList);
 		if (nodePtr == NULL) {
 		    fprintf(stderr,
 			    "%s:%d: bad format in OBJECT-IDENTITY\n",
@@ -1050,7 +1076,7 @@ ParseFile (FILE *fp)
 		nodeList = nodePtr;
 		break;
 	      case ASN1_OBJECT_IDENTIFIER:
-		nodePtr = ParseObjectID(fp, name, &nodeList);
+		nodePtr = ParseObjectID(in, name, &nodeList);
 		if (nodePtr == NULL) {
 		    fprintf(stderr,
 			    "%s:%d: bad format in OBJECT-IDENTIFIER\n",
@@ -1063,7 +1089,7 @@ ParseFile (FILE *fp)
 		nodeList = nodePtr;
 		break;
 	      case OBJTYPE:
-		nodePtr = ParseObjectType(fp, name, &nodeList);
+		nodePtr = ParseObjectType(in, name, &nodeList);
 		if (nodePtr == NULL) {
 		    fprintf(stderr,
 			    "%s:%d: bad format in OBJECT-TYPE\n",
@@ -1087,16 +1113,16 @@ ParseFile (FILE *fp)
 		if (typePtr &&
 		    ((typePtr->syntax != ASN1_OCTET_STRING) ||
 		     ((typePtr->syntax == ASN1_OCTET_STRING) &&
-		      ((syntax = ReadKeyword(fp, keyword)) != EOF) &&
+		      ((syntax = ReadKeyword(in, keyword)) != EOF) &&
 		      (syntax == SIZE) &&
-		      ((syntax = ReadKeyword(fp, keyword)) != EOF) &&
+		      ((syntax = ReadKeyword(in, keyword)) != EOF) &&
 		      (syntax == LEFTPAREN)))) {
 		   char *ranges;
 
-		   if ((ReadRange(fp, &ranges) != RIGHTPAREN) ||
+		   if ((ReadRange(in, &ranges) != RIGHTPAREN) ||
 		       (typePtr &&
 		        ((typePtr->syntax == ASN1_OCTET_STRING) &&
-		         (((syntax = ReadKeyword(fp, keyword)) == EOF) ||
+		         (((syntax = ReadKeyword(in, keyword)) == EOF) ||
 		          (syntax != RIGHTPAREN))))) {
 			ckfree (ranges);
 		   } else if (typePtr) {
@@ -1117,7 +1143,7 @@ ParseFile (FILE *fp)
 		  for (;;) {
 		      char buf [SYMBOL_MAXLEN];
 		      int syntax;
-		      if ((syntax = ReadKeyword(fp, buf)) == LEFTPAREN)
+		      if ((syntax = ReadKeyword(in, buf)) == LEFTPAREN)
 			cnt ++;
 		      else if (syntax == RIGHTPAREN)
 			cnt--;
@@ -1131,7 +1157,7 @@ ParseFile (FILE *fp)
 	      case LEFTBRACKET:
 		{ 
 		    char *enums;
-		    if (ReadIntEnums(fp, &enums) != RIGHTBRACKET) {
+		    if (ReadIntEnums(in, &enums) != RIGHTBRACKET) {
 			fprintf(stderr, "%s:%d: bad mib format\n",
 				tnmMibFileName, line);
 			ckfree (enums);
@@ -1171,31 +1197,31 @@ ParseFile (FILE *fp)
  */
 
 static int
-ParseHeader (FILE *fp, char *keyword)
+ParseHeader (MibInput *in, char *keyword)
 {
     int syntax;
 
     tnmMibModuleName = ckstrdup(keyword);
    
-    if ((syntax = ReadKeyword(fp, keyword)) != EQUALS) {
+    if ((syntax = ReadKeyword(in, keyword)) != EQUALS) {
 	return ERROR;
     }
 
-    if ((syntax = ReadKeyword(fp, keyword)) != BEGIN) {
+    if ((syntax = ReadKeyword(in, keyword)) != BEGIN) {
 	return ERROR;
     }
 
-    syntax = ReadKeyword(fp, keyword);
+    syntax = ReadKeyword(in, keyword);
 
     /*
      * if it's EXPORTS clause, read the next keyword after SEMICOLON
      */
 
     if (syntax == EXPORTS) {
-	while ((syntax = ReadKeyword(fp, keyword)) != SEMICOLON) {
+	while ((syntax = ReadKeyword(in, keyword)) != SEMICOLON) {
 	    if (syntax == EOF) return EOF;
 	}
-	syntax = ReadKeyword(fp, keyword);
+	syntax = ReadKeyword(in, keyword);
     }
 
     
@@ -1204,13 +1230,14 @@ ParseHeader (FILE *fp, char *keyword)
      */
 
     if (syntax == IMPORTS) {
-	while ((syntax = ReadKeyword(fp, keyword)) != SEMICOLON) {
+	while ((syntax = ReadKeyword(in, keyword)) != SEMICOLON) {
 	    switch (syntax) {
 	    case FROM:
-		syntax = ReadKeyword(fp, keyword);
+		syntax = ReadKeyword(in, keyword);
 		if (syntax == EOF) return EOF;
 		if (syntax != LABEL) return ERROR;
-		/* fprintf(stderr, " module %s\n", keyword); */
+		Tcl_ListObjAppendElement(NULL, tnmMibImportList,
+					 Tcl_NewStringObj(keyword, -1));
 #if 0
 		{
 		    int i, objc, code;
@@ -1247,7 +1274,7 @@ ParseHeader (FILE *fp, char *keyword)
 		break;
 	    }
 	}
-	syntax = ReadKeyword(fp, keyword);
+	syntax = ReadKeyword(in, keyword);
     }
 
     /*
@@ -1264,7 +1291,7 @@ ParseHeader (FILE *fp, char *keyword)
  */
 
 static int
-ParseASN1Type (FILE *fp, char *keyword)
+ParseASN1Type (MibInput *in, char *keyword)
 {
 #ifndef USE_RANGES
     int level = 0;
@@ -1279,7 +1306,7 @@ ParseASN1Type (FILE *fp, char *keyword)
     /* save passed name: */
     strcpy (name, keyword);
     
-    syntax = ReadKeyword(fp, keyword);
+    syntax = ReadKeyword(in, keyword);
 
     /*
      * Accept more primitive types than required by the
@@ -1301,7 +1328,7 @@ ParseASN1Type (FILE *fp, char *keyword)
 	
 	break;
     case ASN1_SEQUENCE:
-	while ((syntax = ReadKeyword(fp, keyword)) != RIGHTBRACKET)
+	while ((syntax = ReadKeyword(in, keyword)) != RIGHTBRACKET)
 	    if (syntax == EOF) return 0;
 	syntax = ASN1_SEQUENCE;
 	break;
@@ -1310,11 +1337,11 @@ ParseASN1Type (FILE *fp, char *keyword)
 	/* default: no convention/enums seen: */
 	convention [0] = 0;
 	
-	while ((syntax = ReadKeyword(fp, keyword)) != SYNTAX
+	while ((syntax = ReadKeyword(in, keyword)) != SYNTAX
 	       && syntax != DISPLAYHINT) {
 	    switch (syntax) {
 	    case STATUS:
-		syntax = ReadKeyword(fp, keyword);
+		syntax = ReadKeyword(in, keyword);
 		if (syntax != CURRENT
 		    && syntax != OBSOLETE && syntax != DEPRECATED) {
 		    fprintf(stderr, "%s:%d: scan error near `%s'\n", 
@@ -1324,8 +1351,8 @@ ParseASN1Type (FILE *fp, char *keyword)
 		status = TnmGetTableKey(tnmMibStatusTable, keyword);
 		break;
 	    case DESCRIPTION:
-		offset = ftell(fp);
-		if ((syntax = ReadKeyword(fp, keyword)) != QUOTESTRING) {
+		offset = TellInput(in);
+		if ((syntax = ReadKeyword(in, keyword)) != QUOTESTRING) {
 		    return 0;
 		}
 		break;
@@ -1338,7 +1365,7 @@ ParseASN1Type (FILE *fp, char *keyword)
 	 * read the keyword following SYNTAX or DISPLAYHINT
 	 */
 	
-	merk = ReadKeyword(fp, keyword);
+	merk = ReadKeyword(in, keyword);
 	/* ugh. and yet another ugly hack to this ugly parser... */
 	if (syntax == SYNTAX && merk == LABEL)
 	{
@@ -1362,10 +1389,10 @@ ParseASN1Type (FILE *fp, char *keyword)
 	    strcpy (convention, keyword);
 	    
 	    /* skip to SYNTAX: */
-	    while ((syntax = ReadKeyword(fp, keyword)) != SYNTAX) {
+	    while ((syntax = ReadKeyword(in, keyword)) != SYNTAX) {
 		switch (syntax) {
 		case STATUS:
-		    syntax = ReadKeyword(fp, keyword);
+		    syntax = ReadKeyword(in, keyword);
 		    if (syntax != CURRENT
 			&& syntax != OBSOLETE && syntax != DEPRECATED) {
 			fprintf(stderr, "%s:%d: scan error near `%s'\n", 
@@ -1375,8 +1402,8 @@ ParseASN1Type (FILE *fp, char *keyword)
 		    status = TnmGetTableKey(tnmMibStatusTable, keyword);
 		    break;
 		case DESCRIPTION:
-		    offset = ftell(fp);
-		    if ((syntax = ReadKeyword(fp, keyword)) != QUOTESTRING) {
+		    offset = TellInput(in);
+		    if ((syntax = ReadKeyword(in, keyword)) != QUOTESTRING) {
 			return 0;
 		    }
 		    break;
@@ -1385,7 +1412,7 @@ ParseASN1Type (FILE *fp, char *keyword)
 		}
 	    }
 	    
-	    if ((merk = ReadKeyword(fp, keyword)) == LABEL)
+	    if ((merk = ReadKeyword(in, keyword)) == LABEL)
 		return 0;
 	}
 	
@@ -1398,17 +1425,17 @@ ParseASN1Type (FILE *fp, char *keyword)
 	 * if next keyword is a bracket, we have to continue
 	 */
 	
-	if ((syntax = ReadKeyword(fp, keyword)) == LEFTPAREN) {
+	if ((syntax = ReadKeyword(in, keyword)) == LEFTPAREN) {
 #ifdef USE_RANGES
 	    if ((osyntax != ASN1_OCTET_STRING) ||
 		((osyntax == ASN1_OCTET_STRING) &&
-		 ((syntax = ReadKeyword(fp, keyword)) != EOF) &&
+		 ((syntax = ReadKeyword(in, keyword)) != EOF) &&
 		 (syntax == SIZE) &&
-		 ((syntax = ReadKeyword(fp, keyword)) != EOF) &&
+		 ((syntax = ReadKeyword(in, keyword)) != EOF) &&
 		 (syntax == LEFTPAREN))) {
-		if ((ReadRange(fp, &enums) != RIGHTPAREN) ||
+		if ((ReadRange(in, &enums) != RIGHTPAREN) ||
 		    ((osyntax == ASN1_OCTET_STRING) &&
-		     (((syntax = ReadKeyword(fp, keyword)) == EOF) ||
+		     (((syntax = ReadKeyword(in, keyword)) == EOF) ||
 		      (syntax != RIGHTPAREN)))) {
 		    fprintf(stderr, "%s:%d: bad range definition\n",
 		            tnmMibFileName, line);
@@ -1421,19 +1448,19 @@ ParseASN1Type (FILE *fp, char *keyword)
 #else
 	    level = 1;
 	    while (level != 0) {
-		if ((syntax = ReadKeyword(fp, keyword)) == EOF)
+		if ((syntax = ReadKeyword(in, keyword)) == EOF)
 		    return 0;
 		if (syntax == LEFTPAREN)
 		    ++level;
 		if (syntax == RIGHTPAREN)
 		    --level;
 	    }
-	    syntax = ReadKeyword(fp, keyword);
+	    syntax = ReadKeyword(in, keyword);
 #endif
 	}
 	
 	if (syntax == LEFTBRACKET) {
-	    syntax = ReadIntEnums(fp, &enums);
+	    syntax = ReadIntEnums(in, &enums);
 	}
 	
 	/* found MIB_TextConv: */
@@ -1488,7 +1515,7 @@ ParseASN1Type (FILE *fp, char *keyword)
  */
 
 static TnmMibNode*
-ParseModuleCompliance (FILE *fp, char *name, TnmMibNode **nodeList)
+ParseModuleCompliance (MibInput *in, char *name, TnmMibNode **nodeList)
 {
     char keyword[SYMBOL_MAXLEN];
     int syntax;
@@ -1500,12 +1527,12 @@ ParseModuleCompliance (FILE *fp, char *name, TnmMibNode **nodeList)
      * read keywords until syntax EQUALS is found
      */
     
-    while ((syntax = ReadKeyword(fp, keyword)) != EQUALS) {
+    while ((syntax = ReadKeyword(in, keyword)) != EQUALS) {
 	switch (syntax) {
 	case DESCRIPTION:
 	    if (nodePtr->fileOffset <= 0) {
-		nodePtr->fileOffset = ftell (fp);
-		if ((syntax = ReadKeyword(fp, keyword)) != QUOTESTRING) {
+		nodePtr->fileOffset = TellInput(in);
+		if ((syntax = ReadKeyword(in, keyword)) != QUOTESTRING) {
 		    fprintf(stderr, "%d --> %s\n", syntax, keyword);
 		    return NULL;
 		}
@@ -1518,7 +1545,7 @@ ParseModuleCompliance (FILE *fp, char *name, TnmMibNode **nodeList)
 	}
     }
 
-    if (ParseNodeList(fp, nodeList, nodePtr) < 0) {
+    if (ParseNodeList(in, nodeList, nodePtr) < 0) {
 	return NULL;
     }
     
@@ -1531,7 +1558,7 @@ ParseModuleCompliance (FILE *fp, char *name, TnmMibNode **nodeList)
  */
 
 static TnmMibNode*
-ParseModuleIdentity (FILE *fp, char *name, TnmMibNode **nodeList)
+ParseModuleIdentity (MibInput *in, char *name, TnmMibNode **nodeList)
 {
     char keyword[SYMBOL_MAXLEN];
     int	syntax;
@@ -1543,12 +1570,12 @@ ParseModuleIdentity (FILE *fp, char *name, TnmMibNode **nodeList)
      * read keywords until syntax EQUALS is found
      */
 
-    while ((syntax = ReadKeyword(fp, keyword)) != EQUALS) {
+    while ((syntax = ReadKeyword(in, keyword)) != EQUALS) {
 	switch (syntax) {
 	  case DESCRIPTION:
 	      if (nodePtr->fileOffset <= 0) {
-		  nodePtr->fileOffset = ftell(fp);
-		  if ((syntax = ReadKeyword(fp, keyword)) != QUOTESTRING) {
+		  nodePtr->fileOffset = TellInput(in);
+		  if ((syntax = ReadKeyword(in, keyword)) != QUOTESTRING) {
 		      fprintf(stderr, "%d --> %s\n", syntax, keyword);
 		      return NULL;
 		  }
@@ -1561,7 +1588,7 @@ ParseModuleIdentity (FILE *fp, char *name, TnmMibNode **nodeList)
 	}
     }
 
-    if (ParseNodeList(fp, nodeList, nodePtr) < 0) {
+    if (ParseNodeList(in, nodeList, nodePtr) < 0) {
 	return NULL;
     }
 
@@ -1574,7 +1601,7 @@ ParseModuleIdentity (FILE *fp, char *name, TnmMibNode **nodeList)
  */
 
 static TnmMibNode*
-ParseNotificationType (FILE *fp, char *name, TnmMibNode **nodeList)
+ParseNotificationType (MibInput *in, char *name, TnmMibNode **nodeList)
 {
     char keyword[SYMBOL_MAXLEN];
     int	syntax;
@@ -1586,10 +1613,10 @@ ParseNotificationType (FILE *fp, char *name, TnmMibNode **nodeList)
      * read keywords until syntax EQUALS is found
      */
 
-    while ((syntax = ReadKeyword(fp, keyword)) != EQUALS) {
+    while ((syntax = ReadKeyword(in, keyword)) != EQUALS) {
 	switch (syntax) {
 	  case STATUS:
-	    syntax = ReadKeyword(fp, keyword);
+	    syntax = ReadKeyword(in, keyword);
 	    if (syntax != CURRENT
 		&& syntax != OBSOLETE && syntax != DEPRECATED) {
 		fprintf(stderr, "%s:%d: scan error near `%s'\n", 
@@ -1599,14 +1626,14 @@ ParseNotificationType (FILE *fp, char *name, TnmMibNode **nodeList)
 	    nodePtr->status = TnmGetTableKey(tnmMibStatusTable, keyword);
 	    break;
 	case OBJECTS:
-	    nodePtr->index = ReadNameList(fp);
+	    nodePtr->index = ReadNameList(in);
 	    if (! nodePtr->index) {
 		return NULL;
 	    }
 	    break;
 	  case DESCRIPTION:
-            nodePtr->fileOffset = ftell (fp);
-            if ((syntax = ReadKeyword(fp, keyword)) != QUOTESTRING) {
+            nodePtr->fileOffset = TellInput(in);
+            if ((syntax = ReadKeyword(in, keyword)) != QUOTESTRING) {
 		fprintf(stderr, "%d --> %s\n", syntax, keyword);
 		return NULL;
             }
@@ -1618,7 +1645,7 @@ ParseNotificationType (FILE *fp, char *name, TnmMibNode **nodeList)
 	}
     }
     
-    if (ParseNodeList(fp, nodeList, nodePtr) < 0) {
+    if (ParseNodeList(in, nodeList, nodePtr) < 0) {
 	return NULL;
     }
     
@@ -1632,7 +1659,7 @@ ParseNotificationType (FILE *fp, char *name, TnmMibNode **nodeList)
  */
 
 static TnmMibNode*
-ParseCapabilitiesType (FILE *fp, char *name, TnmMibNode **nodeList)
+ParseCapabilitiesType (MibInput *in, char *name, TnmMibNode **nodeList)
 {
     char keyword[SYMBOL_MAXLEN];
     int	syntax;
@@ -1640,11 +1667,11 @@ ParseCapabilitiesType (FILE *fp, char *name, TnmMibNode **nodeList)
 
     nodePtr = TnmMibNewNode(name);
 
-    while ((syntax = ReadKeyword(fp, keyword)) != EQUALS) {
+    while ((syntax = ReadKeyword(in, keyword)) != EQUALS) {
 	switch (syntax) {
           case DESCRIPTION:
-            nodePtr->fileOffset = ftell (fp);
-            if ((syntax = ReadKeyword(fp, keyword)) != QUOTESTRING) {
+            nodePtr->fileOffset = TellInput(in);
+            if ((syntax = ReadKeyword(in, keyword)) != QUOTESTRING) {
 		fprintf(stderr, "%d --> %s\n", syntax, keyword);
 		return NULL;
             }
@@ -1656,7 +1683,7 @@ ParseCapabilitiesType (FILE *fp, char *name, TnmMibNode **nodeList)
 	}
     }
 
-    if (ParseNodeList(fp, nodeList, nodePtr) < 0) {
+    if (ParseNodeList(in, nodeList, nodePtr) < 0) {
 	return NULL;
     }
     
@@ -1669,7 +1696,7 @@ ParseCapabilitiesType (FILE *fp, char *name, TnmMibNode **nodeList)
  */
 
 static TnmMibNode*
-ParseTrapType (FILE *fp, char *name, TnmMibNode **nodeList)
+ParseTrapType (MibInput *in, char *name, TnmMibNode **nodeList)
 {
     char keyword[SYMBOL_MAXLEN];
     int  syntax, bracket = 0;
@@ -1682,26 +1709,26 @@ ParseTrapType (FILE *fp, char *name, TnmMibNode **nodeList)
      * read keywords until syntax EQUALS is found
      */
 
-    while ((syntax = ReadKeyword(fp, keyword)) != EQUALS) {
+    while ((syntax = ReadKeyword(in, keyword)) != EQUALS) {
 	switch (syntax) {
 	case DESCRIPTION:
-	    nodePtr->fileOffset = ftell (fp);
-	    if ((syntax = ReadKeyword(fp, keyword)) != QUOTESTRING) {
+	    nodePtr->fileOffset = TellInput(in);
+	    if ((syntax = ReadKeyword(in, keyword)) != QUOTESTRING) {
 		fprintf(stderr, "%d --> %s\n", syntax, keyword);
 		return NULL;
 	    }
             break;
 	case VARIABLES:
-	    nodePtr->index = ReadNameList(fp);
+	    nodePtr->index = ReadNameList(in);
 	    if (! nodePtr->index) {
 		return NULL;
 	    }
 	    break;
 	case ENTERPRISE:
-	    syntax = ReadKeyword(fp, keyword);
+	    syntax = ReadKeyword(in, keyword);
 	    if (syntax == LEFTBRACKET) {
 		bracket = 1;
-		syntax = ReadKeyword(fp, keyword);
+		syntax = ReadKeyword(in, keyword);
 	    }
 	    if (syntax != LABEL) {
 		fprintf(stderr, "%s:%d: unable to parse ENTERPRISE %s\n",
@@ -1737,7 +1764,7 @@ ParseTrapType (FILE *fp, char *name, TnmMibNode **nodeList)
 	    }
 #endif
 	    if (bracket) {
-		syntax = ReadKeyword(fp, keyword);
+		syntax = ReadKeyword(in, keyword);
 		if (syntax != RIGHTBRACKET) {
 		    fprintf(stderr, "%s:%d: expected bracket but got %s\n",
 			    tnmMibFileName, line, keyword);
@@ -1755,7 +1782,7 @@ ParseTrapType (FILE *fp, char *name, TnmMibNode **nodeList)
     /*
      * parse a number defining the trap number */
 
-    syntax = ReadKeyword(fp, keyword);
+    syntax = ReadKeyword(in, keyword);
     if (syntax != NUMBER || enterprise == NULL) {
 	return NULL;
     }
@@ -1776,7 +1803,7 @@ ParseTrapType (FILE *fp, char *name, TnmMibNode **nodeList)
  */
 
 static TnmMibNode*
-ParseObjectGroup (FILE *fp, char *name, TnmMibNode **nodeList)
+ParseObjectGroup (MibInput *in, char *name, TnmMibNode **nodeList)
 {
     char keyword[SYMBOL_MAXLEN];
     int	syntax;
@@ -1786,12 +1813,12 @@ ParseObjectGroup (FILE *fp, char *name, TnmMibNode **nodeList)
      * next keyword must be OBJECTS
      */
     
-    if ((syntax = ReadKeyword(fp, keyword)) != OBJECTS)
+    if ((syntax = ReadKeyword(in, keyword)) != OBJECTS)
 	return NULL;
     
     nodePtr = TnmMibNewNode(name);
     
-    nodePtr->index = ReadNameList(fp);
+    nodePtr->index = ReadNameList(in);
     if (! nodePtr->index) {
 	return NULL;
     }
@@ -1800,10 +1827,10 @@ ParseObjectGroup (FILE *fp, char *name, TnmMibNode **nodeList)
      * read keywords until EQUALS are found
      */
     
-    while ((syntax = ReadKeyword(fp, keyword)) != EQUALS) {
+    while ((syntax = ReadKeyword(in, keyword)) != EQUALS) {
 	switch (syntax) {
 	  case STATUS:
-	    syntax = ReadKeyword(fp, keyword);
+	    syntax = ReadKeyword(in, keyword);
 	    if (syntax != CURRENT
 		&& syntax != OBSOLETE && syntax != DEPRECATED) {
 		fprintf(stderr, "%s:%d: scan error near `%s'\n", 
@@ -1813,8 +1840,8 @@ ParseObjectGroup (FILE *fp, char *name, TnmMibNode **nodeList)
 	    nodePtr->status = TnmGetTableKey(tnmMibStatusTable, keyword);
 	    break;
 	  case DESCRIPTION:
-	    nodePtr->fileOffset = ftell (fp);
-	    if ((syntax = ReadKeyword(fp, keyword)) != QUOTESTRING) {
+	    nodePtr->fileOffset = TellInput(in);
+	    if ((syntax = ReadKeyword(in, keyword)) != QUOTESTRING) {
 		fprintf(stderr, "%d --> %s\n", syntax, keyword);
 		return NULL;
 	    }
@@ -1826,7 +1853,7 @@ ParseObjectGroup (FILE *fp, char *name, TnmMibNode **nodeList)
 	}
     }
     
-    if (ParseNodeList(fp, nodeList, nodePtr) < 0) {
+    if (ParseNodeList(in, nodeList, nodePtr) < 0) {
 	return NULL;
     }
 
@@ -1841,7 +1868,7 @@ ParseObjectGroup (FILE *fp, char *name, TnmMibNode **nodeList)
  */
 
 static TnmMibNode*
-ParseNotificationGroup (FILE *fp, char *name, TnmMibNode **nodeList)
+ParseNotificationGroup (MibInput *in, char *name, TnmMibNode **nodeList)
 {
     char keyword[SYMBOL_MAXLEN];
     int	syntax;
@@ -1851,13 +1878,13 @@ ParseNotificationGroup (FILE *fp, char *name, TnmMibNode **nodeList)
      * next keyword must be NOTIFICATIONS
      */
     
-    if ((syntax = ReadKeyword(fp, keyword)) != NOTIFICATIONS) {
+    if ((syntax = ReadKeyword(in, keyword)) != NOTIFICATIONS) {
 	return NULL;
     }
 
     nodePtr = TnmMibNewNode(name);
 
-    nodePtr->index = ReadNameList(fp);
+    nodePtr->index = ReadNameList(in);
     if (! nodePtr->index) {
 	return NULL;
     }
@@ -1866,10 +1893,10 @@ ParseNotificationGroup (FILE *fp, char *name, TnmMibNode **nodeList)
      * read keywords until EQUALS are found
      */
     
-    while ((syntax = ReadKeyword(fp, keyword)) != EQUALS) {
+    while ((syntax = ReadKeyword(in, keyword)) != EQUALS) {
 	switch (syntax) {
 	  case STATUS:
-	    syntax = ReadKeyword(fp, keyword);
+	    syntax = ReadKeyword(in, keyword);
 	    if (syntax != CURRENT
 		&& syntax != OBSOLETE && syntax != DEPRECATED) {
 		fprintf(stderr, "%s:%d: scan error near `%s'\n", 
@@ -1879,8 +1906,8 @@ ParseNotificationGroup (FILE *fp, char *name, TnmMibNode **nodeList)
 	    nodePtr->status = TnmGetTableKey(tnmMibStatusTable, keyword);
 	    break;
 	  case DESCRIPTION:
-	    nodePtr->fileOffset = ftell (fp);
-	    if ((syntax = ReadKeyword(fp, keyword)) != QUOTESTRING) {
+	    nodePtr->fileOffset = TellInput(in);
+	    if ((syntax = ReadKeyword(in, keyword)) != QUOTESTRING) {
 		fprintf(stderr, "%d --> %s\n", syntax, keyword);
 		return NULL;
 	    }
@@ -1892,7 +1919,7 @@ ParseNotificationGroup (FILE *fp, char *name, TnmMibNode **nodeList)
 	}
     }
     
-    if (ParseNodeList(fp, nodeList, nodePtr) < 0) {
+    if (ParseNodeList(in, nodeList, nodePtr) < 0) {
 	return NULL;
     }
     
@@ -1907,7 +1934,7 @@ ParseNotificationGroup (FILE *fp, char *name, TnmMibNode **nodeList)
  */
 
 static TnmMibNode*
-ParseObjectIdentity (FILE *fp, char *name, TnmMibNode **nodeList)
+ParseObjectIdentity (MibInput *in, char *name, TnmMibNode **nodeList)
 {
     char keyword[SYMBOL_MAXLEN];
     int	syntax;
@@ -1919,10 +1946,10 @@ ParseObjectIdentity (FILE *fp, char *name, TnmMibNode **nodeList)
      * read keywords until EQUALS are found
      */
 
-    while ((syntax = ReadKeyword(fp, keyword)) != EQUALS) {
+    while ((syntax = ReadKeyword(in, keyword)) != EQUALS) {
 	switch (syntax) {
 	  case STATUS:
-            syntax = ReadKeyword(fp, keyword);
+            syntax = ReadKeyword(in, keyword);
             if (syntax != CURRENT
 		&& syntax != OBSOLETE && syntax != DEPRECATED) {
 		fprintf(stderr, "%s:%d: scan error near `%s'\n", 
@@ -1932,8 +1959,8 @@ ParseObjectIdentity (FILE *fp, char *name, TnmMibNode **nodeList)
 	    nodePtr->status = TnmGetTableKey(tnmMibStatusTable, keyword);
             break;
           case DESCRIPTION:
-            nodePtr->fileOffset = ftell (fp);
-            if ((syntax = ReadKeyword(fp, keyword)) != QUOTESTRING) {
+            nodePtr->fileOffset = TellInput(in);
+            if ((syntax = ReadKeyword(in, keyword)) != QUOTESTRING) {
 		fprintf(stderr, "%d --> %s\n", syntax, keyword);
 		return NULL;
             }
@@ -1945,7 +1972,7 @@ ParseObjectIdentity (FILE *fp, char *name, TnmMibNode **nodeList)
 	}
     }
     
-    if (ParseNodeList(fp, nodeList, nodePtr) < 0) {
+    if (ParseNodeList(in, nodeList, nodePtr) < 0) {
 	return NULL;
     }
 
@@ -1960,7 +1987,7 @@ ParseObjectIdentity (FILE *fp, char *name, TnmMibNode **nodeList)
  */
 
 static TnmMibNode*
-ParseObjectID(FILE *fp, char *name, TnmMibNode **nodeList)
+ParseObjectID(MibInput *in, char *name, TnmMibNode **nodeList)
 {
     char keyword[SYMBOL_MAXLEN];
     int	syntax;
@@ -1970,13 +1997,13 @@ ParseObjectID(FILE *fp, char *name, TnmMibNode **nodeList)
      * next keyword must be EQUALS
      */
 
-    if ((syntax = ReadKeyword(fp, keyword)) != EQUALS)
+    if ((syntax = ReadKeyword(in, keyword)) != EQUALS)
       return NULL;
     
     nodePtr = TnmMibNewNode(name);
     nodePtr->syntax = ASN1_OTHER;
     
-    if (ParseNodeList(fp, nodeList, nodePtr) < 0) {
+    if (ParseNodeList(in, nodeList, nodePtr) < 0) {
 	return NULL;
     }
     
@@ -1990,7 +2017,7 @@ ParseObjectID(FILE *fp, char *name, TnmMibNode **nodeList)
  */
 
 static TnmMibNode*
-ParseObjectType (FILE *fp, char *name, TnmMibNode **nodeList)
+ParseObjectType (MibInput *in, char *name, TnmMibNode **nodeList)
 {
     char keyword[SYMBOL_MAXLEN];
     int	syntax;
@@ -2002,7 +2029,7 @@ ParseObjectType (FILE *fp, char *name, TnmMibNode **nodeList)
      * next keyword must be SYNTAX
      */
 
-    if ((syntax = ReadKeyword(fp, keyword)) != SYNTAX)
+    if ((syntax = ReadKeyword(in, keyword)) != SYNTAX)
       return NULL;
     
     nodePtr = TnmMibNewNode(name);
@@ -2012,7 +2039,7 @@ ParseObjectType (FILE *fp, char *name, TnmMibNode **nodeList)
      * next keyword defines OBECT-TYPE syntax
      */
 
-    if ((syntax = ReadKeyword(fp, keyword)) == ACCESS)
+    if ((syntax = ReadKeyword(in, keyword)) == ACCESS)
       return NULL;
     
     nodePtr->syntax = syntax;
@@ -2042,7 +2069,7 @@ ParseObjectType (FILE *fp, char *name, TnmMibNode **nodeList)
 	 * old eat-it-up code: skip anything to the ACCESS keyword: 
 	 */
 	
-	while ((syntax = ReadKeyword(fp, keyword)) != ACCESS)
+	while ((syntax = ReadKeyword(in, keyword)) != ACCESS)
 	  if (syntax == EOF)
 	    return NULL;
 
@@ -2062,21 +2089,21 @@ ParseObjectType (FILE *fp, char *name, TnmMibNode **nodeList)
 	 * ``(0..99)'' or nothing.
 	 */ 
 
-	syntax = ReadKeyword(fp, keyword);
+	syntax = ReadKeyword(in, keyword);
 	if (syntax == LEFTBRACKET) {
-	    syntax = ReadIntEnums(fp, &restrictions);
+	    syntax = ReadIntEnums(in, &restrictions);
 	} else if (syntax == LEFTPAREN) {
 
 #ifdef USE_RANGES
 	    if ((baseType != ASN1_OCTET_STRING) ||
 		((baseType == ASN1_OCTET_STRING) &&
-		 ((syntax = ReadKeyword(fp, keyword)) != EOF) &&
+		 ((syntax = ReadKeyword(in, keyword)) != EOF) &&
 		 (syntax == SIZE) &&
-		 ((syntax = ReadKeyword(fp, keyword)) != EOF) &&
+		 ((syntax = ReadKeyword(in, keyword)) != EOF) &&
 		 (syntax == LEFTPAREN))) {
-		if ((ReadRange(fp, &restrictions) != RIGHTPAREN) ||
+		if ((ReadRange(in, &restrictions) != RIGHTPAREN) ||
 		    ((baseType == ASN1_OCTET_STRING) &&
-		     (((syntax = ReadKeyword(fp, keyword)) == EOF) ||
+		     (((syntax = ReadKeyword(in, keyword)) == EOF) ||
 		      (syntax != RIGHTPAREN)))) {
 		    fprintf(stderr, "%s:%d: bad range definition\n",
 		            tnmMibFileName, line);
@@ -2092,7 +2119,7 @@ ParseObjectType (FILE *fp, char *name, TnmMibNode **nodeList)
 	    /* XXX: fetch here ranges... -- we simply skip */
 	    int level = 1;
 	    
-	    while ((syntax = ReadKeyword(fp, keyword)) != RIGHTPAREN
+	    while ((syntax = ReadKeyword(in, keyword)) != RIGHTPAREN
 		   && level > 0) 
 	      {
 		  if (syntax == EOF)
@@ -2109,7 +2136,7 @@ ParseObjectType (FILE *fp, char *name, TnmMibNode **nodeList)
 	 */
 	
 	while (syntax != ACCESS) {
-	    syntax = ReadKeyword(fp, keyword);
+	    syntax = ReadKeyword(in, keyword);
 	    if (syntax == EOF) {
 		return NULL;
 	    }
@@ -2132,11 +2159,11 @@ ParseObjectType (FILE *fp, char *name, TnmMibNode **nodeList)
 	}
 
     } else if (syntax == ASN1_SEQUENCE) {
-	if ((syntax = ReadKeyword(fp, keyword)) == ASN1_SEQUENCE_OF) {
+	if ((syntax = ReadKeyword(in, keyword)) == ASN1_SEQUENCE_OF) {
 	    nodePtr->syntax = syntax;
 	}
 	while (syntax != ACCESS) {
-            syntax = ReadKeyword(fp, keyword);
+            syntax = ReadKeyword(in, keyword);
             if (syntax == EOF) {
                 return NULL;
             }
@@ -2148,7 +2175,7 @@ ParseObjectType (FILE *fp, char *name, TnmMibNode **nodeList)
 	* old eat-it-up code: skip anything to the ACCESS keyword: 
 	*/
 	
-	while ((syntax = ReadKeyword(fp, keyword)) != ACCESS)
+	while ((syntax = ReadKeyword(in, keyword)) != ACCESS)
 	  if (syntax == EOF)
 	    return NULL;
     }
@@ -2157,7 +2184,7 @@ ParseObjectType (FILE *fp, char *name, TnmMibNode **nodeList)
      * next keyword defines ACCESS mode for object
      */
 
-    syntax = ReadKeyword(fp, keyword);
+    syntax = ReadKeyword(in, keyword);
     if (syntax < READONLY || syntax > NOACCESS) {
 	fprintf(stderr, "%s:%d: scan error near `%s'\n", 
 		tnmMibFileName, line, keyword);
@@ -2188,14 +2215,14 @@ ParseObjectType (FILE *fp, char *name, TnmMibNode **nodeList)
      * next keyword must be STATUS
      */
 
-    if ((syntax = ReadKeyword(fp, keyword)) != STATUS)
+    if ((syntax = ReadKeyword(in, keyword)) != STATUS)
 	return NULL;
     
     /*
      * next keyword defines status of object
      */
 
-    syntax = ReadKeyword(fp, keyword);
+    syntax = ReadKeyword(in, keyword);
     if (syntax < MANDATORY || syntax > DEPRECATED) {
 	fprintf(stderr, "%s:%d: scan error near `%s'\n", 
 		tnmMibFileName, line, keyword);
@@ -2220,23 +2247,23 @@ ParseObjectType (FILE *fp, char *name, TnmMibNode **nodeList)
      * now determine optional parts of OBJECT-TYPE macro
      */
 
-    while ((syntax = ReadKeyword(fp, keyword)) != EQUALS) {
+    while ((syntax = ReadKeyword(in, keyword)) != EQUALS) {
 	switch (syntax) {
 	  case DESCRIPTION:
-            nodePtr->fileOffset = ftell (fp);
-            if ((syntax = ReadKeyword(fp, keyword)) != QUOTESTRING) {
+            nodePtr->fileOffset = TellInput(in);
+            if ((syntax = ReadKeyword(in, keyword)) != QUOTESTRING) {
 		return NULL;
             }
             break;
 	  case AUGMENTS:
-	    if ((syntax = ReadKeyword(fp, keyword)) != LEFTBRACKET) {
+	    if ((syntax = ReadKeyword(in, keyword)) != LEFTBRACKET) {
 		return NULL;
 	    }
-	    if ((syntax = ReadKeyword(fp, keyword)) != LABEL) {
+	    if ((syntax = ReadKeyword(in, keyword)) != LABEL) {
 		return NULL;
 	    }
 	    nodePtr->index = ckstrdup(keyword);
-	    if ((syntax = ReadKeyword(fp, keyword)) != RIGHTBRACKET) {
+	    if ((syntax = ReadKeyword(in, keyword)) != RIGHTBRACKET) {
 		ckfree(nodePtr->index);
 		nodePtr->index = NULL;
 		return NULL;
@@ -2245,10 +2272,10 @@ ParseObjectType (FILE *fp, char *name, TnmMibNode **nodeList)
 	    break;
 	  case INDEX:
 	    Tcl_DStringInit(&dst);
-	    if ((syntax = ReadKeyword(fp, keyword)) != LEFTBRACKET) {
+	    if ((syntax = ReadKeyword(in, keyword)) != LEFTBRACKET) {
 	        return NULL;
 	    }
-	    while ((syntax = ReadKeyword(fp, keyword)) != RIGHTBRACKET) {
+	    while ((syntax = ReadKeyword(in, keyword)) != RIGHTBRACKET) {
 		switch (syntax) {
 		case COMMA:
 		    break;
@@ -2273,10 +2300,10 @@ ParseObjectType (FILE *fp, char *name, TnmMibNode **nodeList)
 	    Tcl_DStringFree(&dst);
 	    break;
 	  case DEFVAL:
-	    if ((syntax = ReadKeyword(fp, keyword)) != LEFTBRACKET) {
+	    if ((syntax = ReadKeyword(in, keyword)) != LEFTBRACKET) {
                 return NULL;
             }
-            while ((syntax = ReadKeyword(fp, keyword)) != RIGHTBRACKET) {
+            while ((syntax = ReadKeyword(in, keyword)) != RIGHTBRACKET) {
 		if (syntax == EOF) {
 		    return NULL;
 		}
@@ -2320,7 +2347,7 @@ ParseObjectType (FILE *fp, char *name, TnmMibNode **nodeList)
 	}
     }
 
-    if (ParseNodeList(fp, nodeList, nodePtr) < 0) {
+    if (ParseNodeList(in, nodeList, nodePtr) < 0) {
 	return NULL;
     }
     
@@ -2334,11 +2361,11 @@ ParseObjectType (FILE *fp, char *name, TnmMibNode **nodeList)
  */
 
 static int
-ParseNodeList(FILE *fp, TnmMibNode **nodeList, TnmMibNode *nodePtr)
+ParseNodeList(MibInput *in, TnmMibNode **nodeList, TnmMibNode *nodePtr)
 {
     struct subid *subidList, *freePtr;
 
-    subidList = ReadSubID(fp);
+    subidList = ReadSubID(in);
     if (subidList == NULL) {
 	return -1;
     }
@@ -2369,102 +2396,133 @@ ParseNodeList(FILE *fp, TnmMibNode **nodeList, TnmMibNode *nodePtr)
 
 
 /*
- * HashKeywords() builds up a hash table, including the defined keywords
- * as records. This enables the other functions to directly reference
- * records by doing arithmetic transformations on the keywords name.
+ * HashKeywords() builds up the perfect hash table of the defined
+ * keywords by trying seeds of the hash function until all keywords
+ * hash to different slots. It also initializes the character class
+ * table used by the tokenizer. This is only done once.
  */
 
 static void
 HashKeywords()
 {
-    char *cp = NULL;
-    int	hash_val = 0;
-    int	hash_index = 0;
+    static int initialized = 0;
     Keyword *tp = NULL;
+    char *cp = NULL;
+    unsigned int hash_val = 0;
+    int ch;
 
-    memset((char *) hashtab, 0, sizeof (hashtab));
-    
-    for (tp = keywords; tp->name; tp++) {
-	hash_val = 0;
-	for (cp = tp->name; *cp; cp++) 
-	  hash_val += *cp;
-	hash_index = HASH (hash_val);
-	tp->hash   = hash_val;
-
-	if (hashtab[hash_index] != NULL) {
-	    tp->nextPtr = hashtab[hash_index];
+    if (initialized) {
+	return;
+    }
+
+    for (ch = 0; ch < 256; ch++) {
+	charClass[ch] = isspace(ch) ? CHAR_SPACE : 0;
+    }
+    for (cp = "(){},;.|"; *cp; cp++) {
+	charClass[(unsigned char) *cp] = CHAR_PUNCT;
+    }
+
+    for (keySeed = 0; ; keySeed++) {
+	memset((char *) keytab, 0, sizeof(keytab));
+	for (tp = keywords; tp->name; tp++) {
+	    hash_val = KEYHASH_INIT(keySeed);
+	    for (cp = tp->name; *cp; cp++) {
+		hash_val = KEYHASH_STEP(hash_val, *cp);
+	    }
+	    tp->hash = hash_val;
+	    if (keytab[hash_val % KEYTAB_SIZE]) {
+		break;
+	    }
+	    keytab[hash_val % KEYTAB_SIZE] = tp;
+	}
+	if (tp->name == NULL) {
+	    break;
 	}
-	hashtab[hash_index] = tp;
     }
+    initialized = 1;
 }
 
 /*
  * ReadKeyword() parses a keyword from the MIB file and places it in
  * the string pointed to by keyword. Returns the syntax of keyword or
- * EOF if any error.
+ * EOF if any error. Keywords longer than SYMBOL_MAXLEN are truncated.
  */
 
 static int
-ReadKeyword(FILE *fp, char *keyword)
+ReadKeyword(MibInput *in, char *keyword)
 {
-    char *cp = keyword;
-    int	ch = lastchar;
-    int	hash_val = 0;
-    char quoteChar = '\0';
+    char *cp, *p, *q, *last = keyword + SYMBOL_MAXLEN - 3;
+    int	ch, len;
+    unsigned int hash_val;
+    char quoteChar;
 
     Keyword *tp;
-    
+
+ again:
+    cp = keyword;
+    ch = lastchar;
+    hash_val = KEYHASH_INIT(keySeed);
     *keyword = '\0';
 
     /*
      * skip spaces
      */
 
-    while (isspace (ch) && ch != EOF) {
+    while (ch != EOF && (charClass[ch] & CHAR_SPACE)) {
 	if (ch == '\n') line++;
-	ch = getc (fp);
+	ch = GetChar(in);
     }
 
     if (ch == EOF) return EOF;
 
     /*
      * skip textual descriptions enclosed in " characters
-     * or hex/bin values enclosed in ' characters
+     * or hex/bin values enclosed in ' characters. Only the
+     * first characters are saved in keyword. Values enclosed
+     * in NUL characters are accepted like the old getc() based
+     * scanner did.
      */
 
-    if ((ch == '"') || (ch == '\'')) {
+    if ((ch == '"') || (ch == '\'') || (ch == '\0')) {
 	quoteChar = ch;
-    }
-
-    if (ch == quoteChar) {
-	int len = 0;
-	*keyword = '\0';
-	while ((ch = getc (fp)) != EOF) {
-	    if (ch == '\n') {
+	len = 0;
+	for (p = in->cur; p < in->end && *p != quoteChar
+		 && len < SYMBOL_MAXLEN - 2; p++) {
+	    if (*p == '\n') {
 		line++;
-	    } else if (ch == quoteChar) {
-		lastchar = ' ';
-		if (quoteChar == '"') {
-		    return QUOTESTRING;
-		} else {
-		    if ((ch = getc (fp)) != EOF) {
-			switch (toupper(ch)) {
-			case 'B':
-			    return BINVALUE;
-			case 'H':
-			    return HEXVALUE;
-			default:
-			    ungetc( ch, fp );
-			    break;
-			}
-		    }
-		    return QUOTEVALUE;
-		}
-	    } else if (len < SYMBOL_MAXLEN - 2) {
-		keyword [len++] = ch, keyword [len] = 0;
+	    } else {
+		keyword[len++] = *p;
 	    }
 	}
-	return EOF;
+	keyword[len] = '\0';
+	q = memchr(p, quoteChar, (size_t) (in->end - p));
+	if (q == NULL) {
+	    q = in->end;
+	}
+	for (; (p = memchr(p, '\n', (size_t) (q - p))) != NULL; p++) {
+	    line++;
+	}
+	if (q == in->end) {
+	    in->cur = q;
+	    return EOF;
+	}
+	in->cur = q + 1;
+	lastchar = ' ';
+	if (quoteChar == '"') {
+	    return QUOTESTRING;
+	}
+	if ((ch = GetChar(in)) != EOF) {
+	    switch (toupper(ch)) {
+	    case 'B':
+		return BINVALUE;
+	    case 'H':
+		return HEXVALUE;
+	    default:
+		UngetChar(in);
+		break;
+	    }
+	}
+	return QUOTEVALUE;
     }
 
     /*
@@ -2472,115 +2530,105 @@ ReadKeyword(FILE *fp, char *keyword)
      */
 
     if (ch == '-') {
-	hash_val += ch;
+	hash_val = KEYHASH_STEP(hash_val, ch);
 	*cp++ = ch;
 	
-	if ((ch = getc (fp)) == '-') {
+	if ((ch = GetChar(in)) == '-') {
 	    *keyword = '\0';
-	    while ((ch = getc (fp)) != EOF) {
-		if (ch == '\n') {
-		    line++;
-		    break;
-		}
+	    p = memchr(in->cur, '\n', (size_t) (in->end - in->cur));
+	    if (p == NULL) {
+		in->cur = in->end;
+		return EOF;
 	    }
-	    if (ch == EOF) return EOF;
-	    
+	    in->cur = p + 1;
+	    line++;
 	    lastchar = ' ';
-	    return ReadKeyword(fp, keyword);
+	    goto again;
 	}
+	if (ch == EOF) return EOF;
     }
    
     /*
      * Read characters until end of keyword is found
      */
 
-    do {
+    for (;;) {
+
+	/*
+	 * build keyword and hashvalue (NUL characters end the
+	 * keyword string and are thus not part of the hash)
+	 */
+
+	while (! charClass[ch]) {
+	    if (ch) hash_val = KEYHASH_STEP(hash_val, ch);
+	    if (cp < last) *cp++ = ch;
+	    if ((ch = GetChar(in)) == EOF) return EOF;
+	}
+
 	if (ch == '\n') line++;
-	
-	if (isspace (ch) || ch == '(' || ch == ')' || ch =='{' ||
-	    ch == '}' || ch == ',' || ch == ';' || ch == '.' ||
-	    ch == '|') {
-
-	    if ((ch == '.') && (lastchar == '.')) {
-		*cp++ = lastchar;
-		*cp++ = ch;
-		*cp = 0;
-		ch = getc(fp);
-		lastchar = ' ';
-		return UPTO;
-	    }
 
-	    /*
-             * check for keyword of length 1
-	     */
+	if ((ch == '.') && (lastchar == '.')) {
+	    *cp++ = lastchar;
+	    *cp++ = ch;
+	    *cp = 0;
+	    (void) GetChar(in);
+	    lastchar = ' ';
+	    return UPTO;
+	}
 
-	    if (!isspace (ch) && *keyword == '\0') {
-		hash_val += ch;
-		*cp++ = ch;
-		lastchar = ' ';
-	    } else if (ch == '\n') {
-		lastchar = ' ';
-	    } else {
-		lastchar = ch;
-	    }
+	/*
+	 * check for keyword of length 1
+	 */
+
+	if (! (charClass[ch] & CHAR_SPACE) && *keyword == '\0') {
+	    hash_val = KEYHASH_STEP(hash_val, ch);
+	    *cp++ = ch;
+	    lastchar = ' ';
+	} else if (ch == '\n') {
+	    lastchar = ' ';
+	} else {
+	    lastchar = ch;
+	}
 	       
-	    *cp = '\0';
+	*cp = '\0';
 
-	    /*
-	     * is this a defined keyword ?
-	     */
+	/*
+	 * is this a defined keyword ?
+	 */
 
-	    for (tp = hashtab[HASH(hash_val)]; tp != NULL; tp = tp->nextPtr) {
-		if ((tp->hash == hash_val) && !fstrcmp (tp->name, keyword))
-		  break;
-	    }
-	    
-	    if (tp != NULL) {
+	tp = keytab[hash_val % KEYTAB_SIZE];
+	if (tp != NULL && tp->hash == hash_val && !fstrcmp(tp->name, keyword)) {
 
-		/*
-		 * if keyword is not complete, continue; otherwise return
-		 */
-		
-		if (tp->key == CONTINUE) {
-		    lastchar = ch;
-		    continue;
-		}
-		return tp->key;
-	    }
-	    
 	    /*
-	     * is it a LABEL ?
+	     * if keyword is not complete, continue; otherwise return
 	     */
-	    
-	    for (cp = keyword; *cp; cp++) {
-		if (cp == keyword && (*cp == '-' || *cp == '+')) continue;
-		if (! isdigit (*cp)) return LABEL;
+		
+	    if (tp->key == CONTINUE) {
+		lastchar = ch;
+		if ((ch = GetChar(in)) == EOF) return EOF;
+		continue;
 	    }
+	    return tp->key;
+	}
 	    
-	    /*
-	     * keywords consists of digits only
-	     */
+	/*
+	 * is it a LABEL ?
+	 */
 	    
-	    return (keyword[0] == '-' || keyword[0] == '+') 
-		? SIGNEDNUMBER : NUMBER;
-
-	} else {
-	
-	    /*
-	     * build keyword and hashvalue
-	     */
-
-	    hash_val += ch;
-	    *cp++ = ch;
+	for (cp = keyword; *cp; cp++) {
+	    if (cp == keyword && (*cp == '-' || *cp == '+')) continue;
+	    if (*cp < '0' || *cp > '9') return LABEL;
 	}
-    } while ((ch = getc (fp)) != EOF);
-    
-    return EOF;
+	    
+	/*
+	 * keywords consists of digits only
+	 */
+	    
+	return (keyword[0] == '-' || keyword[0] == '+') 
+	    ? SIGNEDNUMBER : NUMBER;
+    }
 }
 
-
-
-
 /*
  * ReadSubID() parses a list of the form { iso org(3) dod(6) 1 }
  * and creates a parent-child entry for each node. Returns NULL
@@ -2588,7 +2636,7 @@ ReadKeyword(FILE *fp, char *keyword)
  */
 
 static struct subid*
-ReadSubID (FILE *fp)
+ReadSubID (MibInput *in)
 {
    char	name[SYMBOL_MAXLEN]; 
    char	keyword[SYMBOL_MAXLEN]; 
@@ -2601,13 +2649,13 @@ ReadSubID (FILE *fp)
     * EQUALS are passed, so first keyword must be LEFTBRACKET
     */
 
-   if ((syntax = ReadKeyword(fp, keyword)) != LEFTBRACKET) return NULL;
+   if ((syntax = ReadKeyword(in, keyword)) != LEFTBRACKET) return NULL;
 
    /*
     * now read keywords until RIGHTBRACKET is passed
     */
 
-   while ((syntax = ReadKeyword(fp, keyword)) != RIGHTBRACKET) {
+   while ((syntax = ReadKeyword(in, keyword)) != RIGHTBRACKET) {
        switch (syntax) {
 	 case EOF:
 	   return NULL;
@@ -2636,9 +2684,9 @@ ReadSubID (FILE *fp)
 	   strcpy (name, keyword);
 	   break;
          case LEFTPAREN:
-	   if ((syntax = ReadKeyword(fp, keyword)) != NUMBER) return NULL;
+	   if ((syntax = ReadKeyword(in, keyword)) != NUMBER) return NULL;
 	   np->subid = atoi (keyword);
-	   if ((syntax = ReadKeyword(fp, keyword)) != RIGHTPAREN)
+	   if ((syntax = ReadKeyword(in, keyword)) != RIGHTPAREN)
 	     return NULL;
 	   break;            
          case NUMBER:
@@ -32,6 +32,14 @@
 static Tcl_Obj *mibFilesLoaded = NULL;
 Tcl_Obj *tnmMibModulesLoaded = NULL;
 
+/*
+ * Flags which indicate whether the default MIB definitions listed in
+ * tnm(mibs:core) and tnm(mibs) have been loaded.
+ */
+
+static int coreLoaded = 0;
+static int mibsLoaded = 0;
+
 TCL_DECLARE_MUTEX(mibMutex)	/* To serialize access to the mib command. */
     
 /*
@@ -54,6 +62,15 @@ GetMibColumnNode (Tcl_Interp *interp, Tcl_Obj *objPtr,
 static Tcl_Obj*
 GetIndexList	(Tcl_Interp *interp, TnmMibNode *nodePtr,
 			     TnmMibNode ***indexNodeList, int *implied);
+static int
+FindMibFile	(Tcl_Interp *interp, Tcl_Obj *objPtr,
+			     Tcl_DString *dsPtr);
+static char*
+CacheFileName	(Tcl_Interp *interp, char *fileName, char *suffix,
+			     Tcl_DString *dsPtr);
+static int
+LoadModules	(Tcl_Interp *interp, Tcl_Obj *listPtr);
+
 static int
 WalkTree	(Tcl_Interp *interp, Tcl_Obj *varName, 
 			     Tcl_Obj *body, TnmMibNode* nodePtr, 
@@ -336,6 +353,127 @@ GetIndexList(Tcl_Interp *interp, TnmMibNode *nodePtr, TnmMibNode ***indexNodeLis
     return idxObj;
 }
 
+/*
+ *----------------------------------------------------------------------
+ *
+ * FindMibFile --
+ *
+ *	This procedure searches for a MIB file. First try the file
+ *	argument translated into the platform specific format. If not
+ *	found, check $tnm(library)/site and $tnm(library)/mibs.
+ *
+ * Results:
+ *	A standard Tcl result. The file name is left in the dynamic
+ *	string or an error message is left in the interpreter.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+FindMibFile(Tcl_Interp *interp, Tcl_Obj *objPtr, Tcl_DString *dsPtr)
+{
+    const char *library;
+    Tcl_Obj *filePath;
+    int code = TCL_OK;
+
+    if (Tcl_FSConvertToPathType(interp, objPtr) == TCL_ERROR) {
+	return TCL_ERROR;
+    }
+
+    library = Tcl_GetVar2(interp, "tnm", "library", TCL_GLOBAL_ONLY);
+    if (! library || Tcl_FSAccess(objPtr, R_OK) == 0) {
+	Tcl_DStringAppend(dsPtr, Tcl_GetString(objPtr), -1);
+	return TCL_OK;
+    }
+
+    /*
+     * Copy the whole library path, append "site" or "mibs" and
+     * finally append the file name and path. This makes sure
+     * that relative paths like "sun/SUN-MIB" will be found in
+     * $tnm(library)/site/sun/SUN-MIB.
+     */
+
+    filePath = Tcl_NewStringObj("", 0);
+    Tcl_IncrRefCount(filePath);
+    Tcl_AppendStringsToObj(filePath, library, "/site/",
+			   Tcl_GetStringFromObj(objPtr, NULL), NULL);
+    if (Tcl_FSConvertToPathType(interp, filePath) != TCL_OK
+	|| Tcl_FSAccess(filePath, R_OK) != 0) {
+	Tcl_SetStringObj(filePath, "", 0);
+	Tcl_AppendStringsToObj(filePath, library, "/mibs/",
+			       Tcl_GetStringFromObj(objPtr, NULL), NULL);
+	if (Tcl_FSConvertToPathType(interp, filePath) != TCL_OK
+	    || Tcl_FSAccess(filePath, R_OK) != 0) {
+	    Tcl_AppendResult(interp, "couldn't open MIB file \"",
+			     Tcl_GetStringFromObj(objPtr, NULL),
+			     "\": ", Tcl_PosixError(interp),
+			     (char *) NULL);
+	    code = TCL_ERROR;
+	}
+    }
+    if (code == TCL_OK) {
+	Tcl_DStringAppend(dsPtr, Tcl_GetString(filePath), -1);
+    }
+    Tcl_DecrRefCount(filePath);
+    return code;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * CacheFileName --
+ *
+ *	This procedure constructs the name of a file in the machine
+ *	specific directory where we keep frozen files and creates the
+ *	directory if needed. The name of the file is the last element
+ *	of fileName followed by the suffix.
+ *
+ * Results:
+ *	The native file name or NULL if we can't use the cache.
+ *
+ * Side effects:
+ *	The cache directory may be created.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static char*
+CacheFileName(Tcl_Interp *interp, char *fileName, char *suffix,
+	      Tcl_DString *dsPtr)
+{
+    const char *cache, *arch;
+    Tcl_Obj *path, *splitList, *elem = NULL;
+    char *cacheFileName = NULL;
+    int splitListLen;
+
+    cache = Tcl_GetVar2(interp, "tnm", "cache", TCL_GLOBAL_ONLY);
+    arch = Tcl_GetVar2(interp, "tnm", "arch", TCL_GLOBAL_ONLY);
+    if (cache == NULL || arch == NULL) {
+	return NULL;
+    }
+
+    path = Tcl_NewStringObj(fileName, -1);
+    Tcl_IncrRefCount(path);
+    splitList = Tcl_FSSplitPath(path, &splitListLen);
+    Tcl_IncrRefCount(splitList);
+    Tcl_ListObjIndex(NULL, splitList, splitListLen-1, &elem);
+    Tcl_SetStringObj(path, "", 0);
+    Tcl_AppendStringsToObj(path, cache, "/", arch, (char *) NULL);
+    if (elem && TnmMkDir(interp, path) == TCL_OK) {
+	Tcl_AppendStringsToObj(path, "/", Tcl_GetString(elem),
+			       suffix, (char *) NULL);
+	cacheFileName = Tcl_TranslateFileName(interp,
+				Tcl_GetString(path), dsPtr);
+    }
+    Tcl_ResetResult(interp);
+    Tcl_DecrRefCount(splitList);
+    Tcl_DecrRefCount(path);
+    return cacheFileName;
+}
+
 /*
  *----------------------------------------------------------------------
  *
@@ -360,17 +498,10 @@ int
 TnmMibLoadFile(Tcl_Interp *interp, Tcl_Obj *objPtr)
 {
     Tcl_DString fileBuffer, frozenFileBuffer;
-    const char *library;
-    char *fileName, *frozenFileName = NULL;
-    char *file = NULL, *module;
-    int code = TCL_OK;
-#if 0
-    /* see 'frozen' related code below */
-    Tcl_Obj *splitList;
-    int splitListLen;
-    const char *cache, *arch;
-#endif
-    Tcl_Obj *filePath = NULL;
+    char *fileName, *frozenFileName;
+    char *module;
+    int i, objc, code = TCL_OK;
+    Tcl_Obj **objv;
 
     Tcl_DStringInit(&fileBuffer);
     Tcl_DStringInit(&frozenFileBuffer);
@@ -382,152 +513,208 @@ TnmMibLoadFile(Tcl_Interp *interp, Tcl_Obj *objPtr)
 	tnmMibModulesLoaded = Tcl_NewListObj(0, NULL);
     }
 
-    fileName = Tcl_GetString(objPtr);	/* xxx this sucks ... */
-
+    /* 
+     * Search for the MIB file we are trying to load.
+     */
 
-    library = Tcl_GetVar2(interp, "tnm", "library", TCL_GLOBAL_ONLY);
+    if (FindMibFile(interp, objPtr, &fileBuffer) != TCL_OK) {
+	code = TCL_ERROR;
+	goto exit;
+    }
+    fileName = Tcl_DStringValue(&fileBuffer);
 
-#if 0
     /*
-     * Split the file argument into a path and the file name. Also,
-     * get the Tnm library and cache paths and the architecture string.
+     * First check whether this module is already loaded before we
+     * call the parser. This helps to avoid memory leaks when loading
+     * the same module multiple times.
      */
 
-    splitList = Tcl_FSSplitPath(objPtr, &splitListLen);
-    
-    cache = Tcl_GetVar2(interp, "tnm", "cache", TCL_GLOBAL_ONLY);
-    arch = Tcl_GetVar2(interp, "tnm", "arch", TCL_GLOBAL_ONLY);
+    code = Tcl_ListObjGetElements(NULL, mibFilesLoaded, &objc, &objv);
+    if (code != TCL_OK) {
+	Tcl_Panic("currupted internal list mibFilesLoaded");
+    }
+
+    for (i = 0; i < objc; i++) {
+	char *s = Tcl_GetStringFromObj(objv[i], NULL);
+	char *t = Tcl_GetStringFromObj(objPtr, NULL);
+	if (strcmp(s, t) == 0) {
+	    goto exit;
+	}	
+    }
 
     /* 
-     * Check if we can write a frozen file. Construct the path to the
-     * directory where we keep frozen files. Create a machine specific
-     * sub-directory if needed. The result of the following block is
-     * the native frozen file name or NULL if we can't write a frozen
-     * file.
+     * Check if we can use a frozen file and call the parser to do
+     * its job.
      */
 
-    if (cache != NULL && arch != NULL) {
-	Tcl_Obj *path;
-	Tcl_Obj *elem = NULL;
-	Tcl_Obj *obj;
-
-	path = Tcl_NewStringObj("", 0);
-	Tcl_IncrRefCount(path);
-	Tcl_AppendStringsToObj(path, cache, "/", arch, NULL);
-	obj = Tcl_NewStringObj(path,-1);
-	Tcl_IncrRefCount(obj);
-	(void) TnmMkDir(interp, obj);
-	Tcl_DecrRefCount(obj);
-
-	Tcl_ListObjIndex(NULL, splitList, splitListLen-1, &elem);
-	Tcl_AppendStringsToObj(path, cache, "/",
-			       Tcl_GetStringFromObj(elem, NULL),
-			       ".idy", NULL);
-	frozenFileName = Tcl_TranslateFileName(interp,
-				Tcl_GetStringFromObj(path, NULL),
-			        &frozenFileBuffer);
-	Tcl_DecrRefCount(path);
+    frozenFileName = CacheFileName(interp, fileName, ".idy",
+				   &frozenFileBuffer);
+    module = TnmMibParse(fileName, frozenFileName);
+    if (module == NULL) {
+	Tcl_AppendResult(interp, "couldn't parse MIB file \"",
+			 fileName,"\"", (char *) NULL);
+	code = TCL_ERROR;
+    } else {
+	Tcl_ListObjAppendElement(NULL, mibFilesLoaded, objPtr);
+	Tcl_ListObjAppendElement(NULL, tnmMibModulesLoaded,
+				 Tcl_NewStringObj(module, -1));
     }
-#endif
 
+ exit:
     /* 
-     * Search for the MIB file we are trying to load. First try the
-     * file argument translated into the platform specific format. If
-     * not found, check $tnm(library)/site and $tnm(library)/mibs.
+     * Free up all the memory that we have allocated.
      */
 
-    if (Tcl_FSConvertToPathType(interp, objPtr) == TCL_ERROR) {
-	code = TCL_ERROR;
-	goto exit;
-    }
+    Tcl_DStringFree(&fileBuffer);
+    Tcl_DStringFree(&frozenFileBuffer);
+    return code;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * LoadModules --
+ *
+ *	This procedure loads a list of MIB files. The MIB tree built
+ *	from the list is kept in a bundle in the machine specific
+ *	cache directory, so that the next time the whole list can be
+ *	loaded at once if no file has been modified. Otherwise, the
+ *	modified modules and the modules which import them are parsed
+ *	again while all others are loaded from their frozen files,
+ *	and a new bundle is written.
+ *
+ * Results:
+ *	A standard Tcl result.
+ *
+ * Side effects:
+ *	New frozen MIB files and bundles may be created.
+ *
+ *----------------------------------------------------------------------
+ */
 
-    if (library && Tcl_FSAccess(objPtr, R_OK) != 0) {
+static int
+LoadModules(Tcl_Interp *interp, Tcl_Obj *listPtr)
+{
+    TnmMibModule *modules;
+    Tcl_DString *fileBuffers, bundleBuffer, frozenFileBuffer;
+    Tcl_Obj **objv, *modPtr;
+    char *p, *bundle = NULL, *frozenFileName, buf[32];
+    unsigned int hash = 2166136261U;
+    int i, j, objc, numLoaded, useBundle, code = TCL_OK;
 
-	/*
-	 * Copy the whole library path, append "site" or "mibs" and
-	 * finally append the file name and path. This makes sure
-	 * that relative paths like "sun/SUN-MIB" will be found in
-	 * $tnm(library)/site/sun/SUN-MIB.
-	 */
+    if (Tcl_ListObjGetElements(interp, listPtr, &objc, &objv) != TCL_OK) {
+	return TCL_ERROR;
+    }
+    if (objc == 0) {
+	return TCL_OK;
+    }
 
-	filePath = Tcl_NewStringObj("", 0);
-	Tcl_IncrRefCount(filePath);
-	Tcl_AppendStringsToObj(filePath, library, "/site/",
-			       Tcl_GetStringFromObj(objPtr, NULL), NULL);
-	if (Tcl_FSConvertToPathType(interp, filePath) != TCL_OK
-	    || Tcl_FSAccess(filePath, R_OK) != 0) {
-	    Tcl_SetStringObj(filePath, "", 0);
-	    Tcl_AppendStringsToObj(filePath, library, "/mibs/",
-				   Tcl_GetStringFromObj(objPtr, NULL), NULL);
-	    if (Tcl_FSConvertToPathType(interp, filePath) != TCL_OK
-		|| Tcl_FSAccess(filePath, R_OK) != 0) {
-		Tcl_AppendResult(interp, "couldn't open MIB file \"",
-				 Tcl_GetStringFromObj(objPtr, NULL),
-				 "\": ", Tcl_PosixError(interp),
-				 (char *) NULL);
-		code = TCL_ERROR;
-		goto exit;
-	    }
-	}
-	fileName = Tcl_GetString(filePath);
+    if (! mibFilesLoaded) {
+	mibFilesLoaded = Tcl_NewListObj(0, NULL);
+    }
+    if (! tnmMibModulesLoaded) {
+	tnmMibModulesLoaded = Tcl_NewListObj(0, NULL);
     }
 
+    modules = (TnmMibModule *) ckalloc(objc * sizeof(TnmMibModule));
+    memset((char *) modules, 0, objc * sizeof(TnmMibModule));
+    fileBuffers = (Tcl_DString *) ckalloc(objc * sizeof(Tcl_DString));
+    Tcl_DStringInit(&bundleBuffer);
+
     /*
-     * First check whether this module is already loaded before we
-     * call the parser. This helps to avoid memory leaks when loading
-     * the same module multiple times.
+     * A bundle replaces the whole MIB tree. It can therefore only be
+     * used if nothing has been loaded yet and if all files exist.
      */
 
-    if (fileName) {
-	int i, objc, code;
-	Tcl_Obj **objv;
-	
-	code = Tcl_ListObjGetElements(NULL, mibFilesLoaded,
-				      &objc, &objv);
-	if (code != TCL_OK) {
-	    Tcl_Panic("currupted internal list mibFilesLoaded");
+    useBundle = (tnmMibTree == NULL && tnmMibTypeList == NULL);
+    for (i = 0; i < objc; i++) {
+	Tcl_DStringInit(&fileBuffers[i]);
+	modules[i].name = Tcl_GetString(objv[i]);
+	if (useBundle
+	    && FindMibFile(interp, objv[i], &fileBuffers[i]) == TCL_OK) {
+	    modules[i].fileName = Tcl_DStringValue(&fileBuffers[i]);
+	} else {
+	    useBundle = 0;
+	}
+    }
+    Tcl_ResetResult(interp);
+
+    if (useBundle) {
+	for (p = Tcl_GetString(listPtr); *p; p++) {
+	    hash = (hash ^ (unsigned char) *p) * 16777619U;
 	}
+	sprintf(buf, "bundle-%08x", hash);
+	bundle = CacheFileName(interp, buf, ".idb", &bundleBuffer);
+    }
 
+    if (bundle && TnmMibReadBundle(bundle, objc, modules) == TCL_OK) {
 	for (i = 0; i < objc; i++) {
-	    char *s = Tcl_GetStringFromObj(objv[i], NULL);
-	    char *t = Tcl_GetStringFromObj(objPtr, NULL);
-	    if (strcmp(s, t) == 0) {
-		goto exit;
-	    }	
+	    for (j = 0; j < i; j++) {
+		if (strcmp(modules[j].name, modules[i].name) == 0) {
+		    break;
+		}
+	    }
+	    if (j == i) {
+		Tcl_ListObjAppendElement(NULL, mibFilesLoaded, objv[i]);
+	    }
+	    if (modules[i].moduleName) {
+		Tcl_ListObjAppendElement(NULL, tnmMibModulesLoaded,
+			 Tcl_NewStringObj(modules[i].moduleName, -1));
+	    }
 	}
+	goto exit;
     }
 
     /*
-     * If we have the file name now, call the parser to do its job.
+     * Load the files one by one. The frozen files of modified modules
+     * and of the modules which depend on them are removed first. We
+     * remember the module name and the imports of every file for the
+     * new bundle.
      */
-    
-    if (fileName) {
-	module = TnmMibParse(fileName, frozenFileName);
-	if (module == NULL) {
-	    Tcl_AppendResult(interp, "couldn't parse MIB file \"",
-			     fileName,"\"", (char *) NULL);
-	    code = TCL_ERROR;
-	} else {
-	    Tcl_ListObjAppendElement(NULL, mibFilesLoaded, objPtr);
-	    Tcl_ListObjAppendElement(NULL, tnmMibModulesLoaded,
-				     Tcl_NewStringObj(module, -1));
+
+    for (i = 0; i < objc; i++) {
+	if (modules[i].dirty) {
+	    Tcl_DStringInit(&frozenFileBuffer);
+	    frozenFileName = CacheFileName(interp, modules[i].fileName,
+					   ".idy", &frozenFileBuffer);
+	    if (frozenFileName) {
+		unlink(frozenFileName);
+	    }
+	    Tcl_DStringFree(&frozenFileBuffer);
+	}
+	if (tnmMibImportList) {
+	    Tcl_DecrRefCount(tnmMibImportList);
+	    tnmMibImportList = NULL;
+	}
+	Tcl_ListObjLength(NULL, tnmMibModulesLoaded, &numLoaded);
+	code = TnmMibLoadFile(interp, objv[i]);
+	if (code != TCL_OK) {
+	    break;
+	}
+	if (Tcl_ListObjIndex(NULL, tnmMibModulesLoaded,
+			     numLoaded, &modPtr) == TCL_OK && modPtr) {
+	    modules[i].moduleName = Tcl_GetString(modPtr);
+	}
+	modules[i].importList = tnmMibImportList;
+	if (modules[i].importList) {
+	    Tcl_IncrRefCount(modules[i].importList);
 	}
-    } else {
-	Tcl_AppendResult(interp, "couldn't open MIB file \"", file,
-			 "\": ", Tcl_PosixError(interp), (char *) NULL);
-	code = TCL_ERROR;
     }
 
- exit:
-    /* 
-     * Free up all the memory that we have allocated.
-     */
+    if (bundle && code == TCL_OK) {
+	(void) TnmMibWriteBundle(bundle, objc, modules);
+    }
 
-    Tcl_DStringFree(&fileBuffer);
-    Tcl_DStringFree(&frozenFileBuffer);
-    if (filePath != NULL) {
-	Tcl_DecrRefCount(filePath);
+ exit:
+    for (i = 0; i < objc; i++) {
+	if (modules[i].importList) {
+	    Tcl_DecrRefCount(modules[i].importList);
+	}
+	Tcl_DStringFree(&fileBuffers[i]);
     }
+    ckfree((char *) fileBuffers);
+    ckfree((char *) modules);
+    Tcl_DStringFree(&bundleBuffer);
     return code;
 }
 
@@ -552,31 +739,21 @@ TnmMibLoadFile(Tcl_Interp *interp, Tcl_Obj *objPtr)
 int
 TnmMibLoadCore(Tcl_Interp *interp)
 {
-    Tcl_Obj *listPtr, *part1Ptr, *part2Ptr, **objv;
-    int i, objc;
-    static int alreadyDone = 0;
+    Tcl_Obj *listPtr;
 
-    if (alreadyDone) {
+    if (coreLoaded) {
 	return TCL_OK;
     }
 
-    part1Ptr = Tcl_NewStringObj("tnm", -1);
-    part2Ptr = Tcl_NewStringObj("mibs:core", -1);
-    listPtr = Tcl_ObjGetVar2(interp, part1Ptr, part2Ptr, TCL_GLOBAL_ONLY);
+    listPtr = Tcl_GetVar2Ex(interp, "tnm", "mibs:core", TCL_GLOBAL_ONLY);
     if (! listPtr) {
 	return TCL_OK;
     }
-    if (Tcl_ListObjGetElements(interp, listPtr, &objc, &objv) != TCL_OK) {
+    if (LoadModules(interp, listPtr) != TCL_OK) {
 	return TCL_ERROR;
     }
 
-    for (i = 0; i < objc; i++) {
-	if (TnmMibLoadFile(interp, objv[i]) != TCL_OK) {
-	    return TCL_ERROR;
-	}
-    }
-
-    alreadyDone = 1;
+    coreLoaded = 1;
     return TCL_OK;
 }
 
@@ -588,7 +765,8 @@ TnmMibLoadCore(Tcl_Interp *interp)
  *	This procedure reads the set of default MIB definitions and
  *	adds the objects to the internal MIB tree. The set of default
  *	MIB definitions is taken from the global Tcl variables
- *	tnm(mibs:core) and tnm(mibs).
+ *	tnm(mibs:core) and tnm(mibs). Both sets are loaded as one
+ *	list if the core MIB definitions are not loaded yet.
  *
  * Results:
  *	A standard Tcl result.
@@ -602,37 +780,38 @@ TnmMibLoadCore(Tcl_Interp *interp)
 int
 TnmMibLoad(Tcl_Interp *interp)
 {
-    Tcl_Obj *listPtr, *part1Ptr, *part2Ptr, **objv;
-    int i, objc;
-    static int alreadyDone = 0;
-
-    if (alreadyDone) {
-	return TCL_OK;
-    }
-
-    if (TnmMibLoadCore(interp) != TCL_OK) {
-	return TCL_ERROR;
-    }
+    Tcl_Obj *corePtr, *listPtr, *allPtr;
+    int code;
 
-    part1Ptr = Tcl_NewStringObj("tnm", -1);
-    part2Ptr = Tcl_NewStringObj("mibs", -1);
-    listPtr = Tcl_ObjGetVar2(interp, part1Ptr, part2Ptr, TCL_GLOBAL_ONLY);
-    Tcl_DecrRefCount(part1Ptr);
-    Tcl_DecrRefCount(part2Ptr);
-    if (! listPtr) {
+    if (mibsLoaded) {
 	return TCL_OK;
     }
-    if (Tcl_ListObjGetElements(interp, listPtr, &objc, &objv) != TCL_OK) {
-	return TCL_ERROR;
-    }
 
-    for (i = 0; i < objc; i++) {
-	if (TnmMibLoadFile(interp, objv[i]) != TCL_OK) {
+    listPtr = Tcl_GetVar2Ex(interp, "tnm", "mibs", TCL_GLOBAL_ONLY);
+    corePtr = coreLoaded ? NULL
+	: Tcl_GetVar2Ex(interp, "tnm", "mibs:core", TCL_GLOBAL_ONLY);
+    if (corePtr && listPtr) {
+	allPtr = Tcl_DuplicateObj(corePtr);
+	Tcl_IncrRefCount(allPtr);
+	code = Tcl_ListObjAppendList(interp, allPtr, listPtr);
+	if (code == TCL_OK) {
+	    code = LoadModules(interp, allPtr);
+	}
+	Tcl_DecrRefCount(allPtr);
+	if (code != TCL_OK) {
+	    return TCL_ERROR;
+	}
+	coreLoaded = 1;
+    } else {
+	if (TnmMibLoadCore(interp) != TCL_OK) {
+	    return TCL_ERROR;
+	}
+	if (listPtr && LoadModules(interp, listPtr) != TCL_OK) {
 	    return TCL_ERROR;
 	}
     }
 
-    alreadyDone = 1;
+    mibsLoaded = 1;
     return TCL_OK;
 }
 
@@ -739,7 +918,7 @@ Tnm_MibObjCmd(ClientData clientData, Tcl_Interp *interp, int	objc, Tcl_Obj *cons
     int code;
 
     enum commands {
-	cmdAccess, cmdChild, cmdCompare, cmdDefval, cmdDescr, 
+	cmdAccess, cmdCache, cmdChild, cmdCompare, cmdDefval, cmdDescr, 
 	cmdDisplay, cmdEnums, cmdExists, cmdFile, cmdFormat, cmdIndex,
 	cmdInfo, cmdLabel, cmdLength, cmdLoad, cmdMacro,
 	cmdMember, cmdModule, cmdName, cmdOid, cmdPack, cmdParent,
@@ -748,7 +927,7 @@ Tnm_MibObjCmd(ClientData clientData, Tcl_Interp *interp, int	objc, Tcl_Obj *cons
     } cmd;
 
     static const char *cmdTable[] = {
-	"access", "children", "compare", "defval", "description", 
+	"access", "cache", "children", "compare", "defval", "description", 
 	"displayhint", "enums", "exists", "file", "format", "index",
 	"info", "label", "length", "load", "macro", 
 	"member", "module", "name", "oid", "pack", "parent",
@@ -788,16 +967,15 @@ Tnm_MibObjCmd(ClientData clientData, Tcl_Interp *interp, int	objc, Tcl_Obj *cons
 
     Tcl_MutexLock(&mibMutex);
     if (! initialized) {
-	if (TnmMibLoadCore(interp) != TCL_OK) {
+	if (strcmp(Tcl_GetStringFromObj(objv[1], NULL), "load") != 0) {
+	    code = TnmMibLoad(interp);
+	} else {
+	    code = TnmMibLoadCore(interp);
+	}
+	if (code != TCL_OK) {
 	    Tcl_MutexUnlock(&mibMutex);
 	    return TCL_ERROR;
 	}
-	if (strcmp(Tcl_GetStringFromObj(objv[1], NULL), "load") != 0) {
-	    if (TnmMibLoad(interp) != TCL_OK) {
-		Tcl_MutexUnlock(&mibMutex);
-		return TCL_ERROR;
-	    }
-	}
 	initialized = 1;
     }
     Tcl_MutexUnlock(&mibMutex);
@@ -918,6 +1096,28 @@ Tnm_MibObjCmd(ClientData clientData, Tcl_Interp *interp, int	objc, Tcl_Obj *cons
 	}
 	break;
 
+    case cmdCache: {
+	int size, entries;
+	Tcl_WideInt hits, misses;
+	if (objc != 2 && objc != 3) {
+	    Tcl_WrongNumArgs(interp, 2, objv, "?size?");
+	    return TCL_ERROR;
+	}
+	if (objc == 3) {
+	    if (TnmGetUnsignedFromObj(interp, objv[2], &size) != TCL_OK) {
+		return TCL_ERROR;
+	    }
+	    TnmMibCacheConfig(size);
+	}
+	TnmMibCacheInfo(&size, &entries, &hits, &misses);
+	listPtr = Tcl_GetObjResult(interp);
+	Tcl_ListObjAppendElement(interp, listPtr, Tcl_NewIntObj(size));
+	Tcl_ListObjAppendElement(interp, listPtr, Tcl_NewIntObj(entries));
+	Tcl_ListObjAppendElement(interp, listPtr, Tcl_NewWideIntObj(hits));
+	Tcl_ListObjAppendElement(interp, listPtr, Tcl_NewWideIntObj(misses));
+	break;
+    }
+
     case cmdChild: {
 	TnmOid nodeOid;
 	int len;
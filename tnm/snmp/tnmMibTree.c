@@ -39,11 +39,29 @@ static TnmMibNode	*nodehashtab[NODEHASHSIZE];
 static Tcl_HashTable *typeHashTable = NULL;
 static Tcl_HashTable *nodeHashTable = NULL;
 
+/*
+ * Nodes with at least CHILDTAB_MIN children keep a vector of their
+ * children sorted by subid, which allows to find a child with a
+ * binary search. The children of other nodes are searched in the
+ * list of child nodes, which is also sorted by subid.
+ */
+
+#define CHILDTAB_MIN 8
+
 /*
  * Forward declarations for procedures defined later in this file:
  */
 
 static TnmMibNode*
+FindChild		(TnmMibNode *nodePtr, u_int subid);
+
+static void
+IndexChildren		(TnmMibNode *nodePtr);
+
+static TnmMibNode*
+MatchPrefix		(TnmMibNode *root, TnmOid *oidPtr,
+				     int *lengthPtr);
+static TnmMibNode*
 LookupOID		(TnmMibNode *root, const char *label,
 				     int *offset, int exact);
 static TnmMibNode*
@@ -62,12 +80,179 @@ BuildTree		(TnmMibNode *nlist);
 static void
 BuildSubTree		(TnmMibNode *root);
 
+static void
+InstallSubTree		(TnmMibNode *root);
+
 static void
 HashNodeList		(TnmMibNode *nlist);
 
 static int
 HashNodeLabel		(char *label);
 
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * FindChild --
+ *
+ *	This procedure searches for the child node with the given
+ *	subidentifier. It performs a binary search if the node has a
+ *	sorted vector of children and scans the sorted list of child
+ *	nodes otherwise.
+ *
+ * Results:
+ *	The pointer to the child node or NULL if there is no such child.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static TnmMibNode*
+FindChild(TnmMibNode *nodePtr, u_int subid)
+{
+    TnmMibNode *q;
+
+    if (nodePtr->childTab) {
+	int lo = 0, hi = nodePtr->numChildren;
+	while (lo < hi) {
+	    int mid = lo + (hi - lo) / 2;
+	    if (nodePtr->childTab[mid]->subid < subid) {
+		lo = mid + 1;
+	    } else {
+		hi = mid;
+	    }
+	}
+	return (lo < nodePtr->numChildren
+		&& nodePtr->childTab[lo]->subid == subid)
+	    ? nodePtr->childTab[lo] : NULL;
+    }
+
+    for (q = nodePtr->childPtr; q && q->subid < subid; q = q->nextPtr) ;
+    return (q && q->subid == subid) ? q : NULL;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * IndexChildren --
+ *
+ *	This procedure rebuilds the sorted vector of child nodes after
+ *	the list of child nodes has been modified. Nodes with only a
+ *	few children do not get a vector.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	Memory is allocated or freed.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+IndexChildren(TnmMibNode *nodePtr)
+{
+    TnmMibNode *q;
+    int n = 0;
+
+    if (nodePtr->childTab) {
+	ckfree((char *) nodePtr->childTab);
+	nodePtr->childTab = NULL;
+	nodePtr->numChildren = 0;
+    }
+
+    for (q = nodePtr->childPtr; q; q = q->nextPtr) {
+	n++;
+    }
+    if (n < CHILDTAB_MIN) {
+	return;
+    }
+
+    nodePtr->childTab = (TnmMibNode **) ckalloc(n * sizeof(TnmMibNode *));
+    for (q = nodePtr->childPtr; q; q = q->nextPtr) {
+	nodePtr->childTab[nodePtr->numChildren++] = q;
+    }
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * MatchPrefix --
+ *
+ *	This procedure searches for the MIB node with the longest
+ *	object identifier which is a prefix of the object identifier
+ *	given by oidPtr. The search starts at the list of top-level
+ *	nodes given by root.
+ *
+ * Results:
+ *	The pointer to the node or NULL if not even the first
+ *	subidentifier matches. The length of the object identifier
+ *	of the node is left in lengthPtr.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static TnmMibNode*
+MatchPrefix(TnmMibNode *root, TnmOid *oidPtr, int *lengthPtr)
+{
+    int i, len = TnmOidGetLength(oidPtr);
+    TnmMibNode *p, *q;
+
+    *lengthPtr = 0;
+    if (len == 0) {
+	return NULL;
+    }
+
+    for (p = root; p ; p = p->nextPtr) {
+	if (TnmOidGet(oidPtr, 0) == p->subid) break;
+    }
+    if (!p) {
+	return NULL;
+    }
+
+    for (i = 1; i < len; i++) {
+	q = FindChild(p, TnmOidGet(oidPtr, i));
+	if (!q) {
+	    break;
+	}
+	p = q;
+    }
+
+    *lengthPtr = i;
+    return p;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * TnmMibFindPrefix --
+ *
+ *	This procedure performs a longest prefix match of an object
+ *	identifier in the MIB tree. Any subidentifiers beyond the
+ *	length of the matching node's object identifier usually
+ *	identify an instance.
+ *
+ * Results:
+ *	The pointer to the node or NULL if the node was not found.
+ *	The length of the object identifier of the node is left in
+ *	lengthPtr.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+TnmMibNode*
+TnmMibFindPrefix(TnmOid *oidPtr, int *lengthPtr)
+{
+    return MatchPrefix(tnmMibTree, oidPtr, lengthPtr);
+}
 
 /*
  *----------------------------------------------------------------------
@@ -91,39 +276,21 @@ HashNodeLabel		(char *label);
 TnmMibNode*
 TnmMibNodeFromOid(TnmOid *oidPtr, TnmOid *nodeOidPtr)
 {
-    int i;
-    TnmMibNode *p, *q = NULL;
+    int i, len;
+    TnmMibNode *p;
 
     if (nodeOidPtr) {
 	TnmOidFree(nodeOidPtr);
     }
 
-    for (p = tnmMibTree; p ; p = p->nextPtr) {
-	if (TnmOidGet(oidPtr, 0) == p->subid) break;
-    }
-    if (!p) {
-	return NULL;
-    }
-
-    if (nodeOidPtr) {
-	TnmOidAppend(nodeOidPtr, TnmOidGet(oidPtr, 0));
-    }
-
-    for (q = p, i = 1; i < TnmOidGetLength(oidPtr); p = q, i++) {
-	for (q = p->childPtr; q; q = q->nextPtr) {
-	    if (q->subid == TnmOidGet(oidPtr, i)) {
-		if (nodeOidPtr) {
-		    TnmOidAppend(nodeOidPtr, TnmOidGet(oidPtr, i));
-		}
-		break;
-	    }
-	}
-	if (!q) {
-	    return p;
+    p = MatchPrefix(tnmMibTree, oidPtr, &len);
+    if (p && nodeOidPtr) {
+	for (i = 0; i < len; i++) {
+	    TnmOidAppend(nodeOidPtr, TnmOidGet(oidPtr, i));
 	}
     }
 
-    return q;
+    return p;
 }
 
 /*
@@ -150,8 +317,8 @@ static TnmMibNode*
 LookupOID(TnmMibNode *root, const char *label, int *offset, int exact)
 {
     TnmOid oid;
-    int i;
-    TnmMibNode *p, *q = NULL;
+    int i, len;
+    TnmMibNode *p;
     const char *s = label;
 
     if (offset) *offset = -1;
@@ -175,39 +342,21 @@ LookupOID(TnmMibNode *root, const char *label, int *offset, int exact)
 	return NULL;
     }
 
-    for (p = root; p ; p = p->nextPtr) {
-	if (TnmOidGet(&oid, 0) == p->subid) break;
-    }
-    if (!p) {
-	TnmOidFree(&oid);
-	return NULL;
-    }
-
-    while (offset && s && ispunct(*s)) s++;
-    while (offset && s && isdigit(*s)) s++;
-
-    for (q = p, i = 1; i < TnmOidGetLength(&oid); p = q, i++) {
-	for (q = p->childPtr; q; q = q->nextPtr) {
-	    if (q->subid == TnmOidGet(&oid, i)) break;
-	}
-	if (!q) {
-	    if (! exact) {
-		if (offset) {
-		    *offset = s - label;
-		}
-		TnmOidFree(&oid);
-		return p;
-	    } else {
-		TnmOidFree(&oid);
-		return NULL; 
+    p = MatchPrefix(root, &oid, &len);
+    if (p && len < TnmOidGetLength(&oid)) {
+	if (exact) {
+	    p = NULL;
+	} else if (offset) {
+	    for (i = 0; i < len; i++) {
+		while (*s && ispunct(*s)) s++;
+		while (*s && isdigit(*s)) s++;
 	    }
+	    *offset = s - label;
 	}
-	while (offset && s && ispunct(*s)) s++;
-	while (offset && s && isdigit(*s)) s++;
     }
 
     TnmOidFree(&oid);
-    return q;
+    return p;
 }
 
 /*
@@ -272,14 +421,9 @@ LookupLabelOID(TnmMibNode *root, const char *label, int *offset, int exact)
 			TnmOidInit(&o);
 			TnmOidFromString(&o, label+*offset);
 			for (i = 0; i < TnmOidGetLength(&o); i++) {
-			    for (nPtr = nodePtr->childPtr; 
-				 nPtr; nPtr = nPtr->nextPtr) {
-				if (nPtr->subid == TnmOidGet(&o, i)) {
-				    nodePtr = nPtr;
-				    break;
-				}
-			    }
+			    nPtr = FindChild(nodePtr, TnmOidGet(&o, i));
 			    if (! nPtr) break;
+			    nodePtr = nPtr;
 			}
 			TnmOidFree(&o);
 
@@ -831,6 +975,7 @@ BuildSubTree(TnmMibNode *root)
 {
     TnmMibNode **np, **ptr;
     int	hash = HashNodeLabel(root->label);
+    int changed = 0;
 
     /*
      * Loop through all nodes whose parent is root. They are all
@@ -876,6 +1021,7 @@ BuildSubTree(TnmMibNode *root)
 		thisNode->nextPtr = *ptr;
                 *ptr = thisNode;
 		HashNode(thisNode);
+		changed = 1;
 	    }
 
 	    BuildSubTree(*ptr);			/* recurse on child */
@@ -884,6 +1030,10 @@ BuildSubTree(TnmMibNode *root)
 	    np = &(*np)->nextPtr;
 	}
     }
+
+    if (changed) {
+	IndexChildren(root);
+    }
 }
 
 /*
@@ -901,7 +1051,8 @@ BuildSubTree(TnmMibNode *root)
  *
  * Side effects:
  *	The nodes are moved from the nodeList into the correct 
- *	position in the MIB tree.
+ *	position in the MIB tree and the translation cache is
+ *	flushed.
  *
  *----------------------------------------------------------------------
  */
@@ -918,6 +1069,8 @@ TnmMibAddNode(TnmMibNode **rootPtr, TnmMibNode *nodeList)
 	return 0;
     }
 
+    TnmMibCacheFlush();
+
     if (! root) {
 	*rootPtr = BuildTree(nodeList);
     }
@@ -975,6 +1128,69 @@ TnmMibAddNode(TnmMibNode **rootPtr, TnmMibNode *nodeList)
     return result;
 }
 
+/*
+ *----------------------------------------------------------------------
+ *
+ * TnmMibInstallTree --
+ *
+ *	This procedure installs a MIB tree whose nodes are already
+ *	linked, e.g. a tree loaded from a bundle. The tree replaces
+ *	an empty MIB tree.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	The nodes below the top-level nodes are added to the hash
+ *	table used to lookup nodes by name, the sorted vectors
+ *	of child nodes are created and the translation cache is
+ *	flushed.
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+TnmMibInstallTree(TnmMibNode *treePtr)
+{
+    TnmMibNode *nodePtr;
+
+    TnmMibCacheFlush();
+    tnmMibTree = treePtr;
+    for (nodePtr = treePtr; nodePtr; nodePtr = nodePtr->nextPtr) {
+	InstallSubTree(nodePtr);
+    }
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * InstallSubTree --
+ *
+ *	This procedure adds all nodes below root to the hash table
+ *	used to lookup nodes by name and creates the sorted vectors
+ *	of child nodes.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	The hash table is updated and memory is allocated.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+InstallSubTree(TnmMibNode *root)
+{
+    TnmMibNode *nodePtr;
+
+    IndexChildren(root);
+    for (nodePtr = root->childPtr; nodePtr; nodePtr = nodePtr->nextPtr) {
+	HashNode(nodePtr);
+	InstallSubTree(nodePtr);
+    }
+}
+
 /*
  *----------------------------------------------------------------------
  *
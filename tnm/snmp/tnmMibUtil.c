@@ -30,6 +30,8 @@ TnmMibNode *tnmMibTree = NULL;		/* The root of the MIB tree.	   */
 TnmMibType *tnmMibTypeList = NULL;	/* List of textual conventions.	   */
 TnmMibType *tnmMibTypeSaveMark = NULL;	/* The first already saved	   */
 					/* element of tnmMibTypeList.	   */
+Tcl_Obj *tnmMibImportList = NULL;	/* Modules imported by the current */
+					/* MIB file loaded.		   */
 
 TnmTable tnmMibAccessTable[] = {
     { TNM_MIB_NOACCESS,   "not-accessible" },
@@ -68,7 +70,31 @@ TnmTable tnmMibStatusTable[] = {
  * dottet notation.
  */
 
-static char oidBuffer[TNM_OID_MAX_SIZE * 8];
+static char oidBuffer[TNM_MIB_CACHE_MAX];
+
+/*
+ * The translation cache maps the kind of a translation and its
+ * argument to the result of the translation. The entries are kept
+ * in a list ordered by their last use so that the least recently
+ * used entry can be removed when the cache is full.
+ */
+
+typedef struct CacheEntry {
+    Tcl_HashEntry *entryPtr;	/* The entry in the hash table. */
+    struct CacheEntry *nextPtr;	/* Next (more recently used) entry. */
+    struct CacheEntry *prevPtr;	/* Previous (less recently used) entry. */
+    char value[1];		/* The result of the translation. */
+} CacheEntry;
+
+static Tcl_HashTable cacheTable;
+static int cacheInitialized = 0;
+static CacheEntry *cacheHead = NULL;
+static CacheEntry *cacheTail = NULL;
+static int cacheSize = 4096;		/* Max. number of cache entries. */
+static Tcl_WideInt cacheHits = 0;	/* Number of successful lookups. */
+static Tcl_WideInt cacheMisses = 0;	/* Number of failed lookups. */
+
+TCL_DECLARE_MUTEX(cacheMutex)
 
 /*
  * Forward declarations for procedures defined later in this file:
@@ -92,6 +118,12 @@ GetMibPath		(TnmMibNode *nodePtr, char *soid);
 static void
 FormatUnsigned		(unsigned u, char *s);
 
+static int
+CacheMakeKey		(int kind, const char *key, char *buffer);
+
+static void
+CacheRemove		(CacheEntry *cachePtr);
+
 
 /*
  *----------------------------------------------------------------------
@@ -208,20 +240,28 @@ TnmMibNodeToOid(TnmMibNode *nodePtr, TnmOid *oidPtr)
 char*
 TnmMibGetOid(const char *label)
 {
-    char *expanded = TnmHexToOid(label);
+    const char *key = label;
+    char *expanded;
     TnmMibNode *nodePtr;
     int offset = -1;
 
+    if (TnmMibCacheGet(TNM_MIB_CACHE_OID, key, oidBuffer) >= 0) {
+	return oidBuffer;
+    }
+
+    expanded = TnmHexToOid(label);
     if (expanded) label = expanded;
     nodePtr = TnmMibFindNode(label, &offset, 0);
     if (nodePtr) {
 	if (TnmIsOid(label)) {
+	  TnmMibCachePut(TNM_MIB_CACHE_OID, key, label);
 	  return (char *) label;
 	}
 	GetMibPath(nodePtr, oidBuffer);
 	if (offset > 0) {
 	    strcat(oidBuffer, label+offset);
 	}
+	TnmMibCachePut(TNM_MIB_CACHE_OID, key, oidBuffer);
 	return oidBuffer;
     }
 
@@ -249,18 +289,26 @@ TnmMibGetOid(const char *label)
 char*
 TnmMibGetName(char *label, int exact)
 {
-    char *expanded = TnmHexToOid(label);
+    char *key = label, *expanded;
     TnmMibNode *nodePtr;
     int offset = -1;
-    
+    int kind = exact ? TNM_MIB_CACHE_EXACT : TNM_MIB_CACHE_NAME;
+
+    if (TnmMibCacheGet(kind, key, oidBuffer) >= 0) {
+	return oidBuffer;
+    }
+
+    expanded = TnmHexToOid(label);
     if (expanded) label = expanded;
     nodePtr = TnmMibFindNode(label, &offset, exact);
     if (nodePtr) {
 	if (offset > 0) {
 	    strcpy(oidBuffer, nodePtr->label);
 	    strcat(oidBuffer, label+offset);
+	    TnmMibCachePut(kind, key, oidBuffer);
 	    return oidBuffer;
 	} else {
+	    TnmMibCachePut(kind, key, nodePtr->label);
 	    return nodePtr->label;
 	}
     }
@@ -268,6 +316,281 @@ TnmMibGetName(char *label, int exact)
     return NULL;
 }
 
+/*
+ *----------------------------------------------------------------------
+ *
+ * CacheMakeKey --
+ *
+ *	This procedure writes the key of a translation cache entry
+ *	into the buffer, which must be TNM_MIB_CACHE_MAX + 1 bytes
+ *	long. The key is the kind of the translation followed by its
+ *	argument.
+ *
+ * Results:
+ *	1 if the key has been created or 0 if the argument is too
+ *	long to be cached.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+CacheMakeKey(int kind, const char *key, char *buffer)
+{
+    size_t len = strlen(key);
+
+    if (len >= TNM_MIB_CACHE_MAX) {
+	return 0;
+    }
+    buffer[0] = (char) kind;
+    memcpy(buffer + 1, key, len + 1);
+    return 1;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * CacheRemove --
+ *
+ *	This procedure removes an entry from the translation cache.
+ *	The caller must hold the cache mutex.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	Memory is freed.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+CacheRemove(CacheEntry *cachePtr)
+{
+    if (cachePtr->prevPtr) {
+	cachePtr->prevPtr->nextPtr = cachePtr->nextPtr;
+    } else {
+	cacheHead = cachePtr->nextPtr;
+    }
+    if (cachePtr->nextPtr) {
+	cachePtr->nextPtr->prevPtr = cachePtr->prevPtr;
+    } else {
+	cacheTail = cachePtr->prevPtr;
+    }
+    Tcl_DeleteHashEntry(cachePtr->entryPtr);
+    ckfree((char *) cachePtr);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * TnmMibCacheGet --
+ *
+ *	This procedure looks up a translation in the translation
+ *	cache and copies the result into the buffer, which must be
+ *	TNM_MIB_CACHE_MAX bytes long.
+ *
+ * Results:
+ *	The length of the result or -1 if the translation is not
+ *	in the cache.
+ *
+ * Side effects:
+ *	The entry becomes the most recently used entry and the hit
+ *	or miss counter is updated.
+ *
+ *----------------------------------------------------------------------
+ */
+
+int
+TnmMibCacheGet(int kind, const char *key, char *buffer)
+{
+    char keyBuffer[TNM_MIB_CACHE_MAX + 1];
+    Tcl_HashEntry *entryPtr;
+    CacheEntry *cachePtr;
+    int len = -1;
+
+    if (cacheSize <= 0 || ! CacheMakeKey(kind, key, keyBuffer)) {
+	return -1;
+    }
+
+    Tcl_MutexLock(&cacheMutex);
+    entryPtr = cacheInitialized
+	? Tcl_FindHashEntry(&cacheTable, keyBuffer) : NULL;
+    if (! entryPtr) {
+	cacheMisses++;
+	Tcl_MutexUnlock(&cacheMutex);
+	return -1;
+    }
+    cachePtr = (CacheEntry *) Tcl_GetHashValue(entryPtr);
+    if (cachePtr != cacheTail) {
+	if (cachePtr->prevPtr) {
+	    cachePtr->prevPtr->nextPtr = cachePtr->nextPtr;
+	} else {
+	    cacheHead = cachePtr->nextPtr;
+	}
+	cachePtr->nextPtr->prevPtr = cachePtr->prevPtr;
+	cachePtr->nextPtr = NULL;
+	cachePtr->prevPtr = cacheTail;
+	cacheTail->nextPtr = cachePtr;
+	cacheTail = cachePtr;
+    }
+    len = strlen(cachePtr->value);
+    memcpy(buffer, cachePtr->value, (size_t) len + 1);
+    cacheHits++;
+    Tcl_MutexUnlock(&cacheMutex);
+    return len;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * TnmMibCachePut --
+ *
+ *	This procedure saves the result of a translation in the
+ *	translation cache. The least recently used entry is removed
+ *	if the cache is full.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	Memory is allocated.
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+TnmMibCachePut(int kind, const char *key, const char *value)
+{
+    char keyBuffer[TNM_MIB_CACHE_MAX + 1];
+    Tcl_HashEntry *entryPtr;
+    CacheEntry *cachePtr;
+    size_t len = strlen(value);
+    int isNew;
+
+    if (cacheSize <= 0 || len >= TNM_MIB_CACHE_MAX
+	|| ! CacheMakeKey(kind, key, keyBuffer)) {
+	return;
+    }
+
+    Tcl_MutexLock(&cacheMutex);
+    if (! cacheInitialized) {
+	Tcl_InitHashTable(&cacheTable, TCL_STRING_KEYS);
+	cacheInitialized = 1;
+    }
+    entryPtr = Tcl_CreateHashEntry(&cacheTable, keyBuffer, &isNew);
+    if (! isNew) {
+	CacheRemove((CacheEntry *) Tcl_GetHashValue(entryPtr));
+	entryPtr = Tcl_CreateHashEntry(&cacheTable, keyBuffer, &isNew);
+    }
+    while (cacheTable.numEntries > cacheSize && cacheHead) {
+	CacheRemove(cacheHead);
+    }
+
+    cachePtr = (CacheEntry *) ckalloc(sizeof(CacheEntry) + len);
+    cachePtr->entryPtr = entryPtr;
+    memcpy(cachePtr->value, value, len + 1);
+    Tcl_SetHashValue(entryPtr, (ClientData) cachePtr);
+
+    cachePtr->nextPtr = NULL;
+    cachePtr->prevPtr = cacheTail;
+    if (cacheTail) {
+	cacheTail->nextPtr = cachePtr;
+    } else {
+	cacheHead = cachePtr;
+    }
+    cacheTail = cachePtr;
+    Tcl_MutexUnlock(&cacheMutex);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * TnmMibCacheFlush --
+ *
+ *	This procedure removes all entries from the translation cache.
+ *	It is called whenever nodes are added to the MIB tree since
+ *	new nodes change the result of translations.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	Memory is freed.
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+TnmMibCacheFlush(void)
+{
+    Tcl_MutexLock(&cacheMutex);
+    while (cacheHead) {
+	CacheRemove(cacheHead);
+    }
+    Tcl_MutexUnlock(&cacheMutex);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * TnmMibCacheConfig --
+ *
+ *	This procedure sets the maximum number of entries of the
+ *	translation cache. A size of 0 turns the cache off.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	Entries are removed if the cache is too large.
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+TnmMibCacheConfig(int size)
+{
+    Tcl_MutexLock(&cacheMutex);
+    cacheSize = size;
+    while (cacheHead && cacheTable.numEntries > cacheSize) {
+	CacheRemove(cacheHead);
+    }
+    Tcl_MutexUnlock(&cacheMutex);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * TnmMibCacheInfo --
+ *
+ *	This procedure returns the size of the translation cache, the
+ *	number of entries and the number of lookups which did or did
+ *	not find a translation in the cache.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+TnmMibCacheInfo(int *sizePtr, int *entriesPtr, Tcl_WideInt *hitsPtr,
+		Tcl_WideInt *missesPtr)
+{
+    Tcl_MutexLock(&cacheMutex);
+    *sizePtr = cacheSize;
+    *entriesPtr = cacheInitialized ? cacheTable.numEntries : 0;
+    *hitsPtr = cacheHits;
+    *missesPtr = cacheMisses;
+    Tcl_MutexUnlock(&cacheMutex);
+}
+
 /*
  *----------------------------------------------------------------------
  *
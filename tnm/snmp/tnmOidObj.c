@@ -861,11 +861,32 @@ UpdateStringOfOid(Tcl_Obj *objPtr)
 	strcpy(objPtr->bytes, string);
     } else {
 	TnmMibNode *nodePtr;
-	int offset;
-	nodePtr = TnmMibFindNode(string, &offset, 0);
+	char buffer[TNM_MIB_CACHE_MAX];
+	int i, len, offset = -1;
+
+	len = TnmMibCacheGet(TNM_MIB_CACHE_QNAME, string, buffer);
+	if (len >= 0) {
+	    objPtr->length = len;
+	    objPtr->bytes = Tcl_Alloc(objPtr->length + 1);
+	    memcpy(objPtr->bytes, buffer, (size_t) len + 1);
+	    return;
+	}
+
+	/*
+	 * Find the node with the longest matching prefix. The offset
+	 * points to the dot which separates the subidentifiers not
+	 * covered by the node.
+	 */
+
+	nodePtr = TnmMibFindPrefix(oidPtr, &len);
 	if (! nodePtr) {
 	    goto returnOid;
 	}
+	if (len < TnmOidGetLength(oidPtr)) {
+	    for (i = 0, offset = 0; string[offset]; offset++) {
+		if (string[offset] == '.' && ++i == len) break;
+	    }
+	}
 	objPtr->length = strlen(nodePtr->label);
 	if (nodePtr->moduleName) {
 	    objPtr->length += strlen(nodePtr->moduleName) + 2;
@@ -888,6 +909,7 @@ UpdateStringOfOid(Tcl_Obj *objPtr)
 	if (offset > 0) {
 	    strcat(objPtr->bytes, string+offset);
 	}
+	TnmMibCachePut(TNM_MIB_CACHE_QNAME, string, objPtr->bytes);
     }
 }
 
@@ -0,0 +1,520 @@
+/*
+ * tnmSHA2.c --
+ *
+ *	This file contains an implementation of the SHA-224, SHA-256,
+ *	SHA-384 and SHA-512 hash functions as defined in FIPS 180-4.
+ *	They are used by the HMAC-SHA-2 authentication protocols of
+ *	the user based security model (RFC 7860).
+ *
+ * See the file "license.terms" for information on usage and redistribution
+ * of this file, and for a DISCLAIMER OF ALL WARRANTIES.
+ */
+
+#include "tnmInt.h"
+#include "tnmSHA2.h"
+
+#define ROR32(x,n)	(((x) >> (n)) | ((x) << (32 - (n))))
+#define ROR64(x,n)	(((x) >> (n)) | ((x) << (64 - (n))))
+
+#define CH(x,y,z)	(((x) & (y)) ^ (~(x) & (z)))
+#define MAJ(x,y,z)	(((x) & (y)) ^ ((x) & (z)) ^ ((y) & (z)))
+
+#define S256_0(x)	(ROR32(x, 2) ^ ROR32(x,13) ^ ROR32(x,22))
+#define S256_1(x)	(ROR32(x, 6) ^ ROR32(x,11) ^ ROR32(x,25))
+#define s256_0(x)	(ROR32(x, 7) ^ ROR32(x,18) ^ ((x) >> 3))
+#define s256_1(x)	(ROR32(x,17) ^ ROR32(x,19) ^ ((x) >> 10))
+
+#define S512_0(x)	(ROR64(x,28) ^ ROR64(x,34) ^ ROR64(x,39))
+#define S512_1(x)	(ROR64(x,14) ^ ROR64(x,18) ^ ROR64(x,41))
+#define s512_0(x)	(ROR64(x, 1) ^ ROR64(x, 8) ^ ((x) >> 7))
+#define s512_1(x)	(ROR64(x,19) ^ ROR64(x,61) ^ ((x) >> 6))
+
+#define W64(x)		((Tcl_WideUInt) (x))
+
+static const unsigned int K256[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5,
+    0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+    0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc,
+    0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7,
+    0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+    0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3,
+    0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5,
+    0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+    0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+static const Tcl_WideUInt K512[80] = {
+    W64(0x428a2f98d728ae22ULL), W64(0x7137449123ef65cdULL),
+    W64(0xb5c0fbcfec4d3b2fULL), W64(0xe9b5dba58189dbbcULL),
+    W64(0x3956c25bf348b538ULL), W64(0x59f111f1b605d019ULL),
+    W64(0x923f82a4af194f9bULL), W64(0xab1c5ed5da6d8118ULL),
+    W64(0xd807aa98a3030242ULL), W64(0x12835b0145706fbeULL),
+    W64(0x243185be4ee4b28cULL), W64(0x550c7dc3d5ffb4e2ULL),
+    W64(0x72be5d74f27b896fULL), W64(0x80deb1fe3b1696b1ULL),
+    W64(0x9bdc06a725c71235ULL), W64(0xc19bf174cf692694ULL),
+    W64(0xe49b69c19ef14ad2ULL), W64(0xefbe4786384f25e3ULL),
+    W64(0x0fc19dc68b8cd5b5ULL), W64(0x240ca1cc77ac9c65ULL),
+    W64(0x2de92c6f592b0275ULL), W64(0x4a7484aa6ea6e483ULL),
+    W64(0x5cb0a9dcbd41fbd4ULL), W64(0x76f988da831153b5ULL),
+    W64(0x983e5152ee66dfabULL), W64(0xa831c66d2db43210ULL),
+    W64(0xb00327c898fb213fULL), W64(0xbf597fc7beef0ee4ULL),
+    W64(0xc6e00bf33da88fc2ULL), W64(0xd5a79147930aa725ULL),
+    W64(0x06ca6351e003826fULL), W64(0x142929670a0e6e70ULL),
+    W64(0x27b70a8546d22ffcULL), W64(0x2e1b21385c26c926ULL),
+    W64(0x4d2c6dfc5ac42aedULL), W64(0x53380d139d95b3dfULL),
+    W64(0x650a73548baf63deULL), W64(0x766a0abb3c77b2a8ULL),
+    W64(0x81c2c92e47edaee6ULL), W64(0x92722c851482353bULL),
+    W64(0xa2bfe8a14cf10364ULL), W64(0xa81a664bbc423001ULL),
+    W64(0xc24b8b70d0f89791ULL), W64(0xc76c51a30654be30ULL),
+    W64(0xd192e819d6ef5218ULL), W64(0xd69906245565a910ULL),
+    W64(0xf40e35855771202aULL), W64(0x106aa07032bbd1b8ULL),
+    W64(0x19a4c116b8d2d0c8ULL), W64(0x1e376c085141ab53ULL),
+    W64(0x2748774cdf8eeb99ULL), W64(0x34b0bcb5e19b48a8ULL),
+    W64(0x391c0cb3c5c95a63ULL), W64(0x4ed8aa4ae3418acbULL),
+    W64(0x5b9cca4f7763e373ULL), W64(0x682e6ff3d6b2b8a3ULL),
+    W64(0x748f82ee5defb2fcULL), W64(0x78a5636f43172f60ULL),
+    W64(0x84c87814a1f0ab72ULL), W64(0x8cc702081a6439ecULL),
+    W64(0x90befffa23631e28ULL), W64(0xa4506cebde82bde9ULL),
+    W64(0xbef9a3f7b2c67915ULL), W64(0xc67178f2e372532bULL),
+    W64(0xca273eceea26619cULL), W64(0xd186b8c721c0c207ULL),
+    W64(0xeada7dd6cde0eb1eULL), W64(0xf57d4f7fee6ed178ULL),
+    W64(0x06f067aa72176fbaULL), W64(0x0a637dc5a2c898a6ULL),
+    W64(0x113f9804bef90daeULL), W64(0x1b710b35131c471bULL),
+    W64(0x28db77f523047d84ULL), W64(0x32caab7b40c72493ULL),
+    W64(0x3c9ebe0a15c9bebcULL), W64(0x431d67c49c100d4cULL),
+    W64(0x4cc5d4becb3e42b6ULL), W64(0x597f299cfc657e2aULL),
+    W64(0x5fcb6fab3ad6faecULL), W64(0x6c44198c4a475817ULL)
+};
+
+/*
+ * Forward declarations for procedures defined later in this file:
+ */
+
+static void
+SHA256Transform	(unsigned int *state, const unsigned char *block);
+
+static void
+SHA512Transform	(Tcl_WideUInt *state, const unsigned char *block);
+
+static void
+SHA256Pad	(TnmSHA256_CTX *ctx);
+
+static void
+SHA512Pad	(TnmSHA512_CTX *ctx);
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * SHA256Transform --
+ *
+ *	This procedure processes a 64 byte block with the SHA-256
+ *	compression function.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	The state is updated.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+SHA256Transform(unsigned int *state, const unsigned char *block)
+{
+    unsigned int w[64], a, b, c, d, e, f, g, h, t1, t2;
+    int i;
+
+    for (i = 0; i < 16; i++) {
+	w[i] = ((unsigned int) block[4*i] << 24)
+	    | ((unsigned int) block[4*i+1] << 16)
+	    | ((unsigned int) block[4*i+2] << 8)
+	    | (unsigned int) block[4*i+3];
+    }
+    for (i = 16; i < 64; i++) {
+	w[i] = s256_1(w[i-2]) + w[i-7] + s256_0(w[i-15]) + w[i-16];
+    }
+
+    a = state[0]; b = state[1]; c = state[2]; d = state[3];
+    e = state[4]; f = state[5]; g = state[6]; h = state[7];
+
+    for (i = 0; i < 64; i++) {
+	t1 = h + S256_1(e) + CH(e, f, g) + K256[i] + w[i];
+	t2 = S256_0(a) + MAJ(a, b, c);
+	h = g; g = f; f = e; e = d + t1;
+	d = c; c = b; b = a; a = t1 + t2;
+    }
+
+    state[0] += a; state[1] += b; state[2] += c; state[3] += d;
+    state[4] += e; state[5] += f; state[6] += g; state[7] += h;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * SHA512Transform --
+ *
+ *	This procedure processes a 128 byte block with the SHA-512
+ *	compression function.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	The state is updated.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+SHA512Transform(Tcl_WideUInt *state, const unsigned char *block)
+{
+    Tcl_WideUInt w[80], a, b, c, d, e, f, g, h, t1, t2;
+    int i, j;
+
+    for (i = 0; i < 16; i++) {
+	w[i] = 0;
+	for (j = 0; j < 8; j++) {
+	    w[i] = (w[i] << 8) | block[8*i+j];
+	}
+    }
+    for (i = 16; i < 80; i++) {
+	w[i] = s512_1(w[i-2]) + w[i-7] + s512_0(w[i-15]) + w[i-16];
+    }
+
+    a = state[0]; b = state[1]; c = state[2]; d = state[3];
+    e = state[4]; f = state[5]; g = state[6]; h = state[7];
+
+    for (i = 0; i < 80; i++) {
+	t1 = h + S512_1(e) + CH(e, f, g) + K512[i] + w[i];
+	t2 = S512_0(a) + MAJ(a, b, c);
+	h = g; g = f; f = e; e = d + t1;
+	d = c; c = b; b = a; a = t1 + t2;
+    }
+
+    state[0] += a; state[1] += b; state[2] += c; state[3] += d;
+    state[4] += e; state[5] += f; state[6] += g; state[7] += h;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * TnmSHA224Init, TnmSHA256Init --
+ *
+ *	These procedures initialize a context for SHA-224 or SHA-256.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	The context is initialized.
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+TnmSHA224Init(TnmSHA256_CTX *ctx)
+{
+    static const unsigned int init[8] = {
+	0xc1059ed8, 0x367cd507, 0x3070dd17, 0xf70e5939,
+	0xffc00b31, 0x68581511, 0x64f98fa7, 0xbefa4fa4
+    };
+    memcpy(ctx->state, init, sizeof(init));
+    ctx->count = 0;
+}
+
+void
+TnmSHA256Init(TnmSHA256_CTX *ctx)
+{
+    static const unsigned int init[8] = {
+	0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+	0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+    };
+    memcpy(ctx->state, init, sizeof(init));
+    ctx->count = 0;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * TnmSHA256Update --
+ *
+ *	This procedure adds data to a SHA-224 or SHA-256 digest.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	The context is updated.
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+TnmSHA256Update(TnmSHA256_CTX *ctx, unsigned char *data, int length)
+{
+    int used = (int) (ctx->count % TNM_SHA256_BLOCKSIZE);
+
+    ctx->count += length;
+    if (used) {
+	int n = TNM_SHA256_BLOCKSIZE - used;
+	if (n > length) {
+	    n = length;
+	}
+	memcpy(ctx->buffer + used, data, (size_t) n);
+	data += n, length -= n, used += n;
+	if (used < TNM_SHA256_BLOCKSIZE) {
+	    return;
+	}
+	SHA256Transform(ctx->state, ctx->buffer);
+    }
+    while (length >= TNM_SHA256_BLOCKSIZE) {
+	SHA256Transform(ctx->state, data);
+	data += TNM_SHA256_BLOCKSIZE, length -= TNM_SHA256_BLOCKSIZE;
+    }
+    if (length) {
+	memcpy(ctx->buffer, data, (size_t) length);
+    }
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * SHA256Pad --
+ *
+ *	This procedure appends the padding and the message length
+ *	and processes the final blocks.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	The context is updated.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+SHA256Pad(TnmSHA256_CTX *ctx)
+{
+    unsigned char pad[TNM_SHA256_BLOCKSIZE + 8];
+    Tcl_WideUInt bits = ctx->count << 3;
+    int used = (int) (ctx->count % TNM_SHA256_BLOCKSIZE);
+    int i, n = (used < 56) ? 56 - used : 120 - used;
+
+    memset(pad, 0, sizeof(pad));
+    pad[0] = 0x80;
+    for (i = 0; i < 8; i++) {
+	pad[n + i] = (unsigned char) (bits >> (56 - 8 * i));
+    }
+    TnmSHA256Update(ctx, pad, n + 8);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * TnmSHA224Final, TnmSHA256Final --
+ *
+ *	These procedures finish a SHA-224 or SHA-256 digest.
+ *
+ * Results:
+ *	The digest is written to the digest argument.
+ *
+ * Side effects:
+ *	The context must be initialized before it is used again.
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+TnmSHA224Final(unsigned char digest[TNM_SHA224_SIZE], TnmSHA256_CTX *ctx)
+{
+    int i;
+
+    SHA256Pad(ctx);
+    for (i = 0; i < TNM_SHA224_SIZE; i++) {
+	digest[i] = (unsigned char) (ctx->state[i >> 2] >> (24 - 8 * (i & 3)));
+    }
+}
+
+void
+TnmSHA256Final(unsigned char digest[TNM_SHA256_SIZE], TnmSHA256_CTX *ctx)
+{
+    int i;
+
+    SHA256Pad(ctx);
+    for (i = 0; i < TNM_SHA256_SIZE; i++) {
+	digest[i] = (unsigned char) (ctx->state[i >> 2] >> (24 - 8 * (i & 3)));
+    }
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * TnmSHA384Init, TnmSHA512Init --
+ *
+ *	These procedures initialize a context for SHA-384 or SHA-512.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	The context is initialized.
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+TnmSHA384Init(TnmSHA512_CTX *ctx)
+{
+    static const Tcl_WideUInt init[8] = {
+	W64(0xcbbb9d5dc1059ed8ULL), W64(0x629a292a367cd507ULL),
+	W64(0x9159015a3070dd17ULL), W64(0x152fecd8f70e5939ULL),
+	W64(0x67332667ffc00b31ULL), W64(0x8eb44a8768581511ULL),
+	W64(0xdb0c2e0d64f98fa7ULL), W64(0x47b5481dbefa4fa4ULL)
+    };
+    memcpy(ctx->state, init, sizeof(init));
+    ctx->count = 0;
+}
+
+void
+TnmSHA512Init(TnmSHA512_CTX *ctx)
+{
+    static const Tcl_WideUInt init[8] = {
+	W64(0x6a09e667f3bcc908ULL), W64(0xbb67ae8584caa73bULL),
+	W64(0x3c6ef372fe94f82bULL), W64(0xa54ff53a5f1d36f1ULL),
+	W64(0x510e527fade682d1ULL), W64(0x9b05688c2b3e6c1fULL),
+	W64(0x1f83d9abfb41bd6bULL), W64(0x5be0cd19137e2179ULL)
+    };
+    memcpy(ctx->state, init, sizeof(init));
+    ctx->count = 0;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * TnmSHA512Update --
+ *
+ *	This procedure adds data to a SHA-384 or SHA-512 digest.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	The context is updated.
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+TnmSHA512Update(TnmSHA512_CTX *ctx, unsigned char *data, int length)
+{
+    int used = (int) (ctx->count % TNM_SHA512_BLOCKSIZE);
+
+    ctx->count += length;
+    if (used) {
+	int n = TNM_SHA512_BLOCKSIZE - used;
+	if (n > length) {
+	    n = length;
+	}
+	memcpy(ctx->buffer + used, data, (size_t) n);
+	data += n, length -= n, used += n;
+	if (used < TNM_SHA512_BLOCKSIZE) {
+	    return;
+	}
+	SHA512Transform(ctx->state, ctx->buffer);
+    }
+    while (length >= TNM_SHA512_BLOCKSIZE) {
+	SHA512Transform(ctx->state, data);
+	data += TNM_SHA512_BLOCKSIZE, length -= TNM_SHA512_BLOCKSIZE;
+    }
+    if (length) {
+	memcpy(ctx->buffer, data, (size_t) length);
+    }
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * SHA512Pad --
+ *
+ *	This procedure appends the padding and the message length
+ *	and processes the final blocks. The length is encoded in
+ *	128 bits of which the upper 64 bits are always zero here.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	The context is updated.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+SHA512Pad(TnmSHA512_CTX *ctx)
+{
+    unsigned char pad[TNM_SHA512_BLOCKSIZE + 16];
+    Tcl_WideUInt bits = ctx->count << 3;
+    int used = (int) (ctx->count % TNM_SHA512_BLOCKSIZE);
+    int i, n = (used < 112) ? 112 - used : 240 - used;
+
+    memset(pad, 0, sizeof(pad));
+    pad[0] = 0x80;
+    for (i = 0; i < 8; i++) {
+	pad[n + 8 + i] = (unsigned char) (bits >> (56 - 8 * i));
+    }
+    TnmSHA512Update(ctx, pad, n + 16);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * TnmSHA384Final, TnmSHA512Final --
+ *
+ *	These procedures finish a SHA-384 or SHA-512 digest.
+ *
+ * Results:
+ *	The digest is written to the digest argument.
+ *
+ * Side effects:
+ *	The context must be initialized before it is used again.
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+TnmSHA384Final(unsigned char digest[TNM_SHA384_SIZE], TnmSHA512_CTX *ctx)
+{
+    int i;
+
+    SHA512Pad(ctx);
+    for (i = 0; i < TNM_SHA384_SIZE; i++) {
+	digest[i] = (unsigned char) (ctx->state[i >> 3] >> (56 - 8 * (i & 7)));
+    }
+}
+
+void
+TnmSHA512Final(unsigned char digest[TNM_SHA512_SIZE], TnmSHA512_CTX *ctx)
+{
+    int i;
+
+    SHA512Pad(ctx);
+    for (i = 0; i < TNM_SHA512_SIZE; i++) {
+	digest[i] = (unsigned char) (ctx->state[i >> 3] >> (56 - 8 * (i & 7)));
+    }
+}
+
+/*
+ * Local Variables:
+ * compile-command: "make -k -C ../../unix"
+ * End:
+ */
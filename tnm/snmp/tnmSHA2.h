@@ -0,0 +1,47 @@
+/*
+ * tnmSHA2.h --
+ *
+ *	Definitions for the SHA-2 family of hash functions as defined
+ *	in FIPS 180-4. They are used by the HMAC-SHA-2 authentication
+ *	protocols of the user based security model (RFC 7860).
+ *
+ * See the file "license.terms" for information on usage and redistribution
+ * of this file, and for a DISCLAIMER OF ALL WARRANTIES.
+ */
+
+#ifndef _TNMSHA2
+#define _TNMSHA2
+
+#define TNM_SHA224_SIZE		28
+#define TNM_SHA256_SIZE		32
+#define TNM_SHA384_SIZE		48
+#define TNM_SHA512_SIZE		64
+
+#define TNM_SHA256_BLOCKSIZE	64
+#define TNM_SHA512_BLOCKSIZE	128
+
+typedef struct TnmSHA256_CTX {
+    unsigned int state[8];		/* The intermediate hash value. */
+    Tcl_WideUInt count;			/* The number of bytes hashed. */
+    unsigned char buffer[TNM_SHA256_BLOCKSIZE];	/* Unprocessed bytes. */
+} TnmSHA256_CTX;
+
+typedef struct TnmSHA512_CTX {
+    Tcl_WideUInt state[8];		/* The intermediate hash value. */
+    Tcl_WideUInt count;			/* The number of bytes hashed. */
+    unsigned char buffer[TNM_SHA512_BLOCKSIZE];	/* Unprocessed bytes. */
+} TnmSHA512_CTX;
+
+void TnmSHA224Init(TnmSHA256_CTX *);
+void TnmSHA256Init(TnmSHA256_CTX *);
+void TnmSHA256Update(TnmSHA256_CTX *, unsigned char *, int);
+void TnmSHA224Final(unsigned char [TNM_SHA224_SIZE], TnmSHA256_CTX *);
+void TnmSHA256Final(unsigned char [TNM_SHA256_SIZE], TnmSHA256_CTX *);
+
+void TnmSHA384Init(TnmSHA512_CTX *);
+void TnmSHA512Init(TnmSHA512_CTX *);
+void TnmSHA512Update(TnmSHA512_CTX *, unsigned char *, int);
+void TnmSHA384Final(unsigned char [TNM_SHA384_SIZE], TnmSHA512_CTX *);
+void TnmSHA512Final(unsigned char [TNM_SHA512_SIZE], TnmSHA512_CTX *);
+
+#endif /* _TNMSHA2 */
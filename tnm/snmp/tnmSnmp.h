@@ -162,11 +162,18 @@ EXTERN TnmSnmpMark tnmSnmpBenchMark;
 #define TNM_SNMP_AUTH_NONE	0x00
 #define TNM_SNMP_AUTH_MD5	0x01
 #define TNM_SNMP_AUTH_SHA	0x02
+#define TNM_SNMP_AUTH_SHA224	0x03
+#define TNM_SNMP_AUTH_SHA256	0x04
+#define TNM_SNMP_AUTH_SHA384	0x05
+#define TNM_SNMP_AUTH_SHA512	0x06
 #define TNM_SNMP_AUTH_MASK	0x0f
+#define TNM_SNMP_AUTH_MAXSIZE	48
 
 #define TNM_SNMP_PRIV_NONE	0x00
 #define TNM_SNMP_PRIV_DES	0x10
+#define TNM_SNMP_PRIV_AES	0x20
 #define TNM_SNMP_PRIV_MASK	0xf0
+#define TNM_SNMP_PRIV_SALTSIZE	8
 
 extern TnmTable tnmSnmpSecurityLevelTable[];
 #endif
@@ -176,7 +183,8 @@ extern TnmTable tnmSnmpSecurityLevelTable[];
  * SNMP sockets can be shared between multiple manager or agent
  * sessions. The TnmSnmpSocket data type adds a reference count
  * to a real system socket so that we can close the system socket
- * if it is not used anymore.
+ * if it is not used anymore. Datagrams are read in batches and
+ * the datagrams not yet processed are kept with the socket.
  *----------------------------------------------------------------
  */
 
@@ -192,6 +200,7 @@ typedef struct TnmSnmpSocket {
     struct sockaddr *peername;		/* peer name (if any) */
     int flags;				/* special flags (if any) */
     int refCount;			/* reference count */
+    struct TnmSnmpBatch *batchPtr;	/* datagrams not yet processed */
     struct TnmSnmpSocket *nextPtr;	/* pointer to next socket */
 } TnmSnmpSocket;
 
@@ -218,6 +227,28 @@ typedef enum {
 
 extern TnmTable tnmSnmpApplTable[];
 
+/*
+ *----------------------------------------------------------------
+ * The TnmSnmpBucket structure is used to pace the messages sent
+ * by a session or by all sessions. A message may be sent if the
+ * bucket holds a packet token and no byte debt. The byte tokens
+ * may become negative so that messages larger than the bucket
+ * size can be sent. A rate of 0 means that there is no limit.
+ *----------------------------------------------------------------
+ */
+
+typedef struct TnmSnmpBucket {
+    int rate;			  /* Max. number of packets per second. */
+    int byteRate;		  /* Max. number of bytes per second. */
+    int delay;			  /* Min. delay (ms) between two packets. */
+    double tokens;		  /* Packet tokens currently available. */
+    double byteTokens;		  /* Byte tokens currently available. */
+    Tcl_WideInt stamp;		  /* Time (us) of the last refill. */
+    Tcl_WideInt last;		  /* Time (us) of the last packet. */
+} TnmSnmpBucket;
+
+EXTERN TnmSnmpBucket tnmSnmpBucket;
+
 /*
  *----------------------------------------------------------------
  * The TnmSnmp structure contains all infomation needed to handle
@@ -242,6 +273,8 @@ typedef struct TnmSnmp {
     Tcl_Obj *privPassWord;	  /* The password to compute the privKey. */
     Tcl_Obj *usmAuthKey;	  /* The USM authentication key. */
     Tcl_Obj *usmPrivKey;	  /* The USM privacy key. */
+    struct TnmSnmpHmac *usmHmac;  /* The HMAC state of the usmAuthKey. */
+    struct TnmSnmpCipher *usmCipher; /* The cipher state of the usmPrivKey. */
     char securityLevel;		  /* The security level. */
 #ifdef TNM_SNMPv2U
     u_char qos;
@@ -256,10 +289,18 @@ typedef struct TnmSnmp {
     int retries;                  /* Number of retries until we give up. */
     int timeout;                  /* Milliseconds before we timeout. */
     int window;                   /* Max. number of active async. requests. */
-    int delay;                    /* Minimum delay between requests. */
+    TnmSnmpBucket bucket;         /* Pacing of messages sent. */
     int active;                   /* Number of active async. requests. */
     int waiting;                  /* Number of waiting async. requests. */
+    struct TnmSnmpRequest *activeHead; /* FIFO of active async. requests. */
+    struct TnmSnmpRequest *activeTail;
+    struct TnmSnmpRequest *waitHead;   /* FIFO of waiting async. requests. */
+    struct TnmSnmpRequest *waitTail;
+    struct TnmSnmp *nextReadyPtr; /* Ring of sessions with waiting requests. */
+    struct TnmSnmp *prevReadyPtr;
     Tcl_Obj *tagList;		  /* The tags associated with this session. */
+    Tcl_Obj *targets;		  /* The targets of a poll group. */
+    struct TnmSnmpRates *rates;	  /* The last samples of polled counters. */
     struct TnmSnmpBinding *bindPtr; /* Commands bound to this session. */
     Tcl_Interp *interp;		  /* Tcl interpreter owning this session. */
     Tcl_Command token;		  /* The command token used by Tcl. */
@@ -321,6 +362,109 @@ EXTERN char*
 Tnm_SnmpMergeVBList	(int varBindSize, 
 				     SNMP_VarBind *varBindPtr);
 
+/*
+ *----------------------------------------------------------------
+ * Binary representation of varbind lists. Object identifiers,
+ * octet strings and other variable length values are kept in a
+ * single buffer owned by the list and referenced by offsets, so
+ * that a decoded PDU requires only a few allocations. Lists are
+ * reference counted and shared by the Tcl_Obj type below, which
+ * creates the Tcl string representation only when it is needed.
+ *----------------------------------------------------------------
+ */
+
+typedef struct TnmSnmpVarBind {
+    int oidOffset;		/* Offset of the name sub-identifiers. */
+    short oidLength;		/* Number of name sub-identifiers.     */
+    u_char syntax;		/* ASN.1 tag of the value or exception.*/
+    union {
+	int intValue;		/* INTEGER, Counter32, Gauge32 and     */
+				/* TimeTicks values.                   */
+	TnmUnsigned64 u64Value;	/* Counter64 values.                   */
+	struct {
+	    int offset;		/* Offset of the value in the buffer.  */
+	    int length;		/* Number of octets or sub-identifiers.*/
+	} data;			/* OCTET STRING, IpAddress, Opaque and */
+				/* OBJECT IDENTIFIER values.           */
+    } value;
+} TnmSnmpVarBind;
+
+#define TNM_SNMP_STATIC_VARBINDS 8
+#define TNM_SNMP_STATIC_BUFFER	 512
+
+typedef struct TnmSnmpVarBindList {
+    int refCount;		/* Number of references to this list.  */
+    int numVarBinds;		/* Number of varbinds in the list.     */
+    int maxVarBinds;		/* Number of varbinds allocated.       */
+    TnmSnmpVarBind *varBinds;	/* The vector of varbinds.             */
+    int bufferLength;		/* Number of buffer bytes used.        */
+    int bufferSize;		/* Number of buffer bytes allocated.   */
+    char *buffer;		/* Storage for variable length data.   */
+    TnmSnmpVarBind staticVarBinds[TNM_SNMP_STATIC_VARBINDS];
+    char staticBuffer[TNM_SNMP_STATIC_BUFFER];
+} TnmSnmpVarBindList;
+
+#define TnmSnmpVarBindOid(vblPtr,vbPtr) \
+	((Tnm_Oid *) ((vblPtr)->buffer + (vbPtr)->oidOffset))
+#define TnmSnmpVarBindData(vblPtr,vbPtr) \
+	((vblPtr)->buffer + (vbPtr)->value.data.offset)
+#define TnmSnmpVarBindOidValue(vblPtr,vbPtr) \
+	((Tnm_Oid *) TnmSnmpVarBindData(vblPtr,vbPtr))
+#define TnmSnmpPreserveVarBindList(vblPtr) \
+	((vblPtr)->refCount++)
+
+EXTERN Tcl_ObjType tnmVarBindListType;
+
+EXTERN TnmSnmpVarBindList*
+TnmSnmpNewVarBindList	(void);
+
+EXTERN void
+TnmSnmpReleaseVarBindList (TnmSnmpVarBindList *vblPtr);
+
+EXTERN TnmSnmpVarBind*
+TnmSnmpAddVarBind	(TnmSnmpVarBindList *vblPtr,
+			     Tnm_Oid *oid, int oidLength, int syntax);
+EXTERN void
+TnmSnmpSetVarBindData	(TnmSnmpVarBindList *vblPtr,
+			     TnmSnmpVarBind *vbPtr, 
+			     const char *bytes, int length);
+EXTERN void
+TnmSnmpSetVarBindOid	(TnmSnmpVarBindList *vblPtr,
+			     TnmSnmpVarBind *vbPtr,
+			     Tnm_Oid *oid, int oidLength);
+EXTERN int
+TnmSnmpScanVarBindValue	(Tcl_Interp *interp,
+			     TnmSnmpVarBindList *vblPtr,
+			     TnmSnmpVarBind *vbPtr,
+			     const char *name, const char *value);
+EXTERN void
+TnmSnmpGetVarBindName	(TnmSnmpVarBindList *vblPtr,
+			     TnmSnmpVarBind *vbPtr, TnmOid *oidPtr);
+EXTERN Tcl_Obj*
+TnmSnmpGetVarBindValue	(TnmSnmpVarBindList *vblPtr,
+			     TnmSnmpVarBind *vbPtr);
+EXTERN Tcl_Obj*
+TnmSnmpGetVarBindTypedValue (TnmSnmpVarBindList *vblPtr,
+			     TnmSnmpVarBind *vbPtr, TnmMibNode *nodePtr);
+EXTERN TnmSnmpVarBindList*
+TnmSnmpCopyVarBindList	(TnmSnmpVarBindList *vblPtr,
+			     int first, int count);
+EXTERN void
+TnmSnmpAppendVarBinds	(TnmSnmpVarBindList *dstPtr,
+			     TnmSnmpVarBindList *srcPtr,
+			     int first, int count);
+EXTERN unsigned int
+TnmSnmpHashVarBindList	(TnmSnmpVarBindList *vblPtr);
+EXTERN int
+TnmSnmpEqualVarBindList	(TnmSnmpVarBindList *vblPtr1,
+			     TnmSnmpVarBindList *vblPtr2);
+EXTERN Tcl_Obj*
+TnmSnmpNewVarBindListObj (TnmSnmpVarBindList *vblPtr);
+
+EXTERN TnmSnmpVarBindList*
+TnmSnmpGetVarBindListFromObj (Tcl_Interp *interp, 
+			     Tcl_Obj *objPtr, int pduType);
+
 /*
  *----------------------------------------------------------------
  * Structure to describe a SNMP PDU.
@@ -340,12 +484,12 @@ typedef struct TnmSnmpPdu {
     int engineIDLength;
     char *engineID;
 #endif
-#if 1
     Tcl_Obj *vbList;		/* The list of varbinds as a Tcl_Obj.  */
-#endif
-    Tcl_DString varbind;	/* The list of varbinds as Tcl string. */
 } TnmSnmpPdu;
 
+EXTERN void
+TnmSnmpPduSetVarBinds	(TnmSnmpPdu *pdu, Tcl_Obj *vbList);
+
 /*
  *----------------------------------------------------------------
  * Structure to describe an asynchronous request.
@@ -358,13 +502,27 @@ typedef void (TnmSnmpRequestProc)	(TnmSnmp *session,
 typedef struct TnmSnmpRequest {
     int id;                          /* The unique request identifier. */
     int sends;                       /* Number of send operations. */
+    int queued;			     /* Set while linked into a FIFO. */
     u_char *packet;                  /* The encoded SNMP message. */
     int packetlen;		     /* The length of the encoded message. */
-    Tcl_TimerToken timer;	     /* Token used by Tcl Timer Handler. */
+    Tcl_WideInt expire;		     /* Retransmission time in ms. */
+    struct TnmSnmpRequest **timerSlot; /* Timer wheel slot or NULL. */
+    struct TnmSnmpRequest *timerNextPtr; /* Next request in the slot. */
+    struct TnmSnmpRequest *timerPrevPtr; /* Previous request in the slot. */
     TnmSnmp *session;		     /* The SNMP session for this request. */
     TnmSnmpRequestProc *proc;        /* The callback functions. */
     ClientData clientData;           /* The argument of the callback. */
-    struct TnmSnmpRequest *nextPtr;  /* Pointer to next pending request. */
+    struct sockaddr_in *to;	     /* Destination or NULL for the session
+				      * address (not owned). */
+    Tcl_Obj *community;		     /* Community or NULL for the session
+				      * community (not owned). */
+#ifdef TNM_SNMPv3
+    TnmSnmpPdu *pdu;		     /* Copy of the PDU to encode the request
+				      * again after engine discovery or NULL. */
+    u_char *buffer;		     /* The re-encoded message or NULL. */
+#endif
+    struct TnmSnmpRequest *nextPtr;  /* Next request in the session FIFO. */
+    struct TnmSnmpRequest *prevPtr;  /* Previous request in the session FIFO. */
 #ifdef TNM_SNMP_BENCH
     TnmSnmpMark stats;              /* Statistics for this SNMP operation. */
 #endif
@@ -438,6 +596,33 @@ EXTERN int
 TnmSnmpEvalBinding	(Tcl_Interp *interp, TnmSnmp *session,
                                      TnmSnmpPdu *pdu, int event);
 
+/*
+ *----------------------------------------------------------------
+ * Structure to describe an instance provider. A provider owns a
+ * subtree of the instance tree and answers requests for all
+ * instances in this subtree without the need to create instance
+ * nodes and Tcl variables. The provider procedure is called with
+ * the type ASN1_SNMP_GET to append the varbind for the instance
+ * oidPtr (if it exists) to the varbind list. It is called with the
+ * type ASN1_SNMP_GETNEXT to append up to count varbinds of the
+ * instances that follow oidPtr in lexicographic order. Errors are
+ * reported by returning TCL_ERROR with the SNMP error status in
+ * the interpreter result.
+ *----------------------------------------------------------------
+ */
+
+typedef int (TnmSnmpProviderProc)	(Tcl_Interp *interp,
+		TnmSnmp *session, int type, TnmOid *oidPtr, int count,
+		TnmSnmpVarBindList *vblPtr, ClientData clientData);
+
+typedef void (TnmSnmpProviderDeleteProc) (ClientData clientData);
+
+typedef struct TnmSnmpProvider {
+    TnmSnmpProviderProc *proc;		/* The provider procedure.  */
+    TnmSnmpProviderDeleteProc *deleteProc; /* Called when removed.  */
+    ClientData clientData;		/* Passed to the procedures.*/
+} TnmSnmpProvider;
+
 /*
  *----------------------------------------------------------------
  * Structure to describe a MIB node known by a session handle.
@@ -455,8 +640,12 @@ typedef struct TnmSnmpNode {
     char *tclVarName;			/* Tcl variable name.	    */
     TnmSnmpBinding *bindings;		/* List of bindings.        */ 
     u_int subid;			/* Sub identifier in Tree.  */
-    struct TnmSnmpNode *childPtr;       /* List of child nodes.	    */
-    struct TnmSnmpNode *nextPtr;	/* List of peer node.	    */
+    struct TnmSnmpNode *parentPtr;	/* The parent node.	    */
+    struct TnmSnmpNode **children;	/* Child nodes by subid.    */
+    int numChildren;			/* Number of child nodes.   */
+    int maxChildren;			/* Size of children vector. */
+    struct TnmSnmpNode *varNextPtr;	/* Next node of Tcl var.    */
+    TnmSnmpProvider *provider;		/* Provider of the subtree. */
 } TnmSnmpNode;
 
 EXTERN int
@@ -468,6 +657,28 @@ TnmSnmpFindNode		(TnmSnmp *session, TnmOid *oidPtr);
 EXTERN TnmSnmpNode*
 TnmSnmpFindNextNode	(TnmSnmp *session, TnmOid *oidPtr);
 
+EXTERN TnmSnmpNode*
+TnmSnmpNextNode		(TnmSnmp *session, TnmSnmpNode *inst);
+
+EXTERN unsigned int
+TnmSnmpNodeEpoch	(void);
+
+EXTERN TnmSnmpNode*
+TnmSnmpFindProvider	(TnmSnmp *session, TnmOid *oidPtr);
+
+EXTERN int
+TnmSnmpCreateProvider	(TnmOid *oidPtr, TnmSnmpProviderProc *proc,
+				     TnmSnmpProviderDeleteProc *deleteProc,
+				     ClientData clientData);
+EXTERN void
+TnmSnmpDeleteProvider	(TnmOid *oidPtr);
+
+EXTERN int
+TnmSnmpSetTclProvider	(Tcl_Interp *interp, TnmOid *oidPtr,
+				     Tcl_Obj *cmdPrefix);
+EXTERN Tcl_Obj*
+TnmSnmpGetTclProvider	(TnmOid *oidPtr);
+
 EXTERN int
 TnmSnmpSetNodeBinding	(TnmSnmp *session, TnmOid *oidPtr,
 				     int event, char *command);
@@ -542,6 +753,9 @@ typedef struct TnmSnmpStats {
     u_int usecStatsBadParameters;
     u_int usecStatsUnauthorizedOperations;
 #endif
+#ifdef TNM_SNMPv3
+    u_int usmStatsUnknownEngineIDs;
+#endif
 } TnmSnmpStats;
 
 /*
@@ -569,20 +783,80 @@ TnmSnmpEncode		(Tcl_Interp *interp, TnmSnmp *session,
 				     TnmSnmpPdu *pdu, TnmSnmpRequestProc *proc,
 				     ClientData clientData);
 EXTERN int
+TnmSnmpEncodeRequest	(Tcl_Interp *interp, TnmSnmp *session,
+				     TnmSnmpPdu *pdu, u_char *packet,
+				     int *packetlenPtr);
+EXTERN int
+TnmSnmpEncodeResponse	(Tcl_Interp *interp, TnmSnmp *session,
+				     TnmSnmpPdu *pdu, u_char *packet,
+				     int *packetlenPtr);
+EXTERN int
+TnmSnmpEncodePDU	(Tcl_Interp *interp, TnmSnmp *session,
+				     TnmSnmpPdu *pdu, u_char *packet,
+				     int *packetlenPtr);
+EXTERN int
+TnmSnmpEncodeOverhead	(Tcl_Interp *interp, TnmSnmp *session,
+				     TnmSnmpPdu *pdu);
+EXTERN int
+TnmSnmpVarBindSize	(Tcl_Interp *interp, TnmSnmp *session,
+				     TnmSnmpVarBindList *vblPtr,
+				     TnmSnmpVarBind *vbPtr);
+EXTERN int
 TnmSnmpDecode		(Tcl_Interp *interp, 
 				     u_char *packet, int packetlen,
 				     struct sockaddr_in *from,
 				     TnmSnmp *session, int *reqid,
 				     int *status, int *index);
+EXTERN int
+TnmSnmpPoll		(Tcl_Interp *interp, TnmSnmp *session,
+				     int type, int non, int max, int rates,
+				     Tcl_Obj *vbList, Tcl_Obj *cmdObj);
+EXTERN void
+TnmSnmpPollCancel	(TnmSnmp *session);
+EXTERN Tcl_Obj*
+TnmSnmpRateVarBinds	(TnmSnmp *session, struct sockaddr_in *addr,
+				     TnmSnmpVarBindList *vblPtr);
+EXTERN void
+TnmSnmpRateFree		(TnmSnmp *session);
+EXTERN int
+TnmSnmpWalk		(Tcl_Interp *interp, TnmSnmp *session,
+				     Tcl_Obj *oidList, int flags,
+				     TnmSnmpRequestProc *proc,
+				     ClientData clientData);
+EXTERN int
+TnmSnmpWalkTable	(Tcl_Interp *interp, TnmSnmp *session,
+				     Tcl_Obj *oidList, int flags,
+				     TnmSnmpRequestProc *proc,
+				     ClientData clientData);
+EXTERN int
+TnmSnmpWalkWait		(TnmSnmp *session, ClientData clientData);
+EXTERN void
+TnmSnmpWalkAbort	(TnmSnmp *session, ClientData clientData);
+EXTERN void
+TnmSnmpWalkCancel	(TnmSnmp *session);
+
 EXTERN void
 TnmSnmpTimeoutProc	(ClientData clientData);
 
+EXTERN void
+TnmSnmpStartTimer	(TnmSnmpRequest *request, int ms);
+
+EXTERN void
+TnmSnmpStopTimer	(TnmSnmpRequest *request);
+
 EXTERN int
 TnmSnmpAgentInit	(Tcl_Interp *interp, 
 				     TnmSnmp *session);
 EXTERN int
 TnmSnmpAgentRequest	(Tcl_Interp *interp, TnmSnmp *session,
 				     TnmSnmpPdu *pdu);
+EXTERN void
+TnmSnmpAgentCacheClear	(TnmSnmp *session);
+EXTERN void
+TnmSnmpAgentCacheConfig	(int size, int lifetime);
+EXTERN void
+TnmSnmpAgentCacheInfo	(int *sizePtr, int *lifetimePtr,
+				     int *entriesPtr);
 EXTERN int
 TnmSnmpEvalCallback	(Tcl_Interp *interp, TnmSnmp *session,
 				     TnmSnmpPdu *pdu,
@@ -591,19 +865,80 @@ TnmSnmpEvalCallback	(Tcl_Interp *interp, TnmSnmp *session,
 
 /*
  *----------------------------------------------------------------
- * The following function is used to create a socket used for
+ * The following function is used to create the sockets used for
  * all manager initiated communication. The Close function
- * is used to close this socket if all SNMP sessions have been
- * destroyed.
+ * is used to close these sockets if all SNMP sessions have been
+ * destroyed. Asynchronous messages are distributed over a number
+ * of sockets, which may share a local port, as configured in the
+ * TnmSnmpManager structure.
  *----------------------------------------------------------------
  */
 
+#define TNM_SNMP_SOCKETS_MAX	64
+
+typedef struct TnmSnmpManager {
+    int sockets;		/* Number of asynchronous sockets. */
+    int port;			/* Local port or 0 for any port. */
+    int rcvbuf;			/* Receive buffer size or 0. */
+} TnmSnmpManager;
+
+EXTERN TnmSnmpManager tnmSnmpManager;
+
 EXTERN int
 TnmSnmpManagerOpen	(Tcl_Interp	*interp);
 
 EXTERN void
 TnmSnmpManagerClose	(void);
 
+EXTERN int
+TnmSnmpManagerReopen	(Tcl_Interp *interp);
+
+/*
+ *----------------------------------------------------------------
+ * Responses to manager initiated requests may be received and
+ * decoded by engine threads. A decoded message is queued for
+ * the thread which opened the manager socket, which dispatches
+ * it to the sessions. The packet is part of the message so that
+ * decoded values may point into it.
+ *----------------------------------------------------------------
+ */
+
+#if defined(TCL_THREADS) && !(defined(__WIN32__) || defined(_WIN32))
+#define TNM_SNMP_ENGINE
+#endif
+
+#define TNM_SNMP_ENGINE_MAX	64
+
+typedef struct TnmSnmpMessage {
+    struct TnmSnmpMessage *nextPtr;	/* Next message in the queue. */
+    struct sockaddr_in from;		/* The address of the sender. */
+    int sock;				/* The socket it was received on. */
+    int packetlen;			/* The length of the packet. */
+    u_char *packet;			/* The packet as received. */
+} TnmSnmpMessage;
+
+EXTERN int
+TnmSnmpManagerThreads	(Tcl_Interp *interp, int count);
+
+EXTERN TnmSnmpMessage*
+TnmSnmpDecodeMessage	(u_char *packet, int packetlen,
+				     struct sockaddr_in *from);
+EXTERN int
+TnmSnmpDispatchMessage	(Tcl_Interp *interp, TnmSnmpMessage *msgPtr);
+
+EXTERN void
+TnmSnmpFreeMessage	(TnmSnmpMessage *msgPtr);
+
+EXTERN int
+TnmSnmpEngineStart	(Tcl_Interp *interp, int *socks, int numSocks,
+				     int count);
+
+EXTERN void
+TnmSnmpEngineStop	(void);
+
+EXTERN void
+TnmSnmpEngineDiscard	(void);
+
 /*
  *----------------------------------------------------------------
  * Create and close a socket used for notification listener
@@ -654,7 +989,9 @@ TnmSnmpNmtrapdClose	(void);
 /*
  *----------------------------------------------------------------
  * Functions used to send and receive SNMP messages. The 
- * TnmSnmpWait function is used to wait for an answer.
+ * TnmSnmpWait function is used to wait for an answer. Messages
+ * sent asynchronously may be queued and sent in batches. The
+ * TnmSnmpFlush function sends all queued messages.
  *----------------------------------------------------------------
  */
 
@@ -674,7 +1011,19 @@ EXTERN int
 TnmSnmpWait		(int ms, int flags);
 
 EXTERN void
-TnmSnmpDelay		(TnmSnmp *session);
+TnmSnmpFlush		(void);
+
+EXTERN int
+TnmSnmpBucketWait	(TnmSnmpBucket *bucketPtr, int length);
+
+EXTERN void
+TnmSnmpBucketTake	(TnmSnmpBucket *bucketPtr, int length);
+
+EXTERN int
+TnmSnmpPace		(TnmSnmp *session, int length);
+
+EXTERN void
+TnmSnmpDelay		(TnmSnmp *session, int length);
 
 /*
  *----------------------------------------------------------------
@@ -693,13 +1042,63 @@ TnmSnmpMD5Digest	(u_char *packet, int packetlen,
 EXTERN void
 TnmSnmpComputeKeys	(TnmSnmp *session);
 
+EXTERN int
+TnmSnmpPrecomputeKeys	(Tcl_Interp *interp, Tcl_Obj *listObj);
+
+EXTERN int
+TnmSnmpKeyFile		(Tcl_Interp *interp, Tcl_Obj *fileName);
+
+EXTERN int
+TnmSnmpKeyCacheSize	(void);
+
+EXTERN void
+TnmSnmpKeyCacheClear	(void);
+
 EXTERN void
 TnmSnmpComputeDigest	();
 
+EXTERN int
+TnmSnmpAuthLength	(int algorithm);
+
+EXTERN int
+TnmSnmpAuthOutMsg	(Tcl_Interp *interp, TnmSnmp *session,
+				     u_char *packet, int packetlen);
+EXTERN int
+TnmSnmpAuthInMsg	(TnmSnmp *session, u_char *packet,
+				     int packetlen, u_char *authParam,
+				     int authLength);
+EXTERN void
+TnmSnmpHmacFree		(TnmSnmp *session);
+
 EXTERN void
-TnmSnmpAuthOutMsg	(int algorithm, Tcl_Obj *authKey,
-				     u_char *msg, int msgLen,
-				     u_char *msgAuthenticationParameters);
+TnmSnmpPrivSalt		(TnmSnmp *session, u_char *salt);
+
+EXTERN TnmBer*
+TnmSnmpEncryptPdu	(TnmSnmp *session, TnmBer *ber,
+				     u_char *data, u_char *salt);
+EXTERN int
+TnmSnmpDecryptPdu	(TnmSnmp *session, u_char *salt,
+				     int saltLength, int engineBoots,
+				     int engineTime, u_char *data,
+				     int length);
+EXTERN void
+TnmSnmpCipherFree	(TnmSnmp *session);
+EXTERN void
+TnmSnmpEngineUpdate	(struct sockaddr_in *addr, char *engineID,
+				     int engineIDLength, int engineBoots,
+				     int engineTime);
+EXTERN int
+TnmSnmpEngineLookup	(TnmSnmp *session, struct sockaddr_in *addr);
+EXTERN int
+TnmSnmpSetEngine	(TnmSnmp *session, char *engineID,
+				     int engineIDLength, int engineBoots,
+				     int engineTime);
+EXTERN Tcl_Obj*
+TnmSnmpEngineList	(void);
+EXTERN void
+TnmSnmpEngineClear	(void);
+EXTERN int
+TnmSnmpReencodeRequest	(TnmSnmpRequest *request);
 #endif
 
 #ifdef TNM_SNMPv2U
@@ -21,21 +21,63 @@
 #include "tnmMib.h"
 
 /*
- * The following structure is used to implement a cache that
+ * The following structures are used to implement a cache that
  * is used to remember queries so that we can respond to
  * retries quickly. This is needed because side effects can
- * break the agent down if we do them for each retry.
+ * break the agent down if we do them for each retry. The cache
+ * is a hash table indexed by the session, the source address,
+ * the request id and a digest of the request. It keeps the
+ * encoded response, so a retry is answered with a single send.
+ * The entries are also linked in a FIFO list in the order in
+ * which they were created, which is used to expire entries and
+ * to remove the oldest entries if the cache is full.
  */
 
-typedef struct CacheElement {
-    TnmSnmp *session;
-    TnmSnmpPdu request;
-    TnmSnmpPdu response;
-    time_t timestamp;
-} CacheElement;
+typedef struct CacheKey {
+    TnmSnmp *session;		/* The session which answered. */
+    unsigned int addr;		/* The source address of the request. */
+    unsigned int port;		/* The source port of the request. */
+    int requestId;		/* The request id of the request. */
+    unsigned int digest;	/* The digest of the request pdu. */
+} CacheKey;
+
+typedef struct CacheEntry {
+    Tcl_HashEntry *entryPtr;	/* The entry in the hash table. */
+    int type;			/* The type of the request pdu. */
+    int errorStatus;		/* The error status of the request pdu. */
+    int errorIndex;		/* The error index of the request pdu. */
+    Tcl_Obj *vbList;		/* The varbind list of the request pdu. */
+    Tcl_WideInt expire;		/* Expiration time in ms. */
+    u_char *packet;		/* The encoded response message. */
+    int packetlen;		/* The length of the response message. */
+    struct CacheEntry *nextPtr;	/* Next (younger) entry in the FIFO. */
+    struct CacheEntry *prevPtr;	/* Previous (older) entry in the FIFO. */
+} CacheEntry;
+
+static Tcl_HashTable cacheTable;
+static int cacheInitialized = 0;
+static CacheEntry *cacheHead = NULL;
+static CacheEntry *cacheTail = NULL;
+static int cacheSize = 1024;		/* Max. number of cache entries. */
+static int cacheLifetime = 5000;	/* Lifetime of cache entries in ms. */
 
-#define CACHE_SIZE 64
-static CacheElement cache[CACHE_SIZE];
+/*
+ * The following structure is used by the getbulk processing code
+ * to keep a cursor in the instance tree for every varbind of the
+ * request. The node pointer is only valid as long as the epoch
+ * of the instance tree does not change. Otherwise, we search the
+ * tree again starting at the name of the last instance returned.
+ */
+
+typedef struct BulkCursor {
+    TnmSnmpNode *inst;		/* The next instance or provider node. */
+    TnmOid oid;			/* The name of the last instance. */
+    Tcl_Obj *value;		/* The value of the request varbind. */
+    unsigned int epoch;		/* The epoch in which inst was found. */
+    TnmSnmpVarBindList *fetchPtr;	/* Instances fetched from a provider. */
+    int fetched;		/* The number of instances consumed. */
+    int done;			/* Set if the end of the view is reached. */
+} BulkCursor;
 
 /*
  * Flags used by the SNMP set processing code to keep state information
@@ -48,14 +90,26 @@ static CacheElement cache[CACHE_SIZE];
  * Forward declarations for procedures defined later in this file:
  */
 
+static Tcl_WideInt
+CacheNow		(void);
+
+static void
+CacheMakeKey		(CacheKey *keyPtr, TnmSnmp *session,
+				     TnmSnmpPdu *pdu);
+static CacheEntry*
+CacheHit		(TnmSnmp *session, TnmSnmpPdu *pdu);
+
 static void
-CacheInit		(void);
+CachePut		(TnmSnmp *session, TnmSnmpPdu *pdu,
+				     u_char *packet, int packetlen);
+static void
+CacheRemove		(CacheEntry *cachePtr);
 
-static TnmSnmpPdu*
-CacheGet		(TnmSnmp *session, TnmSnmpPdu *pdu);
+static void
+CacheExpire		(Tcl_WideInt now);
 
-static TnmSnmpPdu*
-CacheHit		(TnmSnmp *session, TnmSnmpPdu *pdu);
+static int
+CacheMatch		(Tcl_Obj *objPtr1, Tcl_Obj *objPtr2);
 
 static char*
 TraceSysUpTime		(ClientData clientData,
@@ -78,10 +132,33 @@ FindInstance		(TnmSnmp *session, TnmOid *oidPtr);
 static TnmSnmpNode*
 FindNextInstance	(TnmSnmp *session, TnmOid *oidPtr);
 
+static int
+CallProvider		(Tcl_Interp *interp, TnmSnmp *session,
+				     TnmSnmpNode *inst, int type,
+				     TnmOid *oidPtr, int count,
+				     TnmSnmpVarBindList *vblPtr);
+
+static int
+AppendResponse		(Tcl_Interp *interp,
+				     TnmSnmpVarBindList *vblPtr,
+				     TnmSnmpNode *inst, const char *value);
+static int
+TooBig			(TnmSnmpVarBindList *vblPtr);
+
+static SNMP_VarBind*
+SplitVarBinds		(TnmSnmpVarBindList *vblPtr);
+
 static int
 GetRequest		(Tcl_Interp *interp, TnmSnmp *session,
 				     TnmSnmpPdu *request, TnmSnmpPdu *response);
 static int
+BulkStep		(Tcl_Interp *interp, TnmSnmp *session,
+				     TnmSnmpPdu *request, BulkCursor *cursor,
+				     int count, TnmSnmpVarBindList *rspPtr);
+static int
+GetBulkRequest		(Tcl_Interp *interp, TnmSnmp *session,
+				     TnmSnmpPdu *request, TnmSnmpPdu *response);
+static int
 SetRequest		(Tcl_Interp *interp, TnmSnmp *session,
 				     TnmSnmpPdu *request, TnmSnmpPdu *response);
 
@@ -166,13 +243,12 @@ static struct StatReg statTable[] = {
 /*
  *----------------------------------------------------------------------
  *
- * CacheInit --
+ * CacheNow --
  *
- *	This procedure initializes the cache of answered requests.
- *	This procedure is only called once when we become an agent.
+ *	This procedure returns the current time in milliseconds.
  *
  * Results:
- *	None.
+ *	The current time in milliseconds.
  *
  * Side effects:
  *	None.
@@ -180,27 +256,26 @@ static struct StatReg statTable[] = {
  *----------------------------------------------------------------------
  */
 
-static void
-CacheInit()
+static Tcl_WideInt
+CacheNow(void)
 {
-    int i;
-    memset((char *) cache, 0, sizeof(cache));
-    for (i = 0; i < CACHE_SIZE; i++) {
-	Tcl_DStringInit(&cache[i].request.varbind);
-	Tcl_DStringInit(&cache[i].response.varbind);
-    }
+    Tcl_Time now;
+
+    Tcl_GetTime(&now);
+    return (Tcl_WideInt) now.sec * 1000 + now.usec / 1000;
 }
 
 /*
  *----------------------------------------------------------------------
  *
- * CacheGet --
+ * CacheMakeKey --
  *
- *	This procedure gets a free cache element. The cache is a
- *	simple FIFO ring buffer, so we just return the next element.
+ *	This procedure initializes the cache key for a request. The
+ *	digest covers the pdu type, the error status and index fields
+ *	(which carry the getbulk parameters) and the varbind list.
  *
  * Results:
- *	A pointer to a free cache element.
+ *	None.
  *
  * Side effects:
  *	None.
@@ -208,23 +283,31 @@ CacheInit()
  *----------------------------------------------------------------------
  */
 
-static TnmSnmpPdu*
-CacheGet(TnmSnmp *session, TnmSnmpPdu *pdu)
+static void
+CacheMakeKey(CacheKey *keyPtr, TnmSnmp *session, TnmSnmpPdu *pdu)
 {
-    static int last = 0;
-    last = (last + 1 ) % CACHE_SIZE;
-    Tcl_DStringFree(&cache[last].request.varbind);
-    Tcl_DStringFree(&cache[last].response.varbind);
-    cache[last].session = session;
-    cache[last].response.requestId = 0;
-    cache[last].response.errorStatus = TNM_SNMP_NOERROR;
-    cache[last].response.errorIndex = 0;
-    cache[last].response.addr = pdu->addr;
-    Tcl_DStringAppend(&cache[last].request.varbind, 
-		      Tcl_DStringValue(&pdu->varbind), 
-		      Tcl_DStringLength(&pdu->varbind));
-    cache[last].timestamp = time((time_t *) NULL);
-    return &(cache[last].response);
+    unsigned int digest = 0;
+
+    if (pdu->vbList) {
+	if (pdu->vbList->typePtr == &tnmVarBindListType) {
+	    digest = TnmSnmpHashVarBindList((TnmSnmpVarBindList *)
+				    pdu->vbList->internalRep.otherValuePtr);
+	} else {
+	    char *p = Tcl_GetString(pdu->vbList);
+	    while (*p) {
+		digest = digest * 31 + (unsigned char) *p++;
+	    }
+	}
+    }
+    digest = ((digest * 31 + pdu->type) * 31 + pdu->errorStatus) * 31
+	+ pdu->errorIndex;
+
+    memset((char *) keyPtr, 0, sizeof(CacheKey));
+    keyPtr->session = session;
+    keyPtr->addr = pdu->addr.sin_addr.s_addr;
+    keyPtr->port = pdu->addr.sin_port;
+    keyPtr->requestId = pdu->requestId;
+    keyPtr->digest = digest;
 }
 
 /*
@@ -232,84 +315,307 @@ CacheGet(TnmSnmp *session, TnmSnmpPdu *pdu)
  *
  * CacheHit --
  *
- *	This procedure checks if the request identified by session and
- *	request id is in the cache so we can send the answer without
- *	further processing.
+ *	This procedure checks if the request identified by session,
+ *	source address, request id and pdu is in the cache so we can
+ *	send the answer without further processing.
  *
  * Results:
- *      A pointer to the PDU or NULL if the lookup failed.
+ *      A pointer to the cache entry or NULL if the lookup failed.
  *
  * Side effects:
- *	None.
+ *	Expired cache entries are removed.
  *
  *----------------------------------------------------------------------
  */
 
-static TnmSnmpPdu*
+static CacheEntry*
 CacheHit(TnmSnmp *session, TnmSnmpPdu *pdu)
 {
-    int i;
-    time_t now = time((time_t *) NULL);
+    CacheKey key;
+    Tcl_HashEntry *entryPtr;
+    CacheEntry *cachePtr;
 
     /*
      * Never try to lookup request id 0 because there are some
      * management applications that always use the request id 0.
      */
 
-    if (pdu->requestId == 0) {
+    if (pdu->requestId == 0 || ! cacheInitialized) {
 	return NULL;
     }
 
-    for (i = 0; i < CACHE_SIZE; i++) {
-	if (cache[i].response.requestId != pdu->requestId
-            || cache[i].session != session) {
-	    continue;
-	}
-	if (!cache[i].timestamp || now - cache[i].timestamp > 5) {
-	    continue;
-	}
-	if (cache[i].response.requestId == pdu->requestId
-	    && cache[i].session == session
-	    && Tcl_DStringLength(&pdu->varbind) 
-	       == Tcl_DStringLength(&cache[i].request.varbind)
-	    && strcmp(Tcl_DStringValue(&pdu->varbind), 
-		      Tcl_DStringValue(&cache[i].request.varbind)) == 0
-	    ) {
-	    cache[i].response.addr = pdu->addr;
-	    return &cache[i].response;
-	}
+    CacheExpire(CacheNow());
+
+    CacheMakeKey(&key, session, pdu);
+    entryPtr = Tcl_FindHashEntry(&cacheTable, (char *) &key);
+    if (! entryPtr) {
+	return NULL;
     }
-    return NULL;
+    cachePtr = (CacheEntry *) Tcl_GetHashValue(entryPtr);
+    if (cachePtr->type != pdu->type
+	|| cachePtr->errorStatus != pdu->errorStatus
+	|| cachePtr->errorIndex != pdu->errorIndex
+	|| ! CacheMatch(pdu->vbList, cachePtr->vbList)) {
+	return NULL;
+    }
+    return cachePtr;
 }
 
 /*
  *----------------------------------------------------------------------
  *
- * CacheClear --
+ * CachePut --
  *
- *	This procedure clears the cache for a given session.
+ *	This procedure saves the encoded response to a request in the
+ *	cache. The oldest entry is removed if the cache is full.
  *
  * Results:
- *      None.
+ *	None.
+ *
+ * Side effects:
+ *	Memory is allocated.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+CachePut(TnmSnmp *session, TnmSnmpPdu *pdu, u_char *packet, int packetlen)
+{
+    CacheKey key;
+    Tcl_HashEntry *entryPtr;
+    CacheEntry *cachePtr;
+    int isNew;
+
+    if (pdu->requestId == 0 || cacheSize <= 0 || cacheLifetime <= 0) {
+	return;
+    }
+
+    if (! cacheInitialized) {
+	Tcl_InitHashTable(&cacheTable, sizeof(CacheKey) / sizeof(int));
+	cacheInitialized = 1;
+    }
+
+    CacheMakeKey(&key, session, pdu);
+    entryPtr = Tcl_CreateHashEntry(&cacheTable, (char *) &key, &isNew);
+    if (! isNew) {
+	CacheRemove((CacheEntry *) Tcl_GetHashValue(entryPtr));
+	entryPtr = Tcl_CreateHashEntry(&cacheTable, (char *) &key, &isNew);
+    }
+    while (cacheTable.numEntries > cacheSize && cacheHead) {
+	CacheRemove(cacheHead);
+    }
+
+    cachePtr = (CacheEntry *) ckalloc(sizeof(CacheEntry) + packetlen);
+    cachePtr->entryPtr = entryPtr;
+    cachePtr->type = pdu->type;
+    cachePtr->errorStatus = pdu->errorStatus;
+    cachePtr->errorIndex = pdu->errorIndex;
+    cachePtr->vbList = pdu->vbList;
+    if (cachePtr->vbList) {
+	Tcl_IncrRefCount(cachePtr->vbList);
+    }
+    cachePtr->expire = CacheNow() + cacheLifetime;
+    cachePtr->packet = (u_char *) cachePtr + sizeof(CacheEntry);
+    memcpy(cachePtr->packet, packet, (size_t) packetlen);
+    cachePtr->packetlen = packetlen;
+    Tcl_SetHashValue(entryPtr, (ClientData) cachePtr);
+
+    cachePtr->nextPtr = NULL;
+    cachePtr->prevPtr = cacheTail;
+    if (cacheTail) {
+	cacheTail->nextPtr = cachePtr;
+    } else {
+	cacheHead = cachePtr;
+    }
+    cacheTail = cachePtr;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * CacheRemove --
+ *
+ *	This procedure removes an entry from the cache.
+ *
+ * Results:
+ *	None.
  *
  * Side effects:
+ *	Memory is freed.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+CacheRemove(CacheEntry *cachePtr)
+{
+    if (cachePtr->prevPtr) {
+	cachePtr->prevPtr->nextPtr = cachePtr->nextPtr;
+    } else {
+	cacheHead = cachePtr->nextPtr;
+    }
+    if (cachePtr->nextPtr) {
+	cachePtr->nextPtr->prevPtr = cachePtr->prevPtr;
+    } else {
+	cacheTail = cachePtr->prevPtr;
+    }
+    Tcl_DeleteHashEntry(cachePtr->entryPtr);
+    if (cachePtr->vbList) {
+	Tcl_DecrRefCount(cachePtr->vbList);
+    }
+    ckfree((char *) cachePtr);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * CacheExpire --
+ *
+ *	This procedure removes the expired entries from the head of
+ *	the FIFO list. Entries which expire out of order because the
+ *	lifetime has been changed are removed when they reach the head.
+ *
+ * Results:
  *	None.
  *
+ * Side effects:
+ *	Memory is freed.
+ *
  *----------------------------------------------------------------------
  */
 
 static void
-CacheClear(TnmSnmp *session)
+CacheExpire(Tcl_WideInt now)
 {
-    int i;
+    while (cacheHead && cacheHead->expire <= now) {
+	CacheRemove(cacheHead);
+    }
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * CacheMatch --
+ *
+ *	This procedure compares the varbind list of a request with
+ *	the varbind list of a cached request. Decoded varbind lists
+ *	are compared in their binary form.
+ *
+ * Results:
+ *      1 if the varbind lists are equal, 0 otherwise.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
 
-    for (i = 0; i < CACHE_SIZE; i++) {
-	if (cache[i].session == session) {
-	    cache[i].timestamp = 0;
+static int
+CacheMatch(Tcl_Obj *objPtr1, Tcl_Obj *objPtr2)
+{
+    if (! objPtr1 || ! objPtr2) {
+	return (objPtr1 == objPtr2);
+    }
+    if (objPtr1->typePtr == &tnmVarBindListType
+	&& objPtr2->typePtr == &tnmVarBindListType) {
+	return TnmSnmpEqualVarBindList((TnmSnmpVarBindList *)
+				       objPtr1->internalRep.otherValuePtr,
+				       (TnmSnmpVarBindList *)
+				       objPtr2->internalRep.otherValuePtr);
+    }
+    return (strcmp(Tcl_GetString(objPtr1), Tcl_GetString(objPtr2)) == 0);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * TnmSnmpAgentCacheClear --
+ *
+ *	This procedure clears the cache for a given session or for
+ *	all sessions if the session is NULL.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *	Memory is freed.
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+TnmSnmpAgentCacheClear(TnmSnmp *session)
+{
+    CacheEntry *cachePtr, *nextPtr;
+
+    for (cachePtr = cacheHead; cachePtr; cachePtr = nextPtr) {
+	CacheKey *keyPtr = (CacheKey *) 
+	    Tcl_GetHashKey(&cacheTable, cachePtr->entryPtr);
+	nextPtr = cachePtr->nextPtr;
+	if (! session || keyPtr->session == session) {
+	    CacheRemove(cachePtr);
 	}
     }
 }
 
+/*
+ *----------------------------------------------------------------------
+ *
+ * TnmSnmpAgentCacheConfig --
+ *
+ *	This procedure sets the maximum number of entries and the
+ *	lifetime in milliseconds of the cache. A size or lifetime
+ *	of 0 turns the cache off.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *	Entries are removed if the cache is too large.
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+TnmSnmpAgentCacheConfig(int size, int lifetime)
+{
+    cacheSize = size;
+    cacheLifetime = lifetime;
+    if (cacheSize <= 0 || cacheLifetime <= 0) {
+	TnmSnmpAgentCacheClear(NULL);
+	return;
+    }
+    while (cacheInitialized && cacheTable.numEntries > cacheSize) {
+	CacheRemove(cacheHead);
+    }
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * TnmSnmpAgentCacheInfo --
+ *
+ *	This procedure returns the configuration of the cache and
+ *	the number of entries which have not yet expired.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *	Expired entries are removed.
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+TnmSnmpAgentCacheInfo(int *sizePtr, int *lifetimePtr, int *entriesPtr)
+{
+    CacheExpire(CacheNow());
+    *sizePtr = cacheSize;
+    *lifetimePtr = cacheLifetime;
+    *entriesPtr = cacheInitialized ? cacheTable.numEntries : 0;
+}
+
 /*
  *----------------------------------------------------------------------
  *
@@ -436,26 +742,22 @@ TnmSnmpAgentInit(Tcl_Interp *interp, TnmSnmp *session)
     }
 
     /*
-     * Make sure we are only called once - at least until we support
-     * multiple agent entities in one scotty process.
+     * Cached responses were encoded with the old session parameters
+     * and must not be used after the session has been reconfigured.
      */
 
-    if (done) {
-	return TCL_OK;
-    }
-
-    done = 1;
-    CacheInit();
+    TnmSnmpAgentCacheClear(session);
 
     /*
      * Here we build up our engineID value. This roughly conformes to
      * the "description" in RFC 2271, which is IMHO not a real cool
-     * thing.
+     * thing. Every responder session needs an engineID, so this is
+     * done before the check below unless an engineID has been
+     * configured already.
      */
-    
-    Tcl_SetObjLength(session->engineID, 12);
-    {
-        u_char *p = (unsigned char *) Tcl_GetStringFromObj(session->engineID, NULL);
+
+    if (Tcl_GetCharLength(session->engineID) == 0) {
+        char engineID[12], *p = engineID;
 	int id = 1575;
 	*p++ = (id >> 24) & 0xff;
 	*p++ = (id >> 16) & 0xff;
@@ -463,9 +765,23 @@ TnmSnmpAgentInit(Tcl_Interp *interp, TnmSnmp *session)
 	*p++ = id & 0xff;
 	*p++ = 0x04;
 	memcpy(p, "smile:)", 7);
+	Tcl_DecrRefCount(session->engineID);
+	session->engineID = TnmNewOctetStringObj(engineID, 12);
+	Tcl_IncrRefCount(session->engineID);
+	session->engineTime = time((time_t *) NULL);
+	session->engineBoots = session->engineTime - 849394800;
+    }
+
+    /*
+     * Make sure we are only called once - at least until we support
+     * multiple agent entities in one scotty process.
+     */
+
+    if (done) {
+	return TCL_OK;
     }
-    session->engineTime = time((time_t *) NULL);
-    session->engineBoots = session->engineTime - 849394800;
+
+    done = 1;
 
 #ifdef TNM_SNMPv2U
     /*
@@ -591,7 +907,9 @@ FindInstance(TnmSnmp *session, TnmOid *oidPtr)
  *
  *	This procedure locates the next instance given by the oid in
  *	the instance tree. Ignores all tree nodes without a valid 
- *	syntax that are only used internally as non leaf nodes.
+ *	syntax that are only used internally as non leaf nodes. The
+ *	node of a provider is returned if the provider may own the
+ *	next instance.
  *
  * Results:
  *      A pointer to the instance or NULL is not found.
@@ -606,7 +924,167 @@ static TnmSnmpNode*
 FindNextInstance(TnmSnmp *session, TnmOid *oidPtr)
 {
     TnmSnmpNode *inst = TnmSnmpFindNextNode(session, oidPtr);
-    return (inst && inst->syntax) ? inst : NULL;
+    return (inst && (inst->syntax || inst->provider)) ? inst : NULL;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * CallProvider --
+ *
+ *	This procedure asks the provider of the node inst for the
+ *	instance oidPtr (get) or for up to count instances that
+ *	follow oidPtr (getnext) and appends them to the varbind list.
+ *	The result of the provider is checked so that a broken
+ *	provider can not make managers loop forever.
+ *
+ * Results:
+ *      TCL_OK if varbinds have been appended, TCL_BREAK if the
+ *	provider has no such instance and TCL_ERROR if an error
+ *	occured. The SNMP error status is left in the interpreter
+ *	result in the later case.
+ *
+ * Side effects:
+ *	A background error is raised if the provider misbehaves.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+CallProvider(Tcl_Interp *interp, TnmSnmp *session, TnmSnmpNode *inst, int type, TnmOid *oidPtr, int count, TnmSnmpVarBindList *vblPtr)
+{
+    int numVarBinds = vblPtr->numVarBinds;
+    int bufferLength = vblPtr->bufferLength;
+    TnmOid tree, oid, last;
+    int i, code, ok;
+
+    /*
+     * Get the name of the subtree before we call the provider
+     * since the provider may remove itself and its node.
+     */
+
+    TnmOidInit(&tree);
+    TnmOidFromString(&tree, inst->label);
+
+    Tcl_Preserve((ClientData) session);
+    code = inst->provider->proc(interp, session, type, oidPtr, count, vblPtr,
+				inst->provider->clientData);
+    Tcl_Release((ClientData) session);
+    if (code != TCL_OK) {
+	vblPtr->numVarBinds = numVarBinds;
+	vblPtr->bufferLength = bufferLength;
+	TnmOidFree(&tree);
+	return TCL_ERROR;
+    }
+    if (vblPtr->numVarBinds == numVarBinds) {
+	TnmOidFree(&tree);
+	return TCL_BREAK;
+    }
+
+    /*
+     * The provider must return instances of its subtree. The
+     * first instance is either the requested instance or a
+     * successor and all other instances must be in order.
+     */
+
+    TnmOidInit(&oid);
+    TnmOidInit(&last);
+    TnmOidCopy(&last, oidPtr);
+    ok = (vblPtr->numVarBinds - numVarBinds <= count);
+    for (i = numVarBinds; ok && i < vblPtr->numVarBinds; i++) {
+	TnmSnmpGetVarBindName(vblPtr, vblPtr->varBinds + i, &oid);
+	ok = TnmOidInTree(&tree, &oid)
+	    && ((type == ASN1_SNMP_GET) ? TnmOidCompare(&oid, &last) == 0
+		: TnmOidCompare(&oid, &last) > 0);
+	TnmOidCopy(&last, &oid);
+    }
+    TnmOidFree(&oid);
+    TnmOidFree(&last);
+    if (ok) {
+	TnmOidFree(&tree);
+	return TCL_OK;
+    }
+
+    vblPtr->numVarBinds = numVarBinds;
+    vblPtr->bufferLength = bufferLength;
+    Tcl_ResetResult(interp);
+    Tcl_AppendResult(interp, "provider for \"", TnmOidToString(&tree),
+		     "\" returned an invalid instance for \"", (char *) NULL);
+    Tcl_AppendResult(interp, TnmOidToString(oidPtr), "\"", (char *) NULL);
+    TnmOidFree(&tree);
+    Tcl_AddErrorInfo(interp, "\n    (snmp provider)");
+    Tcl_BackgroundError(interp);
+    Tcl_SetResult(interp, "genErr", TCL_STATIC);
+    return TCL_ERROR;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * AppendResponse --
+ *
+ *	This procedure appends the value of an instance to the varbind
+ *	list of a response. The value is converted into the binary
+ *	representation right away so that broken values are detected
+ *	before we attempt to encode the response.
+ *
+ * Results:
+ *      A standard Tcl result.
+ *
+ * Side effects:
+ *	A background error is raised if the value is not valid.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+AppendResponse(Tcl_Interp *interp, TnmSnmpVarBindList *vblPtr, TnmSnmpNode *inst, const char *value)
+{
+    TnmSnmpVarBind *vbPtr;
+    Tnm_Oid *oid;
+    int oidLen;
+
+    oid = TnmStrToOid(inst->label, &oidLen);
+    if (oid) {
+	vbPtr = TnmSnmpAddVarBind(vblPtr, oid, oidLen, inst->syntax);
+	if (TnmSnmpScanVarBindValue(interp, vblPtr, vbPtr,
+				    inst->label, value) == TCL_OK) {
+	    return TCL_OK;
+	}
+    }
+
+    Tcl_AddErrorInfo(interp, "\n    (snmp send reply)");
+    Tcl_BackgroundError(interp);
+    Tcl_ResetResult(interp);
+    return TCL_ERROR;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * TooBig --
+ *
+ *	This procedure estimates whether the encoding of a varbind
+ *	list exceeds our buffer used to build the packet. Every
+ *	sub-identifier is stored in 4 bytes but may take up to 5
+ *	bytes on the wire, and every varbind adds a few bytes for
+ *	the tags and lengths.
+ *
+ * Results:
+ *      1 if the varbind list is likely too big, 0 otherwise.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+TooBig(TnmSnmpVarBindList *vblPtr)
+{
+    int size = vblPtr->bufferLength + vblPtr->bufferLength / 4
+	+ 16 * vblPtr->numVarBinds;
+    return (size >= TNM_SNMP_MAXSIZE);
 }
 
 /*
@@ -629,43 +1107,54 @@ FindNextInstance(TnmSnmp *session, TnmOid *oidPtr)
 static int
 GetRequest(Tcl_Interp *interp, TnmSnmp *session, TnmSnmpPdu *request, TnmSnmpPdu *response)
 {
-    int i, code;
+    int i, code = TCL_OK;
     TnmSnmpNode *inst;
-    Tcl_Obj *vbList, **vbListElems;
-    int vbListLen;
+    TnmSnmpVarBindList *vblPtr, *rspPtr;
+    TnmOid oid;
 
-    vbList = Tcl_NewStringObj(Tcl_DStringValue(&request->varbind), -1);
-    code = Tcl_ListObjGetElements((Tcl_Interp *) NULL, vbList,
-				  &vbListLen, &vbListElems);
-    if (code != TCL_OK) {
-	Tcl_DecrRefCount(vbList);
+    if (! request->vbList) {
+	return TCL_ERROR;
+    }
+    vblPtr = TnmSnmpGetVarBindListFromObj((Tcl_Interp *) NULL,
+					  request->vbList, request->type);
+    if (! vblPtr) {
 	return TCL_ERROR;
     }
 
-    for (i = 0; i < vbListLen; i++) {
+    rspPtr = TnmSnmpNewVarBindList();
+    TnmSnmpPreserveVarBindList(rspPtr);
+    TnmOidInit(&oid);
+
+    for (i = 0; i < vblPtr->numVarBinds; i++) {
 
-	char *syntax;
 	const char *value;
 	Tcl_Obj *objPtr;
-	TnmOid *oidPtr;
+	TnmSnmpVarBind *vbPtr = vblPtr->varBinds + i;
 
-	(void) Tcl_ListObjIndex(interp, vbListElems[i], 0, &objPtr);
-	oidPtr = TnmGetOidFromObj(interp, objPtr);
-	if (! oidPtr) {
-	    response->errorStatus = TNM_SNMP_GENERR;
-	    tnmSnmpStats.snmpOutGenErrs++;
-	    goto varBindError;
-	}
+	TnmSnmpGetVarBindName(vblPtr, vbPtr, &oid);
 	if (request->type == ASN1_SNMP_GETNEXT 
 	    || request->type == ASN1_SNMP_GETBULK) {
-	    inst = FindNextInstance(session, oidPtr);
+	    inst = FindNextInstance(session, &oid);
+	    while (inst && inst->provider) {
+		code = CallProvider(interp, session, inst,
+				    ASN1_SNMP_GETNEXT, &oid, 1, rspPtr);
+		if (code != TCL_BREAK) break;
+		inst = TnmSnmpNextNode(session, inst);
+	    }
 	} else {
-	    inst = FindInstance(session, oidPtr);
+	    inst = TnmSnmpFindProvider(session, &oid);
+	    if (inst) {
+		code = CallProvider(interp, session, inst,
+				    ASN1_SNMP_GET, &oid, 1, rspPtr);
+		if (code == TCL_BREAK) inst = NULL;
+	    } else {
+		inst = FindInstance(session, &oid);
+	    }
 	}
 
 	if (! inst) {
 
-	    char *soid;
+	    int exception = ASN1_END_OF_MIB_VIEW;
 
 	    /*
 	     * SNMPv1 handles this case by sending back an error PDU
@@ -679,36 +1168,35 @@ GetRequest(Tcl_Interp *interp, TnmSnmp *session, TnmSnmpPdu *request, TnmSnmpPdu
 		goto varBindError;
 	    }
 
-	    soid = TnmOidToString(oidPtr);
-	    Tcl_DStringStartSublist(&response->varbind);
-	    Tcl_DStringAppendElement(&response->varbind, soid);
 	    if (request->type == ASN1_SNMP_GET) {
-		TnmMibNode *nodePtr = TnmMibFindNode(soid, NULL, 0);
+		TnmMibNode *nodePtr;
+		nodePtr = TnmMibFindNode(TnmOidToString(&oid), NULL, 0);
 		if (!nodePtr || nodePtr->childPtr) {
-		    Tcl_DStringAppendElement(&response->varbind,
-					     "noSuchObject");
+		    exception = ASN1_NO_SUCH_OBJECT;
 		} else {
-		    Tcl_DStringAppendElement(&response->varbind, 
-					     "noSuchInstance");
+		    exception = ASN1_NO_SUCH_INSTANCE;
 		}
-	    } else {
-		Tcl_DStringAppendElement(&response->varbind, "endOfMibView");
 	    }
-	    Tcl_DStringAppendElement(&response->varbind, "");
-	    Tcl_DStringEndSublist(&response->varbind);
+	    (void) TnmSnmpAddVarBind(rspPtr, TnmSnmpVarBindOid(vblPtr, vbPtr),
+				     vbPtr->oidLength, exception);
 	    continue;
 	}
 
-	Tcl_DStringStartSublist(&response->varbind);
-	Tcl_DStringAppendElement(&response->varbind, inst->label);
-	syntax = TnmGetTableValue(tnmSnmpTypeTable, (unsigned) inst->syntax);
-	Tcl_DStringAppendElement(&response->varbind, syntax ? syntax : "");
+	if (inst->provider) {
+	    if (code == TCL_ERROR) {
+		goto varBindTclError;
+	    }
+	    tnmSnmpStats.snmpInTotalReqVars++;
+	    continue;
+	}
 
-	(void) Tcl_ListObjIndex(interp, vbListElems[i], 2, &objPtr);
+	objPtr = TnmSnmpGetVarBindValue(vblPtr, vbPtr);
+	Tcl_IncrRefCount(objPtr);
 	code = TnmSnmpEvalNodeBinding(session, request, inst, 
 				      TNM_SNMP_GET_EVENT, 
 				      Tcl_GetStringFromObj(objPtr, NULL),
 				      (char *) NULL);
+	Tcl_DecrRefCount(objPtr);
 	if (code == TCL_ERROR) {
 	    goto varBindTclError;
 	}
@@ -719,13 +1207,14 @@ GetRequest(Tcl_Interp *interp, TnmSnmp *session, TnmSnmpPdu *request, TnmSnmpPdu
 	    tnmSnmpStats.snmpOutGenErrs++;
 	    goto varBindError;
 	}
-	Tcl_DStringAppendElement(&response->varbind, value);
+	if (AppendResponse(interp, rspPtr, inst, value) != TCL_OK) {
+	    response->errorStatus = TNM_SNMP_GENERR;
+	    tnmSnmpStats.snmpOutGenErrs++;
+	    goto varBindError;
+	}
 	Tcl_ResetResult(interp);
 
 	tnmSnmpStats.snmpInTotalReqVars++;
-
-	Tcl_DStringEndSublist(&response->varbind);
-	
 	continue;
 
       varBindTclError:
@@ -743,20 +1232,406 @@ GetRequest(Tcl_Interp *interp, TnmSnmp *session, TnmSnmpPdu *request, TnmSnmpPdu
     }
 
     /*
-     * We check here if the varbind length in string representation
-     * exceeds our buffer used to build the packet. This is not always
+     * We check here if the encoded varbind list is likely to exceed
+     * our buffer used to build the packet. This is not always
      * correct, but we should be on the safe side in most cases.
      */
 
-    if (Tcl_DStringLength(&response->varbind) >= TNM_SNMP_MAXSIZE) {
+    if (TooBig(rspPtr)) {
 	response->errorStatus = TNM_SNMP_TOOBIG;
 	response->errorIndex = 0;
     }
 
-    Tcl_DecrRefCount(vbList);
+    TnmSnmpPduSetVarBinds(response, TnmSnmpNewVarBindListObj(rspPtr));
+    TnmSnmpReleaseVarBindList(rspPtr);
+    TnmSnmpReleaseVarBindList(vblPtr);
+    TnmOidFree(&oid);
+    return TCL_OK;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * BulkStep --
+ *
+ *	This procedure appends the instance that follows the last
+ *	instance of a getbulk cursor to the varbind list and moves
+ *	the cursor forward. Instances of providers are fetched in
+ *	chunks of up to count instances. An endOfMibView exception
+ *	is appended if there is no next instance.
+ *
+ * Results:
+ *      A standard Tcl result. The SNMP error status is left in the
+ *	interpreter result if an error occured.
+ *
+ * Side effects:
+ *	Bindings and providers are evaluated.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+BulkStep(Tcl_Interp *interp, TnmSnmp *session, TnmSnmpPdu *request, BulkCursor *cursor, int count, TnmSnmpVarBindList *rspPtr)
+{
+    TnmSnmpNode *inst, *p;
+    TnmSnmpVarBind *vbPtr;
+    const char *value;
+    int code, syntax;
+
+    while (1) {
+
+	/*
+	 * Take the next instance out of the chunk we got from a
+	 * provider. Ask the provider again once the chunk is used
+	 * up since providers may return less instances than asked.
+	 */
+
+	if (cursor->fetchPtr) {
+	    TnmSnmpVarBindList *fetchPtr = cursor->fetchPtr;
+	    if (cursor->fetched < fetchPtr->numVarBinds) {
+		vbPtr = fetchPtr->varBinds + cursor->fetched;
+		TnmSnmpAppendVarBinds(rspPtr, fetchPtr, cursor->fetched, 1);
+		TnmSnmpGetVarBindName(fetchPtr, vbPtr, &cursor->oid);
+		cursor->fetched++;
+		return TCL_OK;
+	    }
+	    TnmSnmpReleaseVarBindList(fetchPtr);
+	    cursor->fetchPtr = NULL;
+	}
+
+	if (cursor->epoch != TnmSnmpNodeEpoch()) {
+	    cursor->inst = FindNextInstance(session, &cursor->oid);
+	    cursor->epoch = TnmSnmpNodeEpoch();
+	}
+
+	inst = cursor->inst;
+	if (! inst) {
+	    cursor->done = 1;
+	    (void) TnmSnmpAddVarBind(rspPtr, TnmOidGetElements(&cursor->oid),
+				     TnmOidGetLength(&cursor->oid),
+				     ASN1_END_OF_MIB_VIEW);
+	    return TCL_OK;
+	}
+
+	if (inst->provider) {
+	    TnmOid tree;
+	    cursor->fetchPtr = TnmSnmpNewVarBindList();
+	    TnmSnmpPreserveVarBindList(cursor->fetchPtr);
+	    cursor->fetched = 0;
+	    TnmOidInit(&tree);
+	    TnmOidFromString(&tree, inst->label);
+	    code = CallProvider(interp, session, inst, ASN1_SNMP_GETNEXT,
+				&cursor->oid, count, cursor->fetchPtr);
+	    if (code == TCL_ERROR) {
+		TnmOidFree(&tree);
+		return TCL_ERROR;
+	    }
+	    if (code == TCL_BREAK) {
+
+		/*
+		 * Skip the subtree of the provider. We have to locate
+		 * the provider again if it has changed the tree.
+		 */
+
+		if (cursor->epoch != TnmSnmpNodeEpoch()) {
+		    inst = FindNextInstance(session, &cursor->oid);
+		    cursor->epoch = TnmSnmpNodeEpoch();
+		    if (! inst || ! inst->provider
+			|| strcmp(inst->label, TnmOidToString(&tree)) != 0) {
+			cursor->inst = inst;
+			inst = NULL;
+		    }
+		}
+		if (inst) {
+		    cursor->inst = TnmSnmpNextNode(session, inst);
+		}
+	    }
+	    TnmOidFree(&tree);
+	    continue;
+	}
+
+	for (p = inst; p && ! p->bindings; p = p->parentPtr) ;
+	if (p) {
+	    code = TnmSnmpEvalNodeBinding(session, request, inst,
+					  TNM_SNMP_GET_EVENT,
+			  Tcl_GetStringFromObj(cursor->value, NULL),
+					  (char *) NULL);
+	    if (code == TCL_ERROR) {
+		return TCL_ERROR;
+	    }
+	    if (cursor->epoch != TnmSnmpNodeEpoch()) {
+		cursor->inst = FindNextInstance(session, &cursor->oid);
+		cursor->epoch = TnmSnmpNodeEpoch();
+		if (! cursor->inst || cursor->inst->provider) {
+		    continue;
+		}
+		inst = cursor->inst;
+	    }
+	}
+
+	/*
+	 * Remember the name and the syntax of the instance and move
+	 * the cursor before we read the variable since read traces
+	 * may remove the instance.
+	 */
+
+	TnmOidFromString(&cursor->oid, inst->label);
+	syntax = inst->syntax;
+	cursor->inst = TnmSnmpNextNode(session, inst);
+
+	value = Tcl_GetVar(interp, inst->tclVarName,
+			   TCL_GLOBAL_ONLY | TCL_LEAVE_ERR_MSG);
+	if (! value) {
+	    Tcl_SetResult(interp, "genErr", TCL_STATIC);
+	    return TCL_ERROR;
+	}
+	vbPtr = TnmSnmpAddVarBind(rspPtr, TnmOidGetElements(&cursor->oid),
+				  TnmOidGetLength(&cursor->oid), syntax);
+	if (TnmSnmpScanVarBindValue(interp, rspPtr, vbPtr,
+			    TnmOidToString(&cursor->oid), value) != TCL_OK) {
+	    Tcl_AddErrorInfo(interp, "\n    (snmp send reply)");
+	    Tcl_BackgroundError(interp);
+	    Tcl_SetResult(interp, "genErr", TCL_STATIC);
+	    return TCL_ERROR;
+	}
+	Tcl_ResetResult(interp);
+	tnmSnmpStats.snmpInTotalReqVars++;
+	return TCL_OK;
+    }
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * GetBulkRequest --
+ *
+ *	This procedure is called to process getbulk requests. It
+ *	keeps a cursor in the instance tree for every varbind of
+ *	the request so that the repetitions do not search the tree
+ *	from the root (RFC 3416 section 4.2.3). The size of every
+ *	varbind is accounted for while the response is built and
+ *	we stop as soon as the next varbind would not fit into a
+ *	message of the maximum message size of the session.
+ *
+ * Results:
+ *      A standard Tcl result.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+GetBulkRequest(Tcl_Interp *interp, TnmSnmp *session, TnmSnmpPdu *request, TnmSnmpPdu *response)
+{
+    int i, j, k, m, n, code, size, space, count, done, numDone = 0;
+    int nonRepeaters, maxRepetitions, numVarBinds, bufferLength, minSize;
+    TnmSnmpVarBindList *vblPtr, *rspPtr;
+    TnmSnmpPdu pdu;
+    BulkCursor *cursors;
+
+    if (! request->vbList) {
+	return TCL_ERROR;
+    }
+    vblPtr = TnmSnmpGetVarBindListFromObj((Tcl_Interp *) NULL,
+					  request->vbList, request->type);
+    if (! vblPtr) {
+	return TCL_ERROR;
+    }
+
+    n = vblPtr->numVarBinds;
+    nonRepeaters = request->errorStatus < 0 ? 0 : request->errorStatus;
+    nonRepeaters = nonRepeaters > n ? n : nonRepeaters;
+    maxRepetitions = request->errorIndex < 0 ? 0 : request->errorIndex;
+
+    /*
+     * Compute the space left for varbinds in the response message.
+     */
+
+    pdu = *response;
+    pdu.type = ASN1_SNMP_RESPONSE;
+    pdu.requestId = request->requestId;
+    pdu.vbList = NULL;
+    space = TnmSnmpEncodeOverhead(interp, session, &pdu);
+    if (space < 0) {
+	Tcl_AddErrorInfo(interp, "\n    (snmp send reply)");
+	Tcl_BackgroundError(interp);
+	Tcl_ResetResult(interp);
+	response->errorStatus = TNM_SNMP_GENERR;
+	tnmSnmpStats.snmpOutGenErrs++;
+	TnmSnmpReleaseVarBindList(vblPtr);
+	return TCL_OK;
+    }
+    space = (session->maxSize < TNM_SNMP_MAXSIZE
+	     ? session->maxSize : TNM_SNMP_MAXSIZE) - space;
+
+    cursors = (BulkCursor *) ckalloc((n ? n : 1) * sizeof(BulkCursor));
+    memset((char *) cursors, 0, (n ? n : 1) * sizeof(BulkCursor));
+    for (i = 0; i < n; i++) {
+	TnmSnmpVarBind *vbPtr = vblPtr->varBinds + i;
+	TnmOidInit(&cursors[i].oid);
+	TnmSnmpGetVarBindName(vblPtr, vbPtr, &cursors[i].oid);
+	cursors[i].value = TnmSnmpGetVarBindValue(vblPtr, vbPtr);
+	Tcl_IncrRefCount(cursors[i].value);
+	cursors[i].inst = FindNextInstance(session, &cursors[i].oid);
+	cursors[i].epoch = TnmSnmpNodeEpoch();
+    }
+
+    rspPtr = TnmSnmpNewVarBindList();
+    TnmSnmpPreserveVarBindList(rspPtr);
+
+    /*
+     * We keep track of the smallest varbind so that we do not ask
+     * providers for many more instances than fit into the message.
+     * The initial guess assumes that the instances are not smaller
+     * than the varbinds of the request.
+     */
+
+    for (minSize = TNM_SNMP_MAXSIZE, i = 0; i < n; i++) {
+	size = vblPtr->varBinds[i].oidLength + 6;
+	minSize = (size < minSize) ? size : minSize;
+    }
+
+    /*
+     * The non-repeaters are processed once and the repeaters are
+     * processed in rounds until we have reached max-repetitions,
+     * all repeaters have reached the end of the MIB view or the
+     * message is full.
+     */
+
+    m = n - nonRepeaters;
+    for (k = 0; space > 0; k++) {
+	if (k < nonRepeaters) {
+	    i = k;
+	    count = 1;
+	} else {
+	    if (m == 0) break;
+	    i = nonRepeaters + (k - nonRepeaters) % m;
+	    j = (k - nonRepeaters) / m;
+	    if (j >= maxRepetitions) break;
+	    if (i == nonRepeaters && j > 0 && numDone == m) break;
+	    count = space / (m * minSize) + 1;
+	    count = (count < maxRepetitions - j) ? count : maxRepetitions - j;
+	}
+
+	numVarBinds = rspPtr->numVarBinds;
+	bufferLength = rspPtr->bufferLength;
+	done = cursors[i].done;
+	code = BulkStep(interp, session, request, cursors + i, count, rspPtr);
+	if (code != TCL_OK) {
+	    response->errorStatus = TnmGetTableKey(tnmSnmpErrorTable,
+					Tcl_GetStringResult(interp));
+	    if (response->errorStatus < 0) {
+		response->errorStatus = TNM_SNMP_GENERR;
+	    }
+	    tnmSnmpStats.snmpOutGenErrs +=
+		(response->errorStatus == TNM_SNMP_GENERR);
+	    response->errorIndex = i+1;
+	    break;
+	}
+
+	size = TnmSnmpVarBindSize(interp, session, rspPtr,
+				  rspPtr->varBinds + numVarBinds);
+	if (size < 0) {
+	    Tcl_AddErrorInfo(interp, "\n    (snmp send reply)");
+	    Tcl_BackgroundError(interp);
+	    Tcl_ResetResult(interp);
+	    response->errorStatus = TNM_SNMP_GENERR;
+	    tnmSnmpStats.snmpOutGenErrs++;
+	    response->errorIndex = i+1;
+	    break;
+	}
+	if (size > space) {
+	    rspPtr->numVarBinds = numVarBinds;
+	    rspPtr->bufferLength = bufferLength;
+	    break;
+	}
+	space -= size;
+	minSize = (size < minSize) ? size : minSize;
+	if (i >= nonRepeaters && ! done && cursors[i].done) {
+	    numDone++;
+	}
+    }
+
+    for (i = 0; i < n; i++) {
+	TnmOidFree(&cursors[i].oid);
+	Tcl_DecrRefCount(cursors[i].value);
+	if (cursors[i].fetchPtr) {
+	    TnmSnmpReleaseVarBindList(cursors[i].fetchPtr);
+	}
+    }
+    ckfree((char *) cursors);
+
+    TnmSnmpPduSetVarBinds(response, TnmSnmpNewVarBindListObj(rspPtr));
+    TnmSnmpReleaseVarBindList(rspPtr);
+    TnmSnmpReleaseVarBindList(vblPtr);
     return TCL_OK;
 }
 
+/*
+ *----------------------------------------------------------------------
+ *
+ * SplitVarBinds --
+ *
+ *	This procedure converts the binary varbind list of a set
+ *	request into a vector of SNMP_VarBind structures as needed
+ *	by the set processing code. The object identifier and the
+ *	formatted value of each varbind share a single allocation
+ *	so that the vector can be freed by Tnm_SnmpFreeVBList().
+ *
+ * Results:
+ *      A pointer to the vector of SNMP_VarBind structures.
+ *
+ * Side effects:
+ *	Memory is allocated.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static SNMP_VarBind*
+SplitVarBinds(TnmSnmpVarBindList *vblPtr)
+{
+    SNMP_VarBind *varBindPtr;
+    int i, size = vblPtr->numVarBinds;
+
+    varBindPtr = (SNMP_VarBind *) ckalloc((size ? size : 1)
+					   * sizeof(SNMP_VarBind));
+    memset((char *) varBindPtr, 0, (size ? size : 1) * sizeof(SNMP_VarBind));
+
+    for (i = 0; i < size; i++) {
+	TnmSnmpVarBind *vbPtr = vblPtr->varBinds + i;
+	Tcl_Obj *objPtr;
+	char *soid, *value;
+	int soidLen, valueLen;
+
+	objPtr = TnmSnmpGetVarBindValue(vblPtr, vbPtr);
+	value = Tcl_GetStringFromObj(objPtr, &valueLen);
+	soid = TnmOidToStr(TnmSnmpVarBindOid(vblPtr, vbPtr), vbPtr->oidLength);
+	soidLen = strlen(soid);
+
+	varBindPtr[i].freePtr = ckalloc(soidLen + valueLen + 2);
+	varBindPtr[i].soid = varBindPtr[i].freePtr;
+	memcpy(varBindPtr[i].soid, soid, soidLen + 1);
+	varBindPtr[i].value = varBindPtr[i].freePtr + soidLen + 1;
+	memcpy(varBindPtr[i].value, value, valueLen + 1);
+	Tcl_DecrRefCount(objPtr);
+
+	if (TnmSnmpException(vbPtr->syntax)) {
+	    varBindPtr[i].syntax = TnmGetTableValue(tnmSnmpExceptionTable,
+						    vbPtr->syntax);
+	} else {
+	    varBindPtr[i].syntax = TnmGetTableValue(tnmSnmpTypeTable,
+						    vbPtr->syntax);
+	}
+	if (! varBindPtr[i].syntax) {
+	    varBindPtr[i].syntax = "Opaque";
+	}
+    }
+
+    return varBindPtr;
+}
+
 /*
  *----------------------------------------------------------------------
  *
@@ -783,24 +1658,38 @@ SetRequest(Tcl_Interp *interp, TnmSnmp *session, TnmSnmpPdu *request, TnmSnmpPdu
     int inVarBindSize;
     TnmSnmpNode *inst;
     int varsToRollback = 0;
+    TnmSnmpVarBindList *vblPtr, *rspPtr;
 
-    TnmOidInit(&oid);
-
-    code = Tnm_SnmpSplitVBList(interp, Tcl_DStringValue(&request->varbind),
-			       &inVarBindSize, &inVarBindPtr);
-    if (code != TCL_OK) {
+    if (! request->vbList) {
 	return TCL_ERROR;
     }
+    vblPtr = TnmSnmpGetVarBindListFromObj((Tcl_Interp *) NULL,
+					  request->vbList, request->type);
+    if (! vblPtr) {
+	return TCL_ERROR;
+    }
+    inVarBindSize = vblPtr->numVarBinds;
+    inVarBindPtr = SplitVarBinds(vblPtr);
+    TnmSnmpReleaseVarBindList(vblPtr);
+
+    rspPtr = TnmSnmpNewVarBindList();
+    TnmSnmpPreserveVarBindList(rspPtr);
+    TnmOidInit(&oid);
 
     for (i = 0; i < inVarBindSize; i++) {
 
 	const char *value;
-	char *syntax;
 	int setAlreadyDone = 0;
 	varsToRollback = i;
 
 	TnmOidFromString(&oid, inVarBindPtr[i].soid);
 	inst = FindInstance(session, &oid);
+	if (! inst && TnmSnmpFindProvider(session, &oid)) {
+	    TnmOidFree(&oid);
+	    response->errorStatus = TNM_SNMP_NOTWRITABLE;
+	    varsToRollback--;
+	    goto varBindError;
+	}
 	TnmOidFree(&oid);
 
 	if (! inst) {
@@ -891,20 +1780,18 @@ SetRequest(Tcl_Interp *interp, TnmSnmp *session, TnmSnmpPdu *request, TnmSnmpPdu
 	    tnmSnmpStats.snmpInTotalSetVars++;
 	}
 	
-	Tcl_DStringStartSublist(&response->varbind);
-	Tcl_DStringAppendElement(&response->varbind, inst->label);
-	syntax = TnmGetTableValue(tnmSnmpTypeTable, (unsigned) inst->syntax);
-	Tcl_DStringAppendElement(&response->varbind, syntax ? syntax : "");
 	value = Tcl_GetVar(interp, inst->tclVarName, 
 			   TCL_GLOBAL_ONLY | TCL_LEAVE_ERR_MSG);
 	if (!value) {
 	    response->errorStatus = TNM_SNMP_GENERR;
 	    goto varBindError;
 	}
-	Tcl_DStringAppendElement(&response->varbind, value);
+	if (AppendResponse(interp, rspPtr, inst, value) != TCL_OK) {
+	    response->errorStatus = TNM_SNMP_GENERR;
+	    tnmSnmpStats.snmpOutGenErrs++;
+	    goto varBindError;
+	}
 	Tcl_ResetResult(interp);
-
-	Tcl_DStringEndSublist(&response->varbind);
 	
 	continue;
 
@@ -923,15 +1810,17 @@ SetRequest(Tcl_Interp *interp, TnmSnmp *session, TnmSnmpPdu *request, TnmSnmpPdu
     }
 
     /*
-     * We check here if the varbind length in string representation
-     * exceeds our buffer used to build the packet. This is not always
+     * We check here if the encoded varbind list is likely to exceed
+     * our buffer used to build the packet. This is not always
      * correct, but we should be on the safe side in most cases.
      */
     
-    if (Tcl_DStringLength(&response->varbind) >= TNM_SNMP_MAXSIZE) {
+    if (TooBig(rspPtr)) {
 	response->errorStatus = TNM_SNMP_TOOBIG;
 	response->errorIndex = 0;
     }
+    TnmSnmpPduSetVarBinds(response, TnmSnmpNewVarBindListObj(rspPtr));
+    TnmSnmpReleaseVarBindList(rspPtr);
 
     /*
      * Another check for consistency errors before we start 
@@ -1054,8 +1943,10 @@ SetRequest(Tcl_Interp *interp, TnmSnmp *session, TnmSnmpPdu *request, TnmSnmpPdu
 int
 TnmSnmpAgentRequest(Tcl_Interp *interp, TnmSnmp *session, TnmSnmpPdu *pdu)
 {
-    int rc;
-    TnmSnmpPdu *reply;
+    int rc, packetlen;
+    TnmSnmpPdu _reply, *reply = &_reply;
+    CacheEntry *cachePtr;
+    u_char packet[TNM_SNMP_MAXSIZE];
 
     switch (pdu->type) {
       case ASN1_SNMP_GET:
@@ -1074,26 +1965,35 @@ TnmSnmpAgentRequest(Tcl_Interp *interp, TnmSnmp *session, TnmSnmpPdu *pdu)
 
     }
 
-    if (pdu->type == ASN1_SNMP_SET) {
-	CacheClear(session);
-    }
+    /*
+     * Retries of requests we have already answered get the cached
+     * response without evaluating any bindings again. This also
+     * makes sure that the side effects of set requests happen once.
+     */
 
-    reply = CacheHit(session, pdu);
-    if (reply != NULL) {
-	rc = TnmSnmpEncode(interp, session, reply, NULL, NULL);
-	return rc;
+    cachePtr = CacheHit(session, pdu);
+    if (cachePtr != NULL) {
+	tnmSnmpStats.snmpOutGetResponses++;
+	return TnmSnmpSend(interp, session, cachePtr->packet,
+			   cachePtr->packetlen, &pdu->addr, TNM_SNMP_ASYNC);
     }
 
     TnmSnmpEvalBinding(interp, session, pdu, TNM_SNMP_BEGIN_EVENT);
 
-    reply = CacheGet(session, pdu);
+    memset((char *) reply, 0, sizeof(TnmSnmpPdu));
+    reply->addr = pdu->addr;
+    reply->errorStatus = TNM_SNMP_NOERROR;
 
     if (pdu->type == ASN1_SNMP_SET) {
 	rc = SetRequest(interp, session, pdu, reply);
+    } else if (pdu->type == ASN1_SNMP_GETBULK
+	       && session->version != TNM_SNMPv1) {
+	rc = GetBulkRequest(interp, session, pdu, reply);
     } else {
 	rc = GetRequest(interp, session, pdu, reply);
     }
     if (rc != TCL_OK) {
+	TnmSnmpPduSetVarBinds(reply, NULL);
 	return TCL_ERROR;
     }
 
@@ -1103,10 +2003,7 @@ TnmSnmpAgentRequest(Tcl_Interp *interp, TnmSnmp *session, TnmSnmpPdu *pdu)
      */
 
     if (reply->errorStatus != TNM_SNMP_NOERROR) {
-	Tcl_DStringFree(&reply->varbind);
-	Tcl_DStringAppend(&reply->varbind,
-			  Tcl_DStringValue(&pdu->varbind),
-			  Tcl_DStringLength(&pdu->varbind));
+	TnmSnmpPduSetVarBinds(reply, pdu->vbList);
     }
  
     reply->type = ASN1_SNMP_RESPONSE;
@@ -1114,18 +2011,21 @@ TnmSnmpAgentRequest(Tcl_Interp *interp, TnmSnmp *session, TnmSnmpPdu *pdu)
 
     TnmSnmpEvalBinding(interp, session, reply, TNM_SNMP_END_EVENT);
 
-    if (TnmSnmpEncode(interp, session, reply, NULL, NULL) != TCL_OK) {
+    packetlen = sizeof(packet);
+    rc = TnmSnmpEncodeResponse(interp, session, reply, packet, &packetlen);
+    if (rc != TCL_OK) {
 	Tcl_AddErrorInfo(interp, "\n    (snmp send reply)");
 	Tcl_BackgroundError(interp);
 	Tcl_ResetResult(interp);
 	reply->errorStatus = TNM_SNMP_GENERR;
-	Tcl_DStringFree(&reply->varbind);
-        Tcl_DStringAppend(&reply->varbind,
-			  Tcl_DStringValue(&pdu->varbind),
-			  Tcl_DStringLength(&pdu->varbind));
-	return TnmSnmpEncode(interp, session, reply, NULL, NULL);
-    } else {
-	return TCL_OK;
+	TnmSnmpPduSetVarBinds(reply, pdu->vbList);
+	packetlen = sizeof(packet);
+	rc = TnmSnmpEncodeResponse(interp, session, reply, packet, &packetlen);
+    }
+    if (rc == TCL_OK) {
+	CachePut(session, pdu, packet, packetlen);
     }
+    TnmSnmpPduSetVarBinds(reply, NULL);
+    return rc;
 }
 
@@ -21,10 +21,19 @@
 #include "tnmMib.h"
 
 /*
- * The root of the tree containing all MIB instances.
+ * The root of the tree containing all MIB instances. The children
+ * of every node are kept in a vector sorted by the sub identifier
+ * so that we can use a binary search at each level of the tree.
+ * The table below maps the names of the Tcl variables to the nodes
+ * which use them so that we do not have to scan the whole tree if
+ * a variable is removed. The epoch is incremented whenever a node
+ * is freed or a provider changes so that code which keeps pointers
+ * to nodes across Tcl evaluations can detect that they are stale.
  */
 
 static TnmSnmpNode *instTree = NULL;
+static Tcl_HashTable varTable;
+static unsigned int nodeEpoch = 0;
 
 /*
  * Forward declarations for procedures defined later in this file:
@@ -36,21 +45,47 @@ DumpTree                (TnmSnmpNode *instPtr);
 static void
 FreeNode		(TnmSnmpNode *inst);
 
+static int
+FindChild		(TnmSnmpNode *parentPtr, u_int subid,
+				     int *indexPtr);
+static TnmSnmpNode*
+InsertChild		(TnmSnmpNode *parentPtr, int index,
+				     u_int subid, char *label);
+static void
+PruneNode		(TnmSnmpNode *inst);
+
+static void
+LinkVar			(TnmSnmpNode *inst);
+
+static void
+UnlinkVar		(TnmSnmpNode *inst);
+
 static TnmSnmpNode*
 AddNode			(char *id, int offset, int syntax,
 				     int access, char *tclVarName);
 static void
-RemoveNode		(TnmSnmpNode *root, char *varname);
+RemoveNode		(char *varname);
 
 static TnmSnmpNode*
 FindNode		(TnmSnmpNode *root, TnmOid *oidPtr);
 
 static TnmSnmpNode*
-FindNextNode		(TnmSnmpNode *root, u_int *oid, int len);
+FirstNode		(TnmSnmpNode *parentPtr, int index);
+
+static TnmSnmpNode*
+FindNextNode		(TnmSnmpNode *parentPtr, u_int *oid, int len);
 
 static char*
 DeleteNodeProc		(ClientData clientData, Tcl_Interp *interp,
 				     char *name1, char *name2, int flags);
+static int
+TclProviderProc		(Tcl_Interp *interp, TnmSnmp *session,
+				     int type, TnmOid *oidPtr, int count,
+				     TnmSnmpVarBindList *vblPtr,
+				     ClientData clientData);
+static void
+TclProviderDeleteProc	(ClientData clientData);
+
 
 
 /*
@@ -73,16 +108,15 @@ DeleteNodeProc		(ClientData clientData, Tcl_Interp *interp,
 static void
 DumpTree(TnmSnmpNode *instPtr)
 {
+    int i;
+
     if (instPtr) {
         fprintf(stderr, "** %s (%s)\n",
                 instPtr->label ? instPtr->label : "(none)",
                 TnmGetTableValue(tnmMibAccessTable,
 				 (unsigned) instPtr->access));
-        if (instPtr->childPtr) {
-            DumpTree(instPtr->childPtr);
-        }
-        if (instPtr->nextPtr) {
-            DumpTree(instPtr->nextPtr);
+	for (i = 0; i < instPtr->numChildren; i++) {
+            DumpTree(instPtr->children[i]);
         }
     }
 }
@@ -107,13 +141,22 @@ DumpTree(TnmSnmpNode *instPtr)
 static void
 FreeNode(TnmSnmpNode *instPtr)
 {
-
+    nodeEpoch++;
     if (instPtr->label) {
 	ckfree(instPtr->label);
     }
     if (instPtr->tclVarName) {
 	ckfree(instPtr->tclVarName);
     }
+    if (instPtr->children) {
+	ckfree((char *) instPtr->children);
+    }
+    if (instPtr->provider) {
+	if (instPtr->provider->deleteProc) {
+	    instPtr->provider->deleteProc(instPtr->provider->clientData);
+	}
+	ckfree((char *) instPtr->provider);
+    }
     while (instPtr->bindings) {
 	TnmSnmpBinding *bindPtr = instPtr->bindings;
 	instPtr->bindings = instPtr->bindings->nextPtr;
@@ -125,6 +168,193 @@ FreeNode(TnmSnmpNode *instPtr)
     ckfree((char *) instPtr);
 }
 
+/*
+ *----------------------------------------------------------------------
+ *
+ * FindChild --
+ *
+ *	This procedure performs a binary search for the child node
+ *	with the given sub identifier.
+ *
+ * Results:
+ *	1 if the child exists and 0 otherwise. The index of the child
+ *	or the index where the child has to be inserted is left in
+ *	indexPtr.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+FindChild(TnmSnmpNode *parentPtr, u_int subid, int *indexPtr)
+{
+    int lo = 0, hi = parentPtr->numChildren;
+
+    while (lo < hi) {
+	int mid = lo + (hi - lo) / 2;
+	if (parentPtr->children[mid]->subid < subid) {
+	    lo = mid + 1;
+	} else {
+	    hi = mid;
+	}
+    }
+    *indexPtr = lo;
+    return (lo < parentPtr->numChildren
+	    && parentPtr->children[lo]->subid == subid);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * InsertChild --
+ *
+ *	This procedure creates a new node and inserts it into the
+ *	vector of child nodes at the given index. The vector grows
+ *	by doubling its size so that tables which are created in
+ *	lexicographic order are appended in constant time.
+ *
+ * Results:
+ *	A pointer to the new node.
+ *
+ * Side effects:
+ *	Memory is allocated.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static TnmSnmpNode*
+InsertChild(TnmSnmpNode *parentPtr, int index, u_int subid, char *label)
+{
+    TnmSnmpNode *n;
+
+    if (parentPtr->numChildren == parentPtr->maxChildren) {
+	parentPtr->maxChildren = parentPtr->maxChildren
+	    ? 2 * parentPtr->maxChildren : 4;
+	parentPtr->children = (TnmSnmpNode **)
+	    ckrealloc((char *) parentPtr->children,
+		      parentPtr->maxChildren * sizeof(TnmSnmpNode *));
+    }
+    memmove(parentPtr->children + index + 1, parentPtr->children + index,
+	    (parentPtr->numChildren - index) * sizeof(TnmSnmpNode *));
+    parentPtr->numChildren++;
+
+    n = (TnmSnmpNode *) ckalloc(sizeof(TnmSnmpNode));
+    memset((char *) n, 0, sizeof(TnmSnmpNode));
+    n->label = ckstrdup(label);
+    n->subid = subid;
+    n->parentPtr = parentPtr;
+    parentPtr->children[index] = n;
+    return n;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * PruneNode --
+ *
+ *	This procedure removes a node which is neither an instance
+ *	nor a provider nor carries bindings nor has children from the
+ *	tree. The parent nodes are pruned as well if they became
+ *	useless.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	Memory is freed.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+PruneNode(TnmSnmpNode *inst)
+{
+    TnmSnmpNode *p;
+    int index;
+
+    while (inst != instTree && inst->numChildren == 0 && ! inst->syntax
+	   && ! inst->bindings && ! inst->tclVarName && ! inst->provider) {
+	p = inst->parentPtr;
+	if (FindChild(p, inst->subid, &index)) {
+	    memmove(p->children + index, p->children + index + 1,
+		    (p->numChildren - index - 1) * sizeof(TnmSnmpNode *));
+	    p->numChildren--;
+	}
+	FreeNode(inst);
+	inst = p;
+    }
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * LinkVar --
+ *
+ *	This procedure registers a node in the table which maps Tcl
+ *	variable names to instance nodes.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+LinkVar(TnmSnmpNode *inst)
+{
+    Tcl_HashEntry *entryPtr;
+    int isNew;
+
+    entryPtr = Tcl_CreateHashEntry(&varTable, inst->tclVarName, &isNew);
+    inst->varNextPtr = isNew ? NULL : (TnmSnmpNode *) Tcl_GetHashValue(entryPtr);
+    Tcl_SetHashValue(entryPtr, (ClientData) inst);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * UnlinkVar --
+ *
+ *	This procedure removes a node from the table which maps Tcl
+ *	variable names to instance nodes.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+UnlinkVar(TnmSnmpNode *inst)
+{
+    Tcl_HashEntry *entryPtr;
+    TnmSnmpNode **pp;
+
+    entryPtr = Tcl_FindHashEntry(&varTable, inst->tclVarName);
+    if (! entryPtr) {
+	return;
+    }
+    for (pp = (TnmSnmpNode **) &Tcl_GetHashValue(entryPtr); *pp;
+	 pp = &(*pp)->varNextPtr) {
+	if (*pp == inst) {
+	    *pp = inst->varNextPtr;
+	    break;
+	}
+    }
+    inst->varNextPtr = NULL;
+    if (Tcl_GetHashValue(entryPtr) == NULL) {
+	Tcl_DeleteHashEntry(entryPtr);
+    }
+}
+
 /*
  *----------------------------------------------------------------------
  *
@@ -146,7 +376,7 @@ static TnmSnmpNode*
 AddNode(char *soid, int offset, int syntax, int access, char *tclVarName)
 {
     Tnm_Oid *oid;
-    int i, oidlen;
+    int i, index, oidlen;
     TnmSnmpNode *p, *q = NULL;
 
     if (instTree == NULL) {
@@ -154,67 +384,48 @@ AddNode(char *soid, int offset, int syntax, int access, char *tclVarName)
 	memset((char *) instTree, 0, sizeof(TnmSnmpNode));
 	instTree->label = "1";
 	instTree->subid = 1;
+	Tcl_InitHashTable(&varTable, TCL_STRING_KEYS);
     }
 
     oid = TnmStrToOid(soid, &oidlen);
-    if (oid[0] != 1 || oidlen < 1) {
+    if (! oid || oidlen < 1 || oid[0] != 1) {
 	return NULL;
     }
-    if (oidlen == 1 && oid[0] == 1) {
+    if (oidlen == 1) {
         return instTree;
     }
 
     for (p = instTree, i = 1; i < oidlen; p = q, i++) {
-	for (q = p->childPtr; q; q = q->nextPtr) {
-	    if (q->subid == oid[i]) break;
-	}
-	if (! q) {
+	if (FindChild(p, oid[i], &index)) {
+	    q = p->children[index];
+	} else {
 
 	    /*
 	     * Create new intermediate nodes.
 	     */
 
-	    TnmSnmpNode *n;
-	    char *s = TnmOidToStr(oid, i+1);
-	    
-	    n = (TnmSnmpNode *) ckalloc(sizeof(TnmSnmpNode));
-	    memset((char *) n, 0, sizeof(TnmSnmpNode));
-	    n->label = ckstrdup(s);
-	    n->subid = oid[i];
-	    n->offset = offset;
-
-	    if (! p->childPtr) {			/* first node  */
-		p->childPtr = n;
-
-	    } else if (p->childPtr->subid > oid[i]) {	/* insert head */
-		n->nextPtr = p->childPtr;
-		p->childPtr = n;
-
-	    } else {					/* somewhere else */
-		for (q = p->childPtr; q->nextPtr && q->nextPtr->subid < oid[i]; 
-		     q = q->nextPtr) ;
-		if (q->nextPtr && q->nextPtr->subid == oid[i]) {
-		    continue;
-		}
-		n->nextPtr = q->nextPtr;
-		q->nextPtr = n;
-	    }
-
-	    q = n;
+	    q = InsertChild(p, index, oid[i], TnmOidToStr(oid, i+1));
+	    q->offset = offset;
 	}
     }
 
     if (q) {
 	if (q->label) ckfree(q->label);
-	if (q->tclVarName && q->tclVarName != tclVarName) {
-	    ckfree(q->tclVarName);
+	if (q->tclVarName != tclVarName) {
+	    if (q->tclVarName) {
+		UnlinkVar(q);
+		ckfree(q->tclVarName);
+	    }
+	    q->tclVarName = tclVarName;
+	    if (q->tclVarName) {
+		LinkVar(q);
+	    }
 	}
 	
 	q->label  = soid;
 	q->offset = offset;
 	q->syntax = syntax;
 	q->access = access;
-	q->tclVarName = tclVarName;
     }
   
     return q;
@@ -223,13 +434,15 @@ AddNode(char *soid, int offset, int syntax, int access, char *tclVarName)
 /*
  *----------------------------------------------------------------------
  *
- * FindNextNode --
+ * FirstNode --
  *
- *	This procedure locates the lexikographic next instance
- *	node in the instance tree.
+ *	This procedure locates the first instance node in the
+ *	subtrees rooted at the child nodes of parentPtr, starting
+ *	with the child node at the given index. Nodes with a
+ *	provider are returned without looking at their subtree.
  *
  * Results:
- *	A pointer to the node or NULL if there is no next node.
+ *	A pointer to the node or NULL if there is no instance node.
  *
  * Side effects:
  *	None.
@@ -238,65 +451,73 @@ AddNode(char *soid, int offset, int syntax, int access, char *tclVarName)
  */
 
 static TnmSnmpNode*
-FindNextNode(TnmSnmpNode *root, u_int *oid, int len)
+FirstNode(TnmSnmpNode *parentPtr, int index)
 {
-    TnmSnmpNode *p, *inst;
-    static int force = 0;
+    TnmSnmpNode *inst;
 
-    /*
-     * Reset the force flag if we start a new search from the root of
-     * the instance tree. The flag will be set whenever we decide that
-     * the next instance we find will be a good candidate.
-     */
-
-    if (root == instTree) {
-	force = 0;
+    for (; index < parentPtr->numChildren; index++) {
+	TnmSnmpNode *p = parentPtr->children[index];
+	if (p->syntax || p->provider) {
+	    return p;
+	}
+	inst = FirstNode(p, 0);
+	if (inst) {
+	    return inst;
+	}
     }
+    return NULL;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * FindNextNode --
+ *
+ *	This procedure locates the lexikographic next instance
+ *	node below parentPtr. The sub identifiers in oid are
+ *	relative to the parent node.
+ *
+ * Results:
+ *	A pointer to the node or NULL if there is no next node. The
+ *	node of a provider is returned if the oid is in the subtree
+ *	of the provider or if the subtree follows the oid. The
+ *	caller must ask the provider for the next instance.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static TnmSnmpNode*
+FindNextNode(TnmSnmpNode *parentPtr, u_int *oid, int len)
+{
+    TnmSnmpNode *inst;
+    int index;
 
     /*
-     * Skip over all subidentifier that are lower than the
-     * subidentifier of interest.
+     * All nodes below the parent follow the parent if we have
+     * no more sub identifiers. Otherwise, descend into the child
+     * with a matching sub identifier and continue with the
+     * following children if there is nothing left in that subtree.
      */
 
-    p = root;
-    if (len) {
-	while (p && p->subid < oid[0]) p = p->nextPtr;
+    if (len == 0) {
+	return FirstNode(parentPtr, 0);
     }
 
-    /*
-     * Loop over all neighbours at this tree level. Descend if possible.
-     */
-
-    while (p) {
-	if (p->childPtr) {
-	    if (len > 0 && p->subid == oid[0]) {
-		/* descend - positive match */
-		inst = FindNextNode(p->childPtr, oid + 1, len - 1);
-	    } else if (p->syntax) {
-		/* no match - use this node */
-		return p;
-	    } else {
-		/* descend - force next node */
-		force = 1;
-		inst = FindNextNode(p->childPtr, NULL, 0);
-	    }
-	    if (inst) return inst;
-	} else {
-	    if (len == 0 && p->syntax) {
-		/* found - node has larger oid */
-		return p;
-	    } else if (((len && p->subid != oid[0]) || force) && p->syntax) {
-		/* no match - forced to use this node */
-		return p;
-	    } else {
-		/* force next node */
-		force = 1;
-	    }
+    if (FindChild(parentPtr, oid[0], &index)) {
+	if (parentPtr->children[index]->provider) {
+	    return parentPtr->children[index];
 	}
-	p = p->nextPtr;
+	inst = FindNextNode(parentPtr->children[index], oid + 1, len - 1);
+	if (inst) {
+	    return inst;
+	}
+	index++;
     }
 
-    return NULL;
+    return FirstNode(parentPtr, index);
 }
 
 /*
@@ -319,19 +540,17 @@ FindNextNode(TnmSnmpNode *root, u_int *oid, int len)
 static TnmSnmpNode*
 FindNode(TnmSnmpNode *root, TnmOid *oidPtr)
 {
-    TnmSnmpNode *p, *q = NULL;
-    int i;
+    TnmSnmpNode *p;
+    int i, index, len = TnmOidGetLength(oidPtr);
     
-    if (TnmOidGet(oidPtr, 0) != 1) return NULL;
-    for (p = root, i = 1; p && i < TnmOidGetLength(oidPtr); p = q, i++) {
-	for (q = p->childPtr; q; q = q->nextPtr) {
-	    if (q->subid == TnmOidGet(oidPtr, i)) break;
-	}
-	if (!q) {
-	    return NULL; 
+    if (! root || len < 2 || TnmOidGet(oidPtr, 0) != 1) return NULL;
+    for (p = root, i = 1; i < len; i++) {
+	if (! FindChild(p, TnmOidGet(oidPtr, i), &index)) {
+	    return NULL;
 	}
+	p = p->children[index];
     }
-    return q;
+    return p;
 }
 
 /*
@@ -340,7 +559,8 @@ FindNode(TnmSnmpNode *root, TnmOid *oidPtr)
  * RemoveNode --
  *
  *	This procedure removes all nodes from the tree that are 
- *	associated with a given Tcl variable.
+ *	associated with a given Tcl variable. Nodes which still
+ *	have children are kept as intermediate nodes.
  *
  * Results:
  *	None.
@@ -352,28 +572,35 @@ FindNode(TnmSnmpNode *root, TnmOid *oidPtr)
  */
 
 static void
-RemoveNode(TnmSnmpNode *root, char *varName)
+RemoveNode(char *varName)
 {
+    Tcl_HashEntry *entryPtr;
     TnmSnmpNode *p, *q;
 
-    if (!root) return;
-
-    for (p = root; p; p = p->nextPtr) {
-	if (p->childPtr) {
-	    q = p->childPtr;
-	    RemoveNode(q, varName);
-	    if (q->tclVarName && (strcmp(q->tclVarName, varName) == 0)) {
-		p->childPtr = q->nextPtr;
-		FreeNode(q);
-	    }
-	}
-	if (p->nextPtr) {
-	    q = p->nextPtr;
-	    if (q->tclVarName && (strcmp(q->tclVarName, varName) == 0)) {
-		p->nextPtr = q->nextPtr;
-		FreeNode(q);
+    if (! instTree) return;
+
+    entryPtr = Tcl_FindHashEntry(&varTable, varName);
+    if (! entryPtr) return;
+
+    p = (TnmSnmpNode *) Tcl_GetHashValue(entryPtr);
+    Tcl_DeleteHashEntry(entryPtr);
+
+    for (; p; p = q) {
+	q = p->varNextPtr;
+	p->varNextPtr = NULL;
+	ckfree(p->tclVarName);
+	p->tclVarName = NULL;
+	p->syntax = 0;
+	p->access = 0;
+	while (p->bindings) {
+	    TnmSnmpBinding *bindPtr = p->bindings;
+	    p->bindings = bindPtr->nextPtr;
+	    if (bindPtr->command) {
+		ckfree(bindPtr->command);
 	    }
+	    ckfree((char *) bindPtr);
 	}
+	PruneNode(p);
     }
 }
 
@@ -418,7 +645,7 @@ DeleteNodeProc(clientData, interp, name1, name2, flags)
 	strcat(varName,")");
     }
 
-    RemoveNode(instTree, varName);
+    RemoveNode(varName);
     ckfree(varName);
     return NULL;
 }
@@ -598,11 +825,351 @@ TnmSnmpFindNode(TnmSnmp *session, TnmOid *oidPtr)
 TnmSnmpNode*
 TnmSnmpFindNextNode(TnmSnmp *session, TnmOid *oidPtr)
 {
+    u_int *oid = TnmOidGetElements(oidPtr);
+    int len = TnmOidGetLength(oidPtr);
+
 #if 0
     DumpTree(instTree);
 #endif
-    return FindNextNode(instTree, TnmOidGetElements(oidPtr), 
-			TnmOidGetLength(oidPtr));
+    if (! instTree || (len > 0 && oid[0] > 1)) {
+	return NULL;
+    }
+    if (len == 0 || oid[0] < 1) {
+	return FirstNode(instTree, 0);
+    }
+    return FindNextNode(instTree, oid + 1, len - 1);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * TnmSnmpNextNode --
+ *
+ *	This procedure locates the instance which follows a given
+ *	instance in the instance tree. It walks up the parent nodes
+ *	and is used to iterate over a range of instances without
+ *	searching the tree from the root for every step. The subtree
+ *	of a provider is skipped.
+ *
+ * Results:
+ *	A pointer to the node or NULL if there is no next node.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+TnmSnmpNode*
+TnmSnmpNextNode(TnmSnmp *session, TnmSnmpNode *inst)
+{
+    TnmSnmpNode *p, *q;
+    int index;
+
+    if (! inst->provider) {
+	q = FirstNode(inst, 0);
+	if (q) {
+	    return q;
+	}
+    }
+    for (p = inst->parentPtr; p; inst = p, p = p->parentPtr) {
+	if (FindChild(p, inst->subid, &index)) {
+	    index++;
+	}
+	q = FirstNode(p, index);
+	if (q) {
+	    return q;
+	}
+    }
+    return NULL;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * TnmSnmpNodeEpoch --
+ *
+ *	This procedure returns the current epoch of the instance
+ *	tree. Pointers to nodes obtained in an earlier epoch may
+ *	refer to nodes which have been freed.
+ *
+ * Results:
+ *	The current epoch.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+unsigned int
+TnmSnmpNodeEpoch(void)
+{
+    return nodeEpoch;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * TnmSnmpFindProvider --
+ *
+ *	This procedure locates the provider which owns the subtree
+ *	that contains the given oid.
+ *
+ * Results:
+ *	A pointer to the node of the provider or NULL if the oid
+ *	is not owned by a provider.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+TnmSnmpNode*
+TnmSnmpFindProvider(TnmSnmp *session, TnmOid *oidPtr)
+{
+    TnmSnmpNode *p;
+    int i, index, len = TnmOidGetLength(oidPtr);
+
+    if (! instTree || len < 2 || TnmOidGet(oidPtr, 0) != 1) return NULL;
+    for (p = instTree, i = 1; i < len; i++) {
+	if (! FindChild(p, TnmOidGet(oidPtr, i), &index)) {
+	    return NULL;
+	}
+	p = p->children[index];
+	if (p->provider) {
+	    return p;
+	}
+    }
+    return NULL;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * TnmSnmpCreateProvider --
+ *
+ *	This procedure installs a provider for the subtree identified
+ *	by oidPtr. An existing provider for the same subtree is
+ *	replaced.
+ *
+ * Results:
+ *	A standard Tcl result.
+ *
+ * Side effects:
+ *	The delete procedure of a replaced provider is called.
+ *
+ *----------------------------------------------------------------------
+ */
+
+int
+TnmSnmpCreateProvider(TnmOid *oidPtr, TnmSnmpProviderProc *proc, TnmSnmpProviderDeleteProc *deleteProc, ClientData clientData)
+{
+    TnmSnmpNode *node;
+    TnmSnmpProvider *provider;
+
+    node = FindNode(instTree, oidPtr);
+    if (! node) {
+	node = AddNode(ckstrdup(TnmOidToString(oidPtr)), 0, 0, 0, NULL);
+	if (! node || node == instTree) {
+	    return TCL_ERROR;
+	}
+    }
+
+    provider = (TnmSnmpProvider *) ckalloc(sizeof(TnmSnmpProvider));
+    provider->proc = proc;
+    provider->deleteProc = deleteProc;
+    provider->clientData = clientData;
+
+    if (node->provider) {
+	if (node->provider->deleteProc) {
+	    node->provider->deleteProc(node->provider->clientData);
+	}
+	ckfree((char *) node->provider);
+    }
+    node->provider = provider;
+    nodeEpoch++;
+    return TCL_OK;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * TnmSnmpDeleteProvider --
+ *
+ *	This procedure removes the provider for the subtree
+ *	identified by oidPtr.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	The delete procedure of the provider is called.
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+TnmSnmpDeleteProvider(TnmOid *oidPtr)
+{
+    TnmSnmpNode *node = FindNode(instTree, oidPtr);
+    TnmSnmpProvider *provider;
+
+    if (node && node->provider) {
+	provider = node->provider;
+	node->provider = NULL;
+	nodeEpoch++;
+	if (provider->deleteProc) {
+	    provider->deleteProc(provider->clientData);
+	}
+	ckfree((char *) provider);
+	PruneNode(node);
+    }
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * TclProviderProc --
+ *
+ *	This procedure implements providers written in Tcl. The
+ *	command prefix is invoked with the arguments "get oid" or
+ *	"next oid count" and returns a varbind list.
+ *
+ * Results:
+ *	A standard Tcl result.
+ *
+ * Side effects:
+ *	Whatever the Tcl command does.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+TclProviderProc(Tcl_Interp *interp, TnmSnmp *session, int type, TnmOid *oidPtr, int count, TnmSnmpVarBindList *vblPtr, ClientData clientData)
+{
+    Tcl_Obj *cmdPtr = Tcl_DuplicateObj((Tcl_Obj *) clientData);
+    TnmSnmpVarBindList *resPtr;
+    int code;
+
+    Tcl_IncrRefCount(cmdPtr);
+    Tcl_ListObjAppendElement(NULL, cmdPtr, Tcl_NewStringObj(
+	(type == ASN1_SNMP_GET) ? "get" : "next", -1));
+    Tcl_ListObjAppendElement(NULL, cmdPtr,
+			     Tcl_NewStringObj(TnmOidToString(oidPtr), -1));
+    if (type != ASN1_SNMP_GET) {
+	Tcl_ListObjAppendElement(NULL, cmdPtr, Tcl_NewIntObj(count));
+    }
+    code = Tcl_EvalObjEx(interp, cmdPtr, TCL_EVAL_GLOBAL);
+    Tcl_DecrRefCount(cmdPtr);
+    if (code == TCL_ERROR) {
+	return TCL_ERROR;
+    }
+
+    resPtr = TnmSnmpGetVarBindListFromObj(interp, Tcl_GetObjResult(interp),
+					  ASN1_SNMP_SET);
+    if (! resPtr) {
+	return TCL_ERROR;
+    }
+    TnmSnmpAppendVarBinds(vblPtr, resPtr, 0, count);
+    TnmSnmpReleaseVarBindList(resPtr);
+    Tcl_ResetResult(interp);
+    return TCL_OK;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * TclProviderDeleteProc --
+ *
+ *	This procedure releases the command prefix of a provider
+ *	written in Tcl.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+TclProviderDeleteProc(ClientData clientData)
+{
+    Tcl_DecrRefCount((Tcl_Obj *) clientData);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * TnmSnmpSetTclProvider --
+ *
+ *	This procedure installs a Tcl command prefix as the provider
+ *	for the subtree identified by oidPtr. An empty command prefix
+ *	removes the provider.
+ *
+ * Results:
+ *	A standard Tcl result.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+int
+TnmSnmpSetTclProvider(Tcl_Interp *interp, TnmOid *oidPtr, Tcl_Obj *cmdPrefix)
+{
+    int length;
+
+    if (Tcl_ListObjLength(interp, cmdPrefix, &length) != TCL_OK) {
+	return TCL_ERROR;
+    }
+    if (length == 0) {
+	TnmSnmpDeleteProvider(oidPtr);
+	return TCL_OK;
+    }
+
+    cmdPrefix = Tcl_DuplicateObj(cmdPrefix);
+    Tcl_IncrRefCount(cmdPrefix);
+    if (TnmSnmpCreateProvider(oidPtr, TclProviderProc, TclProviderDeleteProc,
+			      (ClientData) cmdPrefix) != TCL_OK) {
+	Tcl_DecrRefCount(cmdPrefix);
+	Tcl_AppendResult(interp, "illegal provider subtree \"",
+			 TnmOidToString(oidPtr), "\"", (char *) NULL);
+	return TCL_ERROR;
+    }
+    return TCL_OK;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * TnmSnmpGetTclProvider --
+ *
+ *	This procedure retrieves the Tcl command prefix of the
+ *	provider for the subtree identified by oidPtr.
+ *
+ * Results:
+ *	The command prefix or NULL if there is no Tcl provider.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+Tcl_Obj*
+TnmSnmpGetTclProvider(TnmOid *oidPtr)
+{
+    TnmSnmpNode *node = FindNode(instTree, oidPtr);
+
+    if (node && node->provider && node->provider->proc == TclProviderProc) {
+	return (Tcl_Obj *) node->provider->clientData;
+    }
+    return NULL;
 }
 
 /*
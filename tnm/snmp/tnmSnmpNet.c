@@ -16,6 +16,17 @@
 #include <config.h>
 #endif
 
+/*
+ * recvmmsg() and sendmmsg() are only declared by glibc if we ask
+ * for the GNU extensions.
+ */
+
+#if defined(HAVE_RECVMMSG) || defined(HAVE_SENDMMSG)
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#endif
+
 #include "tnmSnmp.h"
 
 /*
@@ -25,11 +36,24 @@
 extern int hexdump;		/* flag that controls hexdump */
 
 /*
- * Shared socket used for all asynchronous messages send out by this
- * manager or agent.
+ * Shared sockets used for all asynchronous messages send out by this
+ * manager or agent. Messages are distributed over the sockets by a
+ * hash of the destination address so that all messages exchanged with
+ * an agent use the same socket. The first socket is also available as
+ * asyncSocket. The interpreter used to process responses is kept in
+ * managerInterp.
  */
 
 static TnmSnmpSocket *asyncSocket = NULL;
+static TnmSnmpSocket *asyncSockets[TNM_SNMP_SOCKETS_MAX];
+static int numAsyncSockets = 0;
+static Tcl_Interp *managerInterp = NULL;
+
+/*
+ * The configuration of the asynchronous manager sockets.
+ */
+
+TnmSnmpManager tnmSnmpManager = { 1, 0, 0 };
 
 /*
  * Shared socket used for all synchronous manager initiated 
@@ -38,12 +62,107 @@ static TnmSnmpSocket *asyncSocket = NULL;
 
 static TnmSnmpSocket *syncSocket = NULL;
 
+/*
+ * The number of engine threads which receive the datagrams sent to
+ * the manager socket. The datagrams are received by the event loop
+ * if this is 0.
+ */
+
+static int engineThreads = 0;
+
 /*
  * The list of all shared sockets maintained in this module.
  */
 
 TnmSnmpSocket *tnmSnmpSocketList = NULL;
 
+/*
+ * The bucket used to pace the messages sent by all sessions. The
+ * buckets fill up for at most BUCKET_BURST milliseconds so that a
+ * bucket can catch up with the granularity of the event loop but
+ * does not release long bursts after an idle period.
+ */
+
+TnmSnmpBucket tnmSnmpBucket;
+
+#define BUCKET_BURST	10
+
+/*
+ * The retransmission timers of all asynchronous requests are kept
+ * in a hierarchical timer wheel with a resolution of one millisecond.
+ * Each level has TIMER_SLOTS slots and covers TIMER_SLOTS times the
+ * range of the level below. Timers move down one level whenever the
+ * lower level wraps around. The wheel is driven by a single Tcl timer
+ * handler which is scheduled for the next point in time where the
+ * wheel has work to do.
+ */
+
+#define TIMER_BITS	6
+#define TIMER_SLOTS	(1 << TIMER_BITS)
+#define TIMER_MASK	(TIMER_SLOTS - 1)
+#define TIMER_LEVELS	4
+#define TIMER_RANGE	(((Tcl_WideInt) 1 << (TIMER_BITS * TIMER_LEVELS)) - 1)
+
+typedef struct TimerWheel {
+    TnmSnmpRequest *slots[TIMER_LEVELS][TIMER_SLOTS];
+    int count[TIMER_LEVELS];	/* Number of timers on each level. */
+    Tcl_WideInt now;		/* Time (ms) the wheel has advanced to. */
+    Tcl_WideInt wakeup;		/* Time (ms) the Tcl timer is set for. */
+    Tcl_TimerToken token;	/* The Tcl timer driving the wheel. */
+} TimerWheel;
+
+static TimerWheel timerWheel;
+
+/*
+ * Datagrams are read from a socket in batches of up to RECV_BATCH
+ * datagrams per readable event if recvmmsg() is available. The
+ * datagrams of a batch are kept with the socket and processed one
+ * after the other. Callbacks may re-enter the event loop, so the
+ * event handlers always continue with the next unprocessed datagram
+ * of the batch before reading a new batch.
+ */
+
+#ifdef HAVE_RECVMMSG
+#define RECV_BATCH	16
+#else
+#define RECV_BATCH	1
+#endif
+
+typedef struct TnmSnmpBatch {
+    int count;			/* Number of datagrams in the batch. */
+    int next;			/* Index of the next datagram to process. */
+    int length[RECV_BATCH];	/* The length of each datagram. */
+    struct sockaddr_in from[RECV_BATCH];	/* The sender addresses. */
+    u_char packet[RECV_BATCH][TNM_SNMP_MAXSIZE];
+} TnmSnmpBatch;
+
+/*
+ * Asynchronous messages sent to the manager socket are queued and
+ * sent in batches with sendmmsg() if it is available. The queue is
+ * flushed when it is full, when a batch of received datagrams has
+ * been processed, when the event loop becomes idle and when the
+ * application exits.
+ */
+
+#define SEND_BATCH	32
+#define SEND_BUFFER	65536
+
+typedef struct SendQueue {
+    int count;			/* Number of queued messages. */
+    int used;			/* Number of buffer bytes used. */
+    int idle;			/* Idle handler has been scheduled. */
+    int exit;			/* Exit handler has been created. */
+    int sock[SEND_BATCH];	/* The socket used for each message. */
+    int offset[SEND_BATCH];	/* Offset of each message in the buffer. */
+    int length[SEND_BATCH];	/* Length of each message. */
+    struct sockaddr_in to[SEND_BATCH];	/* Destination addresses. */
+    u_char buffer[SEND_BUFFER];	/* The messages. */
+} SendQueue;
+
+#ifdef HAVE_SENDMMSG
+static SendQueue *sendQueue = NULL;
+#endif
+
 /*
  * A global variable for performance measurements.
  */
@@ -62,10 +181,59 @@ ResponseProc		(ClientData clientData, int mask);
 static void
 AgentProc		(ClientData clientData, int mask);
 
+static void
+FreeSocket		(char *memPtr);
+
+static TnmSnmpSocket*
+CreateSocket		(Tcl_Interp *interp, struct sockaddr_in *addr,
+				     int reuse, int rcvbuf);
+static TnmSnmpSocket*
+ManagerSocket		(struct sockaddr_in *to);
+
+static int
+OpenManagerSockets	(Tcl_Interp *interp);
+
+static void
+CloseManagerSockets	(void);
+
+static int
+StartReceivers		(Tcl_Interp *interp);
+
+static void
+StopReceivers		(void);
+
 static int
-AgentRecv		(Tcl_Interp *interp, TnmSnmp *session,
+SocketRecv		(Tcl_Interp *interp, TnmSnmpSocket *sockPtr,
 				     u_char *packet, int *packetlen,
 				     struct sockaddr_in *from);
+static int
+BatchRecv		(Tcl_Interp *interp, TnmSnmpSocket *sockPtr);
+
+#ifdef HAVE_SENDMMSG
+static int
+QueueSend		(int sock, u_char *packet, int packetlen,
+				     struct sockaddr_in *to);
+static void
+FlushIdleProc		(ClientData clientData);
+
+static void
+FlushExitProc		(ClientData clientData);
+#endif
+
+static Tcl_WideInt
+TimerNow		(void);
+
+static void
+TimerInsert		(TnmSnmpRequest *request);
+
+static void
+TimerCascade		(int level);
+
+static void
+TimerSchedule		(void);
+
+static void
+TimerProc		(ClientData clientData);
 
 
 /*
@@ -93,7 +261,7 @@ TnmSnmpOpen(Tcl_Interp *interp, struct sockaddr_in *addr)
 {
     TnmSnmpSocket *sockPtr;
     struct sockaddr_in name;
-    int code, socket;
+    int code;
     socklen_t namelen = sizeof(name);
 
     /*
@@ -109,10 +277,35 @@ TnmSnmpOpen(Tcl_Interp *interp, struct sockaddr_in *addr)
 	}
     }
 
-    /*
-     * Create a new socket for this transport endpoint and set up
-     * a Tcl filehandler to handle incoming messages.
-     */
+    return CreateSocket(interp, addr, 0, 0);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * CreateSocket --
+ *
+ *	This procedure opens a new SNMP socket for a transport
+ *	endpoint. The socket may share the port with other sockets
+ *	if reuse is set and the system supports SO_REUSEPORT. The
+ *	receive buffer is set to rcvbuf bytes if rcvbuf is not 0.
+ *
+ * Results:
+ *	A pointer to the new socket or NULL if the socket can't be
+ *	opened. An error message is left in interp->result if interp
+ *	is not a NULL pointer.
+ * 
+ * Side effects:
+ *	A real socket is opened.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static TnmSnmpSocket *
+CreateSocket(Tcl_Interp *interp, struct sockaddr_in *addr, int reuse, int rcvbuf)
+{
+    TnmSnmpSocket *sockPtr;
+    int code, socket;
 
     socket = TnmSocket(AF_INET, SOCK_DGRAM, 0);
     if (socket == TNM_SOCKET_ERROR) {
@@ -123,6 +316,18 @@ TnmSnmpOpen(Tcl_Interp *interp, struct sockaddr_in *addr)
         return NULL;
     }
 
+#ifdef SO_REUSEPORT
+    if (reuse) {
+        int on = 1;
+	setsockopt(socket, SOL_SOCKET, SO_REUSEPORT, (char *) &on, sizeof(on));
+    }
+#endif
+
+    if (rcvbuf > 0) {
+	setsockopt(socket, SOL_SOCKET, SO_RCVBUF,
+		   (char *) &rcvbuf, sizeof(rcvbuf));
+    }
+
     code = TnmSocketBind(socket, (struct sockaddr *) addr, sizeof(*addr));
     if (code == TNM_SOCKET_ERROR) {
 	if (interp) {
@@ -162,7 +367,8 @@ TnmSnmpOpen(Tcl_Interp *interp, struct sockaddr_in *addr)
  *	None.
  * 
  * Side effects:
- *	A real socket might be closed.
+ *	A real socket might be closed. Queued messages are sent
+ *	before the manager socket is closed.
  *
  *----------------------------------------------------------------------
  */
@@ -176,14 +382,46 @@ TnmSnmpClose(TnmSnmpSocket *sockPtr)
 
     sockPtr->refCount--;
     if (sockPtr->refCount == 0) {
+	if (sockPtr == asyncSocket) {
+	    TnmSnmpFlush();
+	}
 	TnmDeleteSocketHandler(sockPtr->sock);
 	TnmSocketClose(sockPtr->sock);
 	while (*sockPtrPtr != sockPtr) {
 	    sockPtrPtr = &(*sockPtrPtr)->nextPtr;
 	}
 	*sockPtrPtr = sockPtr->nextPtr;
-	ckfree((char *) sockPtr);
+	Tcl_EventuallyFree((ClientData) sockPtr, FreeSocket);
+    }
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * FreeSocket --
+ *
+ *	This procedure frees a shared SNMP socket once it is not
+ *	used anymore by any event handler. Datagrams which have not
+ *	been processed yet are discarded.
+ *
+ * Results:
+ *	None.
+ * 
+ * Side effects:
+ *	Memory is freed.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+FreeSocket(char *memPtr)
+{
+    TnmSnmpSocket *sockPtr = (TnmSnmpSocket *) memPtr;
+
+    if (sockPtr->batchPtr) {
+	ckfree((char *) sockPtr->batchPtr);
     }
+    ckfree((char *) sockPtr);
 }
 
 /*
@@ -287,48 +525,174 @@ TnmSnmpWait(int ms, int flags)
 /*
  *----------------------------------------------------------------------
  *
- * TnmSnmpDelay --
+ * TnmSnmpBucketWait --
  *
- *	This procedure enforces a small delay if the delay option
- *	of the session is set to value greater than 0.
+ *	This procedure refills a token bucket and computes how long
+ *	a message of the given length has to wait before it may be
+ *	sent without violating the limits of the bucket.
  *
  * Results:
- *	None.
- * 
+ *	The number of milliseconds to wait or 0 if the message can
+ *	be sent right away.
+ *
  * Side effects:
+ *	The tokens of the bucket are updated.
+ *
+ *----------------------------------------------------------------------
+ */
+
+int
+TnmSnmpBucketWait(TnmSnmpBucket *bucketPtr, int length)
+{
+    Tcl_Time time;
+    Tcl_WideInt now;
+    double wait = 0, burst;
+
+    if (! bucketPtr->rate && ! bucketPtr->byteRate && ! bucketPtr->delay) {
+	return 0;
+    }
+
+    Tcl_GetTime(&time);
+    now = (Tcl_WideInt) time.sec * 1000000 + time.usec;
+
+    /*
+     * Refill the bucket. A bucket that has not been used before
+     * (or which has been reconfigured) starts full.
+     */
+
+    if (bucketPtr->rate) {
+	burst = (double) bucketPtr->rate * BUCKET_BURST / 1000;
+	if (burst < 1) burst = 1;
+	if (bucketPtr->stamp) {
+	    bucketPtr->tokens += (double) (now - bucketPtr->stamp)
+		* bucketPtr->rate / 1000000;
+	}
+	if (! bucketPtr->stamp || bucketPtr->tokens > burst) {
+	    bucketPtr->tokens = burst;
+	}
+	if (bucketPtr->tokens < 1) {
+	    wait = (1 - bucketPtr->tokens) * 1000 / bucketPtr->rate;
+	}
+    }
+
+    if (bucketPtr->byteRate) {
+	burst = (double) bucketPtr->byteRate * BUCKET_BURST / 1000;
+	if (bucketPtr->stamp) {
+	    bucketPtr->byteTokens += (double) (now - bucketPtr->stamp)
+		* bucketPtr->byteRate / 1000000;
+	}
+	if (! bucketPtr->stamp || bucketPtr->byteTokens > burst) {
+	    bucketPtr->byteTokens = burst;
+	}
+	if (bucketPtr->byteTokens < 0
+	    && -bucketPtr->byteTokens * 1000 / bucketPtr->byteRate > wait) {
+	    wait = -bucketPtr->byteTokens * 1000 / bucketPtr->byteRate;
+	}
+    }
+
+    if (bucketPtr->delay && bucketPtr->last) {
+	double delta = bucketPtr->delay
+	    - (double) (now - bucketPtr->last) / 1000;
+	if (delta > wait) {
+	    wait = delta;
+	}
+    }
+
+    bucketPtr->stamp = now;
+    return (wait > 0) ? (int) wait + 1 : 0;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * TnmSnmpBucketTake --
+ *
+ *	This procedure takes the tokens for a message of the given
+ *	length out of a token bucket. It must be called after
+ *	TnmSnmpBucketWait() has returned 0 for the message.
+ *
+ * Results:
  *	None.
  *
+ * Side effects:
+ *	The tokens of the bucket are updated.
+ *
  *----------------------------------------------------------------------
  */
 
 void
-TnmSnmpDelay(TnmSnmp *session)
+TnmSnmpBucketTake(TnmSnmpBucket *bucketPtr, int length)
 {
-    static Tcl_Time lastTimeStamp;
-    Tcl_Time currentTime;
-    int delta, wtime;
-
-    if (session->delay <= 0) return;
+    bucketPtr->tokens -= 1;
+    bucketPtr->byteTokens -= length;
+    bucketPtr->last = bucketPtr->stamp;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * TnmSnmpPace --
+ *
+ *	This procedure checks whether a message of the given length
+ *	may be sent by a session. The message must pass the bucket
+ *	of the session as well as the global bucket. The tokens are
+ *	taken from both buckets if the message can be sent.
+ *
+ * Results:
+ *	The number of milliseconds to wait or 0 if the message can
+ *	be sent right away.
+ *
+ * Side effects:
+ *	The tokens of the buckets are updated.
+ *
+ *----------------------------------------------------------------------
+ */
 
-    Tcl_GetTime(&currentTime);
+int
+TnmSnmpPace(TnmSnmp *session, int length)
+{
+    int wait, globalWait;
 
-    if (lastTimeStamp.sec == 0 && lastTimeStamp.usec == 0) {
-	lastTimeStamp = currentTime;
-	return;
+    wait = TnmSnmpBucketWait(&session->bucket, length);
+    globalWait = TnmSnmpBucketWait(&tnmSnmpBucket, length);
+    if (wait || globalWait) {
+	return (wait > globalWait) ? wait : globalWait;
     }
 
-    delta = (currentTime.sec - lastTimeStamp.sec) * 1000 
-	    + (currentTime.usec - lastTimeStamp.usec) / 1000;
-    wtime = session->delay - delta;
+    TnmSnmpBucketTake(&session->bucket, length);
+    TnmSnmpBucketTake(&tnmSnmpBucket, length);
+    return 0;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * TnmSnmpDelay --
+ *
+ *	This procedure blocks until a message of the given length
+ *	may be sent by a session. It is only used for synchronous
+ *	requests which block the application anyway. Asynchronous
+ *	requests are paced by the request scheduler.
+ *
+ * Results:
+ *	None.
+ * 
+ * Side effects:
+ *	The tokens of the buckets are updated.
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+TnmSnmpDelay(TnmSnmp *session, int length)
+{
+    struct timeval timeout;
+    int wait;
 
-    if (wtime <= 0) {
-	lastTimeStamp = currentTime;
-    } else {
-	struct timeval timeout;
-	timeout.tv_usec = (wtime * 1000) % 1000000;
-	timeout.tv_sec = (wtime * 1000) / 1000000;
+    while ((wait = TnmSnmpPace(session, length)) > 0) {
+	timeout.tv_sec = wait / 1000;
+	timeout.tv_usec = (wait % 1000) * 1000;
 	select(0, (fd_set *) NULL, (fd_set *) NULL, (fd_set *) NULL, &timeout);
-	Tcl_GetTime(&lastTimeStamp);
     }
 }
 
@@ -337,7 +701,7 @@ TnmSnmpDelay(TnmSnmp *session)
  *
  * TnmSnmpManagerOpen --
  *
- *	This procedure creates a socket used for normal management
+ *	This procedure creates the sockets used for normal management
  *	communication.
  *
  * Results:
@@ -364,13 +728,11 @@ TnmSnmpManagerOpen(Tcl_Interp *interp)
 	    return TCL_ERROR;
 	}
     }
-    if (! asyncSocket) {
-	asyncSocket = TnmSnmpOpen(interp, &addr);
-	if (! asyncSocket) {
+    if (! numAsyncSockets) {
+	managerInterp = interp;
+	if (OpenManagerSockets(interp) != TCL_OK) {
 	    return TCL_ERROR;
 	}
-	TnmCreateSocketHandler(asyncSocket->sock, TCL_READABLE, 
-			       ResponseProc, (ClientData) interp);
     }
     return TCL_OK;
 }
@@ -380,13 +742,14 @@ TnmSnmpManagerOpen(Tcl_Interp *interp)
  *
  * TnmSnmpManagerClose --
  *
- *	This procedure closes the shared manager socket.
+ *	This procedure closes the shared manager sockets.
  *
  * Results:
  *	None.
  *
  * Side effects:
- *	None.
+ *	The engine threads are stopped and responses which have not
+ *	been dispatched yet are discarded.
  *
  *----------------------------------------------------------------------
  */
@@ -394,8 +757,9 @@ TnmSnmpManagerOpen(Tcl_Interp *interp)
 void
 TnmSnmpManagerClose()
 {
-    TnmSnmpClose(asyncSocket);
-    asyncSocket = NULL;
+    CloseManagerSockets();
+    TnmSnmpEngineDiscard();
+    managerInterp = NULL;
     TnmSnmpClose(syncSocket);
     syncSocket = NULL;
 }
@@ -403,109 +767,132 @@ TnmSnmpManagerClose()
 /*
  *----------------------------------------------------------------------
  *
- * TnmSnmpResponderOpen --
+ * TnmSnmpManagerReopen --
  *
- *	This procedure creates a socket for a command responder session
- *	on a given port. If an agent socket is already created, we close
- *	the socket and open a new one.
+ *	This procedure reopens the asynchronous manager sockets after
+ *	the configuration in tnmSnmpManager has been changed. Requests
+ *	which are still waiting for a response are retransmitted on
+ *	the new sockets.
  *
  * Results:
  *	A standard Tcl result.
  *
  * Side effects:
- *	None.
+ *	Sockets are closed and opened.
  *
  *----------------------------------------------------------------------
  */
 
 int
-TnmSnmpResponderOpen(Tcl_Interp *interp, TnmSnmp *session)
+TnmSnmpManagerReopen(Tcl_Interp *interp)
 {
-    if (session->socket) {
-	TnmSnmpClose(session->socket);
+    if (! numAsyncSockets) {
+	return TCL_OK;
     }
-    session->socket = TnmSnmpOpen(interp, &session->maddr);
-    if (! session->socket) {
+    CloseManagerSockets();
+    if (OpenManagerSockets(managerInterp) != TCL_OK) {
+	if (interp != managerInterp) {
+	    Tcl_SetObjResult(interp, Tcl_GetObjResult(managerInterp));
+	}
 	return TCL_ERROR;
     }
-    TnmCreateSocketHandler(session->socket->sock, TCL_READABLE,
-			   AgentProc, (ClientData) session);
     return TCL_OK;
 }
 
 /*
  *----------------------------------------------------------------------
  *
- * TnmSnmpResponderClose --
+ * OpenManagerSockets --
  *
- *	This procedure closes the socket for incoming requests.
+ *	This procedure opens the asynchronous manager sockets as
+ *	configured in tnmSnmpManager. The sockets share the same
+ *	port if a port is configured for more than one socket.
  *
  * Results:
- *	None.
+ *	A standard Tcl result.
  *
  * Side effects:
- *	None.
+ *	Sockets are opened and the receivers are started.
  *
  *----------------------------------------------------------------------
  */
 
-void
-TnmSnmpResponderClose(TnmSnmp *session)
+static int
+OpenManagerSockets(Tcl_Interp *interp)
 {
-    if (session->socket) {
-	TnmSnmpClose(session->socket);
+    struct sockaddr_in addr;
+    int i, reuse;
+
+    memset((char *) &addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons((unsigned short) tnmSnmpManager.port);
+    addr.sin_addr.s_addr = INADDR_ANY;
+    reuse = (tnmSnmpManager.port && tnmSnmpManager.sockets > 1);
+
+    for (i = 0; i < tnmSnmpManager.sockets; i++) {
+	TnmSnmpSocket *sockPtr;
+	sockPtr = CreateSocket(interp, &addr, reuse, tnmSnmpManager.rcvbuf);
+	if (! sockPtr) {
+	    CloseManagerSockets();
+	    return TCL_ERROR;
+	}
+	asyncSockets[numAsyncSockets++] = sockPtr;
     }
-    session->socket = NULL;
+    asyncSocket = asyncSockets[0];
+
+    if (StartReceivers(interp) != TCL_OK) {
+	CloseManagerSockets();
+	return TCL_ERROR;
+    }
+    return TCL_OK;
 }
 
 /*
  *----------------------------------------------------------------------
  *
- * TnmSnmpListenerOpen --
+ * CloseManagerSockets --
  *
- *	This procedure creates a socket for a notification listener
- *	on a given port. If an socket is already created, we close
- *	the socket and open a new one.
+ *	This procedure closes the asynchronous manager sockets after
+ *	sending all queued messages.
  *
  * Results:
- *	A standard Tcl result.
+ *	None.
  *
  * Side effects:
- *	None.
+ *	Sockets are closed and the receivers are stopped.
  *
  *----------------------------------------------------------------------
  */
 
-int
-TnmSnmpListenerOpen(Tcl_Interp *interp, TnmSnmp *session)
+static void
+CloseManagerSockets(void)
 {
-#ifdef _TNMUNIXPORT
-    if (ntohs(session->maddr.sin_port) == TNM_SNMP_TRAPPORT) {
-	return TnmSnmpNmtrapdOpen(interp);
-    }
-#endif
-    
-    if (session->socket) {
-	TnmSnmpClose(session->socket);
+    int i;
+
+    if (! numAsyncSockets) {
+	return;
     }
-    session->socket = TnmSnmpOpen(interp, &session->maddr);
-    if (! session->socket) {
-	return TCL_ERROR;
+
+    TnmSnmpFlush();
+    StopReceivers();
+    for (i = 0; i < numAsyncSockets; i++) {
+	TnmSnmpClose(asyncSockets[i]);
+	asyncSockets[i] = NULL;
     }
-    TnmCreateSocketHandler(session->socket->sock, TCL_READABLE,
-			   AgentProc, (ClientData) session);
-    return TCL_OK;
+    numAsyncSockets = 0;
+    asyncSocket = NULL;
 }
 
 /*
  *----------------------------------------------------------------------
  *
- * TnmSnmpListenerClose --
+ * ManagerSocket --
  *
- *	This procedure closes the socket for incoming notifications.
+ *	This procedure selects the asynchronous manager socket used
+ *	to send a message to the destination address to.
  *
  * Results:
- *	None.
+ *	A pointer to the socket or NULL if there is no open socket.
  *
  * Side effects:
  *	None.
@@ -513,205 +900,1091 @@ TnmSnmpListenerOpen(Tcl_Interp *interp, TnmSnmp *session)
  *----------------------------------------------------------------------
  */
 
-void
+static TnmSnmpSocket*
+ManagerSocket(struct sockaddr_in *to)
+{
+    unsigned int hash;
+
+    if (numAsyncSockets < 2) {
+	return asyncSocket;
+    }
+
+    hash = (unsigned int) to->sin_addr.s_addr * 2654435761U;
+    hash ^= (unsigned int) to->sin_port * 40503U;
+    return asyncSockets[(hash >> 8) % numAsyncSockets];
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * StartReceivers --
+ *
+ *	This procedure starts to receive the responses sent to the
+ *	asynchronous manager sockets, either by the event loop or
+ *	by engine threads.
+ *
+ * Results:
+ *	A standard Tcl result.
+ *
+ * Side effects:
+ *	Event handlers are created or engine threads are started.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+StartReceivers(Tcl_Interp *interp)
+{
+    int i;
+
+    if (engineThreads) {
+	int socks[TNM_SNMP_SOCKETS_MAX];
+	for (i = 0; i < numAsyncSockets; i++) {
+	    socks[i] = asyncSockets[i]->sock;
+	}
+	return TnmSnmpEngineStart(interp, socks, numAsyncSockets,
+				  engineThreads);
+    }
+
+    for (i = 0; i < numAsyncSockets; i++) {
+	TnmCreateSocketHandler(asyncSockets[i]->sock, TCL_READABLE, 
+			       ResponseProc, (ClientData) asyncSockets[i]);
+    }
+    return TCL_OK;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * StopReceivers --
+ *
+ *	This procedure stops to receive the responses sent to the
+ *	asynchronous manager sockets.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	Event handlers are deleted or engine threads are stopped.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+StopReceivers(void)
+{
+    int i;
+
+    if (engineThreads) {
+	TnmSnmpEngineStop();
+	return;
+    }
+
+    for (i = 0; i < numAsyncSockets; i++) {
+	TnmDeleteSocketHandler(asyncSockets[i]->sock);
+    }
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * TnmSnmpManagerThreads --
+ *
+ *	This procedure sets the number of engine threads which
+ *	receive and decode the responses sent to the manager sockets.
+ *	The responses are received by the event loop if count is 0.
+ *	Open manager sockets are switched over immediately. The
+ *	current setting is not changed if count is negative.
+ *
+ * Results:
+ *	A standard Tcl result. The number of engine threads is left
+ *	in the interpreter result.
+ *
+ * Side effects:
+ *	Engine threads are started or stopped.
+ *
+ *----------------------------------------------------------------------
+ */
+
+int
+TnmSnmpManagerThreads(Tcl_Interp *interp, int count)
+{
+    int code = TCL_OK;
+
+    if (count < 0) {
+	Tcl_SetObjResult(interp, Tcl_NewIntObj(engineThreads));
+	return TCL_OK;
+    }
+
+#ifndef TNM_SNMP_ENGINE
+    if (count) {
+	Tcl_SetResult(interp, "threads are not supported", TCL_STATIC);
+	return TCL_ERROR;
+    }
+#endif
+
+    if (count > TNM_SNMP_ENGINE_MAX) {
+	count = TNM_SNMP_ENGINE_MAX;
+    }
+
+    if (numAsyncSockets) {
+	StopReceivers();
+	engineThreads = count;
+	code = StartReceivers(managerInterp);
+	if (code != TCL_OK) {
+	    Tcl_SetObjResult(interp, Tcl_GetObjResult(managerInterp));
+	    engineThreads = 0;
+	    StartReceivers(managerInterp);
+	}
+    } else {
+	engineThreads = count;
+    }
+
+    if (code == TCL_OK) {
+	Tcl_SetObjResult(interp, Tcl_NewIntObj(engineThreads));
+    }
+    return code;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * TnmSnmpResponderOpen --
+ *
+ *	This procedure creates a socket for a command responder session
+ *	on a given port. If an agent socket is already created, we close
+ *	the socket and open a new one.
+ *
+ * Results:
+ *	A standard Tcl result.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+int
+TnmSnmpResponderOpen(Tcl_Interp *interp, TnmSnmp *session)
+{
+    if (session->socket) {
+	TnmSnmpClose(session->socket);
+    }
+    session->socket = TnmSnmpOpen(interp, &session->maddr);
+    if (! session->socket) {
+	return TCL_ERROR;
+    }
+    TnmCreateSocketHandler(session->socket->sock, TCL_READABLE,
+			   AgentProc, (ClientData) session);
+    return TCL_OK;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * TnmSnmpResponderClose --
+ *
+ *	This procedure closes the socket for incoming requests.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+TnmSnmpResponderClose(TnmSnmp *session)
+{
+    if (session->socket) {
+	TnmSnmpClose(session->socket);
+    }
+    session->socket = NULL;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * TnmSnmpListenerOpen --
+ *
+ *	This procedure creates a socket for a notification listener
+ *	on a given port. If an socket is already created, we close
+ *	the socket and open a new one.
+ *
+ * Results:
+ *	A standard Tcl result.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+int
+TnmSnmpListenerOpen(Tcl_Interp *interp, TnmSnmp *session)
+{
+#ifdef _TNMUNIXPORT
+    if (ntohs(session->maddr.sin_port) == TNM_SNMP_TRAPPORT) {
+	return TnmSnmpNmtrapdOpen(interp);
+    }
+#endif
+    
+    if (session->socket) {
+	TnmSnmpClose(session->socket);
+    }
+    session->socket = TnmSnmpOpen(interp, &session->maddr);
+    if (! session->socket) {
+	return TCL_ERROR;
+    }
+    TnmCreateSocketHandler(session->socket->sock, TCL_READABLE,
+			   AgentProc, (ClientData) session);
+    return TCL_OK;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * TnmSnmpListenerClose --
+ *
+ *	This procedure closes the socket for incoming notifications.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
 TnmSnmpListenerClose(TnmSnmp *session)
 {
-#ifdef _TNMUNIXPORT
-    if (ntohs(session->maddr.sin_port) == TNM_SNMP_TRAPPORT) {
-	TnmSnmpNmtrapdClose();
-    }
-#endif
-    
-    if (session->socket) {
-	TnmSnmpClose(session->socket);
+#ifdef _TNMUNIXPORT
+    if (ntohs(session->maddr.sin_port) == TNM_SNMP_TRAPPORT) {
+	TnmSnmpNmtrapdClose();
+    }
+#endif
+    
+    if (session->socket) {
+	TnmSnmpClose(session->socket);
+    }
+    session->socket = NULL;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * TnmSnmpSend --
+ *
+ *	This procedure sends a packet to the destination address.
+ *	Asynchronous messages are queued and sent in batches if
+ *	sendmmsg() is available. Errors are not reported for queued
+ *	messages.
+ *
+ * Results:
+ *	A standard Tcl result.
+ *
+ * Side effects:
+ *	The packet may be queued.
+ *
+ *----------------------------------------------------------------------
+ */
+
+int
+TnmSnmpSend(Tcl_Interp *interp, TnmSnmp *session, u_char *packet, int packetlen, struct sockaddr_in *to, int flags)
+{
+    int code, sock;
+
+    if (session->domain == TNM_SNMP_TCP_DOMAIN) {
+	/* 1 get suitable tcp socket */
+	/* 2. send the packet */
+    }
+
+    if (! tnmSnmpSocketList) {
+	Tcl_SetResult(interp, "sendto failed: no open socket", TCL_STATIC);
+	return TCL_ERROR;
+    }
+
+    sock = tnmSnmpSocketList ? tnmSnmpSocketList->sock : -1;
+    if (flags & TNM_SNMP_ASYNC && asyncSocket) {
+	sock = ManagerSocket(to)->sock;
+    }
+    if (flags & TNM_SNMP_SYNC && syncSocket) {
+	sock = syncSocket->sock;
+    }
+
+#ifdef HAVE_SENDMMSG
+    if (flags & TNM_SNMP_ASYNC && asyncSocket) {
+	code = QueueSend(sock, packet, packetlen, to);
+    } else {
+	TnmSnmpFlush();
+	code = TnmSocketSendTo(sock, packet, (size_t) packetlen, 0, 
+			       (struct sockaddr *) to, sizeof(*to));
+    }
+#else
+    code = TnmSocketSendTo(sock, packet, (size_t) packetlen, 0, 
+			   (struct sockaddr *) to, sizeof(*to));
+#endif
+
+    if (code == TNM_SOCKET_ERROR) {
+        Tcl_AppendResult(interp, "sendto failed: ", 
+			 Tcl_PosixError(interp), (char *) NULL);
+	return TCL_ERROR;
+    }
+    
+    tnmSnmpStats.snmpOutPkts++;
+
+#ifdef TNM_SNMP_BENCH
+    Tcl_GetTime(&tnmSnmpBenchMark.sendTime);
+    tnmSnmpBenchMark.sendSize = packetlen;
+#endif
+
+    if (hexdump) {
+	struct sockaddr_in name, *from = NULL;
+	socklen_t namelen = sizeof(name);
+
+	if (getsockname(sock, (struct sockaddr *) &name, &namelen) == 0) {
+	    from = &name;
+	}
+	
+	TnmSnmpDumpPacket(packet, packetlen, from, to);
+    }
+    
+    return TCL_OK;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * TnmSnmpRecv --
+ *
+ *	This procedure reads incoming responses from the 
+ *	manager socket.
+ *
+ * Results:
+ *	A standard Tcl result. The data and the length of the
+ *	packet is stored in packet and packetlen. The address of
+ *	the sender is stored in from.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+int
+TnmSnmpRecv(Tcl_Interp *interp, u_char *packet, int	*packetlen, struct sockaddr_in *from, int flags)
+{
+    int sock;
+    socklen_t fromlen = sizeof(*from);
+
+    if (! tnmSnmpSocketList) {
+	Tcl_SetResult(interp, "sendto failed: no open socket", TCL_STATIC);
+	return TCL_ERROR;
+    }
+
+    sock = tnmSnmpSocketList ? tnmSnmpSocketList->sock : -1;
+    if (flags & TNM_SNMP_ASYNC && asyncSocket) {
+	sock = asyncSocket->sock;
+    }
+    if (flags & TNM_SNMP_SYNC && syncSocket) {
+	sock = syncSocket->sock;
+    }
+
+    *packetlen = TnmSocketRecvFrom(sock, packet, (size_t) *packetlen, 0,
+				   (struct sockaddr *) from, &fromlen);
+
+    if (*packetlen == TNM_SOCKET_ERROR) {
+	Tcl_AppendResult(interp, "recvfrom failed: ",
+			 Tcl_PosixError(interp), (char *) NULL);
+	return TCL_ERROR;
+    }
+
+#ifdef TNM_SNMP_BENCH
+    Tcl_GetTime(&tnmSnmpBenchMark.recvTime);
+    tnmSnmpBenchMark.recvSize = *packetlen;
+#endif
+
+    if (hexdump) {
+	struct sockaddr_in name, *to = NULL;
+	socklen_t namelen = sizeof(name);
+
+	if (getsockname(sock, (struct sockaddr *) &name, &namelen) == 0) {
+	    to = &name;
+	}
+
+	TnmSnmpDumpPacket(packet, *packetlen, from, to);
+    }
+
+    return TCL_OK;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * BatchRecv --
+ *
+ *	This procedure reads a new batch of datagrams from a socket.
+ *	It is only called if the socket is readable and all datagrams
+ *	of the previous batch have been processed. We read as many
+ *	datagrams as are available without blocking, up to the size
+ *	of a batch. Without recvmmsg(), a batch contains a single
+ *	datagram.
+ *
+ * Results:
+ *	A standard Tcl result.
+ *
+ * Side effects:
+ *	The batch of the socket is refilled.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+BatchRecv(Tcl_Interp *interp, TnmSnmpSocket *sockPtr)
+{
+    TnmSnmpBatch *batchPtr = sockPtr->batchPtr;
+    socklen_t fromlen;
+    int n;
+
+    if (! batchPtr) {
+	batchPtr = (TnmSnmpBatch *) ckalloc(sizeof(TnmSnmpBatch));
+	sockPtr->batchPtr = batchPtr;
+    }
+    batchPtr->count = batchPtr->next = 0;
+
+#ifdef HAVE_RECVMMSG
+    {
+	static int unavailable = 0;
+	struct mmsghdr msgs[RECV_BATCH];
+	struct iovec iov[RECV_BATCH];
+
+	if (! unavailable) {
+	    memset((char *) msgs, 0, sizeof(msgs));
+	    for (n = 0; n < RECV_BATCH; n++) {
+		iov[n].iov_base = batchPtr->packet[n];
+		iov[n].iov_len = TNM_SNMP_MAXSIZE;
+		msgs[n].msg_hdr.msg_iov = &iov[n];
+		msgs[n].msg_hdr.msg_iovlen = 1;
+		msgs[n].msg_hdr.msg_name = &batchPtr->from[n];
+		msgs[n].msg_hdr.msg_namelen = sizeof(struct sockaddr_in);
+	    }
+	    n = recvmmsg(sockPtr->sock, msgs, RECV_BATCH, MSG_DONTWAIT, NULL);
+	    if (n >= 0) {
+		for (batchPtr->count = 0; batchPtr->count < n; 
+		     batchPtr->count++) {
+		    batchPtr->length[batchPtr->count]
+			= msgs[batchPtr->count].msg_len;
+		}
+		return TCL_OK;
+	    }
+	    if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
+		return TCL_OK;
+	    }
+	    if (errno != ENOSYS) {
+		Tcl_AppendResult(interp, "recvmmsg failed: ",
+				 Tcl_PosixError(interp), (char *) NULL);
+		return TCL_ERROR;
+	    }
+	    unavailable = 1;
+	}
+    }
+#endif
+
+    fromlen = sizeof(batchPtr->from[0]);
+    n = TnmSocketRecvFrom(sockPtr->sock, batchPtr->packet[0],
+			  TNM_SNMP_MAXSIZE, 0,
+			  (struct sockaddr *) &batchPtr->from[0], &fromlen);
+    if (n == TNM_SOCKET_ERROR) {
+	Tcl_AppendResult(interp, "recvfrom failed: ",
+			 Tcl_PosixError(interp), (char *) NULL);
+	return TCL_ERROR;
+    }
+    batchPtr->length[0] = n;
+    batchPtr->count = 1;
+    return TCL_OK;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * SocketRecv --
+ *
+ *	This procedure returns the next datagram received on a socket.
+ *	A new batch is read from the socket if all datagrams of the
+ *	current batch have been processed. The datagram is copied so
+ *	that the batch can be refilled while the caller is still
+ *	processing the datagram.
+ *
+ * Results:
+ *	A standard Tcl result. TCL_BREAK is returned if there is no
+ *	datagram available.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+SocketRecv(Tcl_Interp *interp, TnmSnmpSocket *sockPtr, u_char *packet, int *packetlen, struct sockaddr_in *from)
+{
+    TnmSnmpBatch *batchPtr = sockPtr->batchPtr;
+    int i;
+
+    if (! batchPtr || batchPtr->next >= batchPtr->count) {
+	if (BatchRecv(interp, sockPtr) != TCL_OK) {
+	    return TCL_ERROR;
+	}
+	batchPtr = sockPtr->batchPtr;
+	if (batchPtr->count == 0) {
+	    return TCL_BREAK;
+	}
+    }
+
+    i = batchPtr->next++;
+    *packetlen = batchPtr->length[i] < *packetlen
+	? batchPtr->length[i] : *packetlen;
+    memcpy(packet, batchPtr->packet[i], (size_t) *packetlen);
+    *from = batchPtr->from[i];
+
+#ifdef TNM_SNMP_BENCH
+    Tcl_GetTime(&tnmSnmpBenchMark.recvTime);
+    tnmSnmpBenchMark.recvSize = *packetlen;
+#endif
+
+    if (hexdump) {
+	struct sockaddr_in name, *to = NULL;
+	socklen_t namelen = sizeof(name);
+
+	if (getsockname(sockPtr->sock, 
+			(struct sockaddr *) &name, &namelen) == 0) {
+	    to = &name;
+	}
+
+	TnmSnmpDumpPacket(packet, *packetlen, from, to);
+    }
+
+    return TCL_OK;
+}
+
+#ifdef HAVE_SENDMMSG
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * QueueSend --
+ *
+ *	This procedure appends a message to the send queue of the
+ *	manager sockets. The queue is flushed first if there is no
+ *	space left. An idle handler is scheduled to flush the queue.
+ *
+ * Results:
+ *	0 or TNM_SOCKET_ERROR if the message could not be sent.
+ *
+ * Side effects:
+ *	The message is queued or sent.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+QueueSend(int sock, u_char *packet, int packetlen, struct sockaddr_in *to)
+{
+    SendQueue *queuePtr = sendQueue;
+
+    if (packetlen > SEND_BUFFER) {
+	TnmSnmpFlush();
+	return TnmSocketSendTo(sock, packet, (size_t) packetlen,
+			       0, (struct sockaddr *) to, sizeof(*to));
+    }
+
+    if (! queuePtr) {
+	queuePtr = (SendQueue *) ckalloc(sizeof(SendQueue));
+	memset((char *) queuePtr, 0, sizeof(SendQueue));
+	sendQueue = queuePtr;
+    }
+
+    if (queuePtr->count == SEND_BATCH
+	|| queuePtr->used + packetlen > SEND_BUFFER) {
+	TnmSnmpFlush();
+    }
+
+    memcpy(queuePtr->buffer + queuePtr->used, packet, (size_t) packetlen);
+    queuePtr->sock[queuePtr->count] = sock;
+    queuePtr->offset[queuePtr->count] = queuePtr->used;
+    queuePtr->length[queuePtr->count] = packetlen;
+    queuePtr->to[queuePtr->count] = *to;
+    queuePtr->used += packetlen;
+    queuePtr->count++;
+
+    if (! queuePtr->idle) {
+	Tcl_DoWhenIdle(FlushIdleProc, (ClientData) NULL);
+	queuePtr->idle = 1;
+    }
+    if (! queuePtr->exit) {
+	Tcl_CreateExitHandler(FlushExitProc, (ClientData) NULL);
+	queuePtr->exit = 1;
+    }
+    return 0;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * FlushIdleProc --
+ *
+ *	This procedure is called from the event loop when it becomes
+ *	idle in order to send all queued messages.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	Messages are sent.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+FlushIdleProc(ClientData clientData)
+{
+    if (sendQueue) {
+	sendQueue->idle = 0;
+    }
+    TnmSnmpFlush();
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * FlushExitProc --
+ *
+ *	This procedure is called when the application exits. It makes
+ *	sure that queued messages (e.g. notifications) are not lost.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	Messages are sent and the send queue is freed.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+FlushExitProc(ClientData clientData)
+{
+    TnmSnmpFlush();
+    if (sendQueue) {
+	if (sendQueue->idle) {
+	    Tcl_CancelIdleCall(FlushIdleProc, (ClientData) NULL);
+	}
+	ckfree((char *) sendQueue);
+	sendQueue = NULL;
     }
-    session->socket = NULL;
 }
+#endif
 
 /*
  *----------------------------------------------------------------------
  *
- * TnmSnmpSend --
+ * TnmSnmpFlush --
  *
- *	This procedure sends a packet to the destination address.
+ *	This procedure sends all messages queued for the manager
+ *	socket. Messages which can not be sent are dropped.
  *
  * Results:
- *	A standard Tcl result.
+ *	None.
  *
  * Side effects:
- *	None.
+ *	Messages are sent.
  *
  *----------------------------------------------------------------------
  */
 
-int
-TnmSnmpSend(Tcl_Interp *interp, TnmSnmp *session, u_char *packet, int packetlen, struct sockaddr_in *to, int flags)
+void
+TnmSnmpFlush(void)
 {
-    int code, sock;
+#ifdef HAVE_SENDMMSG
+    SendQueue *queuePtr = sendQueue;
+    struct mmsghdr msgs[SEND_BATCH];
+    struct iovec iov[SEND_BATCH];
+    int i, j, n;
 
-    if (session->domain == TNM_SNMP_TCP_DOMAIN) {
-	/* 1 get suitable tcp socket */
-	/* 2. send the packet */
+    if (! queuePtr || ! queuePtr->count) {
+	return;
     }
-
-    if (! tnmSnmpSocketList) {
-	Tcl_SetResult(interp, "sendto failed: no open socket", TCL_STATIC);
-	return TCL_ERROR;
+    if (! asyncSocket) {
+	queuePtr->count = queuePtr->used = 0;
+	return;
     }
 
-    sock = tnmSnmpSocketList ? tnmSnmpSocketList->sock : -1;
-    if (flags & TNM_SNMP_ASYNC && asyncSocket) {
-	sock = asyncSocket->sock;
-    }
-    if (flags & TNM_SNMP_SYNC && syncSocket) {
-	sock = syncSocket->sock;
+    memset((char *) msgs, 0, queuePtr->count * sizeof(struct mmsghdr));
+    for (i = 0; i < queuePtr->count; i++) {
+	iov[i].iov_base = queuePtr->buffer + queuePtr->offset[i];
+	iov[i].iov_len = queuePtr->length[i];
+	msgs[i].msg_hdr.msg_iov = &iov[i];
+	msgs[i].msg_hdr.msg_iovlen = 1;
+	msgs[i].msg_hdr.msg_name = &queuePtr->to[i];
+	msgs[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_in);
     }
 
-    code = TnmSocketSendTo(sock, packet, (size_t) packetlen, 0, 
-			   (struct sockaddr *) to, sizeof(*to));
+    /*
+     * sendmmsg() stops at the first message which can not be sent.
+     * We skip this message and continue with the next one. Each call
+     * sends a run of messages queued for the same socket. The
+     * messages are sent one by one if sendmmsg() is not supported
+     * by the kernel.
+     */
 
-    if (code == TNM_SOCKET_ERROR) {
-        Tcl_AppendResult(interp, "sendto failed: ", 
-			 Tcl_PosixError(interp), (char *) NULL);
-	return TCL_ERROR;
+    for (i = 0; i < queuePtr->count; ) {
+	for (j = i + 1; j < queuePtr->count
+		 && queuePtr->sock[j] == queuePtr->sock[i]; j++) ;
+	n = sendmmsg(queuePtr->sock[i], msgs + i, j - i, 0);
+	if (n > 0) {
+	    i += n;
+	    continue;
+	}
+	if (n < 0 && errno == EINTR) {
+	    continue;
+	}
+	if (n < 0 && errno == ENOSYS) {
+	    for (; i < queuePtr->count; i++) {
+		TnmSocketSendTo(queuePtr->sock[i], iov[i].iov_base,
+				iov[i].iov_len, 0,
+				(struct sockaddr *) &queuePtr->to[i],
+				sizeof(queuePtr->to[i]));
+	    }
+	    break;
+	}
+	i++;
     }
-    
-    tnmSnmpStats.snmpOutPkts++;
 
-#ifdef TNM_SNMP_BENCH
-    Tcl_GetTime(&tnmSnmpBenchMark.sendTime);
-    tnmSnmpBenchMark.sendSize = packetlen;
+    queuePtr->count = queuePtr->used = 0;
 #endif
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * TimerNow --
+ *
+ *	This procedure returns the current time in milliseconds.
+ *
+ * Results:
+ *	The current time in milliseconds.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
 
-    if (hexdump) {
-	struct sockaddr_in name, *from = NULL;
-	socklen_t namelen = sizeof(name);
+static Tcl_WideInt
+TimerNow(void)
+{
+    Tcl_Time now;
 
-	if (getsockname(sock, (struct sockaddr *) &name, &namelen) == 0) {
-	    from = &name;
+    Tcl_GetTime(&now);
+    return (Tcl_WideInt) now.sec * 1000 + now.usec / 1000;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * TimerInsert --
+ *
+ *	This procedure links a request into the wheel slot which
+ *	corresponds to its expiration time relative to the time
+ *	the wheel has advanced to.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	The timer wheel is modified.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+TimerInsert(TnmSnmpRequest *request)
+{
+    TimerWheel *wheelPtr = &timerWheel;
+    Tcl_WideInt expire = request->expire;
+    Tcl_WideInt delta = expire - wheelPtr->now;
+    TnmSnmpRequest **slotPtr;
+    int level;
+
+    if (delta < 0) {
+	expire = wheelPtr->now;
+	delta = 0;
+    } else if (delta > TIMER_RANGE) {
+	expire = wheelPtr->now + TIMER_RANGE;
+	delta = TIMER_RANGE;
+    }
+
+    for (level = 0; level < TIMER_LEVELS - 1; level++) {
+	if (delta < ((Tcl_WideInt) 1 << (TIMER_BITS * (level + 1)))) {
+	    break;
 	}
-	
-	TnmSnmpDumpPacket(packet, packetlen, from, to);
     }
-    
-    return TCL_OK;
+
+    slotPtr = &wheelPtr->slots[level]
+	[(expire >> (TIMER_BITS * level)) & TIMER_MASK];
+    request->timerSlot = slotPtr;
+    request->timerPrevPtr = NULL;
+    request->timerNextPtr = *slotPtr;
+    if (*slotPtr) {
+	(*slotPtr)->timerPrevPtr = request;
+    }
+    *slotPtr = request;
+    wheelPtr->count[level]++;
 }
 
 /*
  *----------------------------------------------------------------------
  *
- * TnmSnmpRecv --
+ * TimerCascade --
  *
- *	This procedure reads incoming responses from the 
- *	manager socket.
+ *	This procedure moves all timers of the current slot of the
+ *	given level down to the lower levels. It is called whenever
+ *	the level below wraps around.
  *
  * Results:
- *	A standard Tcl result. The data and the length of the
- *	packet is stored in packet and packetlen. The address of
- *	the sender is stored in from.
+ *	None.
  *
  * Side effects:
- *	None.
+ *	The timer wheel is modified.
  *
  *----------------------------------------------------------------------
  */
 
-int
-TnmSnmpRecv(Tcl_Interp *interp, u_char *packet, int	*packetlen, struct sockaddr_in *from, int flags)
+static void
+TimerCascade(int level)
 {
-    int sock;
-    socklen_t fromlen = sizeof(*from);
+    TimerWheel *wheelPtr = &timerWheel;
+    TnmSnmpRequest *list, *request;
+    int index;
+
+    index = (wheelPtr->now >> (TIMER_BITS * level)) & TIMER_MASK;
+    list = wheelPtr->slots[level][index];
+    wheelPtr->slots[level][index] = NULL;
+
+    while (list) {
+	request = list;
+	list = list->timerNextPtr;
+	wheelPtr->count[level]--;
+	TimerInsert(request);
+    }
 
-    if (! tnmSnmpSocketList) {
-	Tcl_SetResult(interp, "sendto failed: no open socket", TCL_STATIC);
-	return TCL_ERROR;
+    if (index == 0 && level < TIMER_LEVELS - 1) {
+	TimerCascade(level + 1);
+    }
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * TimerSchedule --
+ *
+ *	This procedure makes sure that the Tcl timer driving the wheel
+ *	is scheduled for the next expiring timer. Timers on the higher
+ *	levels are handled by waking up when the lowest level wraps.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	The Tcl timer handler may be created or deleted.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+TimerSchedule(void)
+{
+    TimerWheel *wheelPtr = &timerWheel;
+    Tcl_WideInt wakeup = -1, now;
+    int i, level, index, ms;
+
+    if (wheelPtr->count[0]) {
+	index = wheelPtr->now & TIMER_MASK;
+	for (i = 0; i < TIMER_SLOTS; i++) {
+	    if (wheelPtr->slots[0][(index + i) & TIMER_MASK]) {
+		wakeup = wheelPtr->now + i;
+		break;
+	    }
+	}
+    }
+    for (level = 1; level < TIMER_LEVELS; level++) {
+	if (wheelPtr->count[level]) {
+	    Tcl_WideInt wrap = (wheelPtr->now | TIMER_MASK) + 1;
+	    if (wakeup < 0 || wrap < wakeup) {
+		wakeup = wrap;
+	    }
+	    break;
+	}
     }
 
-    sock = tnmSnmpSocketList ? tnmSnmpSocketList->sock : -1;
-    if (flags & TNM_SNMP_ASYNC && asyncSocket) {
-	sock = asyncSocket->sock;
+    if (wheelPtr->token) {
+	if (wakeup == wheelPtr->wakeup) {
+	    return;
+	}
+	Tcl_DeleteTimerHandler(wheelPtr->token);
+	wheelPtr->token = NULL;
     }
-    if (flags & TNM_SNMP_SYNC && syncSocket) {
-	sock = syncSocket->sock;
+    if (wakeup < 0) {
+	return;
     }
 
-    *packetlen = TnmSocketRecvFrom(sock, packet, (size_t) *packetlen, 0,
-				   (struct sockaddr *) from, &fromlen);
+    now = TimerNow();
+    ms = (wakeup > now) ? (int) (wakeup - now) : 0;
+    wheelPtr->wakeup = wakeup;
+    wheelPtr->token = Tcl_CreateTimerHandler(ms, TimerProc, NULL);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * TimerProc --
+ *
+ *	This procedure is called by the Tcl event loop to advance the
+ *	timer wheel to the current time. The timeout procedure is
+ *	called for all requests with an expired timer.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	Packets may be retransmitted and callbacks evaluated.
+ *
+ *----------------------------------------------------------------------
+ */
 
-    if (*packetlen == TNM_SOCKET_ERROR) {
-	Tcl_AppendResult(interp, "recvfrom failed: ",
-			 Tcl_PosixError(interp), (char *) NULL);
-	return TCL_ERROR;
-    }
+static void
+TimerProc(ClientData clientData)
+{
+    TimerWheel *wheelPtr = &timerWheel;
+    TnmSnmpRequest *request;
+    Tcl_WideInt now = TimerNow();
+    int pending;
 
-#ifdef TNM_SNMP_BENCH
-    Tcl_GetTime(&tnmSnmpBenchMark.recvTime);
-    tnmSnmpBenchMark.recvSize = *packetlen;
-#endif
+    wheelPtr->token = NULL;
 
-    if (hexdump) {
-	struct sockaddr_in name, *to = NULL;
-	socklen_t namelen = sizeof(name);
+    /*
+     * Note that the timeout procedure may re-enter the event loop.
+     * All state is therefore re-read from the wheel after each
+     * expired timer.
+     */
 
-	if (getsockname(sock, (struct sockaddr *) &name, &namelen) == 0) {
-	    to = &name;
+    while (wheelPtr->now <= now) {
+	request = wheelPtr->slots[0][wheelPtr->now & TIMER_MASK];
+	if (request) {
+	    TnmSnmpStopTimer(request);
+	    TnmSnmpTimeoutProc((ClientData) request);
+	    continue;
+	}
+	pending = wheelPtr->count[0] + wheelPtr->count[1]
+	    + wheelPtr->count[2] + wheelPtr->count[3];
+	if (! pending) {
+	    wheelPtr->now = now + 1;
+	    break;
+	}
+	if (! wheelPtr->count[0] && (wheelPtr->now | TIMER_MASK) < now) {
+	    wheelPtr->now |= TIMER_MASK;
+	}
+	wheelPtr->now++;
+	if ((wheelPtr->now & TIMER_MASK) == 0) {
+	    TimerCascade(1);
 	}
-
-	TnmSnmpDumpPacket(packet, *packetlen, from, to);
     }
 
-    return TCL_OK;
+    TimerSchedule();
 }
 
 /*
  *----------------------------------------------------------------------
  *
- * AgentRecv --
+ * TnmSnmpStartTimer --
  *
- *	This procedure reads from the socket to process incoming
- *	SNMP requests.
+ *	This procedure starts the retransmission timer of a request.
+ *	The timeout procedure is called for the request once the
+ *	given number of milliseconds have passed.
  *
  * Results:
- *	A standard Tcl result.
+ *	None.
  *
  * Side effects:
- *	None.
+ *	The timer wheel is modified.
  *
  *----------------------------------------------------------------------
  */
 
-static int
-AgentRecv(Tcl_Interp	*interp, TnmSnmp *session, u_char *packet, int *packetlen, struct sockaddr_in *from)
+void
+TnmSnmpStartTimer(TnmSnmpRequest *request, int ms)
 {
-    int sock = session->socket->sock;
-    socklen_t fromlen = sizeof(*from);
-
-    if (! session->socket) {
-	Tcl_SetResult(interp, "recvfrom failed: no agent socket", TCL_STATIC);
-	return TCL_ERROR;
-    }
+    TimerWheel *wheelPtr = &timerWheel;
+    Tcl_WideInt now = TimerNow();
 
-    *packetlen = TnmSocketRecvFrom(sock, packet, (size_t) *packetlen, 0,
-				   (struct sockaddr *) from, &fromlen);
+    TnmSnmpStopTimer(request);
 
-    if (*packetlen == TNM_SOCKET_ERROR) {
-	Tcl_AppendResult(interp, "recvfrom failed: ",
-			 Tcl_PosixError(interp), (char *) NULL);
-	return TCL_ERROR;
+    if (! (wheelPtr->count[0] + wheelPtr->count[1]
+	   + wheelPtr->count[2] + wheelPtr->count[3])) {
+	wheelPtr->now = now;
     }
 
-    if (hexdump) {
-	struct sockaddr_in name, *to = NULL;
-	socklen_t namelen = sizeof(name);
+    request->expire = now + (ms > 0 ? ms : 0);
+    TimerInsert(request);
+    TimerSchedule();
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * TnmSnmpStopTimer --
+ *
+ *	This procedure stops the retransmission timer of a request.
+ *	Nothing happens if the timer is not running.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	The timer wheel is modified. The Tcl timer driving the wheel
+ *	is not touched since it will reschedule itself.
+ *
+ *----------------------------------------------------------------------
+ */
 
-	if (getsockname(sock, (struct sockaddr *) &name, &namelen) == 0) {
-	    to = &name;
-	}
+void
+TnmSnmpStopTimer(TnmSnmpRequest *request)
+{
+    TimerWheel *wheelPtr = &timerWheel;
+    int level;
 
-	TnmSnmpDumpPacket(packet, *packetlen, from, to);
+    if (! request->timerSlot) {
+	return;
     }
 
-    return TCL_OK;
+    if (request->timerPrevPtr) {
+	request->timerPrevPtr->timerNextPtr = request->timerNextPtr;
+    } else {
+	*request->timerSlot = request->timerNextPtr;
+    }
+    if (request->timerNextPtr) {
+	request->timerNextPtr->timerPrevPtr = request->timerPrevPtr;
+    }
+
+    level = (request->timerSlot - &wheelPtr->slots[0][0]) / TIMER_SLOTS;
+    wheelPtr->count[level]--;
+
+    request->timerSlot = NULL;
+    request->timerNextPtr = request->timerPrevPtr = NULL;
 }
 
 /*
@@ -719,7 +1992,7 @@ AgentRecv(Tcl_Interp	*interp, TnmSnmp *session, u_char *packet, int *packetlen,
  *
  * TnmSnmpTimeoutProc --
  *
- *	This procedure is called from the event dispatcher whenever
+ *	This procedure is called from the timer wheel whenever
  *	a timeout occurs so that we can retransmit packets.
  *
  * Results:
@@ -739,7 +2012,20 @@ TnmSnmpTimeoutProc(ClientData clientData)
     Tcl_Interp *interp = request->interp;
 
     if (request->sends < (1 + session->retries)) {
+	int wait;
 	
+	/*
+	 * Defer the retransmission if the session or the global
+	 * bucket does not permit to send it now. The first send
+	 * has already been paced by the request scheduler.
+	 */
+
+	wait = TnmSnmpPace(session, request->packetlen);
+	if (wait && request->sends) {
+	    TnmSnmpStartTimer(request, wait);
+	    return;
+	}
+
 	/* 
 	 * Reinstall TimerHandler for this request and retransmit
 	 * this request (keeping the original oid).
@@ -750,9 +2036,9 @@ TnmSnmpTimeoutProc(ClientData clientData)
 	    TnmSnmpUsecAuth(session, request->packet, request->packetlen);
 	}
 #endif
-	TnmSnmpDelay(session);
 	TnmSnmpSend(interp, session, request->packet, request->packetlen, 
-		    &session->maddr, TNM_SNMP_ASYNC);
+		    request->to ? request->to : &session->maddr,
+		    TNM_SNMP_ASYNC);
 #ifdef TNM_SNMP_BENCH
 	if (request->stats.sendSize == 0) {
 	    request->stats.sendSize = tnmSnmpBenchMark.sendSize;
@@ -760,9 +2046,8 @@ TnmSnmpTimeoutProc(ClientData clientData)
 	}
 #endif
         request->sends++;
-	request->timer = Tcl_CreateTimerHandler(
-			(session->timeout * 1000) / (session->retries + 1),
-			TnmSnmpTimeoutProc, (ClientData) request);
+	TnmSnmpStartTimer(request,
+			  (session->timeout * 1000) / (session->retries + 1));
 
     } else {
 
@@ -779,7 +2064,7 @@ TnmSnmpTimeoutProc(ClientData clientData)
 	memset((char *) pdu, 0, sizeof(TnmSnmpPdu));
 	pdu->requestId = request->id;
 	pdu->errorStatus = TNM_SNMP_NORESPONSE;
-	Tcl_DStringInit(&pdu->varbind);
+	pdu->vbList = NULL;
 
 	Tcl_Preserve((ClientData) request);
 	Tcl_Preserve((ClientData) session);
@@ -787,6 +2072,7 @@ TnmSnmpTimeoutProc(ClientData clientData)
 	if (request->proc) {
 	    (request->proc) (session, pdu, request->clientData);
 	}
+	TnmSnmpPduSetVarBinds(pdu, NULL);
 	Tcl_Release((ClientData) session);
 	Tcl_Release((ClientData) request);
 	Tcl_ResetResult(interp);
@@ -813,25 +2099,40 @@ TnmSnmpTimeoutProc(ClientData clientData)
 static void
 ResponseProc(ClientData	clientData, int mask)
 {
-    Tcl_Interp *interp = (Tcl_Interp *) clientData;
+    Tcl_Interp *interp = managerInterp;
+    TnmSnmpSocket *sockPtr = (TnmSnmpSocket *) clientData;
     u_char packet[TNM_SNMP_MAXSIZE];
-    int code, packetlen = TNM_SNMP_MAXSIZE;
+    int code, packetlen;
     struct sockaddr_in from;
 
-    Tcl_ResetResult(interp);
-    code = TnmSnmpRecv(interp, packet, &packetlen, &from, TNM_SNMP_ASYNC);
-    if (code != TCL_OK) return;
+    if (! interp) return;
 
-    code = TnmSnmpDecode(interp, packet, packetlen, &from, 
-			 NULL, NULL, NULL, NULL);
-    if (code == TCL_ERROR) {
-	Tcl_AddErrorInfo(interp, "\n    (snmp response event)");
-	Tcl_BackgroundError(interp);
-    }
-    if (code == TCL_CONTINUE && hexdump) {
-	TnmWriteMessage(Tcl_GetStringResult(interp));
-	TnmWriteMessage("\n");
+    /*
+     * Process all datagrams of the current batch. The socket may
+     * be closed while we evaluate callbacks.
+     */
+
+    Tcl_Preserve((ClientData) sockPtr);
+    while (sockPtr->refCount > 0) {
+	Tcl_ResetResult(interp);
+	packetlen = TNM_SNMP_MAXSIZE;
+	code = SocketRecv(interp, sockPtr, packet, &packetlen, &from);
+	if (code != TCL_OK) break;
+
+	code = TnmSnmpDecode(interp, packet, packetlen, &from, 
+			     NULL, NULL, NULL, NULL);
+	if (code == TCL_ERROR) {
+	    Tcl_AddErrorInfo(interp, "\n    (snmp response event)");
+	    Tcl_BackgroundError(interp);
+	}
+	if (code == TCL_CONTINUE && hexdump) {
+	    TnmWriteMessage(Tcl_GetStringResult(interp));
+	    TnmWriteMessage("\n");
+	}
+	if (sockPtr->batchPtr->next >= sockPtr->batchPtr->count) break;
     }
+    Tcl_Release((ClientData) sockPtr);
+    TnmSnmpFlush();
 }
 
 /*
@@ -856,25 +2157,41 @@ AgentProc(ClientData clientData, int mask)
 {
     TnmSnmp *session = (TnmSnmp *) clientData;
     Tcl_Interp *interp = session->interp;
+    TnmSnmpSocket *sockPtr = session->socket;
     u_char packet[TNM_SNMP_MAXSIZE];
-    int code, packetlen = TNM_SNMP_MAXSIZE;
+    int code, packetlen;
     struct sockaddr_in from;
 
-    if (! interp) return;
+    if (! interp || ! sockPtr) return;
+
+    /*
+     * Process all datagrams of the current batch. The session may
+     * be destroyed or moved to another socket while we evaluate
+     * callbacks.
+     */
 
-    Tcl_ResetResult(interp);
-    code = AgentRecv(interp, session, packet, &packetlen, &from);
-    if (code != TCL_OK) return;
+    Tcl_Preserve((ClientData) session);
+    Tcl_Preserve((ClientData) sockPtr);
+    while (session->socket == sockPtr && sockPtr->refCount > 0) {
+	Tcl_ResetResult(interp);
+	packetlen = TNM_SNMP_MAXSIZE;
+	code = SocketRecv(interp, sockPtr, packet, &packetlen, &from);
+	if (code != TCL_OK) break;
     
-    code = TnmSnmpDecode(interp, packet, packetlen, &from, 
-			 NULL, NULL, NULL, NULL);
-    if (code == TCL_ERROR) {
-	Tcl_AddErrorInfo(interp, "\n    (snmp agent event)");
-	Tcl_BackgroundError(interp);
-    }
-    if (code == TCL_CONTINUE && hexdump) {
-	TnmWriteMessage(Tcl_GetStringResult(interp));
-	TnmWriteMessage("\n");
+	code = TnmSnmpDecode(interp, packet, packetlen, &from, 
+			     NULL, NULL, NULL, NULL);
+	if (code == TCL_ERROR) {
+	    Tcl_AddErrorInfo(interp, "\n    (snmp agent event)");
+	    Tcl_BackgroundError(interp);
+	}
+	if (code == TCL_CONTINUE && hexdump) {
+	    TnmWriteMessage(Tcl_GetStringResult(interp));
+	    TnmWriteMessage("\n");
+	}
+	if (sockPtr->batchPtr->next >= sockPtr->batchPtr->count) break;
     }
+    Tcl_Release((ClientData) sockPtr);
+    Tcl_Release((ClientData) session);
+    TnmSnmpFlush();
 }
 
@@ -0,0 +1,640 @@
+/*
+ * tnmSnmpPoll.c --
+ *
+ *	This file implements poll groups. A poll group is a generator
+ *	session which sends the same request to a list of targets. The
+ *	PDU is encoded once and only the message header and the request
+ *	identifier are written for each target. The results are passed
+ *	to a Tcl callback in batches instead of evaluating one callback
+ *	per target.
+ *
+ * See the file "license.terms" for information on usage and redistribution
+ * of this file, and for a DISCLAIMER OF ALL WARRANTIES.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "tnmSnmp.h"
+
+/*
+ * Each poll keeps a copy of its targets so that the target list of
+ * the poll group can be modified while a poll is in progress. The
+ * requests of a poll refer to the address and the community stored
+ * in the target structures.
+ */
+
+struct Poll;
+
+typedef struct PollTarget {
+    struct Poll *pollPtr;	/* The poll this target belongs to. */
+    struct sockaddr_in addr;	/* The address of the target. */
+    Tcl_Obj *addrObj;		/* The address as given by the user. */
+    Tcl_Obj *community;		/* The community used for this target. */
+} PollTarget;
+
+typedef struct Poll {
+    TnmSnmp *session;		/* The poll group session. */
+    Tcl_Interp *interp;		/* The interpreter used for callbacks. */
+    Tcl_Obj *cmdObj;		/* The callback script. */
+    Tcl_Obj *resultObj;		/* Results not yet passed to the callback. */
+    int pending;		/* Number of outstanding requests. */
+    int idle;			/* Idle handler has been scheduled. */
+    int rates;			/* Convert counters into rates. */
+    int numTargets;		/* Number of targets. */
+    PollTarget *targets;	/* The targets of this poll. */
+    struct Poll *nextPtr;	/* Next poll in progress. */
+} Poll;
+
+static Poll *pollList = NULL;
+
+/*
+ * The request identifiers of poll requests are always encoded in
+ * four octets so that they can be patched into the PDU template.
+ * Results are passed to the callback once the event loop becomes
+ * idle or when POLL_BATCH results have been collected.
+ */
+
+#define POLL_MIN_ID	0x00800000
+#define POLL_BATCH	1000
+
+/*
+ * Forward declarations for procedures defined later in this file:
+ */
+
+static int
+ParseTargets		(Tcl_Interp *interp, Poll *pollPtr);
+
+static int
+RequestId		(void);
+
+static int
+EncodeMessage		(TnmSnmp *session, PollTarget *targetPtr,
+			 u_char *pduPacket, int pduLength, int offset,
+			 int id, u_char *packet);
+static void
+PollProc		(TnmSnmp *session, TnmSnmpPdu *pdu,
+			 ClientData clientData);
+static void
+PollIdleProc		(ClientData clientData);
+
+static void
+PollDeliver		(Poll *pollPtr);
+
+static void
+PollUnlink		(Poll *pollPtr);
+
+static void
+PollDestroyProc		(char *memPtr);
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * ParseTargets --
+ *
+ *	This procedure converts the target list of a poll group into
+ *	the target array of a poll. Each element of the target list
+ *	is a list with an address and an optional community string.
+ *
+ * Results:
+ *	A standard Tcl result.
+ *
+ * Side effects:
+ *	The target array of the poll is allocated.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+ParseTargets(Tcl_Interp *interp, Poll *pollPtr)
+{
+    TnmSnmp *session = pollPtr->session;
+    Tcl_Obj **objv, **elemv;
+    int i, objc, elemc;
+
+    if (! session->targets) {
+	return TCL_OK;
+    }
+    if (Tcl_ListObjGetElements(interp, session->targets,
+			       &objc, &objv) != TCL_OK) {
+	return TCL_ERROR;
+    }
+
+    pollPtr->targets = (PollTarget *) ckalloc(objc * sizeof(PollTarget) + 1);
+    for (i = 0; i < objc; i++) {
+	PollTarget *targetPtr = pollPtr->targets + i;
+
+	if (Tcl_ListObjGetElements(interp, objv[i], &elemc, &elemv) != TCL_OK) {
+	    return TCL_ERROR;
+	}
+	if (elemc < 1 || elemc > 2) {
+	    Tcl_AppendResult(interp, "illegal target \"",
+			     Tcl_GetString(objv[i]), "\"", (char *) NULL);
+	    return TCL_ERROR;
+	}
+	targetPtr->addr = session->maddr;
+	if (TnmSetIPAddress(interp, Tcl_GetString(elemv[0]),
+			    &targetPtr->addr) != TCL_OK) {
+	    return TCL_ERROR;
+	}
+	targetPtr->pollPtr = pollPtr;
+	targetPtr->addrObj = elemv[0];
+	Tcl_IncrRefCount(targetPtr->addrObj);
+	targetPtr->community = (elemc > 1) ? elemv[1] : session->community;
+	Tcl_IncrRefCount(targetPtr->community);
+	pollPtr->numTargets++;
+    }
+    return TCL_OK;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * RequestId --
+ *
+ *	This procedure generates an unused request identifier which
+ *	is encoded in exactly four octets.
+ *
+ * Results:
+ *	The request identifier.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+RequestId(void)
+{
+    int id;
+
+    do {
+	id = TnmSnmpGetRequestId() & 0x7fffffff;
+    } while (id < POLL_MIN_ID || TnmSnmpFindRequest(id));
+
+    return id;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * EncodeMessage --
+ *
+ *	This procedure builds the message for a target. It encodes
+ *	the message header, copies the PDU template and patches the
+ *	request identifier located at the given offset.
+ *
+ * Results:
+ *	The length of the message or 0 if the message does not fit
+ *	into the packet buffer.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+EncodeMessage(TnmSnmp *session, PollTarget *targetPtr, u_char *pduPacket, int pduLength, int offset, int id, u_char *packet)
+{
+    TnmBer _ber, *ber;
+    u_char *seqToken, *p;
+    char *community;
+    int communityLength;
+
+    community = Tcl_GetStringFromObj(targetPtr->community, &communityLength);
+
+    ber = TnmBerInit(&_ber, packet, TNM_SNMP_MAXSIZE);
+    ber = TnmBerEncSequenceStart(ber, ASN1_SEQUENCE, &seqToken);
+    ber = TnmBerEncInt(ber, ASN1_INTEGER,
+		       session->version == TNM_SNMPv1 ? 0 : 1);
+    ber = TnmBerEncOctetString(ber, ASN1_OCTET_STRING,
+			       community, communityLength);
+    if (! ber || ber->current + pduLength + 4 >= ber->end) {
+	return 0;
+    }
+
+    p = ber->current;
+    memcpy(p, pduPacket, (size_t) pduLength);
+    p[offset]     = (id >> 24) & 0xff;
+    p[offset + 1] = (id >> 16) & 0xff;
+    p[offset + 2] = (id >> 8) & 0xff;
+    p[offset + 3] = id & 0xff;
+    ber->current += pduLength;
+
+    ber = TnmBerEncSequenceEnd(ber, seqToken);
+    return ber ? TnmBerSize(ber) : 0;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * TnmSnmpPoll --
+ *
+ *	This procedure sends a request to all targets of a poll group.
+ *	The requests are queued like other asynchronous requests and
+ *	are therefore subject to the window and the pacing of the
+ *	poll group session. The callback is evaluated with batches
+ *	of results until all targets have responded or timed out.
+ *	Counter values are converted into per-second rates by
+ *	TnmSnmpRateVarBinds() if rates is set.
+ *
+ * Results:
+ *	A standard Tcl result. The number of targets polled is left
+ *	in the interpreter.
+ *
+ * Side effects:
+ *	Requests are queued.
+ *
+ *----------------------------------------------------------------------
+ */
+
+int
+TnmSnmpPoll(Tcl_Interp *interp, TnmSnmp *session, int type, int non, int max, int rates, Tcl_Obj *vbList, Tcl_Obj *cmdObj)
+{
+    TnmSnmpPdu _pdu, *pdu = &_pdu;
+    Poll *pollPtr;
+    u_char pduPacket[TNM_SNMP_MAXSIZE], packet[TNM_SNMP_MAXSIZE];
+    int i, pduLength = sizeof(pduPacket), offset, packetlen;
+
+    if (session->version != TNM_SNMPv1 && session->version != TNM_SNMPv2C) {
+	Tcl_SetResult(interp, "poll groups require SNMPv1 or SNMPv2c",
+		      TCL_STATIC);
+	return TCL_ERROR;
+    }
+
+    pollPtr = (Poll *) ckalloc(sizeof(Poll));
+    memset((char *) pollPtr, 0, sizeof(Poll));
+    pollPtr->session = session;
+    pollPtr->interp = interp;
+    pollPtr->rates = rates;
+    if (ParseTargets(interp, pollPtr) != TCL_OK) {
+	PollDestroyProc((char *) pollPtr);
+	return TCL_ERROR;
+    }
+
+    /*
+     * Encode the PDU template. SNMPv1 does not know getbulk, so
+     * we send getnext requests instead (see TnmSnmpEncode()).
+     */
+
+    memset((char *) pdu, 0, sizeof(TnmSnmpPdu));
+    pdu->type = type;
+    pdu->requestId = POLL_MIN_ID;
+    if (type == ASN1_SNMP_GETBULK) {
+	if (session->version == TNM_SNMPv1) {
+	    pdu->type = ASN1_SNMP_GETNEXT;
+	} else {
+	    pdu->errorStatus = non > 0 ? non : 0;
+	    pdu->errorIndex = max > 0 ? max : 0;
+	}
+    }
+    TnmSnmpPduSetVarBinds(pdu, vbList);
+    if (TnmSnmpEncodePDU(interp, session, pdu, pduPacket,
+			 &pduLength) != TCL_OK) {
+	TnmSnmpPduSetVarBinds(pdu, NULL);
+	PollDestroyProc((char *) pollPtr);
+	return TCL_ERROR;
+    }
+    TnmSnmpPduSetVarBinds(pdu, NULL);
+
+    offset = (pduPacket[1] & 0x80) ? 2 + (pduPacket[1] & 0x7f) : 2;
+    if (pduPacket[offset] != ASN1_INTEGER || pduPacket[offset + 1] != 4) {
+	Tcl_SetResult(interp, "failed to encode PDU template", TCL_STATIC);
+	PollDestroyProc((char *) pollPtr);
+	return TCL_ERROR;
+    }
+    offset += 2;
+
+    for (i = 0; i < pollPtr->numTargets; i++) {
+	if (! EncodeMessage(session, pollPtr->targets + i, pduPacket,
+			    pduLength, offset, POLL_MIN_ID, packet)) {
+	    Tcl_SetResult(interp, "message too big", TCL_STATIC);
+	    PollDestroyProc((char *) pollPtr);
+	    return TCL_ERROR;
+	}
+    }
+
+    if (pollPtr->numTargets == 0) {
+	PollDestroyProc((char *) pollPtr);
+	Tcl_SetObjResult(interp, Tcl_NewIntObj(0));
+	return TCL_OK;
+    }
+
+    pollPtr->cmdObj = cmdObj;
+    Tcl_IncrRefCount(pollPtr->cmdObj);
+    pollPtr->resultObj = Tcl_NewListObj(0, NULL);
+    Tcl_IncrRefCount(pollPtr->resultObj);
+    pollPtr->pending = pollPtr->numTargets;
+    pollPtr->nextPtr = pollList;
+    pollList = pollPtr;
+
+    /*
+     * Write the message header and the request identifier for each
+     * target and queue the requests.
+     */
+
+    for (i = 0; i < pollPtr->numTargets; i++) {
+	PollTarget *targetPtr = pollPtr->targets + i;
+	TnmSnmpRequest *request;
+	int id = RequestId();
+
+	packetlen = EncodeMessage(session, targetPtr, pduPacket, pduLength,
+				  offset, id, packet);
+	request = TnmSnmpCreateRequest(id, packet, packetlen, PollProc,
+				       (ClientData) targetPtr, interp);
+	request->to = &targetPtr->addr;
+	request->community = targetPtr->community;
+	TnmSnmpQueueRequest(session, request);
+
+	switch (pdu->type) {
+	case ASN1_SNMP_GET:
+	    tnmSnmpStats.snmpOutGetRequests++;
+	    break;
+	case ASN1_SNMP_GETNEXT:
+	    tnmSnmpStats.snmpOutGetNexts++;
+	    break;
+	}
+    }
+
+    Tcl_SetObjResult(interp, Tcl_NewIntObj(pollPtr->numTargets));
+    return TCL_OK;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * PollProc --
+ *
+ *	This procedure is called when a response for a poll request
+ *	has been received or when the request timed out. The result
+ *	is appended to the results of the poll.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	The callback may be evaluated or scheduled for evaluation.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+PollProc(TnmSnmp *session, TnmSnmpPdu *pdu, ClientData clientData)
+{
+    PollTarget *targetPtr = (PollTarget *) clientData;
+    Poll *pollPtr = targetPtr->pollPtr;
+    Tcl_Obj *elemv[4];
+    char *name;
+    int count;
+
+    name = TnmGetTableValue(tnmSnmpErrorTable, (unsigned) pdu->errorStatus);
+    elemv[0] = targetPtr->addrObj;
+    elemv[1] = Tcl_NewStringObj(name ? name : "unknown", -1);
+    elemv[2] = Tcl_NewIntObj(pdu->errorIndex - 1);
+    elemv[3] = pdu->vbList ? pdu->vbList : Tcl_NewObj();
+    if (pollPtr->rates && pdu->vbList
+	&& pdu->errorStatus == TNM_SNMP_NOERROR) {
+	TnmSnmpVarBindList *vblPtr;
+	vblPtr = TnmSnmpGetVarBindListFromObj(NULL, pdu->vbList, pdu->type);
+	if (vblPtr) {
+	    elemv[3] = TnmSnmpRateVarBinds(session, &targetPtr->addr, vblPtr);
+	    TnmSnmpReleaseVarBindList(vblPtr);
+	}
+    }
+    Tcl_ListObjAppendElement(NULL, pollPtr->resultObj,
+			     Tcl_NewListObj(4, elemv));
+    pollPtr->pending--;
+
+    Tcl_ListObjLength(NULL, pollPtr->resultObj, &count);
+    if (! pollPtr->pending || count >= POLL_BATCH) {
+	if (pollPtr->idle) {
+	    Tcl_CancelIdleCall(PollIdleProc, (ClientData) pollPtr);
+	    pollPtr->idle = 0;
+	}
+	PollDeliver(pollPtr);
+    } else if (! pollPtr->idle) {
+	Tcl_DoWhenIdle(PollIdleProc, (ClientData) pollPtr);
+	pollPtr->idle = 1;
+    }
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * PollIdleProc --
+ *
+ *	This procedure is called when the event loop becomes idle
+ *	to pass the results collected so far to the callback.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	The callback is evaluated.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+PollIdleProc(ClientData clientData)
+{
+    Poll *pollPtr = (Poll *) clientData;
+
+    pollPtr->idle = 0;
+    PollDeliver(pollPtr);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * PollDeliver --
+ *
+ *	This procedure evaluates the callback of a poll with the
+ *	results collected so far. The escape %L is replaced by the
+ *	list of results and %S by the name of the poll group. Each
+ *	result is a list with the target address, the error status,
+ *	the error index and the varbind list. The poll is removed
+ *	once the last result has been delivered.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	Tcl commands are evaluated which can have all kind of effects.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+PollDeliver(Poll *pollPtr)
+{
+    TnmSnmp *session = pollPtr->session;
+    Tcl_Interp *interp = pollPtr->interp;
+    Tcl_Obj *resultObj = pollPtr->resultObj;
+    Tcl_DString tclCmd;
+    char *startPtr, *scanPtr;
+    int code;
+
+    Tcl_Preserve((ClientData) pollPtr);
+    if (pollPtr->pending == 0) {
+	PollUnlink(pollPtr);
+    }
+
+    pollPtr->resultObj = Tcl_NewListObj(0, NULL);
+    Tcl_IncrRefCount(pollPtr->resultObj);
+
+    Tcl_DStringInit(&tclCmd);
+    startPtr = Tcl_GetString(pollPtr->cmdObj);
+    for (scanPtr = startPtr; *scanPtr != '\0'; scanPtr++) {
+	if (*scanPtr != '%') {
+	    continue;
+	}
+	Tcl_DStringAppend(&tclCmd, startPtr, scanPtr - startPtr);
+	scanPtr++;
+	startPtr = scanPtr + 1;
+	switch (*scanPtr) {
+	case 'L':
+	    Tcl_DStringAppend(&tclCmd, Tcl_GetString(resultObj), -1);
+	    break;
+	case 'S':
+	    if (session->token) {
+		Tcl_DStringAppend(&tclCmd,
+			  Tcl_GetCommandName(interp, session->token), -1);
+	    }
+	    break;
+	case '%':
+	    Tcl_DStringAppend(&tclCmd, "%", -1);
+	    break;
+	case '\0':
+	    startPtr = scanPtr--;
+	    Tcl_DStringAppend(&tclCmd, "%", -1);
+	    break;
+	default:
+	    Tcl_DStringAppend(&tclCmd, scanPtr - 1, 2);
+	    break;
+	}
+    }
+    Tcl_DStringAppend(&tclCmd, startPtr, scanPtr - startPtr);
+    Tcl_DecrRefCount(resultObj);
+
+    Tcl_Preserve((ClientData) interp);
+    Tcl_AllowExceptions(interp);
+    code = Tcl_GlobalEval(interp, Tcl_DStringValue(&tclCmd));
+    Tcl_DStringFree(&tclCmd);
+    if (code == TCL_ERROR) {
+	Tcl_AddErrorInfo(interp, "\n    (snmp poll callback)");
+	Tcl_BackgroundError(interp);
+    }
+    Tcl_ResetResult(interp);
+    Tcl_Release((ClientData) interp);
+    Tcl_Release((ClientData) pollPtr);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * PollUnlink --
+ *
+ *	This procedure removes a poll from the list of polls in
+ *	progress and frees it once it is not used anymore.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	The poll is freed eventually.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+PollUnlink(Poll *pollPtr)
+{
+    Poll **pPtrPtr;
+
+    for (pPtrPtr = &pollList; *pPtrPtr; pPtrPtr = &(*pPtrPtr)->nextPtr) {
+	if (*pPtrPtr == pollPtr) {
+	    *pPtrPtr = pollPtr->nextPtr;
+	    break;
+	}
+    }
+    if (pollPtr->idle) {
+	Tcl_CancelIdleCall(PollIdleProc, (ClientData) pollPtr);
+	pollPtr->idle = 0;
+    }
+    Tcl_EventuallyFree((ClientData) pollPtr, PollDestroyProc);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * PollDestroyProc --
+ *
+ *	This procedure is invoked by Tcl_EventuallyFree or Tcl_Release
+ *	to clean up the internal structure of a poll at a safe time.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	Everything associated with the poll is freed up.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+PollDestroyProc(char *memPtr)
+{
+    Poll *pollPtr = (Poll *) memPtr;
+    int i;
+
+    for (i = 0; i < pollPtr->numTargets; i++) {
+	Tcl_DecrRefCount(pollPtr->targets[i].addrObj);
+	Tcl_DecrRefCount(pollPtr->targets[i].community);
+    }
+    if (pollPtr->targets) {
+	ckfree((char *) pollPtr->targets);
+    }
+    if (pollPtr->cmdObj) {
+	Tcl_DecrRefCount(pollPtr->cmdObj);
+    }
+    if (pollPtr->resultObj) {
+	Tcl_DecrRefCount(pollPtr->resultObj);
+    }
+    ckfree((char *) pollPtr);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * TnmSnmpPollCancel --
+ *
+ *	This procedure discards all polls of a session. It is called
+ *	when a session is deleted after its requests have been removed.
+ *	Results which have not yet been delivered are discarded.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	The polls of the session are freed eventually.
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+TnmSnmpPollCancel(TnmSnmp *session)
+{
+    Poll *pollPtr, *nextPtr;
+
+    for (pollPtr = pollList; pollPtr; pollPtr = nextPtr) {
+	nextPtr = pollPtr->nextPtr;
+	if (pollPtr->session == session) {
+	    PollUnlink(pollPtr);
+	}
+    }
+}
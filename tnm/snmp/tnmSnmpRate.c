@@ -0,0 +1,464 @@
+/*
+ * tnmSnmpRate.c --
+ *
+ *	This file implements the computation of rates from polled
+ *	counters. The last sample of each counter is kept in a hash
+ *	table indexed by the agent address and the object identifier
+ *	so that per-second rates are computed when a response is
+ *	decoded and no Tcl code has to be evaluated for each sample.
+ *	Samples of counters which are no longer polled are expired.
+ *
+ * See the file "license.terms" for information on usage and redistribution
+ * of this file, and for a DISCLAIMER OF ALL WARRANTIES.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "tnmSnmp.h"
+
+/*
+ * The key of a sample is the IPv4 address and the port of the agent
+ * followed by the sub-identifiers of the counter. The sample and a
+ * copy of the key are allocated together with the hash entry so that
+ * each counter requires a single allocation.
+ */
+
+typedef struct RateKey {
+    int length;			/* Number of words used. */
+    u_int words[TNM_OID_MAX_SIZE + 2];
+} RateKey;
+
+typedef struct RateSample {
+    TnmUnsigned64 value;	/* The counter value of the last sample. */
+    double time;		/* The time of the last sample in seconds. */
+    Tcl_WideInt seen;		/* The local time of the last sample in ms. */
+    Tcl_WideInt gap;		/* The local time between the last two
+				 * samples in ms or 0 for the first one. */
+    u_char syntax;		/* The syntax of the last sample. */
+    u_char uptime;		/* The time was taken from sysUpTime.0. */
+} RateSample;
+
+#define KEY_SIZE(length)	(sizeof(int) + (length) * sizeof(u_int))
+
+/*
+ * The samples of a session. The table is swept at most once every
+ * RATE_SWEEP ms. A sample expires if it has not been updated for
+ * RATE_ROUNDS times the time between its last two updates, but not
+ * before RATE_MIN ms have passed. Samples which were updated only
+ * once use the largest time between two updates found by the last
+ * sweep instead, or RATE_FIRST ms if there is none yet.
+ */
+
+typedef struct TnmSnmpRates {
+    Tcl_HashTable table;	/* The samples indexed by RateKey. */
+    Tcl_WideInt sweep;		/* The local time of the next sweep in ms. */
+    Tcl_WideInt maxGap;		/* The largest gap found by the last sweep. */
+} TnmSnmpRates;
+
+#define RATE_SWEEP	30000
+#define RATE_ROUNDS	4
+#define RATE_MIN	60000
+#define RATE_FIRST	7200000
+
+/*
+ * The object identifier of sysUpTime.0, which is used as the time
+ * base if it is contained in a response.
+ */
+
+static Tnm_Oid sysUpTimeOid[] = { 1, 3, 6, 1, 2, 1, 1, 3, 0 };
+
+#define SYSUPTIME_LENGTH (sizeof(sysUpTimeOid) / sizeof(Tnm_Oid))
+
+/*
+ * Forward declarations for procedures defined later in this file:
+ */
+
+static unsigned int
+HashRateKey		(Tcl_HashTable *tablePtr, void *keyPtr);
+
+static int
+CompareRateKeys		(void *keyPtr, Tcl_HashEntry *hPtr);
+
+static Tcl_HashEntry*
+AllocRateEntry		(Tcl_HashTable *tablePtr, void *keyPtr);
+
+static void
+FreeRateEntry		(Tcl_HashEntry *hPtr);
+
+static int
+SampleRate		(RateSample *samplePtr, int isNew,
+			 TnmSnmpVarBind *vbPtr, double now, int uptime,
+			 double *ratePtr);
+
+static void
+ExpireRates		(TnmSnmpRates *ratesPtr, Tcl_WideInt now);
+
+static Tcl_HashKeyType rateKeyType = {
+    TCL_HASH_KEY_TYPE_VERSION,	/* version */
+    0,				/* flags */
+    HashRateKey,		/* hashKeyProc */
+    CompareRateKeys,		/* compareKeysProc */
+    AllocRateEntry,		/* allocEntryProc */
+    FreeRateEntry		/* freeEntryProc */
+};
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HashRateKey --
+ *
+ *	This procedure computes the hash value of a sample key.
+ *
+ * Results:
+ *	The hash value.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static unsigned int
+HashRateKey(Tcl_HashTable *tablePtr, void *keyPtr)
+{
+    RateKey *key = (RateKey *) keyPtr;
+    unsigned int hash = 2166136261U;
+    int i;
+
+    for (i = 0; i < key->length; i++) {
+	hash = (hash ^ key->words[i]) * 16777619U;
+    }
+    return hash;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * CompareRateKeys --
+ *
+ *	This procedure compares a sample key with the key of a
+ *	hash entry.
+ *
+ * Results:
+ *	1 if the keys are equal and 0 otherwise.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+CompareRateKeys(void *keyPtr, Tcl_HashEntry *hPtr)
+{
+    RateKey *key1 = (RateKey *) keyPtr;
+    RateKey *key2 = (RateKey *) hPtr->key.oneWordValue;
+
+    return key1->length == key2->length
+	&& memcmp(key1->words, key2->words,
+		  key1->length * sizeof(u_int)) == 0;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * AllocRateEntry --
+ *
+ *	This procedure allocates a hash entry together with an empty
+ *	sample and a copy of the key.
+ *
+ * Results:
+ *	A pointer to the new hash entry.
+ *
+ * Side effects:
+ *	Memory is allocated.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static Tcl_HashEntry*
+AllocRateEntry(Tcl_HashTable *tablePtr, void *keyPtr)
+{
+    RateKey *key = (RateKey *) keyPtr;
+    Tcl_HashEntry *hPtr;
+    RateSample *samplePtr;
+
+    hPtr = (Tcl_HashEntry *) ckalloc(sizeof(Tcl_HashEntry)
+		     + sizeof(RateSample) + KEY_SIZE(key->length));
+    samplePtr = (RateSample *) (hPtr + 1);
+    memset((char *) samplePtr, 0, sizeof(RateSample));
+    memcpy((char *) (samplePtr + 1), (char *) key, KEY_SIZE(key->length));
+    hPtr->key.oneWordValue = (char *) (samplePtr + 1);
+    hPtr->clientData = (ClientData) samplePtr;
+    return hPtr;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * FreeRateEntry --
+ *
+ *	This procedure frees a hash entry allocated by AllocRateEntry().
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	Memory is freed.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+FreeRateEntry(Tcl_HashEntry *hPtr)
+{
+    ckfree((char *) hPtr);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * SampleRate --
+ *
+ *	This procedure stores a new sample of a counter and computes
+ *	the rate since the previous sample. Counter32 values are
+ *	assumed to have wrapped once if they decreased. A decreasing
+ *	Counter64 value, a sysUpTime.0 value which went backwards or
+ *	a change of the syntax or the time base is a discontinuity
+ *	and the new sample starts a new series.
+ *
+ * Results:
+ *	1 if a rate has been stored in ratePtr and 0 otherwise.
+ *
+ * Side effects:
+ *	The sample is updated.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+SampleRate(RateSample *samplePtr, int isNew, TnmSnmpVarBind *vbPtr, double now, int uptime, double *ratePtr)
+{
+    TnmUnsigned64 value;
+    double delta = 0;
+    int valid = 0;
+
+    if (vbPtr->syntax == ASN1_COUNTER64) {
+	value = vbPtr->value.u64Value;
+    } else {
+	value = (unsigned) vbPtr->value.intValue;
+    }
+
+    if (! isNew && samplePtr->syntax == vbPtr->syntax
+	&& samplePtr->uptime == uptime) {
+	if (now == samplePtr->time) {
+	    return 0;
+	}
+	if (now > samplePtr->time) {
+	    if (value >= samplePtr->value) {
+		delta = (double) (value - samplePtr->value);
+		valid = 1;
+	    } else if (vbPtr->syntax == ASN1_COUNTER32) {
+		delta = 4294967296.0 - (double) (samplePtr->value - value);
+		valid = 1;
+	    }
+	    if (valid) {
+		*ratePtr = delta / (now - samplePtr->time);
+	    }
+	}
+    }
+
+    samplePtr->value = value;
+    samplePtr->time = now;
+    samplePtr->syntax = vbPtr->syntax;
+    samplePtr->uptime = uptime;
+    return valid;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * ExpireRates --
+ *
+ *	This procedure removes the samples of counters which are no
+ *	longer polled, e.g. because the target was removed from the
+ *	poll group or because it stopped responding. The table is
+ *	only swept every RATE_SWEEP ms so that the costs per sample
+ *	do not depend on the number of samples.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	Expired samples are freed.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+ExpireRates(TnmSnmpRates *ratesPtr, Tcl_WideInt now)
+{
+    Tcl_HashEntry *entryPtr;
+    Tcl_HashSearch search;
+    RateSample *samplePtr;
+    Tcl_WideInt gap, lifetime, maxGap = 0;
+
+    if (now < ratesPtr->sweep) {
+	return;
+    }
+    ratesPtr->sweep = now + RATE_SWEEP;
+
+    for (entryPtr = Tcl_FirstHashEntry(&ratesPtr->table, &search);
+	 entryPtr; entryPtr = Tcl_NextHashEntry(&search)) {
+	samplePtr = (RateSample *) Tcl_GetHashValue(entryPtr);
+	gap = samplePtr->gap ? samplePtr->gap : ratesPtr->maxGap;
+	lifetime = gap ? RATE_ROUNDS * gap : RATE_FIRST;
+	if (lifetime < RATE_MIN) {
+	    lifetime = RATE_MIN;
+	}
+	if (now - samplePtr->seen > lifetime) {
+	    Tcl_DeleteHashEntry(entryPtr);
+	} else if (samplePtr->gap > maxGap) {
+	    maxGap = samplePtr->gap;
+	}
+    }
+    ratesPtr->maxGap = maxGap;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * TnmSnmpRateVarBinds --
+ *
+ *	This procedure converts the Counter32 and Counter64 values of
+ *	a response received from addr into per-second rates. The time
+ *	base is the value of sysUpTime.0 if the response contains it
+ *	and the local clock otherwise. Only sysUpTime.0 allows to
+ *	detect agent restarts. The rate of a counter is an empty
+ *	string until two consecutive samples are available.
+ *
+ * Results:
+ *	A new Tcl list of varbinds where counter values are replaced
+ *	by rates. Other values are converted as in varbind lists.
+ *
+ * Side effects:
+ *	The samples of the session are updated and expired.
+ *
+ *----------------------------------------------------------------------
+ */
+
+Tcl_Obj*
+TnmSnmpRateVarBinds(TnmSnmp *session, struct sockaddr_in *addr, TnmSnmpVarBindList *vblPtr)
+{
+    RateKey key;
+    Tcl_Obj *listPtr, *elemv[3];
+    Tcl_Time time;
+    Tcl_WideInt seen;
+    double now = 0, rate;
+    int i, isNew, uptime = 0;
+
+    Tcl_GetTime(&time);
+    seen = (Tcl_WideInt) time.sec * 1000 + time.usec / 1000;
+
+    if (! session->rates) {
+	session->rates = (TnmSnmpRates *) ckalloc(sizeof(TnmSnmpRates));
+	Tcl_InitCustomHashTable(&session->rates->table, TCL_CUSTOM_TYPE_KEYS,
+				&rateKeyType);
+	session->rates->sweep = seen + RATE_SWEEP;
+	session->rates->maxGap = 0;
+    }
+    ExpireRates(session->rates, seen);
+
+    for (i = 0; i < vblPtr->numVarBinds; i++) {
+	TnmSnmpVarBind *vbPtr = vblPtr->varBinds + i;
+	if (vbPtr->syntax == ASN1_TIMETICKS
+	    && vbPtr->oidLength == SYSUPTIME_LENGTH
+	    && memcmp(TnmSnmpVarBindOid(vblPtr, vbPtr), sysUpTimeOid,
+		      sizeof(sysUpTimeOid)) == 0) {
+	    now = (unsigned) vbPtr->value.intValue / 100.0;
+	    uptime = 1;
+	    break;
+	}
+    }
+    if (! uptime) {
+	now = time.sec + time.usec / 1000000.0;
+    }
+
+    key.words[0] = addr->sin_addr.s_addr;
+    key.words[1] = addr->sin_port;
+
+    listPtr = Tcl_NewListObj(0, NULL);
+    for (i = 0; i < vblPtr->numVarBinds; i++) {
+	TnmSnmpVarBind *vbPtr = vblPtr->varBinds + i;
+	char *syntax;
+
+	elemv[0] = Tcl_NewStringObj(TnmOidToStr(TnmSnmpVarBindOid(vblPtr,
+			   vbPtr), vbPtr->oidLength), -1);
+	if (TnmSnmpException(vbPtr->syntax)) {
+	    syntax = TnmGetTableValue(tnmSnmpExceptionTable, vbPtr->syntax);
+	} else {
+	    syntax = TnmGetTableValue(tnmSnmpTypeTable, vbPtr->syntax);
+	}
+	elemv[1] = Tcl_NewStringObj(syntax ? syntax : "Opaque", -1);
+
+	if (vbPtr->syntax == ASN1_COUNTER32
+	    || vbPtr->syntax == ASN1_COUNTER64) {
+	    Tcl_HashEntry *entryPtr;
+	    RateSample *samplePtr;
+	    key.length = vbPtr->oidLength + 2;
+	    memcpy(key.words + 2, TnmSnmpVarBindOid(vblPtr, vbPtr),
+		   vbPtr->oidLength * sizeof(u_int));
+	    entryPtr = Tcl_CreateHashEntry(&session->rates->table,
+					   (char *) &key, &isNew);
+	    samplePtr = (RateSample *) Tcl_GetHashValue(entryPtr);
+	    if (! isNew) {
+		samplePtr->gap = seen - samplePtr->seen;
+	    }
+	    samplePtr->seen = seen;
+	    if (SampleRate(samplePtr, isNew, vbPtr, now, uptime, &rate)) {
+		elemv[2] = Tcl_NewDoubleObj(rate);
+	    } else {
+		elemv[2] = Tcl_NewObj();
+	    }
+	} else {
+	    elemv[2] = TnmSnmpGetVarBindValue(vblPtr, vbPtr);
+	}
+	Tcl_ListObjAppendElement(NULL, listPtr, Tcl_NewListObj(3, elemv));
+    }
+
+    return listPtr;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * TnmSnmpRateFree --
+ *
+ *	This procedure discards all samples of a session.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	Memory is freed.
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+TnmSnmpRateFree(TnmSnmp *session)
+{
+    if (session->rates) {
+	Tcl_DeleteHashTable(&session->rates->table);
+	ckfree((char *) session->rates);
+	session->rates = NULL;
+    }
+}
+
+/*
+ * Local Variables:
+ * compile-command: "make -k -C ../../unix"
+ * End:
+ */
@@ -57,8 +57,47 @@ typedef struct Message {
     int engineIDLength;
     int engineBoots;
     int engineTime;
+    u_char *privParam;
+    int privParamLen;
+    u_char *encryptedPdu;
+    int encryptedPduLen;
+    TnmSnmp *privSession;
+    int badVersion;
+    TnmSnmpVarBindList *vblPtr;
 } Message;
 
+/*
+ * A message decoded by an engine thread. The message is decoded
+ * from the copy of the packet which follows the structure so that
+ * the pointers into the packet stay valid until the message is
+ * dispatched by the interpreter thread.
+ */
+
+typedef struct Decoded {
+    TnmSnmpMessage message;	/* The public part of the message. */
+    int code;			/* The result of DecodeMessage(). */
+    Message msg;		/* The decoded message header. */
+    TnmSnmpPdu pdu;		/* The decoded PDU. */
+} Decoded;
+
+/*
+ * The object identifiers added to the varbind list of SNMPv1 traps.
+ * They are kept here instead of being converted with TnmStrToOid(),
+ * which uses a static buffer, since messages may be decoded by
+ * engine threads.
+ */
+
+static Tnm_Oid sysUpTimeOid[] = { 1, 3, 6, 1, 2, 1, 1, 3, 0 };
+static Tnm_Oid snmpTrapOidOid[] = { 1, 3, 6, 1, 6, 3, 1, 1, 4, 1, 0 };
+static Tnm_Oid snmpTrapEnterpriseOid[] = { 1, 3, 6, 1, 6, 3, 1, 1, 4, 3, 0 };
+static Tnm_Oid snmpTrapsOid[] = { 1, 3, 6, 1, 6, 3, 1, 1, 5 };
+
+#ifdef TNM_SNMPv3
+static Tnm_Oid usmStatsUnknownEngineIDsOid[] = { 1, 3, 6, 1, 6, 3, 15, 1, 1, 4 };
+#endif
+
+#define OID_LENGTH(oid)	(sizeof(oid) / sizeof(Tnm_Oid))
+
 /*
  * Forward declarations for procedures defined later in this file:
  */
@@ -68,16 +107,44 @@ Authentic		(TnmSnmp *session,
 				     Message *msg, TnmSnmpPdu *pdu,
 				     u_char *packet, int packetlen,
 				     u_int **snmpStatPtr);
+#ifdef TNM_SNMPv3
+static int
+CanDecrypt		(TnmSnmp *session, Message *msg,
+				     u_char *packet, int packetlen);
+static int
+SameKeys		(TnmSnmp *session1, TnmSnmp *session2);
+static int
+DecryptScopedPDU	(Message *msg, TnmSnmpPdu *pdu,
+				     u_char *packet, int packetlen,
+				     TnmSnmp *session);
+static int
+ReportUnknownEngine	(Tcl_Interp *interp, Message *msg,
+				     struct sockaddr_in *from);
+static int
+IsUnknownEngineReport	(TnmSnmpPdu *pdu);
+static int
+LearnEngine		(TnmSnmp *session, TnmSnmpRequest *request,
+				     Message *msg);
+#endif
 
 static int
-DecodeMessage		(Tcl_Interp	*interp, 
-				     Message *msg, TnmSnmpPdu *pdu,
+AuthenticCommunity	(Tcl_Obj *community, Message *msg);
+
+static int
+DecodeMessage		(Message *msg, TnmSnmpPdu *pdu,
 				     TnmBer *ber);
+static int
+Dispatch		(Tcl_Interp *interp, Message *msg,
+				     TnmSnmpPdu *pdu, u_char *packet,
+				     int packetlen, struct sockaddr_in *from,
+				     TnmSnmp *session, int *reqid,
+				     int *status, int *index);
 static TnmBer*
 DecodeHeader		(Message *msg, TnmSnmpPdu *pdu,
 				     TnmBer *ber);
 static TnmBer*
-DecodeScopedPDU		(TnmBer *ber, TnmSnmpPdu *pdu);
+DecodeScopedPDU		(TnmBer *ber, TnmSnmpPdu *pdu,
+				     TnmSnmpVarBindList **vblPtrPtr);
 
 static TnmBer*
 DecodeUsmSecParams	(Message *msg, TnmSnmpPdu *pdu,
@@ -95,7 +162,8 @@ SendUsecReport		(Tcl_Interp *interp,
 #endif
 
 static TnmBer*
-DecodePDU		(TnmBer *ber, TnmSnmpPdu *pdu);
+DecodePDU		(TnmBer *ber, TnmSnmpPdu *pdu,
+				     TnmSnmpVarBindList **vblPtrPtr);
 
 
 /*
@@ -121,26 +189,194 @@ TnmSnmpDecode(Tcl_Interp *interp, u_char *packet, int	packetlen, struct sockaddr
 {
     TnmSnmpPdu _pdu, *pdu = &_pdu;
     Message _msg, *msg = &_msg;
-    TnmSnmpRequest *request = NULL;
-    int code, delivered = 0;
-    TnmBer *ber;
+    TnmBer _ber, *ber;
 
     if (reqid) {
 	*reqid = 0;
     }
     memset((char *) msg, 0, sizeof(Message));
-    Tcl_DStringInit(&pdu->varbind);
+    pdu->vbList = NULL;
     pdu->addr = *from;
 
     tnmSnmpStats.snmpInPkts++;
-    ber = TnmBerCreate(packet, packetlen);
-    code = DecodeMessage(interp, msg, pdu, ber);
-    TnmBerDelete(ber);
-    if (code == TCL_ERROR) {
-	Tcl_DStringFree(&pdu->varbind);
+    ber = TnmBerInit(&_ber, packet, packetlen);
+    if (DecodeMessage(msg, pdu, ber) != TCL_OK) {
+	if (msg->badVersion) {
+	    tnmSnmpStats.snmpInBadVersions++;
+	}
+	tnmSnmpStats.snmpInASNParseErrs++;
+	Tcl_SetResult(interp, TnmBerGetError(ber), TCL_VOLATILE);
 	return TCL_ERROR;
     }
 
+    return Dispatch(interp, msg, pdu, packet, packetlen, from,
+		    session, reqid, status, index);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * TnmSnmpDecodeMessage --
+ *
+ *	This procedure decodes a copy of a packet without touching
+ *	any session, request or statistics. It is called by engine
+ *	threads and may therefore not use the Tcl interpreter. Any
+ *	errors are reported when the message is dispatched.
+ *
+ * Results:
+ *	A pointer to the new message.
+ *
+ * Side effects:
+ *	Memory is allocated.
+ *
+ *----------------------------------------------------------------------
+ */
+
+TnmSnmpMessage*
+TnmSnmpDecodeMessage(u_char *packet, int packetlen, struct sockaddr_in *from)
+{
+    Decoded *decPtr;
+    TnmBer ber;
+
+    decPtr = (Decoded *) ckalloc(sizeof(Decoded) + packetlen);
+    memset((char *) decPtr, 0, sizeof(Decoded));
+    decPtr->message.from = *from;
+    decPtr->message.packetlen = packetlen;
+    decPtr->message.packet = (u_char *) (decPtr + 1);
+    memcpy(decPtr->message.packet, packet, (size_t) packetlen);
+
+    decPtr->pdu.addr = *from;
+    TnmBerInit(&ber, decPtr->message.packet, packetlen);
+    decPtr->code = DecodeMessage(&decPtr->msg, &decPtr->pdu, &ber);
+    return (TnmSnmpMessage *) decPtr;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * TnmSnmpDispatchMessage --
+ *
+ *	This procedure does all required actions for a message
+ *	decoded by TnmSnmpDecodeMessage(). Messages which could not
+ *	be decoded are passed to TnmSnmpDecode() again so that the
+ *	statistics and the error message are the same as without
+ *	engine threads.
+ *
+ * Results:
+ *	A standard Tcl result.
+ *
+ * Side effects:
+ *	Callbacks are evaluated.
+ *
+ *----------------------------------------------------------------------
+ */
+
+int
+TnmSnmpDispatchMessage(Tcl_Interp *interp, TnmSnmpMessage *msgPtr)
+{
+    Decoded *decPtr = (Decoded *) msgPtr;
+
+    if (decPtr->code != TCL_OK) {
+	return TnmSnmpDecode(interp, msgPtr->packet, msgPtr->packetlen,
+			     &msgPtr->from, NULL, NULL, NULL, NULL);
+    }
+
+    tnmSnmpStats.snmpInPkts++;
+    return Dispatch(interp, &decPtr->msg, &decPtr->pdu, msgPtr->packet,
+		    msgPtr->packetlen, &msgPtr->from, NULL, NULL, NULL, NULL);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * TnmSnmpFreeMessage --
+ *
+ *	This procedure frees a message created by TnmSnmpDecodeMessage().
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	Memory is freed.
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+TnmSnmpFreeMessage(TnmSnmpMessage *msgPtr)
+{
+    Decoded *decPtr = (Decoded *) msgPtr;
+
+    if (decPtr->msg.vblPtr) {
+	TnmSnmpReleaseVarBindList(decPtr->msg.vblPtr);
+    }
+    ckfree((char *) decPtr);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * Dispatch --
+ *
+ *	This procedure does all required actions for a decoded
+ *	message (mostly executing callbacks or doing gets/sets in
+ *	the agent module). The varbind list of the message is moved
+ *	into a Tcl object first.
+ *
+ * Results:
+ *	A standard Tcl result.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+Dispatch(Tcl_Interp *interp, Message *msg, TnmSnmpPdu *pdu, u_char *packet, int packetlen, struct sockaddr_in *from, TnmSnmp *session, int *reqid, int *status, int *index)
+{
+    TnmSnmpRequest *request = NULL;
+    int delivered = 0;
+
+#ifdef TNM_SNMPv3
+    if (msg->version == TNM_SNMPv3 && ! session
+	&& *msg->msgFlags & TNM_SNMP_FLAG_REPORT
+	&& ReportUnknownEngine(interp, msg, from)) {
+	return TCL_CONTINUE;
+    }
+    if (msg->encryptedPdu
+	&& ! DecryptScopedPDU(msg, pdu, packet, packetlen, session)) {
+	return TCL_CONTINUE;
+    }
+#endif
+
+    TnmSnmpPduSetVarBinds(pdu, TnmSnmpNewVarBindListObj(msg->vblPtr));
+    TnmSnmpReleaseVarBindList(msg->vblPtr);
+    msg->vblPtr = NULL;
+
+    /*
+     * Update our SNMP statistics if we got an error-status which
+     * is counted in the SNMP MIB.
+     */
+
+    switch (pdu->errorStatus) {
+      case TNM_SNMP_TOOBIG:
+	  tnmSnmpStats.snmpInTooBigs++;
+	  break;
+      case TNM_SNMP_NOSUCHNAME:
+	  tnmSnmpStats.snmpInNoSuchNames++;
+	  break;
+      case TNM_SNMP_BADVALUE:
+	  tnmSnmpStats.snmpInBadValues++;
+	  break;
+      case TNM_SNMP_READONLY:
+	  tnmSnmpStats.snmpInReadOnlys++;
+	  break;
+      case TNM_SNMP_GENERR:
+	  tnmSnmpStats.snmpInGenErrs++;
+	  break;
+    }
+
     /*
      * Show the contents of the PDU - mostly for debugging.
      */
@@ -154,7 +390,7 @@ TnmSnmpDecode(Tcl_Interp *interp, u_char *packet, int	packetlen, struct sockaddr
 	    s = request->session;
 	}
 	if (! s) {
-	    Tcl_DStringFree(&pdu->varbind);
+	    TnmSnmpPduSetVarBinds(pdu, NULL);
 	    return TCL_CONTINUE;
 	}
 
@@ -167,11 +403,51 @@ TnmSnmpDecode(Tcl_Interp *interp, u_char *packet, int	packetlen, struct sockaddr
 
 	TnmSnmpEvalBinding(interp, s, pdu, TNM_SNMP_RECV_EVENT);
 
-	TnmSetOctetStringObj(s->engineID, msg->engineID, msg->engineIDLength);
-	s->engineBoots = msg->engineBoots;
-	s->engineTime = msg->engineTime;
+	/*
+	 * Reports are not authenticated during discovery, so anyone
+	 * could forge them. The engineID of an unauthenticated report
+	 * is only accepted if it reports an unknown engineID to a
+	 * session which still waits for discovery (RFC 3414 section
+	 * 4). The engineBoots and engineTime are only accepted from
+	 * an authenticated report, and only authenticated messages
+	 * update the engine cache shared by all sessions. The waiting
+	 * requests of the session are encoded again if the engine
+	 * does not accept the old parameters and the request is resent.
+	 */
+
+	if (msg->engineIDLength > 0) {
+	    TnmSnmpRequest *rPtr;
+	    int stale = 0, engineIDLength;
+
+	    (void) TnmGetOctetStringFromObj(NULL, s->engineID,
+					    &engineIDLength);
+	    if (*msg->msgFlags & TNM_SNMP_FLAG_AUTH) {
+		if (Authentic(s, msg, pdu, packet, packetlen, NULL)) {
+		    stale = LearnEngine(s, request, msg);
+		}
+	    } else if (engineIDLength == 0 && IsUnknownEngineReport(pdu)) {
+		stale = TnmSnmpSetEngine(s, msg->engineID, msg->engineIDLength,
+					 s->engineBoots, s->engineTime);
+	    }
+	    if (! stale) {
+		TnmSnmpPduSetVarBinds(pdu, NULL);
+		return TCL_CONTINUE;
+	    }
+	    for (rPtr = s->waitHead; rPtr; rPtr = rPtr->nextPtr) {
+		(void) TnmSnmpReencodeRequest(rPtr);
+	    }
+	    if (request && request->pdu && request->sends
+		&& TnmSnmpReencodeRequest(request) == TCL_OK) {
+		(void) TnmSnmpPace(s, request->packetlen);
+		TnmSnmpSend(interp, s, request->packet, request->packetlen,
+			    request->to ? request->to : &s->maddr,
+			    TNM_SNMP_ASYNC);
+		TnmSnmpStartTimer(request,
+				  (s->timeout * 1000) / (s->retries + 1));
+	    }
+	}
 	
-	Tcl_DStringFree(&pdu->varbind);
+	TnmSnmpPduSetVarBinds(pdu, NULL);
 	return TCL_BREAK;
     }
 
@@ -205,7 +481,7 @@ TnmSnmpDecode(Tcl_Interp *interp, u_char *packet, int	packetlen, struct sockaddr
 	    s = request->session;
 	}
 	if (! s) {
-	    Tcl_DStringFree(&pdu->varbind);
+	    TnmSnmpPduSetVarBinds(pdu, NULL);
 	    return TCL_CONTINUE;
 	}
 
@@ -255,12 +531,12 @@ TnmSnmpDecode(Tcl_Interp *interp, u_char *packet, int	packetlen, struct sockaddr
 	    
 	    if (request) {
 		TnmSnmpUsecAuth(s, request->packet, request->packetlen);
-		TnmSnmpDelay(s);
+		(void) TnmSnmpPace(s, request->packetlen);
 		TnmSnmpSend(interp, s, request->packet, request->packetlen,
 			    &s->maddr, TNM_SNMP_ASYNC);
 	    }
 	}
-	Tcl_DStringFree(&pdu->varbind);
+	TnmSnmpPduSetVarBinds(pdu, NULL);
 	return TCL_BREAK;
     }
 #endif
@@ -285,7 +561,7 @@ TnmSnmpDecode(Tcl_Interp *interp, u_char *packet, int	packetlen, struct sockaddr
 
 	if (! request) {
 	    if (! session) {
-		Tcl_DStringFree(&pdu->varbind);
+		TnmSnmpPduSetVarBinds(pdu, NULL);
 		return TCL_CONTINUE;
 	    }
 	    
@@ -295,9 +571,12 @@ TnmSnmpDecode(Tcl_Interp *interp, u_char *packet, int	packetlen, struct sockaddr
 
 	    if (! Authentic(session, msg, pdu, packet, packetlen, NULL)) {
 		Tcl_SetResult(interp, "authentication failure", TCL_STATIC);
-		Tcl_DStringFree(&pdu->varbind);
+		TnmSnmpPduSetVarBinds(pdu, NULL);
 		return TCL_CONTINUE;
 	    }
+#ifdef TNM_SNMPv3
+	    (void) LearnEngine(session, NULL, msg);
+#endif
 
 	    TnmSnmpEvalBinding(interp, session, pdu, TNM_SNMP_RECV_EVENT);
 	    
@@ -310,26 +589,35 @@ TnmSnmpDecode(Tcl_Interp *interp, u_char *packet, int	packetlen, struct sockaddr
 				 (char *) NULL);
 		sprintf(buf, " %d ", pdu->errorIndex - 1);
 		Tcl_AppendResult(interp, buf, 
-				  Tcl_DStringValue(&pdu->varbind),
-				  (char *) NULL);
-		Tcl_DStringFree(&pdu->varbind);
+				 pdu->vbList ? Tcl_GetString(pdu->vbList) : "",
+				 (char *) NULL);
+		TnmSnmpPduSetVarBinds(pdu, NULL);
 		if (status) *status = pdu->errorStatus;
 		if (index) *index = pdu->errorIndex;
 		return TCL_ERROR;
 	    }
-	    Tcl_ResetResult(interp);
-	    Tcl_DStringResult(interp, &pdu->varbind);
+	    if (pdu->vbList) {
+		Tcl_SetObjResult(interp, pdu->vbList);
+	    } else {
+		Tcl_ResetResult(interp);
+	    }
+	    TnmSnmpPduSetVarBinds(pdu, NULL);
 	    return TCL_OK;
 
 	} else {
 
 	    session = request->session;
 
-	    if (! Authentic(session, msg, pdu, packet, packetlen, NULL)) {
+	    if (! (request->community
+		   ? AuthenticCommunity(request->community, msg)
+		   : Authentic(session, msg, pdu, packet, packetlen, NULL))) {
 		Tcl_SetResult(interp, "authentication failure", TCL_STATIC);
-		Tcl_DStringFree(&pdu->varbind);
+		TnmSnmpPduSetVarBinds(pdu, NULL);
 		return TCL_CONTINUE;
 	    }
+#ifdef TNM_SNMPv3
+	    (void) LearnEngine(session, request, msg);
+#endif
 
 #ifdef TNM_SNMP_BENCH
 	    request->stats.recvSize = tnmSnmpBenchMark.recvSize;
@@ -359,7 +647,7 @@ TnmSnmpDecode(Tcl_Interp *interp, u_char *packet, int	packetlen, struct sockaddr
 	     * Free response message structure.
 	     */
 	    
-	    Tcl_DStringFree(&pdu->varbind);
+	    TnmSnmpPduSetVarBinds(pdu, NULL);
 	    return TCL_OK;
 	}
     }
@@ -413,7 +701,7 @@ TnmSnmpDecode(Tcl_Interp *interp, u_char *packet, int	packetlen, struct sockaddr
 		pdu->type = ASN1_SNMP_RESPONSE;
 		if (TnmSnmpEncode(interp, session, pdu, NULL, NULL)
 		    != TCL_OK) {
-		    Tcl_DStringFree(&pdu->varbind);
+		    TnmSnmpPduSetVarBinds(pdu, NULL);
 		    return TCL_ERROR;
 		}
             }
@@ -429,7 +717,7 @@ TnmSnmpDecode(Tcl_Interp *interp, u_char *packet, int	packetlen, struct sockaddr
 		if (Authentic(session, msg, pdu, packet, packetlen, &statPtr)) {
 		    TnmSnmpEvalBinding(interp, session, pdu, TNM_SNMP_RECV_EVENT);
 		    if (TnmSnmpAgentRequest(interp, session, pdu) != TCL_OK) {
-			Tcl_DStringFree(&pdu->varbind);
+			TnmSnmpPduSetVarBinds(pdu, NULL);
 			return TCL_ERROR;
 		    }
 		    delivered++;
@@ -451,7 +739,7 @@ TnmSnmpDecode(Tcl_Interp *interp, u_char *packet, int	packetlen, struct sockaddr
 	tnmSnmpStats.snmpInBadCommunityNames++;
     }
 
-    Tcl_DStringFree(&pdu->varbind);
+    TnmSnmpPduSetVarBinds(pdu, NULL);
     return TCL_CONTINUE;
 }
 
@@ -629,23 +917,381 @@ Authentic(TnmSnmp *session, Message *msg, TnmSnmpPdu *pdu, u_char *packet, int p
 	}
 	break;
 #endif
-    case TNM_SNMPv3:
+    case TNM_SNMPv3: {
+	char *user;
+	int userLength;
+	user = Tcl_GetStringFromObj(session->user, &userLength);
+	if (userLength != msg->userLength
+	    || memcmp(user, msg->user, (size_t) userLength) != 0) {
+	    break;
+	}
 	if (! (*msg->msgFlags & TNM_SNMP_FLAG_AUTH) 
 	    && ! (*msg->msgFlags & TNM_SNMP_FLAG_PRIV)) {
-	    char *user;
-	    int userLength;
-	    user = Tcl_GetStringFromObj(session->user, &userLength);
-
-	    authentic = (userLength == msg->userLength)
-		&& (memcmp(user, msg->user, (size_t) userLength) == 0);
+	    authentic = 1;
 	    break;
 	}
+
+	/*
+	 * Verify the MAC of authenticated messages with the HMAC
+	 * state of the session (RFC 2274 section 6.3.2 and 7.3.2).
+	 * Encrypted messages were already verified and decrypted by
+	 * DecryptScopedPDU(), which invalidates the MAC. They are
+	 * authentic for all sessions with the same keys.
+	 */
+
+	if (*msg->msgFlags & TNM_SNMP_FLAG_PRIV) {
+	    authentic = msg->privSession
+		&& (msg->privSession == session
+		    || SameKeys(msg->privSession, session));
+	} else if (*msg->msgFlags & TNM_SNMP_FLAG_AUTH) {
+	    authentic = TnmSnmpAuthInMsg(session, packet, packetlen,
+					 msg->authDigest, msg->authDigestLen);
+	}
 	break;
     }
+    }
 
     return authentic;
 }
 
+/*
+ *----------------------------------------------------------------------
+ *
+ * AuthenticCommunity --
+ *
+ *	This procedure checks whether a SNMPv1 or SNMPv2c response
+ *	carries a given community string. It is used for requests
+ *	that were not sent with the community of their session.
+ *
+ * Results:
+ *	1 if the response is authentic, 0 otherwise.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+AuthenticCommunity(Tcl_Obj *community, Message *msg)
+{
+    int length;
+    char *bytes;
+
+    if (msg->version != TNM_SNMPv1 && msg->version != TNM_SNMPv2C) {
+	return 0;
+    }
+    bytes = Tcl_GetStringFromObj(community, &length);
+    return (length == msg->comLen)
+	&& (memcmp(bytes, msg->com, (size_t) length) == 0);
+}
+
+#ifdef TNM_SNMPv3
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * CanDecrypt --
+ *
+ *	This procedure checks whether a private SNMPv3 message was
+ *	sent to or from a session, i.e. whether the user and the
+ *	security level match and the MAC can be verified with the
+ *	authentication key of the session.
+ *
+ * Results:
+ *	1 if the session can decrypt the message, 0 otherwise.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+CanDecrypt(TnmSnmp *session, Message *msg, u_char *packet, int packetlen)
+{
+    char *user;
+    int userLength;
+
+    if (session->version != TNM_SNMPv3
+	|| ! (session->securityLevel & TNM_SNMP_PRIV_MASK)) {
+	return 0;
+    }
+    user = Tcl_GetStringFromObj(session->user, &userLength);
+    if (userLength != msg->userLength
+	|| memcmp(user, msg->user, (size_t) userLength) != 0) {
+	return 0;
+    }
+    return TnmSnmpAuthInMsg(session, packet, packetlen,
+			    msg->authDigest, msg->authDigestLen);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * SameKeys --
+ *
+ *	This procedure checks whether two SNMPv3 sessions use the
+ *	same security level and the same localized keys.
+ *
+ * Results:
+ *	1 if the keys are the same, 0 otherwise.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+SameKeys(TnmSnmp *session1, TnmSnmp *session2)
+{
+    Tcl_Obj *keys1[2], *keys2[2];
+    char *bytes1, *bytes2;
+    int i, length1, length2;
+
+    if (session1->securityLevel != session2->securityLevel) {
+	return 0;
+    }
+    keys1[0] = session1->usmAuthKey, keys1[1] = session1->usmPrivKey;
+    keys2[0] = session2->usmAuthKey, keys2[1] = session2->usmPrivKey;
+    for (i = 0; i < 2; i++) {
+	if (! keys1[i] || ! keys2[i]) {
+	    return 0;
+	}
+	bytes1 = TnmGetOctetStringFromObj(NULL, keys1[i], &length1);
+	bytes2 = TnmGetOctetStringFromObj(NULL, keys2[i], &length2);
+	if (! bytes1 || ! bytes2 || length1 != length2
+	    || memcmp(bytes1, bytes2, (size_t) length1) != 0) {
+	    return 0;
+	}
+    }
+    return 1;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * DecryptScopedPDU --
+ *
+ *	This procedure decrypts the scoped PDU of a private SNMPv3
+ *	message in place and decodes it. The session is the session
+ *	of the request with the msgID of the message, the session
+ *	passed in or the first session which can verify the message.
+ *
+ * Results:
+ *	1 if the scoped PDU was decrypted and decoded, 0 otherwise.
+ *
+ * Side effects:
+ *	The packet is modified and the session used to decrypt the
+ *	message is saved in the message structure.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+DecryptScopedPDU(Message *msg, TnmSnmpPdu *pdu, u_char *packet, int packetlen, TnmSnmp *session)
+{
+    TnmSnmpRequest *request;
+    TnmBer _ber, *ber;
+
+    request = TnmSnmpFindRequest(msg->msgID);
+    if (request) {
+	session = request->session;
+    }
+    if (session) {
+	if (! CanDecrypt(session, msg, packet, packetlen)) {
+	    return 0;
+	}
+    } else {
+	for (session = tnmSnmpList; session; session = session->nextPtr) {
+	    if (CanDecrypt(session, msg, packet, packetlen)) {
+		break;
+	    }
+	}
+	if (! session) {
+	    return 0;
+	}
+    }
+
+    if (! TnmSnmpDecryptPdu(session, msg->privParam, msg->privParamLen,
+			    msg->engineBoots, msg->engineTime,
+			    msg->encryptedPdu, msg->encryptedPduLen)) {
+	return 0;
+    }
+
+    /*
+     * Any DES padding follows the scoped PDU and is ignored.
+     */
+
+    ber = TnmBerInit(&_ber, msg->encryptedPdu, msg->encryptedPduLen);
+    if (! DecodeScopedPDU(ber, pdu, &msg->vblPtr)) {
+	return 0;
+    }
+    msg->privSession = session;
+    return 1;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * ReportUnknownEngine --
+ *
+ *	This procedure checks whether a reportable message is sent to
+ *	the engine of a SNMPv3 responder session. Otherwise, a report
+ *	with the usmStatsUnknownEngineIDs counter is sent back so that
+ *	the sender can discover the engine (RFC 3414 section 3.2 step
+ *	3 and section 4). The report carries the msgID of the message
+ *	as request id since an encrypted PDU can not be decoded.
+ *
+ * Results:
+ *	1 if a report has been sent, 0 otherwise.
+ *
+ * Side effects:
+ *	The usmStatsUnknownEngineIDs counter is incremented.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+ReportUnknownEngine(Tcl_Interp *interp, Message *msg, struct sockaddr_in *from)
+{
+    TnmSnmp *session, *responder = NULL;
+    TnmSnmpPdu _pdu, *pdu = &_pdu;
+    char *engineID, varbind[80];
+    int engineIDLength, securityLevel;
+
+    for (session = tnmSnmpList; session; session = session->nextPtr) {
+	if (session->version != TNM_SNMPv3
+	    || session->type != TNM_SNMP_RESPONDER) {
+	    continue;
+	}
+	engineID = TnmGetOctetStringFromObj(NULL, session->engineID,
+					    &engineIDLength);
+	if (engineIDLength == msg->engineIDLength
+	    && memcmp(engineID, msg->engineID, (size_t) engineIDLength) == 0) {
+	    return 0;
+	}
+	if (! responder) {
+	    responder = session;
+	}
+    }
+    if (! responder) {
+	return 0;
+    }
+
+    tnmSnmpStats.usmStatsUnknownEngineIDs++;
+
+    memset((char *) pdu, 0, sizeof(TnmSnmpPdu));
+    pdu->addr = *from;
+    pdu->type = ASN1_SNMP_REPORT;
+    pdu->requestId = msg->msgID;
+    pdu->errorStatus = TNM_SNMP_NOERROR;
+    pdu->errorIndex = 0;
+    pdu->trapOID = NULL;
+    pdu->vbList = NULL;
+
+    sprintf(varbind, "{1.3.6.1.6.3.15.1.1.4.0 Counter32 %u}",
+	    tnmSnmpStats.usmStatsUnknownEngineIDs);
+
+    /*
+     * Reports for unknown engines are not authenticated since the
+     * sender has not yet localized its keys for this engine.
+     */
+
+    securityLevel = responder->securityLevel;
+    responder->securityLevel = TNM_SNMP_AUTH_NONE | TNM_SNMP_PRIV_NONE;
+    TnmSnmpPduSetVarBinds(pdu, Tcl_NewStringObj(varbind, -1));
+    (void) TnmSnmpEncode(interp, responder, pdu, NULL, NULL);
+    TnmSnmpPduSetVarBinds(pdu, NULL);
+    responder->securityLevel = securityLevel;
+    return 1;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * IsUnknownEngineReport --
+ *
+ *	This procedure checks whether a report PDU carries the
+ *	usmStatsUnknownEngineIDs counter, which is the answer to
+ *	a discovery probe (RFC 3414 section 4).
+ *
+ * Results:
+ *	1 if the first varbind is usmStatsUnknownEngineIDs, 0 otherwise.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+IsUnknownEngineReport(TnmSnmpPdu *pdu)
+{
+    TnmSnmpVarBindList *vblPtr;
+    TnmSnmpVarBind *vbPtr;
+    int len = OID_LENGTH(usmStatsUnknownEngineIDsOid);
+
+    if (! pdu->vbList) {
+	return 0;
+    }
+    vblPtr = TnmSnmpGetVarBindListFromObj(NULL, pdu->vbList, pdu->type);
+    if (! vblPtr || vblPtr->numVarBinds < 1) {
+	return 0;
+    }
+    vbPtr = vblPtr->varBinds;
+    return vbPtr->oidLength >= len
+	&& memcmp(TnmSnmpVarBindOid(vblPtr, vbPtr),
+		  usmStatsUnknownEngineIDsOid, len * sizeof(Tnm_Oid)) == 0;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * LearnEngine --
+ *
+ *	This procedure takes the engine parameters of an authenticated
+ *	SNMPv3 message from the authoritative engine of a session. The
+ *	engine cache is updated if the session did not know these
+ *	parameters yet, so that other sessions can use them without
+ *	a discovery exchange. It must only be called for messages
+ *	that have been verified with Authentic().
+ *
+ * Results:
+ *	1 if messages encoded with the old parameters would be
+ *	rejected by the engine, 0 otherwise.
+ *
+ * Side effects:
+ *	The engine parameters of the session and the engine cache
+ *	may change.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+LearnEngine(TnmSnmp *session, TnmSnmpRequest *request, Message *msg)
+{
+    int stale;
+
+    if (msg->version != TNM_SNMPv3
+	|| ! (*msg->msgFlags & TNM_SNMP_FLAG_AUTH)
+	|| msg->engineIDLength <= 0) {
+	return 0;
+    }
+
+    stale = TnmSnmpSetEngine(session, msg->engineID, msg->engineIDLength,
+			     msg->engineBoots, msg->engineTime);
+    if (stale) {
+	TnmSnmpEngineUpdate(request && request->to
+			    ? request->to : &session->maddr,
+			    msg->engineID, msg->engineIDLength,
+			    msg->engineBoots, msg->engineTime);
+    }
+    return stale;
+}
+#endif
+
 /*
  *----------------------------------------------------------------------
  *
@@ -664,7 +1310,7 @@ Authentic(TnmSnmp *session, Message *msg, TnmSnmpPdu *pdu, u_char *packet, int p
  */
 
 static int
-DecodeMessage(Tcl_Interp *interp, Message *msg, TnmSnmpPdu *pdu, TnmBer *ber)
+DecodeMessage(Message *msg, TnmSnmpPdu *pdu, TnmBer *ber)
 {
     int version, msgSeqLength;
     u_char *msgSeqToken, *msgSeqStart;
@@ -707,7 +1353,7 @@ DecodeMessage(Tcl_Interp *interp, Message *msg, TnmSnmpPdu *pdu, TnmBer *ber)
 	break;
     default:
 	TnmBerSetError(ber, "unknown version in SNMP message");
-	tnmSnmpStats.snmpInBadVersions++;
+	msg->badVersion = 1;
 	goto asn1Error;
     }
     
@@ -726,7 +1372,7 @@ DecodeMessage(Tcl_Interp *interp, Message *msg, TnmSnmpPdu *pdu, TnmBer *ber)
 	}
 #endif
 
-	if (! DecodePDU(ber, pdu)) {
+	if (! DecodePDU(ber, pdu, &msg->vblPtr)) {
 	    goto asn1Error;
 	}
 
@@ -742,7 +1388,7 @@ DecodeMessage(Tcl_Interp *interp, Message *msg, TnmSnmpPdu *pdu, TnmBer *ber)
 
     if (version == 3) {
 	u_char *usmParam;
-	TnmBer *usmBer;
+	TnmBer usmBer;
 	int usmParamLength;
 
 	if (! DecodeHeader(msg, pdu, ber)) {
@@ -752,13 +1398,28 @@ DecodeMessage(Tcl_Interp *interp, Message *msg, TnmSnmpPdu *pdu, TnmBer *ber)
 				   (char **) &usmParam, &usmParamLength)) {
 	    goto asn1Error;
 	}
-	usmBer = TnmBerCreate(usmParam, usmParamLength);
-	if (! DecodeUsmSecParams(msg, pdu, usmBer)) {
-	    TnmBerDelete(usmBer);
+	TnmBerInit(&usmBer, usmParam, usmParamLength);
+	if (! DecodeUsmSecParams(msg, pdu, &usmBer)) {
+	    TnmBerSetError(ber, TnmBerGetError(&usmBer));
 	    goto asn1Error;
 	}
-	TnmBerDelete(usmBer);
-	if (! DecodeScopedPDU(ber, pdu)) {
+
+	/*
+	 * The scoped PDU of a private message can only be decrypted
+	 * once the session is known, which is done in Dispatch().
+	 */
+
+	if (*msg->msgFlags & TNM_SNMP_FLAG_PRIV) {
+	    if (! (*msg->msgFlags & TNM_SNMP_FLAG_AUTH)) {
+		TnmBerSetError(ber, "private message without authentication");
+		goto asn1Error;
+	    }
+	    if (! TnmBerDecOctetString(ber, ASN1_OCTET_STRING,
+				       (char **) &msg->encryptedPdu,
+				       &msg->encryptedPduLen)) {
+		goto asn1Error;
+	    }
+	} else if (! DecodeScopedPDU(ber, pdu, &msg->vblPtr)) {
 	    goto asn1Error;
 	}
     }
@@ -768,21 +1429,17 @@ DecodeMessage(Tcl_Interp *interp, Message *msg, TnmSnmpPdu *pdu, TnmBer *ber)
     }
 
     if (! TnmBerDecDone(ber)) {
-	goto lengthError;
+	TnmBerSetError(ber, "message length does not match packet size");
+	goto asn1Error;
     }
     
     return TCL_OK;
 
   asn1Error:
-    Tcl_SetResult(interp, ber ? TnmBerGetError(ber) : "parse error",
-		  TCL_VOLATILE);
-    tnmSnmpStats.snmpInASNParseErrs++;
-    return TCL_ERROR;
-
- lengthError:
-    Tcl_SetResult(interp, "message length does not match packet size", 
-		  TCL_STATIC);
-    tnmSnmpStats.snmpInASNParseErrs++;
+    if (msg->vblPtr) {
+	TnmSnmpReleaseVarBindList(msg->vblPtr);
+	msg->vblPtr = NULL;
+    }
     return TCL_ERROR;
 }
 
@@ -902,10 +1559,14 @@ DecodeUsmSecParams(Message *msg, TnmSnmpPdu *pdu, TnmBer *ber)
 			       &msg->user, &msg->userLength)) {
 	return NULL;
     }
-    if (! TnmBerDecOctetString(ber, ASN1_OCTET_STRING, NULL, NULL)) {
+    if (! TnmBerDecOctetString(ber, ASN1_OCTET_STRING,
+			       (char **) &msg->authDigest,
+			       &msg->authDigestLen)) {
 	return NULL;
     }
-    if (! TnmBerDecOctetString(ber, ASN1_OCTET_STRING, NULL, NULL)) {
+    if (! TnmBerDecOctetString(ber, ASN1_OCTET_STRING,
+			       (char **) &msg->privParam,
+			       &msg->privParamLen)) {
 	return NULL;
     }
 
@@ -936,7 +1597,7 @@ DecodeUsmSecParams(Message *msg, TnmSnmpPdu *pdu, TnmBer *ber)
  */
 
 static TnmBer*
-DecodeScopedPDU(TnmBer *ber, TnmSnmpPdu *pdu)
+DecodeScopedPDU(TnmBer *ber, TnmSnmpPdu *pdu, TnmSnmpVarBindList **vblPtrPtr)
 {
     u_char *seqToken;
     int seqLength;
@@ -953,7 +1614,7 @@ DecodeScopedPDU(TnmBer *ber, TnmSnmpPdu *pdu)
 			       &pdu->context, &pdu->contextLength)) {
 	return NULL;
     }
-    if (! DecodePDU(ber, pdu)) {
+    if (! DecodePDU(ber, pdu, vblPtrPtr)) {
 	return NULL;
     }
     
@@ -1099,7 +1760,7 @@ SendUsecReport(Tcl_Interp *interp, TnmSnmp *session, struct sockaddr_in *to, int
     pdu->errorStatus = TNM_SNMP_NOERROR;
     pdu->errorIndex = 0;    
     pdu->trapOID = NULL;
-    Tcl_DStringInit(&pdu->varbind);
+    pdu->vbList = NULL;
     
     if (statPtr > &tnmSnmpStats.usecStatsUnsupportedQoS) {
 	sprintf(varbind, "{1.3.6.1.6.3.6.1.2.%d %u}", 
@@ -1121,9 +1782,9 @@ SendUsecReport(Tcl_Interp *interp, TnmSnmp *session, struct sockaddr_in *to, int
 	session->qos = USEC_QOS_NULL;
     }
 
-    Tcl_DStringAppend(&pdu->varbind, varbind, -1);
+    TnmSnmpPduSetVarBinds(pdu, Tcl_NewStringObj(varbind, -1));
     TnmSnmpEncode(interp, session, pdu, NULL, NULL);
-    Tcl_DStringFree(&pdu->varbind);
+    TnmSnmpPduSetVarBinds(pdu, NULL);
 
     session->qos = qos;
 }
@@ -1135,11 +1796,14 @@ SendUsecReport(Tcl_Interp *interp, TnmSnmp *session, struct sockaddr_in *to, int
  * DecodePDU --
  *
  *	This procedure takes a serialized packet and decodes the PDU. 
- *	The result is written to the pdu structure and varbind list 
- *	is converted to a TCL list contained in pdu->varbind.
+ *	The result is written to the pdu structure and the varbind
+ *	list is kept in binary form in a preserved varbind list which
+ *	is stored in vblPtrPtr. The varbinds are decoded in a single
+ *	pass from views into the packet buffer. This procedure does
+ *	not use a Tcl interpreter and may be called by engine threads.
  *
  * Results:
- *	A standard Tcl result.
+ *	A pointer to the BER buffer or NULL if the PDU is malformed.
  *
  * Side effects:
  *	None.
@@ -1148,29 +1812,31 @@ SendUsecReport(Tcl_Interp *interp, TnmSnmp *session, struct sockaddr_in *to, int
  */
 
 static TnmBer*
-DecodePDU(TnmBer *ber, TnmSnmpPdu *pdu)
+DecodePDU(TnmBer *ber, TnmSnmpPdu *pdu, TnmSnmpVarBindList **vblPtrPtr)
 {
     int oidlen = 0;
     
     Tnm_Oid oid[TNM_OID_MAX_SIZE];
     int int_val;
-    char buf[20];
-    char *exception, *freeme;
-    static char *vboid;
-    static int vboidLen = 0;
-    char *snmpTrapEnterprise = NULL;
+    char *freeme;
+    Tnm_Oid trapEnterprise[TNM_OID_MAX_SIZE];
+    int trapEnterpriseLen = 0;
+    TnmSnmpVarBindList *vblPtr;
+    TnmSnmpVarBind *vbPtr;
+    TnmBerVarbindIter iter;
+    TnmBerVarbind vb;
     u_char byte;
+    int code;
 
-    u_char tag;
-
-    u_char *pduSeqToken, *vbSeqToken, *vblSeqToken;
-    int pduSeqLength, vbSeqLength, vblSeqLength;
+    u_char *pduSeqToken;
+    int pduSeqLength;
 
     if (ber == NULL) {
 	return NULL;
     }
 
-    Tcl_DStringInit(&pdu->varbind);
+    vblPtr = TnmSnmpNewVarBindList();
+    TnmSnmpPreserveVarBindList(vblPtr);
 
     /*
      * Decode the PDU sequence and check whether the PDU type is
@@ -1179,7 +1845,6 @@ DecodePDU(TnmBer *ber, TnmSnmpPdu *pdu)
 
     TnmBerDecPeek(ber, (u_char *) &byte);
     if (! TnmBerDecSequenceStart(ber, byte, &pduSeqToken, &pduSeqLength)) {
-	tnmSnmpStats.snmpInASNParseErrs++;
 	goto asn1Error;
     }
     pdu->type = byte;
@@ -1197,7 +1862,6 @@ DecodePDU(TnmBer *ber, TnmSnmpPdu *pdu)
     if (pdu->type == ASN1_SNMP_TRAP1) {
 
 	int generic, specific;
-	char *toid = NULL;
 
 	pdu->requestId = 0;
 	pdu->errorStatus = 0;
@@ -1211,16 +1875,9 @@ DecodePDU(TnmBer *ber, TnmSnmpPdu *pdu)
 	 * snmpTrapEnterprise for details.
 	 */
 
-	{
-	    char *tmp;
-	    snmpTrapEnterprise = TnmOidToStr(oid, oidlen);
-	    tmp = TnmMibGetName(snmpTrapEnterprise, 0);
-	    if (tmp) {
-		snmpTrapEnterprise = ckstrdup(tmp);
-	    } else {
-		snmpTrapEnterprise = ckstrdup(snmpTrapEnterprise);
-	    }
-	}
+	trapEnterpriseLen = oidlen;
+	memcpy((char *) trapEnterprise, (char *) oid, 
+	       oidlen * sizeof(Tnm_Oid));
 
 	if (! TnmBerDecOctetString(ber, ASN1_IPADDRESS, 
 				   (char **) &freeme, &int_val)) {
@@ -1254,67 +1911,30 @@ DecodePDU(TnmBer *ber, TnmSnmpPdu *pdu)
 	if (! TnmBerDecInt(ber, ASN1_TIMETICKS, &int_val)) {
 	    goto asn1Error;
 	}
-	{   sprintf(buf, "%u", int_val);
-	    Tcl_DStringStartSublist(&pdu->varbind);
-	    Tcl_DStringAppendElement(&pdu->varbind, "1.3.6.1.2.1.1.3.0");
-	    Tcl_DStringAppendElement(&pdu->varbind, "TimeTicks");
-	    Tcl_DStringAppendElement(&pdu->varbind, buf);
-	    Tcl_DStringEndSublist(&pdu->varbind);
-	}
+	vbPtr = TnmSnmpAddVarBind(vblPtr, sysUpTimeOid,
+				  OID_LENGTH(sysUpTimeOid), ASN1_TIMETICKS);
+	vbPtr->value.intValue = int_val;
 
-	switch (generic) {
-	  case 0:				/* coldStart*/
-	    toid = "1.3.6.1.6.3.1.1.5.1";
-	    break;
-	  case 1:				/* warmStart */
-	    toid = "1.3.6.1.6.3.1.1.5.2";
-	    break;
-	  case 2:				/* linkDown */
-	    toid = "1.3.6.1.6.3.1.1.5.3";
-	    break;
-	  case 3:				/* linkUp */
-	    toid = "1.3.6.1.6.3.1.1.5.4";
-	    break;
-	  case 4:				/* authenticationFailure */
-	    toid = "1.3.6.1.6.3.1.1.5.5";
-	    break;
-	  case 5:				/* egpNeighborLoss */
-	    toid = "1.3.6.1.6.3.1.1.5.6";
-	    break;
-	  default:
+	/*
+	 * The generic traps coldStart (0), warmStart (1), linkDown (2),
+	 * linkUp (3), authenticationFailure (4) and egpNeighborLoss (5)
+	 * map to snmpTraps.1 up to snmpTraps.6. Everything else is an
+	 * enterpriseSpecific trap.
+	 */
+
+	if (generic >= 0 && generic <= 5) {
+	    oidlen = OID_LENGTH(snmpTrapsOid);
+	    memcpy((char *) oid, (char *) snmpTrapsOid, sizeof(snmpTrapsOid));
+	    oid[oidlen++] = generic + 1;
+	} else {
 	    oid[oidlen++] = 0;
 	    oid[oidlen++] = specific;		/* enterpriseSpecific */
-	    toid = ckstrdup(TnmOidToStr(oid, oidlen));
-	    break;
-	}
-
-	Tcl_DStringStartSublist(&pdu->varbind);
-	Tcl_DStringAppendElement(&pdu->varbind, "1.3.6.1.6.3.1.1.4.1.0");
-	Tcl_DStringAppendElement(&pdu->varbind, "OBJECT IDENTIFIER");
-	{
-#if 1
-	    Tcl_Obj *tmp = TnmMibFormat("1.3.6.1.6.3.1.1.4.1.0", 0, toid);
-	    if (tmp) {
-		Tcl_DStringAppendElement(&pdu->varbind, Tcl_GetString(tmp));
-		Tcl_DecrRefCount(tmp);
-	    } else {
-		Tcl_DStringAppendElement(&pdu->varbind, toid);
-	    }
-#else
-	    char *tmp = TnmMibGetName(toid, 0);
-	    if (tmp) {
-		Tcl_DStringAppendElement(&pdu->varbind, tmp);
-	    } else {
-		Tcl_DStringAppendElement(&pdu->varbind, toid);
-	    }
-#endif
 	}
 
-	if (((generic < 0) || (generic > 5)) && toid) {
-	    ckfree(toid);
-	    toid = NULL;
-	}
-	Tcl_DStringEndSublist(&pdu->varbind);
+	vbPtr = TnmSnmpAddVarBind(vblPtr, snmpTrapOidOid,
+				  OID_LENGTH(snmpTrapOidOid),
+				  ASN1_OBJECT_IDENTIFIER);
+	TnmSnmpSetVarBindOid(vblPtr, vbPtr, oid, oidlen);
 
 	if (ber == NULL) {
 	    goto trapError;
@@ -1324,8 +1944,7 @@ DecodePDU(TnmBer *ber, TnmSnmpPdu *pdu)
 
 	/*
 	 * Decode the request-id, the error-status, and the error-index
-	 * fields. Update our SNMP statistics if we got an error-status
-	 * which is counted in the SNMP MIB.
+	 * fields.
 	 */
 	
 	if (! TnmBerDecInt(ber, ASN1_INTEGER, &pdu->requestId)) {
@@ -1348,24 +1967,6 @@ DecodePDU(TnmBer *ber, TnmSnmpPdu *pdu)
 	    TnmBerSetError(ber, "unknown error status in SNMP PDU");
 	    goto asn1Error;
 	}
-	
-	switch (pdu->errorStatus) {
-	  case TNM_SNMP_TOOBIG:
-	      tnmSnmpStats.snmpInTooBigs++;
-	      break;
-	  case TNM_SNMP_NOSUCHNAME:
-	      tnmSnmpStats.snmpInNoSuchNames++;
-	      break;
-	  case TNM_SNMP_BADVALUE:
-	      tnmSnmpStats.snmpInBadValues++;
-	      break;
-	  case TNM_SNMP_READONLY:
-	      tnmSnmpStats.snmpInReadOnlys++;
-	      break;
-	  case TNM_SNMP_GENERR:
-	      tnmSnmpStats.snmpInGenErrs++;
-	      break;
-	}
     }
     
     /*
@@ -1374,221 +1975,95 @@ DecodePDU(TnmBer *ber, TnmSnmpPdu *pdu)
      * and why it is needed...
      */
 
-    if (! TnmBerDecSequenceStart(ber, ASN1_SEQUENCE,
-				 &vblSeqToken, &vblSeqLength)) {
+    if (! TnmBerVarbindIterInit(&iter, ber)) {
 	if (pdu->type == ASN1_SNMP_TRAP1) {
 	    goto trapError;
 	}
 	goto asn1Error;
     }
 
-    /*
-     * vbLen contains the total length of the encoded varbind list. We
-     * loop over the varbind list by decrementing vbLen until vbLen
-     * gets zero. (We have an encoding error is vbLen ever falls below
-     * zero.
-     */
-
-    while (!TnmBerDecDone(ber)) {
-
-	/* 
-	 * Decode a VarBind sequence (RFC 1157, RFC 1905) and
-	 * start a new element in our varbind-list.
-	 */
+    while ((code = TnmBerVarbindIterNext(&iter, &vb)) > 0) {
 
-	if (! TnmBerDecSequenceStart(ber, ASN1_SEQUENCE,
-				     &vbSeqToken, &vbSeqLength)) {
-	    goto asn1Error;
-	}
-	
-	Tcl_DStringStartSublist(&pdu->varbind);
-	
 	/*
-	 * Decode the OBJECT-IDENTIFIER of the varbind.
+	 * Decode the OBJECT-IDENTIFIER of the varbind and start a new
+	 * element in our varbind-list. Exceptions are kept as the
+	 * syntax of the varbind. Unknown tags are treated as Opaque
+	 * values.
 	 */
 	
-	if (! TnmBerDecOID(ber, oid, &oidlen)) {
+	if (! TnmBerDecOIDView(ber, vb.name, vb.nameLength, oid, &oidlen)) {
 	    goto asn1Error;
 	}
 
-	{
-	    char *soid = TnmOidToStr(oid, oidlen);
-	    int len = strlen(soid);
-	    if (vboidLen < len + 1)  {
-		if (vboid) ckfree(vboid);
-		vboidLen = len + 1;
-		vboid = ckstrdup(soid);
-	    } else {
-		strcpy(vboid, soid);
-	    }
-	    Tcl_DStringAppendElement(&pdu->varbind, vboid);
-	}
-
-	/*
-	 * Handle exceptions that are coded in the SNMP varbind. We
-	 * try to create a type conforming null value if possible.
-	 */
-
-	if (! TnmBerDecPeek(ber, &tag)) {
-	    goto asn1Error;
-	}
-
-	exception = TnmGetTableValue(tnmSnmpExceptionTable, tag);
-	if (exception) {
-	    Tcl_DStringAppendElement(&pdu->varbind, exception);
-	    Tcl_DStringAppendElement(&pdu->varbind, 
-				     TnmMibGetBaseSyntax(vboid)
-				     == ASN1_OCTET_STRING ? "" : "0");
-	    TnmBerDecNull(ber, tag);
-	    goto nextVarBind;
-	}
-
-	/*
-	 * Decode the ASN.1 type.
-	 */
-
-	{
-	    char *syntax = TnmGetTableValue(tnmSnmpTypeTable, tag);
-	    Tcl_DStringAppendElement(&pdu->varbind, syntax
-				     ? syntax : "Opaque");
+	switch (vb.tag) {
+	case ASN1_NO_SUCH_OBJECT:
+	case ASN1_NO_SUCH_INSTANCE:
+	case ASN1_END_OF_MIB_VIEW:
+	case ASN1_INTEGER:
+	case ASN1_COUNTER32:
+	case ASN1_GAUGE32:
+	case ASN1_TIMETICKS:
+	case ASN1_COUNTER64:
+	case ASN1_NULL:
+	case ASN1_OBJECT_IDENTIFIER:
+	case ASN1_IPADDRESS:
+	case ASN1_OCTET_STRING:
+	case ASN1_OPAQUE:
+	    vbPtr = TnmSnmpAddVarBind(vblPtr, oid, oidlen, vb.tag);
+	    break;
+	default:
+	    vbPtr = TnmSnmpAddVarBind(vblPtr, oid, oidlen, ASN1_OPAQUE);
+	    break;
 	}
 
 	/*
 	 * Decode the value of the object.
 	 */
 
-	switch (tag) {
+	switch (vb.tag) {
+	case ASN1_NO_SUCH_OBJECT:
+	case ASN1_NO_SUCH_INSTANCE:
+	case ASN1_END_OF_MIB_VIEW:
+	case ASN1_NULL:
+	    break;
 	case ASN1_COUNTER32:
 	case ASN1_GAUGE32:
 	case ASN1_TIMETICKS:
-	    if (! TnmBerDecInt(ber, tag, &int_val)) {
-		goto asn1Error;
-	    }
-	    sprintf(buf, "%u", int_val);
-            Tcl_DStringAppendElement(&pdu->varbind, buf);
-            break;
 	case ASN1_INTEGER:
-	    if (! TnmBerDecInt(ber, tag, &int_val)) {
+	    if (! TnmBerDecIntView(ber, vb.tag, vb.value, vb.valueLength,
+				   &vbPtr->value.intValue)) {
 		goto asn1Error;
 	    }
-	    {   Tcl_Obj *tmp;
-		sprintf(buf, "%d", int_val);
-		tmp = TnmMibFormat(vboid, 0, buf);
-		if (tmp) {
-		    Tcl_DStringAppendElement(&pdu->varbind,
-					     Tcl_GetString(tmp));
-		    Tcl_DecrRefCount(tmp);
-		} else {
-		    Tcl_DStringAppendElement(&pdu->varbind, buf);
-		}
-	    }
             break;
 	case ASN1_COUNTER64:
-	    {
-		TnmUnsigned64 u;
-		Tcl_Obj *objPtr;
-		if (! TnmBerDecUnsigned64(ber, &u)) {
-		    goto asn1Error;
-		}
-		objPtr = TnmNewUnsigned64Obj(u);
-		Tcl_DStringAppendElement(&pdu->varbind, 
-					 Tcl_GetStringFromObj(objPtr, NULL));
-		Tcl_DecrRefCount(objPtr);
-	    }
-	    break;
-	case ASN1_NULL:
-	    if (! TnmBerDecNull(ber, ASN1_NULL)) {
+	    if (! TnmBerDecUnsigned64View(ber, vb.value, vb.valueLength,
+					  &vbPtr->value.u64Value)) {
 		goto asn1Error;
 	    }
-	    Tcl_DStringAppendElement(&pdu->varbind, "");
-            break;
+	    break;
 	case ASN1_OBJECT_IDENTIFIER:
-	    if (! TnmBerDecOID(ber, oid, &oidlen)) {
+	    if (! TnmBerDecOIDView(ber, vb.value, vb.valueLength,
+				   oid, &oidlen)) {
 		goto asn1Error;
 	    }
-#if 1
-	    {   char *soid = TnmOidToStr(oid, oidlen);
-		Tcl_Obj *tmp = TnmMibFormat(vboid, 0, soid);
-		if (tmp) {
-		    Tcl_DStringAppendElement(&pdu->varbind,
-					     Tcl_GetString(tmp));
-		    Tcl_DecrRefCount(tmp);
-		} else {
-		    Tcl_DStringAppendElement(&pdu->varbind, soid);
-		}
-	    }
-#else
-	    Tcl_DStringAppendElement(&pdu->varbind, TnmOidToStr(oid, oidlen));
-#endif
+	    TnmSnmpSetVarBindOid(vblPtr, vbPtr, oid, oidlen);
             break;
 	case ASN1_IPADDRESS:
-	    if (! TnmBerDecOctetString(ber, ASN1_IPADDRESS, 
-				       (char **) &freeme, &int_val)) {
-		 goto asn1Error;
-	    }
-	    if (int_val != 4) goto asn1Error;
-            Tcl_DStringAppend(&pdu->varbind, " ", 1);
-	    {
-		struct sockaddr_in addr;
-		memcpy(&addr.sin_addr, freeme, 4);
-		Tcl_DStringAppendElement(&pdu->varbind, 
-					 inet_ntoa(addr.sin_addr));
-	    }
-            break;
+	    if (vb.valueLength != 4) goto asn1Error;
+	    /* fall through */
 	case ASN1_OPAQUE:
 	case ASN1_OCTET_STRING:
-            if (! TnmBerDecOctetString(ber, tag, 
-				       (char **) &freeme, &int_val)) {
-		goto asn1Error;
-	    }
-	    {
-		static char *hex = NULL;
-		static size_t hexLen = 0;
-		if (hexLen < int_val * 5 + 1) {
-		    if (hex) ckfree(hex);
-		    hexLen = int_val * 5 + 1;
-		    hex = ckalloc(hexLen);
-		}
-		TnmHexEnc(freeme, int_val, hex);
-		if (tag == ASN1_OCTET_STRING) {
-		    Tcl_Obj *tmp;
-		    tmp = TnmMibFormat(vboid, 0, hex);
-		    if (tmp) {
-			Tcl_DStringAppendElement(&pdu->varbind,
-						 Tcl_GetString(tmp));
-			Tcl_DecrRefCount(tmp);
-		    } else {
-			Tcl_DStringAppendElement(&pdu->varbind, hex);
-		    }
-		} else {
-		    Tcl_DStringAppendElement(&pdu->varbind, hex);
-		}
-	    }
+	    TnmSnmpSetVarBindData(vblPtr, vbPtr,
+				  (char *) vb.value, vb.valueLength);
             break;
 	default:
-	    if (! TnmBerDecAny(ber, (char **) &freeme, &int_val)) {
-		    goto asn1Error;
-	    }
-	    {
-		static char *hex = NULL;
-		static size_t hexLen = 0;
-		if (hexLen < int_val * 5 + 1) {
-		    if (hex) ckfree(hex);
-		    hexLen = int_val * 5 + 1;
-		    hex = ckalloc(hexLen);
-		}
-		TnmHexEnc(freeme, int_val, hex);
-		Tcl_DStringAppendElement(&pdu->varbind, hex);
-	    }
+	    TnmSnmpSetVarBindData(vblPtr, vbPtr,
+				  (char *) vb.encoding, vb.encodingLength);
 	    break;
 	}
-	
-      nextVarBind:
-
-	Tcl_DStringEndSublist(&pdu->varbind);
-	if (! TnmBerDecSequenceEnd(ber, vbSeqToken, vbSeqLength)) {
-	    goto asn1Error;
-	}
+    }
+    if (code < 0) {
+	goto asn1Error;
     }
 
     /*
@@ -1596,29 +2071,30 @@ DecodePDU(TnmBer *ber, TnmSnmpPdu *pdu)
      * See the definition of snmpTrapEnterprise of details.
      */
 
-    if (pdu->type == ASN1_SNMP_TRAP1 && snmpTrapEnterprise) {
-	Tcl_DStringStartSublist(&pdu->varbind);
-	Tcl_DStringAppendElement(&pdu->varbind, "1.3.6.1.6.3.1.1.4.3.0");
-        Tcl_DStringAppendElement(&pdu->varbind, "OBJECT IDENTIFIER");
-	Tcl_DStringAppendElement(&pdu->varbind, snmpTrapEnterprise);
-	Tcl_DStringEndSublist(&pdu->varbind);
-	ckfree(snmpTrapEnterprise);
+    if (pdu->type == ASN1_SNMP_TRAP1 && trapEnterpriseLen) {
+	vbPtr = TnmSnmpAddVarBind(vblPtr, snmpTrapEnterpriseOid,
+				  OID_LENGTH(snmpTrapEnterpriseOid),
+				  ASN1_OBJECT_IDENTIFIER);
+	TnmSnmpSetVarBindOid(vblPtr, vbPtr, 
+			     trapEnterprise, trapEnterpriseLen);
     }
 
-    if (! TnmBerDecSequenceEnd(ber, vblSeqToken, vblSeqLength)) {
+    if (! TnmBerVarbindIterDone(&iter)) {
 	goto asn1Error;
     }
     if (! TnmBerDecSequenceEnd(ber, pduSeqToken, pduSeqLength)) {
 	goto asn1Error;
     }
 
+    *vblPtrPtr = vblPtr;
     return ber;
     
   asn1Error:
-    tnmSnmpStats.snmpInASNParseErrs++;
+    TnmSnmpReleaseVarBindList(vblPtr);
     return NULL;
 
   trapError:
+    *vblPtrPtr = vblPtr;
     return ber;
 }
 
@@ -31,6 +31,16 @@ extern int	hexdump;
  * Forward declarations for procedures defined later in this file:
  */
 
+static void
+MapPdu			(TnmSnmp *session, TnmSnmpPdu *pdu);
+static void
+CountPdu		(TnmSnmpPdu *pdu);
+static int
+IsRequest		(TnmSnmpPdu *pdu);
+static int
+EncodePacket		(Tcl_Interp *interp,
+				     TnmSnmp *session, TnmSnmpPdu *pdu,
+				     u_char *packet, int *packetlenPtr);
 static int
 EncodeMessage		(Tcl_Interp *interp,
 				     TnmSnmp *sess, TnmSnmpPdu *pdu,
@@ -43,7 +53,7 @@ EncodeScopedPDU		(Tcl_Interp *interp, TnmSnmp *session,
 				     TnmSnmpPdu *pdu, TnmBer *ber);
 static u_char*
 EncodeUsmSecParams	(TnmSnmp *session, TnmSnmpPdu *pdu,
-				     int *lengthPtr);
+				     int *lengthPtr, u_char *salt);
 #ifdef TNM_SNMPv2U
 static int
 EncodeUsecParameter	(TnmSnmp *session, TnmSnmpPdu *pdu, 
@@ -54,6 +64,10 @@ static TnmBer*
 EncodePDU		(Tcl_Interp *interp, 
 				     TnmSnmp *sess, TnmSnmpPdu *pdu,
 				     TnmBer *ber);
+static TnmBer*
+EncodeVarBind		(Tcl_Interp *interp, TnmSnmp *session,
+				     int type, TnmSnmpVarBindList *vblPtr,
+				     TnmSnmpVarBind *vbPtr, TnmBer *ber);
 
 /*
  *----------------------------------------------------------------------
@@ -76,12 +90,271 @@ EncodePDU		(Tcl_Interp *interp,
 int
 TnmSnmpEncode(Tcl_Interp *interp, TnmSnmp *session, TnmSnmpPdu *pdu, TnmSnmpRequestProc *proc, ClientData clientData)
 {
-    int	retry = 0, packetlen = 0, code = 0;
+    int	retry = 0, packetlen = 0, code = 0, reencode = 0;
     u_char packet[TNM_SNMP_MAXSIZE];
-    TnmBer *ber;
 
     memset((char *) packet, 0, sizeof(packet));
 
+    MapPdu(session, pdu);
+
+    /*
+     * A trap message or a response? - send it and we are done!
+     */
+    
+    if (pdu->type == ASN1_SNMP_TRAP1 || pdu->type == ASN1_SNMP_TRAP2 
+	|| pdu->type == ASN1_SNMP_RESPONSE || pdu->type == ASN1_SNMP_REPORT) {
+	packetlen = sizeof(packet);
+	return TnmSnmpEncodeResponse(interp, session, pdu, packet, &packetlen);
+    }
+
+    packetlen = sizeof(packet);
+    if (TnmSnmpEncodeRequest(interp, session, pdu, packet, &packetlen)
+	!= TCL_OK) {
+	return TCL_ERROR;
+    }
+
+    /*
+     * Asychronous request: queue request and we are done.
+     */
+
+    if (proc) {
+	TnmSnmpRequest *rPtr;
+	rPtr = TnmSnmpCreateRequest(pdu->requestId, packet, packetlen,
+				    proc, clientData, interp);
+#ifdef TNM_SNMPv3
+	if (session->version == TNM_SNMPv3 && IsRequest(pdu)) {
+	    rPtr->pdu = (TnmSnmpPdu *) ckalloc(sizeof(TnmSnmpPdu));
+	    *rPtr->pdu = *pdu;
+	    rPtr->pdu->trapOID = NULL;
+	    rPtr->pdu->vbList = NULL;
+	    TnmSnmpPduSetVarBinds(rPtr->pdu, pdu->vbList);
+	}
+#endif
+	TnmSnmpQueueRequest(session, rPtr);
+	Tcl_SetObjResult (interp, Tcl_NewIntObj (pdu->requestId));
+	return TCL_OK;
+    }
+    
+    /*
+     * Synchronous request: send packet and wait for response.
+     */
+    
+    for (retry = 0; retry <= session->retries; retry++) {
+	int id, status, index;
+#ifdef TNM_SNMP_BENCH
+	TnmSnmpMark stats;
+	memset((char *) &stats, 0, sizeof(stats));
+#endif
+
+      repeat:
+	if (reencode) {
+
+	    /*
+	     * A report may have changed the engine parameters of the
+	     * session, so the request must be encoded again.
+	     */
+
+	    packetlen = sizeof(packet);
+	    if (EncodePacket(interp, session, pdu, packet, &packetlen)
+		!= TCL_OK) {
+		return TCL_ERROR;
+	    }
+	    reencode = 0;
+	}
+#ifdef TNM_SNMPv2U
+	if (session->version == TNM_SNMPv2U) {
+	    TnmSnmpUsecAuth(session, packet, packetlen);
+	}
+#endif
+	TnmSnmpDelay(session, packetlen);
+	code = TnmSnmpSend(interp, session, packet, packetlen, 
+			   &pdu->addr, TNM_SNMP_SYNC);
+	if (code != TCL_OK) {
+	    return TCL_ERROR;
+	}
+
+#ifdef TNM_SNMP_BENCH
+	if (stats.sendSize == 0) {
+	    stats.sendSize = tnmSnmpBenchMark.sendSize;
+	    stats.sendTime = tnmSnmpBenchMark.sendTime;
+	}
+#endif
+
+	while (TnmSnmpWait(session->timeout * 1000
+			   / (session->retries + 1), TNM_SNMP_SYNC) > 0) {
+	    u_char packet[TNM_SNMP_MAXSIZE];
+	    int rc, packetlen = TNM_SNMP_MAXSIZE;
+	    struct sockaddr_in from;
+
+	    code = TnmSnmpRecv(interp, packet, &packetlen, 
+			       &from, TNM_SNMP_SYNC);
+	    if (code != TCL_OK) {
+		return TCL_ERROR;
+	    }
+	    
+	    rc = TnmSnmpDecode(interp, packet, packetlen, &from,
+			       session, &id, &status, &index);
+	    if (rc == TCL_BREAK) {
+		if (retry++ <= session->retries + 1) {
+		    reencode = 1;
+		    goto repeat;
+		}
+	    }
+	    if (rc == TCL_OK) {
+		if (id == pdu->requestId) {
+#ifdef TNM_SNMP_BENCH
+		    stats.recvSize = tnmSnmpBenchMark.recvSize;
+		    stats.recvTime = tnmSnmpBenchMark.recvTime;
+		    session->stats = stats;
+#endif
+		    return TCL_OK;
+		}
+		rc = TCL_CONTINUE;
+	    }
+	    
+	    if (rc == TCL_CONTINUE) {
+		if (hexdump) {
+		    fprintf(stderr, "%s\n", Tcl_GetStringResult(interp));
+		}
+		continue;
+	    }
+	    if (rc == TCL_ERROR) {
+		pdu->errorStatus = status;
+		pdu->errorIndex = index;
+		return TCL_ERROR;
+	    }
+	}
+    }
+    
+    Tcl_SetResult(interp, "noResponse 0 {}", TCL_STATIC);
+    return TCL_ERROR;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * TnmSnmpEncodeRequest --
+ *
+ *	This procedure converts a request pdu into BER transfer syntax
+ *	without sending it. It is used by TnmSnmpEncode() and by
+ *	callers which send and retransmit the packet themselves.
+ *
+ * Results:
+ *	A standard Tcl result. The length of the encoded message is
+ *	left in packetlenPtr, which holds the size of the buffer on
+ *	entry.
+ *
+ * Side effects:
+ *	The send bindings of the session are evaluated.
+ *
+ *----------------------------------------------------------------------
+ */
+
+int
+TnmSnmpEncodeRequest(Tcl_Interp *interp, TnmSnmp *session, TnmSnmpPdu *pdu, u_char *packet, int *packetlenPtr)
+{
+    MapPdu(session, pdu);
+
+#ifdef TNM_SNMPv3
+    /*
+     * Take the parameters of the authoritative engine from the engine
+     * cache if we send a request to a remote engine. This saves the
+     * discovery exchange for engines already known to other sessions
+     * and keeps the engineTime current.
+     */
+
+    if (session->version == TNM_SNMPv3 && IsRequest(pdu)) {
+	(void) TnmSnmpEngineLookup(session, &pdu->addr);
+    }
+#endif
+
+    if (EncodePacket(interp, session, pdu, packet, packetlenPtr) != TCL_OK) {
+	return TCL_ERROR;
+    }
+
+    CountPdu(pdu);
+
+    /*
+     * Show the contents of the PDU - mostly for debugging.
+     */
+
+    TnmSnmpEvalBinding(interp, session, pdu, TNM_SNMP_SEND_EVENT);
+
+    TnmSnmpDumpPDU(interp, pdu);
+    return TCL_OK;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * TnmSnmpEncodeResponse --
+ *
+ *	This procedure converts a response, report or trap pdu into
+ *	BER transfer syntax and sends it. The encoded message is left
+ *	in the buffer so that the caller can send it again.
+ *
+ * Results:
+ *	A standard Tcl result. The length of the encoded message is
+ *	left in packetlenPtr, which holds the size of the buffer on
+ *	entry.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+int
+TnmSnmpEncodeResponse(Tcl_Interp *interp, TnmSnmp *session, TnmSnmpPdu *pdu, u_char *packet, int *packetlenPtr)
+{
+    MapPdu(session, pdu);
+
+    if (EncodePacket(interp, session, pdu, packet, packetlenPtr) != TCL_OK) {
+	return TCL_ERROR;
+    }
+
+    CountPdu(pdu);
+
+    /*
+     * Show the contents of the PDU - mostly for debugging.
+     */
+    
+    TnmSnmpEvalBinding(interp, session, pdu, TNM_SNMP_SEND_EVENT);
+
+    TnmSnmpDumpPDU(interp, pdu);
+
+#ifdef TNM_SNMPv2U
+    if (session->version == TNM_SNMPv2U) {
+	TnmSnmpUsecAuth(session, packet, *packetlenPtr);
+    }
+#endif
+    if (TnmSnmpSend(interp, session, packet, *packetlenPtr,
+		    &pdu->addr, TNM_SNMP_ASYNC) != TCL_OK) {
+	return TCL_ERROR;
+    }
+    Tcl_ResetResult(interp);
+    return TCL_OK;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * MapPdu --
+ *
+ *	This procedure adapts a pdu to the version of the session.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	The pdu type and the error status may be changed.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+MapPdu(TnmSnmp *session, TnmSnmpPdu *pdu)
+{
     /*
      * Some special care must be taken to conform to SNMPv1 sessions:
      * SNMPv2 getbulk requests must be turned into getnext requests
@@ -125,22 +398,28 @@ TnmSnmpEncode(Tcl_Interp *interp, TnmSnmp *session, TnmSnmpPdu *pdu, TnmSnmpRequ
 	    }
 	}
     }
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * CountPdu --
+ *
+ *	This procedure updates the SNMP statistics for an outgoing
+ *	pdu.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	The counters in tnmSnmpStats are incremented.
+ *
+ *----------------------------------------------------------------------
+ */
 
-    /*
-     * Encode message into ASN1 BER transfer syntax. Authentication or
-     * encryption is done within the following procedures if it is an
-     * authentic or private message.
-     */
-
-    ber = TnmBerCreate(packet, sizeof(packet));
-    code = EncodeMessage(interp, session, pdu, ber);
-    if (code != TCL_OK) {
-	TnmBerDelete(ber);
-	return TCL_ERROR;
-    }
-    packetlen = TnmBerSize(ber);
-    TnmBerDelete(ber);
-
+static void
+CountPdu(TnmSnmpPdu *pdu)
+{
     switch (pdu->type) {
       case ASN1_SNMP_GET:
 	  tnmSnmpStats.snmpOutGetRequests++;
@@ -158,126 +437,189 @@ TnmSnmpEncode(Tcl_Interp *interp, TnmSnmp *session, TnmSnmpPdu *pdu, TnmSnmpRequ
 	  tnmSnmpStats.snmpOutTraps++; 
 	  break;
     }
-    
-    /*
-     * Show the contents of the PDU - mostly for debugging.
-     */
-    
-    TnmSnmpEvalBinding(interp, session, pdu, TNM_SNMP_SEND_EVENT);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * IsRequest --
+ *
+ *	This procedure checks whether a PDU is sent to a remote
+ *	authoritative SNMP engine, i.e. a request or an inform.
+ *
+ * Results:
+ *	1 if the PDU is sent to a remote authoritative engine, 0
+ *	otherwise.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
 
-    TnmSnmpDumpPDU(interp, pdu);
+static int
+IsRequest(TnmSnmpPdu *pdu)
+{
+    switch (pdu->type) {
+    case ASN1_SNMP_GET:
+    case ASN1_SNMP_GETNEXT:
+    case ASN1_SNMP_GETBULK:
+    case ASN1_SNMP_SET:
+    case ASN1_SNMP_INFORM:
+	return 1;
+    }
+    return 0;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * EncodePacket --
+ *
+ *	This procedure encodes a complete message into ASN1 BER
+ *	transfer syntax. Authentication or encryption is done within
+ *	the following procedures if it is an authentic or private
+ *	message.
+ *
+ * Results:
+ *	A standard Tcl result. The length of the encoded message is
+ *	left in packetlenPtr, which holds the size of the buffer on
+ *	entry.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+EncodePacket(Tcl_Interp *interp, TnmSnmp *session, TnmSnmpPdu *pdu, u_char *packet, int *packetlenPtr)
+{
+    TnmBer *ber;
 
+#ifdef TNM_SNMPv3
     /*
-     * A trap message or a response? - send it and we are done!
+     * Keys can not be localized before we know the engineID of the
+     * remote engine. Send a discovery probe without security and
+     * without varbinds instead (RFC 3414 section 4). The request
+     * is encoded again when the report with the engineID arrives.
      */
-    
-    if (pdu->type == ASN1_SNMP_TRAP1 || pdu->type == ASN1_SNMP_TRAP2 
-	|| pdu->type == ASN1_SNMP_RESPONSE || pdu->type == ASN1_SNMP_REPORT) {
-#ifdef TNM_SNMPv2U
-	if (session->version == TNM_SNMPv2U) {
-	    TnmSnmpUsecAuth(session, packet, packetlen);
-	}
+
+    if (session->version == TNM_SNMPv3 && IsRequest(pdu)
+	&& session->securityLevel & TNM_SNMP_AUTH_MASK
+	&& Tcl_GetCharLength(session->engineID) == 0) {
+	TnmSnmpPdu probe = *pdu;
+	int code, securityLevel = session->securityLevel;
+
+	probe.vbList = NULL;
+	session->securityLevel = TNM_SNMP_AUTH_NONE | TNM_SNMP_PRIV_NONE;
+	ber = TnmBerCreate(packet, *packetlenPtr);
+	code = EncodeMessage(interp, session, &probe, ber);
+	*packetlenPtr = TnmBerSize(ber);
+	TnmBerDelete(ber);
+	session->securityLevel = securityLevel;
+	return code;
+    }
 #endif
-	code = TnmSnmpSend(interp, session, packet, packetlen,
-			   &pdu->addr, TNM_SNMP_ASYNC);
-	if (code != TCL_OK) {
-	    return TCL_ERROR;
-	}
-	Tcl_ResetResult(interp);
-	return TCL_OK;
+
+    ber = TnmBerCreate(packet, *packetlenPtr);
+    if (EncodeMessage(interp, session, pdu, ber) != TCL_OK) {
+	TnmBerDelete(ber);
+	return TCL_ERROR;
     }
-  
-    /*
-     * Asychronous request: queue request and we are done.
-     */
+    *packetlenPtr = TnmBerSize(ber);
+    TnmBerDelete(ber);
 
-    if (proc) {
-	TnmSnmpRequest *rPtr;
-	rPtr = TnmSnmpCreateRequest(pdu->requestId, packet, packetlen,
-				    proc, clientData, interp);
-	TnmSnmpQueueRequest(session, rPtr);
-	Tcl_SetObjResult (interp, Tcl_NewIntObj (pdu->requestId));
-	return TCL_OK;
+#ifdef TNM_SNMPv3
+    if (session->version == TNM_SNMPv3
+	&& session->securityLevel & TNM_SNMP_AUTH_MASK) {
+	return TnmSnmpAuthOutMsg(interp, session, packet, *packetlenPtr);
     }
-    
-    /*
-     * Synchronous request: send packet and wait for response.
-     */
-    
-    for (retry = 0; retry <= session->retries; retry++) {
-	int id, status, index;
-#ifdef TNM_SNMP_BENCH
-	TnmSnmpMark stats;
-	memset((char *) &stats, 0, sizeof(stats));
 #endif
+    return TCL_OK;
+}
+
+#ifdef TNM_SNMPv3
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * TnmSnmpReencodeRequest --
+ *
+ *	This procedure encodes an asynchronous SNMPv3 request again
+ *	with the current engine parameters of its session. It is
+ *	called when a report PDU has changed the engine parameters
+ *	(RFC 3414 section 4).
+ *
+ * Results:
+ *	A standard Tcl result. The request is not modified if it
+ *	does not have a copy of its PDU.
+ *
+ * Side effects:
+ *	The encoded message of the request is replaced.
+ *
+ *----------------------------------------------------------------------
+ */
 
-      repeat:
-#ifdef TNM_SNMPv2U
-	if (session->version == TNM_SNMPv2U) {
-	    TnmSnmpUsecAuth(session, packet, packetlen);
-	}
-#endif
-	TnmSnmpDelay(session);
-	code = TnmSnmpSend(interp, session, packet, packetlen, 
-			   &pdu->addr, TNM_SNMP_SYNC);
-	if (code != TCL_OK) {
-	    return TCL_ERROR;
-	}
+int
+TnmSnmpReencodeRequest(TnmSnmpRequest *request)
+{
+    u_char packet[TNM_SNMP_MAXSIZE];
+    int packetlen = sizeof(packet);
 
-#ifdef TNM_SNMP_BENCH
-	if (stats.sendSize == 0) {
-	    stats.sendSize = tnmSnmpBenchMark.sendSize;
-	    stats.sendTime = tnmSnmpBenchMark.sendTime;
-	}
+    if (! request->pdu) {
+	return TCL_OK;
+    }
+    if (EncodePacket(request->interp, request->session, request->pdu,
+		     packet, &packetlen) != TCL_OK) {
+	return TCL_ERROR;
+    }
+
+    if (request->buffer) {
+	ckfree((char *) request->buffer);
+    }
+    request->buffer = (u_char *) ckalloc((unsigned) packetlen);
+    memcpy(request->buffer, packet, (size_t) packetlen);
+    request->packet = request->buffer;
+    request->packetlen = packetlen;
+    return TCL_OK;
+}
 #endif
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * TnmSnmpEncodePDU --
+ *
+ *	This procedure encodes only the PDU part of a message. It is
+ *	used to build message templates which are sent to many agents
+ *	with different message headers.
+ *
+ * Results:
+ *	A standard Tcl result. The length of the encoded PDU is left
+ *	in packetlenPtr, which holds the size of the buffer on entry.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
 
-	while (TnmSnmpWait(session->timeout * 1000
-			   / (session->retries + 1), TNM_SNMP_SYNC) > 0) {
-	    u_char packet[TNM_SNMP_MAXSIZE];
-	    int rc, packetlen = TNM_SNMP_MAXSIZE;
-	    struct sockaddr_in from;
+int
+TnmSnmpEncodePDU(Tcl_Interp *interp, TnmSnmp *session, TnmSnmpPdu *pdu, u_char *packet, int *packetlenPtr)
+{
+    TnmBer _ber, *ber;
 
-	    code = TnmSnmpRecv(interp, packet, &packetlen, 
-			       &from, TNM_SNMP_SYNC);
-	    if (code != TCL_OK) {
-		return TCL_ERROR;
-	    }
-	    
-	    rc = TnmSnmpDecode(interp, packet, packetlen, &from,
-			       session, &id, &status, &index);
-	    if (rc == TCL_BREAK) {
-		if (retry++ <= session->retries + 1) {
-		    goto repeat;
-		}
-	    }
-	    if (rc == TCL_OK) {
-		if (id == pdu->requestId) {
-#ifdef TNM_SNMP_BENCH
-		    stats.recvSize = tnmSnmpBenchMark.recvSize;
-		    stats.recvTime = tnmSnmpBenchMark.recvTime;
-		    session->stats = stats;
-#endif
-		    return TCL_OK;
-		}
-		rc = TCL_CONTINUE;
-	    }
-	    
-	    if (rc == TCL_CONTINUE) {
-		if (hexdump) {
-		    fprintf(stderr, "%s\n", Tcl_GetStringResult(interp));
-		}
-		continue;
-	    }
-	    if (rc == TCL_ERROR) {
-		pdu->errorStatus = status;
-		pdu->errorIndex = index;
-		return TCL_ERROR;
-	    }
+    ber = TnmBerInit(&_ber, packet, *packetlenPtr);
+    ber = EncodePDU(interp, session, pdu, ber);
+    if (ber == NULL) {
+	if (*Tcl_GetStringResult(interp) == '\0') {
+	    Tcl_SetResult(interp, TnmBerGetError(NULL), TCL_STATIC);
 	}
+	return TCL_ERROR;
     }
-    
-    Tcl_SetResult(interp, "noResponse 0 {}", TCL_STATIC);
-    return TCL_ERROR;
+    *packetlenPtr = TnmBerSize(ber);
+    return TCL_OK;
 }
 
 /*
@@ -355,18 +697,35 @@ EncodeMessage(Tcl_Interp *interp, TnmSnmp *session, TnmSnmpPdu *pdu, TnmBer *ber
 
     if (version == 3) {
 	int secParamLength;
-	unsigned char *secParam;
+	unsigned char *secParam, *privToken;
+	u_char salt[TNM_SNMP_PRIV_SALTSIZE];
+	TnmBer *stream = ber;
 	ber = EncodeHeader(interp, session, pdu, ber);
-	secParam = EncodeUsmSecParams(session, pdu, &secParamLength);
+	secParam = EncodeUsmSecParams(session, pdu, &secParamLength, salt);
 	if (! secParam) {
 	    Tcl_SetResult(interp, TnmBerGetError(NULL), TCL_STATIC);
 	    return TCL_ERROR;
 	}
 	ber = TnmBerEncOctetString(ber, ASN1_OCTET_STRING,
 				   (char *) secParam, secParamLength);
-	ber = EncodeScopedPDU(interp, session, pdu, ber);
-	if (*Tcl_GetStringResult (interp) == '\0') {
-	    Tcl_SetResult(interp, TnmBerGetError(NULL), TCL_STATIC);
+
+	/*
+	 * The scoped PDU of a private message is encrypted in place
+	 * and wrapped into an OCTET STRING (RFC 2272 section 6.8).
+	 */
+
+	if (session->securityLevel & TNM_SNMP_PRIV_MASK) {
+	    ber = TnmBerEncSequenceStart(ber, ASN1_OCTET_STRING, &privToken);
+	    ber = EncodeScopedPDU(interp, session, pdu, ber);
+	    if (ber) {
+		ber = TnmSnmpEncryptPdu(session, ber, privToken + 1, salt);
+	    }
+	    ber = TnmBerEncSequenceEnd(ber, privToken);
+	} else {
+	    ber = EncodeScopedPDU(interp, session, pdu, ber);
+	}
+	if (! ber && *Tcl_GetStringResult(interp) == '\0') {
+	    Tcl_SetResult(interp, TnmBerGetError(stream), TCL_VOLATILE);
 	}
     }
 
@@ -456,6 +815,9 @@ EncodeHeader(Tcl_Interp *interp, TnmSnmp *session, TnmSnmpPdu *pdu, TnmBer *ber)
  *	        msgPrivacyParameters         OCTET STRING
  *	  }
  *
+ *	The salt of a private message is returned in the salt
+ *	parameter.
+ *
  * Results:
  *	A pointer to the beginning to the encoded security parameters.
  *	The length is returned in the lengthPtr parameter.
@@ -467,7 +829,7 @@ EncodeHeader(Tcl_Interp *interp, TnmSnmp *session, TnmSnmpPdu *pdu, TnmBer *ber)
  */
 
 static u_char*
-EncodeUsmSecParams(TnmSnmp *session, TnmSnmpPdu *pdu, int *lengthPtr)
+EncodeUsmSecParams(TnmSnmp *session, TnmSnmpPdu *pdu, int *lengthPtr, u_char *salt)
 {
     u_char *seqToken;
     char *user, *engineID;
@@ -487,7 +849,7 @@ EncodeUsmSecParams(TnmSnmp *session, TnmSnmpPdu *pdu, int *lengthPtr)
     ber = TnmBerEncOctetString(ber, ASN1_OCTET_STRING,
 			       engineID, engineIDLength);
 
-    if (pdu->type == ASN1_SNMP_RESPONSE
+    if (pdu->type == ASN1_SNMP_RESPONSE || pdu->type == ASN1_SNMP_REPORT
 	|| session->securityLevel & TNM_SNMP_AUTH_MASK) {
 	ber = TnmBerEncInt(ber, ASN1_INTEGER, session->engineBoots);
 	ber = TnmBerEncInt(ber, ASN1_INTEGER, session->engineTime);
@@ -501,13 +863,21 @@ EncodeUsmSecParams(TnmSnmp *session, TnmSnmpPdu *pdu, int *lengthPtr)
 			       user, userLength);
     
     if (session->securityLevel & TNM_SNMP_AUTH_MASK) {
-	char zeros[12];
-	memset(zeros, 0, 12);
-	ber = TnmBerEncOctetString(ber, ASN1_OCTET_STRING, zeros, 12);
+	char zeros[TNM_SNMP_AUTH_MAXSIZE];
+	int authLength = TnmSnmpAuthLength(session->securityLevel
+					   & TNM_SNMP_AUTH_MASK);
+	memset(zeros, 0, sizeof(zeros));
+	ber = TnmBerEncOctetString(ber, ASN1_OCTET_STRING, zeros, authLength);
+    } else {
+	ber = TnmBerEncOctetString(ber, ASN1_OCTET_STRING, "", 0);
+    }
+    if (session->securityLevel & TNM_SNMP_PRIV_MASK) {
+	TnmSnmpPrivSalt(session, salt);
+	ber = TnmBerEncOctetString(ber, ASN1_OCTET_STRING, (char *) salt,
+				   TNM_SNMP_PRIV_SALTSIZE);
     } else {
 	ber = TnmBerEncOctetString(ber, ASN1_OCTET_STRING, "", 0);
     }
-    ber = TnmBerEncOctetString(ber, ASN1_OCTET_STRING, "", 0);
     ber = TnmBerEncSequenceEnd(ber, seqToken);
 
     if (! ber) {
@@ -804,8 +1174,8 @@ EncodePDU(Tcl_Interp *interp, TnmSnmp *session, TnmSnmpPdu *pdu, TnmBer *ber)
 {    
     u_char *pduSeqToken, *vbSeqToken, *vblSeqToken;
     
-    int i, vblc, vbc;
-    const char **vblv, **vbv;
+    int i;
+    TnmSnmpVarBindList *vblPtr;
 
     Tnm_Oid *oid;
     int oidlen;
@@ -896,12 +1266,19 @@ EncodePDU(Tcl_Interp *interp, TnmSnmp *session, TnmSnmpPdu *pdu, TnmBer *ber)
     ber = TnmBerEncSequenceStart(ber, ASN1_SEQUENCE, &vblSeqToken);
     
     /*
-     * split the varbind list and loop over all elements
+     * Get the binary varbind list. This converts Tcl lists into
+     * the binary representation and shares binary lists that we
+     * got from received PDUs.
      */
-    
-    if (Tcl_SplitList(interp, Tcl_DStringValue(&pdu->varbind), &vblc, &vblv)
-	!= TCL_OK) {
-	return NULL;
+
+    if (pdu->vbList) {
+	vblPtr = TnmSnmpGetVarBindListFromObj(interp, pdu->vbList, pdu->type);
+	if (! vblPtr) {
+	    return NULL;
+	}
+    } else {
+	vblPtr = TnmSnmpNewVarBindList();
+	TnmSnmpPreserveVarBindList(vblPtr);
     }
 
     if (pdu->type == ASN1_SNMP_TRAP2 || pdu->type == ASN1_SNMP_INFORM) {
@@ -925,275 +1302,195 @@ EncodePDU(Tcl_Interp *interp, TnmSnmp *session, TnmSnmpPdu *pdu, TnmBer *ber)
 	ber = TnmBerEncSequenceEnd(ber, vbSeqToken);
     }
     
-    for (i = 0; i < vblc; i++) {
-	
-        const char *value;
-	int asn1_type = ASN1_OTHER;
-	char string[64];
-	
-	/*
-	 * split a single varbind into its components
-	 */
-	
-	if (Tcl_SplitList(interp, vblv[i], &vbc, &vbv) != TCL_OK) {
-	    ckfree((char *) vblv);
-	    return NULL;
-	}
+    for (i = 0; ber && i < vblPtr->numVarBinds; i++) {
+	ber = EncodeVarBind(interp, session, pdu->type, vblPtr,
+			    vblPtr->varBinds + i, ber);
+    }
 
-	if (vbc == 0) {
-	    Tcl_SetResult(interp, "missing OBJECT IDENTIFIER", TCL_STATIC);
-	    ckfree((char *) vblv);
-            return NULL;
-	}
-	
-	/*
-	 * encode each VarBind ( SEQUENCE name, value )
-	 */
-	
-	ber = TnmBerEncSequenceStart(ber, ASN1_SEQUENCE, &vbSeqToken);
+    TnmSnmpReleaseVarBindList(vblPtr);
 
-	/*
-	 * encode the object identifier, perhaps consulting the MIB
-	 */
+    ber = TnmBerEncSequenceEnd(ber, vblSeqToken);
+    ber = TnmBerEncSequenceEnd(ber, pduSeqToken);
+    return ber;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * EncodeVarBind --
+ *
+ *	This procedure serializes a single varbind of the varbind
+ *	list vblPtr as part of a PDU of the given type.
+ *
+ * Results:
+ *	A pointer to the BER byte stream or NULL.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
 
-	oid = TnmStrToOid(vbv[0], &oidlen);
-	if (! oid) {
-	    char *tmp = TnmMibGetOid(vbv[0]);
-	    if (tmp) {
-		oid = TnmStrToOid(tmp, &oidlen);
-	    }
-	}
-	if (! oid) {
-	    Tcl_ResetResult(interp);
-	    Tcl_AppendResult(interp, "invalid object identifier \"",
-			     vbv[0], "\"", (char *) NULL);
-	    ckfree((char *) vbv);
-	    ckfree((char *) vblv);
-	    return NULL;
-	}
+static TnmBer*
+EncodeVarBind(Tcl_Interp *interp, TnmSnmp *session, int type, TnmSnmpVarBindList *vblPtr, TnmSnmpVarBind *vbPtr, TnmBer *ber)
+{
+    u_char *vbSeqToken;
 
-	ber = TnmBerEncOID(ber, oid, oidlen);
-	if (ber == NULL) {
-	    break;
-	}
+    /*
+     * encode each VarBind ( SEQUENCE name, value )
+     */
+	
+    ber = TnmBerEncSequenceStart(ber, ASN1_SEQUENCE, &vbSeqToken);
+    ber = TnmBerEncOID(ber, TnmSnmpVarBindOid(vblPtr, vbPtr),
+		       vbPtr->oidLength);
+    if (ber == NULL) {
+	return NULL;
+    }
 
-	/*
-	 * guess the asn1 type field and the value
-	 */
+    /*
+     * Check whether we have to encode the value. Don't bother
+     * to encode the actual value for retrieval operations.
+     */
 
-	switch (vbc) {
-	  case 1:
-	    value = "";
-	    asn1_type = ASN1_NULL;
-	    break;
-	  case 2:
-	    value = vbv[1];
-	    asn1_type = TnmMibGetBaseSyntax(vbv[0]);
+    if (TnmSnmpGet(type)) {
+	ber = TnmBerEncNull(ber, ASN1_NULL);
+    } else {
+	switch (vbPtr->syntax) {
+	case ASN1_INTEGER:
+	case ASN1_COUNTER32:
+	case ASN1_GAUGE32:
+	case ASN1_TIMETICKS:
+	    ber = TnmBerEncInt(ber, vbPtr->syntax, vbPtr->value.intValue);
 	    break;
-	  default:
-	    value = vbv[2];
-
-	    /*
-	     * Check if there is an exception in the asn1 type field.
-	     * Convert this into an appropriate NULL type if we create
-	     * a response PDU. Otherwise, ignore this stuff and use
-	     * the type found in the MIB.
-	     */
-
-	    if (pdu->type == ASN1_SNMP_RESPONSE) {
-		asn1_type = TnmGetTableKey(tnmSnmpExceptionTable, vbv[1]);
-	        if (asn1_type < 0) {
-		    asn1_type = TnmGetTableKey(tnmSnmpTypeTable, vbv[1]);
-		    if (asn1_type < 0) {
-			asn1_type = ASN1_OTHER;
-		    }
-		}
-	    } else {
-		asn1_type = TnmGetTableKey(tnmSnmpTypeTable, vbv[1]);
-		if (asn1_type < 0) {
-		    asn1_type = ASN1_OTHER;
-		}
-	    }
-
-	    if (asn1_type == ASN1_OTHER) {
-		TnmMibType *typePtr;
-		typePtr = TnmMibFindType(vbv[1]);
-		if (typePtr) {
-		    asn1_type = typePtr->syntax;
-		}
+	case ASN1_COUNTER64:
+	    if (session->version == TNM_SNMPv1) {
+		Tcl_SetResult(interp,
+			      "Counter64 not allowed on an SNMPv1 session",
+			      TCL_STATIC);
+		return NULL;
 	    }
+	    ber = TnmBerEncUnsigned64(ber, vbPtr->value.u64Value);
 	    break;
-	}
-
-	if (asn1_type == ASN1_OTHER) {
-	    Tcl_ResetResult(interp);
-	    Tcl_AppendResult(interp, "unknown type \"", vbv[1], "\"",
-			     (char *) NULL);
-	    ckfree((char *) vbv);
-	    ckfree((char *) vblv);
-	    return NULL;
-	}
-
-	/*
-         * Check whether we have to encode the value. Don't bother
-	 * to encode the actual value for retrieval operations.
-	 */
-
-	if (TnmSnmpGet(pdu->type)) {
-	    ber = TnmBerEncNull(ber, ASN1_NULL);
-	} else {
-	    switch (asn1_type) {
-	    case ASN1_INTEGER:
-	    case ASN1_COUNTER32:
-	    case ASN1_GAUGE32:
-	    case ASN1_TIMETICKS: {
-		int int_val, rc;
-		rc = Tcl_GetInt(interp, value, &int_val);
-		if (rc != TCL_OK) {
-		    char *tmp = TnmMibScan(vbv[0], 0, value);
-		    if (tmp && *tmp) {
-			Tcl_ResetResult(interp);
-			rc = Tcl_GetInt(interp, tmp, &int_val);
-		    }
-		    if (rc != TCL_OK) return NULL;
-		}
-		ber = TnmBerEncInt(ber, (u_char) asn1_type, int_val);
-		break;
-	    }
-	    case ASN1_COUNTER64: {
-		int int_val, rc;
-		if (session->version == TNM_SNMPv1) {
-		    Tcl_SetResult(interp,
-				  "Counter64 not allowed on an SNMPv1 session",
-				  TCL_STATIC);
-		    return NULL;
-		}
-		if (sizeof(int) >= 8) {
-		    rc = Tcl_GetInt(interp, value, &int_val);
-		    if (rc != TCL_OK) {
-			return NULL;
-		    }
-		    ber = TnmBerEncInt(ber, ASN1_COUNTER64, int_val);
-		} else {
-		    double d;
-		    rc = Tcl_GetDouble(interp, value, &d);
-		    if (rc != TCL_OK) {
-			return NULL;
-		    }
-		    if (d < 0) {
-			Tcl_SetResult(interp, "negativ counter value",
-				      TCL_STATIC);
-			return NULL;
-		    }
-		    ber = TnmBerEncUnsigned64(ber, d);
-		}
-		break;
-	    }
-	    case ASN1_IPADDRESS: {
-		int a, b, c, d, addr = inet_addr(value);
-		int cnt = sscanf(value, "%d.%d.%d.%d", &a, &b, &c, &d);
-		if ((addr == -1 && strcmp(value, "255.255.255.255") != 0)
-		    || (cnt != 4)) {
-		    Tcl_SetResult(interp, "invalid IP address", TCL_STATIC);
-		    return NULL;
-		}
-		ber = TnmBerEncOctetString(ber, ASN1_IPADDRESS,
-					   (char *) &addr, 4);
-		break;
-	    }
-	    case ASN1_OCTET_STRING: {
-		const char *hex = value, *scan;
-		int len;
-		static char *bin = NULL;
-		static size_t binLen = 0;
-		/* quick test for empty strings ... */
-		if (value[0] == 0) {
-		    ber = TnmBerEncOctetString(ber, ASN1_OCTET_STRING, NULL, 0);
-		    break;
-		}
-		scan = TnmMibScan(vbv[0], 0, value);
-		if (scan) hex = scan;
-		if (*hex) {
-		    len = strlen(hex);
-		    if (binLen < len + 1) {
-			if (bin) ckfree(bin);
-			binLen = len + 1;
-			bin = ckalloc(binLen);
-		    }
-		    if (TnmHexDec(hex, bin, &len) < 0) {
-			Tcl_SetResult(interp, "illegal OCTET STRING value",
-				      TCL_STATIC);
-			return NULL;
-		    }
-		} else {
-		    len = 0;
-		}
-		ber = TnmBerEncOctetString(ber, ASN1_OCTET_STRING, bin, len);
-		break;
-	    }
-	    case ASN1_OPAQUE: {
-		const char *hex = value;
-		int len;
-		static char *bin = NULL;
-		static size_t binLen = 0;
-		if (*hex) {
-		    len = strlen(hex);
-		    if (binLen < len + 1) {
-			if (bin) ckfree(bin);
-			binLen = len + 1;
-			bin = ckalloc(binLen);
-		    }
-		    if (TnmHexDec(hex, bin, &len) < 0) {
-			Tcl_SetResult(interp, "illegal Opaque value",
-				      TCL_STATIC);
-			return NULL;
-		    }
-		} else {
-		    len = 0;
-		}
-		ber = TnmBerEncOctetString(ber, ASN1_OPAQUE, bin, len);
-		break;
-	    }
-	    case ASN1_OBJECT_IDENTIFIER:
-		oid = TnmStrToOid(value, &oidlen);
-		if (! oid) {
-		    char *tmp = TnmMibGetOid(value);
-		    if (tmp) {
-			oid = TnmStrToOid(tmp, &oidlen);
-		    }
-		}
-		if (! oid) {
-		    Tcl_AppendResult(interp, 
-				     "illegal object identifier \"",
-				     value, "\"", (char *) NULL);
-		    return NULL;
-		}
-		ber = TnmBerEncOID(ber, oid, oidlen);
-		break;
-	    case ASN1_NO_SUCH_OBJECT:
-	    case ASN1_NO_SUCH_INSTANCE:
-	    case ASN1_END_OF_MIB_VIEW:
-	    case ASN1_NULL:
-		ber = TnmBerEncNull(ber, (u_char) asn1_type);
-		break;
-	    default:
-		sprintf(string, "unknown asn1 type 0x%.2x",
-			asn1_type);
-		Tcl_SetResult (interp, string, TCL_VOLATILE);
+	case ASN1_IPADDRESS:
+	case ASN1_OCTET_STRING:
+	case ASN1_OPAQUE:
+	    ber = TnmBerEncOctetString(ber, vbPtr->syntax,
+				       TnmSnmpVarBindData(vblPtr, vbPtr),
+				       vbPtr->value.data.length);
+	    break;
+	case ASN1_OBJECT_IDENTIFIER:
+	    ber = TnmBerEncOID(ber, TnmSnmpVarBindOidValue(vblPtr, vbPtr),
+			       vbPtr->value.data.length);
+	    break;
+	case ASN1_NO_SUCH_OBJECT:
+	case ASN1_NO_SUCH_INSTANCE:
+	case ASN1_END_OF_MIB_VIEW:
+	    if (type != ASN1_SNMP_RESPONSE) {
+		Tcl_ResetResult(interp);
+		Tcl_AppendResult(interp, "unknown type \"",
+			 TnmGetTableValue(tnmSnmpExceptionTable,
+					  vbPtr->syntax),
+			 "\"", (char *) NULL);
 		return NULL;
 	    }
+	    ber = TnmBerEncNull(ber, vbPtr->syntax);
+	    break;
+	default:
+	    ber = TnmBerEncNull(ber, ASN1_NULL);
+	    break;
 	}
+    }
 	
-	ber = TnmBerEncSequenceEnd(ber, vbSeqToken);
+    return TnmBerEncSequenceEnd(ber, vbSeqToken);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * TnmSnmpVarBindSize --
+ *
+ *	This procedure computes the number of octets needed to encode
+ *	a varbind of the varbind list vblPtr in a response PDU.
+ *
+ * Results:
+ *	The size of the encoded varbind or -1 if the varbind can not
+ *	be encoded. An error message is left in the interpreter in
+ *	the later case.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
 
-	ckfree((char *) vbv);
+int
+TnmSnmpVarBindSize(Tcl_Interp *interp, TnmSnmp *session, TnmSnmpVarBindList *vblPtr, TnmSnmpVarBind *vbPtr)
+{
+    u_char buffer[TNM_SNMP_MAXSIZE];
+    TnmBer _ber, *ber;
+
+    ber = TnmBerInit(&_ber, buffer, sizeof(buffer));
+    ber = EncodeVarBind(interp, session, ASN1_SNMP_RESPONSE,
+			vblPtr, vbPtr, ber);
+    if (ber == NULL) {
+	if (*Tcl_GetStringResult(interp) == '\0') {
+	    Tcl_SetResult(interp, TnmBerGetError(NULL), TCL_STATIC);
+	}
+	return -1;
     }
-
-    ckfree((char *) vblv);
-
-    ber = TnmBerEncSequenceEnd(ber, vblSeqToken);
-    ber = TnmBerEncSequenceEnd(ber, pduSeqToken);
-    return ber;
+    return TnmBerSize(ber);
 }
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * TnmSnmpEncodeOverhead --
+ *
+ *	This procedure computes the number of octets a message takes
+ *	on top of the encoded varbinds of its PDU. The message is
+ *	encoded without varbinds and we add the octets needed by the
+ *	length fields of the enclosing sequences if they grow to
+ *	their long form, plus a block of padding for encrypted
+ *	messages. The result is therefore an upper bound which is
+ *	exact for unencrypted messages larger than 255 octets.
+ *
+ * Results:
+ *	The overhead in octets or -1 if the message can not be
+ *	encoded. An error message is left in the interpreter in the
+ *	later case.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+int
+TnmSnmpEncodeOverhead(Tcl_Interp *interp, TnmSnmp *session, TnmSnmpPdu *pdu)
+{
+    u_char packet[TNM_SNMP_MAXSIZE];
+    TnmSnmpPdu empty = *pdu;
+    TnmBer *ber;
+    int size, levels = 3;
 
+    empty.vbList = NULL;
+    MapPdu(session, &empty);
+    ber = TnmBerCreate(packet, sizeof(packet));
+    if (EncodeMessage(interp, session, &empty, ber) != TCL_OK) {
+	TnmBerDelete(ber);
+	return -1;
+    }
+    size = TnmBerSize(ber);
+    TnmBerDelete(ber);
 
+#ifdef TNM_SNMPv3
+    if (session->version == TNM_SNMPv3) {
+	levels++;
+	if (session->securityLevel & TNM_SNMP_PRIV_MASK) {
+	    levels++;
+	    size += 8;
+	}
+    }
+#endif
+    return size + 2 * levels;
+}
@@ -70,6 +70,12 @@ GetOption	(Tcl_Interp *interp, ClientData object,
 static int
 SetOption	(Tcl_Interp *interp, ClientData object, 
 			     int option, Tcl_Obj *objPtr);
+static Tcl_Obj*
+GetManagerOption (Tcl_Interp *interp, ClientData object, 
+			     int option);
+static int
+SetManagerOption (Tcl_Interp *interp, ClientData object, 
+			     int option, Tcl_Obj *objPtr);
 static int
 BindEvent	(Tcl_Interp *interp, TnmSnmp *session,
 			     Tcl_Obj *eventPtr, Tcl_Obj *script);
@@ -88,6 +94,9 @@ NotifierCmd	(ClientData	clientData, Tcl_Interp *interp,
 static int
 ResponderCmd	(ClientData	clientData, Tcl_Interp *interp,
 			     int objc, Tcl_Obj *const objv[]);
+static int
+PollGroupCmd	(ClientData	clientData, Tcl_Interp *interp,
+			     int objc, Tcl_Obj *const objv[]);
 static int 
 WaitSession	(Tcl_Interp *interp, TnmSnmp *session, int id);
 
@@ -100,15 +109,18 @@ Notify		(Tcl_Interp *interp, TnmSnmp *session, int type,
 static int
 Request		(Tcl_Interp *interp, TnmSnmp *session, int type,
 			     int n, int m, Tcl_Obj *vbList, Tcl_Obj *cmd);
-static Tcl_Obj*
-WalkCheck	(int oidListLen, Tcl_Obj **oidListElems, 
-			     int vbListLen, Tcl_Obj **vbListElems);
 static void
 AsyncWalkProc	(TnmSnmp *session, TnmSnmpPdu *pdu, 
 			     ClientData clientData);
 static int
 AsyncWalk	(Tcl_Interp *interp, TnmSnmp *session,
 			     Tcl_Obj *oidList, Tcl_Obj *tclCmd);
+static void
+SyncWalkProc	(TnmSnmp *session, TnmSnmpPdu *pdu, 
+			     ClientData clientData);
+static void
+WalkError	(Tcl_Interp *interp, int errorStatus,
+			     int errorIndex, Tcl_Obj *vbList);
 static int
 SyncWalk	(Tcl_Interp *interp, TnmSnmp *session,
 			     Tcl_Obj *varName, Tcl_Obj *oidList, 
@@ -120,16 +132,29 @@ static int
 Extract		(Tcl_Interp *interp, int what, Tcl_Obj *objPtr,
 			     Tcl_Obj *indexObjPtr);
 
-#if 0
+struct TableColumn;
+struct TableToken;
+
 static int
-ExpandTable	(Tcl_Interp *interp, 
-			     char *tList, Tcl_DString *dst);
+ExpandTable	(Tcl_Interp *interp, Tcl_Obj *oidList,
+			     Tcl_Obj *columnList);
+static void
+TableProc	(TnmSnmp *session, TnmSnmpPdu *pdu,
+			     ClientData clientData);
 static int
-ExpandScalars	(Tcl_Interp *interp, 
-			     char *sList, Tcl_DString *dst);
+TableCompare	(struct TableColumn *aPtr, int a,
+			     struct TableColumn *bPtr, int b);
+static Tcl_Obj*
+TableMerge	(struct TableToken *tablePtr, Tcl_Obj *defaultObj,
+			     int dict);
 static int
 Table		(Tcl_Interp *interp, TnmSnmp *session,
-			     char *table, char *arrayName);
+			     int objc, Tcl_Obj *const objv[]);
+
+#if 0
+static int
+ExpandScalars	(Tcl_Interp *interp, 
+			     char *sList, Tcl_DString *dst);
 static int
 Scalars		(Tcl_Interp *interp, TnmSnmp *session,
 			     char *group, char *arrayName);
@@ -152,6 +177,7 @@ enum options {
     optPassword,
 #endif
     optTransport, optTimeout, optRetries, optWindow, optDelay,
+    optRate, optByteRate, optTargets, optMaxSize,
 #ifdef TNM_SNMP_BENCH
     optRtt, optSendSize, optRecvSize
 #endif
@@ -179,6 +205,8 @@ static TnmTable generatorOptionTable[] = {
     { optRetries,	"-retries" },
     { optWindow,	"-window" },
     { optDelay,		"-delay" },
+    { optRate,		"-rate" },
+    { optByteRate,	"-byteRate" },
     { optTags,		"-tags" },
 #ifdef TNM_SNMP_BENCH
     { optRtt,		"-rtt" },
@@ -221,6 +249,9 @@ static TnmTable responderOptionTable[] = {
     { optRetries,	"-retries" },
     { optWindow,	"-window" },
     { optDelay,		"-delay" },
+    { optRate,		"-rate" },
+    { optByteRate,	"-byteRate" },
+    { optMaxSize,	"-maxSize" },
     { optTags,		"-tags" },
     { 0, NULL }
 };
@@ -261,6 +292,8 @@ static TnmTable notifierOptionTable[] = {
     { optRetries,	"-retries" },
     { optWindow,	"-window" },
     { optDelay,		"-delay" },
+    { optRate,		"-rate" },
+    { optByteRate,	"-byteRate" },
     { optTags,		"-tags" },
     { optEnterprise,	"-enterprise" },
     { 0, NULL }
@@ -313,6 +346,49 @@ static TnmTable listenerEventTable[] = {
     { 0, NULL }
 };
 
+static TnmTable pollGroupOptionTable[] = {
+    { optPort,		"-port" },
+    { optVersion,	"-version" },
+    { optCommunity,	"-community" },
+    { optTargets,	"-targets" },
+    { optTimeout,	"-timeout" },
+    { optRetries,	"-retries" },
+    { optWindow,	"-window" },
+    { optDelay,		"-delay" },
+    { optRate,		"-rate" },
+    { optByteRate,	"-byteRate" },
+    { optTags,		"-tags" },
+    { 0, NULL }
+};
+
+static TnmConfig pollGroupConfig = {
+    pollGroupOptionTable,
+    SetOption,
+    GetOption
+};
+
+/*
+ * The options used to configure the manager sockets, which are
+ * shared by all sessions.
+ */
+
+enum managerOptions {
+    optSockets, optManagerPort, optRcvBuf
+};
+
+static TnmTable managerOptionTable[] = {
+    { optSockets,	"-sockets" },
+    { optManagerPort,	"-port" },
+    { optRcvBuf,	"-rcvbuf" },
+    { 0, NULL }
+};
+
+static TnmConfig managerConfig = {
+    managerOptionTable,
+    SetManagerOption,
+    GetManagerOption
+};
+
 /*
  * The following structure describes a Tcl command that should be
  * evaluated once we receive a response for a SNMP request.
@@ -321,9 +397,50 @@ static TnmTable listenerEventTable[] = {
 typedef struct AsyncToken {
     Tcl_Interp *interp;
     Tcl_Obj *tclCmd;
-    Tcl_Obj *oidList;
 } AsyncToken;
 
+/*
+ * The structure used to queue the rows of a synchronous walk until
+ * the body of the walk has been evaluated for them.
+ */
+
+typedef struct SyncWalkToken {
+    Tcl_Obj *rowsObj;		/* The rows received so far. */
+    int done;			/* Set once the walk has terminated. */
+    int errorStatus;		/* The status which terminated the walk. */
+    int errorIndex;		/* The error index of that status. */
+    Tcl_Obj *errorVbList;	/* The varbinds of the error response. */
+} SyncWalkToken;
+
+/*
+ * The structures used to retrieve a table. The columns are retrieved
+ * by a table walk and the cells are aligned by their instance
+ * identifiers once the walk is completed. The instance identifiers
+ * of a column are kept in one array of sub-identifiers, so that no
+ * strings are created for the cells.
+ */
+
+typedef struct TableColumn {
+    TnmOid oid;			/* The object identifier of the column. */
+    TnmMibNode *nodePtr;	/* The MIB definition of the column. */
+    int syntax;			/* The syntax of the values received. */
+    u_int *subs;		/* The instance identifiers of the cells. */
+    int numSubs;		/* Number of sub-identifiers in subs. */
+    int maxSubs;		/* Space available in subs. */
+    int *offsets;		/* Start of every instance identifier. */
+    int maxCells;		/* Space available in offsets. */
+    Tcl_Obj *valuesObj;		/* The values of the cells. */
+} TableColumn;
+
+typedef struct TableToken {
+    int numColumns;		/* Number of columns of the table. */
+    TableColumn *columns;	/* The columns of the table. */
+    int done;			/* Set once the walk has terminated. */
+    int errorStatus;		/* The error which terminated a walk. */
+    int errorIndex;		/* The error index of that error. */
+    Tcl_Obj *errorVbList;	/* The varbinds of the error response. */
+} TableToken;
+
 
 /*
  *----------------------------------------------------------------------
@@ -434,7 +551,7 @@ PduInit(TnmSnmpPdu *pduPtr, TnmSnmp *session, int type)
     pduPtr->errorStatus = TNM_SNMP_NOERROR;
     pduPtr->errorIndex = 0;    
     pduPtr->trapOID = NULL;
-    Tcl_DStringInit(&pduPtr->varbind);
+    pduPtr->vbList = NULL;
 
 #ifdef TNM_SNMP_BENCH
     memset((char *) &session->stats, 0, sizeof(session->stats));
@@ -461,7 +578,7 @@ static void
 PduFree(TnmSnmpPdu *pduPtr)
 {
     if (pduPtr->trapOID) ckfree(pduPtr->trapOID);
-    Tcl_DStringFree(&pduPtr->varbind);
+    TnmSnmpPduSetVarBinds(pduPtr, NULL);
 }
 
 /*
@@ -562,9 +679,19 @@ GetOption(Tcl_Interp *interp, ClientData object, int option)
 	return Tcl_NewIntObj(session->window);
     case optDelay:
 	if (session->domain != TNM_SNMP_UDP_DOMAIN) return NULL;
-	return Tcl_NewIntObj(session->delay);
+	return Tcl_NewIntObj(session->bucket.delay);
+    case optRate:
+	if (session->domain != TNM_SNMP_UDP_DOMAIN) return NULL;
+	return Tcl_NewIntObj(session->bucket.rate);
+    case optByteRate:
+	if (session->domain != TNM_SNMP_UDP_DOMAIN) return NULL;
+	return Tcl_NewIntObj(session->bucket.byteRate);
+    case optMaxSize:
+	return Tcl_NewIntObj(session->maxSize);
     case optTags:
 	return session->tagList;
+    case optTargets:
+	return session->targets ? session->targets : Tcl_NewListObj(0, NULL);
     case optEnterprise:
 	return Tcl_NewStringObj(TnmOidToString(&session->enterpriseOid), -1);
 #ifdef TNM_SNMP_BENCH
@@ -836,7 +963,38 @@ SetOption(Tcl_Interp *interp, ClientData object, int option, Tcl_Obj *objPtr)
 	if (TnmGetUnsignedFromObj(interp, objPtr, &num) != TCL_OK) {
 	    return TCL_ERROR;
 	}
-	session->delay = num;
+	session->bucket.delay = num;
+	return TCL_OK;
+    case optRate:
+	if (TnmGetUnsignedFromObj(interp, objPtr, &num) != TCL_OK) {
+	    return TCL_ERROR;
+	}
+	session->bucket.rate = num;
+	session->bucket.stamp = 0;
+	return TCL_OK;
+    case optByteRate:
+	if (TnmGetUnsignedFromObj(interp, objPtr, &num) != TCL_OK) {
+	    return TCL_ERROR;
+	}
+	session->bucket.byteRate = num;
+	session->bucket.stamp = 0;
+	return TCL_OK;
+    case optMaxSize:
+	if (TnmGetIntRangeFromObj(interp, objPtr, 484, TNM_SNMP_MAXSIZE,
+				  &num) != TCL_OK) {
+	    return TCL_ERROR;
+	}
+	session->maxSize = num;
+	return TCL_OK;
+    case optTargets:
+	if (Tcl_ListObjLength(interp, objPtr, &num) != TCL_OK) {
+	    return TCL_ERROR;
+	}
+	if (session->targets) {
+	    Tcl_DecrRefCount(session->targets);
+	}
+	session->targets = objPtr;
+	Tcl_IncrRefCount(session->targets);
 	return TCL_OK;
     case optTags:
 	if (session->tagList) {
@@ -859,6 +1017,96 @@ SetOption(Tcl_Interp *interp, ClientData object, int option, Tcl_Obj *objPtr)
     return TCL_OK;
 }
 
+/*
+ *----------------------------------------------------------------------
+ *
+ * GetManagerOption --
+ *
+ *	This procedure retrieves the value of a manager socket option.
+ *
+ * Results:
+ *	A pointer to the value.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static Tcl_Obj*
+GetManagerOption(Tcl_Interp *interp, ClientData object, int option)
+{
+    TnmSnmpManager *managerPtr = (TnmSnmpManager *) object;
+
+    switch ((enum managerOptions) option) {
+    case optSockets:
+	return Tcl_NewIntObj(managerPtr->sockets);
+    case optManagerPort:
+	return Tcl_NewIntObj(managerPtr->port);
+    case optRcvBuf:
+	return Tcl_NewIntObj(managerPtr->rcvbuf);
+    }
+    return NULL;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * SetManagerOption --
+ *
+ *	This procedure modifies a manager socket option. The sockets
+ *	are not reopened here since several options may be modified
+ *	at once.
+ *
+ * Results:
+ *	A standard Tcl result.
+ *
+ * Side effects:
+ *	The manager configuration is modified.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+SetManagerOption(Tcl_Interp *interp, ClientData object, int option, Tcl_Obj *objPtr)
+{
+    TnmSnmpManager *managerPtr = (TnmSnmpManager *) object;
+    int num;
+
+    switch ((enum managerOptions) option) {
+    case optSockets:
+	if (TnmGetPositiveFromObj(interp, objPtr, &num) != TCL_OK) {
+	    return TCL_ERROR;
+	}
+	if (num > TNM_SNMP_SOCKETS_MAX) {
+	    char buf[80];
+	    sprintf(buf, "number of sockets must not exceed %d",
+		    TNM_SNMP_SOCKETS_MAX);
+	    Tcl_SetResult(interp, buf, TCL_VOLATILE);
+	    return TCL_ERROR;
+	}
+	managerPtr->sockets = num;
+	return TCL_OK;
+    case optManagerPort:
+	if (TnmGetUnsignedFromObj(interp, objPtr, &num) != TCL_OK) {
+	    return TCL_ERROR;
+	}
+	if (num > 65535) {
+	    Tcl_SetResult(interp, "invalid port number", TCL_STATIC);
+	    return TCL_ERROR;
+	}
+	managerPtr->port = num;
+	return TCL_OK;
+    case optRcvBuf:
+	if (TnmGetUnsignedFromObj(interp, objPtr, &num) != TCL_OK) {
+	    return TCL_ERROR;
+	}
+	managerPtr->rcvbuf = num;
+	return TCL_OK;
+    }
+    return TCL_OK;
+}
+
 /*
  *----------------------------------------------------------------------
  *
@@ -1072,9 +1320,10 @@ Tnm_SnmpObjCmd(ClientData clientData, Tcl_Interp *interp, int	objc, Tcl_Obj *con
 #if 0
 	cmdArray,
 #endif
-	cmdDelta, cmdExpand, cmdFind, cmdGenerator, cmdInfo,
-	cmdListener, cmdNotifier, cmdOid, cmdResponder,
-	cmdType, cmdValue, cmdWait, cmdWatch 
+	cmdCache, cmdDelta, cmdEngines, cmdExpand, cmdFind, cmdGenerator, cmdInfo, cmdKeys,
+	cmdListener, cmdManager, cmdNotifier, cmdOid, cmdPollGroup, cmdRate,
+	cmdResponder,
+	cmdThreads, cmdType, cmdValue, cmdWait, cmdWatch 
     } cmd;
 
     static const char *cmdTable[] = {
@@ -1082,9 +1331,10 @@ Tnm_SnmpObjCmd(ClientData clientData, Tcl_Interp *interp, int	objc, Tcl_Obj *con
 #if 0
 	"array",
 #endif
-	"delta", "expand", "find", "generator", "info",
-	"listener", "notifier", "oid", "responder",
-	"type", "value", "wait", "watch",
+	"cache", "delta", "engines", "expand", "find", "generator", "info", "keys",
+	"listener", "manager", "notifier", "oid", "pollgroup", "rate",
+	"responder",
+	"threads", "type", "value", "wait", "watch",
 	(char *) NULL
     };
 
@@ -1402,6 +1652,40 @@ Tnm_SnmpObjCmd(ClientData clientData, Tcl_Interp *interp, int	objc, Tcl_Obj *con
 	result = Extract(interp, 0, objv[2], objc == 4 ? objv[3] : NULL);
 	break;
 
+    case cmdPollGroup:
+
+	/*
+	 * A poll group is a generator session without an address. Its
+	 * requests are sent to the targets of the poll group.
+	 */
+
+	if (TnmMibLoad(interp) != TCL_OK) {
+	    result = TCL_ERROR;
+	    break;
+	}
+	if (TnmSnmpManagerOpen(interp) != TCL_OK) {
+	    result = TCL_ERROR;
+	    break;
+	}
+
+	session = TnmSnmpCreateSession(interp, TNM_SNMP_GENERATOR);
+	session->config = &pollGroupConfig;
+	result = TnmSetConfig(interp, session->config,
+			      (ClientData) session, objc, objv);
+	if (result != TCL_OK) {
+	    TnmSnmpDeleteSession(session);
+	    break;
+	}
+
+	session->nextPtr = tnmSnmpList;
+	tnmSnmpList = session;
+
+	name = TnmGetHandle(interp, "snmp", &nextId);
+	session->token = Tcl_CreateObjCommand(interp, name, PollGroupCmd,
+			  (ClientData) session, DeleteProc);
+	Tcl_SetStringObj(Tcl_GetObjResult(interp), name, -1);
+	break;
+
     case cmdResponder:
 	if (TnmMibLoad(interp) != TCL_OK) {
 	    result = TCL_ERROR;
@@ -1486,6 +1770,147 @@ Tnm_SnmpObjCmd(ClientData clientData, Tcl_Interp *interp, int	objc, Tcl_Obj *con
 	}
 	break;
 
+    case cmdRate: {
+	int rate, byteRate;
+	if (objc != 2 && objc != 4) {
+	    Tcl_WrongNumArgs(interp, 2, objv, "?packets bytes?");
+	    result = TCL_ERROR;
+	    break;
+	}
+	if (objc == 4) {
+	    if (TnmGetUnsignedFromObj(interp, objv[2], &rate) != TCL_OK
+		|| TnmGetUnsignedFromObj(interp, objv[3], &byteRate) != TCL_OK) {
+		result = TCL_ERROR;
+		break;
+	    }
+	    tnmSnmpBucket.rate = rate;
+	    tnmSnmpBucket.byteRate = byteRate;
+	    tnmSnmpBucket.stamp = 0;
+	}
+	listPtr = Tcl_GetObjResult(interp);
+	Tcl_ListObjAppendElement(interp, listPtr,
+				 Tcl_NewIntObj(tnmSnmpBucket.rate));
+	Tcl_ListObjAppendElement(interp, listPtr,
+				 Tcl_NewIntObj(tnmSnmpBucket.byteRate));
+	break;
+    }
+
+    case cmdCache: {
+	int size, lifetime, entries;
+	if (objc != 2 && objc != 4) {
+	    Tcl_WrongNumArgs(interp, 2, objv, "?size lifetime?");
+	    result = TCL_ERROR;
+	    break;
+	}
+	if (objc == 4) {
+	    if (TnmGetUnsignedFromObj(interp, objv[2], &size) != TCL_OK
+		|| TnmGetUnsignedFromObj(interp, objv[3], &lifetime) != TCL_OK) {
+		result = TCL_ERROR;
+		break;
+	    }
+	    TnmSnmpAgentCacheConfig(size, lifetime);
+	}
+	TnmSnmpAgentCacheInfo(&size, &lifetime, &entries);
+	listPtr = Tcl_GetObjResult(interp);
+	Tcl_ListObjAppendElement(interp, listPtr, Tcl_NewIntObj(size));
+	Tcl_ListObjAppendElement(interp, listPtr, Tcl_NewIntObj(lifetime));
+	break;
+    }
+
+    case cmdEngines: {
+	static const char *engineCmdTable[] = {
+	    "clear", (char *) NULL
+	};
+	int engineCmd;
+	if (objc > 3) {
+	    Tcl_WrongNumArgs(interp, 2, objv, "?clear?");
+	    result = TCL_ERROR;
+	    break;
+	}
+	if (objc == 3) {
+	    result = Tcl_GetIndexFromObj(interp, objv[2], engineCmdTable,
+					 "option", TCL_EXACT, &engineCmd);
+	    if (result == TCL_OK) {
+		TnmSnmpEngineClear();
+	    }
+	    break;
+	}
+	Tcl_SetObjResult(interp, TnmSnmpEngineList());
+	break;
+    }
+
+    case cmdKeys: {
+	enum keyCmds { keyClear, keyCompute, keyFile } keyCmd;
+	static const char *keyCmdTable[] = {
+	    "clear", "compute", "file", (char *) NULL
+	};
+	if (objc == 2) {
+	    Tcl_SetObjResult(interp, Tcl_NewIntObj(TnmSnmpKeyCacheSize()));
+	    break;
+	}
+	result = Tcl_GetIndexFromObj(interp, objv[2], keyCmdTable,
+				     "option", TCL_EXACT, (int *) &keyCmd);
+	if (result != TCL_OK) {
+	    break;
+	}
+	switch (keyCmd) {
+	case keyClear:
+	    if (objc != 3) {
+		Tcl_WrongNumArgs(interp, 3, objv, (char *) NULL);
+		result = TCL_ERROR;
+		break;
+	    }
+	    TnmSnmpKeyCacheClear();
+	    break;
+	case keyCompute:
+	    if (objc != 4) {
+		Tcl_WrongNumArgs(interp, 3, objv, "list");
+		result = TCL_ERROR;
+		break;
+	    }
+	    result = TnmSnmpPrecomputeKeys(interp, objv[3]);
+	    break;
+	case keyFile:
+	    if (objc > 4) {
+		Tcl_WrongNumArgs(interp, 3, objv, "?fileName?");
+		result = TCL_ERROR;
+		break;
+	    }
+	    result = TnmSnmpKeyFile(interp, objc == 4 ? objv[3] : NULL);
+	    break;
+	}
+	break;
+    }
+
+    case cmdManager:
+	if (objc == 3) {
+	    result = TnmGetConfig(interp, &managerConfig,
+				  (ClientData) &tnmSnmpManager, objc, objv);
+	    break;
+	}
+	result = TnmSetConfig(interp, &managerConfig,
+			      (ClientData) &tnmSnmpManager, objc, objv);
+	if (result == TCL_OK && objc > 2) {
+	    result = TnmSnmpManagerReopen(interp);
+	}
+	break;
+
+    case cmdThreads: {
+	int count = -1;
+	if (objc > 3) {
+	    Tcl_WrongNumArgs(interp, 2, objv, "?count?");
+	    result = TCL_ERROR;
+	    break;
+	}
+	if (objc == 3
+	    && TnmGetUnsignedFromObj(interp, objv[2], &count) != TCL_OK) {
+	    result = TCL_ERROR;
+	    break;
+	}
+	result = TnmSnmpManagerThreads(interp, count);
+	break;
+    }
+
     case cmdWatch:
 	if (objc > 3) {
 	    Tcl_WrongNumArgs(interp, 2, objv, "?bool?");
@@ -1533,7 +1958,7 @@ GeneratorCmd(ClientData clientData, Tcl_Interp *interp, int objc, Tcl_Obj *const
 #ifdef ASN1_SNMP_GETRANGE
 	cmdGetRange, 
 #endif
-	cmdSet, cmdWait, cmdWalk
+	cmdSet, cmdTbl, cmdWait, cmdWalk
     } cmd;
 
     static const char *cmdTable[] = {
@@ -1541,7 +1966,7 @@ GeneratorCmd(ClientData clientData, Tcl_Interp *interp, int objc, Tcl_Obj *const
 #ifdef ASN1_SNMP_GETRANGE
  	"getrange", 
 #endif
-	"set", "wait", "walk", (char *) NULL
+	"set", "table", "wait", "walk", (char *) NULL
     };
 
     if (objc < 2) {
@@ -1670,6 +2095,14 @@ GeneratorCmd(ClientData clientData, Tcl_Interp *interp, int objc, Tcl_Obj *const
 	return Request(interp, session, ASN1_SNMP_SET, 0, 0,
 		       objv[2], (objc == 4) ? objv[3] : NULL);
 
+    case cmdTbl:
+	if (objc < 3) {
+	    Tcl_WrongNumArgs(interp, 2, objv,
+			     "?-dict? ?-default value? varBindList");
+	    return TCL_ERROR;
+	}
+	return Table(interp, session, objc, objv);
+
     case cmdWait:
 	if (objc == 2) {
 	    return WaitSession(interp, session, 0);
@@ -1715,13 +2148,6 @@ GeneratorCmd(ClientData clientData, Tcl_Interp *interp, int objc, Tcl_Obj *const
     }
 
     switch (cmd) {
-    case cmdTbl:
-	if (argc != 4) {
-	    TnmWrongNumArgs(interp, 2, argv, "table arrayName");
-	    return TCL_ERROR;
-	}
-	return Table(interp, session, argv[2], argv[3]);
-
     case cmdScalars:
 	if (argc != 4) {
 	    TnmWrongNumArgs(interp, 2, argv, "group arrayName");
@@ -1965,9 +2391,9 @@ NotifierCmd(ClientData clientData, Tcl_Interp *interp, int	objc, Tcl_Obj *const
 /*
  *----------------------------------------------------------------------
  *
- * ResponderCmd --
+ * PollGroupCmd --
  *
- *	This procedure is invoked to process a agent command.
+ *	This procedure is invoked to process a poll group command.
  *	See the user documentation for details on what it does.
  *
  * Results:
@@ -1980,29 +2406,30 @@ NotifierCmd(ClientData clientData, Tcl_Interp *interp, int	objc, Tcl_Obj *const
  */
 
 static int
-ResponderCmd(ClientData clientData, Tcl_Interp *interp, int	objc, Tcl_Obj *const objv[])
+PollGroupCmd(ClientData clientData, Tcl_Interp *interp, int objc, Tcl_Obj *const objv[])
 {
     TnmSnmp *session = (TnmSnmp *) clientData;
-    int code;
+    int code, nonReps, maxReps;
 
     enum commands {
-	cmdBind, cmdCget, cmdConfigure, cmdDestroy, cmdInstance
+	cmdCget, cmdConfigure, cmdDestroy, cmdGet, cmdGetBulk, cmdGetNext,
+	cmdRates, cmdWait
     } cmd;
 
     static const char *cmdTable[] = {
-	"bind", "cget", "configure", "destroy", "instance",
-	(char *) NULL
+	"cget", "configure", "destroy", "get", "getbulk", "getnext",
+	"rates", "wait", (char *) NULL
     };
 
     if (objc < 2) {
-	Tcl_WrongNumArgs(interp, 1, objv, "option ?arg arg ...?");
-        return TCL_ERROR;
+ 	Tcl_WrongNumArgs(interp, 1, objv, "option ?arg arg ...?");
+	return TCL_ERROR;
     }
 
     code = Tcl_GetIndexFromObj(interp, objv[1], cmdTable, 
-			       "option", TCL_EXACT, (int *) &cmd);
+ 			       "option", TCL_EXACT, (int *) &cmd);
     if (code != TCL_OK) {
-	return code;
+ 	return code;
     }
 
     switch (cmd) {
@@ -2011,9 +2438,119 @@ ResponderCmd(ClientData clientData, Tcl_Interp *interp, int	objc, Tcl_Obj *const
 			    (ClientData) session, objc, objv);
 
     case cmdConfigure:
+	return TnmSetConfig(interp, session->config,
+			    (ClientData) session, objc, objv);
 
-	/*
-	 * This call to WaitSession() is needed to ensure that a 
+    case cmdDestroy:
+	if (objc != 2) {
+	    Tcl_WrongNumArgs(interp, 2, objv, (char *) NULL);
+	    return TCL_ERROR;
+	}
+	Tcl_DeleteCommandFromToken(interp, session->token);
+	return TCL_OK;
+
+    case cmdGet:
+	if (objc != 4) {
+	    Tcl_WrongNumArgs(interp, 2, objv, "varBindList script");
+	    return TCL_ERROR;
+	}
+	return TnmSnmpPoll(interp, session, ASN1_SNMP_GET, 0, 0, 0,
+			   objv[2], objv[3]);
+
+    case cmdGetNext:
+	if (objc != 4) {
+	    Tcl_WrongNumArgs(interp, 2, objv, "varBindList script");
+	    return TCL_ERROR;
+	}
+	return TnmSnmpPoll(interp, session, ASN1_SNMP_GETNEXT, 0, 0, 0,
+			   objv[2], objv[3]);
+
+    case cmdRates:
+	if (objc != 4) {
+	    Tcl_WrongNumArgs(interp, 2, objv, "varBindList script");
+	    return TCL_ERROR;
+	}
+	return TnmSnmpPoll(interp, session, ASN1_SNMP_GET, 0, 0, 1,
+			   objv[2], objv[3]);
+
+    case cmdGetBulk:
+	if (objc != 6) {
+	    Tcl_WrongNumArgs(interp, 2, objv, 
+		    "nonRepeaters maxRepetitions varBindList script");
+	    return TCL_ERROR;
+	}
+	if (TnmGetUnsignedFromObj(interp, objv[2], &nonReps) != TCL_OK) {
+	    return TCL_ERROR;
+	}
+	if (TnmGetPositiveFromObj(interp, objv[3], &maxReps) != TCL_OK) {
+	    return TCL_ERROR;
+	}
+	return TnmSnmpPoll(interp, session, ASN1_SNMP_GETBULK,
+			   nonReps, maxReps, 0, objv[4], objv[5]);
+
+    case cmdWait:
+	if (objc != 2) {
+	    Tcl_WrongNumArgs(interp, 2, objv, (char *) NULL);
+	    return TCL_ERROR;
+	}
+	return WaitSession(interp, session, 0);
+    }
+
+    return TCL_OK;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * ResponderCmd --
+ *
+ *	This procedure is invoked to process a agent command.
+ *	See the user documentation for details on what it does.
+ *
+ * Results:
+ *	A standard Tcl result.
+ *
+ * Side effects:
+ *	See the user documentation.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+ResponderCmd(ClientData clientData, Tcl_Interp *interp, int	objc, Tcl_Obj *const objv[])
+{
+    TnmSnmp *session = (TnmSnmp *) clientData;
+    int code;
+
+    enum commands {
+	cmdBind, cmdCget, cmdConfigure, cmdDestroy, cmdInstance, cmdProvider
+    } cmd;
+
+    static const char *cmdTable[] = {
+	"bind", "cget", "configure", "destroy", "instance", "provider",
+	(char *) NULL
+    };
+
+    if (objc < 2) {
+	Tcl_WrongNumArgs(interp, 1, objv, "option ?arg arg ...?");
+        return TCL_ERROR;
+    }
+
+    code = Tcl_GetIndexFromObj(interp, objv[1], cmdTable, 
+			       "option", TCL_EXACT, (int *) &cmd);
+    if (code != TCL_OK) {
+	return code;
+    }
+
+    switch (cmd) {
+    case cmdCget:
+	return TnmGetConfig(interp, session->config,
+			    (ClientData) session, objc, objv);
+
+    case cmdConfigure:
+
+	/*
+	 * This call to WaitSession() is needed to ensure that a 
 	 * configuration change does not affect queued requests.
 	 */
 
@@ -2068,6 +2605,27 @@ ResponderCmd(ClientData clientData, Tcl_Interp *interp, int	objc, Tcl_Obj *const
 	    return code;
 	}
 	break;
+
+    case cmdProvider: {
+	TnmOid *oidPtr;
+	Tcl_Obj *cmdPrefix;
+	if (objc < 3 || objc > 4) {
+	    Tcl_WrongNumArgs(interp, 2, objv, "oid ?command?");
+	    return TCL_ERROR;
+	}
+	oidPtr = TnmGetOidFromObj(interp, objv[2]);
+	if (! oidPtr) {
+	    return TCL_ERROR;
+	}
+	if (objc == 4) {
+	    return TnmSnmpSetTclProvider(interp, oidPtr, objv[3]);
+	}
+	cmdPrefix = TnmSnmpGetTclProvider(oidPtr);
+	if (cmdPrefix) {
+	    Tcl_SetObjResult(interp, cmdPrefix);
+	}
+	break;
+    }
     }
 
     return TCL_OK;
@@ -2194,7 +2752,7 @@ Notify(Tcl_Interp *interp, TnmSnmp *session, int type, Tcl_Obj *oid, Tcl_Obj *vb
 	}
 	pdu.trapOID = ckstrdup(tmp);
     }
-    Tcl_DStringAppend(&pdu.varbind, Tcl_GetStringFromObj(vbl, NULL), -1);
+    TnmSnmpPduSetVarBinds(&pdu, vbl);
     if (TnmSnmpEncode(interp, session, &pdu, NULL, NULL) != TCL_OK) {
 	PduFree(&pdu);
 	return TCL_ERROR;
@@ -2225,7 +2783,6 @@ Request(Tcl_Interp *interp, TnmSnmp *session, int type, int non, int max, Tcl_Ob
 {
     TnmSnmpPdu pdu;
     int code = TCL_OK;
-    char *vbl = Tcl_GetStringFromObj(vbList, NULL);
     char *cmd = cmdObj ? Tcl_GetStringFromObj(cmdObj, NULL) : NULL;
 
     PduInit(&pdu, session, type);
@@ -2233,14 +2790,13 @@ Request(Tcl_Interp *interp, TnmSnmp *session, int type, int non, int max, Tcl_Ob
 	pdu.errorStatus = non > 0 ? non : 0;
 	pdu.errorIndex = max > 0 ? max : 0;
     }
-    Tcl_DStringAppend(&pdu.varbind, vbl, -1);
+    TnmSnmpPduSetVarBinds(&pdu, vbList);
 
     if (cmd) {
 	AsyncToken *atPtr = (AsyncToken *) ckalloc(sizeof(AsyncToken));
 	atPtr->interp = interp;
 	atPtr->tclCmd = cmdObj;
 	Tcl_IncrRefCount(atPtr->tclCmd);
-	atPtr->oidList = NULL;
 	code = TnmSnmpEncode(interp, session, &pdu, 
 			     ResponseProc, (ClientData) atPtr);
 	if (code != TCL_OK) {
@@ -2255,80 +2811,14 @@ Request(Tcl_Interp *interp, TnmSnmp *session, int type, int non, int max, Tcl_Ob
     return code;
 }
 
-/*
- *----------------------------------------------------------------------
- *
- * WalkCheck --
- *
- *	This procedure is used to implement MIB walks. It takes
- *	a list of object identifier values and a varbind list as
- *	input and checks whether the varbinds are contained in
- *	the subtrees defined by the object identifier values. This
- *	procedure also checks whether a syntax value of a varbind
- *	matches the endOfMibView exception.
- *
- * Results:
- *	A pointer to the varbind list or NULL if the varbind list
- *	elements are not contained in the subtrees defined by the
- *	object identifier list.
- *
- * Side effects:
- *	None.
- *
- *----------------------------------------------------------------------
- */
-
-static Tcl_Obj*
-WalkCheck(int oidListLen, Tcl_Obj **oidListElems, int vbListLen, Tcl_Obj **vbListElems)
-{
-    int i, code;
-    Tcl_Obj *objPtr;
-
-    /*
-     * Check if all the object identifiers are in the subtree.
-     */
-    
-    for (i = 0; i < oidListLen; i++) {
-	code = Tcl_ListObjIndex(NULL, vbListElems[i], 0, &objPtr);
-	if (code != TCL_OK || !objPtr) {
-	    Tcl_Panic("WalkCheck: no object identifier in varbind list");
-	}
-	code = TnmOidInTree(TnmGetOidFromObj(NULL, oidListElems[i]),
-			    TnmGetOidFromObj(NULL, objPtr));
-	if (! code) {
-	    return NULL;
-	}
-    }
-
-    /*
-     * Check if we got an endOfMibView exception.
-     */
-
-    for (i = 0; i < oidListLen; i++) {
-	code = Tcl_ListObjIndex(NULL, vbListElems[i], 1, &objPtr);
-	if (code != TCL_OK || !objPtr) {
-	    Tcl_Panic("WalkCheck: no syntax in varbind list");
-	}
-	code = TnmGetTableKey(tnmSnmpExceptionTable,
-			      Tcl_GetStringFromObj(objPtr, NULL));
-	if (code == ASN1_END_OF_MIB_VIEW) {
-	    return NULL;
-	}
-    }
-
-    objPtr = Tcl_NewListObj(oidListLen, vbListElems);
-    return objPtr;
-}
-
 /*
  *----------------------------------------------------------------------
  *
  * AsyncWalkProc --
  *
- *	This procedure is called once we have received the response
- *	during an asynchronous SNMP walk. It evaluates a Tcl script
- *	and starts another SNMP getnext if we did not reach the end
- *	of the MIB view.
+ *	This procedure is called by the walk engine for every row
+ *	retrieved during an asynchronous SNMP walk and once more when
+ *	the walk terminates. It evaluates the Tcl callback script.
  *
  * Results:
  *	None.
@@ -2343,63 +2833,17 @@ static void
 AsyncWalkProc(TnmSnmp *session, TnmSnmpPdu *pdu, ClientData clientData)
 {
     AsyncToken *atPtr = (AsyncToken *) clientData;
-    Tcl_Interp *interp = atPtr->interp;
-    Tcl_Obj *vbList, *newList, **vbListElems, **oidListElems;
-    int vbListLen, oidListLen;
 
-#if 0
-    if (pdu->errorStatus == TNM_SNMP_NOSUCHNAME) {
-	pdu->errorStatus = TNM_SNMP_ENDOFWALK;
-	TnmSnmpEvalCallback(interp, session, pdu, 
+    if (pdu) {
+	TnmSnmpEvalCallback(atPtr->interp, session, pdu, 
 			    Tcl_GetStringFromObj(atPtr->tclCmd, NULL),
 			    NULL, NULL, NULL, NULL);
-	goto done;
-    }
-#endif
-
-    if (pdu->errorStatus != TNM_SNMP_NOERROR) {
-	TnmSnmpEvalCallback(interp, session, pdu, 
-			    Tcl_GetStringFromObj(atPtr->tclCmd, NULL),
-			    NULL, NULL, NULL, NULL);
-	goto done;
+	if (pdu->errorStatus == TNM_SNMP_NOERROR) {
+	    return;
+	}
     }
 
-    vbList = Tcl_NewStringObj(Tcl_DStringValue(&pdu->varbind), 
-			      Tcl_DStringLength(&pdu->varbind));
-    
-    if (Tcl_ListObjGetElements(interp, atPtr->oidList,
-			       &oidListLen, &oidListElems) != TCL_OK) {
-	Tcl_Panic("AsyncWalkProc: failed to split object identifier list");
-    }
-    
-    if (Tcl_ListObjGetElements(interp, vbList,
-			       &vbListLen, &vbListElems) != TCL_OK) {
-	Tcl_Panic("AsyncWalkProc: failed to split varbind list");
-    }
-    
-    newList = WalkCheck(oidListLen, oidListElems, vbListLen, vbListElems);
-    Tcl_DecrRefCount(vbList);
-    if (! newList) {
-	pdu->errorStatus = TNM_SNMP_ENDOFWALK;
-	Tcl_DStringFree(&pdu->varbind);
-	TnmSnmpEvalCallback(interp, session, pdu, 
-			    Tcl_GetStringFromObj(atPtr->tclCmd, NULL),
-			    NULL, NULL, NULL, NULL);
-	goto done;
-    }
-    TnmSnmpEvalCallback(interp, session, pdu, 
-			Tcl_GetStringFromObj(atPtr->tclCmd, NULL),
-			NULL, NULL, NULL, NULL);
-    pdu->type = ASN1_SNMP_GETNEXT;
-    pdu->requestId = TnmSnmpGetRequestId();
-    (void) TnmSnmpEncode(interp, session, pdu, AsyncWalkProc, 
-			 (ClientData) atPtr);
-    Tcl_DecrRefCount(newList);
-    return;
-
-done:
     Tcl_DecrRefCount(atPtr->tclCmd);
-    Tcl_DecrRefCount(atPtr->oidList);
     ckfree((char *) atPtr);
 }
 
@@ -2409,11 +2853,9 @@ done:
  * AsyncWalk --
  *
  *	This procedure walks a MIB tree. It evaluates the given Tcl
- *	command foreach varbind retrieved using getbulk requests.
- *	First, all variables contained in the list argument are
- *	converted to their OIDs. Then we start an asynchronous loop
- *	using gebulk requests until we get an error or until one
- *	returned variable starts with an OID not being a valid prefix.
+ *	command foreach row retrieved by the walk engine. The callback
+ *	is evaluated a last time with the error status endOfWalk or
+ *	with the error which terminated the walk.
  *
  * Results:
  *	A standard Tcl result.
@@ -2427,20 +2869,10 @@ done:
 static int
 AsyncWalk(Tcl_Interp *interp, TnmSnmp *session, Tcl_Obj *oidList, Tcl_Obj *tclCmd)
 {
-    TnmSnmpPdu pdu;
-    int i, result;
+    int result, oidListLen;
     AsyncToken *atPtr;
 
-    int oidListLen;
-    Tcl_Obj **oidListElems;
-    
-    /*
-     * Make sure our argument is a valid Tcl list where every 
-     * element in the list is a valid object identifier.
-     */
-
-    result = Tcl_ListObjGetElements(interp, oidList,
-				    &oidListLen, &oidListElems);
+    result = Tcl_ListObjLength(interp, oidList, &oidListLen);
     if (result != TCL_OK) {
 	return TCL_ERROR;
     }
@@ -2448,13 +2880,6 @@ AsyncWalk(Tcl_Interp *interp, TnmSnmp *session, Tcl_Obj *oidList, Tcl_Obj *tclCm
 	return TCL_OK;
     }
 
-    for (i = 0; i < oidListLen; i++) {
-	TnmOid *oidPtr = TnmGetOidFromObj(interp, oidListElems[i]);
-	if (! oidPtr) {
-	    return TCL_ERROR;
-	}
-    }
-
     /*
      * The structure where we keep all information about this
      * asynchronous walk.
@@ -2464,33 +2889,106 @@ AsyncWalk(Tcl_Interp *interp, TnmSnmp *session, Tcl_Obj *oidList, Tcl_Obj *tclCm
     atPtr->interp = interp;
     atPtr->tclCmd = tclCmd;
     Tcl_IncrRefCount(atPtr->tclCmd);
-    atPtr->oidList = oidList;
-    Tcl_IncrRefCount(atPtr->oidList);
 
-    PduInit(&pdu, session, ASN1_SNMP_GETNEXT);
-    Tcl_DStringAppend(&pdu.varbind, Tcl_GetStringFromObj(oidList, NULL), -1);
-    result = TnmSnmpEncode(interp, session, &pdu, 
-			   AsyncWalkProc, (ClientData) atPtr);
+    result = TnmSnmpWalk(interp, session, oidList, TNM_SNMP_ASYNC,
+			 AsyncWalkProc, (ClientData) atPtr);
     if (result != TCL_OK) {
 	Tcl_DecrRefCount(atPtr->tclCmd);
-	Tcl_DecrRefCount(atPtr->oidList);
 	ckfree((char *) atPtr);
     }
-    PduFree(&pdu);
     return result;
 }
 
+/*
+ *----------------------------------------------------------------------
+ *
+ * SyncWalkProc --
+ *
+ *	This procedure is called by the walk engine for every row
+ *	retrieved during a synchronous SNMP walk. The rows are queued
+ *	until the body of the walk is evaluated for them.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	The row is appended to the rows of the walk.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+SyncWalkProc(TnmSnmp *session, TnmSnmpPdu *pdu, ClientData clientData)
+{
+    SyncWalkToken *swPtr = (SyncWalkToken *) clientData;
+
+    if (! pdu) {
+	swPtr->done = 1;
+	return;
+    }
+
+    if (pdu->errorStatus == TNM_SNMP_NOERROR) {
+	Tcl_ListObjAppendElement(NULL, swPtr->rowsObj, pdu->vbList);
+	return;
+    }
+
+    swPtr->done = 1;
+    swPtr->errorStatus = pdu->errorStatus;
+    swPtr->errorIndex = pdu->errorIndex;
+    if (pdu->vbList) {
+	swPtr->errorVbList = pdu->vbList;
+	Tcl_IncrRefCount(swPtr->errorVbList);
+    }
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * WalkError --
+ *
+ *	This procedure leaves the error which terminated a walk in
+ *	the interpreter. The error message has the same format as
+ *	the error messages of synchronous requests.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	The interpreter result is modified.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+WalkError(Tcl_Interp *interp, int errorStatus, int errorIndex, Tcl_Obj *vbList)
+{
+    char buf[20];
+    char *name;
+
+    if (errorStatus == TNM_SNMP_NORESPONSE) {
+	Tcl_SetResult(interp, "noResponse 0 {}", TCL_STATIC);
+	return;
+    }
+
+    name = TnmGetTableValue(tnmSnmpErrorTable, (unsigned) errorStatus);
+    Tcl_ResetResult(interp);
+    sprintf(buf, " %d ", errorIndex - 1);
+    Tcl_AppendResult(interp, name ? name : "unknown", buf,
+		     vbList ? Tcl_GetString(vbList) : "", (char *) NULL);
+}
+
 /*
  *----------------------------------------------------------------------
  *
  * SyncWalk --
  *
  *	This procedure walks a MIB tree. It evaluates the given Tcl
- *	command foreach varbind retrieved using getbulk requests.
- *	First, all variables contained in the list argument are
- *	converted to their OIDs. Then we loop using gebulk requests
- *	until we get an error or until one returned variable starts
- *	with an OID not being a valid prefix.
+ *	command foreach row retrieved by the walk engine. The engine
+ *	keeps several requests in flight, but like other synchronous
+ *	requests it waits only for its own responses and no events
+ *	are processed. The body is evaluated while no request is in
+ *	flight, in the context of the caller, in the same order as
+ *	the rows appear in the MIB tree.
  *
  * Results:
  *	A standard Tcl result.
@@ -2504,45 +3002,11 @@ AsyncWalk(Tcl_Interp *interp, TnmSnmp *session, Tcl_Obj *oidList, Tcl_Obj *tclCm
 static int
 SyncWalk(Tcl_Interp *interp, TnmSnmp *session, Tcl_Obj *varName, Tcl_Obj *oidList, Tcl_Obj *tclCmd)
 {
-    int i, j, result;
-    TnmSnmpPdu pdu;
-    int numRepeaters = 0;
-    int oidListLen, vbListLen;
-    Tcl_Obj **oidListElems, **vbListElems, *vbList;
-
-    /* 
-     * Set warpFactor and warpLimit variables defined below control
-     * how we increate the numRepeaters parameter while walking the
-     * MIB tree. We currently use the sequence 4 8 12 16 20 ... 48.
-     *
-     * The warpFactor defines the amount used to increase the value on
-     * numRepeaters in every round. The warpLimit defines an upper
-     * limit for numRepeaters. Note, the code below reduces the upper
-     * limit whenever a response is received with contains an
-     * "incomplete row".
-     *
-     * Some measurements show some real interesting effects. If you
-     * increase the warp factor too much, you will risk timeouts
-     * because the agent might need a lot of time to build the
-     * response. If the agent does not cache response packets, you
-     * will get very bad performance once the agents input queue fills
-     * up with retries. Therefore, we have limited the `warp' factor to
-     * 48 which works well with scotty's default parameters on an
-     * Ethernet. (This number should not be hard coded but perhaps it
-     * is better so because everyone should read this comment before
-     * playing with these parameters.)
-     */
-
-    int warpLimit = 48;
-    int warpFactor = 4;
-    
-    /*
-     * Make sure our argument is a valid Tcl list where every 
-     * element in the list is a valid object identifier.
-     */
+    int result, oidListLen, numRows, next = 0;
+    SyncWalkToken sw;
+    Tcl_Obj *rowObj;
 
-    result = Tcl_ListObjGetElements(interp, oidList,
-				    &oidListLen, &oidListElems);
+    result = Tcl_ListObjLength(interp, oidList, &oidListLen);
     if (result != TCL_OK) {
 	return TCL_ERROR;
     }
@@ -2550,118 +3014,72 @@ SyncWalk(Tcl_Interp *interp, TnmSnmp *session, Tcl_Obj *varName, Tcl_Obj *oidLis
 	return TCL_OK;
     }
 
-    PduInit(&pdu, session, ASN1_SNMP_GETBULK);
+    memset((char *) &sw, 0, sizeof(sw));
+    sw.rowsObj = Tcl_NewListObj(0, NULL);
+    Tcl_IncrRefCount(sw.rowsObj);
 
-    for (i = 0; i < oidListLen; i++) {
-	TnmOid *oidPtr = TnmGetOidFromObj(interp, oidListElems[i]);
-	if (! oidPtr) {
-	    PduFree(&pdu);
-	    return TCL_ERROR;
-	}
-	Tcl_DStringAppendElement(&pdu.varbind, TnmOidToString(oidPtr));
+    Tcl_Preserve((ClientData) session);
+    result = TnmSnmpWalk(interp, session, oidList, TNM_SNMP_SYNC,
+			 SyncWalkProc, (ClientData) &sw);
+    if (result != TCL_OK) {
+	goto done;
     }
 
     while (1) {
-
-	pdu.type        = ASN1_SNMP_GETBULK;
-	pdu.requestId   = TnmSnmpGetRequestId();
-
-	if (numRepeaters < warpLimit ) {
-	    numRepeaters += warpFactor;
+	Tcl_ListObjLength(NULL, sw.rowsObj, &numRows);
+	if (next == numRows) {
+	    if (sw.done) {
+		break;
+	    }
+	    if (next > 0) {
+		Tcl_ListObjReplace(NULL, sw.rowsObj, 0, next, 0, NULL);
+		next = 0;
+	    }
+	    result = TnmSnmpWalkWait(session, (ClientData) &sw);
+	    if (result != TCL_OK) {
+		break;
+	    }
+	    continue;
 	}
 
-	pdu.errorStatus = 0;
-	pdu.errorIndex  = (numRepeaters / oidListLen > 0) 
-	    ? numRepeaters / oidListLen : 1;
-
-	result = TnmSnmpEncode(interp, session, &pdu, NULL, NULL);
-	vbList = Tcl_GetObjResult(interp);
-	if (result == TCL_ERROR && pdu.errorStatus == TNM_SNMP_NOSUCHNAME) {
-	    result = TCL_OK;
-	    break;
-	}
-	if (result != TCL_OK) {
-            break;
-        }
-	
-	result = Tcl_ListObjGetElements(interp, vbList,
-					&vbListLen, &vbListElems);
-	if (result != TCL_OK) {
+	Tcl_ListObjIndex(NULL, sw.rowsObj, next++, &rowObj);
+	if (Tcl_ObjSetVar2(interp, varName, (Tcl_Obj *) NULL,
+			   rowObj, TCL_LEAVE_ERR_MSG) == NULL) {
+	    result = TCL_ERROR;
 	    break;
 	}
 
-	if (vbListLen < oidListLen) {
-	    Tcl_SetResult(interp, "response with wrong # of varbinds",
-			  TCL_STATIC);
-	    result = TCL_ERROR;
-	    break;
+	result = Tcl_EvalObj(interp, tclCmd);
+	if (result == TCL_OK || result == TCL_CONTINUE) {
+	    result = TCL_OK;
+	    continue;
 	}
-	if (vbListLen % oidListLen) {
-	    /*
-	     * This case is legal according to RFC 1905 when an agent
-	     * truncates the varbind list due to message size
-	     * restrictions.  We handle this case by ignoring the
-	     * trailing varbinds. Otherwise our walk would get out of
-	     * sync. 
-	     */
-	    vbListLen -= vbListLen % oidListLen;
-	    if (warpLimit > 0) {
-		numRepeaters -= warpFactor;
-		warpLimit = numRepeaters;
-	    }
+	if (result == TCL_BREAK) {
+	    result = TCL_OK;
+	} else if (result == TCL_ERROR) {
+	    char msg[100];
+	    sprintf(msg, "\n    (\"%s walk\" body line %d)",
+		    Tcl_GetCommandName(interp, session->token),
+		    Tcl_GetErrorLine(interp));
+	    Tcl_AddErrorInfo(interp, msg);
 	}
+	break;
+    }
 
-	Tcl_IncrRefCount(vbList);
-	for (j = 0; j < vbListLen / oidListLen; j++) {
-
-	    Tcl_Obj *newList;
-
-	    newList = WalkCheck(oidListLen, oidListElems, oidListLen,
-			vbListElems + (j * oidListLen));
-	    if (! newList) {
-		Tcl_DecrRefCount(vbList);
-		goto loopDone;
-	    }
-
-	    PduFree(&pdu);
-	    Tcl_DStringAppend(&pdu.varbind, 
-			      Tcl_GetStringFromObj(newList, NULL), -1);
-
-	    if (Tcl_ObjSetVar2(interp, varName, (Tcl_Obj *) NULL,
-			       newList, TCL_LEAVE_ERR_MSG) == NULL) {
-		result = TCL_ERROR;
-		Tcl_DecrRefCount(vbList);
-		Tcl_DecrRefCount(newList);
-		goto loopDone;
-	    }
-
-	    result = Tcl_EvalObj(interp, tclCmd);
-	    if (result != TCL_OK) {
-		if (result == TCL_CONTINUE) {
-		    result = TCL_OK;
-		} else if (result == TCL_BREAK) {
-		    result = TCL_OK;
-		    Tcl_DecrRefCount(vbList);
-		    goto loopDone;
-		} else if (result == TCL_ERROR) {
-		    char msg[100];
-		    sprintf(msg, "\n    (\"%s walk\" body line %d)",
-			    Tcl_GetCommandName(interp, session->token),
-			    Tcl_GetErrorLine(interp));
-		    Tcl_AddErrorInfo(interp, msg);
-		    Tcl_DecrRefCount(vbList);
-		    goto loopDone;
-		} else {
-		    Tcl_DecrRefCount(vbList);
-		    goto loopDone;
-		}
-	    }
-	}
-	Tcl_DecrRefCount(vbList);
+    if (! sw.done) {
+	TnmSnmpWalkAbort(session, (ClientData) &sw);
+    } else if (result == TCL_OK && sw.errorStatus
+	       && sw.errorStatus != TNM_SNMP_ENDOFWALK) {
+	WalkError(interp, sw.errorStatus, sw.errorIndex, sw.errorVbList);
+	result = TCL_ERROR;
     }
 
-  loopDone:
-    PduFree(&pdu);
+  done:
+    Tcl_Release((ClientData) session);
+    Tcl_DecrRefCount(sw.rowsObj);
+    if (sw.errorVbList) {
+	Tcl_DecrRefCount(sw.errorVbList);
+    }
     if (result == TCL_OK) {
 	Tcl_ResetResult(interp);
     }
@@ -2896,117 +3314,320 @@ Extract(Tcl_Interp *interp, int what, Tcl_Obj *objPtr, Tcl_Obj *indexObjPtr)
 
     return TCL_OK;
 }
-#if 0
 
 /*
  *----------------------------------------------------------------------
  *
  * ExpandTable --
  *
- *	This procedure expands the list of table variables or a single
- *	table name into a list of MIB instances.
+ *	This procedure expands a list of object identifiers into the
+ *	list of columns to retrieve. Tables and table entries are
+ *	replaced by their accessible columns. All other object
+ *	identifiers are taken as they are.
  *
  * Results:
  *	A standard Tcl result.
  *
  * Side effects:
- *	None.
+ *	The columns are appended to columnList.
  *
  *----------------------------------------------------------------------
  */
 
 static int
-ExpandTable(Tcl_Interp *interp, char *tList, Tcl_DString *dst)
+ExpandTable(Tcl_Interp *interp, Tcl_Obj *oidList, Tcl_Obj *columnList)
 {
-    int i, argc, code;
-    char **argv = NULL;
-    TnmMibNode *nodePtr, *entryPtr = NULL, *tablePtr = NULL;
-    
-    code = Tcl_SplitList(interp, tList, &argc, &argv);
-    if (code != TCL_OK) {
+    int i, objc, numColumns;
+    Tcl_Obj **objv;
+    TnmOid *oidPtr, nodeOid, oid;
+    TnmMibNode *nodePtr, *entryPtr;
+
+    if (Tcl_ListObjGetElements(interp, oidList, &objc, &objv) != TCL_OK) {
 	return TCL_ERROR;
     }
 
-    for (i = 0; i < argc; i++) {
-
-	/*
-	 * Lookup the given object.
-	 */
+    TnmOidInit(&nodeOid);
+    TnmOidInit(&oid);
+    for (i = 0; i < objc; i++) {
+	oidPtr = TnmGetOidFromObj(interp, objv[i]);
+	if (! oidPtr) {
+	    TnmOidFree(&nodeOid);
+	    return TCL_ERROR;
+	}
+	nodePtr = TnmMibNodeFromOid(oidPtr, &nodeOid);
+	if (! nodePtr
+	    || TnmOidGetLength(&nodeOid) != TnmOidGetLength(oidPtr)
+	    || (nodePtr->syntax != ASN1_SEQUENCE_OF
+		&& nodePtr->syntax != ASN1_SEQUENCE)) {
+	    Tcl_ListObjAppendElement(NULL, columnList, objv[i]);
+	    continue;
+	}
 
-	nodePtr = TnmMibFindNode(argv[i], NULL, 0);
-	if (! nodePtr) {
-	    Tcl_AppendResult(interp, "unknown mib table \"", argv[i], "\"",
-			     (char *) NULL);
-	    ckfree((char *) argv);
+	entryPtr = (nodePtr->syntax == ASN1_SEQUENCE_OF)
+	    ? nodePtr->childPtr : nodePtr;
+	numColumns = 0;
+	for (nodePtr = entryPtr ? entryPtr->childPtr : NULL;
+	     nodePtr; nodePtr = nodePtr->nextPtr) {
+	    if (nodePtr->access == TNM_MIB_NOACCESS) {
+		continue;
+	    }
+	    TnmOidFree(&oid);
+	    TnmMibNodeToOid(nodePtr, &oid);
+	    Tcl_ListObjAppendElement(NULL, columnList, TnmNewOidObj(&oid));
+	    numColumns++;
+	}
+	if (numColumns == 0) {
+	    Tcl_AppendResult(interp, "no accessible columns in \"",
+			     Tcl_GetString(objv[i]), "\"", (char *) NULL);
+	    TnmOidFree(&nodeOid);
+	    TnmOidFree(&oid);
 	    return TCL_ERROR;
 	}
+    }
 
-	/*
-	 * Locate the entry (SEQUENCE) that contains this object.
-	 */
+    TnmOidFree(&nodeOid);
+    TnmOidFree(&oid);
+    return TCL_OK;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * TableProc --
+ *
+ *	This procedure is called by the walk engine for every row of
+ *	a table retrieved by the table command. The instance identifier
+ *	of every cell is appended to the sub-identifiers of its column
+ *	and the value is converted into a typed object.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	The cells are added to the columns.
+ *
+ *----------------------------------------------------------------------
+ */
 
-	switch (nodePtr->syntax) {
-	  case ASN1_SEQUENCE:
-	    entryPtr = nodePtr;
-	    break;
-	  case ASN1_SEQUENCE_OF: 
-	    if (nodePtr->childPtr) {
-		entryPtr = nodePtr->childPtr;
+static void
+TableProc(TnmSnmp *session, TnmSnmpPdu *pdu, ClientData clientData)
+{
+    TableToken *tablePtr = (TableToken *) clientData;
+    TableColumn *colPtr;
+    TnmSnmpVarBindList *vblPtr;
+    TnmSnmpVarBind *vbPtr;
+    Tnm_Oid *oid;
+    int i, j, n, prefix, numCells;
+
+    if (tablePtr->done) {
+	return;
+    }
+
+    if (pdu && pdu->errorStatus == TNM_SNMP_NOERROR) {
+	vblPtr = TnmSnmpGetVarBindListFromObj(NULL, pdu->vbList, pdu->type);
+	if (! vblPtr) {
+	    return;
+	}
+	for (j = 0; j < vblPtr->numVarBinds && j < tablePtr->numColumns; j++) {
+	    colPtr = tablePtr->columns + j;
+	    vbPtr = vblPtr->varBinds + j;
+	    prefix = TnmOidGetLength(&colPtr->oid);
+	    if (TnmSnmpException(vbPtr->syntax) || vbPtr->oidLength <= prefix) {
+		continue;
 	    }
-	    break;
-	  default:
-	    if (nodePtr->parentPtr && nodePtr->childPtr == NULL
-		&& nodePtr->parentPtr->syntax == ASN1_SEQUENCE) {
-		entryPtr = nodePtr->parentPtr;
-	    } else {
-	    unknownTable:
-		Tcl_AppendResult(interp, "not a table \"", argv[i], "\"",
-				 (char *) NULL);
-		ckfree((char *) argv);
-		return TCL_ERROR;
+	    n = vbPtr->oidLength - prefix;
+	    if (colPtr->numSubs + n > colPtr->maxSubs) {
+		colPtr->maxSubs = 2 * colPtr->maxSubs + n;
+		colPtr->subs = (u_int *) ckrealloc((char *) colPtr->subs,
+				   colPtr->maxSubs * sizeof(u_int));
+	    }
+	    Tcl_ListObjLength(NULL, colPtr->valuesObj, &numCells);
+	    if (numCells + 2 > colPtr->maxCells) {
+		colPtr->maxCells = 2 * colPtr->maxCells + 2;
+		colPtr->offsets = (int *) ckrealloc((char *) colPtr->offsets,
+				      colPtr->maxCells * sizeof(int));
+	    }
+	    oid = TnmSnmpVarBindOid(vblPtr, vbPtr);
+	    for (i = 0; i < n; i++) {
+		colPtr->subs[colPtr->numSubs++] = oid[prefix + i];
+	    }
+	    colPtr->offsets[numCells + 1] = colPtr->numSubs;
+	    Tcl_ListObjAppendElement(NULL, colPtr->valuesObj,
+		     TnmSnmpGetVarBindTypedValue(vblPtr, vbPtr, colPtr->nodePtr));
+	    if (! colPtr->syntax) {
+		colPtr->syntax = vbPtr->syntax;
 	    }
 	}
+	TnmSnmpReleaseVarBindList(vblPtr);
+	return;
+    }
 
-	/*
-	 * Check whether all objects belong to the same table.
-	 */
+    tablePtr->done = 1;
+    if (pdu && pdu->errorStatus != TNM_SNMP_ENDOFWALK) {
+	tablePtr->errorStatus = pdu->errorStatus;
+	tablePtr->errorIndex = pdu->errorIndex;
+	if (pdu->vbList) {
+	    tablePtr->errorVbList = pdu->vbList;
+	    Tcl_IncrRefCount(tablePtr->errorVbList);
+	}
+    }
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * TableCompare --
+ *
+ *	This procedure compares the instance identifiers of two cells
+ *	in lexicographic order.
+ *
+ * Results:
+ *	-1, 0 or 1 if the first instance identifier is smaller than,
+ *	equal to or greater than the second instance identifier.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+TableCompare(TableColumn *aPtr, int a, TableColumn *bPtr, int b)
+{
+    u_int *x = aPtr->subs + aPtr->offsets[a];
+    u_int *y = bPtr->subs + bPtr->offsets[b];
+    int xlen = aPtr->offsets[a + 1] - aPtr->offsets[a];
+    int ylen = bPtr->offsets[b + 1] - bPtr->offsets[b];
+    int i;
 
-	if (entryPtr == NULL || entryPtr->parentPtr == NULL) {
-	    goto unknownTable;
+    for (i = 0; i < xlen && i < ylen; i++) {
+	if (x[i] != y[i]) {
+	    return (x[i] < y[i]) ? -1 : 1;
 	}
+    }
+    return (xlen < ylen) ? -1 : (xlen > ylen);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * TableMerge --
+ *
+ *	This procedure aligns the columns of a table by their instance
+ *	identifiers. Cells missing in a column are filled with
+ *	defaultObj. The value lists of columns without holes are
+ *	used as they are.
+ *
+ * Results:
+ *	A list which contains the list of instance identifiers followed
+ *	by a {name syntax values} triple for every column, or a dict
+ *	which maps "index" and the column names to the lists.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
 
-	if (tablePtr == NULL) {
-	    tablePtr = entryPtr->parentPtr;
+static Tcl_Obj*
+TableMerge(TableToken *tablePtr, Tcl_Obj *defaultObj, int dict)
+{
+    int i, j, n = tablePtr->numColumns, minCell = 0, length, numElems;
+    int *cells, *numCells;
+    TableColumn *colPtr, *minPtr;
+    Tcl_Obj **listObjs, *indexObj, *resultObj, *elemObj, **elems;
+    TnmOid oid;
+    char *syntax;
+
+    cells = (int *) ckalloc(n * sizeof(int));
+    numCells = (int *) ckalloc(n * sizeof(int));
+    listObjs = (Tcl_Obj **) ckalloc(n * sizeof(Tcl_Obj *));
+    for (i = 0; i < n; i++) {
+	cells[i] = 0;
+	Tcl_ListObjLength(NULL, tablePtr->columns[i].valuesObj, numCells + i);
+	listObjs[i] = NULL;
+    }
+
+    indexObj = Tcl_NewListObj(0, NULL);
+    TnmOidInit(&oid);
+    while (1) {
+	minPtr = NULL;
+	for (i = 0; i < n; i++) {
+	    colPtr = tablePtr->columns + i;
+	    if (cells[i] < numCells[i] && (! minPtr
+		   || TableCompare(colPtr, cells[i], minPtr, minCell) < 0)) {
+		minPtr = colPtr;
+		minCell = cells[i];
+	    }
 	}
-	if (tablePtr != entryPtr->parentPtr) {
-	    Tcl_AppendResult(interp, "instances not in the same table",
-			     (char *) NULL);
-	    ckfree((char *) argv);
-	    return TCL_ERROR;
+	if (! minPtr) {
+	    break;
 	}
 
-	/*
-	 * Now add the nodes to the list. Expand SEQUENCE nodes to
-	 * include all child nodes. Check the access mode which must
-	 * allow at least read access.
-	 */
+	length = minPtr->offsets[minCell + 1] - minPtr->offsets[minCell];
+	TnmOidSetLength(&oid, length);
+	for (j = 0; j < length; j++) {
+	    TnmOidSet(&oid, j, minPtr->subs[minPtr->offsets[minCell] + j]);
+	}
+	Tcl_ListObjAppendElement(NULL, indexObj, TnmNewOidObj(&oid));
 
-	if (nodePtr == entryPtr || nodePtr == tablePtr) {
-	    TnmMibNode *nPtr;
-	    for (nPtr = entryPtr->childPtr; nPtr; nPtr=nPtr->nextPtr) {
-		if (nPtr->access != TNM_MIB_NOACCESS) {
-		    Tcl_DStringAppendElement(dst, nPtr->label);
+	for (i = 0; i < n; i++) {
+	    colPtr = tablePtr->columns + i;
+	    if (cells[i] < numCells[i]
+		&& TableCompare(colPtr, cells[i], minPtr, minCell) == 0) {
+		if (listObjs[i]) {
+		    Tcl_ListObjIndex(NULL, colPtr->valuesObj, cells[i],
+				     &elemObj);
+		    Tcl_ListObjAppendElement(NULL, listObjs[i], elemObj);
 		}
+		cells[i]++;
+		continue;
 	    }
-	} else {
-	    if (nodePtr->access != TNM_MIB_NOACCESS) {
-		Tcl_DStringAppendElement(dst, nodePtr->label);
+	    if (! listObjs[i]) {
+		Tcl_ListObjGetElements(NULL, colPtr->valuesObj,
+				       &numElems, &elems);
+		listObjs[i] = Tcl_NewListObj(cells[i], elems);
 	    }
+	    Tcl_ListObjAppendElement(NULL, listObjs[i], defaultObj);
 	}
     }
+    TnmOidFree(&oid);
 
-    ckfree((char *) argv);
-    return TCL_OK;
+    if (dict) {
+	resultObj = Tcl_NewDictObj();
+	Tcl_DictObjPut(NULL, resultObj, Tcl_NewStringObj("index", 5),
+		       indexObj);
+    } else {
+	resultObj = Tcl_NewListObj(1, &indexObj);
+    }
+
+    for (i = 0; i < n; i++) {
+	Tcl_Obj *objv[3];
+	colPtr = tablePtr->columns + i;
+	objv[0] = colPtr->nodePtr
+	    ? Tcl_NewStringObj(colPtr->nodePtr->label, -1)
+	    : TnmNewOidObj(&colPtr->oid);
+	objv[2] = listObjs[i] ? listObjs[i] : colPtr->valuesObj;
+	if (dict) {
+	    Tcl_DictObjPut(NULL, resultObj, objv[0], objv[2]);
+	    continue;
+	}
+	syntax = NULL;
+	if (colPtr->syntax) {
+	    syntax = TnmGetTableValue(tnmSnmpTypeTable,
+				      (unsigned) colPtr->syntax);
+	} else if (colPtr->nodePtr) {
+	    syntax = TnmGetTableValue(tnmSnmpTypeTable,
+				      (unsigned) colPtr->nodePtr->syntax);
+	}
+	objv[1] = Tcl_NewStringObj(syntax ? syntax : "", -1);
+	Tcl_ListObjAppendElement(NULL, resultObj, Tcl_NewListObj(3, objv));
+    }
+
+    ckfree((char *) cells);
+    ckfree((char *) numCells);
+    ckfree((char *) listObjs);
+    return resultObj;
 }
 
 /*
@@ -3014,80 +3635,135 @@ ExpandTable(Tcl_Interp *interp, char *tList, Tcl_DString *dst)
  *
  * Table --
  *
- *	This procedure retrieves a conceptual SNMP table and stores
- *	the values in a Tcl array.
+ *	This procedure retrieves the columns of a conceptual table.
+ *	The columns are retrieved by a table walk which advances every
+ *	column on its own, so that missing cells do not terminate the
+ *	walk. Events are processed until the walk is completed. The
+ *	cells are then aligned by their instance identifiers and
+ *	returned as one list per column.
  *
  * Results:
  *	A standard Tcl result.
  *
  * Side effects:
- *	Tcl variables are modified.
+ *	None.
  *
  *----------------------------------------------------------------------
  */
 
 static int
-Table(Tcl_Interp *interp, TnmSnmp *session, char *table, char *arrayName)
+Table(Tcl_Interp *interp, TnmSnmp *session, int objc, Tcl_Obj *const objv[])
 {
-    int i, largc, code;
-    TnmSnmpPdu _pdu, *pdu = &_pdu;
-    Tcl_DString varList;
-    char **largv;
-    
-    /*
-     * A special hack to make sure that the given array name 
-     * is actually known as an array.
-     */
-
-    Tcl_SetVar2(interp, arrayName, "foo", "", 0);
-    Tcl_UnsetVar(interp, arrayName, 0);
-
-    /*
-     * Initialize the PDU.
-     */
-
-    pdu->addr        = session->maddr;
-    pdu->type        = ASN1_SNMP_GETBULK;
-    pdu->requestId   = TnmSnmpGetRequestId();
-    pdu->errorStatus = TNM_SNMP_NOERROR;
-    pdu->errorIndex  = 0;    
-    pdu->trapOID     = NULL;
-    Tcl_DStringInit(&pdu->varbind);
-    Tcl_DStringInit(&varList);
+    TableToken table;
+    TableColumn *colPtr;
+    Tcl_Obj *columnList, *defaultObj = NULL, **colv;
+    TnmMibNode *nodePtr;
+    TnmOid nodeOid;
+    int i, colc, dict = 0, result = TCL_OK;
 
-    /*
-     * Expand the given table list to create the complete getnext varbind.
-     */
+    enum options { optDefault, optDict } option;
 
-    code = ExpandTable(interp, table, &varList);
-    if (code != TCL_OK) {
-        return TCL_ERROR;
-    }
+    static const char *optionTable[] = {
+	"-default", "-dict", (char *) NULL
+    };
 
-    if (Tcl_DStringLength(&varList) == 0) {
-	return TCL_OK;
+    for (i = 2; i < objc - 1; i++) {
+	result = Tcl_GetIndexFromObj(interp, objv[i], optionTable,
+				     "option", TCL_EXACT, (int *) &option);
+	if (result != TCL_OK) {
+	    return TCL_ERROR;
+	}
+	switch (option) {
+	case optDefault:
+	    if (++i == objc - 1) {
+		Tcl_WrongNumArgs(interp, 2, objv,
+				 "?-dict? ?-default value? varBindList");
+		return TCL_ERROR;
+	    }
+	    defaultObj = objv[i];
+	    break;
+	case optDict:
+	    dict = 1;
+	    break;
+	}
     }
 
-    /*
-     *
-     */
-
-    code = Tcl_SplitList(interp, Tcl_DStringValue(&varList),
-			 &largc, &largv);
-    if (code != TCL_OK) {
-	Tcl_DStringFree(&varList);
+    columnList = Tcl_NewListObj(0, NULL);
+    Tcl_IncrRefCount(columnList);
+    if (ExpandTable(interp, objv[objc-1], columnList) != TCL_OK) {
+	Tcl_DecrRefCount(columnList);
 	return TCL_ERROR;
     }
-
-    for (i = 0; i < largc; i++) {
-	TnmWriteMessage(largv[i]);
-	TnmWriteMessage("\n");
+    Tcl_ListObjGetElements(NULL, columnList, &colc, &colv);
+    if (colc == 0) {
+	Tcl_DecrRefCount(columnList);
+	Tcl_SetResult(interp, "empty object identifier list", TCL_STATIC);
+	return TCL_ERROR;
     }
 
-    ckfree((char *) largv);
-    Tcl_DStringFree(&varList);
-    return TCL_OK;
+    defaultObj = defaultObj ? defaultObj : Tcl_NewObj();
+    Tcl_IncrRefCount(defaultObj);
+
+    memset((char *) &table, 0, sizeof(table));
+    table.numColumns = colc;
+    table.columns = (TableColumn *) ckalloc(colc * sizeof(TableColumn));
+    memset((char *) table.columns, 0, colc * sizeof(TableColumn));
+    TnmOidInit(&nodeOid);
+    for (i = 0; i < colc; i++) {
+	colPtr = table.columns + i;
+	TnmOidInit(&colPtr->oid);
+	TnmOidCopy(&colPtr->oid, TnmGetOidFromObj(NULL, colv[i]));
+	nodePtr = TnmMibNodeFromOid(&colPtr->oid, &nodeOid);
+	if (nodePtr && nodePtr->macro == TNM_MIB_OBJECTTYPE
+	    && TnmOidGetLength(&nodeOid) == TnmOidGetLength(&colPtr->oid)) {
+	    colPtr->nodePtr = nodePtr;
+	}
+	colPtr->maxSubs = 16;
+	colPtr->subs = (u_int *) ckalloc(colPtr->maxSubs * sizeof(u_int));
+	colPtr->maxCells = 16;
+	colPtr->offsets = (int *) ckalloc(colPtr->maxCells * sizeof(int));
+	colPtr->offsets[0] = 0;
+	colPtr->valuesObj = Tcl_NewListObj(0, NULL);
+	Tcl_IncrRefCount(colPtr->valuesObj);
+    }
+    TnmOidFree(&nodeOid);
+
+    Tcl_Preserve((ClientData) session);
+    result = TnmSnmpWalkTable(interp, session, columnList, TNM_SNMP_SYNC,
+			      TableProc, (ClientData) &table);
+    while (result == TCL_OK && ! table.done) {
+	result = TnmSnmpWalkWait(session, (ClientData) &table);
+    }
+    if (! table.done) {
+	TnmSnmpWalkAbort(session, (ClientData) &table);
+    }
+
+    if (result == TCL_OK && table.errorStatus) {
+	WalkError(interp, table.errorStatus, table.errorIndex,
+		  table.errorVbList);
+	result = TCL_ERROR;
+    } else if (result == TCL_OK) {
+	Tcl_SetObjResult(interp, TableMerge(&table, defaultObj, dict));
+    }
+    Tcl_Release((ClientData) session);
+
+    for (i = 0; i < colc; i++) {
+	colPtr = table.columns + i;
+	TnmOidFree(&colPtr->oid);
+	ckfree((char *) colPtr->subs);
+	ckfree((char *) colPtr->offsets);
+	Tcl_DecrRefCount(colPtr->valuesObj);
+    }
+    ckfree((char *) table.columns);
+    if (table.errorVbList) {
+	Tcl_DecrRefCount(table.errorVbList);
+    }
+    Tcl_DecrRefCount(defaultObj);
+    Tcl_DecrRefCount(columnList);
+    return result;
 }
+#if 0
+
 
 /*
  *----------------------------------------------------------------------
@@ -0,0 +1,586 @@
+/*
+ * tnmSnmpThread.c --
+ *
+ *	This file implements the engine threads which receive and
+ *	decode the responses sent to the manager sockets. Decoded
+ *	messages are passed to the thread which owns the manager
+ *	sockets through a lock-free queue and dispatched from a Tcl
+ *	event, so that callbacks are still evaluated by the thread
+ *	which created the sessions.
+ *
+ * See the file "license.terms" for information on usage and redistribution
+ * of this file, and for a DISCLAIMER OF ALL WARRANTIES.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+/*
+ * recvmmsg() is only declared by glibc if we ask for the GNU
+ * extensions.
+ */
+
+#ifdef HAVE_RECVMMSG
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#endif
+
+#include "tnmSnmp.h"
+
+extern int hexdump;		/* flag that controls hexdump */
+
+#ifdef TNM_SNMP_ENGINE
+
+#include <unistd.h>
+#include <poll.h>
+
+/*
+ * The number of datagrams read by an engine thread with a single
+ * system call.
+ */
+
+#ifdef HAVE_RECVMMSG
+#define ENGINE_BATCH	16
+#else
+#define ENGINE_BATCH	1
+#endif
+
+/*
+ * The state of the engine. Engine threads push decoded messages
+ * onto the queue, which is a LIFO list manipulated with atomic
+ * compare-and-swap operations. The thread owning the manager
+ * sockets takes the whole list at once, reverses it and appends it
+ * to the pending FIFO. The pending FIFO is only used by the owning
+ * thread and keeps the order of the messages if callbacks re-enter
+ * the event loop while a batch of messages is dispatched.
+ */
+
+typedef struct Engine {
+    int socks[TNM_SNMP_SOCKETS_MAX];	/* The manager sockets. */
+    int numSocks;		/* Number of manager sockets. */
+    int wakeup[2];		/* Pipe used to stop the engine threads. */
+    int running;		/* Set while the wakeup pipe is open. */
+    int count;			/* Number of engine threads. */
+    Tcl_ThreadId threads[TNM_SNMP_ENGINE_MAX];	/* The engine threads. */
+    Tcl_ThreadId owner;		/* The thread dispatching messages. */
+    Tcl_Interp *interp;		/* The interpreter used for callbacks. */
+    TnmSnmpMessage *pendingHead;	/* First message to dispatch. */
+    TnmSnmpMessage *pendingTail;	/* Last message to dispatch. */
+} Engine;
+
+static Engine engine;
+
+static TnmSnmpMessage * volatile queue = NULL;
+
+#ifndef __GNUC__
+TCL_DECLARE_MUTEX(queueMutex)
+#endif
+
+/*
+ * Forward declarations for procedures defined later in this file:
+ */
+
+static Tcl_ThreadCreateType
+EngineThread		(ClientData clientData);
+
+static int
+EngineRecv		(int sock, u_char *packets, int *lengths,
+				     struct sockaddr_in *from);
+static void
+QueuePush		(TnmSnmpMessage *msgPtr);
+
+static TnmSnmpMessage*
+QueueTake		(void);
+
+static void
+QueuePending		(void);
+
+static int
+EngineEventProc		(Tcl_Event *evPtr, int flags);
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * QueuePush --
+ *
+ *	This procedure pushes a decoded message onto the queue. The
+ *	thread owning the manager sockets is alerted with a Tcl event
+ *	if the queue was empty before. Later messages are picked up
+ *	by the same event.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	A Tcl event may be queued for the owning thread.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+QueuePush(TnmSnmpMessage *msgPtr)
+{
+    TnmSnmpMessage *head;
+
+#ifdef __GNUC__
+    do {
+	head = queue;
+	msgPtr->nextPtr = head;
+    } while (! __sync_bool_compare_and_swap(&queue, head, msgPtr));
+#else
+    Tcl_MutexLock(&queueMutex);
+    head = queue;
+    msgPtr->nextPtr = head;
+    queue = msgPtr;
+    Tcl_MutexUnlock(&queueMutex);
+#endif
+
+    if (! head) {
+	Tcl_Event *evPtr = (Tcl_Event *) ckalloc(sizeof(Tcl_Event));
+	evPtr->proc = EngineEventProc;
+	Tcl_ThreadQueueEvent(engine.owner, evPtr, TCL_QUEUE_TAIL);
+	Tcl_ThreadAlert(engine.owner);
+    }
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * QueueTake --
+ *
+ *	This procedure takes all messages from the queue.
+ *
+ * Results:
+ *	The list of messages in the order they were received.
+ *
+ * Side effects:
+ *	The queue is empty.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static TnmSnmpMessage*
+QueueTake(void)
+{
+    TnmSnmpMessage *msgPtr, *nextPtr, *listPtr = NULL;
+
+#ifdef __GNUC__
+    msgPtr = __sync_lock_test_and_set(&queue, NULL);
+#else
+    Tcl_MutexLock(&queueMutex);
+    msgPtr = queue;
+    queue = NULL;
+    Tcl_MutexUnlock(&queueMutex);
+#endif
+
+    for (; msgPtr; msgPtr = nextPtr) {
+	nextPtr = msgPtr->nextPtr;
+	msgPtr->nextPtr = listPtr;
+	listPtr = msgPtr;
+    }
+    return listPtr;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * QueuePending --
+ *
+ *	This procedure moves all queued messages to the end of the
+ *	pending FIFO.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	The queue is empty.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+QueuePending(void)
+{
+    TnmSnmpMessage *msgPtr = QueueTake();
+
+    if (! msgPtr) {
+	return;
+    }
+    if (engine.pendingTail) {
+	engine.pendingTail->nextPtr = msgPtr;
+    } else {
+	engine.pendingHead = msgPtr;
+    }
+    while (msgPtr->nextPtr) {
+	msgPtr = msgPtr->nextPtr;
+    }
+    engine.pendingTail = msgPtr;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * EngineEventProc --
+ *
+ *	This procedure is called from the event loop of the thread
+ *	owning the manager sockets. It dispatches all pending messages
+ *	in the order they were received. Errors are reported in the
+ *	same way as for responses received by the event loop.
+ *
+ * Results:
+ *	1 if the event has been handled and 0 if file events are
+ *	not processed right now.
+ *
+ * Side effects:
+ *	Callbacks are evaluated.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+EngineEventProc(Tcl_Event *evPtr, int flags)
+{
+    Tcl_Interp *interp = engine.interp;
+    TnmSnmpMessage *msgPtr;
+    int code;
+
+    if (! (flags & TCL_FILE_EVENTS)) {
+	return 0;
+    }
+
+    QueuePending();
+    if (! interp) {
+	return 1;
+    }
+
+    Tcl_Preserve((ClientData) interp);
+    while (engine.interp == interp && (msgPtr = engine.pendingHead)) {
+	engine.pendingHead = msgPtr->nextPtr;
+	if (! engine.pendingHead) {
+	    engine.pendingTail = NULL;
+	}
+
+	Tcl_ResetResult(interp);
+	if (hexdump) {
+	    struct sockaddr_in name, *to = NULL;
+	    socklen_t namelen = sizeof(name);
+
+	    if (getsockname(msgPtr->sock,
+			    (struct sockaddr *) &name, &namelen) == 0) {
+		to = &name;
+	    }
+	    TnmSnmpDumpPacket(msgPtr->packet, msgPtr->packetlen,
+			      &msgPtr->from, to);
+	}
+
+	code = TnmSnmpDispatchMessage(interp, msgPtr);
+	TnmSnmpFreeMessage(msgPtr);
+	if (code == TCL_ERROR) {
+	    Tcl_AddErrorInfo(interp, "\n    (snmp response event)");
+	    Tcl_BackgroundError(interp);
+	}
+	if (code == TCL_CONTINUE && hexdump) {
+	    TnmWriteMessage(Tcl_GetStringResult(interp));
+	    TnmWriteMessage("\n");
+	}
+    }
+    Tcl_Release((ClientData) interp);
+    TnmSnmpFlush();
+    return 1;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * EngineRecv --
+ *
+ *	This procedure reads the datagrams which are waiting on a
+ *	manager socket without blocking. The socket is shared by all
+ *	engine threads, so it is no error if other threads got the
+ *	datagrams first.
+ *
+ * Results:
+ *	The number of datagrams read.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+EngineRecv(int sock, u_char *packets, int *lengths, struct sockaddr_in *from)
+{
+    socklen_t fromlen;
+    int n;
+
+#ifdef HAVE_RECVMMSG
+    {
+	struct mmsghdr msgs[ENGINE_BATCH];
+	struct iovec iov[ENGINE_BATCH];
+
+	memset((char *) msgs, 0, sizeof(msgs));
+	for (n = 0; n < ENGINE_BATCH; n++) {
+	    iov[n].iov_base = packets + n * TNM_SNMP_MAXSIZE;
+	    iov[n].iov_len = TNM_SNMP_MAXSIZE;
+	    msgs[n].msg_hdr.msg_iov = &iov[n];
+	    msgs[n].msg_hdr.msg_iovlen = 1;
+	    msgs[n].msg_hdr.msg_name = &from[n];
+	    msgs[n].msg_hdr.msg_namelen = sizeof(struct sockaddr_in);
+	}
+	n = recvmmsg(sock, msgs, ENGINE_BATCH, MSG_DONTWAIT, NULL);
+	if (n > 0) {
+	    int i;
+	    for (i = 0; i < n; i++) {
+		lengths[i] = msgs[i].msg_len;
+	    }
+	    return n;
+	}
+	if (n == 0 || errno != ENOSYS) {
+	    return 0;
+	}
+    }
+#endif
+
+    fromlen = sizeof(from[0]);
+    n = TnmSocketRecvFrom(sock, packets, TNM_SNMP_MAXSIZE, MSG_DONTWAIT,
+			  (struct sockaddr *) &from[0], &fromlen);
+    if (n == TNM_SOCKET_ERROR) {
+	return 0;
+    }
+    lengths[0] = n;
+    return 1;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * EngineThread --
+ *
+ *	This procedure is the main loop of an engine thread. It waits
+ *	until a manager socket becomes readable, reads the waiting
+ *	datagrams, decodes them and queues the decoded messages. The
+ *	thread terminates when the wakeup pipe becomes readable.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	Messages are queued.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static Tcl_ThreadCreateType
+EngineThread(ClientData clientData)
+{
+    int lengths[ENGINE_BATCH];
+    struct sockaddr_in from[ENGINE_BATCH];
+    struct pollfd fds[TNM_SNMP_SOCKETS_MAX + 1];
+    u_char *packets;
+    int i, j, n, nfds = engine.numSocks;
+
+    /*
+     * We use poll() and not select() since the manager sockets
+     * may be numbered above FD_SETSIZE in a process which talks
+     * to many agents. The wakeup pipe comes last in the array.
+     */
+
+    for (j = 0; j < engine.numSocks; j++) {
+	fds[j].fd = engine.socks[j];
+	fds[j].events = POLLIN;
+    }
+    fds[nfds].fd = engine.wakeup[0];
+    fds[nfds].events = POLLIN;
+
+    packets = (u_char *) ckalloc(ENGINE_BATCH * TNM_SNMP_MAXSIZE);
+
+    while (1) {
+	if (poll(fds, nfds + 1, -1) < 0) {
+	    if (errno == EINTR) continue;
+	    break;
+	}
+	if (fds[nfds].revents) {
+	    break;
+	}
+	for (j = 0; j < nfds; j++) {
+	    int sock = fds[j].fd;
+	    if (! (fds[j].revents & (POLLIN | POLLERR))) continue;
+	    n = EngineRecv(sock, packets, lengths, from);
+	    for (i = 0; i < n; i++) {
+		TnmSnmpMessage *msgPtr;
+		msgPtr = TnmSnmpDecodeMessage(packets + i * TNM_SNMP_MAXSIZE,
+					      lengths[i], &from[i]);
+		msgPtr->sock = sock;
+		QueuePush(msgPtr);
+	    }
+	}
+    }
+
+    ckfree((char *) packets);
+    Tcl_ExitThread(TCL_OK);
+    TCL_THREAD_CREATE_RETURN;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * TnmSnmpEngineStart --
+ *
+ *	This procedure starts count engine threads which receive the
+ *	datagrams sent to the numSocks manager sockets in socks. The
+ *	messages are dispatched by the calling thread using the
+ *	interpreter interp.
+ *
+ * Results:
+ *	A standard Tcl result.
+ *
+ * Side effects:
+ *	Threads are created.
+ *
+ *----------------------------------------------------------------------
+ */
+
+int
+TnmSnmpEngineStart(Tcl_Interp *interp, int *socks, int numSocks, int count)
+{
+    int i;
+
+    if (engine.count) {
+	TnmSnmpEngineStop();
+    }
+    if (count > TNM_SNMP_ENGINE_MAX) {
+	count = TNM_SNMP_ENGINE_MAX;
+    }
+
+    if (pipe(engine.wakeup) < 0) {
+	Tcl_AppendResult(interp, "can not create engine pipe: ",
+			 Tcl_PosixError(interp), (char *) NULL);
+	return TCL_ERROR;
+    }
+    engine.running = 1;
+
+    for (i = 0; i < numSocks; i++) {
+	engine.socks[i] = socks[i];
+    }
+    engine.numSocks = numSocks;
+    engine.interp = interp;
+    engine.owner = Tcl_GetCurrentThread();
+
+    for (i = 0; i < count; i++) {
+	if (Tcl_CreateThread(&engine.threads[i], EngineThread, NULL,
+			     TCL_THREAD_STACK_DEFAULT,
+			     TCL_THREAD_JOINABLE) != TCL_OK) {
+	    TnmSnmpEngineStop();
+	    Tcl_SetResult(interp, "can not create engine thread", TCL_STATIC);
+	    return TCL_ERROR;
+	}
+	engine.count++;
+    }
+    return TCL_OK;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * TnmSnmpEngineStop --
+ *
+ *	This procedure stops all engine threads and waits until they
+ *	have terminated. Messages which have been queued already are
+ *	still dispatched.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	Threads terminate.
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+TnmSnmpEngineStop(void)
+{
+    int i, result;
+
+    if (! engine.running) {
+	return;
+    }
+
+    while (write(engine.wakeup[1], "x", 1) < 0 && errno == EINTR) ;
+    for (i = 0; i < engine.count; i++) {
+	Tcl_JoinThread(engine.threads[i], &result);
+    }
+    engine.count = 0;
+
+    close(engine.wakeup[0]);
+    close(engine.wakeup[1]);
+    engine.running = 0;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * TnmSnmpEngineDiscard --
+ *
+ *	This procedure discards all messages which have not been
+ *	dispatched yet. It is called when the manager socket is
+ *	closed after the engine threads have been stopped.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	Memory is freed.
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+TnmSnmpEngineDiscard(void)
+{
+    TnmSnmpMessage *msgPtr;
+
+    QueuePending();
+    while ((msgPtr = engine.pendingHead)) {
+	engine.pendingHead = msgPtr->nextPtr;
+	TnmSnmpFreeMessage(msgPtr);
+    }
+    engine.pendingTail = NULL;
+    engine.interp = NULL;
+    engine.numSocks = 0;
+}
+
+#else
+
+/*
+ * Stubs used if engine threads are not supported.
+ */
+
+int
+TnmSnmpEngineStart(Tcl_Interp *interp, int *socks, int numSocks, int count)
+{
+    Tcl_SetResult(interp, "threads are not supported", TCL_STATIC);
+    return TCL_ERROR;
+}
+
+void
+TnmSnmpEngineStop(void)
+{
+}
+
+void
+TnmSnmpEngineDiscard(void)
+{
+}
+
+#endif
+
+/*
+ * Local Variables:
+ * compile-command: "make -k -C ../../unix"
+ * End:
+ */
@@ -3,7 +3,8 @@
  *
  *	This file contains the implementation of the user based
  *	security model (USM) for SNMP version 3 as defined in
- *	RFC 2274.
+ *	RFC 2274, the HMAC-SHA-2 authentication protocols defined
+ *	in RFC 7860 and the AES privacy protocol defined in RFC 3826.
  *
  * Copyright (c) 1997-1998 Technical University of Braunschweig.
  *
@@ -21,6 +22,9 @@
 #include "tnmMib.h"
 #include "tnmMD5.h"
 #include "tnmSHA.h"
+#include "tnmSHA2.h"
+#include "tnmDES.h"
+#include "tnmAES.h"
 
 /*
  * The table of known SNMP security levels.
@@ -31,55 +35,394 @@ TnmTable tnmSnmpSecurityLevelTable[] =
     { TNM_SNMP_AUTH_NONE | TNM_SNMP_PRIV_NONE,	"noAuth/noPriv" },
     { TNM_SNMP_AUTH_MD5  | TNM_SNMP_PRIV_NONE,	"md5/noPriv" },
     { TNM_SNMP_AUTH_MD5  | TNM_SNMP_PRIV_DES,	"md5/des" },
+    { TNM_SNMP_AUTH_MD5  | TNM_SNMP_PRIV_AES,	"md5/aes" },
     { TNM_SNMP_AUTH_SHA  | TNM_SNMP_PRIV_NONE,	"sha/noPriv" },
     { TNM_SNMP_AUTH_SHA  | TNM_SNMP_PRIV_DES,	"sha/des" },
+    { TNM_SNMP_AUTH_SHA  | TNM_SNMP_PRIV_AES,	"sha/aes" },
+    { TNM_SNMP_AUTH_SHA224 | TNM_SNMP_PRIV_NONE,	"sha224/noPriv" },
+    { TNM_SNMP_AUTH_SHA224 | TNM_SNMP_PRIV_DES,	"sha224/des" },
+    { TNM_SNMP_AUTH_SHA224 | TNM_SNMP_PRIV_AES,	"sha224/aes" },
+    { TNM_SNMP_AUTH_SHA256 | TNM_SNMP_PRIV_NONE,	"sha256/noPriv" },
+    { TNM_SNMP_AUTH_SHA256 | TNM_SNMP_PRIV_DES,	"sha256/des" },
+    { TNM_SNMP_AUTH_SHA256 | TNM_SNMP_PRIV_AES,	"sha256/aes" },
+    { TNM_SNMP_AUTH_SHA384 | TNM_SNMP_PRIV_NONE,	"sha384/noPriv" },
+    { TNM_SNMP_AUTH_SHA384 | TNM_SNMP_PRIV_DES,	"sha384/des" },
+    { TNM_SNMP_AUTH_SHA384 | TNM_SNMP_PRIV_AES,	"sha384/aes" },
+    { TNM_SNMP_AUTH_SHA512 | TNM_SNMP_PRIV_NONE,	"sha512/noPriv" },
+    { TNM_SNMP_AUTH_SHA512 | TNM_SNMP_PRIV_DES,	"sha512/des" },
+    { TNM_SNMP_AUTH_SHA512 | TNM_SNMP_PRIV_AES,	"sha512/aes" },
     { 0, NULL }
 };
 
 /*
- * The following structures and procedures are used to keep a list of
+ * The following structures and procedures are used to keep a cache of
  * keys that were computed with the SNMPv3 password to key algorithm.
  * This cache is needed so that identical sessions don't suffer from
- * repeated slow computations of authentication keys.
+ * repeated slow computations of authentication keys. The cache is a
+ * hash table indexed by the algorithm, the SHA digest of the password
+ * and the engineID. The password itself is not kept. Keys for longer
+ * engineIDs are not cached.
+ *
+ * If a key file has been configured, the cache is loaded from the
+ * file and every new key is appended to it, so that the keys survive
+ * a restart of the application.
+ */
+
+#define KEY_DIGEST_SIZE	20
+#define KEY_ENGINE_MAX	32
+#define KEY_SIZE_MAX	TNM_SHA512_SIZE
+
+typedef struct KeyCacheKey {
+    int algorithm;			/* The password to key algorithm. */
+    int engineLength;			/* The length of the engineID. */
+    u_char digest[KEY_DIGEST_SIZE];	/* The digest of the password. */
+    u_char engineID[KEY_ENGINE_MAX];	/* The engineID, zero padded. */
+} KeyCacheKey;
+
+static Tcl_HashTable keyCache;
+static int keyCacheInitialized = 0;
+static Tcl_Obj *keyFile = NULL;
+
+static TnmTable keyAlgorithmTable[] =
+{
+    { TNM_SNMP_AUTH_MD5,	"md5" },
+    { TNM_SNMP_AUTH_SHA,	"sha" },
+    { TNM_SNMP_AUTH_SHA224,	"sha224" },
+    { TNM_SNMP_AUTH_SHA256,	"sha256" },
+    { TNM_SNMP_AUTH_SHA384,	"sha384" },
+    { TNM_SNMP_AUTH_SHA512,	"sha512" },
+    { 0, NULL }
+};
+
+/*
+ * The digest contexts of all hash functions used by the authentication
+ * protocols. The HMAC state of a session keeps the contexts after the
+ * inner and the outer padded key have been hashed. They are computed
+ * once for each localized key and copied for every message, which
+ * saves two runs of the compression function per message.
+ */
+
+typedef union HashCtx {
+    MD5_CTX md5;
+    SHA_CTX sha;
+    TnmSHA256_CTX sha256;
+    TnmSHA512_CTX sha512;
+} HashCtx;
+
+typedef struct TnmSnmpHmac {
+    int algorithm;			/* The authentication protocol. */
+    Tcl_Obj *keyObj;			/* The key of the contexts. */
+    HashCtx inner;			/* The context after key ^ ipad. */
+    HashCtx outer;			/* The context after key ^ opad. */
+} TnmSnmpHmac;
+
+#define HMAC_BLOCK_MAX	TNM_SHA512_BLOCKSIZE
+
+/*
+ * The cipher state of a session keeps the expanded privacy key so
+ * that the key schedule is computed once for each localized key and
+ * not for every message. The salt counter makes the initialization
+ * vectors unique (RFC 3414 section 8.1.1.1, RFC 3826 section 3.1.2.1).
+ * It starts at a value derived from the time so that the salts are
+ * not reused after a restart.
+ */
+
+typedef struct TnmSnmpCipher {
+    int algorithm;			/* The privacy protocol. */
+    Tcl_Obj *keyObj;			/* The key of the context. */
+    union {
+	TnmDES_CTX des;
+	TnmAES_CTX aes;
+    } ctx;				/* The expanded key. */
+    u_char preIV[TNM_DES_BLOCKSIZE];	/* The DES pre-IV. */
+} TnmSnmpCipher;
+
+#define PRIV_KEY_MIN	16
+
+static Tcl_WideUInt privSalt = 0;
+static int privSaltInitialized = 0;
+
+TCL_DECLARE_MUTEX(saltMutex)
+
+/*
+ * The engine cache remembers the engineID, engineBoots and engineTime
+ * of the authoritative engines learned from report PDUs (RFC 3414
+ * section 4). It is indexed by the transport address so that new
+ * sessions talking to a known engine skip the discovery exchange.
+ * The engineTime is tracked with the local clock from the moment it
+ * was learned. The cache is shared by all interpreters and threads.
+ */
+
+#define ENGINE_ID_MAX	32
+
+typedef struct EngineCacheKey {
+    unsigned int addr;			/* The IPv4 address (network order). */
+    unsigned int port;			/* The port number (network order). */
+} EngineCacheKey;
+
+typedef struct EngineCacheEntry {
+    int engineIDLength;			/* The length of the engineID. */
+    char engineID[ENGINE_ID_MAX];	/* The engineID of the engine. */
+    int engineBoots;			/* The engineBoots when learned. */
+    int engineTime;			/* The engineTime when learned. */
+    time_t learned;			/* Local time when learned. */
+} EngineCacheEntry;
+
+static Tcl_HashTable engineCache;
+static int engineCacheInitialized = 0;
+
+TCL_DECLARE_MUTEX(engineMutex)
+
+/*
+ * The following structure describes a key which is computed by one of
+ * the threads started by TnmSnmpPrecomputeKeys(). The threads take the
+ * next job from the job list while holding the jobMutex.
  */
 
-typedef struct KeyCache {
-    Tcl_Obj *password;
-    Tcl_Obj *engineID;
-    Tcl_Obj *key;
-    int algorithm;
-    struct KeyCache *nextPtr;
-} KeyCache;
+typedef struct KeyJob {
+    KeyCacheKey cacheKey;		/* The key of the cache entry. */
+    u_char *pwBytes;			/* The password. */
+    int pwLength;			/* The length of the password. */
+    u_char key[KEY_SIZE_MAX];		/* The computed key. */
+} KeyJob;
+
+typedef struct KeyJobList {
+    KeyJob *jobs;			/* The jobs to process. */
+    int numJobs;			/* The number of jobs. */
+    int next;				/* The next job to process. */
+} KeyJobList;
+
+#define KEY_THREADS_MAX	16
+
+TCL_DECLARE_MUTEX(jobMutex)
 
 /*
  * Forward declarations for procedures defined later in this file:
  */
 
 static void
-MD5PassWord2Key	(u_char *pwBytes, int pwLength,
-			     u_char *engineBytes, int engineLength,
-			     u_char *key);
+HashInit	(int algorithm, HashCtx *ctx);
+static void
+HashUpdate	(int algorithm, HashCtx *ctx, u_char *bytes,
+			     int length);
 static void
-SHAPassWord2Key	(u_char *pwBytes, int pwLength,
+HashFinal	(int algorithm, HashCtx *ctx, u_char *digest);
+static int
+BlockLength	(int algorithm);
+static int
+KeyLength	(int algorithm);
+static void
+PassWord2Key	(int algorithm, u_char *pwBytes, int pwLength,
 			     u_char *engineBytes, int engineLength,
 			     u_char *key);
+static int
+MakeCacheKey	(KeyCacheKey *cacheKey, int algorithm,
+			     u_char *pwBytes, int pwLength,
+			     u_char *engineBytes, int engineLength);
+static void
+AddCachedKey	(Tcl_HashEntry *entryPtr, Tcl_Obj *keyObj);
+static void
+SaveCachedKey	(Tcl_Channel channel, KeyCacheKey *cacheKey,
+			     Tcl_Obj *keyObj);
+static int
+LoadKeyFile	(Tcl_Interp *interp, Tcl_Obj *fileName);
 static void
 ComputeKey	(Tcl_Obj **objPtrPtr, Tcl_Obj *password,
 			     Tcl_Obj *engineID, int algorithm);
+#ifdef TCL_THREADS
+static Tcl_ThreadCreateType
+KeyThread	(ClientData clientData);
+#endif
+static void
+RunKeyJobs	(KeyJobList *listPtr);
+static TnmSnmpHmac*
+GetHmac		(TnmSnmp *session);
+static void
+ComputeMac	(TnmSnmpHmac *hmacPtr, u_char *msg, int msgLen,
+			     u_char *mac);
+static u_char*
+FindAuthParams	(u_char *packet, int packetlen, int *lengthPtr);
+static int
+MacEqual	(u_char *mac1, u_char *mac2, int length);
+static TnmSnmpCipher*
+GetCipher	(TnmSnmp *session);
+static void
+MakeAesIV	(u_char *iv, int engineBoots, int engineTime,
+			     u_char *salt);
+static void
+MakeEngineKey	(EngineCacheKey *cacheKey,
+			     struct sockaddr_in *addr);
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HashInit, HashUpdate, HashFinal --
+ *
+ *	These procedures dispatch to the hash function used by an
+ *	authentication protocol.
+ *
+ * Results:
+ *	HashFinal() writes the digest to the digest argument.
+ *
+ * Side effects:
+ *	The context is updated.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+HashInit(int algorithm, HashCtx *ctx)
+{
+    switch (algorithm) {
+    case TNM_SNMP_AUTH_MD5:
+	TnmMD5Init(&ctx->md5);
+	break;
+    case TNM_SNMP_AUTH_SHA:
+	TnmSHAInit(&ctx->sha);
+	break;
+    case TNM_SNMP_AUTH_SHA224:
+	TnmSHA224Init(&ctx->sha256);
+	break;
+    case TNM_SNMP_AUTH_SHA256:
+	TnmSHA256Init(&ctx->sha256);
+	break;
+    case TNM_SNMP_AUTH_SHA384:
+	TnmSHA384Init(&ctx->sha512);
+	break;
+    case TNM_SNMP_AUTH_SHA512:
+	TnmSHA512Init(&ctx->sha512);
+	break;
+    default:
+	Tcl_Panic("unknown authentication algorithm");
+    }
+}
+
+static void
+HashUpdate(int algorithm, HashCtx *ctx, u_char *bytes, int length)
+{
+    switch (algorithm) {
+    case TNM_SNMP_AUTH_MD5:
+	TnmMD5Update(&ctx->md5, bytes, (unsigned) length);
+	break;
+    case TNM_SNMP_AUTH_SHA:
+	TnmSHAUpdate(&ctx->sha, bytes, length);
+	break;
+    case TNM_SNMP_AUTH_SHA224:
+    case TNM_SNMP_AUTH_SHA256:
+	TnmSHA256Update(&ctx->sha256, bytes, length);
+	break;
+    case TNM_SNMP_AUTH_SHA384:
+    case TNM_SNMP_AUTH_SHA512:
+	TnmSHA512Update(&ctx->sha512, bytes, length);
+	break;
+    default:
+	Tcl_Panic("unknown authentication algorithm");
+    }
+}
+
 static void
-MD5AuthOutMsg	(char *authKey, u_char *msg, int msgLen,
-			     u_char *msgAuthenticationParameters);
+HashFinal(int algorithm, HashCtx *ctx, u_char *digest)
+{
+    switch (algorithm) {
+    case TNM_SNMP_AUTH_MD5:
+	TnmMD5Final(digest, &ctx->md5);
+	break;
+    case TNM_SNMP_AUTH_SHA:
+	TnmSHAFinal(digest, &ctx->sha);
+	break;
+    case TNM_SNMP_AUTH_SHA224:
+	TnmSHA224Final(digest, &ctx->sha256);
+	break;
+    case TNM_SNMP_AUTH_SHA256:
+	TnmSHA256Final(digest, &ctx->sha256);
+	break;
+    case TNM_SNMP_AUTH_SHA384:
+	TnmSHA384Final(digest, &ctx->sha512);
+	break;
+    case TNM_SNMP_AUTH_SHA512:
+	TnmSHA512Final(digest, &ctx->sha512);
+	break;
+    default:
+	Tcl_Panic("unknown authentication algorithm");
+    }
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * BlockLength --
+ *
+ *	This procedure returns the block length of the hash function
+ *	used by an authentication protocol.
+ *
+ * Results:
+ *	The block length in bytes.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+BlockLength(int algorithm)
+{
+    return (algorithm == TNM_SNMP_AUTH_SHA384
+	    || algorithm == TNM_SNMP_AUTH_SHA512)
+	? TNM_SHA512_BLOCKSIZE : TNM_SHA256_BLOCKSIZE;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * KeyLength --
+ *
+ *	This procedure returns the length of the keys produced by
+ *	a password to key algorithm, which is the digest length of
+ *	its hash function.
+ *
+ * Results:
+ *	The key length in bytes.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
 
+static int
+KeyLength(int algorithm)
+{
+    switch (algorithm) {
+    case TNM_SNMP_AUTH_MD5:
+	return TNM_MD5_SIZE;
+    case TNM_SNMP_AUTH_SHA:
+	return SHA_DIGESTSIZE;
+    case TNM_SNMP_AUTH_SHA224:
+	return TNM_SHA224_SIZE;
+    case TNM_SNMP_AUTH_SHA256:
+	return TNM_SHA256_SIZE;
+    case TNM_SNMP_AUTH_SHA384:
+	return TNM_SHA384_SIZE;
+    case TNM_SNMP_AUTH_SHA512:
+	return TNM_SHA512_SIZE;
+    default:
+	Tcl_Panic("unknown authentication algorithm");
+    }
+    return 0;
+}
 
 /*
  *----------------------------------------------------------------------
  *
- * MD5PassWord2Key --
+ * PassWord2Key --
  *
- *	This procedure converts a password into a key by using
- *	the `Password to Key Algorithm' as defined in RFC 2274.
- *	The code is a slightly modified version of the source
- *	code in appendix A.2.1 of RFC 2274.
+ *	This procedure converts a password into a localized key by
+ *	using the `Password to Key Algorithm' as defined in RFC 2274
+ *	appendix A.2 with the hash function of the authentication
+ *	protocol (RFC 7860 section 9.3). It does not use any Tcl
+ *	objects and may therefore be called from any thread.
  *
  * Results:
  *	The key is written to the argument key.
@@ -91,44 +434,41 @@ MD5AuthOutMsg	(char *authKey, u_char *msg, int msgLen,
  */
 
 static void
-MD5PassWord2Key(u_char *pwBytes, int pwLength, u_char *engineBytes, int engineLength, u_char *key)
+PassWord2Key(int algorithm, u_char *pwBytes, int pwLength, u_char *engineBytes, int engineLength, u_char *key)
 {
-    MD5_CTX MD;
+    HashCtx ctx;
     u_char *cp, buffer[64];
-    int i, index = 0, count = 0;
+    int i, index = 0, count = 0, keyLength = KeyLength(algorithm);
 
-    TnmMD5Init(&MD);
+    HashInit(algorithm, &ctx);
     while (count < 1048576) {
 	cp = buffer;
-	for(i = 0; i < 64; i++) {
+	for (i = 0; i < 64; i++) {
 	    *cp++ = pwBytes[index++ % pwLength];
 	}
-	TnmMD5Update(&MD, buffer, 64);
+	HashUpdate(algorithm, &ctx, buffer, 64);
 	count += 64;
     }
-    TnmMD5Final(key, &MD);
+    HashFinal(algorithm, &ctx, key);
 
-    memcpy(buffer, key, 16);
-    memcpy(buffer + 16, engineBytes, (size_t) engineLength);
-    memcpy(buffer + 16 + engineLength, key, 16);
-    
-    TnmMD5Init(&MD);
-    TnmMD5Update(&MD, buffer, 16 + engineLength + 16);
-    TnmMD5Final(key, &MD);
+    HashInit(algorithm, &ctx);
+    HashUpdate(algorithm, &ctx, key, keyLength);
+    HashUpdate(algorithm, &ctx, engineBytes, engineLength);
+    HashUpdate(algorithm, &ctx, key, keyLength);
+    HashFinal(algorithm, &ctx, key);
 }
 
 /*
  *----------------------------------------------------------------------
  *
- * SHAPassWord2Key --
+ * MakeCacheKey --
  *
- *	This procedure converts a password into a key by using
- *	the `Password to Key Algorithm' as defined in RFC 2274.
- *	The code is a slightly modified version of the source
- *	code in appendix A.2.2 of RFC 2274.
+ *	This procedure initializes the hash key of a cache entry.
+ *	The structure is cleared first so that it can be compared
+ *	as an array of words.
  *
  * Results:
- *	The key is written to the argument key.
+ *	1 if the key can be cached and 0 if the engineID is too long.
  *
  * Side effects:
  *	None.
@@ -136,31 +476,185 @@ MD5PassWord2Key(u_char *pwBytes, int pwLength, u_char *engineBytes, int engineLe
  *----------------------------------------------------------------------
  */
 
-static void
-SHAPassWord2Key(u_char *pwBytes, int pwLength, u_char *engineBytes, int engineLength, u_char *key)
+static int
+MakeCacheKey(KeyCacheKey *cacheKey, int algorithm, u_char *pwBytes, int pwLength, u_char *engineBytes, int engineLength)
 {
     SHA_CTX SH;
-    u_char *cp, buffer[72];
-    int i, index = 0, count = 0;
+
+    if (engineLength > KEY_ENGINE_MAX) {
+	return 0;
+    }
+
+    memset((char *) cacheKey, 0, sizeof(KeyCacheKey));
+    cacheKey->algorithm = algorithm;
+    cacheKey->engineLength = engineLength;
+    memcpy(cacheKey->engineID, engineBytes, (size_t) engineLength);
 
     TnmSHAInit(&SH);
-    while (count < 1048576) {
-	cp = buffer;
-	for(i = 0; i < 64; i++) {
-	    *cp++ = pwBytes[index++ % pwLength];
+    TnmSHAUpdate(&SH, pwBytes, pwLength);
+    TnmSHAFinal(cacheKey->digest, &SH);
+    return 1;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * AddCachedKey --
+ *
+ *	This procedure stores a key in an entry of the key cache.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	The cache entry keeps a reference to the key object.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+AddCachedKey(Tcl_HashEntry *entryPtr, Tcl_Obj *keyObj)
+{
+    Tcl_Obj *oldObj = (Tcl_Obj *) Tcl_GetHashValue(entryPtr);
+
+    Tcl_IncrRefCount(keyObj);
+    if (oldObj) {
+	Tcl_DecrRefCount(oldObj);
+    }
+    Tcl_SetHashValue(entryPtr, (ClientData) keyObj);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * SaveCachedKey --
+ *
+ *	This procedure writes a cache entry to the key file. Each
+ *	line contains the algorithm, the digest of the password,
+ *	the engineID and the key. Binary values are written in the
+ *	usual hex notation.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	A line is written to the channel.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+SaveCachedKey(Tcl_Channel channel, KeyCacheKey *cacheKey, Tcl_Obj *keyObj)
+{
+    Tcl_Obj *line;
+    char *keyBytes;
+    int keyLength;
+
+    keyBytes = TnmGetOctetStringFromObj(NULL, keyObj, &keyLength);
+
+    line = Tcl_NewListObj(0, NULL);
+    Tcl_ListObjAppendElement(NULL, line, Tcl_NewStringObj(
+	TnmGetTableValue(keyAlgorithmTable, (unsigned) cacheKey->algorithm),
+	-1));
+    Tcl_ListObjAppendElement(NULL, line, TnmNewOctetStringObj(
+	(char *) cacheKey->digest, KEY_DIGEST_SIZE));
+    Tcl_ListObjAppendElement(NULL, line, TnmNewOctetStringObj(
+	(char *) cacheKey->engineID, cacheKey->engineLength));
+    Tcl_ListObjAppendElement(NULL, line,
+			     TnmNewOctetStringObj(keyBytes, keyLength));
+    Tcl_AppendToObj(line, "\n", 1);
+    Tcl_WriteObj(channel, line);
+    Tcl_DecrRefCount(line);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * LoadKeyFile --
+ *
+ *	This procedure loads the keys saved in a key file into the
+ *	key cache. A missing file is treated like an empty file.
+ *	Since the keys allow to authenticate as the user, the file
+ *	is rejected if it is accessible by other users. Malformed
+ *	lines are ignored.
+ *
+ * Results:
+ *	A standard Tcl result.
+ *
+ * Side effects:
+ *	New entries are added to the key cache.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+LoadKeyFile(Tcl_Interp *interp, Tcl_Obj *fileName)
+{
+    Tcl_StatBuf stbuf;
+    Tcl_Channel channel;
+    Tcl_Obj *line, **elemv;
+    Tcl_HashEntry *entryPtr;
+    KeyCacheKey cacheKey;
+    char *bytes;
+    int elemc, length, isNew, algorithm;
+
+    if (Tcl_FSStat(fileName, &stbuf) != 0) {
+	return TCL_OK;
+    }
+#ifndef __WIN32__
+    if (stbuf.st_mode & 077) {
+	Tcl_AppendResult(interp, "key file \"", Tcl_GetString(fileName),
+			 "\" is accessible by other users", (char *) NULL);
+	return TCL_ERROR;
+    }
+#endif
+
+    channel = Tcl_FSOpenFileChannel(interp, fileName, "r", 0);
+    if (! channel) {
+	return TCL_ERROR;
+    }
+
+    line = Tcl_NewObj();
+    Tcl_IncrRefCount(line);
+    while (Tcl_GetsObj(channel, line) >= 0) {
+	if (Tcl_ListObjGetElements(NULL, line, &elemc, &elemv) != TCL_OK
+	    || elemc != 4) {
+	    goto next;
 	}
-	TnmSHAUpdate(&SH, buffer, 64);
-	count += 64;
+	algorithm = TnmGetTableKey(keyAlgorithmTable, Tcl_GetString(elemv[0]));
+	if (algorithm < 0) {
+	    goto next;
+	}
+	memset((char *) &cacheKey, 0, sizeof(cacheKey));
+	cacheKey.algorithm = algorithm;
+	bytes = TnmGetOctetStringFromObj(NULL, elemv[1], &length);
+	if (! bytes || length != KEY_DIGEST_SIZE) {
+	    goto next;
+	}
+	memcpy(cacheKey.digest, bytes, KEY_DIGEST_SIZE);
+	bytes = TnmGetOctetStringFromObj(NULL, elemv[2], &length);
+	if (! bytes || length == 0 || length > KEY_ENGINE_MAX) {
+	    goto next;
+	}
+	memcpy(cacheKey.engineID, bytes, (size_t) length);
+	cacheKey.engineLength = length;
+	bytes = TnmGetOctetStringFromObj(NULL, elemv[3], &length);
+	if (! bytes || length != KeyLength(algorithm)) {
+	    goto next;
+	}
+	entryPtr = Tcl_CreateHashEntry(&keyCache, (char *) &cacheKey, &isNew);
+	if (isNew) {
+	    Tcl_SetHashValue(entryPtr, NULL);
+	}
+	AddCachedKey(entryPtr, TnmNewOctetStringObj(bytes, length));
+    next:
+	Tcl_DecrRefCount(line);
+	line = Tcl_NewObj();
+	Tcl_IncrRefCount(line);
     }
-    TnmSHAFinal(key, &SH);
-    
-    memcpy(buffer, key, 20);
-    memcpy(buffer + 20, engineBytes, (size_t) engineLength);
-    memcpy(buffer + 20 + engineLength, key, 20);
-    
-    TnmSHAInit(&SH);
-    TnmSHAUpdate(&SH, buffer, 20 + engineLength + 20);
-    TnmSHAFinal(key, &SH);
+    Tcl_DecrRefCount(line);
+    Tcl_Close(NULL, channel);
+    return TCL_OK;
 }
 
 /*
@@ -173,10 +667,11 @@ SHAPassWord2Key(u_char *pwBytes, int pwLength, u_char *engineBytes, int engineLe
  *	is maintained in order to save some computations.
  *
  * Results:
- *	A pointer to the key or NULL if not found.
+ *	None. The key is left in objPtrPtr or NULL if no key can
+ *	be computed.
  *
  * Side effects:
- *	None.
+ *	New keys are added to the key cache and the key file.
  *
  *----------------------------------------------------------------------
  */
@@ -184,11 +679,11 @@ SHAPassWord2Key(u_char *pwBytes, int pwLength, u_char *engineBytes, int engineLe
 static void
 ComputeKey(Tcl_Obj **objPtrPtr, Tcl_Obj *password, Tcl_Obj *engineID, int algorithm)
 {
-    unsigned char *pwBytes, *engineBytes, *bytes;
-    int pwLength, engineLength, length;
-    KeyCache *elemPtr;
-    static KeyCache *keyList = NULL;
-    unsigned char buffer[256];	/* must be large enough to hold keys */
+    unsigned char *pwBytes, *engineBytes;
+    int pwLength, engineLength, isNew, cached;
+    KeyCacheKey cacheKey;
+    Tcl_HashEntry *entryPtr = NULL;
+    unsigned char buffer[KEY_SIZE_MAX];
 
     if (*objPtrPtr) {
 	Tcl_DecrRefCount(*objPtrPtr);
@@ -201,206 +696,1372 @@ ComputeKey(Tcl_Obj **objPtrPtr, Tcl_Obj *password, Tcl_Obj *engineID, int algori
     if (! pwBytes || ! engineBytes || engineLength == 0 || pwLength == 0) {
 	return;
     }
-    
+
     /*
-     * Check whether the key is already in our cache. We have
-     * to check that the password and the engineID  matches as
-     * well as the algorithm.
+     * Check whether the key is already in our cache. The hash key
+     * covers the algorithm, the password and the engineID.
      */
 
-    for (elemPtr = keyList; elemPtr; elemPtr = elemPtr->nextPtr) {
-	if (elemPtr->algorithm != algorithm) continue;
-
-	bytes = (unsigned char *) Tcl_GetStringFromObj(elemPtr->password, &length);
-	if (length != pwLength) continue;
-	if (memcmp(pwBytes, bytes, (size_t) length) != 0) continue;
-	
-	bytes = (unsigned char *) Tcl_GetStringFromObj(elemPtr->engineID, &length);
-	if (length != engineLength) continue;
-	if (memcmp(engineBytes, bytes, (size_t) length) != 0) continue;
-
-	*objPtrPtr = elemPtr->key;
-	Tcl_IncrRefCount(*objPtrPtr);
+    if (! keyCacheInitialized) {
+	Tcl_InitHashTable(&keyCache, sizeof(KeyCacheKey) / sizeof(int));
+	keyCacheInitialized = 1;
+    }
+    cached = MakeCacheKey(&cacheKey, algorithm, pwBytes, pwLength,
+			  engineBytes, engineLength);
+    if (cached) {
+	entryPtr = Tcl_CreateHashEntry(&keyCache, (char *) &cacheKey, &isNew);
+	if (! isNew) {
+	    *objPtrPtr = (Tcl_Obj *) Tcl_GetHashValue(entryPtr);
+	    Tcl_IncrRefCount(*objPtrPtr);
+	    return;
+	}
+	Tcl_SetHashValue(entryPtr, NULL);
     }
 
     /*
      * Compute a new key as described in the appendix of RFC 2274.
      */
 
-    switch (algorithm) {
-    case TNM_SNMP_AUTH_MD5:
-        MD5PassWord2Key(pwBytes, pwLength, engineBytes, engineLength, buffer);
-	*objPtrPtr = TnmNewOctetStringObj((char *)buffer, 16);
-	Tcl_IncrRefCount(*objPtrPtr);
-	break;
-    case TNM_SNMP_AUTH_SHA:
-	SHAPassWord2Key(pwBytes, pwLength, engineBytes, engineLength, buffer);
-	*objPtrPtr = TnmNewOctetStringObj((char *)buffer, 20);
-	Tcl_IncrRefCount(*objPtrPtr);
-	break;
-    default:
-	Tcl_Panic("unknown algorithm for password to key conversion");
-    }
+    PassWord2Key(algorithm, pwBytes, pwLength, engineBytes, engineLength,
+		 buffer);
+    *objPtrPtr = TnmNewOctetStringObj((char *) buffer, KeyLength(algorithm));
+    Tcl_IncrRefCount(*objPtrPtr);
 
     /*
-     * Finally, create a new cache entry to save the result for the
-     * future.
+     * Finally, save the result in the cache and in the key file
+     * for the future.
      */
 
-    elemPtr = (KeyCache *) ckalloc(sizeof(KeyCache));
-    elemPtr->algorithm = algorithm;
-    elemPtr->password = password;
-    Tcl_IncrRefCount(elemPtr->password);
-    elemPtr->engineID = engineID;
-    Tcl_IncrRefCount(elemPtr->engineID);
-    elemPtr->key = *objPtrPtr;
-    Tcl_IncrRefCount(elemPtr->key);
-    elemPtr->nextPtr = keyList;
-    keyList = elemPtr;
+    if (cached) {
+	AddCachedKey(entryPtr, *objPtrPtr);
+	if (keyFile) {
+	    Tcl_Channel channel;
+	    channel = Tcl_FSOpenFileChannel(NULL, keyFile, "a", 0600);
+	    if (channel) {
+		SaveCachedKey(channel, &cacheKey, *objPtrPtr);
+		Tcl_Close(NULL, channel);
+	    }
+	}
+    }
 }
 
 /*
  *----------------------------------------------------------------------
  *
- * TnmSnmpComputeKeys --
+ * KeyThread --
  *
- *	This procedure computes new authentication and privacy key
- *	for a given SNMPv3 session.
+ *	This procedure is the body of a thread which computes keys
+ *	for TnmSnmpPrecomputeKeys().
  *
  * Results:
  *	None.
  *
  * Side effects:
- *	The authentication and privacy keys for this session are updated.
+ *	The keys of the jobs are computed.
  *
  *----------------------------------------------------------------------
  */
 
-void
-TnmSnmpComputeKeys(TnmSnmp *session)
+#ifdef TCL_THREADS
+static Tcl_ThreadCreateType
+KeyThread(ClientData clientData)
 {
-    int authProto, privProto;
-
-    authProto = (session->securityLevel & TNM_SNMP_AUTH_MASK);
-    privProto = (session->securityLevel & TNM_SNMP_PRIV_MASK);
-
-    if (authProto != TNM_SNMP_AUTH_NONE) {
-	ComputeKey(&session->usmAuthKey, session->authPassWord,
-		   session->engineID, authProto);
-	if (privProto != TNM_SNMP_PRIV_NONE) {
-	    ComputeKey(&session->usmPrivKey, session->privPassWord,
-		       session->engineID, authProto);
-	}
-    }
+    RunKeyJobs((KeyJobList *) clientData);
+    TCL_THREAD_CREATE_RETURN;
 }
+#endif
 
 /*
  *----------------------------------------------------------------------
  *
- * TnmSnmpLocalizeKey --
+ * RunKeyJobs --
  *
- *	This procedure computes a localized key from a given key and
- *	engineID, either using MD5 or SHA.
+ *	This procedure takes jobs from the job list and computes
+ *	their keys until the job list is exhausted.
  *
  * Results:
- *	The localized key is returned in localAuthKey.
+ *	None.
  *
  * Side effects:
- *	None.
+ *	The keys of the jobs are computed.
  *
  *----------------------------------------------------------------------
  */
 
-void
-TnmSnmpLocalizeKey(int algorithm, Tcl_Obj *authKey, Tcl_Obj *engineID, Tcl_Obj *localAuthKey)
+static void
+RunKeyJobs(KeyJobList *listPtr)
 {
-    unsigned char *engineBytes, *authKeyBytes;
-    int engineLength, authKeyLength, localAuthKeyLength = 20;
-    unsigned char localAuthKeyBytes[20]; /* must be big enough for MD5 and SHA */
+    KeyJob *jobPtr;
 
-    authKeyBytes = (unsigned char *) Tcl_GetStringFromObj(authKey, &authKeyLength);
-    engineBytes = (unsigned char *) Tcl_GetStringFromObj(engineID, &engineLength);
+    while (1) {
+	Tcl_MutexLock(&jobMutex);
+	jobPtr = (listPtr->next < listPtr->numJobs)
+	    ? listPtr->jobs + listPtr->next++ : NULL;
+	Tcl_MutexUnlock(&jobMutex);
+	if (! jobPtr) {
+	    break;
+	}
+	PassWord2Key(jobPtr->cacheKey.algorithm,
+		     jobPtr->pwBytes, jobPtr->pwLength,
+		     jobPtr->cacheKey.engineID, jobPtr->cacheKey.engineLength,
+		     jobPtr->key);
+    }
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * TnmSnmpPrecomputeKeys --
+ *
+ *	This procedure computes the keys for a list of SNMPv3
+ *	credentials in advance so that sessions created later find
+ *	their keys in the key cache. Each element of the list
+ *	contains an algorithm (md5 or sha), a password and an
+ *	engineID. Keys which are not cached yet are computed in
+ *	parallel by one thread per processor.
+ *
+ * Results:
+ *	A standard Tcl result. The number of keys computed is left
+ *	in the interpreter.
+ *
+ * Side effects:
+ *	New keys are added to the key cache and the key file.
+ *
+ *----------------------------------------------------------------------
+ */
+
+int
+TnmSnmpPrecomputeKeys(Tcl_Interp *interp, Tcl_Obj *listObj)
+{
+    Tcl_Obj **objv, **elemv;
+    Tcl_HashEntry *entryPtr;
+    KeyJobList jobList;
+    u_char *pwBytes, *engineBytes;
+    int i, objc, elemc, pwLength, engineLength, algorithm, isNew;
+    int numThreads = 1, numStarted = 0;
+#ifdef TCL_THREADS
+    Tcl_ThreadId threads[KEY_THREADS_MAX];
+#endif
+
+    if (Tcl_ListObjGetElements(interp, listObj, &objc, &objv) != TCL_OK) {
+	return TCL_ERROR;
+    }
+
+    if (! keyCacheInitialized) {
+	Tcl_InitHashTable(&keyCache, sizeof(KeyCacheKey) / sizeof(int));
+	keyCacheInitialized = 1;
+    }
+
+    jobList.jobs = (KeyJob *) ckalloc(objc * sizeof(KeyJob) + 1);
+    jobList.numJobs = 0;
+    jobList.next = 0;
+
+    /*
+     * Collect the keys which are not yet in the cache. Cache entries
+     * are created right away so that duplicates are computed once.
+     */
+
+    for (i = 0; i < objc; i++) {
+	KeyJob *jobPtr = jobList.jobs + jobList.numJobs;
+	if (Tcl_ListObjGetElements(interp, objv[i], &elemc, &elemv) != TCL_OK) {
+	    goto error;
+	}
+	if (elemc != 3) {
+	    Tcl_AppendResult(interp, "illegal key specification \"",
+			     Tcl_GetString(objv[i]), "\"", (char *) NULL);
+	    goto error;
+	}
+	algorithm = TnmGetTableKeyFromObj(interp, keyAlgorithmTable,
+					  elemv[0], "algorithm");
+	if (algorithm < 0) {
+	    goto error;
+	}
+	pwBytes = (u_char *) Tcl_GetStringFromObj(elemv[1], &pwLength);
+	engineBytes = (u_char *) TnmGetOctetStringFromObj(interp, elemv[2],
+							  &engineLength);
+	if (! engineBytes) {
+	    goto error;
+	}
+	if (pwLength == 0 || engineLength == 0
+	    || ! MakeCacheKey(&jobPtr->cacheKey, algorithm, pwBytes, pwLength,
+			      engineBytes, engineLength)) {
+	    continue;
+	}
+	entryPtr = Tcl_CreateHashEntry(&keyCache,
+				       (char *) &jobPtr->cacheKey, &isNew);
+	if (! isNew) {
+	    continue;
+	}
+	Tcl_SetHashValue(entryPtr, NULL);
+	jobPtr->pwBytes = pwBytes;
+	jobPtr->pwLength = pwLength;
+	jobList.numJobs++;
+    }
+
+#if defined(TCL_THREADS) && defined(_SC_NPROCESSORS_ONLN)
+    numThreads = (int) sysconf(_SC_NPROCESSORS_ONLN);
+    if (numThreads > KEY_THREADS_MAX) {
+	numThreads = KEY_THREADS_MAX;
+    }
+    if (numThreads > jobList.numJobs) {
+	numThreads = jobList.numJobs;
+    }
+#endif
+
+#ifdef TCL_THREADS
+    for (i = 1; i < numThreads; i++) {
+	if (Tcl_CreateThread(&threads[numStarted], KeyThread,
+			     (ClientData) &jobList, TCL_THREAD_STACK_DEFAULT,
+			     TCL_THREAD_JOINABLE) == TCL_OK) {
+	    numStarted++;
+	}
+    }
+#endif
+    RunKeyJobs(&jobList);
+#ifdef TCL_THREADS
+    for (i = 0; i < numStarted; i++) {
+	int result;
+	Tcl_JoinThread(threads[i], &result);
+    }
+#endif
+
+    /*
+     * Store the computed keys in the cache and append them to the
+     * key file.
+     */
+
+    {
+	Tcl_Channel channel = NULL;
+	if (keyFile && jobList.numJobs) {
+	    channel = Tcl_FSOpenFileChannel(NULL, keyFile, "a", 0600);
+	}
+	for (i = 0; i < jobList.numJobs; i++) {
+	    KeyJob *jobPtr = jobList.jobs + i;
+	    Tcl_Obj *keyObj;
+	    keyObj = TnmNewOctetStringObj((char *) jobPtr->key,
+				    KeyLength(jobPtr->cacheKey.algorithm));
+	    entryPtr = Tcl_FindHashEntry(&keyCache, (char *) &jobPtr->cacheKey);
+	    AddCachedKey(entryPtr, keyObj);
+	    if (channel) {
+		SaveCachedKey(channel, &jobPtr->cacheKey, keyObj);
+	    }
+	}
+	if (channel) {
+	    Tcl_Close(NULL, channel);
+	}
+    }
+
+    Tcl_SetObjResult(interp, Tcl_NewIntObj(jobList.numJobs));
+    ckfree((char *) jobList.jobs);
+    return TCL_OK;
+
+ error:
+    for (i = 0; i < jobList.numJobs; i++) {
+	entryPtr = Tcl_FindHashEntry(&keyCache,
+				     (char *) &jobList.jobs[i].cacheKey);
+	Tcl_DeleteHashEntry(entryPtr);
+    }
+    ckfree((char *) jobList.jobs);
+    return TCL_ERROR;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * TnmSnmpKeyFile --
+ *
+ *	This procedure sets the file which keeps the keys of the key
+ *	cache across restarts. The keys saved in the file are loaded
+ *	into the cache and new keys are appended to the file. The
+ *	file is created with permissions that deny access by other
+ *	users. An empty file name stops saving keys. The current
+ *	file is reported if fileName is NULL.
+ *
+ * Results:
+ *	A standard Tcl result. The name of the key file is left in
+ *	the interpreter.
+ *
+ * Side effects:
+ *	The key cache is updated.
+ *
+ *----------------------------------------------------------------------
+ */
+
+int
+TnmSnmpKeyFile(Tcl_Interp *interp, Tcl_Obj *fileName)
+{
+    Tcl_Obj *pathObj = NULL;
+
+    if (! keyCacheInitialized) {
+	Tcl_InitHashTable(&keyCache, sizeof(KeyCacheKey) / sizeof(int));
+	keyCacheInitialized = 1;
+    }
+
+    if (! fileName) {
+	goto done;
+    }
+
+    if (Tcl_GetCharLength(fileName)) {
+	pathObj = Tcl_FSGetNormalizedPath(interp, fileName);
+	if (! pathObj) {
+	    return TCL_ERROR;
+	}
+	pathObj = Tcl_DuplicateObj(pathObj);
+	Tcl_IncrRefCount(pathObj);
+	if (LoadKeyFile(interp, pathObj) != TCL_OK) {
+	    Tcl_DecrRefCount(pathObj);
+	    return TCL_ERROR;
+	}
+    }
+
+    if (keyFile) {
+	Tcl_DecrRefCount(keyFile);
+    }
+    keyFile = pathObj;
+
+ done:
+    if (keyFile) {
+	Tcl_SetObjResult(interp, keyFile);
+    }
+    return TCL_OK;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * TnmSnmpKeyCacheSize --
+ *
+ *	This procedure returns the number of keys in the key cache.
+ *
+ * Results:
+ *	The number of cached keys.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+int
+TnmSnmpKeyCacheSize(void)
+{
+    return keyCacheInitialized ? keyCache.numEntries : 0;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * TnmSnmpKeyCacheClear --
+ *
+ *	This procedure removes all keys from the key cache. The key
+ *	file is not modified.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	Memory is freed.
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+TnmSnmpKeyCacheClear(void)
+{
+    Tcl_HashEntry *entryPtr;
+    Tcl_HashSearch search;
+
+    if (! keyCacheInitialized) {
+	return;
+    }
+    for (entryPtr = Tcl_FirstHashEntry(&keyCache, &search);
+	 entryPtr; entryPtr = Tcl_NextHashEntry(&search)) {
+	Tcl_Obj *keyObj = (Tcl_Obj *) Tcl_GetHashValue(entryPtr);
+	if (keyObj) {
+	    Tcl_DecrRefCount(keyObj);
+	}
+    }
+    Tcl_DeleteHashTable(&keyCache);
+    Tcl_InitHashTable(&keyCache, sizeof(KeyCacheKey) / sizeof(int));
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * TnmSnmpComputeKeys --
+ *
+ *	This procedure computes new authentication and privacy key
+ *	for a given SNMPv3 session.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	The authentication and privacy keys for this session are updated.
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+TnmSnmpComputeKeys(TnmSnmp *session)
+{
+    int authProto, privProto;
+
+    authProto = (session->securityLevel & TNM_SNMP_AUTH_MASK);
+    privProto = (session->securityLevel & TNM_SNMP_PRIV_MASK);
+
+    /*
+     * Keys configured directly with -authKey or -privKey do not
+     * have a password and are left alone.
+     */
+
+    if (authProto != TNM_SNMP_AUTH_NONE) {
+	if (session->authPassWord) {
+	    ComputeKey(&session->usmAuthKey, session->authPassWord,
+		       session->engineID, authProto);
+	}
+	if (privProto != TNM_SNMP_PRIV_NONE && session->privPassWord) {
+	    ComputeKey(&session->usmPrivKey, session->privPassWord,
+		       session->engineID, authProto);
+	}
+    }
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * TnmSnmpLocalizeKey --
+ *
+ *	This procedure computes a localized key from a given key and
+ *	engineID with the hash function of an authentication protocol.
+ *
+ * Results:
+ *	The localized key is returned in localAuthKey.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+TnmSnmpLocalizeKey(int algorithm, Tcl_Obj *authKey, Tcl_Obj *engineID, Tcl_Obj *localAuthKey)
+{
+    unsigned char *engineBytes, *authKeyBytes;
+    int engineLength, authKeyLength;
+    unsigned char localAuthKeyBytes[KEY_SIZE_MAX];
+    HashCtx ctx;
+
+    authKeyBytes = (unsigned char *) Tcl_GetStringFromObj(authKey, &authKeyLength);
+    engineBytes = (unsigned char *) Tcl_GetStringFromObj(engineID, &engineLength);
+
+    /*
+     * Localize a key as described in section 2.6 of RFC 2274.
+     */
+
+    HashInit(algorithm, &ctx);
+    HashUpdate(algorithm, &ctx, authKeyBytes, authKeyLength);
+    HashUpdate(algorithm, &ctx, engineBytes, engineLength);
+    HashUpdate(algorithm, &ctx, authKeyBytes, authKeyLength);
+    HashFinal(algorithm, &ctx, localAuthKeyBytes);
+
+    Tcl_SetStringObj(localAuthKey, (char *) localAuthKeyBytes,
+		     KeyLength(algorithm));
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * GetHmac --
+ *
+ *	This procedure returns the HMAC state for the authentication
+ *	key of a session. The state is computed again whenever the
+ *	key or the authentication protocol of the session changed,
+ *	which covers keys computed from passwords as well as keys
+ *	configured directly.
+ *
+ * Results:
+ *	A pointer to the HMAC state or NULL if the session has no
+ *	valid authentication key.
+ *
+ * Side effects:
+ *	The HMAC state of the session is updated.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static TnmSnmpHmac*
+GetHmac(TnmSnmp *session)
+{
+    TnmSnmpHmac *hmacPtr = session->usmHmac;
+    int algorithm = (session->securityLevel & TNM_SNMP_AUTH_MASK);
+    u_char ipad[HMAC_BLOCK_MAX], opad[HMAC_BLOCK_MAX], *keyBytes;
+    int i, keyLength, blockLength;
+
+    if (! session->usmAuthKey || algorithm == TNM_SNMP_AUTH_NONE) {
+	return NULL;
+    }
+    if (hmacPtr && hmacPtr->keyObj == session->usmAuthKey
+	&& hmacPtr->algorithm == algorithm) {
+	return hmacPtr;
+    }
+
+    keyBytes = (u_char *) TnmGetOctetStringFromObj(NULL, session->usmAuthKey,
+						   &keyLength);
+    if (! keyBytes || keyLength != KeyLength(algorithm)) {
+	return NULL;
+    }
+
+    if (! hmacPtr) {
+	hmacPtr = (TnmSnmpHmac *) ckalloc(sizeof(TnmSnmpHmac));
+	memset((char *) hmacPtr, 0, sizeof(TnmSnmpHmac));
+	session->usmHmac = hmacPtr;
+    }
+    if (hmacPtr->keyObj) {
+	Tcl_DecrRefCount(hmacPtr->keyObj);
+    }
+    hmacPtr->keyObj = session->usmAuthKey;
+    Tcl_IncrRefCount(hmacPtr->keyObj);
+    hmacPtr->algorithm = algorithm;
+
+    /*
+     * The key is never longer than the block of the hash function,
+     * so it is just padded with zeros (RFC 2104 section 2).
+     */
+
+    blockLength = BlockLength(algorithm);
+    memset(ipad, 0x36, (size_t) blockLength);
+    memset(opad, 0x5c, (size_t) blockLength);
+    for (i = 0; i < keyLength; i++) {
+	ipad[i] ^= keyBytes[i];
+	opad[i] ^= keyBytes[i];
+    }
+    HashInit(algorithm, &hmacPtr->inner);
+    HashUpdate(algorithm, &hmacPtr->inner, ipad, blockLength);
+    HashInit(algorithm, &hmacPtr->outer);
+    HashUpdate(algorithm, &hmacPtr->outer, opad, blockLength);
+    return hmacPtr;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * ComputeMac --
+ *
+ *	This procedure computes the truncated HMAC of a message by
+ *	continuing copies of the precomputed inner and outer digest
+ *	contexts.
+ *
+ * Results:
+ *	The MAC is written to the mac argument.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+ComputeMac(TnmSnmpHmac *hmacPtr, u_char *msg, int msgLen, u_char *mac)
+{
+    HashCtx ctx;
+    u_char digest[KEY_SIZE_MAX];
+    int algorithm = hmacPtr->algorithm;
+
+    ctx = hmacPtr->inner;
+    HashUpdate(algorithm, &ctx, msg, msgLen);
+    HashFinal(algorithm, &ctx, digest);
+
+    ctx = hmacPtr->outer;
+    HashUpdate(algorithm, &ctx, digest, KeyLength(algorithm));
+    HashFinal(algorithm, &ctx, digest);
+
+    memcpy(mac, digest, (size_t) TnmSnmpAuthLength(algorithm));
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * FindAuthParams --
+ *
+ *	This procedure locates the msgAuthenticationParameters field
+ *	in an encoded SNMPv3 message. The message is parsed since the
+ *	encoder may move the field when it fixes up length fields.
+ *
+ * Results:
+ *	A pointer to the field in the packet or NULL if the message
+ *	can not be parsed. The length is returned in lengthPtr.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static u_char*
+FindAuthParams(u_char *packet, int packetlen, int *lengthPtr)
+{
+    TnmBer _ber, *ber, _usmBer, *usmBer;
+    u_char *token, *usmParam;
+    char *authParam, *header;
+    int length, value, usmParamLength, headerLength;
+
+    ber = TnmBerInit(&_ber, packet, packetlen);
+    ber = TnmBerDecSequenceStart(ber, ASN1_SEQUENCE, &token, &length);
+    ber = TnmBerDecInt(ber, ASN1_INTEGER, &value);
+    if (! ber) {
+	return NULL;
+    }
+    ber = TnmBerDecAny(ber, &header, &headerLength);
+    ber = TnmBerDecOctetString(ber, ASN1_OCTET_STRING,
+			       (char **) &usmParam, &usmParamLength);
+    if (! ber) {
+	return NULL;
+    }
+
+    usmBer = TnmBerInit(&_usmBer, usmParam, usmParamLength);
+    usmBer = TnmBerDecSequenceStart(usmBer, ASN1_SEQUENCE, &token, &length);
+    usmBer = TnmBerDecOctetString(usmBer, ASN1_OCTET_STRING, NULL, NULL);
+    usmBer = TnmBerDecInt(usmBer, ASN1_INTEGER, &value);
+    usmBer = TnmBerDecInt(usmBer, ASN1_INTEGER, &value);
+    usmBer = TnmBerDecOctetString(usmBer, ASN1_OCTET_STRING, NULL, NULL);
+    usmBer = TnmBerDecOctetString(usmBer, ASN1_OCTET_STRING,
+				  &authParam, lengthPtr);
+    return usmBer ? (u_char *) authParam : NULL;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * TnmSnmpAuthLength --
+ *
+ *	This procedure returns the length of the msgAuthentication-
+ *	Parameters field of an authentication protocol (RFC 2274
+ *	section 6 and 7, RFC 7860 section 4.2).
+ *
+ * Results:
+ *	The length of the truncated MAC in bytes.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+int
+TnmSnmpAuthLength(int algorithm)
+{
+    switch (algorithm) {
+    case TNM_SNMP_AUTH_SHA224:
+	return 16;
+    case TNM_SNMP_AUTH_SHA256:
+	return 24;
+    case TNM_SNMP_AUTH_SHA384:
+	return 32;
+    case TNM_SNMP_AUTH_SHA512:
+	return 48;
+    default:
+	return 12;
+    }
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * MacEqual --
+ *
+ *	This procedure compares two MACs. The time it takes does not
+ *	depend on the position of the first differing byte so that
+ *	a forged MAC can not be guessed byte by byte.
+ *
+ * Results:
+ *	1 if the MACs are equal and 0 otherwise.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+MacEqual(u_char *mac1, u_char *mac2, int length)
+{
+    u_char diff = 0;
+    int i;
+
+    for (i = 0; i < length; i++) {
+	diff |= mac1[i] ^ mac2[i];
+    }
+    return diff == 0;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * TnmSnmpAuthOutMsg --
+ *
+ *	This procedure authenticates an outgoing SNMPv3 message. The
+ *	msgAuthenticationParameters field must be filled with zeros
+ *	and is replaced with the MAC of the whole message.
+ *
+ * Results:
+ *	A standard Tcl result. An error message is left in interp
+ *	if the message can not be authenticated.
+ *
+ * Side effects:
+ *	The MAC is written into the packet.
+ *
+ *----------------------------------------------------------------------
+ */
+
+int
+TnmSnmpAuthOutMsg(Tcl_Interp *interp, TnmSnmp *session, u_char *packet, int packetlen)
+{
+    TnmSnmpHmac *hmacPtr = GetHmac(session);
+    u_char *authParam;
+    int authLength;
+
+    if (! hmacPtr) {
+	if (interp) {
+	    Tcl_SetResult(interp, "no valid authentication key", TCL_STATIC);
+	}
+	return TCL_ERROR;
+    }
+    authParam = FindAuthParams(packet, packetlen, &authLength);
+    if (! authParam
+	|| authLength != TnmSnmpAuthLength(hmacPtr->algorithm)) {
+	if (interp) {
+	    Tcl_SetResult(interp, "invalid authentication parameters",
+			  TCL_STATIC);
+	}
+	return TCL_ERROR;
+    }
+    ComputeMac(hmacPtr, packet, packetlen, authParam);
+    return TCL_OK;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * TnmSnmpAuthInMsg --
+ *
+ *	This procedure verifies the MAC of an incoming SNMPv3 message.
+ *	The msgAuthenticationParameters field points into the packet.
+ *	It is replaced with zeros while the MAC is computed and then
+ *	restored.
+ *
+ * Results:
+ *	1 if the MAC is valid and 0 otherwise.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+int
+TnmSnmpAuthInMsg(TnmSnmp *session, u_char *packet, int packetlen, u_char *authParam, int authLength)
+{
+    TnmSnmpHmac *hmacPtr = GetHmac(session);
+    u_char received[KEY_SIZE_MAX], mac[KEY_SIZE_MAX];
+
+    if (! hmacPtr || ! authParam
+	|| authLength != TnmSnmpAuthLength(hmacPtr->algorithm)) {
+	return 0;
+    }
+
+    memcpy(received, authParam, (size_t) authLength);
+    memset(authParam, 0, (size_t) authLength);
+    ComputeMac(hmacPtr, packet, packetlen, mac);
+    memcpy(authParam, received, (size_t) authLength);
+
+    return MacEqual(received, mac, authLength);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * TnmSnmpHmacFree --
+ *
+ *	This procedure frees the HMAC state of a session.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	Memory is freed.
+ *
+ *----------------------------------------------------------------------
+ */
 
-    /*
-     * Localize a key as described in section 2.6 of RFC 2274.
-     */
+void
+TnmSnmpHmacFree(TnmSnmp *session)
+{
+    if (session->usmHmac) {
+	if (session->usmHmac->keyObj) {
+	    Tcl_DecrRefCount(session->usmHmac->keyObj);
+	}
+	ckfree((char *) session->usmHmac);
+	session->usmHmac = NULL;
+    }
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * GetCipher --
+ *
+ *	This procedure returns the cipher state for the privacy key
+ *	of a session. Like the HMAC state, it is computed again
+ *	whenever the key or the privacy protocol changed. DES uses
+ *	the first 8 bytes of the localized key as the key and the
+ *	next 8 bytes as the pre-IV. AES-128 uses the first 16 bytes.
+ *
+ * Results:
+ *	A pointer to the cipher state or NULL if the session has no
+ *	valid privacy key.
+ *
+ * Side effects:
+ *	The cipher state of the session is updated.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static TnmSnmpCipher*
+GetCipher(TnmSnmp *session)
+{
+    TnmSnmpCipher *cipherPtr = session->usmCipher;
+    int algorithm = (session->securityLevel & TNM_SNMP_PRIV_MASK);
+    u_char *keyBytes;
+    int keyLength;
+
+    if (! session->usmPrivKey || algorithm == TNM_SNMP_PRIV_NONE) {
+	return NULL;
+    }
+    if (cipherPtr && cipherPtr->keyObj == session->usmPrivKey
+	&& cipherPtr->algorithm == algorithm) {
+	return cipherPtr;
+    }
+
+    keyBytes = (u_char *) TnmGetOctetStringFromObj(NULL, session->usmPrivKey,
+						   &keyLength);
+    if (! keyBytes || keyLength < PRIV_KEY_MIN) {
+	return NULL;
+    }
+
+    if (! cipherPtr) {
+	cipherPtr = (TnmSnmpCipher *) ckalloc(sizeof(TnmSnmpCipher));
+	memset((char *) cipherPtr, 0, sizeof(TnmSnmpCipher));
+	session->usmCipher = cipherPtr;
+    }
+    if (cipherPtr->keyObj) {
+	Tcl_DecrRefCount(cipherPtr->keyObj);
+    }
+    cipherPtr->keyObj = session->usmPrivKey;
+    Tcl_IncrRefCount(cipherPtr->keyObj);
+    cipherPtr->algorithm = algorithm;
 
     switch (algorithm) {
-    case TNM_SNMP_AUTH_MD5: {
-	MD5_CTX MD;
-	TnmMD5Init(&MD);
-	TnmMD5Update(&MD, authKeyBytes, authKeyLength);
-	TnmMD5Update(&MD, engineBytes, engineLength);
-	TnmMD5Update(&MD, authKeyBytes, authKeyLength);
-	Tcl_SetObjLength(localAuthKey, 16);
-	TnmMD5Final(localAuthKeyBytes, &MD);
+    case TNM_SNMP_PRIV_DES:
+	TnmDESSetKey(&cipherPtr->ctx.des, keyBytes);
+	memcpy(cipherPtr->preIV, keyBytes + TNM_DES_KEYSIZE,
+	       TNM_DES_BLOCKSIZE);
 	break;
-    }
-    case TNM_SNMP_AUTH_SHA: {
-	SHA_CTX SH;
-	TnmSHAInit(&SH);
-	TnmSHAUpdate(&SH, authKeyBytes, authKeyLength);
-	TnmSHAUpdate(&SH, engineBytes, engineLength);
-	TnmSHAUpdate(&SH, authKeyBytes, authKeyLength);
-	TnmSHAFinal(localAuthKeyBytes, &SH);
+    case TNM_SNMP_PRIV_AES:
+	TnmAESSetKey(&cipherPtr->ctx.aes, keyBytes);
 	break;
     }
-    default:
-	Tcl_Panic("unknown algorithm for key localization");
+    return cipherPtr;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * MakeAesIV --
+ *
+ *	This procedure builds the AES initialization vector from the
+ *	engineBoots, the engineTime and the salt of a message as
+ *	described in RFC 3826 section 3.1.2.1.
+ *
+ * Results:
+ *	The IV is written to the iv argument.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+MakeAesIV(u_char *iv, int engineBoots, int engineTime, u_char *salt)
+{
+    int i;
+
+    for (i = 0; i < 4; i++) {
+	iv[i] = (u_char) (engineBoots >> (24 - 8 * i));
+	iv[4 + i] = (u_char) (engineTime >> (24 - 8 * i));
+    }
+    memcpy(iv + 8, salt, TNM_SNMP_PRIV_SALTSIZE);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * TnmSnmpPrivSalt --
+ *
+ *	This procedure computes the msgPrivacyParameters of an
+ *	outgoing message. The DES salt is the engineBoots followed
+ *	by the lower half of the salt counter (RFC 3414 section
+ *	8.1.1.1). The AES salt is the whole 64 bit counter.
+ *
+ * Results:
+ *	The salt is written to the salt argument.
+ *
+ * Side effects:
+ *	The salt counter is incremented.
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+TnmSnmpPrivSalt(TnmSnmp *session, u_char *salt)
+{
+    Tcl_WideUInt value;
+    int i;
+
+    Tcl_MutexLock(&saltMutex);
+    if (! privSaltInitialized) {
+	privSalt = ((Tcl_WideUInt) time((time_t *) NULL) << 32)
+	    ^ (Tcl_WideUInt) (size_t) &privSalt;
+	privSaltInitialized = 1;
     }
+    value = privSalt++;
+    Tcl_MutexUnlock(&saltMutex);
 
-    Tcl_SetStringObj(localAuthKey, (char *) localAuthKeyBytes, localAuthKeyLength);
+    if ((session->securityLevel & TNM_SNMP_PRIV_MASK) == TNM_SNMP_PRIV_DES) {
+	value = ((Tcl_WideUInt) (unsigned) session->engineBoots << 32)
+	    | (value & 0xffffffff);
+    }
+    for (i = TNM_SNMP_PRIV_SALTSIZE - 1; i >= 0; i--) {
+	salt[i] = (u_char) (value & 0xff);
+	value >>= 8;
+    }
 }
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * TnmSnmpEncryptPdu --
+ *
+ *	This procedure encrypts the scoped PDU of an outgoing message
+ *	in place. The scoped PDU starts at data and ends at the
+ *	current position of the BER stream. DES needs a multiple of
+ *	the block size, so padding is appended to the BER stream.
+ *	The salt must have been computed with TnmSnmpPrivSalt() and
+ *	the engineBoots and engineTime of the session must be the
+ *	values encoded in the message.
+ *
+ * Results:
+ *	A pointer to the BER byte stream or NULL if the session has
+ *	no privacy key.
+ *
+ * Side effects:
+ *	The scoped PDU is replaced with the cipher text.
+ *
+ *----------------------------------------------------------------------
+ */
 
-static void
-MD5AuthOutMsg(char *authKey, u_char *msg, int msgLen, u_char *msgAuthenticationParameters)
+TnmBer*
+TnmSnmpEncryptPdu(TnmSnmp *session, TnmBer *ber, u_char *data, u_char *salt)
 {
-    MD5_CTX MD;
-    unsigned char extendedAuthKey[64];
-    unsigned char digest[16];
+    TnmSnmpCipher *cipherPtr = GetCipher(session);
+    u_char iv[TNM_AES_BLOCKSIZE];
     int i;
 
-    memset(msgAuthenticationParameters, 0, 12);
-    memcpy(extendedAuthKey, authKey, 16);
+    if (! ber) {
+	return NULL;
+    }
+    if (! cipherPtr) {
+	TnmBerSetError(ber, "no valid privacy key");
+	return NULL;
+    }
+
+    switch (cipherPtr->algorithm) {
+    case TNM_SNMP_PRIV_DES:
+	while ((ber->current - data) % TNM_DES_BLOCKSIZE) {
+	    ber = TnmBerEncByte(ber, 0);
+	    if (! ber) {
+		return NULL;
+	    }
+	}
+	for (i = 0; i < TNM_DES_BLOCKSIZE; i++) {
+	    iv[i] = salt[i] ^ cipherPtr->preIV[i];
+	}
+	TnmDESEncryptCBC(&cipherPtr->ctx.des, iv, data,
+			 (int) (ber->current - data));
+	break;
+    case TNM_SNMP_PRIV_AES:
+	MakeAesIV(iv, session->engineBoots, session->engineTime, salt);
+	TnmAESEncryptCFB(&cipherPtr->ctx.aes, iv, data,
+			 (int) (ber->current - data));
+	break;
+    }
+    return ber;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * TnmSnmpDecryptPdu --
+ *
+ *	This procedure decrypts the encrypted scoped PDU of an
+ *	incoming message in place. The engineBoots and engineTime
+ *	are the values found in the message.
+ *
+ * Results:
+ *	1 if the data was decrypted and 0 if the session has no
+ *	privacy key or the privacy parameters are invalid.
+ *
+ * Side effects:
+ *	The cipher text is replaced with the scoped PDU.
+ *
+ *----------------------------------------------------------------------
+ */
+
+int
+TnmSnmpDecryptPdu(TnmSnmp *session, u_char *salt, int saltLength, int engineBoots, int engineTime, u_char *data, int length)
+{
+    TnmSnmpCipher *cipherPtr = GetCipher(session);
+    u_char iv[TNM_AES_BLOCKSIZE];
+    int i;
 
-    for (i = 1; i < 64; i++) {
-	extendedAuthKey[i] = extendedAuthKey[i] ^ 0x36;
+    if (! cipherPtr || saltLength != TNM_SNMP_PRIV_SALTSIZE) {
+	return 0;
     }
-    
-    TnmMD5Init(&MD);
-    TnmMD5Update(&MD, extendedAuthKey, 64);
-    TnmMD5Update(&MD, msg, msgLen);
-    TnmMD5Final(digest, &MD);
 
-    for (i = 0; i < 64; i++) {
-	extendedAuthKey[i] = extendedAuthKey[i] ^ 0x5c;
+    switch (cipherPtr->algorithm) {
+    case TNM_SNMP_PRIV_DES:
+	if (length % TNM_DES_BLOCKSIZE) {
+	    return 0;
+	}
+	for (i = 0; i < TNM_DES_BLOCKSIZE; i++) {
+	    iv[i] = salt[i] ^ cipherPtr->preIV[i];
+	}
+	TnmDESDecryptCBC(&cipherPtr->ctx.des, iv, data, length);
+	break;
+    case TNM_SNMP_PRIV_AES:
+	MakeAesIV(iv, engineBoots, engineTime, salt);
+	TnmAESDecryptCFB(&cipherPtr->ctx.aes, iv, data, length);
+	break;
     }
+    return 1;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * TnmSnmpCipherFree --
+ *
+ *	This procedure frees the cipher state of a session.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	Memory is freed.
+ *
+ *----------------------------------------------------------------------
+ */
 
-    TnmMD5Init(&MD);
-    TnmMD5Update(&MD, extendedAuthKey, 64);
-    TnmMD5Update(&MD, digest, 16);
-    TnmMD5Final(digest, &MD);
+void
+TnmSnmpCipherFree(TnmSnmp *session)
+{
+    if (session->usmCipher) {
+	if (session->usmCipher->keyObj) {
+	    Tcl_DecrRefCount(session->usmCipher->keyObj);
+	}
+	ckfree((char *) session->usmCipher);
+	session->usmCipher = NULL;
+    }
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * MakeEngineKey --
+ *
+ *	This procedure initializes the engine cache key for a
+ *	transport address.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
 
-    memcpy(msgAuthenticationParameters, digest, 12);
+static void
+MakeEngineKey(EngineCacheKey *cacheKey, struct sockaddr_in *addr)
+{
+    memset((char *) cacheKey, 0, sizeof(EngineCacheKey));
+    cacheKey->addr = addr->sin_addr.s_addr;
+    cacheKey->port = addr->sin_port;
 }
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * TnmSnmpEngineUpdate --
+ *
+ *	This procedure saves the parameters of the authoritative
+ *	engine reachable at a given transport address in the engine
+ *	cache. Empty or oversized engineIDs are ignored.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	The engine cache is updated.
+ *
+ *----------------------------------------------------------------------
+ */
 
 void
-TnmSnmpAuthOutMsg(int algorithm, Tcl_Obj *authKey, u_char *msg, int msgLen, u_char *msgAuthenticationParameters)
+TnmSnmpEngineUpdate(struct sockaddr_in *addr, char *engineID, int engineIDLength, int engineBoots, int engineTime)
 {
-    char *keyBytes;
-    int keyLen;
-    
-    keyBytes = Tcl_GetStringFromObj(authKey, &keyLen);
+    EngineCacheKey cacheKey;
+    EngineCacheEntry *cachePtr;
+    Tcl_HashEntry *entryPtr;
+    int isNew;
 
-    switch (algorithm) {
-    case TNM_SNMP_AUTH_MD5:
-	if (keyLen != 16) {
-	    Tcl_Panic("illegal length of the MD5 authentication key");
+    if (engineIDLength <= 0 || engineIDLength > ENGINE_ID_MAX) {
+	return;
+    }
+
+    MakeEngineKey(&cacheKey, addr);
+
+    Tcl_MutexLock(&engineMutex);
+    if (! engineCacheInitialized) {
+	Tcl_InitHashTable(&engineCache,
+			  sizeof(EngineCacheKey) / sizeof(int));
+	engineCacheInitialized = 1;
+    }
+    entryPtr = Tcl_CreateHashEntry(&engineCache, (char *) &cacheKey, &isNew);
+    if (isNew) {
+	cachePtr = (EngineCacheEntry *) ckalloc(sizeof(EngineCacheEntry));
+	Tcl_SetHashValue(entryPtr, (ClientData) cachePtr);
+    } else {
+	cachePtr = (EngineCacheEntry *) Tcl_GetHashValue(entryPtr);
+    }
+    cachePtr->engineIDLength = engineIDLength;
+    memcpy(cachePtr->engineID, engineID, (size_t) engineIDLength);
+    cachePtr->engineBoots = engineBoots;
+    cachePtr->engineTime = engineTime;
+    cachePtr->learned = time((time_t *) NULL);
+    Tcl_MutexUnlock(&engineMutex);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * TnmSnmpEngineLookup --
+ *
+ *	This procedure looks up the authoritative engine reachable
+ *	at a given transport address in the engine cache. Sessions
+ *	without an engineID take the cached engineID. The engineBoots
+ *	and the current engineTime are taken for sessions which use
+ *	the cached engineID.
+ *
+ * Results:
+ *	1 if the session has been updated from the cache, 0 otherwise.
+ *
+ * Side effects:
+ *	The engine parameters and the keys of the session may change.
+ *
+ *----------------------------------------------------------------------
+ */
+
+int
+TnmSnmpEngineLookup(TnmSnmp *session, struct sockaddr_in *addr)
+{
+    EngineCacheKey cacheKey;
+    EngineCacheEntry cache;
+    Tcl_HashEntry *entryPtr = NULL;
+    char *engineID;
+    int engineIDLength;
+
+    MakeEngineKey(&cacheKey, addr);
+
+    Tcl_MutexLock(&engineMutex);
+    if (engineCacheInitialized) {
+	entryPtr = Tcl_FindHashEntry(&engineCache, (char *) &cacheKey);
+	if (entryPtr) {
+	    cache = *(EngineCacheEntry *) Tcl_GetHashValue(entryPtr);
 	}
-	MD5AuthOutMsg(keyBytes, msg, msgLen, msgAuthenticationParameters);
-	break;
-    default:
-        Tcl_Panic("unknown authentication algorithm");
     }
+    Tcl_MutexUnlock(&engineMutex);
+
+    if (! entryPtr) {
+	return 0;
+    }
+
+    engineID = TnmGetOctetStringFromObj(NULL, session->engineID,
+					&engineIDLength);
+    if (engineIDLength != 0
+	&& (engineIDLength != cache.engineIDLength
+	    || memcmp(engineID, cache.engineID, (size_t) engineIDLength))) {
+	return 0;
+    }
+
+    (void) TnmSnmpSetEngine(session, cache.engineID, cache.engineIDLength,
+			    cache.engineBoots, cache.engineTime
+			    + (int) (time((time_t *) NULL) - cache.learned));
+    return 1;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * TnmSnmpSetEngine --
+ *
+ *	This procedure sets the parameters of the authoritative
+ *	engine used by a session. The keys are localized again if
+ *	the engineID changes.
+ *
+ * Results:
+ *	1 if messages encoded with the old parameters would be
+ *	rejected by the engine, that is if the engineID or the
+ *	engineBoots changed or the engineTime moved out of the
+ *	time window (RFC 3414 section 3.2 step 7), 0 otherwise.
+ *
+ * Side effects:
+ *	The engine parameters and the keys of the session may change.
+ *
+ *----------------------------------------------------------------------
+ */
+
+int
+TnmSnmpSetEngine(TnmSnmp *session, char *engineID, int engineIDLength, int engineBoots, int engineTime)
+{
+    char *oldEngineID;
+    int oldEngineIDLength, stale = 0;
+
+    oldEngineID = TnmGetOctetStringFromObj(NULL, session->engineID,
+					   &oldEngineIDLength);
+    if (oldEngineIDLength != engineIDLength
+	|| memcmp(oldEngineID, engineID, (size_t) engineIDLength) != 0) {
+	Tcl_DecrRefCount(session->engineID);
+	session->engineID = TnmNewOctetStringObj(engineID, engineIDLength);
+	Tcl_IncrRefCount(session->engineID);
+	TnmSnmpComputeKeys(session);
+	stale = 1;
+    }
+
+    if (session->engineBoots != engineBoots
+	|| session->engineTime < engineTime - 150
+	|| session->engineTime > engineTime + 150) {
+	stale = 1;
+    }
+    session->engineBoots = engineBoots;
+    session->engineTime = engineTime;
+
+    return stale;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * TnmSnmpEngineList --
+ *
+ *	This procedure returns the contents of the engine cache. Each
+ *	element is a list with the address, the port, the engineID,
+ *	the engineBoots and the current engineTime of an engine.
+ *
+ * Results:
+ *	A pointer to a new Tcl list object.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+Tcl_Obj*
+TnmSnmpEngineList(void)
+{
+    Tcl_Obj *listPtr, *elemPtr;
+    Tcl_HashEntry *entryPtr;
+    Tcl_HashSearch search;
+    time_t now = time((time_t *) NULL);
+
+    listPtr = Tcl_NewListObj(0, NULL);
+
+    Tcl_MutexLock(&engineMutex);
+    if (engineCacheInitialized) {
+	for (entryPtr = Tcl_FirstHashEntry(&engineCache, &search);
+	     entryPtr; entryPtr = Tcl_NextHashEntry(&search)) {
+	    EngineCacheKey *keyPtr = (EngineCacheKey *)
+		Tcl_GetHashKey(&engineCache, entryPtr);
+	    EngineCacheEntry *cachePtr = (EngineCacheEntry *)
+		Tcl_GetHashValue(entryPtr);
+	    struct in_addr addr;
+
+	    addr.s_addr = keyPtr->addr;
+	    elemPtr = Tcl_NewListObj(0, NULL);
+	    Tcl_ListObjAppendElement(NULL, elemPtr,
+				     Tcl_NewStringObj(inet_ntoa(addr), -1));
+	    Tcl_ListObjAppendElement(NULL, elemPtr,
+		     Tcl_NewIntObj((int) ntohs((unsigned short) keyPtr->port)));
+	    Tcl_ListObjAppendElement(NULL, elemPtr,
+		     TnmNewOctetStringObj(cachePtr->engineID,
+					  cachePtr->engineIDLength));
+	    Tcl_ListObjAppendElement(NULL, elemPtr,
+				     Tcl_NewIntObj(cachePtr->engineBoots));
+	    Tcl_ListObjAppendElement(NULL, elemPtr,
+		     Tcl_NewIntObj(cachePtr->engineTime
+				   + (int) (now - cachePtr->learned)));
+	    Tcl_ListObjAppendElement(NULL, listPtr, elemPtr);
+	}
+    }
+    Tcl_MutexUnlock(&engineMutex);
+
+    return listPtr;
 }
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * TnmSnmpEngineClear --
+ *
+ *	This procedure removes all engines from the engine cache.
+ *	Sessions keep the engine parameters they already use.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	Memory is freed.
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+TnmSnmpEngineClear(void)
+{
+    Tcl_HashEntry *entryPtr;
+    Tcl_HashSearch search;
 
+    Tcl_MutexLock(&engineMutex);
+    if (engineCacheInitialized) {
+	for (entryPtr = Tcl_FirstHashEntry(&engineCache, &search);
+	     entryPtr; entryPtr = Tcl_NextHashEntry(&search)) {
+	    ckfree((char *) Tcl_GetHashValue(entryPtr));
+	}
+	Tcl_DeleteHashTable(&engineCache);
+	Tcl_InitHashTable(&engineCache,
+			  sizeof(EngineCacheKey) / sizeof(int));
+    }
+    Tcl_MutexUnlock(&engineMutex);
+}
@@ -31,10 +31,30 @@
 extern int hexdump;
 
 /*
- * The queue of active and waiting asynchronous requests.
+ * The table of active and waiting asynchronous requests, indexed
+ * by the request identifier. The requests themselves are kept in
+ * per session FIFO queues (see TnmSnmp). Sessions with waiting
+ * requests are linked into the ready list so that a free slot in
+ * the global window can be handed to the next waiting request
+ * without scanning all outstanding requests.
  */
 
-static TnmSnmpRequest *queueHead = NULL;
+static Tcl_HashTable *requestTable = NULL;
+static TnmSnmp *readyHead = NULL;
+static TnmSnmp *readyTail = NULL;
+static int activeRequests = 0;
+
+/*
+ * Waiting requests which can not be sent because of the token
+ * buckets of their session or the global token bucket stay in the
+ * wait queue. A Tcl timer processes the queue again once the first
+ * of these requests may be sent.
+ */
+
+static Tcl_TimerToken paceToken = NULL;
+static Tcl_WideInt paceWakeup = 0;
+
+#define RequestKey(id)	((char *) INT2PTR(id))
 
 /*
  * The following tables are used to map SNMP version numbers,
@@ -162,6 +182,29 @@ SessionDestroyProc	(char *memPtr);
 static void
 RequestDestroyProc	(char *memPtr);
 
+static void
+AppendRequest		(TnmSnmpRequest **headPtr,
+			     TnmSnmpRequest **tailPtr,
+			     TnmSnmpRequest *request);
+static void
+UnlinkRequest		(TnmSnmpRequest **headPtr,
+			     TnmSnmpRequest **tailPtr,
+			     TnmSnmpRequest *request);
+static void
+ReadyInsert		(TnmSnmp *session);
+
+static void
+ReadyRemove		(TnmSnmp *session);
+
+static int
+ActivateRequest		(TnmSnmp *session, int window);
+
+static void
+PaceSchedule		(int ms);
+
+static void
+PaceProc		(ClientData clientData);
+
 #ifdef TNM_SNMPv2U
 static int
 FindAuthKey		(TnmSnmp *session);
@@ -213,6 +256,10 @@ SessionDestroyProc(char *memPtr)
     if (session->usmPrivKey) {
 	Tcl_DecrRefCount(session->usmPrivKey);
     }
+#ifdef TNM_SNMPv3
+    TnmSnmpHmacFree(session);
+    TnmSnmpCipherFree(session);
+#endif
     if (session->authPassWord) {
 	Tcl_DecrRefCount(session->authPassWord);
     }
@@ -222,6 +269,10 @@ SessionDestroyProc(char *memPtr)
     if (session->tagList) {
 	Tcl_DecrRefCount(session->tagList);
     }
+    if (session->targets) {
+	Tcl_DecrRefCount(session->targets);
+    }
+    TnmSnmpRateFree(session);
     
     while (session->bindPtr) {
 	TnmSnmpBinding *bindPtr = session->bindPtr;	
@@ -236,6 +287,7 @@ SessionDestroyProc(char *memPtr)
 	TnmSnmpListenerClose(session);
     }
     if (session->type == TNM_SNMP_RESPONDER) {
+	TnmSnmpAgentCacheClear(session);
 	TnmSnmpResponderClose(session);
     }
     
@@ -265,8 +317,279 @@ RequestDestroyProc(char *memPtr)
 {
     TnmSnmpRequest *request = (TnmSnmpRequest *) memPtr;
 
+#ifdef TNM_SNMPv3
+    if (request->pdu) {
+	TnmSnmpPduSetVarBinds(request->pdu, NULL);
+	ckfree((char *) request->pdu);
+    }
+    if (request->buffer) {
+	ckfree((char *) request->buffer);
+    }
+#endif
     ckfree((char *) request);
 }
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * AppendRequest --
+ *
+ *	This procedure appends a request to the end of a doubly
+ *	linked request FIFO.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	The FIFO is modified.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+AppendRequest(TnmSnmpRequest **headPtr, TnmSnmpRequest **tailPtr, TnmSnmpRequest *request)
+{
+    request->nextPtr = NULL;
+    request->prevPtr = *tailPtr;
+    if (*tailPtr) {
+	(*tailPtr)->nextPtr = request;
+    } else {
+	*headPtr = request;
+    }
+    *tailPtr = request;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * UnlinkRequest --
+ *
+ *	This procedure removes a request from a doubly linked
+ *	request FIFO.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	The FIFO is modified.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+UnlinkRequest(TnmSnmpRequest **headPtr, TnmSnmpRequest **tailPtr, TnmSnmpRequest *request)
+{
+    if (request->prevPtr) {
+	request->prevPtr->nextPtr = request->nextPtr;
+    } else {
+	*headPtr = request->nextPtr;
+    }
+    if (request->nextPtr) {
+	request->nextPtr->prevPtr = request->prevPtr;
+    } else {
+	*tailPtr = request->prevPtr;
+    }
+    request->nextPtr = request->prevPtr = NULL;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * ReadyInsert --
+ *
+ *	This procedure appends a session to the list of sessions
+ *	that have waiting requests. Nothing happens if the session
+ *	is already in the list.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	The ready list is modified.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+ReadyInsert(TnmSnmp *session)
+{
+    if (session->prevReadyPtr || readyHead == session) {
+	return;
+    }
+    session->nextReadyPtr = NULL;
+    session->prevReadyPtr = readyTail;
+    if (readyTail) {
+	readyTail->nextReadyPtr = session;
+    } else {
+	readyHead = session;
+    }
+    readyTail = session;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * ReadyRemove --
+ *
+ *	This procedure removes a session from the list of sessions
+ *	that have waiting requests. Nothing happens if the session
+ *	is not in the list.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	The ready list is modified.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+ReadyRemove(TnmSnmp *session)
+{
+    if (! session->prevReadyPtr && readyHead != session) {
+	return;
+    }
+    if (session->prevReadyPtr) {
+	session->prevReadyPtr->nextReadyPtr = session->nextReadyPtr;
+    } else {
+	readyHead = session->nextReadyPtr;
+    }
+    if (session->nextReadyPtr) {
+	session->nextReadyPtr->prevReadyPtr = session->prevReadyPtr;
+    } else {
+	readyTail = session->prevReadyPtr;
+    }
+    session->nextReadyPtr = session->prevReadyPtr = NULL;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * PaceSchedule --
+ *
+ *	This procedure makes sure that the request queue is processed
+ *	again after the given number of milliseconds. An earlier
+ *	wakeup which is already scheduled is kept.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	A Tcl timer handler may be created or replaced.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+PaceSchedule(int ms)
+{
+    Tcl_Time now;
+    Tcl_WideInt wakeup;
+
+    Tcl_GetTime(&now);
+    wakeup = (Tcl_WideInt) now.sec * 1000 + now.usec / 1000 + ms;
+
+    if (paceToken) {
+	if (paceWakeup <= wakeup) {
+	    return;
+	}
+	Tcl_DeleteTimerHandler(paceToken);
+    }
+    paceWakeup = wakeup;
+    paceToken = Tcl_CreateTimerHandler(ms, PaceProc, (ClientData) NULL);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * PaceProc --
+ *
+ *	This procedure is called from the event loop when requests
+ *	held back by a token bucket may be sent.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	Requests are transmitted and retransmission timers started.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+PaceProc(ClientData clientData)
+{
+    paceToken = NULL;
+    if (readyHead) {
+	TnmSnmpQueueRequest(readyHead, NULL);
+    }
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * ActivateRequest --
+ *
+ *	This procedure moves the first waiting request of a session
+ *	into the active FIFO if the session window, the global window
+ *	and the token buckets permit. A session which still has
+ *	waiting requests afterwards is moved to the end of the ready
+ *	list, so that sessions are served round-robin and a busy
+ *	session can not starve the others. The session is removed
+ *	from the ready list once all its waiting requests have been
+ *	activated. A request held back by a token bucket is sent later
+ *	from PaceProc() instead of blocking the event loop.
+ *
+ * Results:
+ *	-1 if the global window or the global bucket is exhausted,
+ *	1 if a request was activated and 0 otherwise.
+ *
+ * Side effects:
+ *	A request is transmitted and its retransmission timer started.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+ActivateRequest(TnmSnmp *session, int window)
+{
+    TnmSnmpRequest *rPtr = session->waitHead;
+    int wait;
+
+    if (! rPtr) {
+	ReadyRemove(session);
+	return 0;
+    }
+    if (window && activeRequests >= window) {
+	return -1;
+    }
+    if (session->window && session->active >= session->window) {
+	return 0;
+    }
+    wait = TnmSnmpBucketWait(&tnmSnmpBucket, rPtr->packetlen);
+    if (wait) {
+	PaceSchedule(wait);
+	return -1;
+    }
+    wait = TnmSnmpBucketWait(&session->bucket, rPtr->packetlen);
+    if (wait) {
+	PaceSchedule(wait);
+	return 0;
+    }
+
+    UnlinkRequest(&session->waitHead, &session->waitTail, rPtr);
+    AppendRequest(&session->activeHead, &session->activeTail, rPtr);
+    session->waiting--;
+    session->active++;
+    activeRequests++;
+    ReadyRemove(session);
+    if (session->waitHead) {
+	ReadyInsert(session);
+    }
+    TnmSnmpTimeoutProc((ClientData) rPtr);
+    return 1;
+}
 #ifdef TNM_SNMPv2U
 
 /*
@@ -614,7 +937,9 @@ TnmSnmpEvalCallback(Tcl_Interp *interp, TnmSnmp *session, TnmSnmpPdu *pdu, char
 	    }
 	    break;
 	  case 'V':
-	    Tcl_DStringAppend(&tclCmd, Tcl_DStringValue(&pdu->varbind), -1);
+	    if (pdu->vbList) {
+		Tcl_DStringAppend(&tclCmd, Tcl_GetString(pdu->vbList), -1);
+	    }
 	    break;
 	  case 'E':
 	    name = TnmGetTableValue(tnmSnmpErrorTable, (unsigned) pdu->errorStatus);
@@ -805,7 +1130,8 @@ TnmSnmpDumpPDU(Tcl_Interp *interp, TnmSnmpPdu *pdu)
 
 	Tcl_DStringAppend(&dst, buffer, -1);
 
-	code = Tcl_SplitList(interp, Tcl_DStringValue(&pdu->varbind), 
+	code = Tcl_SplitList(interp, 
+			     pdu->vbList ? Tcl_GetString(pdu->vbList) : "",
 			     &argc, &argv);
 	if (code == TCL_OK) {
 	    for (i = 0; i < argc; i++) {
@@ -938,7 +1264,7 @@ TnmSnmpCreateSession(Tcl_Interp *interp, char type)
     session->retries = TNM_SNMP_RETRIES;
     session->timeout = TNM_SNMP_TIMEOUT;
     session->window  = TNM_SNMP_WINDOW;
-    session->delay   = TNM_SNMP_DELAY;
+    session->bucket.delay = TNM_SNMP_DELAY;
     session->tagList = Tcl_NewListObj(0, NULL);
     Tcl_IncrRefCount(session->tagList);
 
@@ -968,23 +1294,41 @@ TnmSnmpCreateSession(Tcl_Interp *interp, char type)
 void
 TnmSnmpDeleteSession(TnmSnmp *session)
 {
-    TnmSnmpRequest **rPtrPtr;
+    TnmSnmpRequest *request;
+    Tcl_HashEntry *entryPtr;
+    int active;
 
     if (! session) return;
 
-    rPtrPtr = &queueHead;
-    while (*rPtrPtr) {
-	if ((*rPtrPtr)->session == session) {
-	    TnmSnmpRequest *request = *rPtrPtr;
-	    *rPtrPtr = (*rPtrPtr)->nextPtr;
-	    if (request->timer) {
-	        Tcl_DeleteTimerHandler(request->timer);
+    /*
+     * Discard all active and waiting requests of this session.
+     * Waiting requests are not activated again because the session
+     * which defines the global window is going away.
+     */
+
+    for (active = 1; active >= 0; active--) {
+	while ((request = active ? session->activeHead : session->waitHead)) {
+	    if (active) {
+		UnlinkRequest(&session->activeHead, &session->activeTail,
+			      request);
+		activeRequests--;
+	    } else {
+		UnlinkRequest(&session->waitHead, &session->waitTail,
+			      request);
 	    }
+	    entryPtr = Tcl_FindHashEntry(requestTable, RequestKey(request->id));
+	    if (entryPtr && Tcl_GetHashValue(entryPtr) == (ClientData) request) {
+		Tcl_DeleteHashEntry(entryPtr);
+	    }
+	    request->queued = 0;
+	    TnmSnmpStopTimer(request);
 	    Tcl_EventuallyFree((ClientData) request, RequestDestroyProc);
-	} else {
-	    rPtrPtr = &(*rPtrPtr)->nextPtr;
 	}
     }
+    session->active = session->waiting = 0;
+    ReadyRemove(session);
+    TnmSnmpPollCancel(session);
+    TnmSnmpWalkCancel(session);
 
     Tcl_EventuallyFree((ClientData) session, SessionDestroyProc);
 }
@@ -1036,13 +1380,12 @@ TnmSnmpCreateRequest(int id, u_char *packet, int packetlen, TnmSnmpRequestProc *
  *
  * TnmSnmpFindRequest --
  *
- *	This procedure scans through the request lists of all open
- *	sessions and tries to find the request for a given request
- *	id.
+ *	This procedure looks up the request for a given request id
+ *	in the table of outstanding requests.
  *
  * Results:
  *	A pointer to the request structure or NULL if the request
- *	id is not in the request list.
+ *	id is not in the request table.
  *
  * Side effects:
  *	None.
@@ -1053,12 +1396,13 @@ TnmSnmpCreateRequest(int id, u_char *packet, int packetlen, TnmSnmpRequestProc *
 TnmSnmpRequest*
 TnmSnmpFindRequest(int id)
 {
-    TnmSnmpRequest *rPtr;
+    Tcl_HashEntry *entryPtr;
 
-    for (rPtr = queueHead; rPtr; rPtr = rPtr->nextPtr) {
-        if (rPtr->id == id) break;
+    if (! requestTable) {
+	return NULL;
     }
-    return rPtr;
+    entryPtr = Tcl_FindHashEntry(requestTable, RequestKey(id));
+    return entryPtr ? (TnmSnmpRequest *) Tcl_GetHashValue(entryPtr) : NULL;
 }
 
 /*
@@ -1081,6 +1425,12 @@ TnmSnmpFindRequest(int id)
  *	sending one request. If the parameter which specifies the
  *	new request is NULL, only queue processing will take place.
  *
+ *	Waiting requests are kept in a FIFO per session. Sessions with
+ *	waiting requests are served round-robin, one request per session
+ *	and round, starting with the session which waited longest. The
+ *	costs of this procedure do therefore not depend on the total
+ *	number of outstanding requests.
+ *
  * Results:
  *	The number of requests queued for this SNMP session.
  *
@@ -1093,38 +1443,33 @@ TnmSnmpFindRequest(int id)
 int
 TnmSnmpQueueRequest(TnmSnmp *session, TnmSnmpRequest *request)
 {
-    int waiting = 0, active = 0;
-    TnmSnmpRequest *rPtr, *lastPtr = NULL;
+    TnmSnmp *sPtr, *nextPtr, *lastPtr;
+    int code, progress;
 
     /*
-     * Walk through the queue and count active and waiting requests.
-     * Keep a pointer to the last request in the queue.
+     * Append the new request (if we have one) to the wait queue
+     * of the session and enter it into the request table. A
+     * request id which is already in use is shadowed so that
+     * responses are matched against the most recent request.
      */
 
-    for (rPtr = queueHead; rPtr; rPtr = rPtr->nextPtr) {
-	if (rPtr->sends) {
-	    active++;
-	} else {
-	    waiting++;
-	}
-	if (request) {
-	    lastPtr = rPtr;
-	}
-    }
+    if (request) {
+	Tcl_HashEntry *entryPtr;
+	int isNew;
 
-    /*
-     * Append the new request (if we have one).
-     */
+	if (! requestTable) {
+	    requestTable = (Tcl_HashTable *) ckalloc(sizeof(Tcl_HashTable));
+	    Tcl_InitHashTable(requestTable, TCL_ONE_WORD_KEYS);
+	}
+	entryPtr = Tcl_CreateHashEntry(requestTable,
+				       RequestKey(request->id), &isNew);
+	Tcl_SetHashValue(entryPtr, (ClientData) request);
 
-    if (request) {
 	request->session = session;
+	request->queued = 1;
+	AppendRequest(&session->waitHead, &session->waitTail, request);
 	session->waiting++;
-	waiting++;
-	if (! queueHead) {
-	    queueHead = request;
-	} else {
-	    lastPtr->nextPtr = request;
-	}
+	ReadyInsert(session);
     }
 
     /*
@@ -1133,17 +1478,19 @@ TnmSnmpQueueRequest(TnmSnmp *session, TnmSnmpRequest *request)
      * window of the current session.
      */
 
-    for (rPtr = queueHead; rPtr && waiting; rPtr = rPtr->nextPtr) {
-        if (session->window && active >= session->window) break;
-	if (! rPtr->sends && (rPtr->session->active < rPtr->session->window 
-			      || rPtr->session->window == 0)) {
-	    TnmSnmpTimeoutProc((ClientData) rPtr);
-	    active++;
-	    waiting--;
-	    rPtr->session->active++;
-	    rPtr->session->waiting--;
+    do {
+	progress = 0;
+	lastPtr = readyTail;
+	for (sPtr = readyHead; sPtr; sPtr = nextPtr) {
+	    nextPtr = (sPtr == lastPtr) ? NULL : sPtr->nextReadyPtr;
+	    code = ActivateRequest(sPtr, session->window);
+	    if (code < 0) {
+		progress = 0;
+		break;
+	    }
+	    progress |= code;
 	}
-    }
+    } while (progress);
 
     return (session->active + session->waiting);
 }
@@ -1169,64 +1516,50 @@ TnmSnmpQueueRequest(TnmSnmp *session, TnmSnmpRequest *request)
 void
 TnmSnmpDeleteRequest(TnmSnmpRequest *request)
 {
-    TnmSnmpRequest *rPtr, **rPtrPtr;
-    TnmSnmp *session;
+    TnmSnmp *session = request->session;
+    Tcl_HashEntry *entryPtr;
 
     /*
-     * Check whether the request still exists. It may have been
+     * Check whether the request is still queued. It may have been
      * removed because the session for this request has been 
      * destroyed during callback processing.
      */
 
-    for (rPtr = queueHead; rPtr; rPtr = rPtr->nextPtr) {
-	if (rPtr == request) break;
-    }
-    if (! rPtr) return;
+    if (! request->queued) return;
     
-    /* 
-     * Check whether the session is still in the session list.
-     * We sometimes get called when the session has already been
-     * destroyed as a side effect of evaluating callbacks.
+    /*
+     * Remove the request from the session queues and from the
+     * request table and free the resources allocated for this
+     * request.
      */
-    
-    for (session = tnmSnmpList; session; session = session->nextPtr) {
-	if (session == request->session) break;
-    }
 
-    if (session) {
-	if (request->sends) {
-	    session->active--;
-	} else {
-	    session->waiting--;
+    if (request->sends) {
+	UnlinkRequest(&session->activeHead, &session->activeTail, request);
+	session->active--;
+	activeRequests--;
+    } else {
+	UnlinkRequest(&session->waitHead, &session->waitTail, request);
+	session->waiting--;
+	if (! session->waitHead) {
+	    ReadyRemove(session);
 	}
     }
-    
-    /*
-     * Remove the request from the list of outstanding requests.
-     * and free the resources allocated for this request.
-     */
+    request->queued = 0;
 
-    rPtrPtr = &queueHead;
-    while (*rPtrPtr && *rPtrPtr != request) {
-	rPtrPtr = &(*rPtrPtr)->nextPtr;
-    }
-    if (*rPtrPtr) {
-	*rPtrPtr = request->nextPtr;
-	if (request->timer) {
-	    Tcl_DeleteTimerHandler(request->timer);
-	    request->timer = NULL;
-	}
-	Tcl_EventuallyFree((ClientData) request, RequestDestroyProc);
+    entryPtr = Tcl_FindHashEntry(requestTable, RequestKey(request->id));
+    if (entryPtr && Tcl_GetHashValue(entryPtr) == (ClientData) request) {
+	Tcl_DeleteHashEntry(entryPtr);
     }
 
+    TnmSnmpStopTimer(request);
+    Tcl_EventuallyFree((ClientData) request, RequestDestroyProc);
+
     /*
      * Update the request queue. This will activate async requests
      * that have been queued because of the window size.
      */
      
-    if (session) {
-	TnmSnmpQueueRequest(session, NULL);
-    }
+    TnmSnmpQueueRequest(session, NULL);
 }
 
 /*
@@ -1249,14 +1582,10 @@ int
 TnmSnmpGetRequestId()
 {
     int id;
-    TnmSnmpRequest *rPtr = queueHead;
 
     do {
 	id = rand();
-	for (rPtr = queueHead; rPtr && rPtr->id != id; rPtr = rPtr->nextPtr) {
-	    /* empty body */
-	}
-    } while (rPtr);
+    } while (TnmSnmpFindRequest(id));
 
     return id;
 }
@@ -0,0 +1,1229 @@
+/*
+ * tnmSnmpVarBind.c --
+ *
+ *	This file implements the binary representation of SNMP
+ *	varbind lists and the tnmVarBindList Tcl object type which
+ *	wraps them. Decoded PDUs keep their values in binary form
+ *	and the Tcl list representation is only created when a Tcl
+ *	script actually looks at the varbind list.
+ *
+ * See the file "license.terms" for information on usage and redistribution
+ * of this file, and for a DISCLAIMER OF ALL WARRANTIES.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "tnmSnmp.h"
+#include "tnmMib.h"
+
+/*
+ * Forward declarations for procedures defined later in this file:
+ */
+
+static int
+ReserveBuffer		(TnmSnmpVarBindList *vblPtr, int size);
+
+static int
+HasData			(int syntax);
+
+static unsigned int
+HashBytes		(unsigned int hash, const void *bytes,
+			 size_t length);
+
+static Tcl_Obj*
+FormatValue		(TnmSnmpVarBindList *vblPtr,
+			 TnmSnmpVarBind *vbPtr, char *soid);
+static void
+DupVarBindListInternalRep (Tcl_Obj *srcPtr, Tcl_Obj *copyPtr);
+
+static void
+FreeVarBindListInternalRep (Tcl_Obj *objPtr);
+
+static void
+UpdateStringOfVarBindList (Tcl_Obj *objPtr);
+
+/*
+ * Varbind lists which are not used anymore are kept on a small
+ * free list, together with any buffers they have grown. This
+ * allows the decoder to process a stream of PDUs without calling
+ * the memory allocator once the buffers have reached their final
+ * size. Buffers which grew beyond KEEP_BUFFER bytes are released.
+ */
+
+#define FREE_LISTS	8
+#define KEEP_BUFFER	16384
+
+static TnmSnmpVarBindList *freeLists[FREE_LISTS];
+static int numFreeLists = 0;
+
+TCL_DECLARE_MUTEX(freeListMutex)
+
+/*
+ * The structure below defines the tnmVarBindList object type by
+ * means of procedures that can be invoked by generic object code.
+ * There is no setFromAnyProc since the conversion of a Tcl list
+ * depends on the PDU type. See TnmSnmpGetVarBindListFromObj().
+ */
+
+Tcl_ObjType tnmVarBindListType = {
+    "tnmVarBindList",			/* name of the type */
+    FreeVarBindListInternalRep,		/* freeIntRepProc */
+    DupVarBindListInternalRep,		/* dupIntRepProc */
+    UpdateStringOfVarBindList,		/* updateStringProc */
+    NULL				/* setFromAnyProc */
+};
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * TnmSnmpNewVarBindList --
+ *
+ *	This procedure returns a new empty varbind list. Lists are
+ *	taken from the free list if possible. The reference count of
+ *	the new list is 0.
+ *
+ * Results:
+ *	A pointer to the new varbind list.
+ *
+ * Side effects:
+ *	Memory may be allocated.
+ *
+ *----------------------------------------------------------------------
+ */
+
+TnmSnmpVarBindList*
+TnmSnmpNewVarBindList(void)
+{
+    TnmSnmpVarBindList *vblPtr = NULL;
+
+    Tcl_MutexLock(&freeListMutex);
+    if (numFreeLists > 0) {
+	vblPtr = freeLists[--numFreeLists];
+    }
+    Tcl_MutexUnlock(&freeListMutex);
+
+    if (! vblPtr) {
+	vblPtr = (TnmSnmpVarBindList *) ckalloc(sizeof(TnmSnmpVarBindList));
+	vblPtr->maxVarBinds = TNM_SNMP_STATIC_VARBINDS;
+	vblPtr->varBinds = vblPtr->staticVarBinds;
+	vblPtr->bufferSize = TNM_SNMP_STATIC_BUFFER;
+	vblPtr->buffer = vblPtr->staticBuffer;
+    }
+    vblPtr->refCount = 0;
+    vblPtr->numVarBinds = 0;
+    vblPtr->bufferLength = 0;
+    return vblPtr;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * TnmSnmpReleaseVarBindList --
+ *
+ *	This procedure decrements the reference count of a varbind
+ *	list. Lists which are not used anymore are put on the free
+ *	list or freed if the free list is full.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	Memory may be freed.
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+TnmSnmpReleaseVarBindList(TnmSnmpVarBindList *vblPtr)
+{
+    if (--vblPtr->refCount > 0) {
+	return;
+    }
+
+    if (vblPtr->bufferSize > KEEP_BUFFER) {
+	ckfree(vblPtr->buffer);
+	vblPtr->bufferSize = TNM_SNMP_STATIC_BUFFER;
+	vblPtr->buffer = vblPtr->staticBuffer;
+    }
+    if (vblPtr->maxVarBinds * sizeof(TnmSnmpVarBind) > KEEP_BUFFER) {
+	ckfree((char *) vblPtr->varBinds);
+	vblPtr->maxVarBinds = TNM_SNMP_STATIC_VARBINDS;
+	vblPtr->varBinds = vblPtr->staticVarBinds;
+    }
+
+    Tcl_MutexLock(&freeListMutex);
+    if (numFreeLists < FREE_LISTS) {
+	freeLists[numFreeLists++] = vblPtr;
+	vblPtr = NULL;
+    }
+    Tcl_MutexUnlock(&freeListMutex);
+
+    if (vblPtr) {
+	if (vblPtr->varBinds != vblPtr->staticVarBinds) {
+	    ckfree((char *) vblPtr->varBinds);
+	}
+	if (vblPtr->buffer != vblPtr->staticBuffer) {
+	    ckfree(vblPtr->buffer);
+	}
+	ckfree((char *) vblPtr);
+    }
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * ReserveBuffer --
+ *
+ *	This procedure reserves space in the buffer of a varbind
+ *	list. The space is aligned so that it can hold object
+ *	identifier sub-identifiers.
+ *
+ * Results:
+ *	The offset of the reserved space in the buffer.
+ *
+ * Side effects:
+ *	The buffer may be reallocated.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+ReserveBuffer(TnmSnmpVarBindList *vblPtr, int size)
+{
+    int offset;
+
+    offset = (vblPtr->bufferLength + sizeof(Tnm_Oid) - 1)
+	& ~(sizeof(Tnm_Oid) - 1);
+    if (offset + size > vblPtr->bufferSize) {
+	int newSize = vblPtr->bufferSize * 2;
+	char *newBuffer;
+	while (offset + size > newSize) {
+	    newSize *= 2;
+	}
+	if (vblPtr->buffer == vblPtr->staticBuffer) {
+	    newBuffer = ckalloc(newSize);
+	    memcpy(newBuffer, vblPtr->buffer, vblPtr->bufferLength);
+	} else {
+	    newBuffer = ckrealloc(vblPtr->buffer, newSize);
+	}
+	vblPtr->buffer = newBuffer;
+	vblPtr->bufferSize = newSize;
+    }
+    vblPtr->bufferLength = offset + size;
+    return offset;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HasData --
+ *
+ *	This procedure checks whether values of the given syntax
+ *	are stored in the buffer of a varbind list.
+ *
+ * Results:
+ *	1 if the value lives in the buffer, 0 otherwise.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+HasData(int syntax)
+{
+    switch (syntax) {
+    case ASN1_OCTET_STRING:
+    case ASN1_IPADDRESS:
+    case ASN1_OPAQUE:
+    case ASN1_OBJECT_IDENTIFIER:
+	return 1;
+    }
+    return 0;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * TnmSnmpAddVarBind --
+ *
+ *	This procedure appends a new varbind to a varbind list. The
+ *	value of the new varbind is cleared.
+ *
+ * Results:
+ *	A pointer to the new varbind. The pointer is only valid
+ *	until the next varbind is added to the list.
+ *
+ * Side effects:
+ *	Memory may be allocated.
+ *
+ *----------------------------------------------------------------------
+ */
+
+TnmSnmpVarBind*
+TnmSnmpAddVarBind(TnmSnmpVarBindList *vblPtr, Tnm_Oid *oid, int oidLength, int syntax)
+{
+    TnmSnmpVarBind *vbPtr;
+    int offset;
+
+    if (vblPtr->numVarBinds == vblPtr->maxVarBinds) {
+	int newMax = vblPtr->maxVarBinds * 2;
+	if (vblPtr->varBinds == vblPtr->staticVarBinds) {
+	    vblPtr->varBinds = (TnmSnmpVarBind *)
+		ckalloc(newMax * sizeof(TnmSnmpVarBind));
+	    memcpy((char *) vblPtr->varBinds, (char *) vblPtr->staticVarBinds,
+		   vblPtr->numVarBinds * sizeof(TnmSnmpVarBind));
+	} else {
+	    vblPtr->varBinds = (TnmSnmpVarBind *)
+		ckrealloc((char *) vblPtr->varBinds,
+			  newMax * sizeof(TnmSnmpVarBind));
+	}
+	vblPtr->maxVarBinds = newMax;
+    }
+
+    offset = ReserveBuffer(vblPtr, oidLength * sizeof(Tnm_Oid));
+    memcpy(vblPtr->buffer + offset, (char *) oid,
+	   oidLength * sizeof(Tnm_Oid));
+
+    vbPtr = vblPtr->varBinds + vblPtr->numVarBinds++;
+    memset((char *) vbPtr, 0, sizeof(TnmSnmpVarBind));
+    vbPtr->oidOffset = offset;
+    vbPtr->oidLength = oidLength;
+    vbPtr->syntax = syntax;
+    return vbPtr;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * TnmSnmpSetVarBindData --
+ *
+ *	This procedure copies an octet string value into the buffer
+ *	of a varbind list.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	The buffer may be reallocated.
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+TnmSnmpSetVarBindData(TnmSnmpVarBindList *vblPtr, TnmSnmpVarBind *vbPtr, const char *bytes, int length)
+{
+    vbPtr->value.data.offset = ReserveBuffer(vblPtr, length);
+    vbPtr->value.data.length = length;
+    if (length > 0) {
+	memcpy(TnmSnmpVarBindData(vblPtr, vbPtr), bytes, length);
+    }
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * TnmSnmpSetVarBindOid --
+ *
+ *	This procedure copies an object identifier value into the
+ *	buffer of a varbind list.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	The buffer may be reallocated.
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+TnmSnmpSetVarBindOid(TnmSnmpVarBindList *vblPtr, TnmSnmpVarBind *vbPtr, Tnm_Oid *oid, int oidLength)
+{
+    TnmSnmpSetVarBindData(vblPtr, vbPtr, (char *) oid,
+			  oidLength * sizeof(Tnm_Oid));
+    vbPtr->value.data.length = oidLength;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * TnmSnmpScanVarBindValue --
+ *
+ *	This procedure converts the string representation of a value
+ *	into the binary representation according to the syntax of the
+ *	varbind. Textual conventions and enumerations are resolved
+ *	by using the MIB definition of the given name.
+ *
+ * Results:
+ *	A standard Tcl result.
+ *
+ * Side effects:
+ *	The buffer of the varbind list may be reallocated.
+ *
+ *----------------------------------------------------------------------
+ */
+
+int
+TnmSnmpScanVarBindValue(Tcl_Interp *interp, TnmSnmpVarBindList *vblPtr, TnmSnmpVarBind *vbPtr, const char *name, const char *value)
+{
+    char string[64];
+
+    switch (vbPtr->syntax) {
+    case ASN1_INTEGER:
+    case ASN1_COUNTER32:
+    case ASN1_GAUGE32:
+    case ASN1_TIMETICKS: {
+	int int_val, rc;
+	rc = Tcl_GetInt(interp, value, &int_val);
+	if (rc != TCL_OK) {
+	    char *tmp = TnmMibScan(name, 0, value);
+	    if (tmp && *tmp) {
+		Tcl_ResetResult(interp);
+		rc = Tcl_GetInt(interp, tmp, &int_val);
+	    }
+	    if (rc != TCL_OK) return TCL_ERROR;
+	}
+	vbPtr->value.intValue = int_val;
+	break;
+    }
+    case ASN1_COUNTER64: {
+	Tcl_Obj *objPtr = Tcl_NewStringObj(value, -1);
+	int rc;
+	Tcl_IncrRefCount(objPtr);
+	rc = TnmGetUnsigned64FromObj(interp, objPtr, &vbPtr->value.u64Value);
+	Tcl_DecrRefCount(objPtr);
+	if (rc != TCL_OK) {
+	    return TCL_ERROR;
+	}
+	break;
+    }
+    case ASN1_IPADDRESS: {
+	int a, b, c, d, addr = inet_addr(value);
+	int cnt = sscanf(value, "%d.%d.%d.%d", &a, &b, &c, &d);
+	if ((addr == -1 && strcmp(value, "255.255.255.255") != 0)
+	    || (cnt != 4)) {
+	    Tcl_SetResult(interp, "invalid IP address", TCL_STATIC);
+	    return TCL_ERROR;
+	}
+	TnmSnmpSetVarBindData(vblPtr, vbPtr, (char *) &addr, 4);
+	break;
+    }
+    case ASN1_OCTET_STRING:
+    case ASN1_OPAQUE: {
+	const char *hex = value;
+	int len = 0;
+
+	/*
+	 * Decode the hex string directly into the buffer. The
+	 * reserved space is trimmed to the decoded length.
+	 */
+
+	if (vbPtr->syntax == ASN1_OCTET_STRING && value[0]) {
+	    const char *scan = TnmMibScan(name, 0, value);
+	    if (scan) hex = scan;
+	}
+	len = strlen(hex);
+	vbPtr->value.data.offset = ReserveBuffer(vblPtr, len + 1);
+	if (*hex) {
+	    if (TnmHexDec(hex, TnmSnmpVarBindData(vblPtr, vbPtr), &len) < 0) {
+		Tcl_SetResult(interp, vbPtr->syntax == ASN1_OPAQUE
+			      ? "illegal Opaque value"
+			      : "illegal OCTET STRING value", TCL_STATIC);
+		return TCL_ERROR;
+	    }
+	}
+	vbPtr->value.data.length = len;
+	vblPtr->bufferLength = vbPtr->value.data.offset + len;
+	break;
+    }
+    case ASN1_OBJECT_IDENTIFIER: {
+	Tnm_Oid *oid;
+	int oidlen;
+	oid = TnmStrToOid(value, &oidlen);
+	if (! oid) {
+	    char *tmp = TnmMibGetOid(value);
+	    if (tmp) {
+		oid = TnmStrToOid(tmp, &oidlen);
+	    }
+	}
+	if (! oid) {
+	    Tcl_AppendResult(interp, "illegal object identifier \"",
+			     value, "\"", (char *) NULL);
+	    return TCL_ERROR;
+	}
+	TnmSnmpSetVarBindOid(vblPtr, vbPtr, oid, oidlen);
+	break;
+    }
+    case ASN1_NO_SUCH_OBJECT:
+    case ASN1_NO_SUCH_INSTANCE:
+    case ASN1_END_OF_MIB_VIEW:
+    case ASN1_NULL:
+	break;
+    default:
+	sprintf(string, "unknown asn1 type 0x%.2x", vbPtr->syntax);
+	Tcl_SetResult(interp, string, TCL_VOLATILE);
+	return TCL_ERROR;
+    }
+
+    return TCL_OK;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * TnmSnmpGetVarBindName --
+ *
+ *	This procedure copies the name of a varbind into an object
+ *	identifier. The object identifier must be initialized.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	Memory may be allocated for the object identifier.
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+TnmSnmpGetVarBindName(TnmSnmpVarBindList *vblPtr, TnmSnmpVarBind *vbPtr, TnmOid *oidPtr)
+{
+    Tnm_Oid *oid = TnmSnmpVarBindOid(vblPtr, vbPtr);
+    int i;
+
+    TnmOidSetLength(oidPtr, vbPtr->oidLength);
+    for (i = 0; i < vbPtr->oidLength; i++) {
+	TnmOidSet(oidPtr, i, oid[i]);
+    }
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * FormatValue --
+ *
+ *	This procedure converts the binary value of a varbind into
+ *	its Tcl representation. Textual conventions and enumerations
+ *	are applied by using the MIB definition of soid.
+ *
+ * Results:
+ *	A pointer to a new Tcl_Obj with a reference count of 0.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static Tcl_Obj*
+FormatValue(TnmSnmpVarBindList *vblPtr, TnmSnmpVarBind *vbPtr, char *soid)
+{
+    static char *hex = NULL;
+    static int hexLen = 0;
+    Tcl_Obj *objPtr = NULL;
+    char buf[20];
+
+    switch (vbPtr->syntax) {
+    case ASN1_NO_SUCH_OBJECT:
+    case ASN1_NO_SUCH_INSTANCE:
+    case ASN1_END_OF_MIB_VIEW:
+	return Tcl_NewStringObj(TnmMibGetBaseSyntax(soid)
+				== ASN1_OCTET_STRING ? "" : "0", -1);
+    case ASN1_COUNTER32:
+    case ASN1_GAUGE32:
+    case ASN1_TIMETICKS:
+	return Tcl_NewWideIntObj((Tcl_WideInt)
+				 (unsigned) vbPtr->value.intValue);
+    case ASN1_INTEGER:
+	sprintf(buf, "%d", vbPtr->value.intValue);
+	objPtr = TnmMibFormat(soid, 0, buf);
+	return objPtr ? objPtr : Tcl_NewIntObj(vbPtr->value.intValue);
+    case ASN1_COUNTER64:
+	return TnmNewUnsigned64Obj(vbPtr->value.u64Value);
+    case ASN1_NULL:
+	return Tcl_NewObj();
+    case ASN1_OBJECT_IDENTIFIER: {
+	char *value = TnmOidToStr(TnmSnmpVarBindOidValue(vblPtr, vbPtr),
+				  vbPtr->value.data.length);
+	objPtr = TnmMibFormat(soid, 0, value);
+	return objPtr ? objPtr : Tcl_NewStringObj(value, -1);
+    }
+    case ASN1_IPADDRESS: {
+	struct sockaddr_in addr;
+	memcpy(&addr.sin_addr, TnmSnmpVarBindData(vblPtr, vbPtr), 4);
+	return Tcl_NewStringObj(inet_ntoa(addr.sin_addr), -1);
+    }
+    }
+
+    /*
+     * All remaining values are octet strings which are converted
+     * into the hex notation first.
+     */
+
+    if (hexLen < vbPtr->value.data.length * 5 + 1) {
+	if (hex) ckfree(hex);
+	hexLen = vbPtr->value.data.length * 5 + 1;
+	hex = ckalloc(hexLen);
+    }
+    TnmHexEnc(TnmSnmpVarBindData(vblPtr, vbPtr),
+	      vbPtr->value.data.length, hex);
+    if (vbPtr->syntax == ASN1_OCTET_STRING) {
+	objPtr = TnmMibFormat(soid, 0, hex);
+    }
+    return objPtr ? objPtr : Tcl_NewStringObj(hex, -1);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * TnmSnmpGetVarBindValue --
+ *
+ *	This procedure returns the Tcl representation of the value
+ *	of a varbind as it appears in the Tcl varbind list.
+ *
+ * Results:
+ *	A pointer to a new Tcl_Obj with a reference count of 0.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+Tcl_Obj*
+TnmSnmpGetVarBindValue(TnmSnmpVarBindList *vblPtr, TnmSnmpVarBind *vbPtr)
+{
+    Tcl_DString soid;
+    Tcl_Obj *objPtr;
+
+    Tcl_DStringInit(&soid);
+    Tcl_DStringAppend(&soid, TnmOidToStr(TnmSnmpVarBindOid(vblPtr, vbPtr),
+					 vbPtr->oidLength), -1);
+    objPtr = FormatValue(vblPtr, vbPtr, Tcl_DStringValue(&soid));
+    Tcl_DStringFree(&soid);
+    return objPtr;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * TnmSnmpGetVarBindTypedValue --
+ *
+ *	This procedure returns the value of a varbind as a typed Tcl
+ *	object. Numbers are returned as integer objects without a
+ *	string representation. Textual conventions and enumerations
+ *	of the MIB definition nodePtr are applied if nodePtr is not
+ *	NULL, which saves the MIB lookup done for every value by
+ *	TnmSnmpGetVarBindValue().
+ *
+ * Results:
+ *	A pointer to a new Tcl_Obj with a reference count of 0.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+Tcl_Obj*
+TnmSnmpGetVarBindTypedValue(TnmSnmpVarBindList *vblPtr, TnmSnmpVarBind *vbPtr, TnmMibNode *nodePtr)
+{
+    Tcl_Obj *objPtr, *fmtPtr;
+    int length;
+
+    switch (vbPtr->syntax) {
+    case ASN1_COUNTER32:
+    case ASN1_GAUGE32:
+    case ASN1_TIMETICKS:
+	return Tcl_NewWideIntObj((Tcl_WideInt)
+				 (unsigned) vbPtr->value.intValue);
+    case ASN1_COUNTER64:
+	return TnmNewUnsigned64Obj(vbPtr->value.u64Value);
+    case ASN1_INTEGER:
+	objPtr = Tcl_NewIntObj(vbPtr->value.intValue);
+	break;
+    case ASN1_OBJECT_IDENTIFIER:
+	objPtr = Tcl_NewStringObj(TnmOidToStr(TnmSnmpVarBindOidValue(vblPtr,
+		vbPtr), vbPtr->value.data.length), -1);
+	break;
+    case ASN1_IPADDRESS: {
+	struct sockaddr_in addr;
+	memcpy(&addr.sin_addr, TnmSnmpVarBindData(vblPtr, vbPtr), 4);
+	return Tcl_NewStringObj(inet_ntoa(addr.sin_addr), -1);
+    }
+    case ASN1_OCTET_STRING:
+    case ASN1_OPAQUE:
+	length = vbPtr->value.data.length;
+	objPtr = Tcl_NewObj();
+	Tcl_SetObjLength(objPtr, length ? length * 3 - 1 : 0);
+	TnmHexEnc(TnmSnmpVarBindData(vblPtr, vbPtr), length, objPtr->bytes);
+	break;
+    default:
+	return Tcl_NewObj();
+    }
+
+    if (! nodePtr || nodePtr->syntax != vbPtr->syntax) {
+	return objPtr;
+    }
+
+    fmtPtr = TnmMibFormatValue(nodePtr->typePtr, vbPtr->syntax, objPtr);
+    if (fmtPtr) {
+	Tcl_DecrRefCount(objPtr);
+	objPtr = fmtPtr;
+    }
+    return objPtr;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * TnmSnmpCopyVarBindList --
+ *
+ *	This procedure creates a new varbind list which contains
+ *	count varbinds of the given list starting at index first.
+ *
+ * Results:
+ *	A pointer to the new varbind list with a reference count of 0.
+ *
+ * Side effects:
+ *	Memory is allocated.
+ *
+ *----------------------------------------------------------------------
+ */
+
+TnmSnmpVarBindList*
+TnmSnmpCopyVarBindList(TnmSnmpVarBindList *vblPtr, int first, int count)
+{
+    TnmSnmpVarBindList *newPtr = TnmSnmpNewVarBindList();
+
+    TnmSnmpAppendVarBinds(newPtr, vblPtr, first, count);
+    return newPtr;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * TnmSnmpAppendVarBinds --
+ *
+ *	This procedure appends count varbinds of the list srcPtr
+ *	starting at index first to the list dstPtr.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	Memory is allocated.
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+TnmSnmpAppendVarBinds(TnmSnmpVarBindList *dstPtr, TnmSnmpVarBindList *srcPtr, int first, int count)
+{
+    int i;
+
+    for (i = first; i < first + count && i < srcPtr->numVarBinds; i++) {
+	TnmSnmpVarBind *vbPtr = srcPtr->varBinds + i;
+	TnmSnmpVarBind *newPtr;
+
+	newPtr = TnmSnmpAddVarBind(dstPtr, TnmSnmpVarBindOid(srcPtr, vbPtr),
+				   vbPtr->oidLength, vbPtr->syntax);
+	if (vbPtr->syntax == ASN1_OBJECT_IDENTIFIER) {
+	    TnmSnmpSetVarBindOid(dstPtr, newPtr,
+				 TnmSnmpVarBindOidValue(srcPtr, vbPtr),
+				 vbPtr->value.data.length);
+	} else if (HasData(vbPtr->syntax)) {
+	    TnmSnmpSetVarBindData(dstPtr, newPtr,
+				  TnmSnmpVarBindData(srcPtr, vbPtr),
+				  vbPtr->value.data.length);
+	} else {
+	    newPtr->value = vbPtr->value;
+	}
+    }
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * TnmSnmpEqualVarBindList --
+ *
+ *	This procedure compares two varbind lists.
+ *
+ * Results:
+ *	1 if both lists contain the same varbinds, 0 otherwise.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+int
+TnmSnmpEqualVarBindList(TnmSnmpVarBindList *vblPtr1, TnmSnmpVarBindList *vblPtr2)
+{
+    int i;
+
+    if (vblPtr1->numVarBinds != vblPtr2->numVarBinds) {
+	return 0;
+    }
+
+    for (i = 0; i < vblPtr1->numVarBinds; i++) {
+	TnmSnmpVarBind *vbPtr1 = vblPtr1->varBinds + i;
+	TnmSnmpVarBind *vbPtr2 = vblPtr2->varBinds + i;
+
+	if (vbPtr1->syntax != vbPtr2->syntax
+	    || vbPtr1->oidLength != vbPtr2->oidLength
+	    || memcmp(TnmSnmpVarBindOid(vblPtr1, vbPtr1),
+		      TnmSnmpVarBindOid(vblPtr2, vbPtr2),
+		      vbPtr1->oidLength * sizeof(Tnm_Oid)) != 0) {
+	    return 0;
+	}
+
+	switch (vbPtr1->syntax) {
+	case ASN1_INTEGER:
+	case ASN1_COUNTER32:
+	case ASN1_GAUGE32:
+	case ASN1_TIMETICKS:
+	    if (vbPtr1->value.intValue != vbPtr2->value.intValue) {
+		return 0;
+	    }
+	    break;
+	case ASN1_COUNTER64:
+	    if (vbPtr1->value.u64Value != vbPtr2->value.u64Value) {
+		return 0;
+	    }
+	    break;
+	case ASN1_OBJECT_IDENTIFIER:
+	    if (vbPtr1->value.data.length != vbPtr2->value.data.length
+		|| memcmp(TnmSnmpVarBindData(vblPtr1, vbPtr1),
+			  TnmSnmpVarBindData(vblPtr2, vbPtr2),
+			  vbPtr1->value.data.length * sizeof(Tnm_Oid)) != 0) {
+		return 0;
+	    }
+	    break;
+	default:
+	    if (HasData(vbPtr1->syntax)
+		&& (vbPtr1->value.data.length != vbPtr2->value.data.length
+		    || memcmp(TnmSnmpVarBindData(vblPtr1, vbPtr1),
+			      TnmSnmpVarBindData(vblPtr2, vbPtr2),
+			      vbPtr1->value.data.length) != 0)) {
+		return 0;
+	    }
+	    break;
+	}
+    }
+    return 1;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HashBytes --
+ *
+ *	This procedure adds a sequence of bytes to a FNV-1a hash value.
+ *
+ * Results:
+ *	The new hash value.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static unsigned int
+HashBytes(unsigned int hash, const void *bytes, size_t length)
+{
+    const unsigned char *p = (const unsigned char *) bytes;
+
+    while (length-- > 0) {
+	hash = (hash ^ *p++) * 16777619U;
+    }
+    return hash;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * TnmSnmpHashVarBindList --
+ *
+ *	This procedure computes a hash value of a varbind list from
+ *	the binary representation of the names and values. Varbind
+ *	lists which are equal according to TnmSnmpEqualVarBindList()
+ *	have the same hash value.
+ *
+ * Results:
+ *	The hash value.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+unsigned int
+TnmSnmpHashVarBindList(TnmSnmpVarBindList *vblPtr)
+{
+    unsigned int hash = 2166136261U;
+    int i;
+
+    for (i = 0; i < vblPtr->numVarBinds; i++) {
+	TnmSnmpVarBind *vbPtr = vblPtr->varBinds + i;
+
+	hash = HashBytes(hash, &vbPtr->syntax, sizeof(vbPtr->syntax));
+	hash = HashBytes(hash, TnmSnmpVarBindOid(vblPtr, vbPtr),
+			 vbPtr->oidLength * sizeof(Tnm_Oid));
+
+	switch (vbPtr->syntax) {
+	case ASN1_INTEGER:
+	case ASN1_COUNTER32:
+	case ASN1_GAUGE32:
+	case ASN1_TIMETICKS:
+	    hash = HashBytes(hash, &vbPtr->value.intValue,
+			     sizeof(vbPtr->value.intValue));
+	    break;
+	case ASN1_COUNTER64:
+	    hash = HashBytes(hash, &vbPtr->value.u64Value,
+			     sizeof(vbPtr->value.u64Value));
+	    break;
+	case ASN1_OBJECT_IDENTIFIER:
+	    hash = HashBytes(hash, TnmSnmpVarBindData(vblPtr, vbPtr),
+			     vbPtr->value.data.length * sizeof(Tnm_Oid));
+	    break;
+	default:
+	    if (HasData(vbPtr->syntax)) {
+		hash = HashBytes(hash, TnmSnmpVarBindData(vblPtr, vbPtr),
+				 (size_t) vbPtr->value.data.length);
+	    }
+	    break;
+	}
+    }
+    return hash;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * TnmSnmpNewVarBindListObj --
+ *
+ *	This procedure creates a new tnmVarBindList object which
+ *	shares the given varbind list. The string representation
+ *	is created lazily.
+ *
+ * Results:
+ *	A pointer to the new Tcl_Obj.
+ *
+ * Side effects:
+ *	The reference count of the varbind list is incremented.
+ *
+ *----------------------------------------------------------------------
+ */
+
+Tcl_Obj*
+TnmSnmpNewVarBindListObj(TnmSnmpVarBindList *vblPtr)
+{
+    Tcl_Obj *objPtr = Tcl_NewObj();
+
+    Tcl_InvalidateStringRep(objPtr);
+    TnmSnmpPreserveVarBindList(vblPtr);
+    objPtr->internalRep.otherValuePtr = (VOID *) vblPtr;
+    objPtr->typePtr = &tnmVarBindListType;
+    return objPtr;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * TnmSnmpGetVarBindListFromObj --
+ *
+ *	This procedure returns the binary varbind list for a Tcl
+ *	object. Objects of the tnmVarBindList type share their
+ *	internal representation. All other objects are parsed as
+ *	a Tcl list of varbinds where the syntax and the value of
+ *	each varbind are optional. Values are not converted for
+ *	retrieval PDUs since they are never encoded. The object
+ *	itself is not converted since the result depends on the
+ *	PDU type.
+ *
+ * Results:
+ *	A pointer to the varbind list or NULL if the object can not
+ *	be converted. The caller must release the varbind list by
+ *	calling TnmSnmpReleaseVarBindList().
+ *
+ * Side effects:
+ *	An error message is left in the interpreter on failure.
+ *
+ *----------------------------------------------------------------------
+ */
+
+TnmSnmpVarBindList*
+TnmSnmpGetVarBindListFromObj(Tcl_Interp *interp, Tcl_Obj *objPtr, int pduType)
+{
+    TnmSnmpVarBindList *vblPtr;
+    Tcl_Obj **objv, **vbv;
+    int i, objc, vbc;
+
+    if (objPtr->typePtr == &tnmVarBindListType) {
+	vblPtr = (TnmSnmpVarBindList *) objPtr->internalRep.otherValuePtr;
+	TnmSnmpPreserveVarBindList(vblPtr);
+	return vblPtr;
+    }
+
+    if (Tcl_ListObjGetElements(interp, objPtr, &objc, &objv) != TCL_OK) {
+	return NULL;
+    }
+
+    vblPtr = TnmSnmpNewVarBindList();
+    TnmSnmpPreserveVarBindList(vblPtr);
+
+    for (i = 0; i < objc; i++) {
+	TnmSnmpVarBind *vbPtr;
+	Tnm_Oid *oid;
+	int oidlen, syntax = ASN1_OTHER;
+	char *name, *type = NULL, *value = "";
+
+	if (Tcl_ListObjGetElements(interp, objv[i], &vbc, &vbv) != TCL_OK) {
+	    goto errorExit;
+	}
+	if (vbc == 0) {
+	    Tcl_SetResult(interp, "missing OBJECT IDENTIFIER", TCL_STATIC);
+	    goto errorExit;
+	}
+
+	/*
+	 * Convert the object identifier, perhaps consulting the MIB.
+	 */
+
+	name = Tcl_GetString(vbv[0]);
+	oid = TnmStrToOid(name, &oidlen);
+	if (! oid) {
+	    char *tmp = TnmMibGetOid(name);
+	    if (tmp) {
+		oid = TnmStrToOid(tmp, &oidlen);
+	    }
+	}
+	if (! oid) {
+	    Tcl_ResetResult(interp);
+	    Tcl_AppendResult(interp, "invalid object identifier \"",
+			     name, "\"", (char *) NULL);
+	    goto errorExit;
+	}
+
+	/*
+	 * Guess the asn1 type field and the value. Exceptions are
+	 * only accepted in response PDUs.
+	 */
+
+	switch (vbc) {
+	case 1:
+	    syntax = ASN1_NULL;
+	    break;
+	case 2:
+	    type = value = Tcl_GetString(vbv[1]);
+	    syntax = TnmMibGetBaseSyntax(name);
+	    break;
+	default:
+	    type = Tcl_GetString(vbv[1]);
+	    value = Tcl_GetString(vbv[2]);
+	    if (pduType == ASN1_SNMP_RESPONSE) {
+		syntax = TnmGetTableKey(tnmSnmpExceptionTable, type);
+	    } else {
+		syntax = -1;
+	    }
+	    if (syntax < 0) {
+		syntax = TnmGetTableKey(tnmSnmpTypeTable, type);
+		if (syntax < 0) {
+		    syntax = ASN1_OTHER;
+		}
+	    }
+	    if (syntax == ASN1_OTHER) {
+		TnmMibType *typePtr = TnmMibFindType(type);
+		if (typePtr) {
+		    syntax = typePtr->syntax;
+		}
+	    }
+	    break;
+	}
+
+	if (syntax == ASN1_OTHER) {
+	    Tcl_ResetResult(interp);
+	    Tcl_AppendResult(interp, "unknown type \"", type, "\"",
+			     (char *) NULL);
+	    goto errorExit;
+	}
+
+	if (TnmSnmpGet(pduType)) {
+	    (void) TnmSnmpAddVarBind(vblPtr, oid, oidlen, ASN1_NULL);
+	    continue;
+	}
+
+	vbPtr = TnmSnmpAddVarBind(vblPtr, oid, oidlen, syntax);
+	if (TnmSnmpScanVarBindValue(interp, vblPtr, vbPtr,
+				    name, value) != TCL_OK) {
+	    goto errorExit;
+	}
+    }
+
+    return vblPtr;
+
+ errorExit:
+    TnmSnmpReleaseVarBindList(vblPtr);
+    return NULL;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * TnmSnmpPduSetVarBinds --
+ *
+ *	This procedure replaces the varbind list of a PDU.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	The reference count of the old list is decremented and the
+ *	reference count of the new list (if any) is incremented.
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+TnmSnmpPduSetVarBinds(TnmSnmpPdu *pdu, Tcl_Obj *vbList)
+{
+    if (vbList) {
+	Tcl_IncrRefCount(vbList);
+    }
+    if (pdu->vbList) {
+	Tcl_DecrRefCount(pdu->vbList);
+    }
+    pdu->vbList = vbList;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * DupVarBindListInternalRep --
+ *
+ *	Initialize the internal representation of a tnmVarBindList
+ *	Tcl_Obj to a copy of the internal representation of an
+ *	existing tnmVarBindList object. The varbind list is shared.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	The reference count of the varbind list is incremented.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+DupVarBindListInternalRep(Tcl_Obj *srcPtr, Tcl_Obj *copyPtr)
+{
+    TnmSnmpVarBindList *vblPtr = (TnmSnmpVarBindList *)
+	srcPtr->internalRep.otherValuePtr;
+
+    TnmSnmpPreserveVarBindList(vblPtr);
+    copyPtr->internalRep.otherValuePtr = (VOID *) vblPtr;
+    copyPtr->typePtr = &tnmVarBindListType;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * FreeVarBindListInternalRep --
+ *
+ *	Deallocate the storage associated with a tnmVarBindList
+ *	object's internal representation.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	The varbind list is released.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+FreeVarBindListInternalRep(Tcl_Obj *objPtr)
+{
+    TnmSnmpReleaseVarBindList((TnmSnmpVarBindList *)
+			      objPtr->internalRep.otherValuePtr);
+    objPtr->internalRep.otherValuePtr = NULL;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * UpdateStringOfVarBindList --
+ *
+ *	Update the string representation for a tnmVarBindList
+ *	object. The string is a Tcl list where each element is a
+ *	list containing the object identifier, the type and the
+ *	formatted value of a varbind.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	The object's string is set to a valid string that results
+ *	from formatting the varbind list.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+UpdateStringOfVarBindList(Tcl_Obj *objPtr)
+{
+    TnmSnmpVarBindList *vblPtr = (TnmSnmpVarBindList *)
+	objPtr->internalRep.otherValuePtr;
+    Tcl_DString list, soid;
+    int i;
+
+    Tcl_DStringInit(&list);
+    Tcl_DStringInit(&soid);
+
+    for (i = 0; i < vblPtr->numVarBinds; i++) {
+	TnmSnmpVarBind *vbPtr = vblPtr->varBinds + i;
+	char *syntax;
+	Tcl_Obj *valuePtr;
+
+	Tcl_DStringSetLength(&soid, 0);
+	Tcl_DStringAppend(&soid,
+			  TnmOidToStr(TnmSnmpVarBindOid(vblPtr, vbPtr),
+				      vbPtr->oidLength), -1);
+
+	if (TnmSnmpException(vbPtr->syntax)) {
+	    syntax = TnmGetTableValue(tnmSnmpExceptionTable, vbPtr->syntax);
+	} else {
+	    syntax = TnmGetTableValue(tnmSnmpTypeTable, vbPtr->syntax);
+	}
+
+	Tcl_DStringStartSublist(&list);
+	Tcl_DStringAppendElement(&list, Tcl_DStringValue(&soid));
+	Tcl_DStringAppendElement(&list, syntax ? syntax : "Opaque");
+	valuePtr = FormatValue(vblPtr, vbPtr, Tcl_DStringValue(&soid));
+	Tcl_DStringAppendElement(&list, Tcl_GetString(valuePtr));
+	Tcl_DecrRefCount(valuePtr);
+	Tcl_DStringEndSublist(&list);
+    }
+
+    objPtr->length = Tcl_DStringLength(&list);
+    objPtr->bytes = ckalloc(objPtr->length + 1);
+    memcpy(objPtr->bytes, Tcl_DStringValue(&list), objPtr->length + 1);
+
+    Tcl_DStringFree(&soid);
+    Tcl_DStringFree(&list);
+}
+
+/*
+ * Local Variables:
+ * compile-command: "make -k -C ../../unix"
+ * End:
+ */
@@ -0,0 +1,1603 @@
+/*
+ * tnmSnmpWalk.c --
+ *
+ *	This file implements the engine behind the walk commands of
+ *	generator sessions. A walk of a single subtree or a table
+ *	walk is split into lanes which cover adjacent ranges of the
+ *	walked subtrees. Every lane keeps one
+ *	getbulk request in flight, so that several requests of a walk
+ *	are outstanding at the same time. The number of repetitions
+ *	is adapted to the size of the responses and the rows are
+ *	passed to the caller in lexicographic order. Table walks
+ *	advance the columns independently, so that columns with
+ *	missing cells do not terminate the walk. Synchronous walks
+ *	send their requests over the socket used for synchronous
+ *	requests and wait for the responses without processing any
+ *	other events.
+ *
+ * See the file "license.terms" for information on usage and redistribution
+ * of this file, and for a DISCLAIMER OF ALL WARRANTIES.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "tnmSnmp.h"
+
+#include <math.h>
+
+/*
+ * A lane walks the range of rows starting after the varbinds
+ * in vbList up to and including the row named stop. The stop
+ * name is empty for the last lane, which walks up to the end
+ * of the subtrees. Rows are kept in the lane until all lanes
+ * covering smaller rows have been completed.
+ */
+
+struct Walk;
+
+typedef struct WalkLane {
+    struct Walk *walkPtr;	/* The walk this lane belongs to. */
+    Tcl_Obj *vbList;		/* The varbinds to continue with. */
+    Tcl_Obj *rowsObj;		/* Rows not yet passed to the caller. */
+    int nextRow;		/* Next row in rowsObj to pass on. */
+    TnmOid stop;		/* Name of the last row of this lane. */
+    TnmOid first;		/* Name of the first row received. */
+    TnmOid last;		/* Name of the last row received. */
+    TnmOid max;			/* Largest cell received by a table walk. */
+    int numRows;		/* Number of rows received so far. */
+    int reps;			/* Repetitions of the request in flight. */
+    int requestId;		/* The request in flight or 0. */
+    u_char *packet;		/* The request of a synchronous walk. */
+    int packetlen;		/* The length of the request. */
+    int sends;			/* Number of times the request was sent. */
+    Tcl_WideInt expire;		/* Retransmission time in ms. */
+    int done;			/* Set once the lane has reached stop. */
+    struct WalkLane *nextPtr;	/* Next lane in lexicographic order. */
+} WalkLane;
+
+typedef struct Walk {
+    TnmSnmp *session;		/* The session used for this walk. */
+    Tcl_Interp *interp;		/* The interpreter used for requests. */
+    int numColumns;		/* Number of subtrees walked. */
+    TnmOid *columns;		/* The object identifiers of the subtrees. */
+    TnmSnmpRequestProc *proc;	/* Procedure called for every row. */
+    ClientData clientData;	/* Argument passed to proc. */
+    int requestId;		/* Request id of the first request. */
+    int reps;			/* Repetitions used for the next request. */
+    int maxReps;		/* Upper limit for the repetitions. */
+    int numLanes;		/* Number of lanes in laneList. */
+    int maxLanes;		/* Upper limit for the number of lanes. */
+    int errorStatus;		/* The error which terminated the walk. */
+    int errorIndex;		/* The error index of that error. */
+    Tcl_Obj *errorVbList;	/* The varbinds of the error response. */
+    int table;			/* Set if the columns advance independently. */
+    int sync;			/* Set if requests are sent synchronously. */
+    int busy;			/* Set while rows are passed to proc. */
+    int stopped;		/* Set once the walk has been stopped. */
+    int finished;		/* Set once proc has been called the last time. */
+    WalkLane *laneList;		/* The lanes in lexicographic order. */
+    struct Walk *nextPtr;	/* Next walk in progress. */
+} Walk;
+
+static Walk *walkList = NULL;
+
+/*
+ * The following constants control how walks are split into lanes
+ * and how many rows are requested in one getbulk request. A new
+ * lane is sized to be completed with about WALK_SPAN responses.
+ * The number of repetitions grows until the responses reach about
+ * WALK_SIZE octets, which keeps them below the usual path MTU.
+ */
+
+#define WALK_LANES	8
+#define WALK_SPAN	8
+#define WALK_REPS	8
+#define WALK_MAX_REPS	256
+#define WALK_SIZE	1400
+
+/*
+ * Forward declarations for procedures defined later in this file:
+ */
+
+static WalkLane*
+LaneCreate		(Walk *walkPtr, TnmOid *startPtr, int prefix);
+
+static void
+LaneFree		(WalkLane *lanePtr);
+
+static int
+LaneSend		(Walk *walkPtr, WalkLane *lanePtr);
+
+static int
+LaneTransmit		(Walk *walkPtr, WalkLane *lanePtr);
+
+static void
+LaneStop		(WalkLane *lanePtr);
+
+static int
+LaneRows		(Walk *walkPtr, WalkLane *lanePtr,
+			 TnmSnmpVarBindList *vblPtr, int *rowsPtr);
+static void
+LaneProc		(TnmSnmp *session, TnmSnmpPdu *pdu,
+			 ClientData clientData);
+static int
+InTree			(Walk *walkPtr, TnmSnmpVarBindList *vblPtr,
+			 int first);
+static int
+CellName		(Walk *walkPtr, TnmSnmpVarBindList *vblPtr,
+			 int first, int column, TnmOid *oidPtr);
+static int
+TableRows		(Walk *walkPtr, WalkLane *lanePtr,
+			 TnmSnmpVarBindList *vblPtr, int *rowsPtr);
+static int
+ResponseSize		(TnmSnmpVarBindList *vblPtr);
+
+static void
+WalkAdapt		(Walk *walkPtr, WalkLane *lanePtr,
+			 TnmSnmpVarBindList *vblPtr, int rows);
+static void
+WalkSplit		(Walk *walkPtr);
+
+static void
+WalkFail		(Walk *walkPtr, WalkLane *lanePtr, int status,
+			 int index, Tcl_Obj *vbList);
+static void
+WalkDeliver		(Walk *walkPtr);
+
+static Tcl_WideInt
+WalkNow			(void);
+
+static int
+WalkRecv		(Walk *walkPtr);
+
+static int
+WalkWait		(Walk *walkPtr);
+
+static void
+WalkStop		(Walk *walkPtr);
+
+static void
+WalkUnlink		(Walk *walkPtr);
+
+static void
+WalkDestroyProc		(char *memPtr);
+
+static int
+WalkCreate		(Tcl_Interp *interp, TnmSnmp *session,
+			 Tcl_Obj *oidList, int table, int flags,
+			 TnmSnmpRequestProc *proc, ClientData clientData);
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * LaneCreate --
+ *
+ *	This procedure creates a new lane. The lane starts at the
+ *	beginning of the subtrees if startPtr is NULL. Otherwise, the
+ *	sub-identifiers of startPtr following the first prefix
+ *	sub-identifiers are appended to every subtree.
+ *
+ * Results:
+ *	A pointer to the new lane or NULL if the start position can
+ *	not be represented.
+ *
+ * Side effects:
+ *	Memory is allocated.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static WalkLane*
+LaneCreate(Walk *walkPtr, TnmOid *startPtr, int prefix)
+{
+    WalkLane *lanePtr;
+    TnmSnmpVarBindList *vblPtr;
+    TnmOid oid;
+    int i, j;
+
+    vblPtr = TnmSnmpNewVarBindList();
+    TnmOidInit(&oid);
+    for (i = 0; i < walkPtr->numColumns; i++) {
+	TnmOidCopy(&oid, walkPtr->columns + i);
+	for (j = prefix; startPtr && j < TnmOidGetLength(startPtr); j++) {
+	    if (TnmOidAppend(&oid, TnmOidGet(startPtr, j)) != TCL_OK) {
+		TnmOidFree(&oid);
+		TnmSnmpPreserveVarBindList(vblPtr);
+		TnmSnmpReleaseVarBindList(vblPtr);
+		return NULL;
+	    }
+	}
+	(void) TnmSnmpAddVarBind(vblPtr, TnmOidGetElements(&oid),
+				 TnmOidGetLength(&oid), ASN1_NULL);
+    }
+    TnmOidFree(&oid);
+
+    lanePtr = (WalkLane *) ckalloc(sizeof(WalkLane));
+    memset((char *) lanePtr, 0, sizeof(WalkLane));
+    lanePtr->walkPtr = walkPtr;
+    lanePtr->vbList = TnmSnmpNewVarBindListObj(vblPtr);
+    Tcl_IncrRefCount(lanePtr->vbList);
+    lanePtr->rowsObj = Tcl_NewListObj(0, NULL);
+    Tcl_IncrRefCount(lanePtr->rowsObj);
+    TnmOidInit(&lanePtr->stop);
+    TnmOidInit(&lanePtr->first);
+    TnmOidInit(&lanePtr->last);
+    TnmOidInit(&lanePtr->max);
+    return lanePtr;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * LaneFree --
+ *
+ *	This procedure frees a lane. The request of the lane must
+ *	have been stopped before.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	Memory is freed.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+LaneFree(WalkLane *lanePtr)
+{
+    Tcl_DecrRefCount(lanePtr->vbList);
+    Tcl_DecrRefCount(lanePtr->rowsObj);
+    TnmOidFree(&lanePtr->stop);
+    TnmOidFree(&lanePtr->first);
+    TnmOidFree(&lanePtr->last);
+    TnmOidFree(&lanePtr->max);
+    if (lanePtr->packet) {
+	ckfree((char *) lanePtr->packet);
+    }
+    ckfree((char *) lanePtr);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * LaneSend --
+ *
+ *	This procedure queues the next getbulk request of a lane.
+ *	SNMPv1 sessions send getnext requests instead (see
+ *	TnmSnmpEncode()). The request of a synchronous walk is only
+ *	encoded here and sent by WalkWait().
+ *
+ * Results:
+ *	A standard Tcl result.
+ *
+ * Side effects:
+ *	A request is queued.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+LaneSend(Walk *walkPtr, WalkLane *lanePtr)
+{
+    TnmSnmpPdu _pdu, *pdu = &_pdu;
+    int code;
+
+    memset((char *) pdu, 0, sizeof(TnmSnmpPdu));
+    pdu->addr = walkPtr->session->maddr;
+    pdu->type = ASN1_SNMP_GETBULK;
+    pdu->requestId = TnmSnmpGetRequestId();
+    pdu->errorStatus = 0;
+    pdu->errorIndex = lanePtr->reps = walkPtr->reps;
+    TnmSnmpPduSetVarBinds(pdu, lanePtr->vbList);
+    if (walkPtr->sync) {
+	u_char packet[TNM_SNMP_MAXSIZE];
+	int packetlen = sizeof(packet);
+
+	code = TnmSnmpEncodeRequest(walkPtr->interp, walkPtr->session, pdu,
+				    packet, &packetlen);
+	if (code == TCL_OK) {
+	    if (lanePtr->packet) {
+		ckfree((char *) lanePtr->packet);
+	    }
+	    lanePtr->packet = (u_char *) ckalloc(packetlen);
+	    memcpy(lanePtr->packet, packet, (size_t) packetlen);
+	    lanePtr->packetlen = packetlen;
+	    lanePtr->sends = 0;
+	}
+    } else {
+	code = TnmSnmpEncode(walkPtr->interp, walkPtr->session, pdu,
+			     LaneProc, (ClientData) lanePtr);
+    }
+    TnmSnmpPduSetVarBinds(pdu, NULL);
+    if (code == TCL_OK) {
+	lanePtr->requestId = pdu->requestId;
+    }
+    return code;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * LaneTransmit --
+ *
+ *	This procedure sends the request of a lane of a synchronous
+ *	walk and computes the time of the next retransmission.
+ *
+ * Results:
+ *	A standard Tcl result.
+ *
+ * Side effects:
+ *	A packet is sent.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+LaneTransmit(Walk *walkPtr, WalkLane *lanePtr)
+{
+    TnmSnmp *session = walkPtr->session;
+
+#ifdef TNM_SNMPv2U
+    if (session->version == TNM_SNMPv2U) {
+	TnmSnmpUsecAuth(session, lanePtr->packet, lanePtr->packetlen);
+    }
+#endif
+    TnmSnmpDelay(session, lanePtr->packetlen);
+    if (TnmSnmpSend(walkPtr->interp, session, lanePtr->packet,
+		    lanePtr->packetlen, &session->maddr, TNM_SNMP_SYNC)
+	!= TCL_OK) {
+	return TCL_ERROR;
+    }
+    lanePtr->sends++;
+    lanePtr->expire = WalkNow()
+	+ (session->timeout * 1000) / (session->retries + 1);
+    return TCL_OK;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * LaneStop --
+ *
+ *	This procedure discards the request in flight of a lane. The
+ *	responses to the requests of a synchronous walk are ignored
+ *	once the request id has been cleared.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	The request is deleted.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+LaneStop(WalkLane *lanePtr)
+{
+    TnmSnmpRequest *request;
+
+    if (lanePtr->requestId && ! lanePtr->walkPtr->sync) {
+	request = TnmSnmpFindRequest(lanePtr->requestId);
+	if (request) {
+	    TnmSnmpDeleteRequest(request);
+	}
+    }
+    lanePtr->requestId = 0;
+    lanePtr->done = 1;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * InTree --
+ *
+ *	This procedure checks whether the row starting at index first
+ *	of a varbind list is contained in the walked subtrees and does
+ *	not carry an endOfMibView exception.
+ *
+ * Results:
+ *	1 if the row belongs to the walk, 0 otherwise.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+InTree(Walk *walkPtr, TnmSnmpVarBindList *vblPtr, int first)
+{
+    TnmSnmpVarBind *vbPtr = vblPtr->varBinds + first;
+    TnmOid oid;
+    int i, code = 1;
+
+    for (i = 0; i < walkPtr->numColumns; i++) {
+	if (vbPtr[i].syntax == ASN1_END_OF_MIB_VIEW) {
+	    return 0;
+	}
+    }
+
+    TnmOidInit(&oid);
+    for (i = 0; i < walkPtr->numColumns && code; i++) {
+	TnmSnmpGetVarBindName(vblPtr, vbPtr + i, &oid);
+	code = TnmOidInTree(walkPtr->columns + i, &oid);
+    }
+    TnmOidFree(&oid);
+    return code;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * LaneRows --
+ *
+ *	This procedure appends the rows of a response to the rows of
+ *	a lane. It stops at the first row which is not contained in
+ *	the subtrees or which is beyond the stop name of the lane.
+ *	Trailing varbinds which do not form a complete row are
+ *	ignored. Agents may truncate responses this way (RFC 3416).
+ *
+ * Results:
+ *	1 if the lane must be continued, 0 if it is done. The number
+ *	of complete rows in the response is left in rowsPtr.
+ *
+ * Side effects:
+ *	The varbinds used for the next request of the lane are
+ *	updated.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+LaneRows(Walk *walkPtr, WalkLane *lanePtr, TnmSnmpVarBindList *vblPtr, int *rowsPtr)
+{
+    int j, n = walkPtr->numColumns, rows = vblPtr->numVarBinds / n;
+    TnmSnmpVarBindList *rowPtr = NULL;
+    TnmOid oid;
+
+    if (walkPtr->table) {
+	return TableRows(walkPtr, lanePtr, vblPtr, rowsPtr);
+    }
+
+    *rowsPtr = rows;
+    if (rows == 0) {
+	lanePtr->done = 1;
+	return 0;
+    }
+
+    TnmOidInit(&oid);
+    for (j = 0; j < rows; j++) {
+	if (! InTree(walkPtr, vblPtr, j * n)) {
+	    break;
+	}
+	TnmSnmpGetVarBindName(vblPtr, vblPtr->varBinds + j * n, &oid);
+	if (TnmOidGetLength(&lanePtr->stop)
+	    && TnmOidCompare(&oid, &lanePtr->stop) > 0) {
+	    break;
+	}
+	rowPtr = TnmSnmpCopyVarBindList(vblPtr, j * n, n);
+	Tcl_ListObjAppendElement(NULL, lanePtr->rowsObj,
+				 TnmSnmpNewVarBindListObj(rowPtr));
+	if (lanePtr->numRows++ == 0) {
+	    TnmOidCopy(&lanePtr->first, &oid);
+	}
+    }
+
+    if (j < rows) {
+	TnmOidFree(&oid);
+	lanePtr->done = 1;
+	return 0;
+    }
+
+    /*
+     * The last row is shared by the row list and the next request,
+     * but each gets its own object so that list operations on the
+     * rows do not shimmer the object used to encode the request.
+     */
+
+    TnmOidCopy(&lanePtr->last, &oid);
+    TnmOidFree(&oid);
+    Tcl_DecrRefCount(lanePtr->vbList);
+    lanePtr->vbList = TnmSnmpNewVarBindListObj(rowPtr);
+    Tcl_IncrRefCount(lanePtr->vbList);
+    return 1;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * CellName --
+ *
+ *	This procedure checks whether a varbind of a row of a table
+ *	walk belongs to its column. The name of the cell is made
+ *	relative to the first column, so that cells of different
+ *	columns can be compared with each other and with the stop
+ *	name of a lane.
+ *
+ * Results:
+ *	1 if the varbind belongs to its column, 0 otherwise.
+ *
+ * Side effects:
+ *	The name of the cell is left in oidPtr.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+CellName(Walk *walkPtr, TnmSnmpVarBindList *vblPtr, int first, int column, TnmOid *oidPtr)
+{
+    TnmSnmpVarBind *vbPtr = vblPtr->varBinds + first + column;
+    TnmOid *colPtr = walkPtr->columns + column;
+    int i, len = TnmOidGetLength(colPtr);
+    Tnm_Oid *oid;
+
+    if (TnmSnmpException(vbPtr->syntax) || vbPtr->oidLength <= len) {
+	return 0;
+    }
+    oid = TnmSnmpVarBindOid(vblPtr, vbPtr);
+    for (i = 0; i < len; i++) {
+	if (oid[i] != TnmOidGet(colPtr, i)) {
+	    return 0;
+	}
+    }
+    TnmOidCopy(oidPtr, walkPtr->columns);
+    for (i = len; i < vbPtr->oidLength; i++) {
+	if (TnmOidAppend(oidPtr, oid[i]) != TCL_OK) {
+	    return 0;
+	}
+    }
+    return 1;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * TableRows --
+ *
+ *	This procedure is the LaneRows() variant of table walks. The
+ *	cells of a row which do not belong to their column or which
+ *	are beyond the stop name of the lane are marked with the
+ *	endOfMibView exception. The lane continues as long as a row
+ *	contains at least one cell, since every column advances from
+ *	its own last cell. The smallest cell of a row names the row
+ *	and the largest cell received so far is remembered, since new
+ *	lanes must start behind it.
+ *
+ * Results:
+ *	1 if the lane must be continued, 0 if it is done. The number
+ *	of complete rows in the response is left in rowsPtr.
+ *
+ * Side effects:
+ *	The varbinds used for the next request of the lane are
+ *	updated.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+TableRows(Walk *walkPtr, WalkLane *lanePtr, TnmSnmpVarBindList *vblPtr, int *rowsPtr)
+{
+    int j, k, live, n = walkPtr->numColumns, rows = vblPtr->numVarBinds / n;
+    TnmSnmpVarBindList *rowPtr;
+    TnmOid oid, name;
+
+    *rowsPtr = rows;
+    TnmOidInit(&oid);
+    TnmOidInit(&name);
+    for (j = 0; j < rows; j++) {
+	rowPtr = TnmSnmpCopyVarBindList(vblPtr, j * n, n);
+	for (k = 0, live = 0; k < n; k++) {
+	    if (CellName(walkPtr, vblPtr, j * n, k, &oid)
+		&& (! TnmOidGetLength(&lanePtr->stop)
+		    || TnmOidCompare(&oid, &lanePtr->stop) <= 0)) {
+		if (! live++ || TnmOidCompare(&oid, &name) < 0) {
+		    TnmOidCopy(&name, &oid);
+		}
+		if (TnmOidCompare(&oid, &lanePtr->max) > 0) {
+		    TnmOidCopy(&lanePtr->max, &oid);
+		}
+	    } else {
+		rowPtr->varBinds[k].syntax = ASN1_END_OF_MIB_VIEW;
+	    }
+	}
+	if (! live) {
+	    TnmSnmpPreserveVarBindList(rowPtr);
+	    TnmSnmpReleaseVarBindList(rowPtr);
+	    break;
+	}
+	Tcl_ListObjAppendElement(NULL, lanePtr->rowsObj,
+				 TnmSnmpNewVarBindListObj(rowPtr));
+	if (lanePtr->numRows++ == 0) {
+	    TnmOidCopy(&lanePtr->first, &name);
+	}
+    }
+    TnmOidFree(&oid);
+
+    if (rows == 0 || j < rows) {
+	TnmOidFree(&name);
+	lanePtr->done = 1;
+	return 0;
+    }
+
+    /*
+     * The next request continues every column from its own last
+     * varbind, including the columns which are already done.
+     */
+
+    TnmOidCopy(&lanePtr->last, &name);
+    TnmOidFree(&name);
+    Tcl_DecrRefCount(lanePtr->vbList);
+    lanePtr->vbList = TnmSnmpNewVarBindListObj(
+	TnmSnmpCopyVarBindList(vblPtr, (rows - 1) * n, n));
+    Tcl_IncrRefCount(lanePtr->vbList);
+    return 1;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * ResponseSize --
+ *
+ *	This procedure estimates the number of octets used by the
+ *	BER encoding of a varbind list.
+ *
+ * Results:
+ *	The estimated size.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+ResponseSize(TnmSnmpVarBindList *vblPtr)
+{
+    TnmSnmpVarBind *vbPtr;
+    int i, size = 0;
+
+    for (i = 0; i < vblPtr->numVarBinds; i++) {
+	vbPtr = vblPtr->varBinds + i;
+	size += 6 + vbPtr->oidLength;
+	switch (vbPtr->syntax) {
+	case ASN1_OCTET_STRING:
+	case ASN1_OPAQUE:
+	case ASN1_IPADDRESS:
+	case ASN1_OBJECT_IDENTIFIER:
+	    size += vbPtr->value.data.length;
+	    break;
+	case ASN1_COUNTER64:
+	    size += 9;
+	    break;
+	default:
+	    size += 5;
+	    break;
+	}
+    }
+    return size;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * WalkAdapt --
+ *
+ *	This procedure adapts the number of repetitions to a response.
+ *	A response with fewer rows than requested was truncated by the
+ *	agent, which limits the repetitions for the rest of the walk.
+ *	Otherwise, the number of repetitions is derived from the size
+ *	of the rows and grows by a factor of two at most.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	The repetitions of the walk are updated.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+WalkAdapt(Walk *walkPtr, WalkLane *lanePtr, TnmSnmpVarBindList *vblPtr, int rows)
+{
+    int reps, size;
+
+    if (walkPtr->session->version == TNM_SNMPv1) {
+	return;
+    }
+
+    if (rows < lanePtr->reps) {
+	walkPtr->maxReps = rows;
+	walkPtr->reps = rows;
+	return;
+    }
+
+    size = ResponseSize(vblPtr) / rows;
+    reps = WALK_SIZE / (size > 0 ? size : 1);
+    if (reps > 2 * walkPtr->reps) {
+	reps = 2 * walkPtr->reps;
+    }
+    if (reps > walkPtr->maxReps) {
+	reps = walkPtr->maxReps;
+    }
+    walkPtr->reps = (reps > 0) ? reps : 1;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * WalkSplit --
+ *
+ *	This procedure creates new lanes behind the last lane of a
+ *	walk if the walk has less than the maximum number of lanes.
+ *	The start positions are extrapolated from the rows received
+ *	by the last lane: We search for the first sub-identifier of
+ *	the index which differs between the first and the last row
+ *	and advance it by the amount needed for WALK_SPAN responses.
+ *	A lane which starts behind the end of the table terminates
+ *	with its first response. The lanes of a table walk start
+ *	behind the largest cell received by the last lane. Walks of
+ *	several columns which are not table walks are never split:
+ *	Their rows pair the successors of the cells of the previous
+ *	row, so the start of a lane in a column with missing cells
+ *	is not known before the previous lane has completed.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	Requests are queued for the new lanes.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+WalkSplit(Walk *walkPtr)
+{
+    WalkLane *tailPtr, *lanePtr;
+    TnmOid *firstPtr, *lastPtr, *maxPtr, start;
+    int i, p, len, prefix = TnmOidGetLength(walkPtr->columns);
+    Tcl_WideInt value, span;
+    double step;
+
+    if (walkPtr->errorStatus || walkPtr->numLanes >= walkPtr->maxLanes
+	|| (! walkPtr->table && walkPtr->numColumns > 1)) {
+	return;
+    }
+
+    for (tailPtr = walkPtr->laneList; tailPtr && tailPtr->nextPtr;
+	 tailPtr = tailPtr->nextPtr) ;
+    if (! tailPtr || tailPtr->done || tailPtr->numRows < 2) {
+	return;
+    }
+
+    firstPtr = &tailPtr->first;
+    lastPtr = &tailPtr->last;
+    len = TnmOidGetLength(firstPtr);
+    if (TnmOidGetLength(lastPtr) < len) {
+	len = TnmOidGetLength(lastPtr);
+    }
+    for (p = prefix; p < len; p++) {
+	if (TnmOidGet(firstPtr, p) != TnmOidGet(lastPtr, p)) break;
+    }
+    if (p >= len || TnmOidGet(lastPtr, p) < TnmOidGet(firstPtr, p)) {
+	return;
+    }
+
+    step = (double) (TnmOidGet(lastPtr, p) - TnmOidGet(firstPtr, p))
+	/ (tailPtr->numRows - 1);
+    span = (Tcl_WideInt) ceil(step * walkPtr->reps * WALK_SPAN);
+    if (span < 1) {
+	span = 1;
+    }
+
+    value = TnmOidGet(lastPtr, p);
+    if (walkPtr->table) {
+	maxPtr = &tailPtr->max;
+	for (i = 0; i < p; i++) {
+	    if (TnmOidGet(maxPtr, i) != TnmOidGet(lastPtr, i)) {
+		return;
+	    }
+	}
+	if (TnmOidGetLength(maxPtr) > p && TnmOidGet(maxPtr, p) > value) {
+	    value = TnmOidGet(maxPtr, p);
+	}
+    }
+
+    TnmOidInit(&start);
+    TnmOidCopy(&start, lastPtr);
+    TnmOidSetLength(&start, p + 1);
+    while (walkPtr->numLanes < walkPtr->maxLanes) {
+	value += span;
+	if (value > 0xffffffff) {
+	    break;
+	}
+	TnmOidSet(&start, p, (u_int) value);
+	lanePtr = LaneCreate(walkPtr, &start, prefix);
+	if (! lanePtr) {
+	    break;
+	}
+	if (LaneSend(walkPtr, lanePtr) != TCL_OK) {
+	    LaneFree(lanePtr);
+	    break;
+	}
+	TnmOidCopy(&tailPtr->stop, &start);
+	tailPtr->nextPtr = lanePtr;
+	tailPtr = lanePtr;
+	walkPtr->numLanes++;
+    }
+    TnmOidFree(&start);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * WalkFail --
+ *
+ *	This procedure records an error which terminates a walk. The
+ *	lanes behind the failed lane are discarded. The lanes in front
+ *	of it are completed so that all rows up to the error are
+ *	passed to the caller before the error is reported.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	Lanes and their requests are discarded.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+WalkFail(Walk *walkPtr, WalkLane *lanePtr, int status, int index, Tcl_Obj *vbList)
+{
+    WalkLane *nextPtr;
+
+    walkPtr->errorStatus = status;
+    walkPtr->errorIndex = index;
+    if (walkPtr->errorVbList) {
+	Tcl_DecrRefCount(walkPtr->errorVbList);
+    }
+    walkPtr->errorVbList = vbList;
+    if (vbList) {
+	Tcl_IncrRefCount(vbList);
+    }
+
+    lanePtr->done = 1;
+    while ((nextPtr = lanePtr->nextPtr)) {
+	lanePtr->nextPtr = nextPtr->nextPtr;
+	LaneStop(nextPtr);
+	LaneFree(nextPtr);
+	walkPtr->numLanes--;
+    }
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * LaneProc --
+ *
+ *	This procedure is called when a response for a request of a
+ *	lane has been received or when the request timed out. It
+ *	collects the rows, adapts the walk and continues the lane.
+ *	A tooBig error is retried with fewer repetitions. A noSuchName
+ *	error terminates the lane since it is the way SNMPv1 agents
+ *	report the end of the MIB view.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	Rows may be passed to the caller and new requests are queued.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+LaneProc(TnmSnmp *session, TnmSnmpPdu *pdu, ClientData clientData)
+{
+    WalkLane *lanePtr = (WalkLane *) clientData;
+    Walk *walkPtr = lanePtr->walkPtr;
+    TnmSnmpVarBindList *vblPtr;
+    int rows, more;
+
+    lanePtr->requestId = 0;
+
+    switch (pdu->errorStatus) {
+    case TNM_SNMP_NOERROR:
+	break;
+    case TNM_SNMP_TOOBIG:
+	if (lanePtr->reps > 1) {
+	    walkPtr->maxReps = lanePtr->reps / 2;
+	    if (walkPtr->reps > walkPtr->maxReps) {
+		walkPtr->reps = walkPtr->maxReps;
+	    }
+	    if (LaneSend(walkPtr, lanePtr) == TCL_OK) {
+		return;
+	    }
+	}
+	WalkFail(walkPtr, lanePtr, pdu->errorStatus, pdu->errorIndex,
+		 pdu->vbList);
+	goto deliver;
+    case TNM_SNMP_NOSUCHNAME:
+	lanePtr->done = 1;
+	goto deliver;
+    default:
+	WalkFail(walkPtr, lanePtr, pdu->errorStatus, pdu->errorIndex,
+		 pdu->vbList);
+	goto deliver;
+    }
+
+    vblPtr = TnmSnmpGetVarBindListFromObj(NULL, pdu->vbList, pdu->type);
+    if (! vblPtr) {
+	lanePtr->done = 1;
+	goto deliver;
+    }
+    more = LaneRows(walkPtr, lanePtr, vblPtr, &rows);
+    if (more) {
+	WalkAdapt(walkPtr, lanePtr, vblPtr, rows);
+    }
+    TnmSnmpReleaseVarBindList(vblPtr);
+
+    if (more) {
+	if (LaneSend(walkPtr, lanePtr) != TCL_OK) {
+	    WalkFail(walkPtr, lanePtr, TNM_SNMP_GENERR, 0, NULL);
+	} else {
+	    WalkSplit(walkPtr);
+	}
+    }
+
+  deliver:
+    WalkDeliver(walkPtr);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * WalkDeliver --
+ *
+ *	This procedure passes the rows of the first lanes to the
+ *	caller. Completed lanes are removed. The caller is called
+ *	a last time with the status endOfWalk or with the error
+ *	which terminated the walk once all lanes are completed.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	The procedure of the caller is called which can have all
+ *	kind of side effects, including the deletion of the walk.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+WalkDeliver(Walk *walkPtr)
+{
+    TnmSnmp *session = walkPtr->session;
+    TnmSnmpPdu _pdu, *pdu = &_pdu;
+    WalkLane *lanePtr;
+    Tcl_Obj *rowObj;
+
+    /*
+     * Rows delivered by a nested call would overtake the rows
+     * which are being passed on by the outer call.
+     */
+
+    if (walkPtr->busy) {
+	return;
+    }
+
+    Tcl_Preserve((ClientData) walkPtr);
+    walkPtr->busy = 1;
+
+    memset((char *) pdu, 0, sizeof(TnmSnmpPdu));
+    pdu->addr = session->maddr;
+    pdu->type = ASN1_SNMP_RESPONSE;
+    pdu->requestId = walkPtr->requestId;
+
+    while (! walkPtr->stopped && (lanePtr = walkPtr->laneList)) {
+	rowObj = NULL;
+	Tcl_ListObjIndex(NULL, lanePtr->rowsObj, lanePtr->nextRow, &rowObj);
+	if (rowObj) {
+	    lanePtr->nextRow++;
+	    Tcl_IncrRefCount(rowObj);
+	    pdu->vbList = rowObj;
+	    (walkPtr->proc) (session, pdu, walkPtr->clientData);
+	    pdu->vbList = NULL;
+	    Tcl_DecrRefCount(rowObj);
+	    continue;
+	}
+	if (lanePtr->nextRow) {
+	    Tcl_ListObjReplace(NULL, lanePtr->rowsObj, 0, lanePtr->nextRow,
+			       0, NULL);
+	    lanePtr->nextRow = 0;
+	}
+	if (! lanePtr->done) {
+	    break;
+	}
+	walkPtr->laneList = lanePtr->nextPtr;
+	walkPtr->numLanes--;
+	LaneFree(lanePtr);
+    }
+
+    walkPtr->busy = 0;
+
+    if (walkPtr->stopped) {
+	if (! walkPtr->finished) {
+	    walkPtr->finished = 1;
+	    (walkPtr->proc) (session, NULL, walkPtr->clientData);
+	}
+    } else if (! walkPtr->laneList) {
+	walkPtr->finished = 1;
+	walkPtr->stopped = 1;
+	WalkUnlink(walkPtr);
+	pdu->errorStatus = walkPtr->errorStatus
+	    ? walkPtr->errorStatus : TNM_SNMP_ENDOFWALK;
+	pdu->errorIndex = walkPtr->errorIndex;
+	pdu->vbList = walkPtr->errorVbList;
+	(walkPtr->proc) (session, pdu, walkPtr->clientData);
+    }
+
+    Tcl_Release((ClientData) walkPtr);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * WalkNow --
+ *
+ *	This procedure returns the current time in milliseconds.
+ *
+ * Results:
+ *	The current time.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static Tcl_WideInt
+WalkNow(void)
+{
+    Tcl_Time now;
+
+    Tcl_GetTime(&now);
+    return (Tcl_WideInt) now.sec * 1000 + now.usec / 1000;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * WalkRecv --
+ *
+ *	This procedure receives a message on the socket used for
+ *	synchronous requests and passes it to the lane which sent the
+ *	request. Messages which do not answer a request in flight are
+ *	discarded. The requests in flight are encoded and sent again
+ *	if a report has changed the engine parameters of the session.
+ *
+ * Results:
+ *	A standard Tcl result.
+ *
+ * Side effects:
+ *	Rows may be passed to the caller and new requests are encoded.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+WalkRecv(Walk *walkPtr)
+{
+    TnmSnmp *session = walkPtr->session;
+    Tcl_Interp *interp = walkPtr->interp;
+    TnmSnmpPdu _pdu, *pdu = &_pdu;
+    u_char packet[TNM_SNMP_MAXSIZE];
+    int code, objc, sends, packetlen = TNM_SNMP_MAXSIZE;
+    int id = 0, status = 0, index = 0;
+    struct sockaddr_in from;
+    WalkLane *lanePtr;
+    Tcl_Obj **objv;
+
+    code = TnmSnmpRecv(interp, packet, &packetlen, &from, TNM_SNMP_SYNC);
+    if (code != TCL_OK) {
+	return TCL_ERROR;
+    }
+
+    code = TnmSnmpDecode(interp, packet, packetlen, &from, session,
+			 &id, &status, &index);
+    if (code == TCL_BREAK) {
+	for (lanePtr = walkPtr->laneList; lanePtr; lanePtr = lanePtr->nextPtr) {
+	    if (! lanePtr->requestId || ! lanePtr->sends
+		|| lanePtr->sends >= 1 + session->retries) {
+		continue;
+	    }
+	    sends = lanePtr->sends;
+	    if (LaneSend(walkPtr, lanePtr) == TCL_OK) {
+		lanePtr->sends = sends;
+		if (LaneTransmit(walkPtr, lanePtr) != TCL_OK) {
+		    return TCL_ERROR;
+		}
+	    }
+	}
+	Tcl_ResetResult(interp);
+	return TCL_OK;
+    }
+
+    for (lanePtr = walkPtr->laneList; lanePtr; lanePtr = lanePtr->nextPtr) {
+	if (lanePtr->requestId && lanePtr->requestId == id
+	    && lanePtr->sends) {
+	    break;
+	}
+    }
+    if (! lanePtr || (code != TCL_OK && code != TCL_ERROR)) {
+	Tcl_ResetResult(interp);
+	return TCL_OK;
+    }
+
+    /*
+     * The varbind list of a response is left in the interpreter.
+     * The error message of an error response starts with the error
+     * status and the error index, followed by the varbinds.
+     */
+
+    memset((char *) pdu, 0, sizeof(TnmSnmpPdu));
+    pdu->addr = from;
+    pdu->type = ASN1_SNMP_RESPONSE;
+    pdu->requestId = id;
+    if (code == TCL_OK) {
+	TnmSnmpPduSetVarBinds(pdu, Tcl_GetObjResult(interp));
+    } else {
+	pdu->errorStatus = status ? status : TNM_SNMP_GENERR;
+	pdu->errorIndex = index;
+	if (Tcl_ListObjGetElements(NULL, Tcl_GetObjResult(interp),
+				   &objc, &objv) == TCL_OK && objc > 2) {
+	    TnmSnmpPduSetVarBinds(pdu, Tcl_NewListObj(objc - 2, objv + 2));
+	}
+    }
+    Tcl_ResetResult(interp);
+
+    LaneProc(session, pdu, (ClientData) lanePtr);
+    TnmSnmpPduSetVarBinds(pdu, NULL);
+    return TCL_OK;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * WalkWait --
+ *
+ *	This procedure sends the encoded requests of a synchronous
+ *	walk and waits until all requests in flight are answered or
+ *	timed out. Only the socket used for synchronous requests is
+ *	serviced, so no other events are processed while we wait.
+ *	Requests encoded while processing the responses are sent by
+ *	the next call, which allows the caller to process the rows
+ *	while no request is in flight.
+ *
+ * Results:
+ *	A standard Tcl result.
+ *
+ * Side effects:
+ *	Packets are sent and rows are passed to the caller.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+WalkWait(Walk *walkPtr)
+{
+    TnmSnmp *session = walkPtr->session;
+    TnmSnmpPdu _pdu, *pdu = &_pdu;
+    WalkLane *lanePtr;
+    Tcl_WideInt now, expire;
+    int code = TCL_OK;
+
+    Tcl_Preserve((ClientData) walkPtr);
+    Tcl_Preserve((ClientData) session);
+
+    for (lanePtr = walkPtr->laneList; lanePtr; lanePtr = lanePtr->nextPtr) {
+	if (lanePtr->requestId && ! lanePtr->sends) {
+	    code = LaneTransmit(walkPtr, lanePtr);
+	    if (code != TCL_OK) {
+		goto done;
+	    }
+	}
+    }
+
+    while (! walkPtr->stopped) {
+	expire = 0;
+	for (lanePtr = walkPtr->laneList; lanePtr; lanePtr = lanePtr->nextPtr) {
+	    if (lanePtr->requestId && lanePtr->sends
+		&& (! expire || lanePtr->expire < expire)) {
+		expire = lanePtr->expire;
+	    }
+	}
+	if (! expire) {
+	    break;
+	}
+
+	now = WalkNow();
+	if (expire > now
+	    && TnmSnmpWait((int) (expire - now), TNM_SNMP_SYNC) > 0) {
+	    code = WalkRecv(walkPtr);
+	    if (code != TCL_OK) {
+		break;
+	    }
+	    continue;
+	}
+
+	/*
+	 * Retransmit the first request which timed out or pass a
+	 * noResponse error to the lane if all retries are used up.
+	 */
+
+	now = WalkNow();
+	for (lanePtr = walkPtr->laneList; lanePtr; lanePtr = lanePtr->nextPtr) {
+	    if (lanePtr->requestId && lanePtr->sends
+		&& lanePtr->expire <= now) {
+		break;
+	    }
+	}
+	if (! lanePtr) {
+	    continue;
+	}
+	if (lanePtr->sends < 1 + session->retries) {
+	    code = LaneTransmit(walkPtr, lanePtr);
+	    if (code != TCL_OK) {
+		break;
+	    }
+	    continue;
+	}
+	memset((char *) pdu, 0, sizeof(TnmSnmpPdu));
+	pdu->requestId = lanePtr->requestId;
+	pdu->errorStatus = TNM_SNMP_NORESPONSE;
+	LaneProc(session, pdu, (ClientData) lanePtr);
+    }
+
+  done:
+    Tcl_Release((ClientData) session);
+    Tcl_Release((ClientData) walkPtr);
+    return code;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * WalkStop --
+ *
+ *	This procedure stops a walk before it is completed. The
+ *	requests of the walk are discarded and the procedure of the
+ *	caller is called with a NULL pdu so that it can release its
+ *	resources.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	The walk is freed eventually.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+WalkStop(Walk *walkPtr)
+{
+    WalkLane *lanePtr;
+
+    for (lanePtr = walkPtr->laneList; lanePtr; lanePtr = lanePtr->nextPtr) {
+	LaneStop(lanePtr);
+    }
+    walkPtr->stopped = 1;
+
+    Tcl_Preserve((ClientData) walkPtr);
+    WalkUnlink(walkPtr);
+    if (! walkPtr->busy && ! walkPtr->finished) {
+	walkPtr->finished = 1;
+	(walkPtr->proc) (walkPtr->session, NULL, walkPtr->clientData);
+    }
+    Tcl_Release((ClientData) walkPtr);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * WalkUnlink --
+ *
+ *	This procedure removes a walk from the list of walks in
+ *	progress and frees it once it is not used anymore.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	The walk is freed eventually.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+WalkUnlink(Walk *walkPtr)
+{
+    Walk **wPtrPtr;
+
+    for (wPtrPtr = &walkList; *wPtrPtr; wPtrPtr = &(*wPtrPtr)->nextPtr) {
+	if (*wPtrPtr == walkPtr) {
+	    *wPtrPtr = walkPtr->nextPtr;
+	    Tcl_EventuallyFree((ClientData) walkPtr, WalkDestroyProc);
+	    break;
+	}
+    }
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * WalkDestroyProc --
+ *
+ *	This procedure is invoked by Tcl_EventuallyFree or Tcl_Release
+ *	to clean up the internal structure of a walk at a safe time.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	Everything associated with the walk is freed up.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+WalkDestroyProc(char *memPtr)
+{
+    Walk *walkPtr = (Walk *) memPtr;
+    WalkLane *lanePtr;
+    int i;
+
+    while ((lanePtr = walkPtr->laneList)) {
+	walkPtr->laneList = lanePtr->nextPtr;
+	LaneFree(lanePtr);
+    }
+    for (i = 0; i < walkPtr->numColumns; i++) {
+	TnmOidFree(walkPtr->columns + i);
+    }
+    ckfree((char *) walkPtr->columns);
+    if (walkPtr->errorVbList) {
+	Tcl_DecrRefCount(walkPtr->errorVbList);
+    }
+    ckfree((char *) walkPtr);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * WalkCreate --
+ *
+ *	This procedure creates a walk of the subtrees given in oidList
+ *	and queues the first request.
+ *
+ * Results:
+ *	A standard Tcl result. The request id of the first request
+ *	is left in the interpreter.
+ *
+ * Side effects:
+ *	Requests are queued.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+WalkCreate(Tcl_Interp *interp, TnmSnmp *session, Tcl_Obj *oidList, int table, int flags, TnmSnmpRequestProc *proc, ClientData clientData)
+{
+    Walk *walkPtr;
+    WalkLane *lanePtr;
+    Tcl_Obj **objv;
+    int i, objc;
+
+    if (Tcl_ListObjGetElements(interp, oidList, &objc, &objv) != TCL_OK) {
+	return TCL_ERROR;
+    }
+    for (i = 0; i < objc; i++) {
+	if (! TnmGetOidFromObj(interp, objv[i])) {
+	    return TCL_ERROR;
+	}
+    }
+    if (objc == 0) {
+	Tcl_SetResult(interp, "empty object identifier list", TCL_STATIC);
+	return TCL_ERROR;
+    }
+
+    walkPtr = (Walk *) ckalloc(sizeof(Walk));
+    memset((char *) walkPtr, 0, sizeof(Walk));
+    walkPtr->session = session;
+    walkPtr->interp = interp;
+    walkPtr->proc = proc;
+    walkPtr->clientData = clientData;
+    walkPtr->table = table;
+    walkPtr->sync = (flags & TNM_SNMP_SYNC) ? 1 : 0;
+    walkPtr->numColumns = objc;
+    walkPtr->columns = (TnmOid *) ckalloc(objc * sizeof(TnmOid));
+    for (i = 0; i < objc; i++) {
+	TnmOidInit(walkPtr->columns + i);
+	TnmOidCopy(walkPtr->columns + i, TnmGetOidFromObj(NULL, objv[i]));
+    }
+    walkPtr->reps = WALK_REPS;
+    walkPtr->maxReps = WALK_MAX_REPS;
+    walkPtr->maxLanes = WALK_LANES;
+    if (session->window > 0 && session->window < walkPtr->maxLanes) {
+	walkPtr->maxLanes = session->window;
+    }
+
+    lanePtr = LaneCreate(walkPtr, NULL, 0);
+    if (! lanePtr || LaneSend(walkPtr, lanePtr) != TCL_OK) {
+	if (lanePtr) {
+	    LaneFree(lanePtr);
+	}
+	WalkDestroyProc((char *) walkPtr);
+	return TCL_ERROR;
+    }
+    walkPtr->laneList = lanePtr;
+    walkPtr->numLanes = 1;
+    walkPtr->requestId = lanePtr->requestId;
+    walkPtr->nextPtr = walkList;
+    walkList = walkPtr;
+    Tcl_SetObjResult(interp, Tcl_NewIntObj(walkPtr->requestId));
+    return TCL_OK;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * TnmSnmpWalk --
+ *
+ *	This procedure starts a walk of the subtrees given in oidList.
+ *	The procedure proc is called for every row with a pdu which
+ *	contains the row in its varbind list. It is called a last
+ *	time with the error status endOfWalk or with the error which
+ *	terminated the walk. It is called with a NULL pdu if the walk
+ *	is stopped by TnmSnmpWalkAbort() or TnmSnmpWalkCancel(). The
+ *	requests of a walk started with the TNM_SNMP_SYNC flag are
+ *	only sent by TnmSnmpWalkWait().
+ *
+ * Results:
+ *	A standard Tcl result. The request id of the first request
+ *	is left in the interpreter.
+ *
+ * Side effects:
+ *	Requests are queued.
+ *
+ *----------------------------------------------------------------------
+ */
+
+int
+TnmSnmpWalk(Tcl_Interp *interp, TnmSnmp *session, Tcl_Obj *oidList, int flags, TnmSnmpRequestProc *proc, ClientData clientData)
+{
+    return WalkCreate(interp, session, oidList, 0, flags, proc, clientData);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * TnmSnmpWalkTable --
+ *
+ *	This procedure starts a walk of the table columns given in
+ *	oidList. It works like TnmSnmpWalk() except that the walk
+ *	continues until all columns are exhausted. Cells which do not
+ *	belong to their column carry the endOfMibView exception in
+ *	the rows passed to proc. The cells of a column are passed in
+ *	lexicographic order, but a row may contain cells of different
+ *	instances if the table has missing cells.
+ *
+ * Results:
+ *	A standard Tcl result. The request id of the first request
+ *	is left in the interpreter.
+ *
+ * Side effects:
+ *	Requests are queued.
+ *
+ *----------------------------------------------------------------------
+ */
+
+int
+TnmSnmpWalkTable(Tcl_Interp *interp, TnmSnmp *session, Tcl_Obj *oidList, int flags, TnmSnmpRequestProc *proc, ClientData clientData)
+{
+    return WalkCreate(interp, session, oidList, 1, flags, proc, clientData);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * TnmSnmpWalkWait --
+ *
+ *	This procedure sends the pending requests of the synchronous
+ *	walk of a session which has been started with the given
+ *	clientData and waits for the responses (see WalkWait()).
+ *
+ * Results:
+ *	A standard Tcl result.
+ *
+ * Side effects:
+ *	The procedure of the walk is called for the rows received.
+ *
+ *----------------------------------------------------------------------
+ */
+
+int
+TnmSnmpWalkWait(TnmSnmp *session, ClientData clientData)
+{
+    Walk *walkPtr;
+
+    for (walkPtr = walkList; walkPtr; walkPtr = walkPtr->nextPtr) {
+	if (walkPtr->session == session && walkPtr->clientData == clientData
+	    && walkPtr->sync) {
+	    return WalkWait(walkPtr);
+	}
+    }
+    return TCL_OK;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * TnmSnmpWalkAbort --
+ *
+ *	This procedure stops the walk of a session which has been
+ *	started with the given clientData.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	The requests of the walk are discarded.
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+TnmSnmpWalkAbort(TnmSnmp *session, ClientData clientData)
+{
+    Walk *walkPtr;
+
+    for (walkPtr = walkList; walkPtr; walkPtr = walkPtr->nextPtr) {
+	if (walkPtr->session == session && walkPtr->clientData == clientData) {
+	    WalkStop(walkPtr);
+	    break;
+	}
+    }
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * TnmSnmpWalkCancel --
+ *
+ *	This procedure stops all walks of a session. It is called
+ *	when a session is deleted.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	The walks of the session are freed eventually.
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+TnmSnmpWalkCancel(TnmSnmp *session)
+{
+    Walk *walkPtr, *nextPtr;
+
+    for (walkPtr = walkList; walkPtr; walkPtr = nextPtr) {
+	nextPtr = walkPtr->nextPtr;
+	if (walkPtr->session == session) {
+	    WalkStop(walkPtr);
+	}
+    }
+}